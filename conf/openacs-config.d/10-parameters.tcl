@@ -119,6 +119,13 @@ ns_section ns/parameters {
     # and system log).
     ns_param asynclogwriter true          ;# default: false
 
+    # Queue system log lines in per-thread buffers, written in batches
+    # by a dedicated log writer thread. When a buffer is full, the
+    # logging thread waits ("block") or the line is discarded ("drop").
+    # ns_param logwriter           true     ;# default: false
+    # ns_param logwriterbuffersize 64KB     ;# default: 64KB; per-thread buffer size
+    # ns_param logwriterpolicy     drop     ;# default: block
+
     # Print durations of long mutex calls to stderr for debugging.
     # ns_param mutexlocktrace  true         ;# default: false
 
@@ -191,8 +198,24 @@ ns_section ns/parameters {
     # ns_param dnscache        false       ;# default: true; enable DNS result caching
     # ns_param dnswaittimeout  5s          ;# default: 5s; timeout for DNS replies
     # ns_param dnscachetimeout 60m         ;# default: 60m (1h); time to keep entries in cache
+    # ns_param dnscachenegativetimeout 10s ;# default: 10s; time to keep failed lookups in cache
+    # ns_param dnsprefetchtime 1m          ;# default: 1m; refresh reused entries expiring within this time
+    # ns_param dnsresolverthreads 4       ;# default: 4; max threads performing DNS lookups
     # ns_param dnscachemaxsize 500KB       ;# max in-memory size of DNS cache; default: 500KB
 
+    #
+    # Reactor threads for socket callbacks (e.g. ns_connchan callback
+    # used by WebSockets). Sockets are distributed over these threads.
+    #
+    # ns_param sockcallbackthreads 1     ;# default: 1
+
+    #
+    # TLS session cache for outgoing connections (ns_http, ns_connchan)
+    #
+    # ns_param tlsclientsessioncache        true  ;# default: true; resume TLS sessions on reconnect
+    # ns_param tlsclientsessioncachetimeout 5m    ;# default: 5m; time to keep sessions in cache
+    # ns_param tlsclientsessioncachemaxsize 200KB ;# default: 200KB; max in-memory size of session cache
+
     ns_param reverseproxymode $reverseproxymode
 }
 
@@ -231,6 +231,13 @@ if {[info exists httpsport] && $httpsport ne ""} {
         # Enabled/disabled protocol versions.
         ns_param protocols          "!SSLv2:!SSLv3:!TLSv1.0:!TLSv1.1"
 
+        # Session ticket keys shared between several instances (e.g.,
+        # behind a load balancer) and across restarts. The file contains
+        # one key per line ("openssl rand -hex 80"), newest first; it is
+        # reloaded periodically to pick up rotated keys.
+        # ns_param ticketkeyfile      $serverroot/etc/ticketkeys
+        # ns_param ticketkeyinterval  1h   ;# default: 1h; reload interval
+
         # OCSP stapling configuration:
         # ns_param OCSPstapling        on   ;# default: off; enable OCSP stapling
         # ns_param OCSPstaplingVerbose on   ;# default: off; more verbose OCSP logging
@@ -14,6 +14,18 @@ ns_section ns/server/$server/module/nslog {
     # ns_param maxbuffer 100   ;# default: 0; number of log entries buffered
                                ;# in memory before being flushed to disk
 
+    # Write entries as one JSON object per line (newline-delimited JSON)
+    # instead of the common log format, and maintain a binary time index
+    # (access.log.idx) for fast seeks by timestamp.
+    # ns_param format        json    ;# default: clf; clf or json
+    # ns_param indexinterval 1m      ;# default: 0s (no index)
+
+    # Per-URL log policies "METHOD URL POLICY ?VALUE?" to reduce the
+    # logging volume of high-traffic URLs. POLICY is one of all, none,
+    # errors, "sample N" (log 1 in N, entries carry weight=N) or "slow TIME".
+    # ns_param policy {GET /resources/* sample 100}
+    # ns_param policy {GET /healthcheck errors}
+
     #------------------------------------------------------------------
     # Control what to log
     #------------------------------------------------------------------
@@ -11,4 +11,6 @@ ns_section ns/server/$server/module/nsproxy {
     # ns_param	waittimeout       100ms ;# default: 1s
     # ns_param	idletimeout       5m    ;# default: 5m
     # ns_param	logminduration    1s    ;# default: 1s
+    # ns_param	minworker         0     ;# default: 0
+    # ns_param	prespawn          false ;# default: false
 }
@@ -358,6 +358,13 @@ ns_section ns/parameters {
     # and system log).
     ns_param asynclogwriter true          ;# default: false
 
+    # Queue system log lines in per-thread buffers, written in batches
+    # by a dedicated log writer thread. When a buffer is full, the
+    # logging thread waits ("block") or the line is discarded ("drop").
+    # ns_param logwriter           true     ;# default: false
+    # ns_param logwriterbuffersize 64KB     ;# default: 64KB; per-thread buffer size
+    # ns_param logwriterpolicy     drop     ;# default: block
+
     # Print durations of long mutex calls to stderr for debugging.
     # ns_param mutexlocktrace  true         ;# default: false
 
@@ -430,8 +437,24 @@ ns_section ns/parameters {
     # ns_param dnscache        false       ;# default: true; enable DNS result caching
     # ns_param dnswaittimeout  5s          ;# default: 5s; timeout for DNS replies
     # ns_param dnscachetimeout 60m         ;# default: 60m (1h); time to keep entries in cache
+    # ns_param dnscachenegativetimeout 10s ;# default: 10s; time to keep failed lookups in cache
+    # ns_param dnsprefetchtime 1m          ;# default: 1m; refresh reused entries expiring within this time
+    # ns_param dnsresolverthreads 4       ;# default: 4; max threads performing DNS lookups
     # ns_param dnscachemaxsize 500KB       ;# max in-memory size of DNS cache; default: 500KB
 
+    #
+    # Reactor threads for socket callbacks (e.g. ns_connchan callback
+    # used by WebSockets). Sockets are distributed over these threads.
+    #
+    # ns_param sockcallbackthreads 1     ;# default: 1
+
+    #
+    # TLS session cache for outgoing connections (ns_http, ns_connchan)
+    #
+    # ns_param tlsclientsessioncache        true  ;# default: true; resume TLS sessions on reconnect
+    # ns_param tlsclientsessioncachetimeout 5m    ;# default: 5m; time to keep sessions in cache
+    # ns_param tlsclientsessioncachemaxsize 200KB ;# default: 200KB; max in-memory size of session cache
+
     ns_param reverseproxymode $reverseproxymode
 }
 
@@ -707,6 +730,13 @@ if {[info exists httpsport] && $httpsport ne ""} {
         # Enabled/disabled protocol versions.
         ns_param protocols          "!SSLv2:!SSLv3:!TLSv1.0:!TLSv1.1"
 
+        # Session ticket keys shared between several instances (e.g.,
+        # behind a load balancer) and across restarts. The file contains
+        # one key per line ("openssl rand -hex 80"), newest first; it is
+        # reloaded periodically to pick up rotated keys.
+        # ns_param ticketkeyfile      $serverroot/etc/ticketkeys
+        # ns_param ticketkeyinterval  1h   ;# default: 1h; reload interval
+
         # OCSP stapling configuration:
         # ns_param OCSPstapling        on   ;# default: off; enable OCSP stapling
         # ns_param OCSPstaplingVerbose on   ;# default: off; more verbose OCSP logging
@@ -1504,6 +1534,18 @@ ns_section ns/server/$server/module/nslog {
     # ns_param maxbuffer 100   ;# default: 0; number of log entries buffered
                                ;# in memory before being flushed to disk
 
+    # Write entries as one JSON object per line (newline-delimited JSON)
+    # instead of the common log format, and maintain a binary time index
+    # (access.log.idx) for fast seeks by timestamp.
+    # ns_param format        json    ;# default: clf; clf or json
+    # ns_param indexinterval 1m      ;# default: 0s (no index)
+
+    # Per-URL log policies "METHOD URL POLICY ?VALUE?" to reduce the
+    # logging volume of high-traffic URLs. POLICY is one of all, none,
+    # errors, "sample N" (log 1 in N, entries carry weight=N) or "slow TIME".
+    # ns_param policy {GET /resources/* sample 100}
+    # ns_param policy {GET /healthcheck errors}
+
     #------------------------------------------------------------------
     # Control what to log
     #------------------------------------------------------------------
@@ -1597,6 +1639,8 @@ ns_section ns/server/$server/module/nsproxy {
     # ns_param	waittimeout       100ms ;# default: 1s
     # ns_param	idletimeout       5m    ;# default: 5m
     # ns_param	logminduration    1s    ;# default: 1s
+    # ns_param	minworker         0     ;# default: 0
+    # ns_param	prespawn          false ;# default: false
 }
 
 # source: openacs-config.d/60-server-openacs-module-nsshell.tcl
@@ -628,15 +628,30 @@ set ::ns_configdoc::data {
                 default {500KB}
                 desc {Max in-memory size of DNS cache}
             }
+            dnscachenegativetimeout {
+                type time
+                default {10s}
+                desc {Time to keep failed lookups in the DNS cache; 0 disables negative caching}
+            }
             dnscachetimeout {
                 type time
                 default {60m}
                 desc {Time to keep entries in cache}
             }
+            dnsprefetchtime {
+                type time
+                default {1m}
+                desc {Refresh reused DNS cache entries in the background when they expire within this time; 0 disables prefetching}
+            }
+            dnsresolverthreads {
+                type integer
+                default 4
+                desc {Maximum number of threads performing DNS lookups for the DNS cache}
+            }
             dnswaittimeout {
                 type time
                 default {5s}
-                desc {Timeout for DNS replies}
+                desc {Timeout for DNS replies; the lookup continues in the background and fills the cache}
             }
             home {
                 type path
@@ -749,6 +764,21 @@ set ::ns_configdoc::data {
                 default false
                 desc {Deltas between log entries in microseconds}
             }
+            logwriter {
+                type boolean
+                default false
+                desc {Queue system log lines in per-thread buffers written by a dedicated log writer thread}
+            }
+            logwriterbuffersize {
+                type size
+                default {64KB}
+                desc {Size of the per-thread buffers of the log writer, rounded up to a power of two}
+            }
+            logwriterpolicy {
+                type string
+                default block
+                desc {Behavior when the per-thread buffer of the log writer is full: "block" waits for the log writer, "drop" discards the line}
+            }
             maxconcurrentupdates {
                 type integer
                 default {1000}
@@ -795,6 +825,11 @@ set ::ns_configdoc::data {
                 default {2s}
                 desc {Log scheduled jobs that run longer than this}
             }
+            schedmaxthreads {
+                type integer
+                default 0
+                desc {Maximum number of threads running scheduled procedures registered with the thread option; 0 means no limit}
+            }
             schedsperthread {
                 type integer
                 default 0
@@ -810,6 +845,11 @@ set ::ns_configdoc::data {
                 default {4}
                 desc {Log repeated accepts after this threshold}
             }
+            sockcallbackthreads {
+                type integer
+                default 1
+                desc {Number of reactor threads monitoring sockets with registered socket callbacks (e.g. ns_connchan callback); sockets are distributed over the reactors, which use epoll on Linux and poll otherwise (max 64)}
+            }
             stacksize {
                 type size
                 deprecated {Use ns/threads stacksize instead}
@@ -831,6 +871,21 @@ set ::ns_configdoc::data {
                 default false
                 desc {Serialize Tcl interpreter initialization; usually disabled, but useful when debugging rare initialization crashes or when running under tools such as valgrind}
             }
+            tlsclientsessioncache {
+                type boolean
+                default true
+                desc {Cache TLS sessions of outgoing connections (ns_http, ns_connchan) to allow session resumption on reconnect}
+            }
+            tlsclientsessioncachemaxsize {
+                type size
+                default {200KB}
+                desc {Max in-memory size of the TLS client session cache}
+            }
+            tlsclientsessioncachetimeout {
+                type time
+                default {5m}
+                desc {Time to keep TLS client sessions in cache}
+            }
             tmpdir {
                 type path
                 desc {Directory for temporary files; when unset, NaviServer uses the TMPDIR environment variable or the system default temporary directory, with a trailing slash removed}
@@ -1409,6 +1464,11 @@ set ::ns_configdoc::data {
                 type list
                 desc {URL pattern registered for ADP processing; each entry maps the pattern for GET, HEAD, and POST requests}
             }
+            precompiledcache {
+                type path
+                default {}
+                desc {File for the precompiled ADP pages written by ns_adp_precompile and loaded at startup; relative to the home directory; empty disables the file}
+            }
             safeeval {
                 type boolean
                 default false
@@ -1430,6 +1490,11 @@ stops execution of that ADP page}
                 default false
                 desc {Enable ADP streaming}
             }
+            streamflushsize {
+                type size
+                default {0}
+                desc {Minimum size of the chunks sent in ADP streaming mode; the first output is always flushed immediately, 0 flushes every output}
+            }
             stricterror {
                 type boolean
                 default false
@@ -1603,6 +1668,40 @@ stops execution of that ADP page}
             }
         }
 
+        ns/server/*/respcache {
+            :title {ns/server/$server/respcache}
+            :desc {
+                The ns/server/$server/respcache section configures the shared
+                HTTP response cache of the server. Cacheable responses to GET
+                requests are stored according to their Cache-Control header
+                field and served for subsequent requests after the filters and
+                the authorization were run; URLs registered via
+                "ns_respcache register" are served directly by the driver
+                thread. The cache is disabled unless cachesize is set.
+            }
+            :see {
+                {command ns_respcache}
+            }
+
+            cachesize {
+                type size
+                default {0}
+                desc {Maximum size of the response cache; 0 disables the cache}
+            }
+
+            maxentry {
+                type size
+                default {512kB}
+                desc {Maximum size of a single cached response body; larger responses are not stored}
+            }
+
+            waittimeout {
+                type time
+                default {5s}
+                desc {Maximum time a request for an entry currently being filled waits for the response of the first request before it is processed independently}
+            }
+        }
+
         ns/server/*/tcl {
             :title {ns/server/$server/tcl}
             :desc {
@@ -2381,6 +2480,19 @@ stops execution of that ADP page}
                 default {!SSLv2:!SSLv3:!TLSv1.0:!TLSv1.1}
                 desc {Colon-separated string of TLS/SSL protocol versions to disable for this driver. The traditional nsssl syntax uses exclusions prefixed with "!", for example "!SSLv2:!SSLv3:!TLSv1.0:!TLSv1.1". When omitted, the default disables SSLv2, SSLv3, TLSv1.0, and TLSv1.1. When explicitly set to the empty string, NaviServer applies no protocol restriction and leaves the effective protocol set to OpenSSL and the system crypto policy.}
             }
+            ticketkeyfile {
+                type path
+                desc {File containing TLS session ticket keys, one key per line as 160 hex digits (e.g., generated via "openssl rand -hex 80"), newest key first. The first key is used for issuing tickets, the others are accepted for resumption only. Sharing this file between instances allows session resumption across restarts and load-balanced nodes}
+            }
+            ticketkeyinterval {
+                type time
+                default {1h}
+                desc {Interval for reloading the session ticket keys from ticketkeyfile or ticketkeyscript to pick up rotated keys; 0 disables reloading}
+            }
+            ticketkeyscript {
+                type script
+                desc {Helper script printing the TLS session ticket keys in the format of ticketkeyfile; used when no ticketkeyfile is configured}
+            }
 
             tlskeyscript {
                 type script
@@ -2668,12 +2780,25 @@ stops execution of that ADP page}
                 desc {Access log file written by this nslog instance; relative paths are resolved against the server log directory}
             }
 
+            format {
+                type enum
+                values {clf json}
+                default clf
+                desc {Format of access log entries; clf writes the (combined) common log format, json writes one JSON object per line (newline-delimited JSON) for processing by log analysis tools without re-parsing text}
+            }
+
             formattedtime {
                 type boolean
                 default true
                 desc {Use formatted timestamps instead of Unix time}
             }
 
+            indexinterval {
+                type time
+                default 0s
+                desc {Interval for writing records to a binary time index next to the access log (suffix .idx); every 16-byte record maps a timestamp to the byte offset of the next log entry, allowing fast seeks by time; the index is rolled together with the log file; 0 disables the index}
+            }
+
             logpartialtimes {
                 type boolean
                 default false
@@ -2720,6 +2845,11 @@ stops execution of that ADP page}
                 default 0
                 desc {Number of log entries buffered}
             }
+            policy {
+                type mapping
+                cardinality multimap
+                desc {Per-URL log policy in the form "METHOD URL POLICY ?VALUE?", where POLICY is all, none, errors, sample N (log 1 in N requests, entries carry the sample weight), or slow TIME (log only requests taking at least TIME); may be specified multiple times; policy-noinherit registers the policy only for the exact URL}
+            }
             rollfmt {
                 type string
                 desc {Suffix format used when rotating the access log file; controls how timestamps are appended to rolled log filenames}
@@ -129,6 +129,7 @@ typedef enum {
 #define NS_OP_RECURSE              0x08u /* Also destroy registered procs below given URL */
 #define NS_OP_ALLCONSTRAINTS       0x10u /* Also destroy all filters for this node */
 #define NS_OP_SEGMENT_MATCH        0x20u /* Also destroy all filters for this node */
+#define NS_OP_STREAMBODY           0x40u /* Dispatch request before the body is received */
 
 
 /*
@@ -1389,6 +1390,10 @@ NS_EXTERN size_t
 Ns_ConnRead(const Ns_Conn *conn, void *vbuf, size_t toRead)
     NS_GNUC_NONNULL(1,2);
 
+NS_EXTERN ssize_t
+Ns_ConnReadBody(const Ns_Conn *conn, void *vbuf, size_t toRead, const Ns_Time *timeoutPtr)
+    NS_GNUC_NONNULL(1,2);
+
 NS_EXTERN Ns_ReturnCode
 Ns_ConnReadLine(const Ns_Conn *conn, Tcl_DString *dsPtr, size_t *nreadPtr)
     NS_GNUC_NONNULL(1,2);
@@ -3685,6 +3690,10 @@ Ns_JsonParse(const unsigned char *buf, size_t len,
              Tcl_DString *errDsPtr)
     NS_GNUC_NONNULL(1,3,6,7);
 
+NS_EXTERN void
+Ns_JsonAppendString(Tcl_DString *dsPtr, const char *s, TCL_SIZE_T len)
+    NS_GNUC_NONNULL(1,2);
+
 
 /*
  * tclmisc.c
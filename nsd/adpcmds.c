@@ -38,6 +38,7 @@ static AdpTagSet *AdpTagSetLookupNamed(NsServer *servPtr, const char *name)
     NS_GNUC_NONNULL(1,2);
 
 static TCL_OBJCMDPROC_T AdpCtlBufSizeObjCmd;
+static TCL_OBJCMDPROC_T AdpCtlStreamFlushSizeObjCmd;
 
 
 /*
@@ -46,7 +47,9 @@ static TCL_OBJCMDPROC_T AdpCtlBufSizeObjCmd;
  * Ns_AdpAppend, NsAdpAppend --
  *
  *      Append content to the ADP output buffer, flushing the content
- *      if necessary.
+ *      if necessary. In streaming mode, the first output is flushed
+ *      immediately to send the response headers early, further output
+ *      is flushed in chunks of at least "streamflushsize" bytes.
  *
  * Results:
  *      TCL_ERROR if append and/or flush failed, TCL_OK otherwise.
@@ -89,7 +92,9 @@ NsAdpAppend(NsInterp *itPtr, const char *buf, TCL_SIZE_T len)
     } else {
         Tcl_DStringAppend(bufPtr, buf, len);
         if (
-            ((itPtr->adp.flags & ADP_STREAM) != 0u
+            (((itPtr->adp.flags & ADP_STREAM) != 0u
+              && ((itPtr->adp.flags & ADP_FLUSHED) == 0u
+                  || (size_t)bufPtr->length >= itPtr->adp.streamflushsize))
              || (size_t)bufPtr->length > itPtr->adp.bufsize
              )
             && NsAdpFlush(itPtr, NS_TRUE) != TCL_OK) {
@@ -238,6 +243,50 @@ AdpCtlBufSizeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * AdpCtlStreamFlushSizeObjCmd --
+ *
+ *      Implements the "streamflushsize" subcommand for the ADP control
+ *      command. This command either queries or updates the minimum size
+ *      of the chunks flushed in streaming mode.
+ *
+ * Results:
+ *      A standard Tcl result (TCL_OK or TCL_ERROR). On success, the
+ *      flush size is set as the Tcl command result.
+ *
+ * Side effects:
+ *      May modify the adp.streamflushsize field in the current NsInterp
+ *      structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AdpCtlStreamFlushSizeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int               result = TCL_OK;
+    Tcl_WideInt       size = -1;
+    Ns_ObjvValueRange sizeRange = {0, SSIZE_MAX};
+    Ns_ObjvSpec args[] = {
+        {"?size", Ns_ObjvWideInt,  &size, &sizeRange},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+    } else {
+        NsInterp  *itPtr = clientData;
+
+        if (size > -1) {
+            itPtr->adp.streamflushsize = (size_t)size;
+        }
+        Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)itPtr->adp.streamflushsize));
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -267,8 +316,9 @@ NsTclAdpCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tc
     unsigned int flag;
 
     enum {
-        CBufSizeIdx = ADP_OPTIONMAX + 1u,
-        CChanIdx    = ADP_OPTIONMAX + 2u
+        CBufSizeIdx         = ADP_OPTIONMAX + 1u,
+        CChanIdx            = ADP_OPTIONMAX + 2u,
+        CStreamFlushSizeIdx = ADP_OPTIONMAX + 3u
     };
 
     static const struct {
@@ -285,6 +335,7 @@ NsTclAdpCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tc
         { "safe",         ADP_SAFE },
         { "singlescript", ADP_SINGLE },
         { "stream",       ADP_STREAM },
+        { "streamflushsize", (unsigned)CStreamFlushSizeIdx },
         { "stricterror",  ADP_STRICT },
         { "trace",        ADP_TRACE },
         { "trimspace",    ADP_TRIM },
@@ -309,6 +360,10 @@ NsTclAdpCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tc
             result = AdpCtlBufSizeObjCmd(clientData, interp, objc, objv);
             break;
 
+        case CStreamFlushSizeIdx:
+            result = AdpCtlStreamFlushSizeObjCmd(clientData, interp, objc, objv);
+            break;
+
         case CChanIdx:
             if (objc != 3) {
                 Tcl_WrongNumArgs(interp, 2, objv, "/channel/");
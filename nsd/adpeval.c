@@ -23,6 +23,23 @@
 #define AdpCodeBlocks(cp)   ((cp)->nblocks)
 #define AdpCodeScripts(cp)  ((cp)->nscripts)
 
+/*
+ * Magic string at the begin of a file with precompiled pages. The file is
+ * written in host byte order and is only valid for the machine and build
+ * which wrote it.
+ */
+
+#define PRECOMPILED_MAGIC     "NSADPC1\n"
+#define PRECOMPILED_MAGIC_LEN 8
+#define PRECOMPILED_MAXDEPTH  32
+
+/*
+ * ADP flags influencing the parsing of a page. Precompiled pages are only
+ * used when these flags are the same as for the request.
+ */
+
+#define PRECOMPILED_FLAGS     (ADP_SAFE|ADP_SINGLE|ADP_CACHE|ADP_TCLFILE)
+
 /*
  * The following structure defines a cached ADP page result.  A cached
  * object is created by executing the non-cached code and saving the
@@ -37,8 +54,9 @@ typedef struct AdpCache {
 } AdpCache;
 
 /*
- * The following structure defines a shared page in the ADP cache.  The
- * size of the object is extended to include the filename bytes.
+ * The following structure defines a shared page in the ADP cache. The
+ * parsed code is shared read-only between all interps of the server,
+ * the interps hold only private script objects (see InterpPage).
  */
 
 typedef struct Page {
@@ -52,11 +70,26 @@ typedef struct Page {
     int            refcnt;   /* Refcnt of current interps using page. */
     int            evals;    /* Count of page evaluations. */
     int            cacheGen; /* Cache generation id. */
+    size_t         codeSize; /* Bytes of the shared page structure and code. */
+    size_t         privateSize; /* Bytes of the script objects of all interps. */
     AdpCache      *cachePtr; /* Cached output. */
     AdpCode        code;     /* ADP code blocks. */
     bool           locked;   /* Page locked for cache update. */
 } Page;
 
+/*
+ * The following structure defines a precompiled page, which was parsed in
+ * advance by "ns_adp_precompile" or loaded from the precompiled cache
+ * file. It is turned into a Page on the first request to the file.
+ */
+
+typedef struct PrecompiledPage {
+    time_t         mtime;    /* Modify time of the parsed file. */
+    off_t          size;     /* Size of the parsed file. */
+    unsigned int   flags;    /* Flags used for parsing (PRECOMPILED_FLAGS). */
+    AdpCode        code;     /* ADP code blocks. */
+} PrecompiledPage;
+
 /*
  * The following structure holds per-interp script byte codes.  The
  * size of the object is extended based on the number of script objects.
@@ -64,6 +97,7 @@ typedef struct Page {
 
 typedef struct Objs {
     int      nobjs;         /* Number of scripts objects. */
+    size_t   size;          /* Bytes of this structure and the script strings. */
     Tcl_Obj *objs[1];       /* Scripts to be compiled and reused. */
 } Objs;
 
@@ -78,6 +112,7 @@ typedef struct InterpPage {
     Objs     *objs;         /* Non-cache ADP code script. */
     int       cacheGen;     /* Cache generation id. */
     Objs     *cacheObjs;    /* Cache results ADP code scripts. */
+    size_t    privateSize;  /* Bytes accounted in pagePtr->privateSize. */
 } InterpPage;
 
 /*
@@ -87,6 +122,39 @@ typedef struct InterpPage {
 static Page *ParseFile(NsInterp *itPtr, const char *file, struct stat *stPtr, unsigned int flags)
     NS_GNUC_NONNULL(1,2,3);
 
+static Page *NewPage(NsServer *servPtr, const struct stat *stPtr, unsigned int flags)
+    NS_GNUC_NONNULL(1,2) NS_GNUC_RETURNS_NONNULL;
+
+static Page *PrecompiledPageGet(NsInterp *itPtr, const char *key, const struct stat *stPtr)
+    NS_GNUC_NONNULL(1,2,3);
+
+static void PrecompiledPageFree(PrecompiledPage *pcPtr)
+    NS_GNUC_NONNULL(1);
+
+static void PrecompiledTableClear(Tcl_HashTable *tablePtr)
+    NS_GNUC_NONNULL(1);
+
+static size_t CodeTextLength(const AdpCode *codePtr)
+    NS_GNUC_NONNULL(1);
+
+static int PrecompileDirectory(NsInterp *itPtr, const char *dir, const char *pattern,
+                               Tcl_HashTable *tablePtr, int depth)
+    NS_GNUC_NONNULL(1,2,3,4);
+
+static void PutBytes(Tcl_DString *dsPtr, const void *bytes, size_t length)
+    NS_GNUC_NONNULL(1,2);
+
+static bool GetBytes(const char **bufPtr, const char *end, void *dest, size_t length)
+    NS_GNUC_NONNULL(1,2,3);
+
+static Ns_ReturnCode PrecompiledWrite(const char *file, const char *signature,
+                                      Tcl_HashTable *tablePtr)
+    NS_GNUC_NONNULL(1,2,3);
+
+static Ns_ReturnCode PrecompiledLoad(const char *file, Tcl_DString *signaturePtr,
+                                     Tcl_HashTable *tablePtr)
+    NS_GNUC_NONNULL(1,2,3);
+
 static int AdpEval(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *resvar)
     NS_GNUC_NONNULL(1);
 
@@ -113,6 +181,9 @@ static void FreeObjs(Objs *objsPtr)
 static void AdpTrace(const NsInterp *itPtr, const char *ptr, TCL_SIZE_T len)
     NS_GNUC_NONNULL(1,2);
 
+static void UpdatePrivateSize(NsServer *servPtr, InterpPage *ipagePtr)
+    NS_GNUC_NONNULL(1,2);
+
 static const char *AdpEffectiveTagSetName(const NsInterp *itPtr)
     NS_GNUC_NONNULL(1);
 
@@ -155,6 +226,7 @@ ConfigServerAdp(const char *server)
      */
 
     Tcl_InitHashTable(&servPtr->adp.pages, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&servPtr->adp.precompiled, TCL_STRING_KEYS);
     Tcl_InitHashTable(&servPtr->adp.tags, TCL_STRING_KEYS);
     Tcl_InitHashTable(&servPtr->adp.tagsets, TCL_STRING_KEYS);
 
@@ -178,8 +250,30 @@ ConfigServerAdp(const char *server)
                                                            (Tcl_WideInt)1000 * 1024, INT_MAX);
     servPtr->adp.bufsize   = (size_t)Ns_ConfigMemUnitRange(section, "bufsize",  "1MB",  (Tcl_WideInt)1024 * 1000,
                                                            (Tcl_WideInt)100 * 1024, INT_MAX);
+    servPtr->adp.streamflushsize = (size_t)Ns_ConfigMemUnitRange(section, "streamflushsize", "0", 0,
+                                                                 0, INT_MAX);
     servPtr->adp.defaultExtension = ns_strcopy(Ns_NullIfEmpty(Ns_ConfigString(section, "defaultextension", "")));
 
+    /*
+     * Load the pages precompiled by an earlier "ns_adp_precompile". The
+     * pages are validated against the file and the registered tags, when
+     * they are requested.
+     */
+    if (Ns_NullIfEmpty(Ns_ConfigGetValue(section, "precompiledcache")) != NULL) {
+        Tcl_DString signature;
+
+        servPtr->adp.precompiledcache = Ns_ConfigFilename(section, "precompiledcache", 16,
+                                                          nsconf.home, "", NS_TRUE, NS_FALSE);
+        Tcl_DStringInit(&signature);
+        if (PrecompiledLoad(servPtr->adp.precompiledcache, &signature,
+                            &servPtr->adp.precompiled) == NS_OK) {
+            servPtr->adp.precompiledSignature = Ns_DStringExport(&signature);
+            Ns_Log(Notice, "adp[%s]: loaded %ld precompiled pages from %s",
+                   server, (long)servPtr->adp.precompiled.numEntries, servPtr->adp.precompiledcache);
+        }
+        Tcl_DStringFree(&signature);
+    }
+
     servPtr->adp.flags = 0u;
     (void) Ns_ConfigFlag(section, "cache",        ADP_CACHE,     0, &servPtr->adp.flags);
     (void) Ns_ConfigFlag(section, "stream",       ADP_STREAM,    0, &servPtr->adp.flags);
@@ -392,9 +486,11 @@ NsAdpReset(NsInterp *itPtr)
     itPtr->adp.conn = NULL;
     if (itPtr->servPtr != NULL) {
         itPtr->adp.bufsize = itPtr->servPtr->adp.bufsize;
+        itPtr->adp.streamflushsize = itPtr->servPtr->adp.streamflushsize;
         itPtr->adp.flags = itPtr->servPtr->adp.flags;
     } else {
         itPtr->adp.bufsize = (size_t)1024u * 1000u;
+        itPtr->adp.streamflushsize = 0u;
         itPtr->adp.flags = 0u;
     }
     Tcl_DStringSetLength(&itPtr->adp.output, 0);
@@ -590,7 +686,7 @@ AdpSource(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *fi
             while (isNew == 0 && (pagePtr = Tcl_GetHashValue(hPtr)) == NULL) {
                 /* NB: Wait for other thread to read/parse page. */
                 Ns_CondWait(&servPtr->adp.pagecond, &servPtr->adp.pagelock);
-                hPtr = Tcl_CreateHashEntry(&servPtr->adp.pages, file, &isNew);
+                hPtr = Tcl_CreateHashEntry(&servPtr->adp.pages, cacheKeyString, &isNew);
             }
             if (isNew == 0 && (pagePtr->mtime != st.st_mtime
                          || pagePtr->size != st.st_size
@@ -603,15 +699,19 @@ AdpSource(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *fi
                 isNew = 1;
             }
             if (isNew != 0) {
+                pagePtr = PrecompiledPageGet(itPtr, cacheKeyString, &st);
                 Ns_MutexUnlock(&servPtr->adp.pagelock);
-                Ns_Log(Debug, "AdpSource calls ParseFile with flags %.8x", itPtr->adp.flags);
-                pagePtr = ParseFile(itPtr, file, &st, itPtr->adp.flags);
+                if (pagePtr == NULL) {
+                    Ns_Log(Debug, "AdpSource calls ParseFile with flags %.8x", itPtr->adp.flags);
+                    pagePtr = ParseFile(itPtr, file, &st, itPtr->adp.flags);
+                }
                 Ns_MutexLock(&servPtr->adp.pagelock);
                 if (pagePtr == NULL) {
                     Tcl_DeleteHashEntry(hPtr);
                 } else {
                     pagePtr->hPtr = hPtr;
                     Tcl_SetHashValue(hPtr, pagePtr);
+                    servPtr->adp.stats.sharedSize += pagePtr->codeSize;
                 }
                 Ns_CondBroadcast(&servPtr->adp.pagecond);
             }
@@ -625,6 +725,7 @@ AdpSource(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *fi
                 ipagePtr->cacheGen = 0;
                 ipagePtr->objs = AllocObjs(pagePtr->code.nscripts);
                 ipagePtr->cacheObjs = NULL;
+                ipagePtr->privateSize = 0u;
                 ePtr = Ns_CacheCreateEntry(itPtr->adp.cache, cacheKeyString, &isNew);
                 if (isNew == 0) {
                     Ns_CacheUnsetValue(ePtr);
@@ -750,6 +851,7 @@ AdpSource(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *fi
         result = AdpExec(itPtr, objc, objv, file, codePtr, objsPtr, outputPtr, &st);
         Ns_MutexLock(&servPtr->adp.pagelock);
         ++ipagePtr->pagePtr->evals;
+        UpdatePrivateSize(servPtr, ipagePtr);
         if (cachePtr != NULL) {
             DecrCache(cachePtr);
         }
@@ -861,7 +963,10 @@ NsAdpDebug(NsInterp *itPtr, const char *debugHost, const char *debugPort, const
  * NsTclAdpStatsObjCmd --
  *
  *      Implements "ns_adp_stats". This command returns statistics about
- *      cached ADP pages.
+ *      cached ADP pages. With "-summary", the command returns a dict
+ *      with the number of pages and interp pages, the bytes of the code
+ *      shared between the interps and of the private script objects of
+ *      the interps, and the usage of the precompiled pages.
  *
  * Results:
  *      Standard Tcl result.
@@ -876,9 +981,13 @@ int
 NsTclAdpStatsObjCmd(ClientData clientData, Tcl_Interp *interp,
                     TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
-    int result = TCL_OK;
+    int         result = TCL_OK, summary = (int)NS_FALSE;
+    Ns_ObjvSpec opts[] = {
+        {"-summary", Ns_ObjvBool, &summary, INT2PTR(NS_TRUE)},
+        {NULL, NULL, NULL, NULL}
+    };
 
-    if (Ns_ParseObjv(NULL, NULL, interp, 1, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(opts, NULL, interp, 1, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
     } else {
@@ -887,23 +996,44 @@ NsTclAdpStatsObjCmd(ClientData clientData, Tcl_Interp *interp,
         Tcl_DString     ds;
         Tcl_HashSearch  search;
         Tcl_HashEntry  *hPtr;
+        int             nPages = 0, nInterpPages = 0;
 
         Tcl_DStringInit(&ds);
         Ns_MutexLock(&servPtr->adp.pagelock);
         hPtr = Tcl_FirstHashEntry(&servPtr->adp.pages, &search);
         while (hPtr != NULL) {
             const Page *pagePtr = Tcl_GetHashValue(hPtr);
-            char       *file    = Tcl_GetHashKey(&servPtr->adp.pages, hPtr);
-
-            Ns_DStringPrintf(&ds, "{%s} "
-                             "{dev %" PRIu64 " ino %" PRIu64 " mtime %" PRIu64 " "
-                             "refcnt %d evals %d size %" PROTd" blocks %d scripts %d} ",
-                             file,
-                             (uint64_t) pagePtr->dev, (uint64_t) pagePtr->ino, (uint64_t) pagePtr->mtime,
-                             pagePtr->refcnt, pagePtr->evals, pagePtr->size,
-                             pagePtr->code.nblocks, pagePtr->code.nscripts);
+
+            if (pagePtr == NULL) {
+                /*
+                 * Page is currently parsed.
+                 */
+            } else if (summary != 0) {
+                nPages ++;
+                nInterpPages += pagePtr->refcnt;
+            } else {
+                const char *file = Tcl_GetHashKey(&servPtr->adp.pages, hPtr);
+
+                Ns_DStringPrintf(&ds, "{%s} "
+                                 "{dev %" PRIu64 " ino %" PRIu64 " mtime %" PRIu64 " "
+                                 "refcnt %d evals %d size %" PROTd" blocks %d scripts %d "
+                                 "shared %" PRIuz " private %" PRIuz "} ",
+                                 file,
+                                 (uint64_t) pagePtr->dev, (uint64_t) pagePtr->ino, (uint64_t) pagePtr->mtime,
+                                 pagePtr->refcnt, pagePtr->evals, pagePtr->size,
+                                 pagePtr->code.nblocks, pagePtr->code.nscripts,
+                                 pagePtr->codeSize, pagePtr->privateSize);
+            }
             hPtr = Tcl_NextHashEntry(&search);
         }
+        if (summary != 0) {
+            Ns_DStringPrintf(&ds, "pages %d interppages %d shared %" PRIuz " private %" PRIuz
+                             " precompiled %ld precompiledhits %lu precompiledmisses %lu",
+                             nPages, nInterpPages,
+                             servPtr->adp.stats.sharedSize, servPtr->adp.stats.privateSize,
+                             (long)servPtr->adp.precompiled.numEntries,
+                             servPtr->adp.stats.precompiledHits, servPtr->adp.stats.precompiledMisses);
+        }
         Ns_MutexUnlock(&servPtr->adp.pagelock);
 
         Tcl_DStringResult(interp, &ds);
@@ -911,6 +1041,99 @@ NsTclAdpStatsObjCmd(ClientData clientData, Tcl_Interp *interp,
     return result;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclAdpPrecompileObjCmd --
+ *
+ *      Implements "ns_adp_precompile". Parses all files matching the
+ *      pattern below the directory (default: the page root of the
+ *      server) and replaces the precompiled pages of the server. When
+ *      "precompiledcache" is configured, the pages are written to this
+ *      file as well, such that these are available after a restart.
+ *
+ * Results:
+ *      Standard Tcl result, the number of precompiled pages.
+ *
+ * Side effects:
+ *      Reads and parses the files, might write the precompiled cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclAdpPrecompileObjCmd(ClientData clientData, Tcl_Interp *interp,
+                         TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int         result = TCL_OK;
+    char       *pattern = (char *)"*.adp", *dir = NULL;
+    Ns_ObjvSpec opts[] = {
+        {"-pattern", Ns_ObjvString, &pattern, NULL},
+        {"--",       Ns_ObjvBreak,  NULL,     NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"?directory", Ns_ObjvString, &dir, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsInterp       *itPtr = clientData;
+        NsServer       *servPtr = itPtr->servPtr;
+        Tcl_DString     ds, signature;
+        Tcl_HashTable   table;
+        const char     *directory = dir;
+        int             count;
+
+        Tcl_DStringInit(&ds);
+        Tcl_DStringInit(&signature);
+        Tcl_InitHashTable(&table, TCL_STRING_KEYS);
+
+        if (directory == NULL) {
+            directory = Ns_PagePath(&ds, servPtr->server, NS_SENTINEL);
+        }
+        count = PrecompileDirectory(itPtr, directory, pattern, &table, 0);
+        NsAdpTagSignature(servPtr, &signature);
+
+        if (servPtr->adp.precompiledcache != NULL
+            && PrecompiledWrite(servPtr->adp.precompiledcache, signature.string, &table) != NS_OK) {
+            Ns_TclPrintfResult(interp, "could not write precompiled pages to \"%s\": %s",
+                               servPtr->adp.precompiledcache, Tcl_PosixError(interp));
+            PrecompiledTableClear(&table);
+            result = TCL_ERROR;
+
+        } else {
+            Tcl_HashSearch  search;
+            Tcl_HashEntry  *hPtr;
+
+            Ns_MutexLock(&servPtr->adp.pagelock);
+            PrecompiledTableClear(&servPtr->adp.precompiled);
+            hPtr = Tcl_FirstHashEntry(&table, &search);
+            while (hPtr != NULL) {
+                int isNew;
+
+                Tcl_SetHashValue(Tcl_CreateHashEntry(&servPtr->adp.precompiled,
+                                                     Tcl_GetHashKey(&table, hPtr), &isNew),
+                                 Tcl_GetHashValue(hPtr));
+                hPtr = Tcl_NextHashEntry(&search);
+            }
+            ns_free(servPtr->adp.precompiledSignature);
+            servPtr->adp.precompiledSignature = Ns_DStringExport(&signature);
+            Ns_MutexUnlock(&servPtr->adp.pagelock);
+
+            Tcl_SetObjResult(interp, Tcl_NewIntObj(count));
+        }
+        Tcl_DeleteHashTable(&table);
+        Tcl_DStringFree(&signature);
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1005,20 +1228,13 @@ ParseFile(NsInterp *itPtr, const char *file, struct stat *stPtr, unsigned int fl
         } else {
             page = Tcl_ExternalToUtfDString(encoding, buf, (TCL_SIZE_T)n, &utf);
         }
-        pagePtr = ns_malloc(sizeof(Page));
-        pagePtr->servPtr = itPtr->servPtr;
-        pagePtr->flags = flags;
-        pagePtr->refcnt = 0;
-        pagePtr->evals = 0;
-        pagePtr->locked = NS_FALSE;
-        pagePtr->cacheGen = 0;
-        pagePtr->cachePtr = NULL;
-        pagePtr->mtime = stPtr->st_mtime;
-        pagePtr->size = stPtr->st_size;
-        pagePtr->dev = stPtr->st_dev;
-        pagePtr->ino = stPtr->st_ino;
+        pagePtr = NewPage(itPtr->servPtr, stPtr, flags);
         Ns_Log(Debug, "ParseFile calls NsAdpParse with flags %.8x", flags);
         NsAdpParse(itPtr, &pagePtr->code, page, flags, file);
+        /*
+         * The text of the code includes the block length and line arrays.
+         */
+        pagePtr->codeSize = sizeof(Page) + (size_t)pagePtr->code.text.length + 1u;
         Tcl_DStringFree(&utf);
     }
 
@@ -1029,6 +1245,573 @@ done:
     return pagePtr;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewPage --
+ *
+ *      Allocate a new shared page for the file with the provided stat
+ *      information. The code of the page is filled in by the caller.
+ *
+ * Results:
+ *      Pointer to new Page structure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Page *
+NewPage(NsServer *servPtr, const struct stat *stPtr, unsigned int flags)
+{
+    Page *pagePtr;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(stPtr != NULL);
+
+    pagePtr = ns_malloc(sizeof(Page));
+    pagePtr->servPtr = servPtr;
+    pagePtr->flags = flags;
+    pagePtr->refcnt = 0;
+    pagePtr->evals = 0;
+    pagePtr->locked = NS_FALSE;
+    pagePtr->cacheGen = 0;
+    pagePtr->cachePtr = NULL;
+    pagePtr->mtime = stPtr->st_mtime;
+    pagePtr->size = stPtr->st_size;
+    pagePtr->dev = stPtr->st_dev;
+    pagePtr->ino = stPtr->st_ino;
+    pagePtr->codeSize = sizeof(Page);
+    pagePtr->privateSize = 0u;
+
+    return pagePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CodeTextLength --
+ *
+ *      Return the length of the text of all blocks of the code, i.e.,
+ *      without the appended length and line arrays.
+ *
+ * Results:
+ *      Number of bytes.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+CodeTextLength(const AdpCode *codePtr)
+{
+    size_t length = 0u;
+    int    i;
+
+    for (i = 0; i < codePtr->nblocks; i++) {
+        TCL_SIZE_T len = AdpCodeLen(codePtr, i);
+
+        length += (size_t)(len < 0 ? -len : len);
+    }
+    return length;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrecompiledPageGet --
+ *
+ *      Lookup a precompiled page for the file. The precompiled page is
+ *      only used when it was parsed from a file with the same mtime and
+ *      size, with the same parse flags and with the currently registered
+ *      tags.
+ *      Every precompiled page is used at most once, since afterwards the
+ *      page is kept in the table of the shared pages. Must be called
+ *      with the pagelock held.
+ *
+ * Results:
+ *      Pointer to new Page structure or NULL, when there is no valid
+ *      precompiled page.
+ *
+ * Side effects:
+ *      Removes the precompiled page from the precompiled pages and
+ *      updates the statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Page *
+PrecompiledPageGet(NsInterp *itPtr, const char *key, const struct stat *stPtr)
+{
+    NsServer      *servPtr;
+    Page          *pagePtr = NULL;
+    Tcl_HashEntry *hPtr = NULL;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(stPtr != NULL);
+
+    servPtr = itPtr->servPtr;
+    if (servPtr->adp.precompiledSignature == NULL) {
+        /*
+         * No precompiled pages are available.
+         */
+        return NULL;
+    }
+
+    /*
+     * Pages were precompiled with the default tag set only.
+     */
+    if (itPtr->adp.effectiveTagSetPtr == NULL) {
+        hPtr = Tcl_FindHashEntry(&servPtr->adp.precompiled, key);
+    }
+    if (hPtr != NULL) {
+        PrecompiledPage *pcPtr = Tcl_GetHashValue(hPtr);
+
+        Tcl_DeleteHashEntry(hPtr);
+        if (pcPtr->mtime == stPtr->st_mtime
+            && pcPtr->size == stPtr->st_size
+            && pcPtr->flags == (itPtr->adp.flags & PRECOMPILED_FLAGS)) {
+            Tcl_DString signature;
+
+            Tcl_DStringInit(&signature);
+            NsAdpTagSignature(servPtr, &signature);
+            if (STREQ(signature.string, servPtr->adp.precompiledSignature)) {
+                const AdpCode *codePtr = &pcPtr->code;
+
+                pagePtr = NewPage(servPtr, stPtr, itPtr->adp.flags);
+                NsAdpRestoreCode(&pagePtr->code, codePtr->nblocks, codePtr->nscripts,
+                                 AdpCodeText(codePtr), CodeTextLength(codePtr),
+                                 codePtr->len, codePtr->line);
+                pagePtr->codeSize = sizeof(Page) + (size_t)pagePtr->code.text.length + 1u;
+            }
+            Tcl_DStringFree(&signature);
+        }
+        PrecompiledPageFree(pcPtr);
+    }
+    if (pagePtr != NULL) {
+        servPtr->adp.stats.precompiledHits++;
+    } else {
+        servPtr->adp.stats.precompiledMisses++;
+        Ns_Log(Debug, "adp: no valid precompiled page for %s", key);
+    }
+
+    return pagePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrecompiledPageFree, PrecompiledTableClear --
+ *
+ *      Free a precompiled page, or all precompiled pages of a table.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The table is empty, but still initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PrecompiledPageFree(PrecompiledPage *pcPtr)
+{
+    NsAdpFreeCode(&pcPtr->code);
+    ns_free(pcPtr);
+}
+
+static void
+PrecompiledTableClear(Tcl_HashTable *tablePtr)
+{
+    Tcl_HashSearch  search;
+    Tcl_HashEntry  *hPtr;
+
+    hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+    while (hPtr != NULL) {
+        PrecompiledPageFree(Tcl_GetHashValue(hPtr));
+        Tcl_DeleteHashEntry(hPtr);
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrecompileDirectory --
+ *
+ *      Parse all files matching the pattern in the directory and its
+ *      subdirectories and add these as precompiled pages to the table.
+ *      The keys are the normalized file names, as used for the shared
+ *      pages. Files which cannot be parsed are skipped with a warning.
+ *
+ * Results:
+ *      Number of precompiled files.
+ *
+ * Side effects:
+ *      Reads and parses the files.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+PrecompileDirectory(NsInterp *itPtr, const char *dir, const char *pattern,
+                    Tcl_HashTable *tablePtr, int depth)
+{
+    DIR           *dp;
+    struct dirent *de;
+    Tcl_DString    path, normalized;
+    int            count = 0;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(dir != NULL);
+    NS_NONNULL_ASSERT(pattern != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    if (depth > PRECOMPILED_MAXDEPTH) {
+        Ns_Log(Warning, "ns_adp_precompile: directory nesting too deep: %s", dir);
+        return 0;
+    }
+    dp = opendir(dir);
+    if (dp == NULL) {
+        Ns_Log(Warning, "ns_adp_precompile: cannot open directory '%s': %s",
+               dir, strerror(errno));
+        return 0;
+    }
+
+    Tcl_DStringInit(&path);
+    Tcl_DStringInit(&normalized);
+    while ((de = readdir(dp)) != NULL) {
+        const char  *fn = de->d_name;
+        struct stat  st;
+
+        if (fn[0] == '.' && (fn[1] == '\0' || (fn[1] == '.' && fn[2] == '\0'))) {
+            continue;
+        }
+        Tcl_DStringSetLength(&path, 0);
+        (void) Ns_MakePath(&path, dir, fn, NS_SENTINEL);
+        if (stat(path.string, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            count += PrecompileDirectory(itPtr, path.string, pattern, tablePtr, depth + 1);
+
+        } else if (S_ISREG(st.st_mode) && Tcl_StringMatch(fn, pattern) != 0) {
+            const char *file;
+            Page       *pagePtr;
+
+            Tcl_DStringSetLength(&normalized, 0);
+            file = Ns_NormalizePath(&normalized, path.string);
+            pagePtr = ParseFile(itPtr, file, &st, itPtr->adp.flags);
+            if (pagePtr == NULL) {
+                Ns_Log(Warning, "ns_adp_precompile: %s",
+                       Tcl_GetString(Tcl_GetObjResult(itPtr->interp)));
+                Tcl_ResetResult(itPtr->interp);
+
+            } else {
+                PrecompiledPage *pcPtr;
+                const AdpCode   *codePtr = &pagePtr->code;
+                Tcl_HashEntry   *hPtr;
+                int              isNew;
+
+                pcPtr = ns_malloc(sizeof(PrecompiledPage));
+                pcPtr->mtime = pagePtr->mtime;
+                pcPtr->size = pagePtr->size;
+                pcPtr->flags = pagePtr->flags & PRECOMPILED_FLAGS;
+                NsAdpRestoreCode(&pcPtr->code, codePtr->nblocks, codePtr->nscripts,
+                                 AdpCodeText(codePtr), CodeTextLength(codePtr),
+                                 codePtr->len, codePtr->line);
+                NsAdpFreeCode(&pagePtr->code);
+                ns_free(pagePtr);
+
+                hPtr = Tcl_CreateHashEntry(tablePtr, file, &isNew);
+                if (isNew == 0) {
+                    PrecompiledPageFree(Tcl_GetHashValue(hPtr));
+                }
+                Tcl_SetHashValue(hPtr, pcPtr);
+                count++;
+            }
+        }
+    }
+    (void) closedir(dp);
+    Tcl_DStringFree(&path);
+    Tcl_DStringFree(&normalized);
+
+    return count;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrecompiledWrite --
+ *
+ *      Write the precompiled pages of the table together with the tag
+ *      signature to the file. The content is first written to a
+ *      temporary file, which is renamed afterwards, such that a server
+ *      starting concurrently never reads a partial file.
+ *
+ *      The file starts with the magic string and the signature followed
+ *      by a newline. For every page it contains the length of the key,
+ *      the key, mtime, size, flags, the number of blocks and scripts,
+ *      the length and line arrays of the blocks, and the length of the
+ *      text followed by the text.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, errno is set on failure.
+ *
+ * Side effects:
+ *      Replaces the file.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PutBytes(Tcl_DString *dsPtr, const void *bytes, size_t length)
+{
+    (void) Tcl_DStringAppend(dsPtr, bytes, (TCL_SIZE_T)length);
+}
+
+static Ns_ReturnCode
+PrecompiledWrite(const char *file, const char *signature, Tcl_HashTable *tablePtr)
+{
+    Tcl_DString     ds, tmpFile;
+    Tcl_HashSearch  search;
+    Tcl_HashEntry  *hPtr;
+    Ns_ReturnCode   status = NS_OK;
+    int             fd;
+
+    NS_NONNULL_ASSERT(file != NULL);
+    NS_NONNULL_ASSERT(signature != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    PutBytes(&ds, PRECOMPILED_MAGIC, PRECOMPILED_MAGIC_LEN);
+    Ns_DStringPrintf(&ds, "%s\n", signature);
+
+    hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+    while (hPtr != NULL) {
+        const char            *key = Tcl_GetHashKey(tablePtr, hPtr);
+        const PrecompiledPage *pcPtr = Tcl_GetHashValue(hPtr);
+        const AdpCode         *codePtr = &pcPtr->code;
+        uint32_t               keyLength = (uint32_t)strlen(key), flags = pcPtr->flags;
+        int64_t                mtime = (int64_t)pcPtr->mtime, size = (int64_t)pcPtr->size;
+        int32_t                nblocks = codePtr->nblocks, nscripts = codePtr->nscripts;
+        uint64_t               textLength = (uint64_t)CodeTextLength(codePtr);
+        int                    i;
+
+        PutBytes(&ds, &keyLength, sizeof(keyLength));
+        PutBytes(&ds, key, keyLength);
+        PutBytes(&ds, &mtime, sizeof(mtime));
+        PutBytes(&ds, &size, sizeof(size));
+        PutBytes(&ds, &flags, sizeof(flags));
+        PutBytes(&ds, &nblocks, sizeof(nblocks));
+        PutBytes(&ds, &nscripts, sizeof(nscripts));
+        for (i = 0; i < nblocks; i++) {
+            int64_t len = (int64_t)AdpCodeLen(codePtr, i);
+
+            PutBytes(&ds, &len, sizeof(len));
+        }
+        for (i = 0; i < nblocks; i++) {
+            int32_t line = AdpCodeLine(codePtr, i);
+
+            PutBytes(&ds, &line, sizeof(line));
+        }
+        PutBytes(&ds, &textLength, sizeof(textLength));
+        PutBytes(&ds, AdpCodeText(codePtr), (size_t)textLength);
+
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+
+    Tcl_DStringInit(&tmpFile);
+    Ns_DStringPrintf(&tmpFile, "%s.tmp", file);
+    fd = ns_open(tmpFile.string, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        status = NS_ERROR;
+    } else {
+        ssize_t written = ns_write(fd, ds.string, (size_t)ds.length);
+
+        if (ns_close(fd) != 0 || written != (ssize_t)ds.length) {
+            if (written >= 0) {
+                errno = EIO;
+            }
+            status = NS_ERROR;
+        } else if (rename(tmpFile.string, file) != 0) {
+            status = NS_ERROR;
+        }
+        if (status != NS_OK) {
+            int savedErrno = errno;
+
+            (void) unlink(tmpFile.string);
+            errno = savedErrno;
+        }
+    }
+    Tcl_DStringFree(&tmpFile);
+    Tcl_DStringFree(&ds);
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PrecompiledLoad --
+ *
+ *      Load the precompiled pages written by PrecompiledWrite() into the
+ *      table. All values are checked against the size of the file, and
+ *      the file is discarded completely when it is not consistent.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Fills the table and appends the tag signature of the pages to
+ *      signaturePtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+GetBytes(const char **bufPtr, const char *end, void *dest, size_t length)
+{
+    bool success = ((size_t)(end - *bufPtr) >= length);
+
+    if (success) {
+        memcpy(dest, *bufPtr, length);
+        *bufPtr += length;
+    }
+    return success;
+}
+
+static Ns_ReturnCode
+PrecompiledLoad(const char *file, Tcl_DString *signaturePtr, Tcl_HashTable *tablePtr)
+{
+    Ns_ReturnCode  status = NS_ERROR;
+    struct stat    st;
+    char          *buf = NULL;
+    const char    *p, *end, *nl;
+    TCL_SIZE_T    *lens = NULL;
+    int           *lines = NULL;
+    int            fd;
+
+    NS_NONNULL_ASSERT(file != NULL);
+    NS_NONNULL_ASSERT(signaturePtr != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    fd = ns_open(file, O_RDONLY | O_BINARY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        Ns_Log(Notice, "adp: no precompiled pages in '%s': %s", file, strerror(errno));
+        return NS_ERROR;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < PRECOMPILED_MAGIC_LEN) {
+        goto invalid;
+    }
+    buf = ns_malloc((size_t)st.st_size);
+    if (ns_read(fd, buf, (size_t)st.st_size) != (ssize_t)st.st_size) {
+        goto invalid;
+    }
+    p = buf;
+    end = buf + st.st_size;
+    if (memcmp(p, PRECOMPILED_MAGIC, PRECOMPILED_MAGIC_LEN) != 0) {
+        goto invalid;
+    }
+    p += PRECOMPILED_MAGIC_LEN;
+    nl = memchr(p, INTCHAR('\n'), (size_t)(end - p));
+    if (nl == NULL) {
+        goto invalid;
+    }
+    Tcl_DStringAppend(signaturePtr, p, (TCL_SIZE_T)(nl - p));
+    p = nl + 1;
+
+    while (p < end) {
+        Tcl_DString      key;
+        PrecompiledPage *pcPtr;
+        Tcl_HashEntry   *hPtr;
+        uint32_t         keyLength, flags;
+        int64_t          mtime, size;
+        int32_t          nblocks, nscripts;
+        uint64_t         textLength, sum = 0u;
+        int              i, isNew;
+
+        if (!GetBytes(&p, end, &keyLength, sizeof(keyLength))
+            || (size_t)(end - p) < keyLength) {
+            goto invalid;
+        }
+        Tcl_DStringInit(&key);
+        Tcl_DStringAppend(&key, p, (TCL_SIZE_T)keyLength);
+        p += keyLength;
+        if (!GetBytes(&p, end, &mtime, sizeof(mtime))
+            || !GetBytes(&p, end, &size, sizeof(size))
+            || !GetBytes(&p, end, &flags, sizeof(flags))
+            || !GetBytes(&p, end, &nblocks, sizeof(nblocks))
+            || !GetBytes(&p, end, &nscripts, sizeof(nscripts))
+            || nblocks < 0 || nscripts < 0 || nscripts > nblocks
+            || (size_t)(end - p) / (sizeof(int64_t) + sizeof(int32_t)) < (size_t)nblocks) {
+            Tcl_DStringFree(&key);
+            goto invalid;
+        }
+        lens = ns_realloc(lens, ((size_t)nblocks + 1u) * sizeof(TCL_SIZE_T));
+        lines = ns_realloc(lines, ((size_t)nblocks + 1u) * sizeof(int));
+        for (i = 0; i < nblocks; i++) {
+            int64_t len = 0;
+
+            (void) GetBytes(&p, end, &len, sizeof(len));
+            lens[i] = (TCL_SIZE_T)len;
+            sum += (uint64_t)(len < 0 ? -len : len);
+        }
+        for (i = 0; i < nblocks; i++) {
+            int32_t line = 0;
+
+            (void) GetBytes(&p, end, &line, sizeof(line));
+            lines[i] = line;
+        }
+        if (!GetBytes(&p, end, &textLength, sizeof(textLength))
+            || textLength != sum
+            || (uint64_t)(end - p) < textLength) {
+            Tcl_DStringFree(&key);
+            goto invalid;
+        }
+
+        pcPtr = ns_malloc(sizeof(PrecompiledPage));
+        pcPtr->mtime = (time_t)mtime;
+        pcPtr->size = (off_t)size;
+        pcPtr->flags = flags;
+        NsAdpRestoreCode(&pcPtr->code, nblocks, nscripts, p, (size_t)textLength, lens, lines);
+        p += textLength;
+
+        hPtr = Tcl_CreateHashEntry(tablePtr, key.string, &isNew);
+        if (isNew == 0) {
+            PrecompiledPageFree(Tcl_GetHashValue(hPtr));
+        }
+        Tcl_SetHashValue(hPtr, pcPtr);
+        Tcl_DStringFree(&key);
+    }
+    status = NS_OK;
+
+ invalid:
+    if (status != NS_OK) {
+        Ns_Log(Warning, "adp: ignore invalid precompiled pages in '%s'", file);
+        PrecompiledTableClear(tablePtr);
+        Tcl_DStringSetLength(signaturePtr, 0);
+    }
+    ns_free(lens);
+    ns_free(lines);
+    ns_free(buf);
+    (void) ns_close(fd);
+
+    return status;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1234,6 +2017,7 @@ AdpExec(NsInterp *itPtr, TCL_SIZE_T objc, Tcl_Obj *const* objv, const char *file
                     objPtr = Tcl_NewStringObj(ptr, (TCL_SIZE_T)len);
                     Tcl_IncrRefCount(objPtr);
                     objsPtr->objs[nscript] = objPtr;
+                    objsPtr->size += (size_t)len + 1u;
                 }
                 Ns_Log(Debug, "AdpExec calls Tcl_EvalObjEx with cmd <%s>", Tcl_GetString(objPtr));
                 result = Tcl_EvalObjEx(interp, objPtr, 0);
@@ -1396,15 +2180,20 @@ FreeInterpPage(void *arg)
     NsServer   *servPtr  = pagePtr->servPtr;
 
     FreeObjs(ipagePtr->objs);
+    if (ipagePtr->cacheObjs != NULL) {
+        FreeObjs(ipagePtr->cacheObjs);
+    }
     Ns_MutexLock(&servPtr->adp.pagelock);
+    pagePtr->privateSize -= ipagePtr->privateSize;
+    servPtr->adp.stats.privateSize -= ipagePtr->privateSize;
     if (--pagePtr->refcnt == 0) {
         if (pagePtr->hPtr != NULL) {
             Tcl_DeleteHashEntry(pagePtr->hPtr);
         }
         if (pagePtr->cachePtr != NULL) {
-            FreeObjs(ipagePtr->cacheObjs);
             DecrCache(pagePtr->cachePtr);
         }
+        servPtr->adp.stats.sharedSize -= pagePtr->codeSize;
         NsAdpFreeCode(&pagePtr->code);
         ns_free(pagePtr);
     }
@@ -1436,6 +2225,7 @@ AllocObjs(int nobjs)
 
     objsPtr = ns_calloc(1u, sizeof(Objs) + ((size_t)nobjs * sizeof(Tcl_Obj *)));
     objsPtr->nobjs = nobjs;
+    objsPtr->size = sizeof(Objs) + ((size_t)nobjs * sizeof(Tcl_Obj *));
 
     return objsPtr;
 }
@@ -1501,6 +2291,42 @@ DecrCache(AdpCache *cachePtr)
     }
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpdatePrivateSize --
+ *
+ *      Account the current size of the script objects of an interp page
+ *      in the page and in the server statistics. Must be called with
+ *      the page lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Updates size statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UpdatePrivateSize(NsServer *servPtr, InterpPage *ipagePtr)
+{
+    size_t size;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(ipagePtr != NULL);
+
+    size = sizeof(InterpPage) + ipagePtr->objs->size;
+    if (ipagePtr->cacheObjs != NULL) {
+        size += ipagePtr->cacheObjs->size;
+    }
+    ipagePtr->pagePtr->privateSize += size - ipagePtr->privateSize;
+    servPtr->adp.stats.privateSize += size - ipagePtr->privateSize;
+    ipagePtr->privateSize = size;
+}
+
 
 /*
  *----------------------------------------------------------------------
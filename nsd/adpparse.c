@@ -101,6 +101,9 @@ static void ParseAtts(char *s, const char *e, unsigned int *flagsPtr, Tcl_DStrin
 static void AdpParseAdp(NsInterp *itPtr, AdpCode *codePtr, char *adp, unsigned int flags)
     NS_GNUC_NONNULL(1,2,3);
 
+static int TagCompare(const void *left, const void *right)
+    NS_GNUC_NONNULL(1,2);
+
 static void AdpParseTclFile(AdpCode *codePtr, const char *adp, unsigned int flags, const char* file)
     NS_GNUC_NONNULL(1,2);
 
@@ -1064,6 +1067,138 @@ NsAdpFreeCode(AdpCode *codePtr)
     codePtr->line = NULL;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsAdpRestoreCode --
+ *
+ *      Rebuild an AdpCode structure from its serialized parts, i.e. the
+ *      concatenated text of all blocks and the per-block length and
+ *      line arrays, as produced by an earlier NsAdpParse().
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Initializes and fills the code structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsAdpRestoreCode(AdpCode *codePtr, int nblocks, int nscripts,
+                 const char *text, size_t textLength,
+                 const TCL_SIZE_T *len, const int *line)
+{
+    NS_NONNULL_ASSERT(codePtr != NULL);
+    NS_NONNULL_ASSERT(text != NULL);
+    NS_NONNULL_ASSERT(len != NULL);
+    NS_NONNULL_ASSERT(line != NULL);
+
+    Tcl_DStringInit(&codePtr->text);
+    Tcl_DStringAppend(&codePtr->text, text, (TCL_SIZE_T)textLength);
+    codePtr->nblocks = nblocks;
+    codePtr->nscripts = nscripts;
+    AppendLengths(codePtr,
+                  len, (size_t)nblocks * sizeof(TCL_SIZE_T),
+                  line, (size_t)nblocks * sizeof(int));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsAdpTagSignature --
+ *
+ *      Compute a signature of the registered ADP tags of the server
+ *      (default tag set). Parsed ADP code depends on these tags, so the
+ *      signature is used to validate precompiled pages.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Appends the hex encoded SHA-1 signature to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsAdpTagSignature(NsServer *servPtr, Tcl_DString *dsPtr)
+{
+    Tcl_HashSearch  search;
+    Tcl_HashEntry  *hPtr;
+    Ns_CtxSHA1      ctx;
+    Ns_DList        tags;
+    unsigned char   digest[20];
+    char            digestChars[41];
+    size_t          i;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    /*
+     * Collect the tags and sort these by name to obtain a signature
+     * independent of the order of the registration.
+     */
+    Ns_DListInit(&tags);
+    Ns_RWLockRdLock(&servPtr->adp.taglock);
+    hPtr = Tcl_FirstHashEntry(&servPtr->adp.tags, &search);
+    while (hPtr != NULL) {
+        Ns_DListAppend(&tags, Tcl_GetHashValue(hPtr));
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+    if (tags.size > 1u) {
+        qsort(tags.data, tags.size, sizeof(void *), TagCompare);
+    }
+
+    Ns_CtxSHAInit(&ctx);
+    for (i = 0u; i < tags.size; i++) {
+        const Tag *tagPtr = tags.data[i];
+        char       type = (char)('0' + tagPtr->type);
+
+        Ns_CtxSHAUpdate(&ctx, (const unsigned char *)tagPtr->tag, strlen(tagPtr->tag) + 1u);
+        Ns_CtxSHAUpdate(&ctx, (const unsigned char *)&type, 1u);
+        if (tagPtr->endtag != NULL) {
+            Ns_CtxSHAUpdate(&ctx, (const unsigned char *)tagPtr->endtag, strlen(tagPtr->endtag));
+        }
+        Ns_CtxSHAUpdate(&ctx, (const unsigned char *)"", 1u);
+        Ns_CtxSHAUpdate(&ctx, (const unsigned char *)tagPtr->content, strlen(tagPtr->content) + 1u);
+    }
+    Ns_RWLockUnlock(&servPtr->adp.taglock);
+    Ns_DListFree(&tags);
+
+    Ns_CtxSHAFinal(&ctx, digest);
+    Ns_HexString(digest, digestChars, 20, NS_FALSE);
+    Tcl_DStringAppend(dsPtr, digestChars, 40);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TagCompare --
+ *
+ *      qsort() callback comparing two tags by name.
+ *
+ * Results:
+ *      Negative, zero or positive value like strcmp().
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TagCompare(const void *left, const void *right)
+{
+    const Tag *leftPtr = *(const Tag *const*)left, *rightPtr = *(const Tag *const*)right;
+
+    return strcmp(leftPtr->tag, rightPtr->tag);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -590,6 +590,7 @@ NsAdpFlush(NsInterp *itPtr, bool doStream)
                 Ns_TclPrintfResult(interp, "adp flush failed: connection closed");
             } else {
                 struct iovec sbuf;
+                unsigned int writeFlags;
 
                 if ((flags & ADP_FLUSHED) == 0u && (flags & ADP_EXPIRE) != 0u) {
                     Ns_ConnCondSetHeadersSz(conn, "expires", 7, "now", 3);
@@ -600,10 +601,23 @@ NsAdpFlush(NsInterp *itPtr, bool doStream)
                     len = 0;
                 }
 
+                if (doStream) {
+                    writeFlags = NS_CONN_STREAM;
+                } else if ((conn->flags & (NS_CONN_STREAM|NS_CONN_CHUNK)) == (NS_CONN_STREAM|NS_CONN_CHUNK)) {
+                    /*
+                     * Final flush of a chunked stream: send the remaining
+                     * output together with the end-of-content trailer, such
+                     * that it can be passed as a single job to the writer
+                     * thread.
+                     */
+                    writeFlags = NS_CONN_STREAM_CLOSE;
+                } else {
+                    writeFlags = 0u;
+                }
+
                 sbuf.iov_base = buf;
                 sbuf.iov_len  = (size_t)len;
-                if (Ns_ConnWriteVChars(itPtr->conn, &sbuf, 1,
-                                       (doStream ? NS_CONN_STREAM : 0u)) == NS_OK) {
+                if (Ns_ConnWriteVChars(itPtr->conn, &sbuf, 1, writeFlags) == NS_OK) {
                     result = TCL_OK;
                 }
                 if (result != TCL_OK) {
@@ -329,6 +329,191 @@ Ns_CompressGzip(const char *buf, int len, Tcl_DString *dsPtr, int level)
 }
 
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsDeflateRawMessage --
+ *
+ *      Compress a message for the WebSocket permessage-deflate
+ *      extension (RFC 7692). The message is compressed as raw deflate
+ *      data without context takeover, terminated by a sync flush,
+ *      with the trailing 0x00 0x00 0xff 0xff removed. Since no context
+ *      is kept, the result can be sent to multiple clients.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Compressed data is appended to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+NsDeflateRawMessage(const unsigned char *buf, size_t len, Tcl_DString *dsPtr, int level)
+{
+    z_stream      z;
+    int           rc;
+    Ns_ReturnCode status = NS_OK;
+
+    NS_NONNULL_ASSERT(buf != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    memset(&z, 0, sizeof(z));
+    z.zalloc = ZAlloc;
+    z.zfree = ZFree;
+    z.opaque = Z_NULL;
+
+    rc = deflateInit2(&z, level, Z_DEFLATED,
+                      -15,        /* windowBits: 15 (max), negative for raw deflate. */
+                      8,          /* memlevel: default. */
+                      Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+        Ns_Log(Error, "NsDeflateRawMessage: zlib error: %d (%s): %s",
+               rc, zError(rc), (z.msg != NULL) ? z.msg : "(none)");
+        status = NS_ERROR;
+    } else {
+        TCL_SIZE_T   offset = dsPtr->length, used = dsPtr->length;
+        size_t       chunk = (size_t)deflateBound(&z, (uLong)len) + 16u;
+
+        z.next_in  = (Bytef *)ns_const2voidp(buf);
+        z.avail_in = (uInt)len;
+        do {
+            Tcl_DStringSetLength(dsPtr, used + (TCL_SIZE_T)chunk);
+            z.next_out  = (Bytef *)dsPtr->string + used;
+            z.avail_out = (uInt)chunk;
+            rc = deflate(&z, Z_SYNC_FLUSH);
+            used += (TCL_SIZE_T)(chunk - z.avail_out);
+        } while (rc == Z_OK && z.avail_out == 0u);
+
+        if ((rc != Z_OK && rc != Z_BUF_ERROR) || z.avail_in != 0u) {
+            Ns_Log(Error, "NsDeflateRawMessage: zlib error: %d (%s): %s",
+                   rc, zError(rc), (z.msg != NULL) ? z.msg : "(none)");
+            used = offset;
+            status = NS_ERROR;
+
+        } else if (used - offset >= 4
+                   && memcmp(dsPtr->string + used - 4, "\0\0\xff\xff", 4u) == 0) {
+            used -= 4;
+        }
+        Tcl_DStringSetLength(dsPtr, used);
+        (void) deflateEnd(&z);
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInflateRawInit, NsInflateRawMessage --
+ *
+ *      Initialize a raw inflate stream and decompress a message
+ *      received via the WebSocket permessage-deflate extension (RFC
+ *      7692). The stream is kept over multiple messages, such that
+ *      messages compressed with context takeover can be decoded. The
+ *      stream has to be terminated with Ns_InflateEnd(). Decompression
+ *      fails when the message would inflate to more than maxSize bytes.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Decompressed data is appended to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+NsInflateRawInit(Ns_CompressStream *cStream)
+{
+    z_stream      *zPtr = &cStream->z;
+    int            rc;
+    Ns_ReturnCode  status = NS_OK;
+
+    memset(zPtr, 0, sizeof(z_stream));
+    zPtr->zalloc   = ZAlloc;
+    zPtr->zfree    = ZFree;
+    zPtr->opaque   = Z_NULL;
+    zPtr->next_in  = Z_NULL;
+    rc = inflateInit2(zPtr, -15); /* windowBits: 15 (max), negative for raw deflate. */
+    if (rc != Z_OK) {
+        Ns_Log(Error, "NsInflateRawInit: zlib error: %d (%s): %s",
+               rc, zError(rc), (zPtr->msg != NULL) ? zPtr->msg : "(unknown)");
+        status = NS_ERROR;
+    }
+    return status;
+}
+
+Ns_ReturnCode
+NsInflateRawMessage(Ns_CompressStream *cStream, const unsigned char *buf, size_t len,
+                    size_t maxSize, Tcl_DString *dsPtr)
+{
+    static const unsigned char trailer[4] = {0x00u, 0x00u, 0xffu, 0xffu};
+    z_stream      *zPtr = &cStream->z;
+    Ns_ReturnCode  status = NS_OK;
+    TCL_SIZE_T     start = dsPtr->length;
+    int            i;
+
+    NS_NONNULL_ASSERT(cStream != NULL);
+    NS_NONNULL_ASSERT(buf != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    /*
+     * Feed the message followed by the trailer removed by the sender.
+     */
+    for (i = 0; i < 2 && status == NS_OK; i++) {
+        zPtr->next_in  = (Bytef *)ns_const2voidp(i == 0 ? buf : trailer);
+        zPtr->avail_in = (uInt)(i == 0 ? len : sizeof(trailer));
+
+        for (;;) {
+            TCL_SIZE_T used = dsPtr->length;
+            size_t     chunk = 16384u;
+            int        rc;
+
+            Tcl_DStringSetLength(dsPtr, used + (TCL_SIZE_T)chunk);
+            zPtr->next_out  = (Bytef *)dsPtr->string + used;
+            zPtr->avail_out = (uInt)chunk;
+            rc = inflate(zPtr, Z_SYNC_FLUSH);
+            Tcl_DStringSetLength(dsPtr, used + (TCL_SIZE_T)(chunk - zPtr->avail_out));
+
+            if (rc == Z_STREAM_END) {
+                /*
+                 * The sender has terminated the deflate stream
+                 * (BFINAL); start from scratch for the next message.
+                 */
+                (void) inflateReset(zPtr);
+                zPtr->avail_in = 0u;
+                i = 2;
+                break;
+            } else if (rc == Z_BUF_ERROR) {
+                break;
+            } else if (rc != Z_OK) {
+                Ns_Log(Warning, "NsInflateRawMessage: zlib error: %d (%s): %s",
+                       rc, zError(rc), (zPtr->msg != NULL) ? zPtr->msg : "(unknown)");
+                status = NS_ERROR;
+                break;
+            } else if ((size_t)(dsPtr->length - start) > maxSize) {
+                /*
+                 * Don't let a small message inflate to an arbitrary
+                 * amount of memory.
+                 */
+                Ns_Log(Warning, "NsInflateRawMessage: message exceeds %" PRIuz " bytes",
+                       maxSize);
+                (void) inflateReset(zPtr);
+                Tcl_DStringSetLength(dsPtr, start);
+                status = NS_ERROR;
+                break;
+            } else if (zPtr->avail_in == 0u && zPtr->avail_out != 0u) {
+                break;
+            }
+        }
+    }
+    return status;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -444,6 +629,27 @@ Ns_InflateEnd(Ns_CompressStream *UNUSED(cStream))
     return NS_ERROR;
 }
 
+
+Ns_ReturnCode
+NsDeflateRawMessage(const unsigned char *UNUSED(buf), size_t UNUSED(len),
+                    Tcl_DString *UNUSED(dsPtr), int UNUSED(level))
+{
+    return NS_ERROR;
+}
+
+Ns_ReturnCode
+NsInflateRawInit(Ns_CompressStream *UNUSED(cStream))
+{
+    return NS_ERROR;
+}
+
+Ns_ReturnCode
+NsInflateRawMessage(Ns_CompressStream *UNUSED(cStream), const unsigned char *UNUSED(buf),
+                    size_t UNUSED(len), size_t UNUSED(maxSize), Tcl_DString *UNUSED(dsPtr))
+{
+    return NS_ERROR;
+}
+
 #endif
 
 /*
@@ -2287,7 +2287,7 @@ enum ISubCmdIdx {
     CCurrentAddrIdx, CCurrentPortIdx,
     CDetailsIdx, CDriverIdx,
     CEncodingIdx,
-    CFileHdrIdx, CFileLenIdx, CFileOffIdx, CFilesIdx, CFlagsIdx, CFormIdx, CFragmentIdx,
+    CFileHdrIdx, CFileLenIdx, CFileOffIdx, CFilesIdx, CFileTmpIdx, CFlagsIdx, CFormIdx, CFragmentIdx,
     CHeaderLengthIdx, CHeadersIdx, CHostIdx,
     CIdIdx, CIsConnectedIdx,
     CKeepAliveIdx,
@@ -2296,7 +2296,7 @@ enum ISubCmdIdx {
     COutputHeadersIdx,
     CPartialTimesIdx, CPeerAddrIdx, CPeerPortIdx, CPoolIdx, CPortIdx, CPrivacyIdx, CProtocolIdx,
     CQueryIdx,
-    CRatelimitIdx, CRequestIdx,
+    CRatelimitIdx, CReadIdx, CRequestIdx,
     CServerIdx, CSockIdx, CStartIdx, CStatusIdx,
     CTargetIdx, CTimeoutIdx,
     CUrlIdx, CUrlcIdx, CUrlDictIdx, CUrlEncodingIdx, CUrlvIdx,
@@ -2319,7 +2319,7 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         "currentaddr", "currentport",
         "details", "driver",
         "encoding",
-        "fileheaders", "filelength", "fileoffset", "files", "flags", "form", "fragment",
+        "fileheaders", "filelength", "fileoffset", "files", "filetmpfile", "flags", "form", "fragment",
         "headerlength", "headers", "host",
         "id", "isconnected",
         "keepalive",
@@ -2328,7 +2328,7 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         "outputheaders",
         "partialtimes", "peeraddr", "peerport", "pool", "port", "privacy", "protocol",
         "query",
-        "ratelimit", "request",
+        "ratelimit", "read", "request",
         "server", "sock", "start", "status",
         "target", "timeout",
         "url", "urlc", "urldict", "urlencoding", "urlv",
@@ -2349,6 +2349,7 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         /* F */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
         /* line continued */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
         /* line continued */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
+        /* line continued */ NS_CONN_REQUIRE_CONFIGURED,
         /* H */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
         /* I */ NS_CONN_REQUIRE_CONFIGURED, 0u,
         /* K */ NS_CONN_REQUIRE_CONNECTED,
@@ -2359,7 +2360,7 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         /* line continued */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONNECTED,
         /* line continued */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
         /* Q */ NS_CONN_REQUIRE_CONFIGURED,
-        /* R */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
+        /* R */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONNECTED, NS_CONN_REQUIRE_CONFIGURED,
         /* S */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONNECTED, NS_CONN_REQUIRE_CONFIGURED,
         /* line continued */ NS_CONN_REQUIRE_CONFIGURED,
         /* T */ NS_CONN_REQUIRE_CONFIGURED, NS_CONN_REQUIRE_CONFIGURED,
@@ -2523,6 +2524,7 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
 
         case CFileHdrIdx: NS_FALL_THROUGH; /* fall through */
         case CFileLenIdx: NS_FALL_THROUGH; /* fall through */
+        case CFileTmpIdx: NS_FALL_THROUGH; /* fall through */
         case CFileOffIdx: {
             char       *fileString = NULL;
             Ns_ObjvSpec largs[] = {
@@ -2547,6 +2549,8 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
                         Tcl_SetObjResult(interp, (filePtr->offObj != NULL) ? filePtr->offObj : Tcl_NewObj());
                     } else if (opt == (int)CFileLenIdx) {
                         Tcl_SetObjResult(interp, (filePtr->sizeObj != NULL) ? filePtr->sizeObj : Tcl_NewObj());
+                    } else if (opt == (int)CFileTmpIdx) {
+                        Tcl_SetObjResult(interp, (filePtr->tmpObj != NULL) ? filePtr->tmpObj : Tcl_NewObj());
                     } else {
                         Tcl_SetObjResult(interp, (filePtr->hdrObj != NULL) ? filePtr->hdrObj : Tcl_NewObj() );
                     }
@@ -2664,6 +2668,47 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
             break;
         }
 
+        case CReadIdx: {
+            Tcl_WideInt       size = 16384;
+            Ns_Time          *timeoutPtr = NULL;
+            Ns_ObjvValueRange sizeRange = {1, INT_MAX};
+            Ns_ObjvSpec       lopts[] = {
+                {"-timeout", Ns_ObjvTime,  &timeoutPtr, NULL},
+                {"--",       Ns_ObjvBreak, NULL,        NULL},
+                {NULL, NULL, NULL, NULL}
+            };
+            Ns_ObjvSpec       largs[] = {
+                {"?size", Ns_ObjvMemUnit, &size, &sizeRange},
+                {NULL, NULL, NULL, NULL}
+            };
+
+            if (Ns_ParseObjv(lopts, largs, interp, 2, objc, objv) != NS_OK
+                || NsConnRequire(interp, required_flags[opt], NULL, &result) != NS_OK ) {
+                result = TCL_ERROR;
+
+            } else {
+                Tcl_Obj       *resultObj = Tcl_NewByteArrayObj(NULL, 0);
+                unsigned char *bytes = Tcl_SetByteArrayLength(resultObj, (TCL_SIZE_T)size);
+                ssize_t        nread = Ns_ConnReadBody(conn, bytes, (size_t)size, timeoutPtr);
+
+                if (nread < 0) {
+                    Tcl_DecrRefCount(resultObj);
+                    if (connPtr->sockPtr != NULL
+                        && connPtr->sockPtr->recvSockState == NS_SOCK_TIMEOUT) {
+                        Ns_TclPrintfResult(interp, "timeout while reading request body");
+                        Tcl_SetErrorCode(interp, "NS_TIMEOUT", NS_SENTINEL);
+                    } else {
+                        Ns_TclPrintfResult(interp, "could not read request body");
+                    }
+                    result = TCL_ERROR;
+                } else {
+                    (void)Tcl_SetByteArrayLength(resultObj, (TCL_SIZE_T)nread);
+                    Tcl_SetObjResult(interp, resultObj);
+                }
+            }
+            break;
+        }
+
         case CStatusIdx: {
             int               status = -1;
             Ns_ObjvValueRange statusRange = {100, 599};
@@ -153,18 +153,32 @@ static bool SockListenCallback(NS_SOCKET sock, void *arg, unsigned int UNUSED(wh
 static void RequireDsBuffer(Tcl_DString **dsPtr)  NS_GNUC_NONNULL(1);
 static void WebsocketFrameSetCommonMembers(Tcl_Obj *resultObj, ssize_t nRead, const NsConnChan *connChanPtr)
     NS_GNUC_NONNULL(1,3);
+static Tcl_Obj *WebsocketInflate(NsConnChan *connChanPtr, const unsigned char *bytes, size_t length)
+    NS_GNUC_NONNULL(1,2);
+static void WebsocketFrameEncode(Tcl_DString *frameDsPtr, const unsigned char *messageString, size_t messageLength,
+                                 int opcode, bool fin, bool masked, bool compressed)
+    NS_GNUC_NONNULL(1,2);
+static int WebsocketMessageEncode(Tcl_Interp *interp, Tcl_DString *frameDsPtr, Tcl_Obj *messageObj,
+                                  int opcode, bool isBinary, bool fin, bool masked, bool compress)
+    NS_GNUC_NONNULL(1,2,3);
+static void GroupsRemoveChannel(NsServer *servPtr, const char *channelName)
+    NS_GNUC_NONNULL(1,2);
 
 static Ns_SockProc NsTclConnChanProc;
 
+static TCL_OBJCMDPROC_T   ConnChanBroadcastObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanCallbackObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanCloseObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanDetachObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanDebugObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanExistsObjCmd;
+static TCL_OBJCMDPROC_T   ConnChanGroupsObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanListObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanListenObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanOpenObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanReadObjCmd;
+static TCL_OBJCMDPROC_T   ConnChanSubscribeObjCmd;
+static TCL_OBJCMDPROC_T   ConnChanUnsubscribeObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanWriteObjCmd;
 static TCL_OBJCMDPROC_T   ConnChanWsencodeObjCmd;
 
@@ -334,6 +348,8 @@ ConnChanCreate(NsServer *servPtr, Sock *sockPtr,
     connChanPtr->secondarySendBuffer = NULL;
     connChanPtr->frameBuffer = NULL;
     connChanPtr->fragmentsBuffer = NULL;
+    connChanPtr->fragmentsCompressed = NS_FALSE;
+    connChanPtr->inflateStream = NULL;
     connChanPtr->frameNeedsData = NS_TRUE;
     connChanPtr->debugLevel = 0;
     connChanPtr->debugFD = 0;
@@ -404,6 +420,7 @@ ConnChanFree(NsConnChan *connChanPtr, NsServer *servPtr) {
     hPtr = Tcl_FindHashEntry(&servPtr->connchans.table, connChanPtr->channelName);
     if (hPtr != NULL) {
         Tcl_DeleteHashEntry(hPtr);
+        GroupsRemoveChannel(servPtr, connChanPtr->channelName);
     } else {
         Ns_Log(Error, "ns_connchan: could not delete hash entry for channel '%s'",
                connChanPtr->channelName);
@@ -456,6 +473,10 @@ ConnChanFree(NsConnChan *connChanPtr, NsServer *servPtr) {
             Tcl_DStringFree(connChanPtr->fragmentsBuffer);
             ns_free((char *)connChanPtr->fragmentsBuffer);
         }
+        if (connChanPtr->inflateStream != NULL) {
+            (void) Ns_InflateEnd(connChanPtr->inflateStream);
+            ns_free((char *)connChanPtr->inflateStream);
+        }
         ns_free((char *)connChanPtr);
     } else {
         Ns_Log(Bug, "ns_connchan: could not delete hash entry for channel '%s'",
@@ -2315,6 +2336,54 @@ WebsocketFrameSetCommonMembers(Tcl_Obj *resultObj, ssize_t nRead, const NsConnCh
                    Tcl_NewIntObj(!connChanPtr->frameNeedsData));
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * WebsocketInflate --
+ *
+ *      Decompress the payload of a WebSocket message sent with the
+ *      permessage-deflate extension. The inflate stream is kept in
+ *      the connection channel to support context takeover of the
+ *      client. The decompressed payload is limited to "maxinput" of
+ *      the driver.
+ *
+ * Results:
+ *      Tcl byte array object with the decompressed payload, or NULL on
+ *      errors.
+ *
+ * Side effects:
+ *      Might create the inflate stream of the connection channel.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Obj *
+WebsocketInflate(NsConnChan *connChanPtr, const unsigned char *bytes, size_t length)
+{
+    Tcl_Obj *resultObj = NULL;
+
+    NS_NONNULL_ASSERT(connChanPtr != NULL);
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+    if (connChanPtr->inflateStream == NULL) {
+        connChanPtr->inflateStream = ns_calloc(1u, sizeof(Ns_CompressStream));
+        if (NsInflateRawInit(connChanPtr->inflateStream) != NS_OK) {
+            ns_free((char *)connChanPtr->inflateStream);
+            connChanPtr->inflateStream = NULL;
+        }
+    }
+    if (connChanPtr->inflateStream != NULL) {
+        Tcl_DString ds;
+
+        Tcl_DStringInit(&ds);
+        if (NsInflateRawMessage(connChanPtr->inflateStream, bytes, length,
+                                (size_t)connChanPtr->sockPtr->drvPtr->maxinput, &ds) == NS_OK) {
+            resultObj = Tcl_NewByteArrayObj((const unsigned char *)ds.string, ds.length);
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return resultObj;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2357,7 +2426,7 @@ static Tcl_Obj*
 GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
 {
     unsigned char *data;
-    bool           finished, masked;
+    bool           finished, masked, compressed, inflateFailed = NS_FALSE;
     int            opcode;
     TCL_SIZE_T     frameLength, fragmentsBufferLength;
     size_t         payloadLength, offset;
@@ -2399,6 +2468,7 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
 
     finished      = ((data[0] & 0x80u) != 0);
     masked        = ((data[1] & 0x80u) != 0);
+    compressed    = ((data[0] & 0x40u) != 0);
     opcode        = (data[0] & 0x0F);
     payloadLength = (data[1] & 0x7Fu);
 
@@ -2458,7 +2528,9 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
     fragmentsBufferLength = ConnChanBufferSize(connChanPtr, fragmentsBuffer);
 
     if (finished) {
-        Tcl_Obj *payloadObj;
+        Tcl_Obj             *payloadObj;
+        const unsigned char *payloadString;
+        TCL_SIZE_T           payloadSize;
         /*
          * The "fin" bit is set, this message is complete. If we have
          * fragments, append the new data to the fragments already
@@ -2466,19 +2538,38 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
          */
 
         if (fragmentsBufferLength == 0) {
-            payloadObj = Tcl_NewByteArrayObj(&data[offset], (TCL_SIZE_T)payloadLength);
+            payloadString = &data[offset];
+            payloadSize = (TCL_SIZE_T)payloadLength;
         } else {
             Tcl_DStringAppend(connChanPtr->fragmentsBuffer,
                               (const char *)&data[offset], (TCL_SIZE_T)payloadLength);
-            payloadObj = Tcl_NewByteArrayObj((const unsigned char *)connChanPtr->fragmentsBuffer->string,
-                                             connChanPtr->fragmentsBuffer->length);
+            payloadString = (const unsigned char *)connChanPtr->fragmentsBuffer->string;
+            payloadSize = connChanPtr->fragmentsBuffer->length;
             Ns_Log(Ns_LogConnchanDebug,
                    "WS: append final payload opcode %d (fragments opcode %d) %" PRITcl_Size" bytes, "
                    "totaling %" PRITcl_Size " bytes, clear fragmentsBuffer",
                    opcode, connChanPtr->fragmentsOpcode,
                    (TCL_SIZE_T)payloadLength, connChanPtr->fragmentsBuffer->length);
-            Tcl_DStringSetLength(connChanPtr->fragmentsBuffer, 0);
             opcode = connChanPtr->fragmentsOpcode;
+            compressed = connChanPtr->fragmentsCompressed;
+        }
+
+        /*
+         * The RSV1 bit of the first frame of a message indicates
+         * permessage-deflate compression (RFC 7692).
+         */
+        payloadObj = NULL;
+        if (compressed) {
+            payloadObj = WebsocketInflate(connChanPtr, payloadString, (size_t)payloadSize);
+            if (payloadObj == NULL) {
+                inflateFailed = NS_TRUE;
+            }
+        }
+        if (payloadObj == NULL) {
+            payloadObj = Tcl_NewByteArrayObj(payloadString, payloadSize);
+        }
+        if (fragmentsBufferLength > 0) {
+            Tcl_DStringSetLength(connChanPtr->fragmentsBuffer, 0);
         }
         Tcl_DictObjPut(NULL, resultObj,
                        NsAtomObj(NS_ATOM_opcode),
@@ -2499,6 +2590,7 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
          */
         if (fragmentsBufferLength == 0) {
             connChanPtr->fragmentsOpcode = opcode;
+            connChanPtr->fragmentsCompressed = compressed;
         }
         Tcl_DStringAppend(connChanPtr->fragmentsBuffer,
                           (const char *)&data[offset], (TCL_SIZE_T)payloadLength);
@@ -2525,6 +2617,12 @@ GetWebsocketFrame(NsConnChan *connChanPtr, char *buffer, ssize_t nRead)
         connChanPtr->frameNeedsData = NS_TRUE;
         Tcl_DStringSetLength(connChanPtr->frameBuffer, 0);
     }
+    if (inflateFailed) {
+        Ns_Log(Warning, "WS: channel %s: could not decompress message",
+               connChanPtr->channelName);
+        Tcl_DictObjPut(NULL, resultObj, NsAtomObj(NS_ATOM_frame),
+                       NsAtomObj(NS_ATOM_exception));
+    }
     WebsocketFrameSetCommonMembers(resultObj, nRead, connChanPtr);
     return resultObj;
 
@@ -3464,6 +3562,179 @@ ConnChanDebugObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
 
     return result;
 }
+/*
+ *----------------------------------------------------------------------
+ *
+ * WebsocketFrameEncode --
+ *
+ *      Appends a WebSocket frame with the provided payload to the
+ *      (empty) frame DString. When "masked" is set, a random mask is
+ *      generated and applied to the payload. When "compressed" is
+ *      set, the payload is expected to be compressed already via
+ *      permessage-deflate and the RSV1 bit is set.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the DString.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+WebsocketFrameEncode(Tcl_DString *frameDsPtr, const unsigned char *messageString, size_t messageLength,
+                     int opcode, bool fin, bool masked, bool compressed)
+{
+    unsigned char *data;
+    size_t         offset;
+
+    NS_NONNULL_ASSERT(frameDsPtr != NULL);
+    NS_NONNULL_ASSERT(messageString != NULL);
+
+    Tcl_DStringSetLength(frameDsPtr, 10);
+    data = (unsigned char *)frameDsPtr->string;
+
+    /*
+     * Initialize first two bytes, and then XOR flags into it.
+     */
+    data[0] = (unsigned char)((unsigned char)opcode & 0x0Fu);
+    data[1] = '\0';
+    if (fin) {
+        data[0] |= 0x80u;
+    }
+    if (compressed) {
+        data[0] |= 0x40u;
+    }
+
+    if ( messageLength <= 125 ) {
+        data[1] = (unsigned char)(data[1] | ((unsigned char)messageLength & 0x7Fu));
+        offset = 2;
+    } else if ( messageLength <= 65535 ) {
+        uint16_t len16;
+        /*
+         * Together with the first clause, this means:
+         * messageLength > 125 && messageLength <= 65535
+         */
+        data[1] |= (( unsigned char )126 & 0x7Fu);
+        len16 = htobe16((short unsigned int)messageLength);
+        memcpy(&data[2], &len16, 2);
+        offset = 4;
+    } else {
+        uint64_t len64;
+        /*
+         * Together with the first two clauses, this means:
+         * messageLength > 65535
+         */
+        data[1] |= (( unsigned char )127 & 0x7Fu);
+        len64 = htobe64((uint64_t)messageLength);
+        memcpy(&data[2], &len64, 8);
+        offset = 10;
+    }
+
+    if (masked) {
+        unsigned char mask[4];
+        size_t        i, j;
+
+        data[1] |= 0x80u;
+#ifdef HAVE_OPENSSL_EVP_H
+        (void) RAND_bytes(&mask[0], 4);
+#else
+        {
+            double d = Ns_DRand();
+            /*
+             * In case double is 64-bits (which is the case on
+             * most platforms) the first four bytes contains much
+             * less randoness than the second 4 bytes.
+             */
+            if (sizeof(d) == 8) {
+                const char *p = (const char *)&d;
+                memcpy(&mask[0], p+4, 4);
+            } else {
+                memcpy(&mask[0], &d, 4);
+            }
+        }
+#endif
+        Tcl_DStringSetLength(frameDsPtr, (TCL_SIZE_T)(offset + 4 + messageLength));
+        data = (unsigned char *)frameDsPtr->string;
+        memcpy(&data[offset], &mask[0], 4);
+        offset += 4;
+        for( i = offset, j = 0u; j < messageLength; i++, j++ ) {
+            data[ i ] = messageString[ j ] ^ mask[ j % 4];
+        }
+    } else {
+        Tcl_DStringSetLength(frameDsPtr, (TCL_SIZE_T)(offset + messageLength));
+        data = (unsigned char *)frameDsPtr->string;
+        memcpy(&data[offset], &messageString[0], messageLength);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WebsocketMessageEncode --
+ *
+ *      Produce a WebSocket frame from a Tcl message object based on
+ *      the provided opcode and flags, optionally compressed via
+ *      permessage-deflate. Compression is only applied to complete
+ *      text and binary messages; the compressed data does not depend
+ *      on earlier messages (no context takeover) and can be sent to
+ *      multiple clients.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      Updates the frame DString, leaves an error message in the
+ *      interpreter on failures.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+WebsocketMessageEncode(Tcl_Interp *interp, Tcl_DString *frameDsPtr, Tcl_Obj *messageObj,
+                       int opcode, bool isBinary, bool fin, bool masked, bool compress)
+{
+    const unsigned char *messageString;
+    TCL_SIZE_T           messageLength;
+    Tcl_DString          messageDs, compressedDs;
+    int                  result = TCL_OK;
+
+    Tcl_DStringInit(&messageDs);
+    Tcl_DStringInit(&compressedDs);
+
+    /*
+     * When the binary opcode is used, get as well the data in
+     * form of binary data.
+     */
+    if (opcode == 2) {
+        isBinary = NS_TRUE;
+    }
+    messageString = Ns_GetBinaryString(messageObj, isBinary, &messageLength, &messageDs);
+
+    if (compress) {
+        if ((opcode != 1 && opcode != 2) || !fin) {
+            Ns_TclPrintfResult(interp, "compression requires a complete text or binary message");
+            result = TCL_ERROR;
+
+        } else if (NsDeflateRawMessage(messageString, (size_t)messageLength, &compressedDs,
+                                       -1 /* default compression level */) != NS_OK) {
+            Ns_TclPrintfResult(interp, "could not compress message");
+            result = TCL_ERROR;
+        } else {
+            messageString = (const unsigned char *)compressedDs.string;
+            messageLength = compressedDs.length;
+        }
+    }
+    if (result == TCL_OK) {
+        WebsocketFrameEncode(frameDsPtr, messageString, (size_t)messageLength,
+                             opcode, fin, masked, compress);
+    }
+
+    Tcl_DStringFree(&messageDs);
+    Tcl_DStringFree(&compressedDs);
+
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3483,7 +3754,7 @@ ConnChanDebugObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
 static int
 ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
-    int                      result = TCL_OK, isBinary = 0, opcode = 1, fin = 1, masked = 0;
+    int                      result = TCL_OK, isBinary = 0, opcode = 1, fin = 1, masked = 0, compress = 0;
     Tcl_Obj                 *messageObj;
     static Ns_ObjvTable      finValues[] = {
         {"0",  0u},
@@ -3501,6 +3772,7 @@ ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SI
     };
     Ns_ObjvSpec opts[] = {
         {"-binary",     Ns_ObjvBool,  &isBinary, INT2PTR(NS_TRUE)},
+        {"-compress",   Ns_ObjvBool,  &compress, INT2PTR(NS_TRUE)},
         {"-fin",        Ns_ObjvIndex, &fin,      &finValues},
         {"-mask",       Ns_ObjvBool,  &masked,   INT2PTR(NS_TRUE)},
         {"-opcode",     Ns_ObjvIndex, &opcode,   &opcodes},
@@ -3516,113 +3788,369 @@ ConnChanWsencodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SI
         result = TCL_ERROR;
 
     } else {
-        const unsigned char *messageString;
-        unsigned char       *data;
-        TCL_SIZE_T           messageLength;
-        Tcl_DString          messageDs, frameDs;
-        size_t               offset;
+        Tcl_DString frameDs;
 
-        Tcl_DStringInit(&messageDs);
         Tcl_DStringInit(&frameDs);
-
-        /*
-         * When the binary opcode is used, get as well the data in
-         * form of binary data.
-         */
-        if (opcode == 2) {
-            isBinary = 1;
+        result = WebsocketMessageEncode(interp, &frameDs, messageObj, opcode,
+                                        isBinary == 1, fin == 1, masked == 1, compress == 1);
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, Tcl_NewByteArrayObj((const unsigned char *)frameDs.string,
+                                                         frameDs.length));
         }
-        messageString = Ns_GetBinaryString(messageObj, isBinary == 1, &messageLength, &messageDs);
-        data = (unsigned char *)frameDs.string;
+        Tcl_DStringFree(&frameDs);
+    }
+    return result;
+}
 
-        Tcl_DStringSetLength(&frameDs, 2);
-        /*
-         * Initialize first two bytes, and then XOR flags into it.
-         */
-        data[0] = '\0';
-        data[1] = '\0';
+/*
+ *----------------------------------------------------------------------
+ *
+ * GroupsRemoveChannel --
+ *
+ *      Remove a connection channel from all broadcast groups. Empty
+ *      groups are deleted. The function has to be called while
+ *      holding the write lock of the connection channels.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the broadcast groups.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+GroupsRemoveChannel(NsServer *servPtr, const char *channelName)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
 
-        data[0] = (unsigned char)(data[0] | ((unsigned char)opcode & 0x0Fu));
-        if (fin) {
-            data[0] |= 0x80u;
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(channelName != NULL);
+
+    hPtr = Tcl_FirstHashEntry(&servPtr->connchans.groups, &search);
+    while (hPtr != NULL) {
+        Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+        Tcl_HashEntry *memberPtr = Tcl_FindHashEntry(membersPtr, channelName);
+
+        if (memberPtr != NULL) {
+            Tcl_DeleteHashEntry(memberPtr);
+            if (membersPtr->numEntries == 0) {
+                Tcl_DeleteHashTable(membersPtr);
+                ns_free(membersPtr);
+                Tcl_DeleteHashEntry(hPtr);
+            }
         }
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+}
 
-        if ( messageLength <= 125 ) {
-            data[1] = (unsigned char)(data[1] | ((unsigned char)messageLength & 0x7Fu));
-            offset = 2;
-        } else if ( messageLength <= 65535 ) {
-            uint16_t len16;
-            /*
-             * Together with the first clause, this means:
-             * messageLength > 125 && messageLength <= 65535
-             */
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanSubscribeObjCmd, ConnChanUnsubscribeObjCmd --
+ *
+ *      Implements "ns_connchan subscribe" and "ns_connchan
+ *      unsubscribe", adding a connection channel to a named
+ *      broadcast group or removing it from the group. Groups are
+ *      created on demand and removed when they become empty. Closed
+ *      channels are removed automatically from all groups.
+ *
+ * Results:
+ *      A standard Tcl result. The result is a boolean value
+ *      indicating whether the membership was changed.
+ *
+ * Side effects:
+ *      Updates the broadcast groups.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanSubscribeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const char  *name = NS_EMPTY_STRING, *group = NS_EMPTY_STRING;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"channel", Ns_ObjvString, &name,  NULL},
+        {"group",   Ns_ObjvString, &group, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const NsInterp *itPtr = clientData;
+        NsServer       *servPtr = itPtr->servPtr;
+        int             isNew = 0;
 
-            Tcl_DStringSetLength(&frameDs, 4);
-            data[1] |= (( unsigned char )126 & 0x7Fu);
-            len16 = htobe16((short unsigned int)messageLength);
-            memcpy(&data[2], &len16, 2);
-            offset = 4;
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        if (Tcl_FindHashEntry(&servPtr->connchans.table, name) == NULL) {
+            result = TCL_ERROR;
         } else {
-            uint64_t len64;
-            /*
-             * Together with the first two clauses, this means:
-             * messageLength > 65535
-             */
+            Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&servPtr->connchans.groups, group, &isNew);
+            Tcl_HashTable *membersPtr;
 
-            Tcl_DStringSetLength(&frameDs, 10);
-            data[1] |= (( unsigned char )127 & 0x7Fu);
-            len64 = htobe64((uint64_t)messageLength);
-            memcpy(&data[2], &len64, 8);
-            offset = 10;
+            if (isNew != 0) {
+                membersPtr = ns_malloc(sizeof(Tcl_HashTable));
+                Tcl_InitHashTable(membersPtr, TCL_STRING_KEYS);
+                Tcl_SetHashValue(hPtr, membersPtr);
+            } else {
+                membersPtr = Tcl_GetHashValue(hPtr);
+            }
+            (void) Tcl_CreateHashEntry(membersPtr, name, &isNew);
         }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
 
-        if (masked) {
-            unsigned char mask[4];
-            size_t        i, j;
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(isNew));
+        } else {
+            Ns_TclPrintfResult(interp, "channel \"%s\" does not exist", name);
+        }
+    }
+    return result;
+}
 
-            data[1] |= 0x80u;
-#ifdef HAVE_OPENSSL_EVP_H
-            (void) RAND_bytes(&mask[0], 4);
-#else
-            {
-                double d = Ns_DRand();
-                /*
-                 * In case double is 64-bits (which is the case on
-                 * most platforms) the first four bytes contains much
-                 * less randoness than the second 4 bytes.
-                 */
-                if (sizeof(d) == 8) {
-                    const char *p = (const char *)&d;
-                    memcpy(&mask[0], p+4, 4);
-                } else {
-                    memcpy(&mask[0], &d, 4);
+static int
+ConnChanUnsubscribeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const char  *name = NS_EMPTY_STRING, *group = NS_EMPTY_STRING;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"channel", Ns_ObjvString, &name,  NULL},
+        {"group",   Ns_ObjvString, &group, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const NsInterp *itPtr = clientData;
+        NsServer       *servPtr = itPtr->servPtr;
+        Tcl_HashEntry  *hPtr;
+        bool            removed = NS_FALSE;
+
+        Ns_RWLockWrLock(&servPtr->connchans.lock);
+        hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, group);
+        if (hPtr != NULL) {
+            Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+            Tcl_HashEntry *memberPtr = Tcl_FindHashEntry(membersPtr, name);
+
+            if (memberPtr != NULL) {
+                Tcl_DeleteHashEntry(memberPtr);
+                removed = NS_TRUE;
+                if (membersPtr->numEntries == 0) {
+                    Tcl_DeleteHashTable(membersPtr);
+                    ns_free(membersPtr);
+                    Tcl_DeleteHashEntry(hPtr);
                 }
             }
-#endif
-            Tcl_DStringSetLength(&frameDs, (TCL_SIZE_T)offset + 4 + messageLength);
-            data = (unsigned char *)frameDs.string;
-            memcpy(&data[offset], &mask[0], 4);
-            offset += 4;
-            for( i = offset, j = 0u; j < (size_t)messageLength; i++, j++ ) {
-                data[ i ] = messageString[ j ] ^ mask[ j % 4];
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(removed));
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanGroupsObjCmd --
+ *
+ *      Implements "ns_connchan groups". Without argument, it returns
+ *      the names of the broadcast groups; when a group is specified,
+ *      it returns the channels subscribed to this group.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanGroupsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const char  *group = NULL;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"?group", Ns_ObjvString, &group, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const NsInterp       *itPtr = clientData;
+        NsServer             *servPtr = itPtr->servPtr;
+        Tcl_Obj              *listObj = Tcl_NewListObj(0, NULL);
+        Tcl_HashTable        *tablePtr = NULL;
+
+        Ns_RWLockRdLock(&servPtr->connchans.lock);
+        if (group == NULL) {
+            tablePtr = &servPtr->connchans.groups;
+        } else {
+            const Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, group);
+
+            if (hPtr != NULL) {
+                tablePtr = Tcl_GetHashValue(hPtr);
             }
+        }
+        if (tablePtr != NULL) {
+            const Tcl_HashEntry *hPtr;
+            Tcl_HashSearch       search;
+
+            for (hPtr = Tcl_FirstHashEntry(tablePtr, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+                Tcl_ListObjAppendElement(NULL, listObj,
+                                         Tcl_NewStringObj(Tcl_GetHashKey(tablePtr, hPtr), TCL_INDEX_NONE));
+            }
+        }
+        Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+        Tcl_SetObjResult(interp, listObj);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConnChanBroadcastObjCmd --
+ *
+ *      Implements "ns_connchan broadcast". The message is encoded
+ *      once (by default as a WebSocket frame, optionally compressed
+ *      via permessage-deflate) and written to all channels subscribed
+ *      to the specified group. The writes are non-blocking; data
+ *      which cannot be sent immediately is kept in the send buffer of
+ *      the channel, as for "ns_connchan write". Channels failing on
+ *      write are skipped.
+ *
+ * Results:
+ *      A standard Tcl result. The result is a dict with the number of
+ *      channels the message was "sent" to and the number of "failed"
+ *      channels.
+ *
+ * Side effects:
+ *      Sends data to the channels.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ConnChanBroadcastObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const char          *group = NS_EMPTY_STRING;
+    int                  result = TCL_OK, isBinary = 0, opcode = 1, compress = 0, raw = 0;
+    Tcl_Obj             *messageObj;
+    static Ns_ObjvTable  opcodes[] = {
+        {"text",      1},
+        {"binary",    2},
+        {NULL,       0u}
+    };
+    Ns_ObjvSpec opts[] = {
+        {"-binary",     Ns_ObjvBool,  &isBinary, INT2PTR(NS_TRUE)},
+        {"-compress",   Ns_ObjvBool,  &compress, INT2PTR(NS_TRUE)},
+        {"-opcode",     Ns_ObjvIndex, &opcode,   &opcodes},
+        {"-raw",        Ns_ObjvBool,  &raw,      INT2PTR(NS_TRUE)},
+        {"--",          Ns_ObjvBreak, NULL,      NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"group",   Ns_ObjvString, &group,      NULL},
+        {"message", Ns_ObjvObj,    &messageObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (raw == 1 && compress == 1) {
+        Ns_TclPrintfResult(interp, "the options '-raw' and '-compress' are mutually exclusive");
+        result = TCL_ERROR;
+
+    } else {
+        const NsInterp      *itPtr = clientData;
+        NsServer            *servPtr = itPtr->servPtr;
+        Tcl_DString          frameDs, membersDs;
+        const char          *frameString = NULL;
+        TCL_SIZE_T           frameLength = 0;
+        const Tcl_HashEntry *hPtr;
+        Tcl_Obj             *dictObj;
+        int                  nSent = 0, nFailed = 0;
+
+        Tcl_DStringInit(&frameDs);
+        Tcl_DStringInit(&membersDs);
+
+        if (raw == 1) {
+            frameString = (const char *)Tcl_GetByteArrayFromObj(messageObj, &frameLength);
         } else {
-            Tcl_DStringSetLength(&frameDs, (TCL_SIZE_T)offset + messageLength);
-            data = (unsigned char *)frameDs.string;
-            memcpy(&data[offset], &messageString[0], (size_t)messageLength);
+            result = WebsocketMessageEncode(interp, &frameDs, messageObj, opcode,
+                                            isBinary == 1, NS_TRUE, NS_FALSE, compress == 1);
+            frameString = frameDs.string;
+            frameLength = frameDs.length;
         }
 
-        Tcl_SetObjResult(interp, Tcl_NewByteArrayObj(data, frameDs.length));
+        if (result == TCL_OK) {
+            /*
+             * Collect the member names (separated by null bytes) to
+             * avoid holding the lock while sending.
+             */
+            Ns_RWLockRdLock(&servPtr->connchans.lock);
+            hPtr = Tcl_FindHashEntry(&servPtr->connchans.groups, group);
+            if (hPtr != NULL) {
+                Tcl_HashTable       *membersPtr = Tcl_GetHashValue(hPtr);
+                const Tcl_HashEntry *memberPtr;
+                Tcl_HashSearch       search;
+
+                for (memberPtr = Tcl_FirstHashEntry(membersPtr, &search); memberPtr != NULL;
+                     memberPtr = Tcl_NextHashEntry(&search)) {
+                    const char *name = Tcl_GetHashKey(membersPtr, memberPtr);
+
+                    Tcl_DStringAppend(&membersDs, name, (TCL_SIZE_T)strlen(name) + 1);
+                }
+            }
+            Ns_RWLockUnlock(&servPtr->connchans.lock);
+
+            {
+                const char *name = membersDs.string, *end = membersDs.string + membersDs.length;
+
+                while (name < end) {
+                    ssize_t       bytesSent;
+                    unsigned long errorCode;
+
+                    if (NsConnChanWrite(interp, name, frameString, frameLength,
+                                        &bytesSent, &errorCode) == TCL_OK) {
+                        nSent++;
+                    } else {
+                        Ns_Log(Ns_LogConnchanDebug, "ns_connchan broadcast: write to %s failed: %s",
+                               name, Tcl_GetStringResult(interp));
+                        Tcl_ResetResult(interp);
+                        nFailed++;
+                    }
+                    name += strlen(name) + 1;
+                }
+            }
+
+            dictObj = Tcl_NewDictObj();
+            Tcl_DictObjPut(NULL, dictObj,
+                           NsAtomObj(NS_ATOM_sent),
+                           Tcl_NewIntObj(nSent));
+            Tcl_DictObjPut(NULL, dictObj,
+                           Tcl_NewStringObj("failed", 6),
+                           Tcl_NewIntObj(nFailed));
+            Tcl_SetObjResult(interp, dictObj);
+        }
 
-        Tcl_DStringFree(&messageDs);
         Tcl_DStringFree(&frameDs);
+        Tcl_DStringFree(&membersDs);
     }
     return result;
 }
 
 
-
-
 /*
  *----------------------------------------------------------------------
  *
@@ -3647,19 +4175,23 @@ int
 NsTclConnChanObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
     const Ns_SubCmdSpec subcmds[] = {
-        {"callback", ConnChanCallbackObjCmd},
-        {"connect",  ConnChanConnectObjCmd},
-        {"close",    ConnChanCloseObjCmd},
-        {"debug",    ConnChanDebugObjCmd},
-        {"detach",   ConnChanDetachObjCmd},
-        {"exists",   ConnChanExistsObjCmd},
-        {"list",     ConnChanListObjCmd},
-        {"listen",   ConnChanListenObjCmd},
-        {"open",     ConnChanOpenObjCmd},
-        {"read",     ConnChanReadObjCmd},
-        {"status",   ConnChanStatusObjCmd},
-        {"write",    ConnChanWriteObjCmd},
-        {"wsencode", ConnChanWsencodeObjCmd},
+        {"broadcast",   ConnChanBroadcastObjCmd},
+        {"callback",    ConnChanCallbackObjCmd},
+        {"connect",     ConnChanConnectObjCmd},
+        {"close",       ConnChanCloseObjCmd},
+        {"debug",       ConnChanDebugObjCmd},
+        {"detach",      ConnChanDetachObjCmd},
+        {"exists",      ConnChanExistsObjCmd},
+        {"groups",      ConnChanGroupsObjCmd},
+        {"list",        ConnChanListObjCmd},
+        {"listen",      ConnChanListenObjCmd},
+        {"open",        ConnChanOpenObjCmd},
+        {"read",        ConnChanReadObjCmd},
+        {"status",      ConnChanStatusObjCmd},
+        {"subscribe",   ConnChanSubscribeObjCmd},
+        {"unsubscribe", ConnChanUnsubscribeObjCmd},
+        {"write",       ConnChanWriteObjCmd},
+        {"wsencode",    ConnChanWsencodeObjCmd},
         {NULL, NULL}
     };
     return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
@@ -286,6 +286,10 @@ Ns_ConnWriteVData(Ns_Conn *conn, struct iovec *bufs, int nbufs, unsigned int fla
     bodyLength = (bufs != NULL) ? Ns_SumVec(bufs, nbufs) : 0u;
     toWrite = 0u;
 
+    if (((const Conn *)conn)->rcFillPtr != NULL) {
+        NsRespCacheCapture((const Conn *)conn, bufs, nbufs);
+    }
+
     if ((flags & NS_CONN_STREAM) != 0u) {
         conn->flags |= NS_CONN_STREAM;
     }
@@ -315,6 +319,18 @@ Ns_ConnWriteVData(Ns_Conn *conn, struct iovec *bufs, int nbufs, unsigned int fla
         }
     }
 
+    if (((const Conn *)conn)->rcFillPtr != NULL
+        && (conn->flags & NS_CONN_STREAM) == 0u
+        && ((const Conn *)conn)->responseLength == (ssize_t)bodyLength) {
+        /*
+         * The complete response is sent with this call. Store it in the
+         * response cache before the client can see the end of the
+         * response, since the client might send the next request
+         * before Ns_ConnClose() is called.
+         */
+        NsRespCacheStore((Conn *)conn);
+    }
+
     /*
      * Send body.
      */
@@ -793,6 +809,14 @@ Ns_ConnClose(Ns_Conn *conn)
            connPtr->flags & NS_CONN_SENT_VIA_WRITER,
            (void *)connPtr->sockPtr);
 
+    if (connPtr->rcFillPtr != NULL) {
+        /*
+         * Store the response in the response cache before the client
+         * can see the end of the response.
+         */
+        NsRespCacheStore(connPtr);
+    }
+
     if (connPtr->sockPtr != NULL) {
 
         if ((connPtr->flags & NS_CONN_STREAM) != 0u
@@ -969,6 +993,90 @@ Ns_ConnRead(const Ns_Conn *conn, void *vbuf, size_t toRead)
     return toRead;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_ConnReadBody --
+ *
+ *      Read the next bytes of the request body. For requests to handlers
+ *      registered with NS_OP_STREAMBODY, the body is received from the
+ *      socket only when it is read, such that the client is slowed down
+ *      by TCP flow control when the consumer is slower than the
+ *      client. For other requests, the function returns the bytes of the
+ *      read-ahead buffers like Ns_ConnRead().
+ *
+ * Results:
+ *      Number of bytes read, 0 at the end of the body, or -1 on error
+ *      or timeout. When timeoutPtr is NULL, the "recvwait" of the driver
+ *      is used.
+ *
+ * Side effects:
+ *      May block the calling thread up to the timeout.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+Ns_ConnReadBody(const Ns_Conn *conn, void *vbuf, size_t toRead, const Ns_Time *timeoutPtr)
+{
+    const Conn *connPtr = (const Conn *) conn;
+    Request    *reqPtr = connPtr->reqPtr;
+    Sock       *sockPtr = connPtr->sockPtr;
+    ssize_t     result;
+
+    NS_NONNULL_ASSERT(conn != NULL);
+    NS_NONNULL_ASSERT(vbuf != NULL);
+
+    if (sockPtr == NULL || reqPtr == NULL) {
+        result = -1;
+
+    } else if (reqPtr->avail > 0u || !reqPtr->streamBody) {
+        result = (ssize_t)Ns_ConnRead(conn, vbuf, toRead);
+
+    } else if (reqPtr->streamRemaining == 0u || toRead == 0u) {
+        result = 0;
+
+    } else {
+        struct iovec buf;
+        Ns_Time      timeout;
+
+        timeout = (timeoutPtr != NULL) ? *timeoutPtr : connPtr->drvPtr->recvwait;
+        buf.iov_base = vbuf;
+        buf.iov_len = MIN(toRead, reqPtr->streamRemaining);
+
+        for (;;) {
+            Ns_SockState sockState;
+
+            result = NsDriverRecv(sockPtr, &buf, 1, &timeout);
+            sockState = sockPtr->recvSockState;
+
+            if (result > 0) {
+                reqPtr->streamRemaining -= (size_t)result;
+                break;
+            }
+            if (sockState == NS_SOCK_AGAIN
+                || (sockState == NS_SOCK_NONE && result == 0)) {
+                if (Ns_SockTimedWait(sockPtr->sock, (unsigned int)NS_SOCK_READ,
+                                     &timeout) == NS_OK) {
+                    continue;
+                }
+                sockState = NS_SOCK_TIMEOUT;
+                sockPtr->recvSockState = sockState;
+            }
+            Ns_Log(Notice, "request body: %s after receiving %" PRIuz " of %" PRIuz " bytes",
+                   sockState == NS_SOCK_TIMEOUT ? "timeout"
+                   : sockState == NS_SOCK_DONE ? "peer closed connection" : "receive error",
+                   connPtr->contentLength - reqPtr->streamRemaining,
+                   connPtr->contentLength);
+            result = -1;
+            break;
+        }
+    }
+
+    return result;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -1542,6 +1650,15 @@ CheckKeep(const Conn *connPtr)
     NS_NONNULL_ASSERT(connPtr != NULL);
 
     do {
+        if (connPtr->reqPtr != NULL
+            && connPtr->reqPtr->streamBody
+            && (connPtr->reqPtr->streamRemaining > 0u || connPtr->reqPtr->avail > 0u)) {
+            /*
+             * The request body was not read completely, the remaining
+             * bytes cannot be distinguished from a next request.
+             */
+            break;
+        }
         if (connPtr->drvPtr->keepwait.sec > 0 || connPtr->drvPtr->keepwait.usec > 0 ) {
             /*
              * Check for manual keep-alive override.
@@ -580,6 +580,34 @@ Ns_ConnGetCookie(Tcl_DString *dest, const Ns_Conn *conn, const char *name)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsHeadersGetCookie --
+ *
+ *      Get first matching cookie from the "cookie" fields of the
+ *      provided request header set, e.g. of a request to be sent.
+ *
+ * Results:
+ *      dest->string or NULL when the cookie was not found.
+ *
+ * Side effects:
+ *      Cookie value is CookieDecoded before placement in dest.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+NsHeadersGetCookie(Tcl_DString *dest, const Ns_Set *hdrs, const char *name)
+{
+    NS_NONNULL_ASSERT(dest != NULL);
+    NS_NONNULL_ASSERT(hdrs != NULL);
+    NS_NONNULL_ASSERT(name != NULL);
+
+    return GetFirstNamedCookie(dest, hdrs, "cookie", name) != -1 ? dest->string : NULL;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -45,11 +45,37 @@ typedef bool (GetProc)(Tcl_DString *dsPtr, const char *key);
  * Static functions defined in this file
  */
 
+/*
+ * A DnsQuery is a lookup performed by one of the resolver threads. Concurrent
+ * requests for the same key share the same query. The query is freed when
+ * the resolver thread and all waiting requesters have released it.
+ */
+
+typedef struct DnsQuery {
+    struct DnsQuery *nextPtr;   /* Next query in the resolver queue. */
+    Tcl_HashEntry   *hPtr;      /* Entry in the table of pending queries. */
+    GetProc         *getProc;   /* GetAddr or GetHost. */
+    Ns_Cache        *cache;     /* Cache receiving the result. */
+    int              refCount;  /* Resolver thread plus waiting requesters. */
+    bool             done;      /* Lookup has finished. */
+    bool             success;   /* Lookup has returned a result. */
+    bool             prefetch;  /* Refresh of an entry still in the cache. */
+    Tcl_DString      ds;        /* Result of the lookup. */
+    char             key[1];    /* Hostname or address to resolve. */
+} DnsQuery;
+
 static GetProc GetAddr;
 static GetProc GetHost;
 static bool DnsGet(GetProc *getProc, Tcl_DString *dsPtr,
                    Ns_Cache *cache, const char *key, bool all)
     NS_GNUC_NONNULL(1,2,4);
+static DnsQuery *DnsQueue(GetProc *getProc, Ns_Cache *cache, const char *key, bool prefetch, bool *isNewPtr)
+    NS_GNUC_NONNULL(1,2,3,5) NS_GNUC_RETURNS_NONNULL;
+static void DnsRelease(DnsQuery *queryPtr)
+    NS_GNUC_NONNULL(1);
+static void DnsCacheResult(const DnsQuery *queryPtr, const Ns_Time *startPtr)
+    NS_GNUC_NONNULL(1,2);
+static Ns_ThreadProc ResolverThread;
 
 
 #if !defined(HAVE_GETADDRINFO) && !defined(HAVE_GETNAMEINFO)
@@ -64,9 +90,43 @@ static void LogError(char *func, int h_errnop);
 static Ns_Cache *hostCache;
 static Ns_Cache *addrCache;
 static Ns_Time   ttl;       /* Time in seconds each entry can live in the cache. */
+static Ns_Time   negativeTTL; /* Time in seconds to keep failed lookups in the cache. */
+static Ns_Time   prefetchTime; /* Refresh popular entries expiring within this time. */
 static Ns_Time   timeout;   /* Time in seconds to wait for concurrent update.  */
 static Ns_Cs     getDNScs = NULL;
 
+/*
+ * The resolver threads perform the potentially blocking lookups for cached
+ * DNS requests. Requesters wait at most "dnswaittimeout" for the result; the
+ * lookup continues in the background and fills the cache for later requests.
+ */
+
+static struct {
+    Ns_Mutex       lock;
+    Ns_Cond        queueCond;   /* Signaled when a query is queued. */
+    Ns_Cond        doneCond;    /* Broadcast when a query has finished. */
+    DnsQuery      *firstPtr;    /* Queue of pending lookups. */
+    DnsQuery      *lastPtr;
+    Tcl_HashTable  pending;     /* Queued or running queries by key. */
+    Ns_Thread     *threads;     /* Started resolver threads, joined at shutdown. */
+    bool           stopping;    /* Set by NsStartDNSShutdown(). */
+    int            maxThreads;
+    int            nStarted;
+    int            nThreads;
+    int            nIdle;
+    int            nQueued;
+    struct {
+        unsigned long lookups;
+        unsigned long hits;
+        unsigned long negativeHits;
+        unsigned long queries;
+        unsigned long shared;
+        unsigned long failures;
+        unsigned long timeouts;
+        unsigned long prefetches;
+    } stats;
+} resolver;
+
 
 
 /*
@@ -100,6 +160,30 @@ NsConfigDNS(void)
             Ns_ConfigTimeUnitRange(section, "dnscachetimeout",
                                    "60m", 0, 0, INT_MAX, 0,
                                    &ttl);
+            Ns_ConfigTimeUnitRange(section, "dnscachenegativetimeout",
+                                   "10s", 0, 0, INT_MAX, 0,
+                                   &negativeTTL);
+            Ns_ConfigTimeUnitRange(section, "dnsprefetchtime",
+                                   "1m", 0, 0, INT_MAX, 0,
+                                   &prefetchTime);
+            resolver.maxThreads = Ns_ConfigIntRange(section, "dnsresolverthreads",
+                                                    4, 1, 100);
+
+            /*
+             * Refreshing more than half of the lifetime before expiry
+             * would mostly cause useless lookups.
+             */
+            if (2 * prefetchTime.sec > ttl.sec) {
+                prefetchTime.sec = ttl.sec / 2;
+                prefetchTime.usec = 0;
+            }
+
+            Ns_MutexInit(&resolver.lock);
+            Ns_MutexSetName2(&resolver.lock, "ns:dns", "resolver");
+            Ns_CondInit(&resolver.queueCond);
+            Ns_CondInit(&resolver.doneCond);
+            Tcl_InitHashTable(&resolver.pending, TCL_STRING_KEYS);
+            resolver.threads = ns_calloc((size_t)resolver.maxThreads, sizeof(Ns_Thread));
 
             hostCache = Ns_CacheCreateSz("ns:dnshost", TCL_STRING_KEYS,
                                          maxSize, ns_free);
@@ -160,8 +244,6 @@ static bool
 DnsGet(GetProc *getProc, Tcl_DString *dsPtr, Ns_Cache *cache, const char *key, bool all)
 {
     Tcl_DString ds;
-    Ns_Time     t;
-    int         isNew;
     bool        success;
 
     NS_NONNULL_ASSERT(getProc != NULL);
@@ -176,45 +258,101 @@ DnsGet(GetProc *getProc, Tcl_DString *dsPtr, Ns_Cache *cache, const char *key, b
     if (cache == NULL) {
         success = (*getProc)(&ds, key);
     } else {
-        Ns_Entry   *entry;
-
-        Ns_GetTime(&t);
-        Ns_IncrTime(&t, timeout.sec, timeout.usec);
+        const Ns_Entry *entry;
+        bool            found = NS_FALSE, prefetch = NS_FALSE;
 
         Ns_CacheLock(cache);
-        entry = Ns_CacheWaitCreateEntry(cache, key, &isNew, &t);
-        if (entry == NULL) {
-            Ns_CacheUnlock(cache);
-            Ns_Log(Notice, "dns: timeout waiting for concurrent update");
-            success = NS_FALSE;
+        entry = Ns_CacheFindEntry(cache, key);
+        if (entry != NULL) {
+            size_t size = Ns_CacheGetSize(entry);
+
+            found = NS_TRUE;
+            if (size > 0u) {
+                Tcl_DStringAppend(&ds, Ns_CacheGetValue(entry), (TCL_SIZE_T)size);
+
+                /*
+                 * Refresh entries requested repeatedly shortly before
+                 * they expire, such that requesters don't have to wait.
+                 */
+                if (prefetchTime.sec > 0 || prefetchTime.usec > 0) {
+                    Ns_Time now, remaining;
+
+                    Ns_GetTime(&now);
+                    (void)Ns_DiffTime(Ns_CacheGetExpirey(entry), &now, &remaining);
+                    prefetch = (Ns_CacheGetReuse(entry) > 1u
+                                && Ns_DiffTime(&remaining, &prefetchTime, NULL) < 0);
+                }
+            }
+        }
+        Ns_CacheUnlock(cache);
+
+        if (found) {
+            /*
+             * Negative results are cached as empty values.
+             */
+            success = (ds.length > 0);
+
+            Ns_MutexLock(&resolver.lock);
+            resolver.stats.lookups++;
+            if (success) {
+                resolver.stats.hits++;
+            } else {
+                resolver.stats.negativeHits++;
+            }
+            if (prefetch && !resolver.stopping) {
+                bool isNew;
+
+                DnsRelease(DnsQueue(getProc, cache, key, NS_TRUE, &isNew));
+                if (isNew) {
+                    resolver.stats.prefetches++;
+                }
+            }
+            Ns_MutexUnlock(&resolver.lock);
 
         } else {
-            if (isNew != 0) {
-                Ns_CacheUnlock(cache);
+            DnsQuery *queryPtr;
+            Ns_Time   t;
+            bool      isNew;
+
+            Ns_GetTime(&t);
+            Ns_IncrTime(&t, timeout.sec, timeout.usec);
+
+            Ns_MutexLock(&resolver.lock);
+            resolver.stats.lookups++;
+            if (resolver.stopping) {
+                /*
+                 * The resolver threads are shutting down, perform the
+                 * lookup in the calling thread.
+                 */
+                Ns_MutexUnlock(&resolver.lock);
                 success = (*getProc)(&ds, key);
-                Ns_CacheLock(cache);
-                if (!success) {
-                    Ns_CacheDeleteEntry(entry);
+
+            } else {
+                queryPtr = DnsQueue(getProc, cache, key, NS_FALSE, &isNew);
+                if (isNew) {
+                    resolver.stats.queries++;
                 } else {
-                    Ns_Time endTime, diffTime;
-
-                    Ns_GetTime(&endTime);
-                    (void)Ns_DiffTime(&endTime, &t, &diffTime);
-                    Ns_IncrTime(&endTime, ttl.sec, ttl.usec);
-                    Ns_CacheSetValueExpires(entry, ns_strdup(ds.string),
-                                            (size_t)ds.length, &endTime,
-                                            (int)(diffTime.sec * 1000000 + diffTime.usec),
-                                            0u, 0u);
+                    resolver.stats.shared++;
                 }
-                Ns_CacheBroadcast(cache);
-            } else {
-                Tcl_DStringAppend(&ds, Ns_CacheGetValue(entry),
-                                  (TCL_SIZE_T)Ns_CacheGetSize(entry));
-                success = NS_TRUE;
+                while (!queryPtr->done) {
+                    if (Ns_CondTimedWait(&resolver.doneCond, &resolver.lock, &t) != NS_OK) {
+                        break;
+                    }
+                }
+                if (!queryPtr->done) {
+                    resolver.stats.timeouts++;
+                    Ns_Log(Notice, "dns: timeout waiting for lookup of '%s'", key);
+                    success = NS_FALSE;
+                } else {
+                    success = queryPtr->success;
+                    if (success) {
+                        Tcl_DStringAppend(&ds, queryPtr->ds.string, queryPtr->ds.length);
+                    }
+                }
+                DnsRelease(queryPtr);
+                Ns_MutexUnlock(&resolver.lock);
             }
-            Ns_CacheUnlock(cache);
         }
-
     }
 
     if (success) {
@@ -238,6 +376,327 @@ DnsGet(GetProc *getProc, Tcl_DString *dsPtr, Ns_Cache *cache, const char *key, b
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * DnsQueue --
+ *
+ *      Return the pending query for the given key, or queue a new one
+ *      for the resolver threads. A further resolver thread is started
+ *      when all running threads are busy. Must be called with the
+ *      resolver lock held.
+ *
+ * Results:
+ *      Query with incremented reference count; isNewPtr is set to
+ *      NS_TRUE when the query was newly created.
+ *
+ * Side effects:
+ *      May create a resolver thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static DnsQuery *
+DnsQueue(GetProc *getProc, Ns_Cache *cache, const char *key, bool prefetch, bool *isNewPtr)
+{
+    DnsQuery      *queryPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_DString    ds;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(getProc != NULL);
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(isNewPtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    Tcl_DStringAppend(&ds, getProc == GetAddr ? "a:" : "h:", 2);
+    Tcl_DStringAppend(&ds, key, TCL_INDEX_NONE);
+    hPtr = Tcl_CreateHashEntry(&resolver.pending, ds.string, &isNew);
+    Tcl_DStringFree(&ds);
+
+    if (isNew == 0) {
+        queryPtr = Tcl_GetHashValue(hPtr);
+    } else {
+        size_t keyLength = strlen(key);
+
+        queryPtr = ns_calloc(1u, sizeof(DnsQuery) + keyLength);
+        memcpy(queryPtr->key, key, keyLength + 1u);
+        queryPtr->hPtr = hPtr;
+        queryPtr->getProc = getProc;
+        queryPtr->cache = cache;
+        queryPtr->prefetch = prefetch;
+        queryPtr->refCount = 1;
+        Tcl_DStringInit(&queryPtr->ds);
+        Tcl_SetHashValue(hPtr, queryPtr);
+
+        if (resolver.lastPtr == NULL) {
+            resolver.firstPtr = queryPtr;
+        } else {
+            resolver.lastPtr->nextPtr = queryPtr;
+        }
+        resolver.lastPtr = queryPtr;
+        resolver.nQueued++;
+
+        if (resolver.nQueued > resolver.nIdle && resolver.nStarted < resolver.maxThreads) {
+            resolver.nThreads++;
+            Ns_ThreadCreate(ResolverThread, NULL, 0, &resolver.threads[resolver.nStarted++]);
+        } else {
+            Ns_CondSignal(&resolver.queueCond);
+        }
+    }
+    queryPtr->refCount++;
+    *isNewPtr = (isNew != 0);
+
+    return queryPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DnsRelease --
+ *
+ *      Drop a reference to a query and free it when unused. Must be
+ *      called with the resolver lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May free the query.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DnsRelease(DnsQuery *queryPtr)
+{
+    NS_NONNULL_ASSERT(queryPtr != NULL);
+
+    if (--queryPtr->refCount == 0) {
+        Tcl_DStringFree(&queryPtr->ds);
+        ns_free(queryPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DnsCacheResult --
+ *
+ *      Store the result of a finished lookup in the cache. Failed
+ *      lookups are cached as empty values for "dnscachenegativetimeout";
+ *      a failed refresh keeps the previous entry until it expires.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the cache and wakes up waiters on the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DnsCacheResult(const DnsQuery *queryPtr, const Ns_Time *startPtr)
+{
+    Ns_Cache *cache = queryPtr->cache;
+    Ns_Entry *entry;
+    Ns_Time   endTime, diffTime;
+    int       isNew;
+    bool      negative;
+
+    NS_NONNULL_ASSERT(queryPtr != NULL);
+    NS_NONNULL_ASSERT(startPtr != NULL);
+
+    negative = (!queryPtr->success && !queryPtr->prefetch
+                && (negativeTTL.sec > 0 || negativeTTL.usec > 0));
+
+    Ns_GetTime(&endTime);
+    (void)Ns_DiffTime(&endTime, startPtr, &diffTime);
+
+    Ns_CacheLock(cache);
+    entry = Ns_CacheCreateEntry(cache, queryPtr->key, &isNew);
+    if (queryPtr->success) {
+        Ns_IncrTime(&endTime, ttl.sec, ttl.usec);
+        Ns_CacheSetValueExpires(entry, ns_strdup(queryPtr->ds.string),
+                                (size_t)queryPtr->ds.length, &endTime,
+                                (int)(diffTime.sec * 1000000 + diffTime.usec),
+                                0u, 0u);
+    } else if (negative) {
+        Ns_IncrTime(&endTime, negativeTTL.sec, negativeTTL.usec);
+        Ns_CacheSetValueExpires(entry, ns_strdup(""), 0u, &endTime,
+                                (int)(diffTime.sec * 1000000 + diffTime.usec),
+                                0u, 0u);
+    } else if (isNew != 0) {
+        Ns_CacheDeleteEntry(entry);
+    }
+    Ns_CacheBroadcast(cache);
+    Ns_CacheUnlock(cache);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolverThread --
+ *
+ *      Resolver thread, performing the queued lookups and caching their
+ *      results. The thread exits on shutdown after the queue is drained.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Wakes up requesters waiting for a finished query.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ResolverThread(void *UNUSED(arg))
+{
+    Ns_ThreadSetName("-dns-");
+    Ns_Log(Notice, "dns: resolver thread starting");
+
+    Ns_MutexLock(&resolver.lock);
+    for (;;) {
+        DnsQuery *queryPtr;
+        Ns_Time   startTime;
+
+        while (resolver.firstPtr == NULL && !resolver.stopping) {
+            resolver.nIdle++;
+            Ns_CondWait(&resolver.queueCond, &resolver.lock);
+            resolver.nIdle--;
+        }
+        if (resolver.firstPtr == NULL) {
+            break;
+        }
+        queryPtr = resolver.firstPtr;
+        resolver.firstPtr = queryPtr->nextPtr;
+        if (resolver.firstPtr == NULL) {
+            resolver.lastPtr = NULL;
+        }
+        resolver.nQueued--;
+        Ns_MutexUnlock(&resolver.lock);
+
+        Ns_GetTime(&startTime);
+        queryPtr->success = (*queryPtr->getProc)(&queryPtr->ds, queryPtr->key);
+        DnsCacheResult(queryPtr, &startTime);
+
+        Ns_MutexLock(&resolver.lock);
+        if (!queryPtr->success) {
+            resolver.stats.failures++;
+        }
+        queryPtr->done = NS_TRUE;
+        Tcl_DeleteHashEntry(queryPtr->hPtr);
+        queryPtr->hPtr = NULL;
+        Ns_CondBroadcast(&resolver.doneCond);
+        DnsRelease(queryPtr);
+    }
+    resolver.nThreads--;
+    Ns_CondBroadcast(&resolver.doneCond);
+    Ns_MutexUnlock(&resolver.lock);
+
+    Ns_Log(Notice, "dns: resolver thread exiting");
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsStartDNSShutdown, NsWaitDNSShutdown --
+ *
+ *      Initiate and then wait for the shutdown of the resolver threads.
+ *      Lookups still queued are performed before the threads exit.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May timeout waiting for shutdown.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsStartDNSShutdown(void)
+{
+    if (addrCache != NULL) {
+        Ns_MutexLock(&resolver.lock);
+        resolver.stopping = NS_TRUE;
+        Ns_CondBroadcast(&resolver.queueCond);
+        Ns_MutexUnlock(&resolver.lock);
+    }
+}
+
+void
+NsWaitDNSShutdown(const Ns_Time *toPtr)
+{
+    if (addrCache != NULL) {
+        Ns_ReturnCode status = NS_OK;
+
+        NS_NONNULL_ASSERT(toPtr != NULL);
+
+        Ns_MutexLock(&resolver.lock);
+        while (status == NS_OK && resolver.nThreads > 0) {
+            status = Ns_CondTimedWait(&resolver.doneCond, &resolver.lock, toPtr);
+        }
+        Ns_MutexUnlock(&resolver.lock);
+
+        if (status != NS_OK) {
+            Ns_Log(Warning, "dns: timeout waiting for resolver threads to exit");
+        } else {
+            int i;
+
+            for (i = 0; i < resolver.nStarted; i++) {
+                Ns_ThreadJoin(&resolver.threads[i], NULL);
+            }
+            resolver.nStarted = 0;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsGetDNSStats --
+ *
+ *      Return statistics of the DNS resolver as a Tcl dict.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Statistics are appended to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsGetDNSStats(Tcl_DString *dsPtr)
+{
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    if (addrCache == NULL) {
+        Ns_DStringPrintf(dsPtr, "cache 0");
+    } else {
+        Ns_MutexLock(&resolver.lock);
+        Ns_DStringPrintf(dsPtr, "cache 1 lookups %lu hits %lu negativehits %lu"
+                         " queries %lu shared %lu failures %lu timeouts %lu prefetches %lu"
+                         " threads %d idle %d queued %d",
+                         resolver.stats.lookups, resolver.stats.hits, resolver.stats.negativeHits,
+                         resolver.stats.queries, resolver.stats.shared, resolver.stats.failures,
+                         resolver.stats.timeouts, resolver.stats.prefetches,
+                         resolver.nThreads, resolver.nIdle, resolver.nQueued);
+        Ns_MutexUnlock(&resolver.lock);
+    }
+}
+
+
 /**********************************************************************
  * Begin IPv6
  **********************************************************************/
@@ -296,6 +296,8 @@ static char *PortsPrint(Tcl_DString *dsPtr, const Ns_DList *dlPtr)
 
 static Ns_ReturnCode SockSetServer(Sock *sockPtr)
     NS_GNUC_NONNULL(1);
+static NsServer *SockLookupServer(Sock *sockPtr)
+    NS_GNUC_NONNULL(1);
 static SockState SockAccept(Driver *drvPtr, NS_SOCKET sock, Sock **sockPtrPtr, const Ns_Time *nowPtr, void *arg)
     NS_GNUC_NONNULL(1);
 static Ns_ReturnCode SockQueue(Sock *sockPtr, const Ns_Time *timePtr)
@@ -2041,6 +2043,14 @@ DriverStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T
             Tcl_ListObjAppendElement(interp, listObj, NsAtomObj(NS_ATOM_closing));
             Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj((Tcl_WideInt)drvPtr->stats.closing));
 
+            if ((drvPtr->opts & NS_DRIVER_SSL) != 0u) {
+                Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("tlsfull", 7));
+                Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(drvPtr->stats.tlsfull));
+
+                Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("tlsresumed", 10));
+                Tcl_ListObjAppendElement(interp, listObj, Tcl_NewWideIntObj(drvPtr->stats.tlsresumed));
+            }
+
             Tcl_ListObjAppendElement(interp, resultObj, listObj);
         }
         Tcl_SetObjResult(interp, resultObj);
@@ -3920,6 +3930,9 @@ RequestFree(Sock *sockPtr, const char *caller)
     reqPtr->avail          = 0u;
     reqPtr->savedChar      = '\0';
 
+    reqPtr->streamBody      = NS_FALSE;
+    reqPtr->streamRemaining = 0u;
+
     /*
      * In the normal request path, headers are usually cleared earlier.
      * For early driver-level terminations, such as queue-full 503 responses
@@ -3944,6 +3957,11 @@ RequestFree(Sock *sockPtr, const char *caller)
         reqPtr->auth = NULL;
     }
 
+    if (reqPtr->multipartPtr != NULL) {
+        NsMultipartParserFree(reqPtr->multipartPtr);
+        reqPtr->multipartPtr = NULL;
+    }
+
     if (reqPtr->request.line != NULL) {
         Ns_Log(DriverDebug, "RequestFree calls Ns_ResetRequest on %p", (void*)&reqPtr->request);
         Ns_ResetRequest(&reqPtr->request);
@@ -4035,6 +4053,22 @@ SockQueueTry(Sock *sockPtr, const Ns_Time *timePtr,
         assert(sockPtr->servPtr != NULL
                || *sockPtr->reqPtr->request.method == 'B');
 
+        /*
+         * Answer the request from the response cache when possible,
+         * without involving a connection thread.
+         */
+        if (sockPtr->servPtr != NULL && sockPtr->servPtr->respcache.cache != NULL) {
+            switch (NsRespCacheDriverServe(sockPtr, timePtr)) {
+            case NS_RESPCACHE_SENT:
+                return NS_OK;
+            case NS_RESPCACHE_ERROR:
+                *failurePtr = SOCK_WRITEERROR;
+                return NS_ERROR;
+            case NS_RESPCACHE_QUEUE:
+                break;
+            }
+        }
+
         /*
          * NS_OK transfers ownership to a connection queue. NS_TIMEOUT
          * retains driver ownership for a later retry. NS_ERROR requires
@@ -4686,6 +4720,10 @@ SockReleaseEx(Sock *sockPtr, SockState reason, int err, bool keep)
 
     NsSlsCleanup(sockPtr);
 
+    if (sockPtr->rcSendPtr != NULL) {
+        NsRespCacheSendFree(sockPtr);
+    }
+
     drvPtr->queuesize--;
 
     if (sockPtr->reqPtr != NULL) {
@@ -5213,7 +5251,19 @@ SockClose(Sock *sockPtr, int keep)
         keep = (int)driverKeep;
     }
     if (keep == (int)NS_FALSE) {
-        DriverClose(sockPtr);
+        if (sockPtr->reqPtr != NULL && sockPtr->reqPtr->streamRemaining > 0u) {
+            /*
+             * The body of a streamed request was not read completely.
+             * Closing the socket now would reset the connection and might
+             * discard the response at the client. Leave the socket open,
+             * such that the driver thread shuts it down for writing and
+             * drains the input during "closewait" before releasing it.
+             */
+            Ns_Log(DriverDebug, "SockClose: %" PRIuz " bytes of streamed request body unread (sock %d)",
+                   sockPtr->reqPtr->streamRemaining, sockPtr->sock);
+        } else {
+            DriverClose(sockPtr);
+        }
     }
     Ns_MutexLock(&sockPtr->drvPtr->lock);
     sockPtr->keep = (bool)keep;
@@ -5607,6 +5657,17 @@ SockRead(Sock *sockPtr, int spooler, const Ns_Time *timePtr)
         if (ns_write(sockPtr->tfd, bufPtr->string + reqPtr->coff, (size_t)n) != n) {
             return SOCK_WRITEERROR;
         }
+
+        /*
+         * Parse multipart content incrementally while it is spooled, such
+         * that the connection thread receives the parsed form with the
+         * file parts in separate files.
+         */
+        reqPtr->multipartPtr = NsMultipartParserNew(reqPtr->headers, reqPtr->length,
+                                                    drvPtr->uploadpath);
+        if (reqPtr->multipartPtr != NULL) {
+            NsMultipartParserFeed(reqPtr->multipartPtr, bufPtr->string + reqPtr->coff, (size_t)n);
+        }
         Tcl_DStringSetLength(bufPtr, 0);
     }
 #endif
@@ -5694,6 +5755,9 @@ SockRead(Sock *sockPtr, int spooler, const Ns_Time *timePtr)
         if (ns_write(sockPtr->tfd, tbuf, (size_t)n) != n) {
             return SOCK_WRITEERROR;
         }
+        if (reqPtr->multipartPtr != NULL) {
+            NsMultipartParserFeed(reqPtr->multipartPtr, tbuf, (size_t)n);
+        }
     } else {
         Tcl_DStringSetLength(bufPtr, (TCL_SIZE_T)(buflen + (size_t)n));
     }
@@ -6402,12 +6466,14 @@ SockParse(Sock *sockPtr)
     while (reqPtr->coff == 0u) {
         char *s, *e;
         size_t cnt;
+        bool   valid;
 
         /*
-         * Find the next header line.
+         * Find the next header line and check it for control
+         * characters in the same pass.
          */
         s = bufPtr->string + reqPtr->roff;
-        e = memchr(s, INTCHAR('\n'), reqPtr->avail);
+        e = (char *)NsHttpScanLine(s, reqPtr->avail, &valid);
 
         if (unlikely(e == NULL)) {
             /*
@@ -6416,6 +6482,20 @@ SockParse(Sock *sockPtr)
             return SOCK_MORE;
         }
 
+        if (unlikely(!valid)) {
+            /*
+             * Control characters (except HTAB) are not allowed in the
+             * request line and in header fields (RFC 9110, section
+             * 5.5). Reject the request, since different
+             * interpretations of such lines are a source of request
+             * smuggling.
+             */
+            Ns_Log(DriverDebug, "SockParse (%d): control character in request %s",
+                   sockPtr->sock, reqPtr->request.line == NULL ? "line" : "header field");
+            sockPtr->keep = NS_FALSE;
+            return (reqPtr->request.line == NULL) ? SOCK_BADREQUEST : SOCK_BADHEADER;
+        }
+
         /*
          * Check for max single line overflows.
          *
@@ -6539,6 +6619,20 @@ SockParse(Sock *sockPtr)
                     }
                 }
             }
+
+            /*
+             * Requests for handlers registered with NS_OP_STREAMBODY are
+             * dispatched without waiting for the body. The connection
+             * thread receives the body via Ns_ConnReadBody().
+             */
+            if (reqPtr->length > reqPtr->avail
+                && reqPtr->chunkStartOff == 0u
+                && (sockPtr->flags & NS_CONN_ENTITYTOOLARGE) == 0u) {
+                NsServer *servPtr = SockLookupServer(sockPtr);
+
+                reqPtr->streamBody = (servPtr != NULL
+                                      && NsRequestStreamBody(servPtr, &reqPtr->request));
+            }
         } else {
             /*
              * We have the request-line or a header line to process.
@@ -6572,9 +6666,10 @@ SockParse(Sock *sockPtr)
                     Ns_Log(Notice, "pre-HTTP/1.0 request <%s>", reqPtr->request.line);
                 }
 
-            } else if (Ns_ParseHeader(reqPtr->headers, s, NULL, NULL) != NS_OK) {
+            } else if (NsParseHeaderLine(reqPtr->headers, s, (size_t)(e - s), NS_TRUE) != NS_OK) {
                 /*
-                 * Invalid header.
+                 * Invalid header, e.g. the field name is not a token or
+                 * is followed by white space before the colon.
                  */
                 return SOCK_BADHEADER;
 
@@ -6609,6 +6704,21 @@ SockParse(Sock *sockPtr)
     assert(reqPtr->coff > 0u);
     assert(reqPtr->request.line != NULL);
 
+    if (reqPtr->streamBody) {
+        /*
+         * Pass the body bytes received so far as readable input. The
+         * content is not available in memory, "length" is 0.
+         */
+        reqPtr->streamRemaining = reqPtr->length - reqPtr->avail;
+        reqPtr->length = 0u;
+        reqPtr->content = bufPtr->string + reqPtr->coff;
+        reqPtr->next = reqPtr->content;
+        Ns_Log(DriverDebug, "SockParse: stream body, %" PRIuz " bytes buffered, "
+               "%" PRIuz " bytes remaining",
+               reqPtr->avail, reqPtr->streamRemaining);
+        return SOCK_READY;
+    }
+
     /*
      * Check if all content has arrived.
      */
@@ -6675,6 +6785,10 @@ SockParse(Sock *sockPtr)
      */
     result = SOCK_READY;
 
+    if (reqPtr->multipartPtr != NULL) {
+        (void) NsMultipartParserFinish(reqPtr->multipartPtr);
+    }
+
     if (sockPtr->tfile != NULL) {
         reqPtr->content = NULL;
         reqPtr->next = NULL;
@@ -7240,6 +7354,58 @@ CheckSingletonHeaderFields(Sock *sockPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SockLookupServer --
+ *
+ *      Determine the virtual server for the request from the driver or
+ *      from the Host header field, like SockSetServer(), but without
+ *      updating the Sock structure. This is used to check the request
+ *      handler directly after parsing the request header.
+ *
+ * Results:
+ *      Server or NULL, when the server cannot be determined.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static NsServer *
+SockLookupServer(Sock *sockPtr)
+{
+    NsServer        *servPtr;
+    Driver          *drvPtr;
+    const ServerMap *mapPtr = NULL;
+    const char      *host;
+
+    NS_NONNULL_ASSERT(sockPtr != NULL);
+
+    drvPtr = sockPtr->drvPtr;
+    servPtr = drvPtr->servPtr;
+
+    if (servPtr == NULL) {
+        host = sockPtr->extractedHeaderFields[NS_EXTRACTED_HEADER_HOST];
+        if (host != NULL) {
+            Tcl_DString hostDs;
+
+            Tcl_DStringInit(&hostDs);
+            Tcl_DStringAppend(&hostDs, host, TCL_INDEX_NONE);
+            mapPtr = DriverLookupHost(&hostDs, NULL, drvPtr);
+            Tcl_DStringFree(&hostDs);
+        }
+        if (mapPtr == NULL) {
+            mapPtr = drvPtr->defMapPtr;
+        }
+        if (mapPtr != NULL) {
+            servPtr = mapPtr->servPtr;
+        }
+    }
+
+    return servPtr;
+}
+
 /*
  *----------------------------------------------------------------------
  *
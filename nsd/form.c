@@ -21,6 +21,54 @@
 # include <string.h>
 #endif
 
+/*
+ * Limits for the incremental multipart parser. RFC 2046 restricts the
+ * boundary to 70 characters; the shift table of the boundary search uses
+ * single bytes.
+ */
+
+#define MULTIPART_MAX_BOUNDARY 200
+#define MULTIPART_MAX_HEADER   16384u
+
+#define MULTIPART_DELIM_NONE   (-1)
+#define MULTIPART_DELIM_MORE   (-2)
+#define MULTIPART_DELIM_FINAL  (-3)
+
+typedef enum {
+    MULTIPART_PREAMBLE,
+    MULTIPART_HEADER,
+    MULTIPART_BODY,
+    MULTIPART_DONE,
+    MULTIPART_ERROR
+} MultipartState;
+
+/*
+ * A part parsed by the incremental multipart parser. For plain fields, the
+ * data contains the part header followed by the value, for file parts only
+ * the part header, while the content is in the temporary file.
+ */
+
+typedef struct MultipartPart {
+    struct MultipartPart *nextPtr;
+    Tcl_DString           data;       /* Part header and value of plain fields. */
+    char                 *tmpFile;    /* Temporary file with the content of a file part. */
+    size_t                offset;     /* Offset of the content in the request body. */
+    size_t                length;     /* Length of the content. */
+} MultipartPart;
+
+struct NsMultipartParser {
+    MultipartState  state;
+    Tcl_DString     delimiter;        /* Newline followed by the boundary. */
+    Tcl_DString     buffer;           /* Received, but not yet processed data. */
+    size_t          position;         /* Offset of the buffer in the content + 1. */
+    size_t          remaining;        /* Bytes of the content not yet received. */
+    const char     *tmpDir;           /* Directory for the temporary files. */
+    int             fd;               /* Temporary file of the current file part. */
+    MultipartPart  *firstPtr;         /* Parsed parts. */
+    MultipartPart  *lastPtr;          /* Current part. */
+    unsigned char   shift[256];       /* Shift table for the boundary search. */
+};
+
 /*
  * Local functions defined in this file.
  */
@@ -34,9 +82,31 @@ static Ns_ReturnCode ParseQueryWithFallback(Tcl_Interp *interp, NsServer *servPt
                                             Tcl_Obj *fallbackCharsetObj)
     NS_GNUC_NONNULL(1,3,4);
 
-static Ns_ReturnCode ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char *end)
+static Ns_ReturnCode ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char *end,
+                                         const MultipartPart *partPtr)
     NS_GNUC_NONNULL(1,3,4);
 
+static Ns_ReturnCode ParseMultipartParts(Conn *connPtr, const NsMultipartParser *mpPtr, char **toParsePtr)
+    NS_GNUC_NONNULL(1,2,3);
+
+static ssize_t MultipartSearch(const NsMultipartParser *mpPtr, size_t offset)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+static ssize_t MultipartDelimiterEnd(const NsMultipartParser *mpPtr, size_t offset)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+static bool MultipartEmit(NsMultipartParser *mpPtr, const char *bytes, size_t length)
+    NS_GNUC_NONNULL(1,2);
+
+static bool MultipartNewPart(NsMultipartParser *mpPtr, const char *header, size_t headerLength, size_t offset)
+    NS_GNUC_NONNULL(1,2);
+
+static void MultipartEndPart(NsMultipartParser *mpPtr)
+    NS_GNUC_NONNULL(1);
+
+static size_t MultipartProcess(NsMultipartParser *mpPtr)
+    NS_GNUC_NONNULL(1);
+
 static char *Ext2utf(Tcl_DString *dsPtr, const char *start, size_t len, Tcl_Encoding encoding, char unescape)
     NS_GNUC_NONNULL(1,2);
 
@@ -354,7 +424,17 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
                                             NS_FALSE, fallbackCharsetObj);
         }
 
-        if (content != NULL) {
+        if (fct == FORM_CONTENT_MULTIPART
+            && connPtr->reqPtr->multipartPtr != NULL
+            && connPtr->reqPtr->multipartPtr->state == MULTIPART_DONE
+            && (connPtr->flags & NS_CONN_CLOSED) == 0u) {
+            /*
+             * The multipart content was already parsed incrementally while
+             * it was received, file parts are in their own temporary files.
+             */
+            status = ParseMultipartParts(connPtr, connPtr->reqPtr->multipartPtr, &toParse);
+
+        } else if (content != NULL) {
             switch (fct) {
             case FORM_CONTENT_URLENCODED: {
                 /*
@@ -446,7 +526,7 @@ Ns_ConnGetQuery(Tcl_Interp *interp, Ns_Conn *conn, Tcl_Obj *fallbackCharsetObj,
 
                             e = NextBoundary(s, (size_t)(formEndPtr - s), &boundaryDs);
                             if (e != NULL) {
-                                status = ParseMultipartEntry(connPtr, valueEncoding, s, e);
+                                status = ParseMultipartEntry(connPtr, valueEncoding, s, e, NULL);
                                 if (status == NS_ERROR) {
                                     toParse = s;
 
@@ -578,6 +658,9 @@ Ns_ConnClearQuery(Ns_Conn *conn)
             if (filePtr->sizeObj != NULL) {
                 Tcl_DecrRefCount(filePtr->sizeObj);
             }
+            if (filePtr->tmpObj != NULL) {
+                Tcl_DecrRefCount(filePtr->tmpObj);
+            }
             ns_free(filePtr);
 
             hPtr = Tcl_NextHashEntry(&search);
@@ -819,7 +902,10 @@ ParseQueryWithFallback(Tcl_Interp *interp, NsServer *servPtr, char *toParse,
  *
  * ParseMultipartEntry --
  *
- *      Parse a single part of a multipart form.
+ *      Parse a single part of a multipart form. When the part was parsed
+ *      by the incremental parser (partPtr != NULL), the content of file
+ *      parts is not contained in the provided data, but in the temporary
+ *      file of the part.
  *
  * Results:
  *      Ns_ReturnCode (NS_OK or NS_ERROR).
@@ -832,7 +918,8 @@ ParseQueryWithFallback(Tcl_Interp *interp, NsServer *servPtr, char *toParse,
  */
 
 static Ns_ReturnCode
-ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char *end)
+ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char *end,
+                    const MultipartPart *partPtr)
 {
     Tcl_Encoding  encoding;
     Tcl_DString   kds, vds;
@@ -940,10 +1027,12 @@ ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char
                 filePtr->hdrObj = Tcl_NewListObj(0, NULL);
                 filePtr->offObj = Tcl_NewListObj(0, NULL);
                 filePtr->sizeObj = Tcl_NewListObj(0, NULL);
+                filePtr->tmpObj = Tcl_NewListObj(0, NULL);
 
                 Tcl_IncrRefCount(filePtr->hdrObj);
                 Tcl_IncrRefCount(filePtr->offObj);
                 Tcl_IncrRefCount(filePtr->sizeObj);
+                Tcl_IncrRefCount(filePtr->tmpObj);
             } else {
                 filePtr = Tcl_GetHashValue(hPtr);
             }
@@ -953,11 +1042,23 @@ ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char
                                             Tcl_GetObjResult(interp));
             Tcl_ResetResult(connPtr->itPtr->interp);
 
-            (void) Tcl_ListObjAppendElement(interp, filePtr->offObj,
-                                            Tcl_NewIntObj((int)(start - connPtr->reqPtr->content)));
-
-            (void) Tcl_ListObjAppendElement(interp, filePtr->sizeObj,
-                                            Tcl_NewWideIntObj((Tcl_WideInt)(end - start)));
+            if (partPtr != NULL) {
+                (void) Tcl_ListObjAppendElement(interp, filePtr->offObj,
+                                                Tcl_NewWideIntObj((Tcl_WideInt)partPtr->offset));
+                (void) Tcl_ListObjAppendElement(interp, filePtr->sizeObj,
+                                                Tcl_NewWideIntObj((Tcl_WideInt)partPtr->length));
+                (void) Tcl_ListObjAppendElement(interp, filePtr->tmpObj,
+                                                Tcl_NewStringObj(partPtr->tmpFile != NULL
+                                                                 ? partPtr->tmpFile : NS_EMPTY_STRING,
+                                                                 TCL_INDEX_NONE));
+            } else {
+                (void) Tcl_ListObjAppendElement(interp, filePtr->offObj,
+                                                Tcl_NewWideIntObj((Tcl_WideInt)(start - connPtr->reqPtr->content)));
+                (void) Tcl_ListObjAppendElement(interp, filePtr->sizeObj,
+                                                Tcl_NewWideIntObj((Tcl_WideInt)(end - start)));
+                (void) Tcl_ListObjAppendElement(interp, filePtr->tmpObj,
+                                                Tcl_NewObj());
+            }
             set = NULL;
         }
         Ns_Log(Debug, "ParseMultipartEntry sets '%s': '%s'", key, value);
@@ -978,6 +1079,70 @@ ParseMultipartEntry(Conn *connPtr, Tcl_Encoding valueEncoding, char *start, char
     return status;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseMultipartParts --
+ *
+ *      Fill the form from the parts of the incremental multipart parser.
+ *      Like for parsing the content, the parts are processed a second
+ *      time, when a "_charset_" field specifies a different encoding.
+ *
+ * Results:
+ *      Ns_ReturnCode (NS_OK or NS_ERROR).
+ *
+ * Side effects:
+ *      Fills connPtr->query and the files table, sets *toParsePtr to the
+ *      data of a part which could not be decoded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+ParseMultipartParts(Conn *connPtr, const NsMultipartParser *mpPtr, char **toParsePtr)
+{
+    Tcl_Encoding  valueEncoding = connPtr->urlEncoding;
+    Ns_ReturnCode status = NS_OK;
+
+    NS_NONNULL_ASSERT(connPtr != NULL);
+    NS_NONNULL_ASSERT(mpPtr != NULL);
+    NS_NONNULL_ASSERT(toParsePtr != NULL);
+
+    for (;;) {
+        const MultipartPart *partPtr;
+        const char          *defaultCharset;
+
+        for (partPtr = mpPtr->firstPtr; partPtr != NULL; partPtr = partPtr->nextPtr) {
+            char *start = partPtr->data.string;
+
+            status = ParseMultipartEntry(connPtr, valueEncoding, start,
+                                         start + partPtr->data.length, partPtr);
+            if (status == NS_ERROR) {
+                /*
+                 * Continue, a later part might be "_charset_".
+                 */
+                *toParsePtr = start;
+            }
+        }
+
+        defaultCharset = Ns_SetGet(connPtr->query, "_charset_");
+        if (defaultCharset != NULL && strcmp(defaultCharset, "utf-8") != 0 && valueEncoding != NULL) {
+            Tcl_Encoding defaultEncoding = Ns_GetCharsetEncoding(defaultCharset);
+
+            if (valueEncoding != defaultEncoding) {
+                valueEncoding = defaultEncoding;
+                Ns_SetTrunc(connPtr->query, 0u);
+                Ns_Log(Debug, "form: retry with default charset %s", defaultCharset);
+                continue;
+            }
+        }
+        break;
+    }
+    return status;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -1223,6 +1388,615 @@ Ext2utf(Tcl_DString *dsPtr, const char *start, size_t len, Tcl_Encoding encoding
     return buffer;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartParserNew --
+ *
+ *      Create an incremental parser for a "multipart/form-data" request
+ *      body. The parser is fed by the driver or spooler thread with the
+ *      data as it is received (see NsMultipartParserFeed()). The contents
+ *      of file parts are written directly to temporary files in the
+ *      provided directory, the values of plain fields are kept in
+ *      memory.
+ *
+ * Results:
+ *      Parser or NULL, when the request has no multipart content type or
+ *      an unusable boundary.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsMultipartParser *
+NsMultipartParserNew(const Ns_Set *headers, size_t length, const char *tmpDir)
+{
+    NsMultipartParser *mpPtr = NULL;
+    const char        *contentType;
+
+    NS_NONNULL_ASSERT(headers != NULL);
+    NS_NONNULL_ASSERT(tmpDir != NULL);
+
+    contentType = Ns_SetIGet(headers, "content-type");
+    if (contentType != NULL
+        && *contentType == 'm'
+        && strncmp(contentType, "multipart/form-data", 19u) == 0) {
+        Tcl_DString boundaryDs;
+
+        Tcl_DStringInit(&boundaryDs);
+        if (GetBoundary(&boundaryDs, contentType)
+            && boundaryDs.length > 2
+            && boundaryDs.length < MULTIPART_MAX_BOUNDARY) {
+            const unsigned char *delimiter;
+            size_t               i, m;
+
+            mpPtr = ns_calloc(1u, sizeof(NsMultipartParser));
+            mpPtr->state = MULTIPART_PREAMBLE;
+            mpPtr->remaining = length;
+            mpPtr->tmpDir = tmpDir;
+            mpPtr->fd = NS_INVALID_FD;
+
+            /*
+             * The delimiter is the boundary preceded by a newline. A newline
+             * is inserted in front of the content, such that a boundary at
+             * the begin of the content is found as well.
+             */
+            Tcl_DStringInit(&mpPtr->delimiter);
+            Tcl_DStringAppend(&mpPtr->delimiter, "\n", 1);
+            Tcl_DStringAppend(&mpPtr->delimiter, boundaryDs.string, boundaryDs.length);
+            Tcl_DStringInit(&mpPtr->buffer);
+            Tcl_DStringAppend(&mpPtr->buffer, "\n", 1);
+
+            /*
+             * Boyer-Moore-Horspool shift table.
+             */
+            delimiter = (const unsigned char *)mpPtr->delimiter.string;
+            m = (size_t)mpPtr->delimiter.length;
+            for (i = 0u; i < 256u; i++) {
+                mpPtr->shift[i] = (unsigned char)m;
+            }
+            for (i = 0u; i < m - 1u; i++) {
+                mpPtr->shift[delimiter[i]] = (unsigned char)(m - 1u - i);
+            }
+        }
+        Tcl_DStringFree(&boundaryDs);
+    }
+    return mpPtr;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartParserFeed --
+ *
+ *      Process the next bytes of the request body. Bytes beyond the
+ *      content length are ignored. Only a tail of the data not longer
+ *      than the delimiter (or an incomplete part header) is buffered
+ *      between calls.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes contents of file parts to temporary files, puts the parser
+ *      into the error state on malformed input.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsMultipartParserFeed(NsMultipartParser *mpPtr, const char *bytes, size_t length)
+{
+    NS_NONNULL_ASSERT(mpPtr != NULL);
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+    if (length > mpPtr->remaining) {
+        length = mpPtr->remaining;
+    }
+    mpPtr->remaining -= length;
+
+    if (mpPtr->state != MULTIPART_DONE && mpPtr->state != MULTIPART_ERROR) {
+        size_t consumed;
+
+        Tcl_DStringAppend(&mpPtr->buffer, bytes, (TCL_SIZE_T)length);
+        consumed = MultipartProcess(mpPtr);
+        if (consumed > 0u) {
+            size_t rest = (size_t)mpPtr->buffer.length - consumed;
+
+            memmove(mpPtr->buffer.string, mpPtr->buffer.string + consumed, rest);
+            Tcl_DStringSetLength(&mpPtr->buffer, (TCL_SIZE_T)rest);
+            mpPtr->position += consumed;
+        }
+    }
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartParserFinish --
+ *
+ *      Complete parsing after the full request body was received.
+ *
+ * Results:
+ *      NS_TRUE, when the body was parsed completely (final boundary
+ *      seen), NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      Closes the temporary file of the current part.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsMultipartParserFinish(NsMultipartParser *mpPtr)
+{
+    NS_NONNULL_ASSERT(mpPtr != NULL);
+
+    if (mpPtr->fd != NS_INVALID_FD) {
+        (void) ns_close(mpPtr->fd);
+        mpPtr->fd = NS_INVALID_FD;
+    }
+    if (mpPtr->state != MULTIPART_DONE) {
+        Ns_Log(Debug, "multipart: incomplete or invalid content, state %d", (int)mpPtr->state);
+        mpPtr->state = MULTIPART_ERROR;
+    }
+    Tcl_DStringFree(&mpPtr->buffer);
+
+    return (mpPtr->state == MULTIPART_DONE);
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsMultipartParserFree --
+ *
+ *      Free the parser together with the parsed parts. The temporary
+ *      files of the file parts are deleted, unless these were moved
+ *      away in the meantime.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Deletes temporary files.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsMultipartParserFree(NsMultipartParser *mpPtr)
+{
+    MultipartPart *partPtr;
+
+    NS_NONNULL_ASSERT(mpPtr != NULL);
+
+    if (mpPtr->fd != NS_INVALID_FD) {
+        (void) ns_close(mpPtr->fd);
+    }
+    partPtr = mpPtr->firstPtr;
+    while (partPtr != NULL) {
+        MultipartPart *nextPtr = partPtr->nextPtr;
+
+        if (partPtr->tmpFile != NULL) {
+            (void) unlink(partPtr->tmpFile);
+            ns_free(partPtr->tmpFile);
+        }
+        Tcl_DStringFree(&partPtr->data);
+        ns_free(partPtr);
+        partPtr = nextPtr;
+    }
+    Tcl_DStringFree(&mpPtr->delimiter);
+    Tcl_DStringFree(&mpPtr->buffer);
+    ns_free(mpPtr);
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartSearch --
+ *
+ *      Search the delimiter in the buffer starting at the provided offset
+ *      using the Boyer-Moore-Horspool algorithm.
+ *
+ * Results:
+ *      Offset of the delimiter in the buffer or -1, when not found.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+MultipartSearch(const NsMultipartParser *mpPtr, size_t offset)
+{
+    const unsigned char *text = (const unsigned char *)mpPtr->buffer.string;
+    const unsigned char *delimiter = (const unsigned char *)mpPtr->delimiter.string;
+    size_t               n = (size_t)mpPtr->buffer.length, m = (size_t)mpPtr->delimiter.length;
+    const unsigned char  last = delimiter[m - 1u];
+
+    while (offset + m <= n) {
+        unsigned char c = text[offset + m - 1u];
+
+        if (c == last && memcmp(text + offset, delimiter, m - 1u) == 0) {
+            return (ssize_t)offset;
+        }
+        offset += mpPtr->shift[c];
+    }
+    return -1;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartDelimiterEnd --
+ *
+ *      Check the characters following a delimiter candidate. A
+ *      delimiter must be followed by CRLF, LF, "--" or the end of the
+ *      content (same rules as in NextBoundary()).
+ *
+ * Results:
+ *      Offset after the line break of the delimiter line, or one of the
+ *      values MULTIPART_DELIM_FINAL, MULTIPART_DELIM_MORE (more data
+ *      needed) and MULTIPART_DELIM_NONE (not a delimiter).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+MultipartDelimiterEnd(const NsMultipartParser *mpPtr, size_t offset)
+{
+    const char *buffer = mpPtr->buffer.string;
+    size_t      after = offset + (size_t)mpPtr->delimiter.length, n = (size_t)mpPtr->buffer.length;
+    bool        atEnd = (mpPtr->remaining == 0u);
+    ssize_t     result;
+
+    if (after == n) {
+        result = atEnd ? MULTIPART_DELIM_FINAL : MULTIPART_DELIM_MORE;
+    } else if (buffer[after] == '\n') {
+        result = (ssize_t)after + 1;
+    } else if (buffer[after] != '\r' && buffer[after] != '-') {
+        result = MULTIPART_DELIM_NONE;
+    } else if (after + 1u == n) {
+        result = atEnd ? MULTIPART_DELIM_NONE : MULTIPART_DELIM_MORE;
+    } else if (buffer[after] == '-') {
+        result = (buffer[after + 1u] == '-') ? MULTIPART_DELIM_FINAL : MULTIPART_DELIM_NONE;
+    } else {
+        result = (buffer[after + 1u] == '\n') ? (ssize_t)after + 2 : MULTIPART_DELIM_NONE;
+    }
+    return result;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartEmit --
+ *
+ *      Append content bytes to the current part, either to its temporary
+ *      file or to its in-memory value.
+ *
+ * Results:
+ *      NS_TRUE on success, NS_FALSE on write errors.
+ *
+ * Side effects:
+ *      Might write to the temporary file.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+MultipartEmit(NsMultipartParser *mpPtr, const char *bytes, size_t length)
+{
+    MultipartPart *partPtr = mpPtr->lastPtr;
+    bool           success = NS_TRUE;
+
+    if (length > 0u) {
+        if (mpPtr->fd != NS_INVALID_FD) {
+            if (ns_write(mpPtr->fd, bytes, length) != (ssize_t)length) {
+                Ns_Log(Error, "multipart: cannot write to %s: %s",
+                       partPtr->tmpFile, strerror(errno));
+                success = NS_FALSE;
+            }
+        } else {
+            Tcl_DStringAppend(&partPtr->data, bytes, (TCL_SIZE_T)length);
+        }
+        partPtr->length += length;
+    }
+    return success;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartNewPart --
+ *
+ *      Start a new part with the provided header block. When the
+ *      Content-Disposition header field contains a filename, a temporary
+ *      file is created for the content.
+ *
+ * Results:
+ *      NS_TRUE on success, NS_FALSE, when the temporary file could not be
+ *      created.
+ *
+ * Side effects:
+ *      Appends the part to the list of parts.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+MultipartNewPart(NsMultipartParser *mpPtr, const char *header, size_t headerLength, size_t offset)
+{
+    MultipartPart *partPtr;
+    Ns_Set        *set;
+    const char    *disp, *s = header, *end = header + headerLength;
+    bool           success = NS_TRUE;
+
+    partPtr = ns_calloc(1u, sizeof(MultipartPart));
+    Tcl_DStringInit(&partPtr->data);
+    Tcl_DStringAppend(&partPtr->data, header, (TCL_SIZE_T)headerLength);
+    partPtr->offset = offset;
+    if (mpPtr->lastPtr == NULL) {
+        mpPtr->firstPtr = partPtr;
+    } else {
+        mpPtr->lastPtr->nextPtr = partPtr;
+    }
+    mpPtr->lastPtr = partPtr;
+
+    /*
+     * Parse the header lines to determine, whether this is a file part.
+     */
+    set = Ns_SetCreate(NS_SET_NAME_MP);
+    while (s < end) {
+        const char *e = memchr(s, INTCHAR('\n'), (size_t)(end - s));
+        Tcl_DString line;
+
+        if (e == NULL) {
+            e = end;
+        }
+        Tcl_DStringInit(&line);
+        Tcl_DStringAppend(&line, s, (TCL_SIZE_T)(e - s));
+        if (line.length > 0 && line.string[line.length - 1] == '\r') {
+            Tcl_DStringSetLength(&line, line.length - 1);
+        }
+        if (line.length > 0) {
+            (void) Ns_ParseHeader(set, line.string, NULL, NULL);
+        }
+        Tcl_DStringFree(&line);
+        s = e + 1;
+    }
+    disp = Ns_SetIGet(set, "content-disposition");
+    if (disp != NULL) {
+        const char *fs, *fe;
+        char        unescape;
+
+        if (GetValue(disp, "filename=", 9u, &fs, &fe, &unescape) == NS_TRUE) {
+            size_t tmpFileLength = strlen(mpPtr->tmpDir) + 16u;
+
+            partPtr->tmpFile = ns_malloc(tmpFileLength);
+            snprintf(partPtr->tmpFile, tmpFileLength, "%s/nsmp.XXXXXX", mpPtr->tmpDir);
+            mpPtr->fd = ns_mkstemp(partPtr->tmpFile);
+            if (mpPtr->fd == NS_INVALID_FD) {
+                Ns_Log(Error, "multipart: cannot create temporary file with template '%s': %s",
+                       partPtr->tmpFile, strerror(errno));
+                ns_free(partPtr->tmpFile);
+                partPtr->tmpFile = NULL;
+                success = NS_FALSE;
+            }
+        }
+    }
+    Ns_SetFree(set);
+
+    return success;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartEndPart --
+ *
+ *      Complete the current part. The value of a plain field is
+ *      terminated with a CRLF, such that the part data has the same
+ *      layout as a part in the request body (see ParseMultipartEntry()).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Closes the temporary file of a file part.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MultipartEndPart(NsMultipartParser *mpPtr)
+{
+    if (mpPtr->fd != NS_INVALID_FD) {
+        (void) ns_close(mpPtr->fd);
+        mpPtr->fd = NS_INVALID_FD;
+    } else {
+        Tcl_DStringAppend(&mpPtr->lastPtr->data, "\r\n", 2);
+    }
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MultipartProcess --
+ *
+ *      Run the state machine of the parser over the buffered data.
+ *      Offsets in the buffer are converted into offsets of the request
+ *      body via mpPtr->position, which is the offset of the begin of the
+ *      buffer, including the inserted leading newline.
+ *
+ * Results:
+ *      Number of bytes at the begin of the buffer, which are processed
+ *      and can be removed.
+ *
+ * Side effects:
+ *      Updates the state of the parser, creates parts.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+MultipartProcess(NsMultipartParser *mpPtr)
+{
+    const char *buffer = mpPtr->buffer.string;
+    size_t      n = (size_t)mpPtr->buffer.length, m = (size_t)mpPtr->delimiter.length;
+    size_t      consumed = 0u, scan = 0u;
+
+    for (;;) {
+        ssize_t pos, next;
+
+        switch (mpPtr->state) {
+        case MULTIPART_PREAMBLE:
+            pos = MultipartSearch(mpPtr, scan);
+            if (pos < 0) {
+                /*
+                 * Keep a potential prefix of the delimiter.
+                 */
+                if (n >= m && n - m + 1u > consumed) {
+                    consumed = n - m + 1u;
+                }
+                return consumed;
+            }
+            next = MultipartDelimiterEnd(mpPtr, (size_t)pos);
+            if (next == MULTIPART_DELIM_MORE) {
+                return (size_t)pos;
+            } else if (next == MULTIPART_DELIM_NONE) {
+                scan = (size_t)pos + 1u;
+            } else if (next == MULTIPART_DELIM_FINAL) {
+                mpPtr->state = MULTIPART_DONE;
+                return n;
+            } else {
+                consumed = scan = (size_t)next;
+                mpPtr->state = MULTIPART_HEADER;
+            }
+            break;
+
+        case MULTIPART_HEADER: {
+            /*
+             * Search the empty line terminating the part header.
+             */
+            size_t      s = consumed, headerEnd = 0u;
+            const char *e;
+
+            while ((e = memchr(buffer + s, INTCHAR('\n'), n - s)) != NULL) {
+                size_t lineLength = (size_t)(e - (buffer + s));
+
+                if (lineLength == 0u || (lineLength == 1u && buffer[s] == '\r')) {
+                    headerEnd = (size_t)(e - buffer) + 1u;
+                    break;
+                }
+                s = (size_t)(e - buffer) + 1u;
+            }
+            pos = MultipartSearch(mpPtr, consumed);
+            if (pos >= 0 && (headerEnd == 0u || (size_t)pos < headerEnd)) {
+                /*
+                 * A delimiter in the part header; leave this to the
+                 * parser working on the full content.
+                 */
+                mpPtr->state = MULTIPART_ERROR;
+                return n;
+            }
+            if (headerEnd == 0u) {
+                if (n - consumed > MULTIPART_MAX_HEADER) {
+                    mpPtr->state = MULTIPART_ERROR;
+                    return n;
+                }
+                return consumed;
+            }
+            if (!MultipartNewPart(mpPtr, buffer + consumed, headerEnd - consumed,
+                                  mpPtr->position + headerEnd - 1u)) {
+                mpPtr->state = MULTIPART_ERROR;
+                return n;
+            }
+            consumed = scan = headerEnd;
+            mpPtr->state = MULTIPART_BODY;
+            break;
+        }
+
+        case MULTIPART_BODY: {
+            size_t valueEnd;
+
+            pos = MultipartSearch(mpPtr, scan);
+            if (pos < 0) {
+                /*
+                 * Keep the bytes which might be the begin of a delimiter
+                 * together with the preceding character (potential CR).
+                 */
+                valueEnd = (n > m + consumed) ? n - m : consumed;
+                if (!MultipartEmit(mpPtr, buffer + consumed, valueEnd - consumed)) {
+                    mpPtr->state = MULTIPART_ERROR;
+                    return n;
+                }
+                return valueEnd;
+            }
+            next = MultipartDelimiterEnd(mpPtr, (size_t)pos);
+            if (next == MULTIPART_DELIM_NONE) {
+                scan = (size_t)pos + 1u;
+                break;
+            }
+            valueEnd = (size_t)pos;
+            if (next == MULTIPART_DELIM_MORE) {
+                if (valueEnd > consumed + 1u) {
+                    if (!MultipartEmit(mpPtr, buffer + consumed, valueEnd - consumed - 1u)) {
+                        mpPtr->state = MULTIPART_ERROR;
+                        return n;
+                    }
+                    consumed = valueEnd - 1u;
+                }
+                return consumed;
+            }
+            if (valueEnd > consumed && buffer[valueEnd - 1u] == '\r') {
+                valueEnd--;
+            }
+            if (!MultipartEmit(mpPtr, buffer + consumed, valueEnd - consumed)) {
+                mpPtr->state = MULTIPART_ERROR;
+                return n;
+            }
+            MultipartEndPart(mpPtr);
+            if (next == MULTIPART_DELIM_FINAL) {
+                mpPtr->state = MULTIPART_DONE;
+                return n;
+            }
+            consumed = scan = (size_t)next;
+            mpPtr->state = MULTIPART_HEADER;
+            break;
+        }
+
+        case MULTIPART_DONE:  NS_FALL_THROUGH; /* fall through */
+        case MULTIPART_ERROR:
+            return n;
+        }
+    }
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -0,0 +1,474 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * httpscan.c --
+ *
+ *      Scanning kernels for parsing HTTP request lines and header
+ *      fields. The kernels find the end of a line while checking for
+ *      control characters in the same pass, and determine the length
+ *      of the token forming a field name. Several implementations
+ *      are provided:
+ *
+ *   - avx2:    32 bytes per step (x86, selected when the CPU
+ *              supports it)
+ *   - sse2:    16 bytes per step (x86)
+ *   - scalar:  portable 8-byte word-at-a-time (SWAR) and table based
+ *              implementation, used e.g. on ARM
+ *
+ *      The implementation is selected at startup based on the
+ *      capabilities of the CPU. All kernels return identical results.
+ */
+
+#include "nsd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# if defined(__SSE2__)
+#  define NS_HTTPSCAN_SSE2 1
+#  include <emmintrin.h>
+# endif
+# if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#  define NS_HTTPSCAN_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+
+/*
+ * Function types of the kernels.
+ */
+
+typedef size_t (HttpScanProc)(const char *s, size_t len);
+
+/*
+ * Local functions defined in this file.
+ */
+
+static HttpScanProc CtlScalar;
+static HttpScanProc TokenScalar;
+#ifdef NS_HTTPSCAN_SSE2
+static HttpScanProc CtlSse2;
+static HttpScanProc TokenSse2;
+#endif
+#ifdef NS_HTTPSCAN_AVX2
+static HttpScanProc CtlAvx2 __attribute__((target("avx2")));
+static HttpScanProc TokenAvx2 __attribute__((target("avx2")));
+#endif
+
+/*
+ * Static variables defined in this file.
+ *
+ * The kernels default to the portable implementation, such that the
+ * scanning functions can be used before NsInitHttpScan() was called.
+ */
+
+static HttpScanProc *ctlProc = CtlScalar;
+static HttpScanProc *tokenProc = TokenScalar;
+static const char   *kernelName = "scalar";
+
+/*
+ * Characters allowed in a token (RFC 9110, section 5.6.2):
+ *
+ *   tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "."
+ *         / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+ */
+
+static const unsigned char tcharTable[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0
+    /* bytes >= 0x80 are not token characters */
+};
+
+/*
+ * Control characters are the bytes below 0x20 and DEL (0x7f). HTAB is
+ * permitted in request lines and field values and is therefore not
+ * reported.
+ */
+#define IS_CTL(c) (((c) < 0x20u && (c) != UCHAR('\t')) || (c) == 0x7fu)
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitHttpScan --
+ *
+ *      Select the scanning kernels based on the capabilities of the
+ *      CPU.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets the kernel function pointers.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitHttpScan(void)
+{
+#ifdef NS_HTTPSCAN_SSE2
+    ctlProc = CtlSse2;
+    tokenProc = TokenSse2;
+    kernelName = "sse2";
+#endif
+#ifdef NS_HTTPSCAN_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ctlProc = CtlAvx2;
+        tokenProc = TokenAvx2;
+        kernelName = "avx2";
+    }
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsHttpScanKernel --
+ *
+ *      Return the name of the selected kernels.
+ *
+ * Results:
+ *      String constant "avx2", "sse2" or "scalar".
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+NsHttpScanKernel(void)
+{
+    return kernelName;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsHttpScanLine --
+ *
+ *      Find the end of a line in the provided buffer. In the same
+ *      pass, check that the line does not contain control characters
+ *      other than HTAB and the CR of the CRLF line terminator.
+ *
+ * Results:
+ *      Pointer to the terminating LF character or NULL, when the
+ *      buffer contains no complete line. The variable pointed to by
+ *      validPtr is set to NS_FALSE when the line contains a
+ *      forbidden control character.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+NsHttpScanLine(const char *s, size_t len, bool *validPtr)
+{
+    const char *result = NULL;
+    size_t      i;
+
+    NS_NONNULL_ASSERT(s != NULL);
+    NS_NONNULL_ASSERT(validPtr != NULL);
+
+    *validPtr = NS_TRUE;
+    i = (*ctlProc)(s, len);
+
+    if (i < len) {
+        if (s[i] == '\n') {
+            result = s + i;
+
+        } else if (s[i] == '\r' && i + 1u < len && s[i + 1u] == '\n') {
+            result = s + i + 1u;
+
+        } else if (s[i] == '\r' && i + 1u == len) {
+            /*
+             * CR at the end of the buffer, wait for the LF.
+             */
+            result = NULL;
+
+        } else {
+            *validPtr = NS_FALSE;
+            result = memchr(s + i, INTCHAR('\n'), len - i);
+        }
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsHttpScanToken --
+ *
+ *      Determine the length of the token (e.g., a field name) at the
+ *      begin of the provided string.
+ *
+ * Results:
+ *      Number of leading token characters, at most len.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+size_t
+NsHttpScanToken(const char *s, size_t len)
+{
+    NS_NONNULL_ASSERT(s != NULL);
+
+    return (*tokenProc)(s, len);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CtlScalar, TokenScalar --
+ *
+ *      Portable kernels. CtlScalar() checks 8 bytes at a time for
+ *      bytes below 0x20 or equal to 0x7f and inspects a word
+ *      bytewise only when it contains such a byte.
+ *
+ * Results:
+ *      Offset of the first control character (respectively the first
+ *      non-token character) or len.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+CtlScalar(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t               i = 0u;
+
+    for (; i + 8u <= len; i += 8u) {
+        uint64_t w, del;
+
+        memcpy(&w, p + i, sizeof(w));
+        del = w ^ UINT64_C(0x7f7f7f7f7f7f7f7f);
+        if (((((w - UINT64_C(0x2020202020202020)) & ~w)
+             | ((del - UINT64_C(0x0101010101010101)) & ~del))
+            & UINT64_C(0x8080808080808080)) != 0u) {
+            size_t j;
+
+            for (j = i; j < i + 8u; j++) {
+                if (IS_CTL(p[j])) {
+                    return j;
+                }
+            }
+        }
+    }
+    for (; i < len; i++) {
+        if (IS_CTL(p[i])) {
+            break;
+        }
+    }
+    return i;
+}
+
+static size_t
+TokenScalar(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t               i;
+
+    for (i = 0u; i < len && tcharTable[p[i]] != 0u; i++) {
+        ;
+    }
+    return i;
+}
+
+#ifdef NS_HTTPSCAN_SSE2
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CtlSse2, TokenSse2 --
+ *
+ *      SSE2 kernels processing 16 bytes per step. Since SSE2 has no
+ *      byte shuffle, the token kernel checks the ranges of the
+ *      separator characters.
+ *
+ * Results:
+ *      Offset of the first control character (respectively the first
+ *      non-token character) or len.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+CtlSse2(const char *s, size_t len)
+{
+    const __m128i limit = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    size_t        i = 0u;
+
+    for (; i + 16u <= len; i += 16u) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, limit), v);
+        int     mask;
+
+        ctl = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl),
+                           _mm_cmpeq_epi8(v, del));
+        mask = _mm_movemask_epi8(ctl);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+    return i + CtlScalar(s + i, len - i);
+}
+
+static size_t
+TokenSse2(const char *s, size_t len)
+{
+    size_t i = 0u;
+
+    for (; i + 16u <= len; i += 16u) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+        __m128i bad;
+        int     mask;
+
+        /*
+         * Outside of the visible ASCII range 0x21..0x7e (signed
+         * comparison, bytes >= 0x80 are negative).
+         */
+        bad = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x21)),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+        /*
+         * Separators: '(' ')', ':' ... '@', '[' '\' ']', and '"' ','
+         * '/' '{' '}'.
+         */
+        bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x27)),
+                                              _mm_cmplt_epi8(v, _mm_set1_epi8(0x2a))));
+        bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x39)),
+                                              _mm_cmplt_epi8(v, _mm_set1_epi8(0x41))));
+        bad = _mm_or_si128(bad, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x5a)),
+                                              _mm_cmplt_epi8(v, _mm_set1_epi8(0x5e))));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+
+        mask = _mm_movemask_epi8(bad);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+    return i + TokenScalar(s + i, len - i);
+}
+#endif /* NS_HTTPSCAN_SSE2 */
+
+#ifdef NS_HTTPSCAN_AVX2
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CtlAvx2, TokenAvx2 --
+ *
+ *      AVX2 kernels processing 32 bytes per step. The token kernel
+ *      classifies the bytes via two nibble lookup tables: the entry
+ *      of the low nibble contains a bit for every high nibble
+ *      (0..7) forming a token character.
+ *
+ * Results:
+ *      Offset of the first control character (respectively the first
+ *      non-token character) or len.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+CtlAvx2(const char *s, size_t len)
+{
+    const __m256i limit = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t        i = 0u;
+
+    for (; i + 32u <= len; i += 32u) {
+        __m256i  v = _mm256_loadu_si256((const __m256i *)(const void *)(s + i));
+        __m256i  ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v);
+        unsigned mask;
+
+        ctl = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl),
+                              _mm256_cmpeq_epi8(v, del));
+        mask = (unsigned)_mm256_movemask_epi8(ctl);
+        if (mask != 0u) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + CtlScalar(s + i, len - i);
+}
+
+#define C(x) ((char)(x))
+
+static size_t
+TokenAvx2(const char *s, size_t len)
+{
+    const __m256i lowTable = _mm256_setr_epi8(
+        C(0xe8), C(0xfc), C(0xf8), C(0xfc), C(0xfc), C(0xfc), C(0xfc), C(0xfc),
+        C(0xf8), C(0xf8), C(0xf4), C(0x54), C(0xd0), C(0x54), C(0xf4), C(0x70),
+        C(0xe8), C(0xfc), C(0xf8), C(0xfc), C(0xfc), C(0xfc), C(0xfc), C(0xfc),
+        C(0xf8), C(0xf8), C(0xf4), C(0x54), C(0xd0), C(0x54), C(0xf4), C(0x70));
+    const __m256i highTable = _mm256_setr_epi8(
+        C(0x01), C(0x02), C(0x04), C(0x08), C(0x10), C(0x20), C(0x40), C(0x80),
+        0, 0, 0, 0, 0, 0, 0, 0,
+        C(0x01), C(0x02), C(0x04), C(0x08), C(0x10), C(0x20), C(0x40), C(0x80),
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t        i = 0u;
+
+    for (; i + 32u <= len; i += 32u) {
+        __m256i  v = _mm256_loadu_si256((const __m256i *)(const void *)(s + i));
+        __m256i  lo = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(v, nibble));
+        __m256i  hi = _mm256_shuffle_epi8(highTable,
+                                          _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i  bad = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+        unsigned mask = (unsigned)_mm256_movemask_epi8(bad);
+
+        if (mask != 0u) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + TokenScalar(s + i, len - i);
+}
+#undef C
+#endif /* NS_HTTPSCAN_AVX2 */
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
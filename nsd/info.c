@@ -959,9 +959,9 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
 
     static const char *const opts[] = {
         "address", "argv", "argv0", "bindir", "boottime", "builddate", "buildinfo",
-        "callbacks", "config", "home", "hostname", "ipv6", "locks", "log", "logdir",
+        "callbacks", "config", "dns", "home", "hostname", "ipv6", "locks", "log", "logdir",
         "major", "meminfo", "minor", "mimetypes", "name", "nsd",
-        "patchlevel", "pid", "pools",
+        "patchlevel", "pid", "pools", "reactors",
         "scheduled", "server", "servers",
         "sockcallbacks", "ssl", "tag", "threads", "uptime",
         "version",
@@ -975,10 +975,10 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
 
     enum {
         IAddressIdx, IArgvIdx, IArgv0Idx, IBindirIdx, IBoottimeIdx, IBuilddateIdx, IBuildinfoIdx,
-        ICallbacksIdx, IConfigIdx, IHomeIdx, IHostNameIdx, IIpv6Idx, ILocksIdx, ILogIdx, ILogdirIdx,
+        ICallbacksIdx, IConfigIdx, IDnsIdx, IHomeIdx, IHostNameIdx, IIpv6Idx, ILocksIdx, ILogIdx, ILogdirIdx,
         IMajorIdx, IMeminfoIdx, IMinorIdx, IMimeIdx, INameIdx, INsdIdx,
         IPatchLevelIdx,
-        IPidIdx, IPoolsIdx,
+        IPidIdx, IPoolsIdx, IReactorsIdx,
         IScheduledIdx, IServerIdx, IServersIdx,
         ISockCallbacksIdx, ISSLIdx, ITagIdx, IThreadsIdx, IUptimeIdx,
         IVersionIdx,
@@ -1055,6 +1055,16 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
         Tcl_DStringResult(interp, &ds);
         break;
 
+    case IReactorsIdx:
+        NsGetSockCallbackReactors(&ds);
+        Tcl_DStringResult(interp, &ds);
+        break;
+
+    case IDnsIdx:
+        NsGetDNSStats(&ds);
+        Tcl_DStringResult(interp, &ds);
+        break;
+
     case IScheduledIdx:
         NsGetScheduled(&ds);
         Tcl_DStringResult(interp, &ds);
@@ -1229,6 +1239,13 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_
                            NsAtomObj(NS_ATOM_with_deprecated),
                            Tcl_NewIntObj(defined_NS_WITH_DEPRECATED));
 
+            /*
+             * Kernels used for scanning HTTP requests.
+             */
+            Tcl_DictObjPut(NULL, dictObj,
+                           NsAtomObj(NS_ATOM_simd),
+                           Tcl_NewStringObj(NsHttpScanKernel(), TCL_INDEX_NONE));
+
             /*
              * The nsd binary was built against this version of Tcl
              */
@@ -65,10 +65,16 @@ Nsd_LibInit(void)
         NsInitBinder();
         NsInitListen();
         NsInitLimits();
+        NsInitRespCacheUrlSpace();
         NsInitInfo();
         NsInitSockCallback();
+        NsInitSse();
         NsInitTask();
         NsInitProcInfo();
+        NsInitRevProxy();
+        NsInitUpstreams();
+        NsInitHttpScan();
+        NsInitJsonIndex();
         NsInitDrivers();
         NsInitQueue();
         NsInitSched();
@@ -74,6 +74,34 @@ typedef struct LogFilter {
     struct LogFilter  *prevPtr;
 } LogFilter;
 
+/*
+ * The following struct is a per-thread ring buffer of formatted log lines
+ * for the log writer thread. The thread producing the log lines is the
+ * only one advancing "head", the log writer thread is the only one
+ * advancing "tail". Both counters grow monotonically; the position in the
+ * buffer is obtained by masking with the power-of-two size.
+ */
+
+typedef struct LogRing {
+    struct LogRing *nextPtr;    /* Next ring known to the log writer */
+    char           *buffer;     /* Ring buffer memory */
+    size_t          size;       /* Size of the buffer, power of two */
+    size_t          head;       /* Bytes ever written by the owning thread */
+    size_t          tail;       /* Bytes ever written to the log file */
+    bool            orphaned;   /* Owning thread has exited */
+    unsigned long   queued;     /* Lines queued by the owning thread */
+    unsigned long   dropped;    /* Lines dropped due to full buffer */
+    unsigned long   blocked;    /* Lines which had to wait for buffer space */
+} LogRing;
+
+#if defined(HAVE_GNU_ATOMIC_UINT32_BUILTINS)
+# define LogRingLoad(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define LogRingStore(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+# define LogRingLoad(ptr)       (*(ptr))
+# define LogRingStore(ptr, val) (*(ptr) = (val))
+#endif
+
 /*
  * The following struct maintains per-thread cached log entries.
  * The cache is a simple dynamic string where variable-length
@@ -92,6 +120,7 @@ typedef struct LogCache {
     size_t      lbufSize;
     LogEntry   *firstEntry;   /* First in the list of log entries */
     LogEntry   *currentEntry; /* Current in the list of log entries */
+    LogRing    *ringPtr;      /* Lines queued for the log writer thread */
     Tcl_DString buffer;       /* The log entries cache text-cache */
 } LogCache;
 
@@ -143,6 +172,17 @@ static Tcl_Obj *LogStats(void);
 static char *LogSeverityColor(char *buffer, Ns_LogSeverity severity)
     NS_GNUC_NONNULL(1);
 
+static void LogWrite(int fd, Ns_LogSeverity severity, const char *bytes, size_t length)
+    NS_GNUC_NONNULL(3);
+static bool LogRingPut(LogCache *cachePtr, const char *bytes, size_t length)
+    NS_GNUC_NONNULL(1,2);
+static void LogRingDrainWait(const LogRing *ringPtr)
+    NS_GNUC_NONNULL(1);
+static void LogWriteV(struct iovec *iov, int niov)
+    NS_GNUC_NONNULL(1);
+static Tcl_Obj *LogWriterStats(void);
+static Ns_ThreadProc LogWriterThread;
+
 /*
  * Static variables defined in this file
  */
@@ -185,6 +225,44 @@ typedef enum {
     COLOR_BRIGHT = 1u
 } LogColorIntensity;
 
+typedef enum {
+    LOG_WRITER_BLOCK = 0u,
+    LOG_WRITER_DROP  = 1u
+} LogWriterPolicy;
+
+static Ns_ObjvTable writerPolicies[] = {
+    {"block",    LOG_WRITER_BLOCK},
+    {"drop",     LOG_WRITER_DROP},
+    {NULL,       0u}
+};
+
+/*
+ * State of the log writer thread, writing the system log lines queued in
+ * the per-thread rings. The lock protects the list of rings and the
+ * condition variables; it is not used for queuing a line.
+ */
+
+static struct {
+    Ns_Mutex        lock;
+    Ns_Cond         cond;         /* Wakes up the log writer */
+    Ns_Cond         spaceCond;    /* Wakes up threads waiting for ring space */
+    Ns_Thread       thread;
+    uintptr_t       threadId;
+    LogRing        *firstRingPtr;
+    size_t          bufferSize;   /* Size of per-thread rings */
+    LogWriterPolicy policy;
+    bool            running;
+    bool            stop;
+    bool            sleeping;
+    unsigned long   queued;       /* Counts of released rings */
+    unsigned long   dropped;
+    unsigned long   blocked;
+    unsigned long   writes;       /* Number of write operations */
+    size_t          bytes;        /* Number of bytes written */
+} logWriter;
+
+#define LOG_WRITER_MAXIOV 64
+
 static LogColor prefixColor = COLOR_GREEN;
 static LogColorIntensity prefixIntensity = COLOR_NORMAL;
 
@@ -392,6 +470,30 @@ NsConfigLog(void)
 
     rollfmt = ns_strcopy(Ns_ConfigString(section, "logrollfmt", NS_EMPTY_STRING));
 
+    if (Ns_ConfigBool(section, "logwriter", NS_FALSE) == NS_TRUE) {
+#if defined(HAVE_GNU_ATOMIC_UINT32_BUILTINS)
+        size_t size = (size_t)Ns_ConfigMemUnitRange(section, "logwriterbuffersize", "64KB", 65536,
+                                                    4096, INT_MAX);
+        /*
+         * Round up to a power of two, such that ring positions can be
+         * computed by masking.
+         */
+        logWriter.bufferSize = 4096u;
+        while (logWriter.bufferSize < size) {
+            logWriter.bufferSize <<= 1u;
+        }
+        logWriter.policy = Ns_ConfigGetEnum(section, "logwriterpolicy",
+                                            writerPolicies, LOG_WRITER_BLOCK);
+        Ns_MutexInit(&logWriter.lock);
+        Ns_MutexSetName(&logWriter.lock, "ns:logwriter");
+        Ns_CondInit(&logWriter.cond);
+        Ns_CondInit(&logWriter.spaceCond);
+        logWriter.running = NS_TRUE;
+        Ns_ThreadCreate(LogWriterThread, NULL, 0, &logWriter.thread);
+#else
+        Ns_Log(Warning, "log: parameter 'logwriter' ignored, atomic operations are not available");
+#endif
+    }
 }
 
 
@@ -1575,14 +1677,20 @@ NsTclLogCtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tc
             }
             break;
 
-        case CStatsIdx:
-            if (objc > 2) {
-                Tcl_WrongNumArgs(interp, 2, objv, NULL);
+        case CStatsIdx: {
+            int         writer = 0;
+            Ns_ObjvSpec lopts[] = {
+                {"-writer", Ns_ObjvBool, &writer, INT2PTR(NS_TRUE)},
+                {NULL, NULL, NULL, NULL}
+            };
+
+            if (Ns_ParseObjv(lopts, NULL, interp, 2, objc, objv) != NS_OK) {
                 result = TCL_ERROR;
             } else {
-                Tcl_SetObjResult(interp, LogStats());
+                Tcl_SetObjResult(interp, writer ? LogWriterStats() : LogStats());
             }
             break;
+        }
 
         default:
             /*
@@ -1951,6 +2059,449 @@ LogClose(void *UNUSED(arg))
 }
 
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogWrite --
+ *
+ *      Write a formatted log line to the passed file descriptor. When
+ *      the log writer thread is running, lines for the system log are
+ *      queued in the ring buffer of the current thread instead. Fatal
+ *      messages and lines larger than the ring are written directly,
+ *      after the lines queued before by this thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes to the file descriptor or queues the line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogWrite(int fd, Ns_LogSeverity severity, const char *bytes, size_t length)
+{
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+    if (length == 0u) {
+        return;
+    }
+    if (fd == STDERR_FILENO
+        && logWriter.running
+        && Ns_ThreadId() != logWriter.threadId) {
+        LogCache *cachePtr = GetCache();
+
+        if (severity != Fatal && LogRingPut(cachePtr, bytes, length)) {
+            return;
+        }
+        if (cachePtr->ringPtr != NULL) {
+            LogRingDrainWait(cachePtr->ringPtr);
+        }
+    }
+    (void) NsAsyncWrite(fd, bytes, length);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogRingPut --
+ *
+ *      Queue a formatted log line in the ring buffer of the current
+ *      thread, creating the ring on first use. When the ring is full,
+ *      the line is dropped or the thread waits for the log writer,
+ *      depending on "logwriterpolicy".
+ *
+ * Results:
+ *      NS_TRUE when the line was queued or dropped, NS_FALSE when the
+ *      caller has to write the line directly.
+ *
+ * Side effects:
+ *      May wake up the log writer thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+LogRingPut(LogCache *cachePtr, const char *bytes, size_t length)
+{
+    LogRing *ringPtr;
+    size_t   head, offset, first;
+    bool     waited = NS_FALSE;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(bytes != NULL);
+
+    ringPtr = cachePtr->ringPtr;
+    if (ringPtr == NULL) {
+        ringPtr = ns_calloc(1u, sizeof(LogRing));
+        ringPtr->size = logWriter.bufferSize;
+        ringPtr->buffer = ns_malloc(ringPtr->size);
+
+        Ns_MutexLock(&logWriter.lock);
+        ringPtr->nextPtr = logWriter.firstRingPtr;
+        logWriter.firstRingPtr = ringPtr;
+        Ns_MutexUnlock(&logWriter.lock);
+        cachePtr->ringPtr = ringPtr;
+    }
+
+    if (length > ringPtr->size) {
+        return NS_FALSE;
+    }
+
+    head = ringPtr->head;
+    while (ringPtr->size - (head - LogRingLoad(&ringPtr->tail)) < length) {
+        Ns_Time timeout;
+
+        if (logWriter.policy == LOG_WRITER_DROP) {
+            ringPtr->dropped++;
+            return NS_TRUE;
+        }
+        if (!waited) {
+            ringPtr->blocked++;
+            waited = NS_TRUE;
+        }
+        Ns_GetTime(&timeout);
+        Ns_IncrTime(&timeout, 0, 100000);
+
+        Ns_MutexLock(&logWriter.lock);
+        if (!logWriter.running) {
+            Ns_MutexUnlock(&logWriter.lock);
+            return NS_FALSE;
+        }
+        if (ringPtr->size - (head - LogRingLoad(&ringPtr->tail)) < length) {
+            Ns_CondSignal(&logWriter.cond);
+            (void) Ns_CondTimedWait(&logWriter.spaceCond, &logWriter.lock, &timeout);
+        }
+        Ns_MutexUnlock(&logWriter.lock);
+    }
+
+    offset = head & (ringPtr->size - 1u);
+    first = MIN(length, ringPtr->size - offset);
+    memcpy(ringPtr->buffer + offset, bytes, first);
+    if (first < length) {
+        memcpy(ringPtr->buffer, bytes + first, length - first);
+    }
+    LogRingStore(&ringPtr->head, head + length);
+    ringPtr->queued++;
+
+    if (LogRingLoad(&logWriter.sleeping)) {
+        Ns_MutexLock(&logWriter.lock);
+        Ns_CondSignal(&logWriter.cond);
+        Ns_MutexUnlock(&logWriter.lock);
+    }
+
+    return NS_TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogRingDrainWait --
+ *
+ *      Wait until the log writer has written all lines queued in the
+ *      passed ring. The wait is bounded, such that a blocked log file
+ *      cannot prevent e.g. fatal messages from being written.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogRingDrainWait(const LogRing *ringPtr)
+{
+    Ns_Time timeout;
+
+    NS_NONNULL_ASSERT(ringPtr != NULL);
+
+    Ns_GetTime(&timeout);
+    Ns_IncrTime(&timeout, 2, 0);
+
+    Ns_MutexLock(&logWriter.lock);
+    while (logWriter.running && LogRingLoad(&ringPtr->tail) != ringPtr->head) {
+        Ns_CondSignal(&logWriter.cond);
+        if (Ns_CondTimedWait(&logWriter.spaceCond, &logWriter.lock, &timeout) != NS_OK) {
+            break;
+        }
+    }
+    Ns_MutexUnlock(&logWriter.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogWriteV --
+ *
+ *      Write the passed buffers to stderr (the system log), handling
+ *      partial writes and the platform limit on the number of buffers.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The contents of iov are modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogWriteV(struct iovec *iov, int niov)
+{
+    NS_NONNULL_ASSERT(iov != NULL);
+
+    while (niov > 0) {
+#ifdef _WIN32
+        ssize_t written = ns_write(STDERR_FILENO, iov->iov_base, iov->iov_len);
+#else
+        ssize_t written = writev(STDERR_FILENO, iov, MIN(niov, UIO_MAXIOV));
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ns_fprintf(stderr, "log: write to system log failed: %s\n", strerror(errno));
+            break;
+        }
+        while (niov > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogWriterThread --
+ *
+ *      Log writer thread. Collects the queued lines of all per-thread
+ *      rings and writes them in a single batch. Rings of exited
+ *      threads are freed once they are drained.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes to the system log; wakes up threads waiting for ring
+ *      space.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogWriterThread(void *UNUSED(arg))
+{
+    struct iovec *iov = NULL;
+    LogRing     **rings = NULL;
+    size_t       *heads = NULL;
+    int           nalloc = 0;
+
+    Ns_ThreadSetName("-logwriter-");
+    logWriter.threadId = Ns_ThreadId();
+
+    Ns_MutexLock(&logWriter.lock);
+    for (;;) {
+        LogRing **ringPtrPtr = &logWriter.firstRingPtr;
+        int       niov = 0, nrings = 0, i;
+        size_t    nbytes = 0u;
+
+        while (*ringPtrPtr != NULL) {
+            LogRing *ringPtr = *ringPtrPtr;
+            size_t   head = LogRingLoad(&ringPtr->head), tail = ringPtr->tail;
+
+            if (head == tail) {
+                if (ringPtr->orphaned) {
+                    *ringPtrPtr = ringPtr->nextPtr;
+                    logWriter.queued += ringPtr->queued;
+                    logWriter.dropped += ringPtr->dropped;
+                    logWriter.blocked += ringPtr->blocked;
+                    ns_free(ringPtr->buffer);
+                    ns_free(ringPtr);
+                    continue;
+                }
+            } else {
+                size_t offset = tail & (ringPtr->size - 1u);
+                size_t length = head - tail;
+                size_t first  = MIN(length, ringPtr->size - offset);
+
+                if (nrings == nalloc) {
+                    nalloc = (nalloc == 0) ? LOG_WRITER_MAXIOV : nalloc * 2;
+                    iov   = ns_realloc(iov, sizeof(struct iovec) * (size_t)nalloc * 2u);
+                    rings = ns_realloc(rings, sizeof(LogRing *) * (size_t)nalloc);
+                    heads = ns_realloc(heads, sizeof(size_t) * (size_t)nalloc);
+                }
+                iov[niov].iov_base = ringPtr->buffer + offset;
+                iov[niov].iov_len  = first;
+                niov++;
+                if (first < length) {
+                    iov[niov].iov_base = ringPtr->buffer;
+                    iov[niov].iov_len  = length - first;
+                    niov++;
+                }
+                rings[nrings] = ringPtr;
+                heads[nrings] = head;
+                nrings++;
+                nbytes += length;
+            }
+            ringPtrPtr = &ringPtr->nextPtr;
+        }
+
+        if (nrings == 0) {
+            Ns_Time timeout;
+
+            if (logWriter.stop) {
+                break;
+            }
+            /*
+             * Producers signal only a sleeping writer, so the timeout
+             * bounds the delay of a line queued while going to sleep.
+             */
+            Ns_GetTime(&timeout);
+            Ns_IncrTime(&timeout, 0, 100000);
+            LogRingStore(&logWriter.sleeping, NS_TRUE);
+            (void) Ns_CondTimedWait(&logWriter.cond, &logWriter.lock, &timeout);
+            LogRingStore(&logWriter.sleeping, NS_FALSE);
+            continue;
+        }
+
+        Ns_MutexUnlock(&logWriter.lock);
+        LogWriteV(iov, niov);
+        Ns_MutexLock(&logWriter.lock);
+
+        for (i = 0; i < nrings; i++) {
+            LogRingStore(&rings[i]->tail, heads[i]);
+        }
+        logWriter.writes++;
+        logWriter.bytes += nbytes;
+        Ns_CondBroadcast(&logWriter.spaceCond);
+    }
+    logWriter.running = NS_FALSE;
+    Ns_CondBroadcast(&logWriter.spaceCond);
+    Ns_MutexUnlock(&logWriter.lock);
+
+    ns_free(iov);
+    ns_free(rings);
+    ns_free(heads);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsStopLogWriter --
+ *
+ *      Stop the log writer thread after it has written all queued
+ *      lines. Later log lines are written directly.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Joins the log writer thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsStopLogWriter(void)
+{
+    if (logWriter.running) {
+        Ns_MutexLock(&logWriter.lock);
+        logWriter.stop = NS_TRUE;
+        Ns_CondSignal(&logWriter.cond);
+        Ns_MutexUnlock(&logWriter.lock);
+        Ns_ThreadJoin(&logWriter.thread, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogWriterStats --
+ *
+ *      Return a Tcl dict with the statistics of the log writer. Like
+ *      in LogStats(), the per-thread counters are read without
+ *      synchronization with the owning threads.
+ *
+ * Results:
+ *      Tcl dict
+ *
+ * Side effects:
+ *      None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+LogWriterStats(void)
+{
+    Tcl_Obj       *dictObj = Tcl_NewDictObj();
+    unsigned long  queued = 0u, dropped = 0u, blocked = 0u, writes = 0u;
+    size_t         pending = 0u, bytes = 0u;
+    int            nrings = 0;
+    bool           enabled = (logWriter.bufferSize > 0u);
+
+    if (enabled) {
+        const LogRing *ringPtr;
+
+        Ns_MutexLock(&logWriter.lock);
+        queued = logWriter.queued;
+        dropped = logWriter.dropped;
+        blocked = logWriter.blocked;
+        writes = logWriter.writes;
+        bytes = logWriter.bytes;
+        for (ringPtr = logWriter.firstRingPtr; ringPtr != NULL; ringPtr = ringPtr->nextPtr) {
+            queued += ringPtr->queued;
+            dropped += ringPtr->dropped;
+            blocked += ringPtr->blocked;
+            pending += LogRingLoad(&ringPtr->head) - ringPtr->tail;
+            nrings++;
+        }
+        Ns_MutexUnlock(&logWriter.lock);
+    }
+
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("enabled", 7),
+                         Tcl_NewBooleanObj(enabled));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("policy", 6),
+                         Tcl_NewStringObj(logWriter.policy == LOG_WRITER_DROP ? "drop" : "block",
+                                          TCL_INDEX_NONE));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("buffersize", 10),
+                         Tcl_NewWideIntObj((Tcl_WideInt)logWriter.bufferSize));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("threads", 7),
+                         Tcl_NewIntObj(nrings));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("queued", 6),
+                         Tcl_NewWideIntObj((Tcl_WideInt)queued));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("dropped", 7),
+                         Tcl_NewWideIntObj((Tcl_WideInt)dropped));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("blocked", 7),
+                         Tcl_NewWideIntObj((Tcl_WideInt)blocked));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("pending", 7),
+                         Tcl_NewWideIntObj((Tcl_WideInt)pending));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("writes", 6),
+                         Tcl_NewWideIntObj((Tcl_WideInt)writes));
+    (void)Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("bytes", 5),
+                         Tcl_NewWideIntObj((Tcl_WideInt)bytes));
+
+    return dictObj;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -2161,7 +2712,7 @@ LogToFile(void *arg, Ns_LogSeverity severity, const Ns_Time *stamp,
             Tcl_DStringInit(&dsRepeat);
             Ns_DStringPrintf(&dsRepeat, "last log entry for this thread was repeated %lu times", sameLineCount);
             (void) LogToDString(&ds, lastSeverity, stamp, dsRepeat.string, (size_t)dsRepeat.length);
-            (void) NsAsyncWrite(fd, ds.string, (size_t)ds.length);
+            LogWrite(fd, lastSeverity, ds.string, (size_t)ds.length);
             Tcl_DStringFree(&dsRepeat);
 
             Tcl_DStringSetLength(&ds, 0);
@@ -2169,7 +2720,7 @@ LogToFile(void *arg, Ns_LogSeverity severity, const Ns_Time *stamp,
         }
 
         (void) LogToDString(&ds, severity, stamp, msg, len);
-        (void) NsAsyncWrite(fd, ds.string, (size_t)ds.length);
+        LogWrite(fd, severity, ds.string, (size_t)ds.length);
         Tcl_DStringFree(&ds);
 
         lastLen = len;
@@ -2187,7 +2738,7 @@ LogToFile(void *arg, Ns_LogSeverity severity, const Ns_Time *stamp,
     Tcl_DStringInit(&ds);
 
     (void) LogToDString(&ds, severity, stamp, msg, len);
-    (void) NsAsyncWrite(fd, Ns_DStringValue(&ds), (size_t)Ns_DStringLength(&ds));
+    LogWrite(fd, severity, Ns_DStringValue(&ds), (size_t)Ns_DStringLength(&ds));
 
     Tcl_DStringFree(&ds);
 #endif
@@ -2433,6 +2984,17 @@ FreeCache(void *arg)
 
         LogFlush(cachePtr, filters, -1, NS_TRUE, NS_TRUE);
 
+        if (cachePtr->ringPtr != NULL) {
+            /*
+             * The log writer frees the ring after writing the remaining
+             * lines.
+             */
+            Ns_MutexLock(&logWriter.lock);
+            cachePtr->ringPtr->orphaned = NS_TRUE;
+            Ns_CondSignal(&logWriter.cond);
+            Ns_MutexUnlock(&logWriter.lock);
+            cachePtr->ringPtr = NULL;
+        }
         Tcl_DStringFree(&cachePtr->buffer);
         ns_free(cachePtr);
     }
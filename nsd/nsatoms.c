@@ -460,6 +460,7 @@ InitCoreAtomSpecs(void)
     atoms[NS_ATOM_server].name           = "server";         atoms[NS_ATOM_server].len = 6;
     atoms[NS_ATOM_servername].name       = "servername";     atoms[NS_ATOM_servername].len = 10;
     atoms[NS_ATOM_signature].name        = "signature";      atoms[NS_ATOM_signature].len = 9;
+    atoms[NS_ATOM_simd].name             = "simd";           atoms[NS_ATOM_simd].len = 4;
     atoms[NS_ATOM_size_dynamic].name     = "size_dynamic";   atoms[NS_ATOM_size_dynamic].len = 12;
     atoms[NS_ATOM_size_static].name      = "size_static";    atoms[NS_ATOM_size_static].len = 11;
     atoms[NS_ATOM_slot].name             = "slot";           atoms[NS_ATOM_slot].len = 4;
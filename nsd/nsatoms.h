@@ -208,6 +208,7 @@ typedef enum {
     NS_ATOM_server,
     NS_ATOM_servername,
     NS_ATOM_signature,
+    NS_ATOM_simd,
     NS_ATOM_size_dynamic,
     NS_ATOM_size_static,
     NS_ATOM_slot,
@@ -104,10 +104,12 @@ NsConfUpdate(void)
     NsConfigMimeTypes();
     NsConfigProgress();
     NsConfigDNS();
+    NsConfigSockCallback();
     NsConfigRedirects();
     NsConfigVhost();
     NsConfigEncodings();
     NsConfigTclHttp();
+    NsConfigTLSClient();
 
     /*
      * Set a default stacksize for threads, if specified. Use OS default otherwise.
@@ -134,6 +136,7 @@ NsConfUpdate(void)
      * sched.c
      */
     nsconf.sched.jobsperthread = Ns_ConfigIntRange(section, "schedsperthread", 0, 0, INT_MAX);
+    nsconf.sched.maxthreads = Ns_ConfigIntRange(section, "schedmaxthreads", 0, 0, INT_MAX);
     Ns_ConfigTimeUnitRange(section, "schedlogminduration", "2s",
                            /* min sec */1, /* min usec */ 0, LONG_MAX, 0,
                            &nsconf.sched.maxelapsed);
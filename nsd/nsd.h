@@ -148,6 +148,8 @@ typedef struct {
 struct Sock;
 struct NsServer;
 typedef struct NsWriterSock NsWriterSock;
+typedef struct NsRespCacheFill NsRespCacheFill;
+typedef struct NsRespCacheSend NsRespCacheSend;
 
 struct nsconf {
     const char *argv0;
@@ -213,6 +215,7 @@ struct nsconf {
     struct {
         Ns_Time maxelapsed;
         int jobsperthread;
+        int maxthreads;
     } sched;
 
 #ifdef _WIN32
@@ -374,6 +377,8 @@ typedef struct {
     Tcl_DString     *frameBuffer;             /* Buffer of for a single WebSocket frame */
     Tcl_DString     *fragmentsBuffer;         /* Buffer for multiple WebSocket segments */
     int              fragmentsOpcode;         /* Opcode of the first WebSocket segment */
+    bool             fragmentsCompressed;     /* First WebSocket segment is compressed (RSV1) */
+    Ns_CompressStream *inflateStream;         /* Stream for permessage-deflate messages */
     int              debugLevel;              /* Debug level (1 log statements, > 1 extra log files) */
     bool             frameNeedsData;          /* Indicator, if additional reads are required */
     bool             requireStableSendBuffer; /* Retransmits for OpenSSL are required to have the same base address and length */
@@ -382,6 +387,12 @@ typedef struct {
 
 
 
+/*
+ * Incremental parser for multipart/form-data content (see form.c).
+ */
+
+typedef struct NsMultipartParser NsMultipartParser;
+
 /*
  * The following structure defines the entire request
  * including HTTP request line, headers, and content.
@@ -424,6 +435,14 @@ typedef struct Request {
     Tcl_DString buffer;           /* Request and content buffer */
     char   savedChar;             /* Character potentially clobbered by null character */
 
+    NsMultipartParser *multipartPtr; /* Incremental parser for spooled multipart content */
+
+    /*
+     * Request body delivered to the connection thread while it is
+     * received (see NS_OP_STREAMBODY).
+     */
+    bool   streamBody;            /* Connection thread reads the body from the socket */
+    size_t streamRemaining;       /* Body bytes not yet received from the socket */
 } Request;
 
 /*
@@ -553,6 +572,8 @@ typedef struct Driver {
         Tcl_WideInt partial;            /* Partial operations */
         Tcl_WideInt received;           /* Received requests */
         Tcl_WideInt errors;             /* Dropped requests due to errors */
+        Tcl_WideInt tlsfull;            /* TLS handshakes without session resumption */
+        Tcl_WideInt tlsresumed;         /* TLS handshakes with resumed session */
         /*
          * Current driver-thread state. These are gauges, not cumulative counters.
          */
@@ -627,6 +648,7 @@ typedef struct Sock {
     ssize_t             sendRejected;     /* handling of SSL_ERROR_WANT_WRITE */
     void               *sendRejectedBase; /* for retransmitting in case of SSL_ERROR_WANT_WRITE */
     unsigned int        deliveryRefs;     /* Nr of delivery objects/threads that may invoke sendProc */
+    NsRespCacheSend    *rcSendPtr;        /* Remainder of a cached response started by the driver */
     size_t              sendCount;        // debugging
     void               *sls[1];           /* Slots for sls storage */
 
@@ -641,6 +663,7 @@ typedef struct FormFile {
     Tcl_Obj *hdrObj;
     Tcl_Obj *offObj;
     Tcl_Obj *sizeObj;
+    Tcl_Obj *tmpObj;
 } FormFile;
 
 /*
@@ -745,6 +768,7 @@ typedef struct Conn {
 
     int fd;
     NsWriterSock *strWriter;
+    NsRespCacheFill *rcFillPtr; /* Response computed for the response cache */
     int rateLimit;          /* -1 undefined, 0 unlimited, otherwise KB/s */
 
     Ns_CompressStream cStream;
@@ -1054,6 +1078,7 @@ typedef struct NsServer {
         unsigned int flags;
         int tracesize;
         size_t bufsize;
+        size_t streamflushsize;
         size_t cachesize;
 
         const char *errorpage;
@@ -1064,6 +1089,15 @@ typedef struct NsServer {
         Ns_Cond pagecond;
         Ns_Mutex pagelock;
         Tcl_HashTable pages;
+        const char *precompiledcache;   /* file of the precompiled pages or NULL */
+        char *precompiledSignature;     /* tag signature of the precompiled pages */
+        Tcl_HashTable precompiled;      /* precompiled pages, protected by pagelock */
+        struct {
+            size_t sharedSize;   /* bytes of the parsed pages shared between interps */
+            size_t privateSize;  /* bytes of the per-interp script objects */
+            unsigned long precompiledHits;
+            unsigned long precompiledMisses;
+        } stats;                 /* protected by pagelock */
         Ns_RWLock taglock;
         Tcl_HashTable tags;
         Tcl_HashTable tagsets;
@@ -1076,6 +1110,27 @@ typedef struct NsServer {
         bool preinit;   /* initialize the compression stream buffers in advance */
     } compress;
 
+    /*
+     * The following struct maintains the response cache (respcache.c).
+     * The statistics are protected by the cache lock.
+     */
+
+    struct {
+        Ns_Cache *cache;        /* NULL, when the response cache is disabled */
+        size_t    maxentry;     /* max size of a cached response body */
+        Ns_Time   waittimeout;  /* max time to wait for a concurrent fill */
+        struct {
+            unsigned long hits;
+            unsigned long driverhits;
+            unsigned long notmodified;
+            unsigned long stale;
+            unsigned long misses;
+            unsigned long coalesced;
+            unsigned long stores;
+            unsigned long purged;
+        } stats;
+    } respcache;
+
     /*
      * The following struct maintains the arrays
      * for the nsv commands.
@@ -1106,8 +1161,18 @@ typedef struct NsServer {
         Ns_RWLock lock;
         //Ns_Mutex wlock;
         Tcl_HashTable table;
+        Tcl_HashTable groups;   /* Broadcast groups, values are tables of channel names */
     } connchans;
 
+    /*
+     * The following struct maintains the topics of the ns_sse
+     * command, protected by the lock in sse.c.
+     */
+
+    struct {
+        Tcl_HashTable topics;   /* Values are tables of subscribed SSE clients */
+    } sse;
+
     struct {
         Ns_Mutex lock;
         const char *logFileName;
@@ -1189,6 +1254,7 @@ typedef struct NsInterp {
 
     struct adp {
         size_t            bufsize;
+        size_t            streamflushsize;
         unsigned int      flags;
         AdpResult         exception;
         int               refresh;
@@ -1249,6 +1315,42 @@ NS_EXTERN Ns_ReturnCode NsWriterQueue(
 ) NS_GNUC_NONNULL(1);
 
 
+/*
+ * Upstream groups: named sets of backend servers, shared by the native
+ * reverse proxy and by "ns_http -upstream". The members of a group are
+ * fixed at creation time; the state fields are protected by the lock
+ * of the group.
+ */
+
+typedef struct NsUpstreamGroup NsUpstreamGroup;
+
+typedef enum {
+    NS_UPSTREAM_OK,                      /* Request completed */
+    NS_UPSTREAM_ERROR,                   /* Connection or I/O error */
+    NS_UPSTREAM_TIMEOUT,                 /* Upstream did not answer in time */
+    NS_UPSTREAM_IGNORE                   /* Not attributable to the upstream (e.g. cancel) */
+} NsUpstreamResult;
+
+typedef struct NsUpstreamMember {
+    NsUpstreamGroup   *groupPtr;
+    char              *url;              /* "scheme://host:port" */
+    char              *host;
+    unsigned short     port;
+    bool               https;
+    bool               healthy;          /* Result of the active health checks */
+    int                failedChecks;     /* Consecutive failed health checks */
+    int                failures;         /* Consecutive failed requests */
+    Ns_Time            ejectedUntil;     /* Passive outlier ejection */
+    unsigned long      outstanding;      /* Requests in progress */
+    struct {
+        unsigned long  requests;
+        unsigned long  errors;
+        unsigned long  timeouts;
+        unsigned long  ejections;
+        unsigned long  checks;
+    } stats;
+} NsUpstreamMember;
+
 /*
  * Structures handling HTTP tasks
  */
@@ -1313,6 +1415,8 @@ typedef struct {
     size_t             pos;              /* needed only for HttpCancel() */
     Tcl_DString        ds;               /* for assembling request string */
     struct _NsHttpChunk *chunk;          /* for parsing chunked encodings */
+    struct HttpUpstream *upstreamPtr;    /* per-upstream connection statistics */
+    NsUpstreamMember  *memberPtr;        /* member of an upstream group (-upstream) */
     //Ns_Mutex           lock;
 } NsHttpTask;
 
@@ -1361,6 +1465,31 @@ typedef struct {
     unsigned int  accept[NS_MAX_VALIDITY_ERRORS_PER_RULE];
 } NsCertValidationException_t;
 
+/*
+ * Hierarchical timing wheel (timerwheel.c). Every level has
+ * NS_TIMERWHEEL_SLOTS slots, the slots of level n cover
+ * NS_TIMERWHEEL_SLOTS^n ticks. Entries are embedded in the structures
+ * of the users and linked into the slot lists.
+ */
+#define NS_TIMERWHEEL_BITS    8
+#define NS_TIMERWHEEL_SLOTS   (1 << NS_TIMERWHEEL_BITS)
+#define NS_TIMERWHEEL_LEVELS  5
+
+typedef struct NsTimerWheelEntry {
+    struct NsTimerWheelEntry  *nextPtr;
+    struct NsTimerWheelEntry  *prevPtr;   /* The first entry points to the last one */
+    struct NsTimerWheelEntry **headPtr;   /* Slot list, NULL when not queued */
+    int64_t                    tick;      /* Expiry time in ticks */
+    void                      *clientData;
+} NsTimerWheelEntry;
+
+typedef struct NsTimerWheel {
+    int64_t            resolution;        /* Duration of a tick in microseconds */
+    int64_t            current;           /* Next tick to be processed */
+    size_t             count;             /* Number of queued entries */
+    NsTimerWheelEntry *slots[NS_TIMERWHEEL_LEVELS][NS_TIMERWHEEL_SLOTS];
+} NsTimerWheel;
+
 
 #define NS_HTTP_FLAG_GUNZIP (NS_HTTP_FLAG_DECOMPRESS|NS_HTTP_FLAG_GZIP_ENCODING)
 
@@ -1391,6 +1520,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclAdpInfoObjCmd,
     NsTclAdpMimeTypeObjCmd,
     NsTclAdpParseObjCmd,
+    NsTclAdpPrecompileObjCmd,
     NsTclAdpPutsObjCmd,
     NsTclAdpRegisterAdpObjCmd,
     NsTclAdpRegisterAdptagObjCmd,
@@ -1547,10 +1677,12 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclRegisterLimitsObjCmd,
     NsTclRegisterProcObjCmd,
     NsTclRegisterProxyObjCmd,
+    NsTclRegisterRevProxyObjCmd,
     NsTclRegisterTclObjCmd,
     NsTclRegisterTraceObjCmd,
     NsTclRegisterUrl2FileObjCmd,
     NsTclRequestAuthorizeObjCmd,
+    NsTclRespCacheObjCmd,
     NsTclRespondObjCmd,
     NsTclResumeObjCmd,
     NsTclReturnBadRequestObjCmd,
@@ -1566,6 +1698,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclReturnTooLargeObjCmd,
     NsTclReturnUnauthorizedObjCmd,
     NsTclReturnUnavailableObjCmd,
+    NsTclRevProxyObjCmd,
     NsTclRlimitObjCmd,
     NsTclRollFileObjCmd,
     NsTclRunOnceObjCmd,
@@ -1597,6 +1730,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclSockSetBlockingObjCmd,
     NsTclSockSetNonBlockingObjCmd,
     NsTclSocketPairObjCmd,
+    NsTclSseObjCmd,
     NsTclStartContentObjCmd,
     NsTclStrcollObjCmd,
     NsTclStrftimeObjCmd,
@@ -1611,6 +1745,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclUnRegisterUrl2FileObjCmd,
     NsTclUnquoteHtmlObjCmd,
     NsTclUnscheduleObjCmd,
+    NsTclUpstreamObjCmd,
     NsTclUrl2FileObjCmd,
     NsTclUrlDecodeObjCmd,
     NsTclUrlEncodeObjCmd,
@@ -1645,6 +1780,7 @@ NS_EXTERN void NsInitConf(void);
 NS_EXTERN void NsInitDNS(void);
 NS_EXTERN void NsInitDrivers(void);
 NS_EXTERN void NsInitFd(void);
+NS_EXTERN void NsInitHttpScan(void);
 NS_EXTERN void NsInitHttptime(void);
 NS_EXTERN void NsInitInfo(void);
 NS_EXTERN void NsInitLimits(void);
@@ -1656,13 +1792,16 @@ NS_EXTERN void NsInitProcInfo(void);
 NS_EXTERN void NsInitQueue(void);
 NS_EXTERN void NsInitRandom(void);
 NS_EXTERN void NsInitRequests(void);
+NS_EXTERN void NsInitRevProxy(void);
 NS_EXTERN void NsInitSched(void);
 NS_EXTERN void NsInitServers(void);
 NS_EXTERN void NsInitSls(void);
 NS_EXTERN void NsInitSockCallback(void);
+NS_EXTERN void NsInitSse(void);
 NS_EXTERN void NsInitTask(void);
 NS_EXTERN void NsInitTcl(void);
 NS_EXTERN void NsInitTclEnv(void);
+NS_EXTERN void NsInitUpstreams(void);
 NS_EXTERN void NsInitUrl2File(void);
 
 NS_EXTERN void NsConfigAdp(void);
@@ -1670,11 +1809,13 @@ NS_EXTERN void NsConfigLog(void);
 NS_EXTERN void NsConfigFastpath(void);
 NS_EXTERN void NsConfigMimeTypes(void);
 NS_EXTERN void NsConfigDNS(void);
+NS_EXTERN void NsConfigSockCallback(void);
 NS_EXTERN void NsConfigRedirects(void);
 NS_EXTERN void NsConfigVhost(void);
 NS_EXTERN void NsConfigEncodings(void);
 NS_EXTERN void NsConfigTcl(void);
 NS_EXTERN void NsConfigTclHttp(void);
+NS_EXTERN void NsConfigTLSClient(void);
 
 /*
  * Type based function prototypes
@@ -1741,6 +1882,14 @@ NS_EXTERN void NsAdpParse(NsInterp *itPtr, AdpCode *codePtr, char *adp, unsigned
 NS_EXTERN void NsAdpFreeCode(AdpCode *codePtr)
     NS_GNUC_NONNULL(1);
 
+NS_EXTERN void NsAdpRestoreCode(AdpCode *codePtr, int nblocks, int nscripts,
+                                const char *text, size_t textLength,
+                                const TCL_SIZE_T *len, const int *line)
+    NS_GNUC_NONNULL(1,4,6,7);
+
+NS_EXTERN void NsAdpTagSignature(NsServer *servPtr, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1,2);
+
 NS_EXTERN void NsAdpLogError(NsInterp *itPtr)
     NS_GNUC_NONNULL(1);
 
@@ -1857,6 +2006,23 @@ NS_EXTERN int NsConnChanWrite(Tcl_Interp *interp, const char *connChanName, cons
                               TCL_SIZE_T msgLength, ssize_t *bytesSentPtr, unsigned long *errnoPtr)
     NS_GNUC_NONNULL(1,2,3,5,6);
 
+/*
+ * compress.c
+ */
+NS_EXTERN Ns_ReturnCode NsDeflateRawMessage(const unsigned char *buf, size_t len, Tcl_DString *dsPtr, int level)
+    NS_GNUC_NONNULL(1,3);
+NS_EXTERN Ns_ReturnCode NsInflateRawInit(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN Ns_ReturnCode NsInflateRawMessage(Ns_CompressStream *cStream, const unsigned char *buf, size_t len,
+                                            size_t maxSize, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1,2,5);
+
+/*
+ * cookies.c
+ */
+NS_EXTERN const char *NsHeadersGetCookie(Tcl_DString *dest, const Ns_Set *hdrs, const char *name)
+    NS_GNUC_NONNULL(1,2,3);
+
 /*
  * dlist.c
  */
@@ -1962,6 +2128,22 @@ NS_EXTERN void NsWriterUnlock(void);
 NS_EXTERN void NsWriterFinish(NsWriterSock *wrSockPtr)
     NS_GNUC_NONNULL(1);
 
+/*
+ * form.c
+ */
+
+NS_EXTERN NsMultipartParser *NsMultipartParserNew(const Ns_Set *headers, size_t length, const char *tmpDir)
+    NS_GNUC_NONNULL(1,3);
+
+NS_EXTERN void NsMultipartParserFeed(NsMultipartParser *mpPtr, const char *bytes, size_t length)
+    NS_GNUC_NONNULL(1,2);
+
+NS_EXTERN bool NsMultipartParserFinish(NsMultipartParser *mpPtr)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN void NsMultipartParserFree(NsMultipartParser *mpPtr)
+    NS_GNUC_NONNULL(1);
+
 /*
  * encoding.c
  */
@@ -2009,6 +2191,7 @@ NS_EXTERN NsLimits *NsGetRequestLimits(NsServer *servPtr, const char *method, co
  * log.c
  */
 NS_EXTERN void NsLogOpen(void);
+NS_EXTERN void NsStopLogWriter(void);
 
 /*
  * mimetypes.c
@@ -2053,6 +2236,9 @@ NS_EXTERN void NsGetRequest2(NsServer *servPtr, const char *method, const char *
 NS_EXTERN void NsGetRequestProcs(Tcl_DString *dsPtr, const char *server)
     NS_GNUC_NONNULL(1,2);
 
+NS_EXTERN bool NsRequestStreamBody(NsServer *servPtr, const Ns_Request *requestPtr)
+    NS_GNUC_NONNULL(1,2);
+
 NS_EXTERN Ns_ReturnCode NsConnRunProxyRequest(Ns_Conn *conn)
     NS_GNUC_NONNULL(1);
 
@@ -2121,11 +2307,48 @@ NS_EXTERN int NsConnParseRange(Ns_Conn *conn, const char *type,
                                Ns_FileVec *bufs, int *nbufsPtr, Tcl_DString *dsPtr)
     NS_GNUC_NONNULL(1,2,7,8);
 
+/*
+ * httpscan.c
+ */
+NS_EXTERN const char *NsHttpScanKernel(void)
+    NS_GNUC_PURE NS_GNUC_RETURNS_NONNULL;
+NS_EXTERN const char *NsHttpScanLine(const char *s, size_t len, bool *validPtr)
+    NS_GNUC_NONNULL(1,3);
+NS_EXTERN size_t NsHttpScanToken(const char *s, size_t len)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
 /*
  * request.c
  */
 NS_EXTERN void NsParseAcceptEncoding(double version, const char *hdr, bool *gzipAcceptPtr, bool *brotliAcceptPtr)
     NS_GNUC_NONNULL(2,3,4);
+NS_EXTERN Ns_ReturnCode NsParseHeaderLine(Ns_Set *set, char *line, size_t length, bool strict)
+    NS_GNUC_NONNULL(1,2);
+
+/*
+ * respcache.c
+ */
+typedef enum {
+    NS_RESPCACHE_QUEUE,     /* not answered, queue the request */
+    NS_RESPCACHE_SENT,      /* response sent, socket returned via NsSockClose() */
+    NS_RESPCACHE_ERROR      /* sending failed, socket has to be released */
+} NsRespCacheResult;
+
+NS_EXTERN void NsInitRespCacheUrlSpace(void);
+NS_EXTERN void NsInitRespCache(NsServer *servPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN NsRespCacheResult NsRespCacheDriverServe(Sock *sockPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void NsRespCacheSendFree(Sock *sockPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN bool NsRespCacheConnResume(Conn *connPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN bool NsRespCacheConnServe(Conn *connPtr)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void NsRespCacheCapture(const Conn *connPtr, const struct iovec *bufs, int nbufs)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void NsRespCacheStore(Conn *connPtr)
+    NS_GNUC_NONNULL(1);
 
 /*
  * return.c
@@ -2137,9 +2360,34 @@ NS_EXTERN const char *NsHttpStatusPhrase(int statusCode)
  * sched.c
  */
 NS_EXTERN void NsGetScheduled(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsGetDNSStats(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsStartDNSShutdown(void);
+NS_EXTERN void NsWaitDNSShutdown(const Ns_Time *toPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStartSchedShutdown(void);
 NS_EXTERN void NsWaitSchedShutdown(const Ns_Time *toPtr);
 
+/*
+ * timerwheel.c
+ */
+NS_EXTERN void NsTimerWheelInit(NsTimerWheel *wheelPtr, const Ns_Time *resolutionPtr,
+                                const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1,2,3);
+NS_EXTERN void NsTimerWheelEntryInit(NsTimerWheelEntry *entryPtr, void *clientData)
+    NS_GNUC_NONNULL(1);
+NS_EXTERN void NsTimerWheelAdd(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr,
+                               const Ns_Time *expiresPtr)
+    NS_GNUC_NONNULL(1,2,3);
+NS_EXTERN bool NsTimerWheelCancel(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1,2);
+NS_EXTERN NsTimerWheelEntry *NsTimerWheelExpire(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1,2);
+NS_EXTERN bool NsTimerWheelNextTimeout(const NsTimerWheel *wheelPtr, Ns_Time *timePtr)
+    NS_GNUC_NONNULL(1,2);
+NS_EXTERN NsTimerWheelEntry *NsTimerWheelDrain(NsTimerWheel *wheelPtr)
+    NS_GNUC_NONNULL(1);
+
+#define NsTimerWheelEntryQueued(entryPtr) ((entryPtr)->headPtr != NULL)
+
 /*
  * server.c
  */
@@ -2195,6 +2443,7 @@ NS_EXTERN int NsPoll(struct pollfd *pfds, NS_POLL_NFDS_TYPE nfds, const Ns_Time
  * sockcallback.c
  */
 NS_EXTERN void NsGetSockCallbacks(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsGetSockCallbackReactors(Tcl_DString *dsPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStartSockShutdown(void);
 NS_EXTERN void NsWaitSockShutdown(const Ns_Time *toPtr);
 
@@ -2255,6 +2504,7 @@ NS_EXTERN void NsStopHttp(NsServer *servPtr)
  * tcljson.c
  */
 NS_EXTERN void NsAtomJsonInit(void);
+NS_EXTERN void NsInitJsonIndex(void);
 /*
  * tcljob.c
  */
@@ -2353,6 +2603,20 @@ NS_EXTERN void NsRestoreSignals(void);
 NS_EXTERN void NsSendSignal(int sig);
 NS_EXTERN void NsUnblockSignal(int signal);
 
+/*
+ * upstream.c
+ */
+NS_EXTERN NsUpstreamGroup *NsUpstreamGroupGet(Tcl_Interp *interp, const char *name)
+    NS_GNUC_NONNULL(2);
+NS_EXTERN const char *NsUpstreamGroupName(const NsUpstreamGroup *groupPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+NS_EXTERN bool NsUpstreamGroupHttpOnly(const NsUpstreamGroup *groupPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+NS_EXTERN NsUpstreamMember *NsUpstreamSelect(NsUpstreamGroup *groupPtr, const Ns_Set *headers, bool acquire)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+NS_EXTERN void NsUpstreamRelease(NsUpstreamMember *memberPtr, NsUpstreamResult result)
+    NS_GNUC_NONNULL(1);
+
 /*
  * url.c
  */
@@ -1181,12 +1181,14 @@ Ns_Main(int argc, char *const* argv, Ns_ServerInitProc *initProc)
     NsStartSockShutdown();
     NsStartTaskQueueShutdown();
     NsStartJobsShutdown();
+    NsStartDNSShutdown();
     NsStartShutdownProcs();
 
     NsWaitSchedShutdown(&timeout);
     NsWaitSockShutdown(&timeout);
     NsWaitTaskQueueShutdown(&timeout);
     NsWaitJobsShutdown(&timeout);
+    NsWaitDNSShutdown(&timeout);
     NsWaitDriversShutdown(&timeout);
     NsWaitShutdownProcs(&timeout);
 
@@ -1212,6 +1214,7 @@ Ns_Main(int argc, char *const* argv, Ns_ServerInitProc *initProc)
 
     NsRemovePidFile();
     StatusMsg(exiting_state);
+    NsStopLogWriter();
 
     /*
      * The main thread exits gracefully on NS_SIGTERM.
@@ -116,6 +116,9 @@ typedef struct NsTLSConfig {
     const char *tlsKeyScript;
     const char *tlsKeylogFile;
     const char *vhostcertificates;
+    struct NsTLSTicketKeys *ticketKeys; /* shared session ticket keys, or NULL */
+    unsigned char sidCtx[SSL_MAX_SID_CTX_LENGTH]; /* session id context for ticketKeys */
+    unsigned int  sidCtxLength;
     int         sni_idx;
     union {
         struct {
@@ -50,6 +50,7 @@ static void RegisterRequest(const char *server, const char *method, const char *
 
 static Ns_Mutex       ulock = NULL;
 static int            uid = 0;
+static bool           streamBodyRegistered = NS_FALSE;
 
 
 /*
@@ -195,6 +196,9 @@ RegisterRequest(const char *server, const char *method, const char *url,
     regPtr->flags = flags;
     regPtr->refcnt = 1;
     Ns_MutexLock(&ulock);
+    if ((flags & NS_OP_STREAMBODY) != 0u) {
+        streamBodyRegistered = NS_TRUE;
+    }
     Ns_UrlSpecificSet2(server, method, url, uid, regPtr, flags,
                        RegisteredProcDecrRef, contextSpec);
     Ns_MutexUnlock(&ulock);
@@ -302,6 +306,55 @@ Ns_GetRequest(const char *server, const char *method, const char *url,
                   procPtr, deletePtr, argPtr, flagsPtr);
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRequestStreamBody --
+ *
+ *      Check, whether the request handler for the given request was
+ *      registered with NS_OP_STREAMBODY, i.e. whether the request has to
+ *      be dispatched before its body is received. The function is called
+ *      by the driver after the request header was parsed.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+bool
+NsRequestStreamBody(NsServer *servPtr, const Ns_Request *requestPtr)
+{
+    bool result = NS_FALSE;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(requestPtr != NULL);
+
+    /*
+     * Avoid the URL space lookup, as long as no such handler was
+     * registered.
+     */
+    if (streamBodyRegistered
+        && requestPtr->method != NULL
+        && requestPtr->url != NULL) {
+        Ns_OpProc   *proc;
+        Ns_Callback *deleteCallback;
+        void        *arg;
+        unsigned int flags;
+
+        NsGetRequest2(servPtr, requestPtr->method, requestPtr->url,
+                      0u, NS_URLSPACE_DEFAULT, NULL, NULL,
+                      &proc, &deleteCallback, &arg, &flags);
+        result = (proc != NULL && (flags & NS_OP_STREAMBODY) != 0u);
+    }
+
+    return result;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -2870,7 +2870,9 @@ ConnRun(Conn *connPtr)
      * data.
      */
     connPtr->flags |= NS_CONN_CONFIGURED;
-    connPtr->contentLength = connPtr->reqPtr->length;
+    connPtr->contentLength = connPtr->reqPtr->streamBody
+        ? connPtr->reqPtr->contentLength
+        : connPtr->reqPtr->length;
 
     connPtr->nContentSent = 0u;
     connPtr->responseStatus = 200;
@@ -2920,6 +2922,14 @@ ConnRun(Conn *connPtr)
         Ns_GetTime(&connPtr->filterDoneTime);
         status = (*sockPtr->drvPtr->requestProc)(sockPtr->drvPtr->arg, conn);
 
+    } else if (NsRespCacheConnResume(connPtr)) {
+        /*
+         * The driver has started to send a cached response, send the
+         * remainder.
+         */
+        Ns_GetTime(&connPtr->filterDoneTime);
+        status = NS_OK;
+
     } else if (connPtr->request.requestType == NS_REQUEST_TYPE_PROXY
                || connPtr->request.requestType == NS_REQUEST_TYPE_CONNECT
                ) {
@@ -2957,9 +2967,12 @@ ConnRun(Conn *connPtr)
                 Ns_GetTime(&connPtr->filterDoneTime);
                 if (status == NS_OK && (connPtr->sockPtr != NULL)) {
                     /*
-                     * Run the actual request
+                     * Run the actual request, unless it can be answered
+                     * from the response cache.
                      */
-                    status = Ns_ConnRunRequest(conn);
+                    if (!NsRespCacheConnServe(connPtr)) {
+                        status = Ns_ConnRunRequest(conn);
+                    }
                 }
                 break;
 
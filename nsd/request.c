@@ -913,6 +913,58 @@ Ns_ParseHeader(Ns_Set *set, const char *line, const char *prefix, size_t *fieldN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsParseHeaderLine --
+ *
+ *    Parse a header line with known length into the given set. The
+ *    field name is determined via NsHttpScanToken(). In strict mode
+ *    (used for requests), a field name which is not a token or which
+ *    is not directly followed by a colon is rejected as required by
+ *    RFC 9112. Otherwise, and for continuation lines, the line is
+ *    processed by Ns_ParseHeader().
+ *
+ * Results:
+ *    NS_OK/NS_ERROR
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+NsParseHeaderLine(Ns_Set *set, char *line, size_t length, bool strict)
+{
+    Ns_ReturnCode status = NS_OK;
+    size_t        nameLength;
+
+    NS_NONNULL_ASSERT(set != NULL);
+    NS_NONNULL_ASSERT(line != NULL);
+
+    nameLength = NsHttpScanToken(line, length);
+
+    if (likely(nameLength > 0u) && likely(nameLength < length) && line[nameLength] == ':') {
+        const char *value = line + nameLength + 1;
+
+        while (*value != '\0' && CHARTYPE(space, *value) != 0) {
+            value++;
+        }
+        (void) Ns_SetPutSz(set, line, (TCL_SIZE_T)nameLength,
+                           value, (TCL_SIZE_T)(length - (size_t)(value - line)));
+
+    } else if (strict && CHARTYPE(space, *line) == 0) {
+        status = NS_ERROR;
+
+    } else {
+        status = Ns_ParseHeader(set, line, NULL, NULL);
+    }
+
+    return status;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -964,8 +1016,10 @@ Ns_HttpMessageParse(
         result = NS_ERROR;
 
     } else {
-        char   *p;
-        size_t  parsed;
+        char       *p;
+        const char *end;
+        size_t      parsed;
+        bool        valid;
 
         p = eol+1;
         /*
@@ -981,16 +1035,23 @@ Ns_HttpMessageParse(
          */
         *firstLineLengthPtr = (size_t)(p - messageString);
 
-        while ((eol = strchr(p, INTCHAR('\n'))) != NULL) {
-            size_t len;
+        /*
+         * Control characters are tolerated here, since the messages
+         * might be received from arbitrary peers (e.g. responses of
+         * ns_http). Only the line ends are relevant.
+         */
+        end = messageString + messageLength;
+        while ((eol = (char *)NsHttpScanLine(p, (size_t)(end - p), &valid)) != NULL) {
+            size_t len, lineLength;
 
             *eol++ = '\0';
-            len = (size_t)((eol-p)-1);
+            len = lineLength = (size_t)((eol-p)-1);
 
             if (len > 0u && p[len - 1u] == '\r') {
                 p[len - 1u] = '\0';
+                lineLength--;
             }
-            if (len < 2 || Ns_ParseHeader(hdrPtr, p, NULL, NULL) != NS_OK) {
+            if (len < 2 || NsParseHeaderLine(hdrPtr, p, lineLength, NS_FALSE) != NS_OK) {
                 break;
             }
             p = eol;
@@ -0,0 +1,1548 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * respcache.c --
+ *
+ *      Per-server cache for complete HTTP responses. Responses of GET
+ *      requests are captured in the connection thread and stored when
+ *      the response header fields allow shared caching (Cache-Control
+ *      with "max-age" or "s-maxage"). Later GET and HEAD requests for
+ *      the same URL are answered by the connection thread after the
+ *      filters and the authorization of the request were run.
+ *
+ *      For URLs registered via "ns_respcache register", cached
+ *      responses are sent directly by the driver thread without queuing
+ *      the request to a connection pool. Since no filters and no
+ *      authorization procs are run for these requests, URLs must only be
+ *      registered when they are not protected. Only when the socket does
+ *      not accept the full response at once, the remainder is sent by a
+ *      connection thread.
+ *
+ *      The cache honors Vary (one entry per variant), ETag with
+ *      If-None-Match (304 responses) and stale-while-revalidate: a
+ *      stale entry is served, while a single request is passed to the
+ *      connection thread to refresh it. Concurrent misses for the same
+ *      URL are coalesced, such that only one request computes the
+ *      response while the others wait for the entry.
+ */
+
+#include "nsd.h"
+
+/*
+ * Separator between the base key and the values of the Vary fields.
+ * The character cannot occur in the request line.
+ */
+#define RC_VARY_SEPARATOR '\n'
+
+/*
+ * Urlspace id of the URLs served by the driver thread.
+ */
+static int rcid;
+
+/*
+ * The following structure defines a cached response. Entries are
+ * reference counted, since the driver sends the content without
+ * holding the cache lock. The reference count is protected by the
+ * cache lock. Vary markers are stored under the base key and list the
+ * fields selecting the variant.
+ */
+
+typedef struct RcEntry {
+    int          refCount;
+    bool         isVary;        /* Marker entry, only "vary" is set */
+    bool         refreshing;    /* Stale entry, refresh in progress */
+    int          status;
+    Ns_Time      created;
+    Ns_Time      freshUntil;
+    const char  *vary;          /* Normalized field names or NULL */
+    const char  *etag;          /* ETag of the response or NULL */
+    const char  *headers;       /* Preformatted response header fields */
+    size_t       headersLength;
+    const char  *body;
+    size_t       bodyLength;
+    char         data[1];
+} RcEntry;
+
+/*
+ * The following structure is attached to a connection computing a
+ * response for the cache.
+ */
+
+struct NsRespCacheFill {
+    char        *key;           /* Key of the placeholder or refreshed entry */
+    char        *baseKey;
+    bool         refresh;       /* Refresh of a stale entry */
+    bool         overflow;      /* Response larger than "maxentry" */
+    Tcl_DString  body;
+};
+
+/*
+ * The following structure keeps the remainder of a cached response,
+ * which could not be sent completely by the driver thread.
+ */
+
+struct NsRespCacheSend {
+    RcEntry     *entryPtr;
+    Tcl_DString  head;
+    size_t       offset;        /* Bytes already sent */
+    int          status;
+    bool         sendBody;
+    bool         keep;
+};
+
+/*
+ * Local functions defined in this file
+ */
+
+static RcEntry *RcEntryNew(const char *vary, const char *etag, const Tcl_DString *headersPtr,
+                           const char *body, size_t bodyLength, size_t *sizePtr)
+    NS_GNUC_NONNULL(3) NS_GNUC_RETURNS_NONNULL;
+static void RcEntryRelease(void *arg)
+    NS_GNUC_NONNULL(1);
+
+static bool RcRequestEligible(const Ns_Request *request, const Ns_Set *headers, size_t contentLength)
+    NS_GNUC_NONNULL(1,2);
+static void RcBaseKey(Tcl_DString *dsPtr, const char *protocol, const Ns_Request *request,
+                      const Ns_Set *headers)
+    NS_GNUC_NONNULL(1,2,3,4);
+static const char *RcVariantKey(Tcl_DString *dsPtr, const char *baseKey, const char *vary,
+                                const Ns_Set *headers)
+    NS_GNUC_NONNULL(1,2,3,4);
+static bool RcParseCacheControl(const char *value, long *maxAgePtr, long *swrPtr)
+    NS_GNUC_NONNULL(2,3);
+static const char *RcNormalizeVary(Tcl_DString *dsPtr, const char *value)
+    NS_GNUC_NONNULL(1,2);
+static bool RcEtagMatch(const char *condition, const char *etag)
+    NS_GNUC_NONNULL(1,2);
+static bool RcKeep(const Driver *drvPtr, const Ns_Request *request, const Ns_Set *headers,
+                   size_t length)
+    NS_GNUC_NONNULL(1,2,3);
+static int RcPrepare(const NsServer *servPtr, const Driver *drvPtr, const RcEntry *ePtr,
+                     const Ns_Request *request, const Ns_Set *headers, const Ns_Time *nowPtr,
+                     Tcl_DString *headPtr, struct iovec *bufs, int *statusPtr, bool *keepPtr)
+    NS_GNUC_NONNULL(1,2,3,4,5,6,7,8,9,10);
+
+static int RcRegisterUrlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
+                            Tcl_Obj *const* objv, bool unregister)
+    NS_GNUC_NONNULL(1,2);
+static int RcEntriesObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc,
+                           Tcl_Obj *const* objv, bool purge)
+    NS_GNUC_NONNULL(1,2);
+static TCL_OBJCMDPROC_T RcPurgeObjCmd;
+static TCL_OBJCMDPROC_T RcKeysObjCmd;
+static TCL_OBJCMDPROC_T RcRegisterObjCmd;
+static TCL_OBJCMDPROC_T RcUnregisterObjCmd;
+static TCL_OBJCMDPROC_T RcStatsObjCmd;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitRespCacheUrlSpace --
+ *
+ *      Allocate the urlspace id for the URLs served by the driver
+ *      thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitRespCacheUrlSpace(void)
+{
+    rcid = Ns_UrlSpecificAlloc();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitRespCache --
+ *
+ *      Configure the response cache of a server. The cache is only
+ *      created when the configured "cachesize" is larger than zero.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Creates the Ns_Cache "ns:respcache:<server>".
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitRespCache(NsServer *servPtr)
+{
+    const char *section;
+    size_t      cacheSize;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+
+    section = Ns_ConfigSectionPath(NULL, servPtr->server, NULL, "respcache", NS_SENTINEL);
+    cacheSize = (size_t)Ns_ConfigMemUnitRange(section, "cachesize", "0", 0, 0, LLONG_MAX);
+    servPtr->respcache.maxentry = (size_t)Ns_ConfigMemUnitRange(section, "maxentry", "512kB",
+                                                                (Tcl_WideInt)512*1024, 1, INT_MAX);
+    Ns_ConfigTimeUnitRange(section, "waittimeout",
+                           "5s", 0, 0, INT_MAX, 0, &servPtr->respcache.waittimeout);
+
+    if (cacheSize > 0u) {
+        Tcl_DString ds;
+
+        Tcl_DStringInit(&ds);
+        Ns_DStringVarAppend(&ds, "ns:respcache:", servPtr->server, NS_SENTINEL);
+        servPtr->respcache.cache = Ns_CacheCreateSz(ds.string, TCL_STRING_KEYS,
+                                                    cacheSize, RcEntryRelease);
+        Tcl_DStringFree(&ds);
+        Ns_Log(Notice, "respcache: server %s uses a response cache of %" PRIuz " bytes",
+               servPtr->server, cacheSize);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcEntryNew --
+ *
+ *      Allocate a cache entry with a reference count of one, held by
+ *      the cache. The strings and the body are stored in the same
+ *      memory block.
+ *
+ * Results:
+ *      New entry, the size is returned via sizePtr.
+ *
+ * Side effects:
+ *      Memory allocation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static RcEntry *
+RcEntryNew(const char *vary, const char *etag, const Tcl_DString *headersPtr,
+           const char *body, size_t bodyLength, size_t *sizePtr)
+{
+    RcEntry *ePtr;
+    size_t   varyLength = (vary != NULL) ? strlen(vary) + 1u : 0u;
+    size_t   etagLength = (etag != NULL) ? strlen(etag) + 1u : 0u;
+    size_t   size;
+    char    *p;
+
+    size = sizeof(RcEntry) + varyLength + etagLength + (size_t)headersPtr->length + 1u + bodyLength;
+    ePtr = ns_calloc(1u, size);
+    ePtr->refCount = 1;
+    p = ePtr->data;
+
+    if (vary != NULL) {
+        memcpy(p, vary, varyLength);
+        ePtr->vary = p;
+        p += varyLength;
+    }
+    if (etag != NULL) {
+        memcpy(p, etag, etagLength);
+        ePtr->etag = p;
+        p += etagLength;
+    }
+    memcpy(p, headersPtr->string, (size_t)headersPtr->length + 1u);
+    ePtr->headers = p;
+    ePtr->headersLength = (size_t)headersPtr->length;
+    p += headersPtr->length + 1;
+
+    if (bodyLength > 0u) {
+        memcpy(p, body, bodyLength);
+    }
+    ePtr->body = p;
+    ePtr->bodyLength = bodyLength;
+
+    *sizePtr = size;
+    return ePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcEntryRelease --
+ *
+ *      Release a reference to an entry. Used as well as free
+ *      procedure of the cache. Must be called with the cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the entry when the last reference is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RcEntryRelease(void *arg)
+{
+    RcEntry *ePtr = arg;
+
+    if (--ePtr->refCount == 0) {
+        ns_free(ePtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcRequestEligible --
+ *
+ *      Check if a request may be answered from the cache. Only GET and
+ *      HEAD requests without content, credentials and range are
+ *      eligible.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RcRequestEligible(const Ns_Request *request, const Ns_Set *headers, size_t contentLength)
+{
+    return (request->requestType == NS_REQUEST_TYPE_PLAIN
+            && request->method != NULL
+            && request->url != NULL
+            && (STREQ(request->method, "GET") || STREQ(request->method, "HEAD"))
+            && request->version >= 1.0
+            && contentLength == 0u
+            && Ns_SetIGet(headers, "authorization") == NULL
+            && Ns_SetIGet(headers, "range") == NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcBaseKey --
+ *
+ *      Compute the base key of a request in the form
+ *      "protocol://host/url?query". The host is converted to lower
+ *      case.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Appends to the provided Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RcBaseKey(Tcl_DString *dsPtr, const char *protocol, const Ns_Request *request,
+          const Ns_Set *headers)
+{
+    const char *host = Ns_SetIGet(headers, "host");
+    TCL_SIZE_T  offset;
+
+    Ns_DStringVarAppend(dsPtr, protocol, "://", NS_SENTINEL);
+    offset = dsPtr->length;
+    Tcl_DStringAppend(dsPtr, host != NULL ? host : NS_EMPTY_STRING, TCL_INDEX_NONE);
+    (void) Ns_StrToLower(dsPtr->string + offset);
+    Tcl_DStringAppend(dsPtr, request->url, TCL_INDEX_NONE);
+    if (request->query != NULL) {
+        Ns_DStringVarAppend(dsPtr, "?", request->query, NS_SENTINEL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcVariantKey --
+ *
+ *      Compute the key of a variant by appending the values of the
+ *      request header fields listed in "vary" to the base key.
+ *
+ * Results:
+ *      The key, stored in the provided Tcl_DString.
+ *
+ * Side effects:
+ *      Resets the provided Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+RcVariantKey(Tcl_DString *dsPtr, const char *baseKey, const char *vary, const Ns_Set *headers)
+{
+    const char *p = vary;
+    const char  separator = RC_VARY_SEPARATOR;
+
+    Tcl_DStringSetLength(dsPtr, 0);
+    Tcl_DStringAppend(dsPtr, baseKey, TCL_INDEX_NONE);
+
+    while (*p != '\0') {
+        const char *end = strchr(p, INTCHAR(','));
+        const char *value;
+        char        name[256];
+        size_t      length = (end != NULL) ? (size_t)(end - p) : strlen(p);
+
+        if (length >= sizeof(name)) {
+            length = sizeof(name) - 1u;
+        }
+        memcpy(name, p, length);
+        name[length] = '\0';
+        value = Ns_SetIGet(headers, name);
+
+        Tcl_DStringAppend(dsPtr, &separator, 1);
+        if (value != NULL) {
+            Tcl_DStringAppend(dsPtr, value, TCL_INDEX_NONE);
+        }
+        if (end == NULL) {
+            break;
+        }
+        p = end + 1;
+    }
+    return dsPtr->string;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcParseCacheControl --
+ *
+ *      Parse the response header field Cache-Control. The freshness
+ *      lifetime is taken from "s-maxage" or "max-age".
+ *
+ * Results:
+ *      NS_FALSE when the response must not be stored in a shared
+ *      cache, NS_TRUE otherwise. The freshness lifetime (or -1) and the
+ *      stale-while-revalidate period are returned via the pointers.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RcParseCacheControl(const char *value, long *maxAgePtr, long *swrPtr)
+{
+    long sMaxAge = -1, maxAge = -1;
+    bool success = NS_TRUE;
+
+    *swrPtr = 0;
+
+    while (value != NULL && *value != '\0') {
+        const char *end;
+        size_t      length;
+
+        while (CHARTYPE(space, *value) != 0 || *value == ',') {
+            value++;
+        }
+        end = strchr(value, INTCHAR(','));
+        length = (end != NULL) ? (size_t)(end - value) : strlen(value);
+
+        if (strncasecmp(value, "no-store", 8u) == 0
+            || strncasecmp(value, "no-cache", 8u) == 0
+            || strncasecmp(value, "private", 7u) == 0) {
+            success = NS_FALSE;
+            break;
+        } else if (length > 9u && strncasecmp(value, "s-maxage=", 9u) == 0) {
+            sMaxAge = strtol(value + 9, NULL, 10);
+        } else if (length > 8u && strncasecmp(value, "max-age=", 8u) == 0) {
+            maxAge = strtol(value + 8, NULL, 10);
+        } else if (length > 23u && strncasecmp(value, "stale-while-revalidate=", 23u) == 0) {
+            *swrPtr = MAX(0, strtol(value + 23, NULL, 10));
+        }
+        value = end;
+    }
+    *maxAgePtr = (sMaxAge >= 0) ? sMaxAge : maxAge;
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcNormalizeVary --
+ *
+ *      Normalize the value of a Vary header field to a comma-separated
+ *      list of lowercase field names without spaces.
+ *
+ * Results:
+ *      Normalized value, or NULL when the response varies on "*".
+ *
+ * Side effects:
+ *      Appends to the provided Tcl_DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+RcNormalizeVary(Tcl_DString *dsPtr, const char *value)
+{
+    const char *result;
+
+    for (; *value != '\0'; value++) {
+        if (CHARTYPE(space, *value) == 0) {
+            char c = CHARCONV(lower, *value);
+
+            Tcl_DStringAppend(dsPtr, &c, 1);
+        }
+    }
+    if (strchr(dsPtr->string, INTCHAR('*')) != NULL) {
+        result = NULL;
+    } else {
+        result = dsPtr->string;
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcEtagMatch --
+ *
+ *      Weak comparison of an If-None-Match condition with the ETag of
+ *      a cached response.
+ *
+ * Results:
+ *      NS_TRUE if the condition matches.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RcEtagMatch(const char *condition, const char *etag)
+{
+    size_t length;
+    bool   success = NS_FALSE;
+
+    if (etag[0] == 'W' && etag[1] == '/') {
+        etag += 2;
+    }
+    length = strlen(etag);
+
+    while (*condition != '\0') {
+        const char *end;
+
+        while (CHARTYPE(space, *condition) != 0 || *condition == ',') {
+            condition++;
+        }
+        if (*condition == '*') {
+            success = NS_TRUE;
+            break;
+        }
+        if (condition[0] == 'W' && condition[1] == '/') {
+            condition += 2;
+        }
+        end = strchr(condition, INTCHAR(','));
+        if (strncmp(condition, etag, length) == 0
+            && (condition[length] == '\0' || condition[length] == ','
+                || CHARTYPE(space, condition[length]) != 0)) {
+            success = NS_TRUE;
+            break;
+        }
+        if (end == NULL) {
+            break;
+        }
+        condition = end;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcKeep --
+ *
+ *      Decide whether the connection can be kept open after sending a
+ *      cached response, following the rules of the connection thread.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RcKeep(const Driver *drvPtr, const Ns_Request *request, const Ns_Set *headers, size_t length)
+{
+    const char *connection = Ns_SetIGet(headers, "connection");
+    bool        keep;
+
+    if (drvPtr->keepwait.sec <= 0 && drvPtr->keepwait.usec <= 0) {
+        keep = NS_FALSE;
+    } else if (request->version > 1.0) {
+        keep = (connection == NULL || strncasecmp(connection, "close", 5u) != 0);
+    } else {
+        keep = (connection != NULL && strncasecmp(connection, "keep-alive", 10u) == 0);
+    }
+    if (keep && drvPtr->keepmaxdownloadsize > 0u && length > drvPtr->keepmaxdownloadsize) {
+        keep = NS_FALSE;
+    }
+    return keep;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcPrepare --
+ *
+ *      Build the response header for a cached entry and setup the I/O
+ *      vector with the header and the body. When the request contains
+ *      an If-None-Match condition matching the ETag of the entry, a
+ *      "304 Not Modified" response is built.
+ *
+ * Results:
+ *      Number of buffers in the I/O vector (1 or 2).
+ *
+ * Side effects:
+ *      Appends to headPtr, sets the status and the keep-alive flag.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RcPrepare(const NsServer *servPtr, const Driver *drvPtr, const RcEntry *ePtr,
+          const Ns_Request *request, const Ns_Set *headers, const Ns_Time *nowPtr,
+          Tcl_DString *headPtr, struct iovec *bufs, int *statusPtr, bool *keepPtr)
+{
+    const char *condition = Ns_SetIGet(headers, "if-none-match");
+    int         status = ePtr->status, nbufs = 1;
+    bool        sendBody, keep;
+    time_t      now = nowPtr->sec;
+
+    if (condition != NULL && ePtr->etag != NULL && RcEtagMatch(condition, ePtr->etag)) {
+        status = 304;
+    }
+    sendBody = (status != 304 && !STREQ(request->method, "HEAD"));
+    keep = RcKeep(drvPtr, request, headers, ePtr->bodyLength);
+
+    Ns_DStringPrintf(headPtr, "HTTP/%.1f %d %s\r\n",
+                     MIN(request->version, 1.1), status, NsHttpStatusPhrase(status));
+    if (!servPtr->opts.stealthmode) {
+        Ns_DStringVarAppend(headPtr, "Server: ", Ns_InfoServerName(), "/", Ns_InfoServerVersion(), "\r\n",
+                            NS_SENTINEL);
+    }
+    Tcl_DStringAppend(headPtr, "Date: ", 6);
+    (void)Ns_HttpTime(headPtr, &now);
+    Ns_DStringPrintf(headPtr, "\r\nAge: %ld\r\n", (long)(nowPtr->sec - ePtr->created.sec));
+    Tcl_DStringAppend(headPtr, ePtr->headers, (TCL_SIZE_T)ePtr->headersLength);
+    if (status != 304) {
+        Ns_DStringPrintf(headPtr, "Content-Length: %" PRIuz "\r\n", ePtr->bodyLength);
+    }
+    Ns_DStringVarAppend(headPtr, "Connection: ", keep ? "keep-alive" : "close", "\r\n\r\n", NS_SENTINEL);
+
+    bufs[0].iov_base = headPtr->string;
+    bufs[0].iov_len = (size_t)headPtr->length;
+    if (sendBody && ePtr->bodyLength > 0u) {
+        bufs[1].iov_base = (void *)ePtr->body;
+        bufs[1].iov_len = ePtr->bodyLength;
+        nbufs = 2;
+    }
+    *statusPtr = status;
+    *keepPtr = keep;
+
+    return nbufs;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheDriverServe --
+ *
+ *      Try to answer a complete request in the driver thread from the
+ *      response cache. Only requests for URLs registered via
+ *      "ns_respcache register" are answered, since no filters and no
+ *      authorization procs are run. The function never blocks: when the
+ *      cache is locked or no fresh (or stale, but already refreshing)
+ *      entry exists, the request is queued as usual. When the socket
+ *      accepts only a part of the response, the remainder is attached to
+ *      the socket and sent by the connection thread.
+ *
+ * Results:
+ *      NS_RESPCACHE_SENT when the response was sent and the socket was
+ *      returned via NsSockClose(), NS_RESPCACHE_ERROR when sending
+ *      failed, NS_RESPCACHE_QUEUE when the request has to be queued.
+ *
+ * Side effects:
+ *      Sends data, updates statistics, writes an access log entry for
+ *      responses sent completely.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsRespCacheResult
+NsRespCacheDriverServe(Sock *sockPtr, const Ns_Time *nowPtr)
+{
+    NsServer          *servPtr;
+    const Driver      *drvPtr;
+    const Request     *reqPtr;
+    RcEntry           *ePtr = NULL;
+    NsRespCacheResult  result = NS_RESPCACHE_QUEUE;
+    Tcl_DString        keyDs, variantDs;
+    Ns_Time            now;
+
+    NS_NONNULL_ASSERT(sockPtr != NULL);
+
+    servPtr = sockPtr->servPtr;
+    drvPtr = sockPtr->drvPtr;
+    reqPtr = sockPtr->reqPtr;
+
+    if (servPtr == NULL
+        || servPtr->respcache.cache == NULL
+        || sockPtr->rcSendPtr != NULL
+        || drvPtr->requestProc != NULL
+        || (drvPtr->opts & NS_DRIVER_QUIC) != 0u
+        || reqPtr == NULL
+        || !RcRequestEligible(&reqPtr->request, reqPtr->headers, reqPtr->contentLength)
+        || Ns_UrlSpecificGet((Ns_Server *)servPtr, reqPtr->request.method, reqPtr->request.url,
+                             rcid, 0u, NS_URLSPACE_DEFAULT, NULL, NULL, NULL) == NULL) {
+        return NS_RESPCACHE_QUEUE;
+    }
+    if (nowPtr == NULL) {
+        Ns_GetTime(&now);
+    } else {
+        now = *nowPtr;
+    }
+
+    Tcl_DStringInit(&keyDs);
+    Tcl_DStringInit(&variantDs);
+    RcBaseKey(&keyDs, drvPtr->protocol, &reqPtr->request, reqPtr->headers);
+
+    if (Ns_CacheTryLock(servPtr->respcache.cache) == NS_OK) {
+        const Ns_Entry *entry = Ns_CacheFindEntry(servPtr->respcache.cache, keyDs.string);
+
+        if (entry != NULL) {
+            ePtr = Ns_CacheGetValue(entry);
+            if (ePtr->isVary) {
+                entry = Ns_CacheFindEntry(servPtr->respcache.cache,
+                                          RcVariantKey(&variantDs, keyDs.string, ePtr->vary,
+                                                       reqPtr->headers));
+                ePtr = (entry != NULL) ? Ns_CacheGetValue(entry) : NULL;
+            }
+        }
+        if (ePtr != NULL) {
+            if (Ns_DiffTime(&ePtr->freshUntil, &now, NULL) > 0) {
+                ePtr->refCount++;
+            } else if (ePtr->refreshing) {
+                servPtr->respcache.stats.stale++;
+                ePtr->refCount++;
+            } else {
+                /*
+                 * Let the connection thread refresh the entry.
+                 */
+                ePtr = NULL;
+            }
+        }
+        if (ePtr != NULL) {
+            servPtr->respcache.stats.hits++;
+            servPtr->respcache.stats.driverhits++;
+        }
+        Ns_CacheUnlock(servPtr->respcache.cache);
+    }
+
+    if (ePtr != NULL) {
+        struct iovec bufs[2];
+        Tcl_DString  headDs;
+        int          nbufs, status;
+        bool         keep;
+        ssize_t      sent;
+        size_t       toSend;
+
+        Tcl_DStringInit(&headDs);
+        nbufs = RcPrepare(servPtr, drvPtr, ePtr, &reqPtr->request, reqPtr->headers, &now,
+                          &headDs, bufs, &status, &keep);
+        toSend = Ns_SumVec(bufs, nbufs);
+        sent = NsDriverSend(sockPtr, bufs, nbufs, 0u);
+
+        Ns_Log(Debug, "respcache: driver sent %" PRIdz " of %" PRIuz " bytes for %s",
+               sent, toSend, keyDs.string);
+
+        if (sent == (ssize_t)toSend) {
+            Ns_CacheLock(servPtr->respcache.cache);
+            if (status == 304) {
+                servPtr->respcache.stats.notmodified++;
+            }
+            RcEntryRelease(ePtr);
+            Ns_CacheUnlock(servPtr->respcache.cache);
+            Tcl_DStringFree(&headDs);
+            NsAddNslogEntry(sockPtr, status, NULL, NULL);
+            NsSockClose(sockPtr, keep ? 1 : 0);
+            result = NS_RESPCACHE_SENT;
+
+        } else if (sent < 0) {
+            Ns_CacheLock(servPtr->respcache.cache);
+            RcEntryRelease(ePtr);
+            Ns_CacheUnlock(servPtr->respcache.cache);
+            Tcl_DStringFree(&headDs);
+            result = NS_RESPCACHE_ERROR;
+
+        } else {
+            NsRespCacheSend *sendPtr = ns_malloc(sizeof(NsRespCacheSend));
+
+            /*
+             * Keep the entry and the header for the connection thread.
+             */
+            sendPtr->entryPtr = ePtr;
+            Tcl_DStringInit(&sendPtr->head);
+            Tcl_DStringAppend(&sendPtr->head, headDs.string, headDs.length);
+            sendPtr->offset = (size_t)sent;
+            sendPtr->status = status;
+            sendPtr->sendBody = (nbufs > 1);
+            sendPtr->keep = keep;
+            sockPtr->rcSendPtr = sendPtr;
+            Tcl_DStringFree(&headDs);
+        }
+    }
+    Tcl_DStringFree(&variantDs);
+    Tcl_DStringFree(&keyDs);
+
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheSendFree --
+ *
+ *      Free the remainder of a cached response attached to a socket.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Releases the reference to the cache entry.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsRespCacheSendFree(Sock *sockPtr)
+{
+    NsRespCacheSend *sendPtr;
+
+    NS_NONNULL_ASSERT(sockPtr != NULL);
+
+    sendPtr = sockPtr->rcSendPtr;
+    if (sendPtr != NULL) {
+        Ns_Cache *cache = sockPtr->servPtr->respcache.cache;
+
+        sockPtr->rcSendPtr = NULL;
+        Ns_CacheLock(cache);
+        RcEntryRelease(sendPtr->entryPtr);
+        Ns_CacheUnlock(cache);
+        Tcl_DStringFree(&sendPtr->head);
+        ns_free(sendPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheConnResume --
+ *
+ *      Called by the connection thread before the request is
+ *      processed. Sends the remainder of a cached response, which was
+ *      started by the driver thread.
+ *
+ * Results:
+ *      NS_TRUE when the remainder of a response was sent.
+ *
+ * Side effects:
+ *      Frees the remainder attached to the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsRespCacheConnResume(Conn *connPtr)
+{
+    Sock            *sockPtr;
+    NsRespCacheSend *sendPtr;
+    NsServer        *servPtr;
+    struct iovec     bufs[2];
+    int              nbufs = 1;
+    size_t           offset, toSend;
+    ssize_t          sent;
+
+    NS_NONNULL_ASSERT(connPtr != NULL);
+
+    sockPtr = connPtr->sockPtr;
+    if (sockPtr == NULL || sockPtr->rcSendPtr == NULL) {
+        return NS_FALSE;
+    }
+    sendPtr = sockPtr->rcSendPtr;
+    servPtr = connPtr->poolPtr->servPtr;
+    offset = sendPtr->offset;
+
+    bufs[0].iov_base = sendPtr->head.string;
+    bufs[0].iov_len = (size_t)sendPtr->head.length;
+    if (sendPtr->sendBody) {
+        bufs[1].iov_base = (void *)sendPtr->entryPtr->body;
+        bufs[1].iov_len = sendPtr->entryPtr->bodyLength;
+        nbufs = 2;
+    }
+    toSend = Ns_SumVec(bufs, nbufs);
+    (void) Ns_ResetVec(bufs, nbufs, offset);
+    sent = Ns_SockSendBufs((Ns_Sock *)sockPtr, bufs, nbufs, &sockPtr->drvPtr->sendwait, 0u);
+
+    connPtr->flags |= NS_CONN_SENTHDRS;
+    connPtr->responseStatus = sendPtr->status;
+    if (sent > 0) {
+        connPtr->nContentSent += (size_t)sent + offset;
+    }
+    connPtr->keep = (sent == (ssize_t)(toSend - offset) && sendPtr->keep) ? 1 : 0;
+    if (sendPtr->status == 304) {
+        Ns_CacheLock(servPtr->respcache.cache);
+        servPtr->respcache.stats.notmodified++;
+        Ns_CacheUnlock(servPtr->respcache.cache);
+    }
+    NsRespCacheSendFree(sockPtr);
+
+    return NS_TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheConnServe --
+ *
+ *      Called by the connection thread after the filters and the
+ *      authorization of the request were run, before the request proc
+ *      is called. Answers the request from the cache, or registers the
+ *      connection to compute the response for the cache. When another
+ *      connection computes the same response, wait for it up to the
+ *      configured "waittimeout".
+ *
+ * Results:
+ *      NS_TRUE when the response was sent from the cache.
+ *
+ * Side effects:
+ *      May set connPtr->rcFillPtr, which requires a call of
+ *      NsRespCacheStore() after the request was processed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsRespCacheConnServe(Conn *connPtr)
+{
+    NsServer        *servPtr;
+    Ns_Cache        *cache;
+    RcEntry         *ePtr = NULL;
+    NsRespCacheFill *fillPtr = NULL;
+    Tcl_DString      keyDs, variantDs;
+    const char      *key;
+    Ns_Time          now, deadline;
+    bool             waited = NS_FALSE, served = NS_FALSE;
+
+    NS_NONNULL_ASSERT(connPtr != NULL);
+
+    connPtr->rcFillPtr = NULL;
+    servPtr = connPtr->poolPtr->servPtr;
+    cache = servPtr->respcache.cache;
+
+    if (cache == NULL
+        || !RcRequestEligible(&connPtr->request, connPtr->headers, connPtr->contentLength)) {
+        return NS_FALSE;
+    }
+
+    Tcl_DStringInit(&keyDs);
+    Tcl_DStringInit(&variantDs);
+    RcBaseKey(&keyDs, connPtr->drvPtr->protocol, &connPtr->request, connPtr->headers);
+    key = keyDs.string;
+
+    Ns_GetTime(&now);
+    deadline = now;
+    Ns_IncrTime(&deadline, servPtr->respcache.waittimeout.sec, servPtr->respcache.waittimeout.usec);
+
+    Ns_CacheLock(cache);
+    for (;;) {
+        int       isNew;
+        Ns_Entry *entry = Ns_CacheCreateEntry(cache, key, &isNew);
+
+        if (isNew != 0) {
+            servPtr->respcache.stats.misses++;
+            if (STREQ(connPtr->request.method, "GET")) {
+                /*
+                 * Keep the empty entry as placeholder for concurrent
+                 * requests.
+                 */
+                fillPtr = ns_calloc(1u, sizeof(NsRespCacheFill));
+            } else {
+                Ns_CacheDeleteEntry(entry);
+            }
+            break;
+        }
+
+        ePtr = Ns_CacheGetValue(entry);
+        if (ePtr == NULL) {
+            /*
+             * Another connection is computing the response.
+             */
+            if (!waited) {
+                servPtr->respcache.stats.coalesced++;
+                waited = NS_TRUE;
+            }
+            if (Ns_CacheTimedWait(cache, &deadline) != NS_OK) {
+                Ns_Log(Notice, "respcache: timeout while waiting for %s", key);
+                servPtr->respcache.stats.misses++;
+                break;
+            }
+
+        } else if (ePtr->isVary) {
+            key = RcVariantKey(&variantDs, keyDs.string, ePtr->vary, connPtr->headers);
+            ePtr = NULL;
+
+        } else if (Ns_DiffTime(&ePtr->freshUntil, &now, NULL) > 0) {
+            break;
+
+        } else if (ePtr->refreshing || !STREQ(connPtr->request.method, "GET")) {
+            servPtr->respcache.stats.stale++;
+            break;
+
+        } else {
+            /*
+             * Refresh the stale entry, while concurrent requests receive
+             * the stale response.
+             */
+            ePtr->refreshing = NS_TRUE;
+            ePtr = NULL;
+            servPtr->respcache.stats.misses++;
+            fillPtr = ns_calloc(1u, sizeof(NsRespCacheFill));
+            fillPtr->refresh = NS_TRUE;
+            break;
+        }
+    }
+    if (ePtr != NULL) {
+        servPtr->respcache.stats.hits++;
+        ePtr->refCount++;
+    }
+    Ns_CacheUnlock(cache);
+
+    if (fillPtr != NULL) {
+        fillPtr->key = ns_strdup(key);
+        fillPtr->baseKey = ns_strdup(keyDs.string);
+        Tcl_DStringInit(&fillPtr->body);
+        connPtr->rcFillPtr = fillPtr;
+
+    } else if (ePtr != NULL) {
+        struct iovec bufs[2];
+        Tcl_DString  headDs;
+        int          nbufs, status;
+        bool         keep;
+        ssize_t      sent;
+
+        Tcl_DStringInit(&headDs);
+        nbufs = RcPrepare(servPtr, connPtr->drvPtr, ePtr, &connPtr->request, connPtr->headers, &now,
+                          &headDs, bufs, &status, &keep);
+        connPtr->flags |= NS_CONN_SENTHDRS;
+        connPtr->responseStatus = status;
+        connPtr->keep = keep ? 1 : 0;
+        sent = Ns_ConnSend((Ns_Conn *)connPtr, bufs, nbufs);
+        if (sent < (ssize_t)Ns_SumVec(bufs, nbufs)) {
+            connPtr->keep = 0;
+        }
+        Tcl_DStringFree(&headDs);
+
+        Ns_CacheLock(cache);
+        if (status == 304) {
+            servPtr->respcache.stats.notmodified++;
+        }
+        RcEntryRelease(ePtr);
+        Ns_CacheUnlock(cache);
+        served = NS_TRUE;
+    }
+    Tcl_DStringFree(&variantDs);
+    Tcl_DStringFree(&keyDs);
+
+    return served;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheCapture --
+ *
+ *      Collect the response body of a connection computing a response
+ *      for the cache. Called by Ns_ConnWriteVData() with the body
+ *      buffers before chunking.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Appends to the body of the fill structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsRespCacheCapture(const Conn *connPtr, const struct iovec *bufs, int nbufs)
+{
+    NsRespCacheFill *fillPtr;
+    int              i;
+
+    NS_NONNULL_ASSERT(connPtr != NULL);
+
+    fillPtr = connPtr->rcFillPtr;
+    if (fillPtr == NULL || fillPtr->overflow || bufs == NULL) {
+        return;
+    }
+    for (i = 0; i < nbufs; i++) {
+        if ((size_t)fillPtr->body.length + bufs[i].iov_len > connPtr->poolPtr->servPtr->respcache.maxentry) {
+            fillPtr->overflow = NS_TRUE;
+            Tcl_DStringFree(&fillPtr->body);
+            break;
+        }
+        Tcl_DStringAppend(&fillPtr->body, bufs[i].iov_base, (TCL_SIZE_T)bufs[i].iov_len);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsRespCacheStore --
+ *
+ *      Called when connPtr->rcFillPtr is set by Ns_ConnWriteVData() before
+ *      a complete response is sent, or otherwise by Ns_ConnClose() before
+ *      the connection to the client is closed. Store the response when it
+ *      is complete and cacheable, otherwise remove the placeholder (or the
+ *      stale entry). Wake up waiting connections in both cases.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the cache, frees the fill structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsRespCacheStore(Conn *connPtr)
+{
+    NsRespCacheFill *fillPtr;
+    NsServer        *servPtr;
+    Ns_Cache        *cache;
+    const Ns_Set    *outputHeaders;
+    RcEntry         *ePtr = NULL;
+    const char      *vary = NULL, *storeKey = NULL;
+    Tcl_DString      headersDs, varyDs, variantDs;
+    size_t           size = 0u;
+    long             maxAge = -1, swr = 0;
+    Ns_Time          staleUntil = {0, 0};
+    int              isNew;
+    Ns_Entry        *entry;
+
+    NS_NONNULL_ASSERT(connPtr != NULL);
+
+    fillPtr = connPtr->rcFillPtr;
+    if (fillPtr == NULL) {
+        return;
+    }
+    connPtr->rcFillPtr = NULL;
+    servPtr = connPtr->poolPtr->servPtr;
+    cache = servPtr->respcache.cache;
+    outputHeaders = connPtr->outputheaders;
+
+    Tcl_DStringInit(&headersDs);
+    Tcl_DStringInit(&varyDs);
+    Tcl_DStringInit(&variantDs);
+
+    /*
+     * Check, if the response is complete and may be stored.
+     */
+    if (!fillPtr->overflow
+        && (connPtr->flags & NS_CONN_SENTHDRS) != 0u
+        && (connPtr->responseStatus == 200
+            || connPtr->responseStatus == 203
+            || connPtr->responseStatus == 301
+            || connPtr->responseStatus == 404
+            || connPtr->responseStatus == 410)
+        && connPtr->responseLength >= 0
+        && (size_t)connPtr->responseLength == (size_t)fillPtr->body.length
+        && outputHeaders != NULL
+        && Ns_SetIGet(outputHeaders, "set-cookie") == NULL
+        && Ns_SetIGet(outputHeaders, "content-encoding") == NULL
+        && RcParseCacheControl(Ns_SetIGet(outputHeaders, "cache-control"), &maxAge, &swr)
+        && maxAge > 0) {
+        const char *varyValue = Ns_SetIGet(outputHeaders, "vary");
+        bool        cacheable = NS_TRUE;
+
+        if (varyValue != NULL) {
+            vary = RcNormalizeVary(&varyDs, varyValue);
+            cacheable = (vary != NULL);
+        }
+        if (cacheable) {
+            size_t i;
+
+            for (i = 0u; i < Ns_SetSize(outputHeaders); i++) {
+                const char *key = Ns_SetKey(outputHeaders, i);
+                const char *value = Ns_SetValue(outputHeaders, i);
+
+                if (key == NULL || value == NULL
+                    || strcasecmp(key, "content-length") == 0
+                    || strcasecmp(key, "connection") == 0
+                    || strcasecmp(key, "keep-alive") == 0
+                    || strcasecmp(key, "transfer-encoding") == 0
+                    || strcasecmp(key, "date") == 0
+                    || strcasecmp(key, "age") == 0) {
+                    continue;
+                }
+                Ns_DStringVarAppend(&headersDs, key, ": ", NS_SENTINEL);
+                for (; *value != '\0'; value++) {
+                    /*
+                     * Sanitize line breaks as in Ns_ConnConstructHeaders().
+                     */
+                    Tcl_DStringAppend(&headersDs, value, 1);
+                    if (*value == '\n') {
+                        Tcl_DStringAppend(&headersDs, "\t", 1);
+                    }
+                }
+                Tcl_DStringAppend(&headersDs, "\r\n", 2);
+            }
+            ePtr = RcEntryNew(NULL, Ns_SetIGet(outputHeaders, "etag"), &headersDs,
+                              fillPtr->body.string, (size_t)fillPtr->body.length, &size);
+            ePtr->status = connPtr->responseStatus;
+            Ns_GetTime(&ePtr->created);
+            ePtr->freshUntil = ePtr->created;
+            ePtr->freshUntil.sec += maxAge;
+            staleUntil = ePtr->freshUntil;
+            staleUntil.sec += swr;
+        }
+    }
+
+    Ns_CacheLock(cache);
+    if (ePtr != NULL) {
+        if (vary != NULL) {
+            RcEntry *markerPtr;
+
+            /*
+             * Store the variant and the marker under the base key.
+             */
+            entry = Ns_CacheCreateEntry(cache, fillPtr->baseKey, &isNew);
+            markerPtr = Ns_CacheGetValue(entry);
+            if (markerPtr == NULL || !markerPtr->isVary || !STREQ(markerPtr->vary, vary)) {
+                size_t markerSize;
+
+                Tcl_DStringSetLength(&headersDs, 0);
+                markerPtr = RcEntryNew(vary, NULL, &headersDs, NULL, 0u, &markerSize);
+                markerPtr->isVary = NS_TRUE;
+                Ns_CacheSetValueSz(entry, markerPtr, markerSize);
+            }
+            storeKey = RcVariantKey(&variantDs, fillPtr->baseKey, vary, connPtr->headers);
+        } else {
+            storeKey = fillPtr->baseKey;
+        }
+        entry = Ns_CacheCreateEntry(cache, storeKey, &isNew);
+        Ns_CacheSetValueExpires(entry, ePtr, size, &staleUntil, 0, 0u, 0u);
+        servPtr->respcache.stats.stores++;
+        Ns_Log(Debug, "respcache: stored %" PRIuz " bytes for %s", size, storeKey);
+    }
+
+    if (storeKey == NULL || !STREQ(storeKey, fillPtr->key)) {
+        /*
+         * Remove the placeholder or the stale entry, which was not
+         * replaced.
+         */
+        entry = Ns_CacheCreateEntry(cache, fillPtr->key, &isNew);
+        if (isNew != 0 || Ns_CacheGetValue(entry) == NULL || fillPtr->refresh) {
+            Ns_CacheDeleteEntry(entry);
+        }
+    }
+    Ns_CacheBroadcast(cache);
+    Ns_CacheUnlock(cache);
+
+    Tcl_DStringFree(&variantDs);
+    Tcl_DStringFree(&varyDs);
+    Tcl_DStringFree(&headersDs);
+    Tcl_DStringFree(&fillPtr->body);
+    ns_free(fillPtr->key);
+    ns_free(fillPtr->baseKey);
+    ns_free(fillPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RcRegisterObjCmd, RcUnregisterObjCmd, RcPurgeObjCmd, RcKeysObjCmd,
+ * RcStatsObjCmd --
+ *
+ *      Implements "ns_respcache register", "ns_respcache unregister",
+ *      "ns_respcache purge", "ns_respcache keys", and "ns_respcache
+ *      stats". The registered URLs are answered from the cache by the
+ *      driver thread. The patterns are matched against the base keys of
+ *      the cached responses.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      "register" and "unregister" modify the urlspace, "purge" removes
+ *      entries from the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RcEntriesObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv,
+                bool purge)
+{
+    const NsInterp *itPtr = clientData;
+    char           *pattern = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"?pattern", Ns_ObjvString, &pattern, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (itPtr->servPtr->respcache.cache == NULL) {
+        Ns_TclPrintfResult(interp, "response cache is not enabled for server %s",
+                           itPtr->servPtr->server);
+        result = TCL_ERROR;
+
+    } else {
+        Ns_Cache       *cache = itPtr->servPtr->respcache.cache;
+        Tcl_Obj        *listObj = Tcl_NewListObj(0, NULL);
+        Tcl_DString     keyDs;
+        Ns_CacheSearch  search;
+        Ns_Entry       *entry;
+        long            nPurged = 0;
+
+        Tcl_DStringInit(&keyDs);
+        Ns_CacheLock(cache);
+        entry = Ns_CacheFirstEntry(cache, &search);
+        while (entry != NULL) {
+            const RcEntry *ePtr = Ns_CacheGetValue(entry);
+            const char    *key = Ns_CacheKey(entry), *separator;
+
+            separator = strchr(key, INTCHAR(RC_VARY_SEPARATOR));
+            Tcl_DStringSetLength(&keyDs, 0);
+            Tcl_DStringAppend(&keyDs, key, separator != NULL ? (TCL_SIZE_T)(separator - key) : TCL_INDEX_NONE);
+
+            if (ePtr != NULL
+                && (pattern == NULL || Tcl_StringMatch(keyDs.string, pattern) == 1)) {
+                if (purge) {
+                    if (!ePtr->isVary) {
+                        nPurged++;
+                    }
+                    Ns_CacheFlushEntry(entry);
+                } else if (!ePtr->isVary) {
+                    Tcl_ListObjAppendElement(interp, listObj,
+                                             Tcl_NewStringObj(keyDs.string, keyDs.length));
+                }
+            }
+            entry = Ns_CacheNextEntry(&search);
+        }
+        if (purge) {
+            itPtr->servPtr->respcache.stats.purged += (unsigned long)nPurged;
+        }
+        Ns_CacheUnlock(cache);
+        Tcl_DStringFree(&keyDs);
+
+        if (purge) {
+            Tcl_DecrRefCount(listObj);
+            Tcl_SetObjResult(interp, Tcl_NewLongObj(nPurged));
+        } else {
+            Tcl_SetObjResult(interp, listObj);
+        }
+    }
+    return result;
+}
+
+static int
+RcRegisterUrlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv,
+                 bool unregister)
+{
+    const NsInterp *itPtr = clientData;
+    NsServer       *servPtr = itPtr->servPtr;
+    char           *method, *url;
+    int             noinherit = 0, result = TCL_OK;
+    Ns_ObjvSpec     opts[] = {
+        {"-noinherit", Ns_ObjvBool,   &noinherit, INT2PTR(NS_TRUE)},
+        {"--",         Ns_ObjvBreak,  NULL,       NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"method", Ns_ObjvString, &method, NULL},
+        {"url",    Ns_ObjvString, &url,    NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        unsigned int flags = 0u;
+
+        if (noinherit != 0) {
+            flags |= NS_OP_NOINHERIT;
+        }
+        Ns_MutexLock(&servPtr->urlspace.lock);
+        if (unregister) {
+            (void) Ns_UrlSpecificDestroy(servPtr->server, method, url, rcid, flags);
+        } else {
+            Ns_UrlSpecificSet(servPtr->server, method, url, rcid, INT2PTR(NS_TRUE), flags, NULL);
+        }
+        Ns_MutexUnlock(&servPtr->urlspace.lock);
+    }
+    return result;
+}
+
+static int
+RcRegisterObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    return RcRegisterUrlObjCmd(clientData, interp, objc, objv, NS_FALSE);
+}
+
+static int
+RcUnregisterObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    return RcRegisterUrlObjCmd(clientData, interp, objc, objv, NS_TRUE);
+}
+
+static int
+RcPurgeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    return RcEntriesObjCmd(clientData, interp, objc, objv, NS_TRUE);
+}
+
+static int
+RcKeysObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    return RcEntriesObjCmd(clientData, interp, objc, objv, NS_FALSE);
+}
+
+static int
+RcStatsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    NsServer *servPtr = ((const NsInterp *)clientData)->servPtr;
+    int       result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (servPtr->respcache.cache == NULL) {
+        Ns_TclPrintfResult(interp, "response cache is not enabled for server %s",
+                           servPtr->server);
+        result = TCL_ERROR;
+
+    } else {
+        Ns_Cache       *cache = servPtr->respcache.cache;
+        Tcl_Obj        *dictObj = Tcl_NewDictObj();
+        Ns_CacheSearch  search;
+        const Ns_Entry *entry;
+        Tcl_WideInt     nEntries = 0, size = 0;
+
+        Ns_CacheLock(cache);
+        for (entry = Ns_CacheFirstEntry(cache, &search); entry != NULL; entry = Ns_CacheNextEntry(&search)) {
+            const RcEntry *ePtr = Ns_CacheGetValue(entry);
+
+            if (ePtr != NULL && !ePtr->isVary) {
+                nEntries++;
+                size += (Tcl_WideInt)Ns_CacheGetSize(entry);
+            }
+        }
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("entries", 7), Tcl_NewWideIntObj(nEntries));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("size", 4), Tcl_NewWideIntObj(size));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("maxsize", 7),
+                              Tcl_NewWideIntObj((Tcl_WideInt)Ns_CacheGetMaxSize(cache)));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("hits", 4),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.hits));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("driverhits", 10),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.driverhits));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("notmodified", 11),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.notmodified));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("stale", 5),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.stale));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("misses", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.misses));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("coalesced", 9),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.coalesced));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("stores", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.stores));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("purged", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)servPtr->respcache.stats.purged));
+        Ns_CacheUnlock(cache);
+
+        Tcl_SetObjResult(interp, dictObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclRespCacheObjCmd --
+ *
+ *      Implements "ns_respcache".
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Depends on subcommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclRespCacheObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"keys",       RcKeysObjCmd},
+        {"purge",      RcPurgeObjCmd},
+        {"register",   RcRegisterObjCmd},
+        {"stats",      RcStatsObjCmd},
+        {"unregister", RcUnregisterObjCmd},
+        {NULL, NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,2626 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * revproxy.c --
+ *
+ *      Native reverse proxy registered via "ns_register_revproxy". The
+ *      request procedure runs in the connection thread only to build
+ *      the upstream request (including the optional header callback)
+ *      and then hands the socket of the client to the proxy
+ *      thread. The proxy thread multiplexes all proxied requests with
+ *      non-blocking I/O: it connects to the upstream server (or reuses
+ *      a pooled connection), sends the request, and relays the
+ *      response to the client without involving a connection thread.
+ *      Idle upstream connections are kept in a bounded pool per
+ *      upstream server.
+ */
+
+#include "nsd.h"
+
+#define RP_DEFAULT_POOLSIZE      10
+#define RP_DEFAULT_IDLETIMEOUT   5
+#define RP_BUFFER_SIZE           16384
+#define RP_MAX_HEAD_SIZE         32768
+#define RP_COMPACT_THRESHOLD     16384u
+
+/*
+ * NS_EAGAIN covers NS_EWOULDBLOCK on all supported platforms.
+ */
+#define RP_WOULDBLOCK(err)       ((err) == NS_EAGAIN || (err) == NS_EINTR)
+
+typedef enum {
+    RP_STATE_START,           /* task was just queued */
+    RP_STATE_CONNECT,         /* waiting for the upstream connect */
+    RP_STATE_SEND,            /* sending the request to the upstream */
+    RP_STATE_HEAD,            /* receiving the response head */
+    RP_STATE_BODY,            /* relaying the response body */
+    RP_STATE_TUNNEL,          /* relaying in both directions after "101 Switching Protocols" */
+    RP_STATE_FLUSH            /* sending buffered data to the client before closing */
+} RpState;
+
+typedef enum {
+    RP_BODY_NONE,
+    RP_BODY_LENGTH,
+    RP_BODY_CHUNKED,
+    RP_BODY_CLOSE
+} RpBodyType;
+
+typedef enum {
+    RP_CHUNK_SIZE,
+    RP_CHUNK_EXT,
+    RP_CHUNK_DATA,
+    RP_CHUNK_DATA_END,
+    RP_CHUNK_TRAILER,
+    RP_CHUNK_DONE
+} RpChunkState;
+
+/*
+ * An idle connection to an upstream server.
+ */
+
+typedef struct RpPooled {
+    struct RpPooled  *nextPtr;
+    NS_SOCKET         sock;
+    Ns_Time           expires;
+    NS_POLL_NFDS_TYPE pollIdx;
+} RpPooled;
+
+/*
+ * The following structure defines an upstream server, identified by
+ * host and port. Upstreams are shared between all registrations
+ * pointing to the same server and are never freed.
+ */
+
+typedef struct RpUpstream {
+    struct RpUpstream *nextPtr;
+    char              *name;              /* "host:port" */
+    char              *host;
+    unsigned short     port;
+    int                poolSize;          /* Maximum number of idle connections */
+    Ns_Time            idleTimeout;
+    RpPooled          *idlePtr;           /* Idle connections, most recently used first */
+    int                nIdle;
+    struct {
+        unsigned long  requests;
+        unsigned long  active;
+        unsigned long  errors;
+        unsigned long  timeouts;
+        unsigned long  connects;
+        unsigned long  reused;
+        unsigned long  retries;
+        unsigned long  responses;
+        Tcl_WideInt    sent;
+        Tcl_WideInt    received;
+        Ns_Time        latencyMin;
+        Ns_Time        latencyMax;
+        Ns_Time        latencySum;
+    } stats;
+} RpUpstream;
+
+/*
+ * The following structure is the client data of a registered request
+ * procedure.
+ */
+
+typedef struct RpRoute {
+    RpUpstream     *upstreamPtr;          /* Fixed upstream, or NULL for a group */
+    NsUpstreamGroup *groupPtr;            /* Upstream group, or NULL */
+    char           *target;               /* Target as provided */
+    char           *path;                 /* Path prefix on the upstream server */
+    char           *targetHost;           /* Value for the host header field, or NULL */
+    Ns_Time         connectTimeout;
+    Ns_Time         timeout;
+    Ns_Time         idleTimeout;          /* Pool parameters, when provided */
+    int             poolSize;
+    Ns_TclCallback *cbPtr;                /* Optional header callback */
+} RpRoute;
+
+/*
+ * A proxied request, owned by the proxy thread.
+ */
+
+typedef struct RpTask {
+    struct RpTask    *nextPtr;
+    RpUpstream       *upstreamPtr;
+    NsUpstreamMember *memberPtr;          /* Selected member of an upstream group */
+    NsUpstreamResult  result;             /* Result reported to the upstream group */
+    Sock             *sockPtr;            /* Client socket */
+    NS_SOCKET         sock;               /* Upstream socket */
+    struct NS_SOCKADDR_STORAGE sa;        /* Resolved address of the upstream */
+    bool              resolved;           /* The address in "sa" is valid */
+    RpState           state;
+    Ns_Time           connectTimeout;
+    Ns_Time           timeout;
+    Ns_Time           startTime;
+    Ns_Time           deadline;
+    bool              reused;             /* Upstream connection is from the pool */
+    bool              retried;
+    bool              idempotent;
+    bool              isHead;
+    bool              http10;             /* Client sent an HTTP/1.0 request */
+    bool              clientKeep;         /* Client connection might be kept alive */
+    bool              upstreamKeep;       /* Upstream connection might be pooled */
+    bool              headSent;           /* Response head was queued for the client */
+    bool              received;           /* Received data from the upstream */
+    bool              bodyDone;
+    bool              clientEof;
+    NS_POLL_NFDS_TYPE upIdx;
+    NS_POLL_NFDS_TYPE clientIdx;
+
+    Tcl_DString       request;            /* Request head, followed by an in-memory body */
+    size_t            requestOffset;
+    const char       *content;            /* Request body in memory (owned by the Sock) */
+    int               contentFd;          /* Spooled request body (owned by the Sock) */
+    size_t            contentLength;
+    size_t            contentOffset;
+
+    Tcl_DString       head;               /* Response head received so far */
+    Tcl_DString       out;                /* Data for the client */
+    size_t            outOffset;
+    size_t            inflight;           /* Length of a rejected TLS write */
+    Tcl_DString       in;                 /* Tunnel: data from the client for the upstream */
+    size_t            inOffset;
+
+    RpBodyType        bodyType;
+    Tcl_WideInt       bodyRemaining;
+    RpChunkState      chunkState;
+    Tcl_WideInt       chunkRemaining;
+    size_t            chunkLineLength;
+    int               status;
+} RpTask;
+
+/*
+ * Local functions defined in this file.
+ */
+
+static void RpStartThread(void);
+static void RpTrigger(void);
+static Ns_ThreadProc RpThread;
+static Ns_ShutdownProc RpShutdown;
+static Ns_OpProc RpRequestProc;
+static Ns_ArgProc RpArgProc;
+static void RpRouteFree(void *arg);
+
+static RpUpstream *RpUpstreamGet(const char *host, unsigned short port, const RpRoute *routePtr)
+    NS_GNUC_NONNULL(1,3) NS_GNUC_RETURNS_NONNULL;
+static void RpUpstreamRelease(RpTask *taskPtr)
+    NS_GNUC_NONNULL(1);
+static NS_SOCKET RpSockConnect(const struct sockaddr *saPtr)
+    NS_GNUC_NONNULL(1);
+static void RpConnect(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpConnected(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpSendRequest(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpReadHead(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static bool RpParseHead(RpTask *taskPtr, const char *head, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpReadBody(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpBodyData(RpTask *taskPtr, const char *data, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static size_t RpChunkScan(RpTask *taskPtr, const char *data, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void RpTunnel(RpTask *taskPtr, short upEvents, short clientEvents)
+    NS_GNUC_NONNULL(1);
+static void RpUpstreamFailed(RpTask *taskPtr, bool timeout, const char *reason, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+static void RpClientFlush(RpTask *taskPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static bool RpTaskRun(RpTask *taskPtr, short upEvents, short clientEvents, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(4);
+static void RpTaskFree(RpTask *taskPtr)
+    NS_GNUC_NONNULL(1);
+static void RpSetDeadline(RpTask *taskPtr, const Ns_Time *nowPtr, const Ns_Time *timeoutPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static bool RpHasToken(const char *value, const char *token)
+    NS_GNUC_NONNULL(2);
+static bool RpIsHopByHop(const char *key, const char *connection)
+    NS_GNUC_NONNULL(1);
+static void RpAppendForwarded(Ns_Set *set, const char *key, const char *value, const char *sep)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static TCL_OBJCMDPROC_T RevProxyStatsObjCmd;
+static TCL_OBJCMDPROC_T RevProxyUpstreamsObjCmd;
+
+/*
+ * Static variables defined in this file.
+ */
+
+static struct {
+    Ns_Mutex          lock;
+    Ns_Cond           cond;
+    Ns_Thread         thread;
+    bool              running;
+    bool              stopping;
+    bool              triggered;
+    NS_SOCKET         trigPipe[2];
+    RpTask           *firstTaskPtr;
+    RpUpstream       *firstUpstreamPtr;
+    Tcl_HashTable     upstreams;          /* Keys are "host:port" */
+} rp;
+
+/*
+ * Header fields which are hop-by-hop or describe the message framing,
+ * which is constructed by the proxy.
+ */
+
+static const char *const hopByHopFields[] = {
+    "connection",
+    "content-length",
+    "expect",
+    "keep-alive",
+    "proxy-connection",
+    "te",
+    "trailer",
+    "trailers",
+    "transfer-encoding",
+    "upgrade",
+    NULL
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitRevProxy --
+ *
+ *      Initialize the reverse proxy subsystem. The proxy thread is
+ *      started on demand by the first proxied request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitRevProxy(void)
+{
+    Ns_MutexInit(&rp.lock);
+    Ns_MutexSetName(&rp.lock, "ns:revproxy");
+    Ns_CondInit(&rp.cond);
+    Tcl_InitHashTable(&rp.upstreams, TCL_STRING_KEYS);
+    rp.trigPipe[0] = NS_INVALID_SOCKET;
+    rp.trigPipe[1] = NS_INVALID_SOCKET;
+    Ns_RegisterProcInfo((ns_funcptr_t)RpRequestProc, "ns:revproxy", RpArgProc);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpStartThread --
+ *
+ *      Start the proxy thread, unless it is already running. Must be
+ *      called with rp.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Creates the trigger pipe and the proxy thread, registers a
+ *      shutdown procedure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpStartThread(void)
+{
+    if (!rp.running) {
+        if (ns_sockpair(rp.trigPipe) != 0) {
+            Ns_Fatal("revproxy: ns_sockpair() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+        rp.running = NS_TRUE;
+        rp.stopping = NS_FALSE;
+        Ns_ThreadCreate(RpThread, NULL, 0, &rp.thread);
+        (void) Ns_RegisterAtShutdown(RpShutdown, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpTrigger --
+ *
+ *      Wake up the proxy thread. Must be called with rp.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes a byte to the trigger pipe, unless a wakeup is already
+ *      pending.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpTrigger(void)
+{
+    if (rp.running && !rp.triggered) {
+        rp.triggered = NS_TRUE;
+        if (ns_send(rp.trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
+            Ns_Fatal("revproxy: trigger send() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpShutdown --
+ *
+ *      Shutdown procedure for the proxy thread. The first call (with
+ *      NULL timeout) signals the thread to stop, the second call waits
+ *      for the thread to finish.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Pending requests are aborted, pooled connections are closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpShutdown(const Ns_Time *toPtr, void *UNUSED(arg))
+{
+    Ns_ReturnCode status = NS_OK;
+
+    Ns_MutexLock(&rp.lock);
+    if (toPtr == NULL) {
+        rp.stopping = NS_TRUE;
+        RpTrigger();
+    } else {
+        while (rp.running && status == NS_OK) {
+            status = Ns_CondTimedWait(&rp.cond, &rp.lock, toPtr);
+        }
+    }
+    Ns_MutexUnlock(&rp.lock);
+
+    if (toPtr != NULL) {
+        if (status != NS_OK) {
+            Ns_Log(Warning, "revproxy: timeout waiting for proxy thread exit");
+        } else if (rp.thread != NULL) {
+            Ns_ThreadJoin(&rp.thread, NULL);
+            rp.thread = NULL;
+            ns_sockclose(rp.trigPipe[0]);
+            ns_sockclose(rp.trigPipe[1]);
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpThread --
+ *
+ *      Thread serving all proxied requests. The thread polls the
+ *      upstream and client sockets of all tasks according to their
+ *      state, advances the tasks, and maintains the pools of idle
+ *      upstream connections.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Reads from and writes to client and upstream sockets.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpThread(void *UNUSED(arg))
+{
+    struct pollfd    *pfds = NULL;
+    NS_POLL_NFDS_TYPE maxFds = 0u;
+    RpTask           *taskPtr, **nextPtrPtr;
+    RpUpstream       *upstreamPtr;
+    RpPooled         *pooledPtr, **pooledPtrPtr;
+
+    Ns_ThreadSetName("-revproxy-");
+    Ns_Log(Notice, "revproxy: starting");
+
+    Ns_MutexLock(&rp.lock);
+    while (!rp.stopping) {
+        NS_POLL_NFDS_TYPE nfds = 1u;
+        long              pollTimeout = -1;
+        Ns_Time           now, diff;
+        int               n;
+
+#define RP_POLL_ADD(idxVar, fdValue, eventsValue)                       \
+        if (nfds >= maxFds) {                                           \
+            maxFds = nfds + 100u;                                       \
+            pfds = ns_realloc(pfds, maxFds * sizeof(struct pollfd));    \
+        }                                                               \
+        (idxVar) = nfds;                                                \
+        pfds[nfds].fd = (fdValue);                                      \
+        pfds[nfds].events = (short)(eventsValue);                       \
+        pfds[nfds].revents = 0;                                         \
+        nfds++
+
+        /*
+         * Build the poll set. The first entry is the trigger pipe,
+         * followed by the sockets of the tasks and the idle pooled
+         * connections, which are polled to detect connections closed
+         * by the upstream server.
+         */
+        Ns_GetTime(&now);
+        for (taskPtr = rp.firstTaskPtr; taskPtr != NULL; taskPtr = taskPtr->nextPtr) {
+            bool  outPending = ((size_t)taskPtr->out.length > taskPtr->outOffset);
+            short upEvents = 0, clientEvents = 0;
+
+            taskPtr->upIdx = 0u;
+            taskPtr->clientIdx = 0u;
+
+            switch (taskPtr->state) {
+            case RP_STATE_START:
+                pollTimeout = 0;
+                break;
+            case RP_STATE_CONNECT:  NS_FALL_THROUGH; /* fall through */
+            case RP_STATE_SEND:
+                upEvents = POLLOUT;
+                break;
+            case RP_STATE_HEAD:
+                upEvents = POLLIN;
+                break;
+            case RP_STATE_BODY:
+                upEvents = outPending ? 0 : POLLIN;
+                break;
+            case RP_STATE_TUNNEL:
+                upEvents = outPending ? 0 : POLLIN;
+                if ((size_t)taskPtr->in.length > taskPtr->inOffset) {
+                    upEvents |= POLLOUT;
+                } else if (!taskPtr->clientEof) {
+                    clientEvents = POLLIN;
+                }
+                break;
+            case RP_STATE_FLUSH:
+                break;
+            }
+            if (outPending) {
+                clientEvents |= POLLOUT;
+            }
+            if (upEvents != 0 && taskPtr->sock != NS_INVALID_SOCKET) {
+                RP_POLL_ADD(taskPtr->upIdx, taskPtr->sock, upEvents);
+            }
+            if (clientEvents != 0) {
+                RP_POLL_ADD(taskPtr->clientIdx, taskPtr->sockPtr->sock, clientEvents);
+            }
+            if (taskPtr->deadline.sec > 0) {
+                long ms = (Ns_DiffTime(&taskPtr->deadline, &now, &diff) > 0)
+                    ? (long)Ns_TimeToMilliseconds(&diff) + 1 : 0;
+
+                if (pollTimeout < 0 || ms < pollTimeout) {
+                    pollTimeout = ms;
+                }
+            }
+        }
+        for (upstreamPtr = rp.firstUpstreamPtr; upstreamPtr != NULL; upstreamPtr = upstreamPtr->nextPtr) {
+            for (pooledPtr = upstreamPtr->idlePtr; pooledPtr != NULL; pooledPtr = pooledPtr->nextPtr) {
+                long ms;
+
+                RP_POLL_ADD(pooledPtr->pollIdx, pooledPtr->sock, POLLIN);
+                ms = (Ns_DiffTime(&pooledPtr->expires, &now, &diff) > 0)
+                    ? (long)Ns_TimeToMilliseconds(&diff) + 1 : 0;
+                if (pollTimeout < 0 || ms < pollTimeout) {
+                    pollTimeout = ms;
+                }
+            }
+        }
+#undef RP_POLL_ADD
+        if (pfds == NULL) {
+            maxFds = 100u;
+            pfds = ns_malloc(maxFds * sizeof(struct pollfd));
+        }
+        pfds[0].fd = rp.trigPipe[0];
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        Ns_MutexUnlock(&rp.lock);
+
+        do {
+            n = ns_poll(pfds, nfds, pollTimeout);
+        } while (n < 0 && errno == NS_EINTR);
+
+        if (n < 0) {
+            Ns_Fatal("revproxy: ns_poll() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+
+        Ns_MutexLock(&rp.lock);
+        if ((pfds[0].revents & POLLIN) != 0) {
+            char c;
+
+            if (recv(rp.trigPipe[0], &c, 1, 0) != 1) {
+                Ns_Fatal("revproxy: trigger recv() failed: %s", ns_sockstrerror(ns_sockerrno));
+            }
+            rp.triggered = NS_FALSE;
+        }
+
+        /*
+         * Close idle connections, which were closed by the upstream
+         * server or exceeded the idle timeout. Connections returned
+         * to the pool while polling have no valid poll index.
+         */
+        Ns_GetTime(&now);
+        for (upstreamPtr = rp.firstUpstreamPtr; upstreamPtr != NULL; upstreamPtr = upstreamPtr->nextPtr) {
+            pooledPtrPtr = &upstreamPtr->idlePtr;
+            while ((pooledPtr = *pooledPtrPtr) != NULL) {
+                if ((pooledPtr->pollIdx > 0u && pooledPtr->pollIdx < nfds && pfds[pooledPtr->pollIdx].revents != 0)
+                    || Ns_DiffTime(&pooledPtr->expires, &now, NULL) <= 0) {
+                    *pooledPtrPtr = pooledPtr->nextPtr;
+                    ns_sockclose(pooledPtr->sock);
+                    ns_free(pooledPtr);
+                    upstreamPtr->nIdle--;
+                } else {
+                    pooledPtr->pollIdx = 0u;
+                    pooledPtrPtr = &pooledPtr->nextPtr;
+                }
+            }
+        }
+
+        /*
+         * Process all tasks. Tasks added while polling are at the
+         * front of the list and have no valid poll index.
+         */
+        nextPtrPtr = &rp.firstTaskPtr;
+        while ((taskPtr = *nextPtrPtr) != NULL) {
+            short upEvents = 0, clientEvents = 0;
+
+            if (taskPtr->upIdx > 0u && taskPtr->upIdx < nfds) {
+                upEvents = pfds[taskPtr->upIdx].revents;
+            }
+            if (taskPtr->clientIdx > 0u && taskPtr->clientIdx < nfds) {
+                clientEvents = pfds[taskPtr->clientIdx].revents;
+            }
+            if (RpTaskRun(taskPtr, upEvents, clientEvents, &now)) {
+                *nextPtrPtr = taskPtr->nextPtr;
+                RpTaskFree(taskPtr);
+            } else {
+                nextPtrPtr = &taskPtr->nextPtr;
+            }
+        }
+    }
+
+    /*
+     * Shutdown: abort all tasks and close all pooled connections.
+     */
+    while ((taskPtr = rp.firstTaskPtr) != NULL) {
+        rp.firstTaskPtr = taskPtr->nextPtr;
+        taskPtr->clientKeep = NS_FALSE;
+        taskPtr->upstreamKeep = NS_FALSE;
+        RpTaskFree(taskPtr);
+    }
+    for (upstreamPtr = rp.firstUpstreamPtr; upstreamPtr != NULL; upstreamPtr = upstreamPtr->nextPtr) {
+        while ((pooledPtr = upstreamPtr->idlePtr) != NULL) {
+            upstreamPtr->idlePtr = pooledPtr->nextPtr;
+            ns_sockclose(pooledPtr->sock);
+            ns_free(pooledPtr);
+        }
+        upstreamPtr->nIdle = 0;
+    }
+    rp.running = NS_FALSE;
+    Ns_CondBroadcast(&rp.cond);
+    Ns_MutexUnlock(&rp.lock);
+
+    ns_free(pfds);
+    Ns_Log(Notice, "revproxy: exiting");
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpTaskRun --
+ *
+ *      Advance a task based on the poll results of its sockets and
+ *      check its deadline. Must be called with rp.lock held.
+ *
+ * Results:
+ *      NS_TRUE when the task is finished and can be freed.
+ *
+ * Side effects:
+ *      I/O on the client and upstream sockets.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RpTaskRun(RpTask *taskPtr, short upEvents, short clientEvents, const Ns_Time *nowPtr)
+{
+    bool finished = NS_FALSE;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    switch (taskPtr->state) {
+    case RP_STATE_START:
+        RpConnect(taskPtr, nowPtr);
+        break;
+
+    case RP_STATE_CONNECT:
+        if (upEvents != 0) {
+            RpConnected(taskPtr, nowPtr);
+        }
+        break;
+
+    case RP_STATE_SEND:
+        if (upEvents != 0) {
+            RpSendRequest(taskPtr, nowPtr);
+        }
+        break;
+
+    case RP_STATE_HEAD:
+        if (upEvents != 0) {
+            RpReadHead(taskPtr, nowPtr);
+        }
+        break;
+
+    case RP_STATE_BODY:
+        if (upEvents != 0) {
+            RpReadBody(taskPtr, nowPtr);
+        }
+        break;
+
+    case RP_STATE_TUNNEL:
+        RpTunnel(taskPtr, upEvents, clientEvents);
+        break;
+
+    case RP_STATE_FLUSH:
+        break;
+    }
+
+    if ((size_t)taskPtr->out.length > taskPtr->outOffset
+        && (clientEvents != 0 || taskPtr->inflight == 0u)) {
+        RpClientFlush(taskPtr, nowPtr);
+    }
+
+    if ((size_t)taskPtr->out.length == taskPtr->outOffset
+        && (taskPtr->state == RP_STATE_FLUSH
+            || (taskPtr->state == RP_STATE_BODY && taskPtr->bodyDone))) {
+        finished = NS_TRUE;
+
+    } else if (taskPtr->deadline.sec > 0 && Ns_DiffTime(&taskPtr->deadline, nowPtr, NULL) <= 0) {
+        if (taskPtr->state == RP_STATE_FLUSH) {
+            Ns_Log(Notice, "revproxy: %s: timeout while sending response to client",
+                   taskPtr->upstreamPtr->name);
+            taskPtr->clientKeep = NS_FALSE;
+            finished = NS_TRUE;
+        } else if (taskPtr->headSent) {
+            Ns_Log(Warning, "revproxy: %s: timeout while relaying response",
+                   taskPtr->upstreamPtr->name);
+            taskPtr->upstreamPtr->stats.timeouts++;
+            taskPtr->upstreamKeep = NS_FALSE;
+            taskPtr->clientKeep = NS_FALSE;
+            finished = NS_TRUE;
+        } else {
+            RpUpstreamFailed(taskPtr, NS_TRUE, "timeout", nowPtr);
+        }
+    }
+
+    return finished;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpSetDeadline --
+ *
+ *      Set the deadline of a task relative to the current time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpSetDeadline(RpTask *taskPtr, const Ns_Time *nowPtr, const Ns_Time *timeoutPtr)
+{
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+    NS_NONNULL_ASSERT(timeoutPtr != NULL);
+
+    if (timeoutPtr->sec > 0 || timeoutPtr->usec > 0) {
+        taskPtr->deadline = *nowPtr;
+        Ns_IncrTime(&taskPtr->deadline, timeoutPtr->sec, timeoutPtr->usec);
+    } else {
+        taskPtr->deadline.sec = 0;
+        taskPtr->deadline.usec = 0;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpSockConnect --
+ *
+ *      Initiate a non-blocking connect to an already resolved
+ *      address. In contrast to Ns_SockAsyncConnect(), no name
+ *      resolution is performed, such that the proxy thread never
+ *      blocks on DNS.
+ *
+ * Results:
+ *      Socket or NS_INVALID_SOCKET on error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static NS_SOCKET
+RpSockConnect(const struct sockaddr *saPtr)
+{
+    NS_SOCKET sock;
+
+    NS_NONNULL_ASSERT(saPtr != NULL);
+
+    sock = (NS_SOCKET)socket((int)saPtr->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock != NS_INVALID_SOCKET) {
+        if (Ns_SockSetNonBlocking(sock) != NS_OK) {
+            Ns_Log(Warning, "revproxy: attempt to set socket nonblocking failed");
+        }
+        if (connect(sock, saPtr, Ns_SockaddrGetSockLen(saPtr)) != 0) {
+            ns_sockerrno_t err = ns_sockerrno;
+
+            if (err != NS_EINPROGRESS && err != NS_EWOULDBLOCK) {
+                ns_sockclose(sock);
+                Ns_SetSockErrno(err);
+                sock = NS_INVALID_SOCKET;
+            }
+        }
+    }
+    return sock;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpConnect --
+ *
+ *      Obtain an upstream connection for a task. Idle pooled
+ *      connections are preferred; otherwise a non-blocking connect to
+ *      the address resolved by the connection thread is initiated.
+ *      Must be called with rp.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the task state and the statistics of the upstream.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpConnect(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    RpUpstream *upstreamPtr;
+    RpPooled   *pooledPtr;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    upstreamPtr = taskPtr->upstreamPtr;
+    taskPtr->requestOffset = 0u;
+    taskPtr->contentOffset = 0u;
+
+    pooledPtr = upstreamPtr->idlePtr;
+    if (pooledPtr != NULL && !taskPtr->retried && !taskPtr->http10) {
+        upstreamPtr->idlePtr = pooledPtr->nextPtr;
+        upstreamPtr->nIdle--;
+        taskPtr->sock = pooledPtr->sock;
+        taskPtr->reused = NS_TRUE;
+        upstreamPtr->stats.reused++;
+        ns_free(pooledPtr);
+
+        taskPtr->state = RP_STATE_SEND;
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+        RpSendRequest(taskPtr, nowPtr);
+
+    } else {
+        taskPtr->reused = NS_FALSE;
+        if (!taskPtr->resolved) {
+            taskPtr->sock = NS_INVALID_SOCKET;
+            RpUpstreamFailed(taskPtr, NS_FALSE, "could not resolve host", nowPtr);
+            return;
+        }
+        taskPtr->sock = RpSockConnect((const struct sockaddr *)&taskPtr->sa);
+        if (taskPtr->sock == NS_INVALID_SOCKET) {
+            RpUpstreamFailed(taskPtr, NS_FALSE, ns_sockstrerror(ns_sockerrno), nowPtr);
+        } else {
+            upstreamPtr->stats.connects++;
+            taskPtr->state = RP_STATE_CONNECT;
+            RpSetDeadline(taskPtr, nowPtr, &taskPtr->connectTimeout);
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpConnected --
+ *
+ *      The upstream socket of a pending connect became writable.
+ *      Check the result of the connect and start sending the request.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the task state.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpConnected(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    int       err = 0;
+    socklen_t len = (socklen_t)sizeof(err);
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    if (getsockopt(taskPtr->sock, SOL_SOCKET, SO_ERROR, (void *)&err, &len) == -1) {
+        err = ns_sockerrno;
+    }
+    if (err != 0) {
+        RpUpstreamFailed(taskPtr, NS_FALSE, ns_sockstrerror(err), nowPtr);
+    } else {
+        taskPtr->state = RP_STATE_SEND;
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+        RpSendRequest(taskPtr, nowPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpSendRequest --
+ *
+ *      Send the request head and body to the upstream server without
+ *      blocking. A spooled request body is read from the spool file
+ *      of the client socket.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Switches to RP_STATE_HEAD when the request was sent.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpSendRequest(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    const size_t headLength = (size_t)taskPtr->request.length;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    for (;;) {
+        const char *data;
+        char        buffer[RP_BUFFER_SIZE];
+        size_t      toSend;
+        ssize_t     sent;
+
+        if (taskPtr->requestOffset < headLength) {
+            data = taskPtr->request.string + taskPtr->requestOffset;
+            toSend = headLength - taskPtr->requestOffset;
+
+        } else if (taskPtr->contentOffset < taskPtr->contentLength) {
+            toSend = taskPtr->contentLength - taskPtr->contentOffset;
+            if (taskPtr->content != NULL) {
+                data = taskPtr->content + taskPtr->contentOffset;
+            } else {
+                ssize_t nRead;
+
+                if (toSend > sizeof(buffer)) {
+                    toSend = sizeof(buffer);
+                }
+                nRead = pread(taskPtr->contentFd, buffer, toSend, (off_t)taskPtr->contentOffset);
+                if (nRead <= 0) {
+                    Ns_Log(Error, "revproxy: %s: cannot read spooled request body: %s",
+                           taskPtr->upstreamPtr->name, strerror(errno));
+                    taskPtr->retried = NS_TRUE;
+                    RpUpstreamFailed(taskPtr, NS_FALSE, "spool file read error", nowPtr);
+                    break;
+                }
+                toSend = (size_t)nRead;
+                data = buffer;
+            }
+        } else {
+            taskPtr->state = RP_STATE_HEAD;
+            RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+            break;
+        }
+
+        sent = ns_send(taskPtr->sock, data, toSend, 0);
+        if (sent < 0) {
+            if (!RP_WOULDBLOCK(ns_sockerrno)) {
+                RpUpstreamFailed(taskPtr, NS_FALSE, ns_sockstrerror(ns_sockerrno), nowPtr);
+            }
+            break;
+        }
+        taskPtr->upstreamPtr->stats.sent += (Tcl_WideInt)sent;
+        if (taskPtr->requestOffset < headLength) {
+            taskPtr->requestOffset += (size_t)sent;
+        } else {
+            taskPtr->contentOffset += (size_t)sent;
+        }
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+        if ((size_t)sent < toSend) {
+            break;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpReadHead --
+ *
+ *      Receive the response head from the upstream server. When the
+ *      head is complete, it is rewritten for the client and queued
+ *      together with the first part of the body.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the task state and the latency statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpReadHead(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    char    buffer[RP_BUFFER_SIZE];
+    ssize_t nRead;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    nRead = ns_recv(taskPtr->sock, buffer, sizeof(buffer), 0);
+    if (nRead < 0) {
+        if (!RP_WOULDBLOCK(ns_sockerrno)) {
+            RpUpstreamFailed(taskPtr, NS_FALSE, ns_sockstrerror(ns_sockerrno), nowPtr);
+        }
+
+    } else if (nRead == 0) {
+        RpUpstreamFailed(taskPtr, NS_FALSE, "connection closed by upstream", nowPtr);
+
+    } else {
+        const char *end;
+        size_t      offset;
+
+        taskPtr->received = NS_TRUE;
+        taskPtr->upstreamPtr->stats.received += (Tcl_WideInt)nRead;
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+
+        /*
+         * Search the end of the head in the new data, including the
+         * last three bytes received before.
+         */
+        offset = (taskPtr->head.length > 3) ? (size_t)taskPtr->head.length - 3u : 0u;
+        Tcl_DStringAppend(&taskPtr->head, buffer, (TCL_SIZE_T)nRead);
+
+        while (taskPtr->state == RP_STATE_HEAD
+               && (end = ns_memmem(taskPtr->head.string + offset, (size_t)taskPtr->head.length - offset,
+                                   "\r\n\r\n", 4u)) != NULL) {
+            size_t headLength = (size_t)(end - taskPtr->head.string) + 4u;
+            size_t rest = (size_t)taskPtr->head.length - headLength;
+
+            if (memchr(taskPtr->head.string, INTCHAR('\0'), headLength) != NULL) {
+                taskPtr->retried = NS_TRUE;
+                RpUpstreamFailed(taskPtr, NS_FALSE, "NUL byte in response head", nowPtr);
+                break;
+            }
+            if (!RpParseHead(taskPtr, taskPtr->head.string, headLength)) {
+                taskPtr->retried = NS_TRUE;
+                RpUpstreamFailed(taskPtr, NS_FALSE, "invalid response head", nowPtr);
+                break;
+            }
+            memmove(taskPtr->head.string, taskPtr->head.string + headLength, rest);
+            Tcl_DStringSetLength(&taskPtr->head, (TCL_SIZE_T)rest);
+            offset = 0u;
+        }
+
+        if (taskPtr->state == RP_STATE_HEAD) {
+            if (taskPtr->head.length > RP_MAX_HEAD_SIZE) {
+                taskPtr->retried = NS_TRUE;
+                RpUpstreamFailed(taskPtr, NS_FALSE, "response head too large", nowPtr);
+            }
+
+        } else if (taskPtr->state == RP_STATE_BODY || taskPtr->state == RP_STATE_TUNNEL) {
+            RpUpstream *upstreamPtr = taskPtr->upstreamPtr;
+            Ns_Time     latency;
+
+            (void) Ns_DiffTime(nowPtr, &taskPtr->startTime, &latency);
+            if (upstreamPtr->stats.responses == 0u || Ns_DiffTime(&latency, &upstreamPtr->stats.latencyMin, NULL) < 0) {
+                upstreamPtr->stats.latencyMin = latency;
+            }
+            if (Ns_DiffTime(&latency, &upstreamPtr->stats.latencyMax, NULL) > 0) {
+                upstreamPtr->stats.latencyMax = latency;
+            }
+            Ns_IncrTime(&upstreamPtr->stats.latencySum, latency.sec, latency.usec);
+            upstreamPtr->stats.responses++;
+
+            /*
+             * The remaining data is the first part of the body (or
+             * of the tunneled stream).
+             */
+            if (taskPtr->head.length > 0) {
+                if (taskPtr->state == RP_STATE_TUNNEL) {
+                    Tcl_DStringAppend(&taskPtr->out, taskPtr->head.string, taskPtr->head.length);
+                } else {
+                    RpBodyData(taskPtr, taskPtr->head.string, (size_t)taskPtr->head.length);
+                }
+            }
+            Tcl_DStringFree(&taskPtr->head);
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpParseHead --
+ *
+ *      Parse a complete response head of the upstream server,
+ *      determine the framing of the body, and queue the rewritten
+ *      head for the client. Interim responses (1xx other than 101)
+ *      are skipped.
+ *
+ * Results:
+ *      NS_FALSE, when the head is invalid.
+ *
+ * Side effects:
+ *      Updates the task state.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RpParseHead(RpTask *taskPtr, const char *head, size_t length)
+{
+    const char *p, *lineEnd, *end = head + length - 2u;
+    const char *connection = NULL, *connectionEnd = NULL;
+    Tcl_DString ds;
+    int         major, minor, status;
+    bool        success = NS_TRUE, chunked = NS_FALSE, upstreamClose;
+    Tcl_WideInt contentLength = -1;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(head != NULL);
+
+    /*
+     * The head is terminated by "\r\n\r\n" and contains no NUL bytes
+     * (checked by the caller), so every line end is found before "end"
+     * and the functions below do not read beyond a line.
+     */
+    lineEnd = ns_memmem(head, length, "\r\n", 2u);
+    if (lineEnd == NULL
+        || sscanf(head, "HTTP/%2d.%2d %3d", &major, &minor, &status) != 3
+        || status < 100 || status > 999) {
+        return NS_FALSE;
+    }
+    if (status >= 100 && status < 200 && status != 101) {
+        return NS_TRUE;
+    }
+    taskPtr->status = status;
+    upstreamClose = (major == 1 && minor == 0);
+
+    /*
+     * First pass: collect the framing information.
+     */
+    for (p = lineEnd + 2; p < end; p = lineEnd + 2) {
+        const char *colon, *value;
+
+        lineEnd = ns_memmem(p, (size_t)(end - p) + 2u, "\r\n", 2u);
+        if (lineEnd == NULL) {
+            return NS_FALSE;
+        }
+        colon = memchr(p, INTCHAR(':'), (size_t)(lineEnd - p));
+        if (colon == NULL) {
+            return NS_FALSE;
+        }
+        for (value = colon + 1; value < lineEnd && CHARTYPE(space, *value) != 0; value++) {
+            ;
+        }
+        if ((size_t)(colon - p) == 14u && strncasecmp(p, "content-length", 14u) == 0) {
+            contentLength = strtoll(value, NULL, 10);
+            if (contentLength < 0) {
+                return NS_FALSE;
+            }
+        } else if ((size_t)(colon - p) == 17u && strncasecmp(p, "transfer-encoding", 17u) == 0) {
+            chunked = NS_FALSE;
+            for (; value + 7 <= lineEnd; value++) {
+                if (strncasecmp(value, "chunked", 7u) == 0) {
+                    chunked = NS_TRUE;
+                    break;
+                }
+            }
+        } else if ((size_t)(colon - p) == 10u && strncasecmp(p, "connection", 10u) == 0) {
+            connection = value;
+            connectionEnd = lineEnd;
+        }
+    }
+    Tcl_DStringInit(&ds);
+    if (connection != NULL) {
+        Tcl_DStringAppend(&ds, connection, (TCL_SIZE_T)(connectionEnd - connection));
+        if (RpHasToken(ds.string, "close")) {
+            upstreamClose = NS_TRUE;
+        } else if (RpHasToken(ds.string, "keep-alive")) {
+            upstreamClose = NS_FALSE;
+        }
+    }
+
+    if (status == 101) {
+        taskPtr->bodyType = RP_BODY_NONE;
+        taskPtr->clientKeep = NS_FALSE;
+        upstreamClose = NS_TRUE;
+    } else if (taskPtr->isHead || status == 204 || status == 304) {
+        taskPtr->bodyType = RP_BODY_NONE;
+    } else if (chunked) {
+        taskPtr->bodyType = RP_BODY_CHUNKED;
+        taskPtr->chunkState = RP_CHUNK_SIZE;
+        taskPtr->chunkRemaining = 0;
+        if (taskPtr->http10) {
+            /*
+             * HTTP/1.0 requests are forwarded as HTTP/1.0, so the
+             * upstream server must not use chunked encoding.
+             */
+            success = NS_FALSE;
+        }
+    } else if (contentLength >= 0) {
+        taskPtr->bodyType = RP_BODY_LENGTH;
+        taskPtr->bodyRemaining = contentLength;
+    } else {
+        taskPtr->bodyType = RP_BODY_CLOSE;
+        taskPtr->clientKeep = NS_FALSE;
+        upstreamClose = NS_TRUE;
+    }
+    taskPtr->upstreamKeep = !upstreamClose;
+
+    if (success) {
+        /*
+         * Second pass: queue the head for the client without the
+         * hop-by-hop header fields of the upstream connection.
+         */
+        lineEnd = ns_memmem(head, length, "\r\n", 2u);
+        p = memchr(head, INTCHAR(' '), (size_t)(lineEnd - head));
+        if (p == NULL) {
+            Tcl_DStringFree(&ds);
+            return NS_FALSE;
+        }
+        Ns_DStringPrintf(&taskPtr->out, "HTTP/1.%d", taskPtr->http10 ? 0 : 1);
+        Tcl_DStringAppend(&taskPtr->out, p, (TCL_SIZE_T)(lineEnd + 2 - p));
+
+        for (p = lineEnd + 2; p < end; p = lineEnd + 2) {
+            const char *colon;
+            char        key[64];
+            size_t      keyLength;
+
+            lineEnd = ns_memmem(p, (size_t)(end - p) + 2u, "\r\n", 2u);
+            colon = memchr(p, INTCHAR(':'), (size_t)(lineEnd - p));
+            keyLength = (size_t)(colon - p);
+            if (keyLength < sizeof(key)) {
+                memcpy(key, p, keyLength);
+                key[keyLength] = '\0';
+                if (RpIsHopByHop(key, ds.string)
+                    && !(status == 101 && strcasecmp(key, "upgrade") == 0)
+                    && !(strcasecmp(key, "transfer-encoding") == 0 && chunked)
+                    && strcasecmp(key, "content-length") != 0) {
+                    continue;
+                }
+            }
+            Tcl_DStringAppend(&taskPtr->out, p, (TCL_SIZE_T)(lineEnd + 2 - p));
+        }
+        if (status == 101) {
+            Tcl_DStringAppend(&taskPtr->out, "Connection: Upgrade\r\n", 21);
+            taskPtr->state = RP_STATE_TUNNEL;
+            taskPtr->deadline.sec = 0;
+            taskPtr->deadline.usec = 0;
+        } else {
+            if (taskPtr->http10 && taskPtr->clientKeep) {
+                Tcl_DStringAppend(&taskPtr->out, "Connection: keep-alive\r\n", 24);
+            } else if (!taskPtr->http10 && !taskPtr->clientKeep) {
+                Tcl_DStringAppend(&taskPtr->out, "Connection: close\r\n", 19);
+            }
+            taskPtr->state = RP_STATE_BODY;
+            taskPtr->bodyDone = (taskPtr->bodyType == RP_BODY_NONE
+                                 || (taskPtr->bodyType == RP_BODY_LENGTH && taskPtr->bodyRemaining == 0));
+        }
+        Tcl_DStringAppend(&taskPtr->out, "\r\n", 2);
+        taskPtr->headSent = NS_TRUE;
+    }
+    Tcl_DStringFree(&ds);
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpReadBody --
+ *
+ *      Read the next part of the response body from the upstream
+ *      server. Only called when all data for the client was sent, so
+ *      slow clients throttle the upstream connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Queues data for the client, might close the upstream
+ *      connection.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpReadBody(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    char    buffer[RP_BUFFER_SIZE];
+    ssize_t nRead;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    if (taskPtr->bodyDone) {
+        return;
+    }
+    nRead = ns_recv(taskPtr->sock, buffer, sizeof(buffer), 0);
+    if (nRead > 0) {
+        taskPtr->upstreamPtr->stats.received += (Tcl_WideInt)nRead;
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+        RpBodyData(taskPtr, buffer, (size_t)nRead);
+
+    } else if (nRead == 0 || !RP_WOULDBLOCK(ns_sockerrno)) {
+        taskPtr->upstreamKeep = NS_FALSE;
+        if (taskPtr->bodyType == RP_BODY_CLOSE && nRead == 0) {
+            taskPtr->bodyDone = NS_TRUE;
+        } else {
+            Ns_Log(Warning, "revproxy: %s: incomplete response body from upstream",
+                   taskPtr->upstreamPtr->name);
+            taskPtr->upstreamPtr->stats.errors++;
+            taskPtr->clientKeep = NS_FALSE;
+            taskPtr->state = RP_STATE_FLUSH;
+        }
+        ns_sockclose(taskPtr->sock);
+        taskPtr->sock = NS_INVALID_SOCKET;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpBodyData --
+ *
+ *      Queue response body data for the client, keeping track of the
+ *      end of the body according to its framing. Data beyond the end
+ *      of the body is discarded, and the upstream connection is not
+ *      reused in this case.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Appends to the output buffer, might set bodyDone.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpBodyData(RpTask *taskPtr, const char *data, size_t length)
+{
+    size_t use = length;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(data != NULL);
+
+    switch (taskPtr->bodyType) {
+    case RP_BODY_NONE:
+        use = 0u;
+        break;
+
+    case RP_BODY_LENGTH:
+        if ((Tcl_WideInt)use > taskPtr->bodyRemaining) {
+            use = (size_t)taskPtr->bodyRemaining;
+        }
+        taskPtr->bodyRemaining -= (Tcl_WideInt)use;
+        if (taskPtr->bodyRemaining == 0) {
+            taskPtr->bodyDone = NS_TRUE;
+        }
+        break;
+
+    case RP_BODY_CHUNKED:
+        use = RpChunkScan(taskPtr, data, length);
+        break;
+
+    case RP_BODY_CLOSE:
+        break;
+    }
+
+    if (use < length) {
+        Ns_Log(Warning, "revproxy: %s: discard %" PRIuz " bytes after response body",
+               taskPtr->upstreamPtr->name, length - use);
+        taskPtr->upstreamKeep = NS_FALSE;
+    }
+    if (use > 0u) {
+        Tcl_DStringAppend(&taskPtr->out, data, (TCL_SIZE_T)use);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpChunkScan --
+ *
+ *      Incremental scanner for chunked response bodies. The data is
+ *      relayed unmodified to the client; the scanner determines just
+ *      where the body ends.
+ *
+ * Results:
+ *      Number of bytes belonging to the body.
+ *
+ * Side effects:
+ *      Updates the chunk state; sets bodyDone after the last chunk.
+ *      Invalid chunk framing disables reuse of both connections.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+RpChunkScan(RpTask *taskPtr, const char *data, size_t length)
+{
+    size_t i = 0u;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(data != NULL);
+
+    while (i < length && taskPtr->chunkState != RP_CHUNK_DONE) {
+        char c = data[i];
+
+        switch (taskPtr->chunkState) {
+        case RP_CHUNK_SIZE:
+            if (CHARTYPE(xdigit, c) != 0) {
+                int digit = (c <= '9') ? (c - '0') : ((c | 0x20) - 'a' + 10);
+
+                if (taskPtr->chunkRemaining > (LLONG_MAX >> 4)) {
+                    goto invalid;
+                }
+                taskPtr->chunkRemaining = taskPtr->chunkRemaining * 16 + digit;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                taskPtr->chunkState = RP_CHUNK_EXT;
+            } else if (c == '\n') {
+                taskPtr->chunkLineLength = 0u;
+                taskPtr->chunkState = (taskPtr->chunkRemaining == 0) ? RP_CHUNK_TRAILER : RP_CHUNK_DATA;
+            } else if (c != '\r') {
+                goto invalid;
+            }
+            i++;
+            break;
+
+        case RP_CHUNK_EXT:
+            if (c == '\n') {
+                taskPtr->chunkLineLength = 0u;
+                taskPtr->chunkState = (taskPtr->chunkRemaining == 0) ? RP_CHUNK_TRAILER : RP_CHUNK_DATA;
+            }
+            i++;
+            break;
+
+        case RP_CHUNK_DATA:
+            {
+                size_t n = length - i;
+
+                if ((Tcl_WideInt)n > taskPtr->chunkRemaining) {
+                    n = (size_t)taskPtr->chunkRemaining;
+                }
+                taskPtr->chunkRemaining -= (Tcl_WideInt)n;
+                i += n;
+                if (taskPtr->chunkRemaining == 0) {
+                    taskPtr->chunkState = RP_CHUNK_DATA_END;
+                }
+            }
+            break;
+
+        case RP_CHUNK_DATA_END:
+            if (c == '\n') {
+                taskPtr->chunkState = RP_CHUNK_SIZE;
+            } else if (c != '\r') {
+                goto invalid;
+            }
+            i++;
+            break;
+
+        case RP_CHUNK_TRAILER:
+            if (c == '\n') {
+                if (taskPtr->chunkLineLength == 0u) {
+                    taskPtr->chunkState = RP_CHUNK_DONE;
+                    taskPtr->bodyDone = NS_TRUE;
+                }
+                taskPtr->chunkLineLength = 0u;
+            } else if (c != '\r') {
+                taskPtr->chunkLineLength++;
+            }
+            i++;
+            break;
+
+        case RP_CHUNK_DONE:
+            break;
+        }
+    }
+    return i;
+
+ invalid:
+    /*
+     * The end of the body can't be determined, relay everything until
+     * the upstream closes the connection.
+     */
+    Ns_Log(Warning, "revproxy: %s: invalid chunked encoding in response",
+           taskPtr->upstreamPtr->name);
+    taskPtr->bodyType = RP_BODY_CLOSE;
+    taskPtr->upstreamKeep = NS_FALSE;
+    taskPtr->clientKeep = NS_FALSE;
+    return length;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpTunnel --
+ *
+ *      Relay data in both directions after the upstream server
+ *      switched protocols (e.g. for WebSockets). The tunnel ends when
+ *      one side closes the connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      I/O on both sockets; switches to RP_STATE_FLUSH at the end.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpTunnel(RpTask *taskPtr, short upEvents, short clientEvents)
+{
+    char    buffer[RP_BUFFER_SIZE];
+    ssize_t n;
+    bool    closed = NS_FALSE;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+
+    if ((upEvents & (POLLIN|POLLHUP|POLLERR)) != 0 && (size_t)taskPtr->out.length == taskPtr->outOffset) {
+        n = ns_recv(taskPtr->sock, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            taskPtr->upstreamPtr->stats.received += (Tcl_WideInt)n;
+            Tcl_DStringAppend(&taskPtr->out, buffer, (TCL_SIZE_T)n);
+        } else if (n == 0 || !RP_WOULDBLOCK(ns_sockerrno)) {
+            closed = NS_TRUE;
+        }
+    }
+
+    if ((clientEvents & (POLLIN|POLLHUP|POLLERR)) != 0) {
+        struct iovec iov;
+
+        iov.iov_base = buffer;
+        iov.iov_len = sizeof(buffer);
+        n = NsDriverRecv(taskPtr->sockPtr, &iov, 1, NULL);
+        if (n > 0) {
+            Tcl_DStringAppend(&taskPtr->in, buffer, (TCL_SIZE_T)n);
+        } else if (taskPtr->sockPtr->recvSockState != NS_SOCK_AGAIN) {
+            taskPtr->clientEof = NS_TRUE;
+            closed = NS_TRUE;
+        }
+    }
+
+    if (!closed && (size_t)taskPtr->in.length > taskPtr->inOffset) {
+        n = ns_send(taskPtr->sock, taskPtr->in.string + taskPtr->inOffset,
+                    (size_t)taskPtr->in.length - taskPtr->inOffset, 0);
+        if (n > 0) {
+            taskPtr->upstreamPtr->stats.sent += (Tcl_WideInt)n;
+            taskPtr->inOffset += (size_t)n;
+            if (taskPtr->inOffset == (size_t)taskPtr->in.length) {
+                Tcl_DStringSetLength(&taskPtr->in, 0);
+                taskPtr->inOffset = 0u;
+            }
+        } else if (n < 0 && !RP_WOULDBLOCK(ns_sockerrno)) {
+            closed = NS_TRUE;
+        }
+    }
+
+    if (closed) {
+        taskPtr->state = RP_STATE_FLUSH;
+        taskPtr->clientKeep = NS_FALSE;
+        taskPtr->upstreamKeep = NS_FALSE;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpUpstreamFailed --
+ *
+ *      Handle a failure of the upstream connection. When a reused
+ *      pooled connection failed before any response data was
+ *      received, an idempotent request is retried once on a fresh
+ *      connection. Otherwise, the client receives a "502 Bad Gateway"
+ *      or "504 Gateway Timeout" response, or the connection is closed
+ *      when the response head was already queued.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Closes the upstream connection, updates statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpUpstreamFailed(RpTask *taskPtr, bool timeout, const char *reason, const Ns_Time *nowPtr)
+{
+    RpUpstream *upstreamPtr;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(reason != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    upstreamPtr = taskPtr->upstreamPtr;
+    if (taskPtr->sock != NS_INVALID_SOCKET) {
+        ns_sockclose(taskPtr->sock);
+        taskPtr->sock = NS_INVALID_SOCKET;
+    }
+    taskPtr->upstreamKeep = NS_FALSE;
+
+    if (taskPtr->reused && !taskPtr->received && !taskPtr->retried && taskPtr->idempotent) {
+        Ns_Log(Debug, "revproxy: %s: pooled connection failed (%s), retry", upstreamPtr->name, reason);
+        upstreamPtr->stats.retries++;
+        taskPtr->retried = NS_TRUE;
+        RpConnect(taskPtr, nowPtr);
+
+    } else {
+        Ns_Log(Warning, "revproxy: %s: %s", upstreamPtr->name, reason);
+        if (timeout) {
+            upstreamPtr->stats.timeouts++;
+            taskPtr->result = NS_UPSTREAM_TIMEOUT;
+        } else {
+            upstreamPtr->stats.errors++;
+            taskPtr->result = NS_UPSTREAM_ERROR;
+        }
+        if (!taskPtr->headSent) {
+            int         status = timeout ? 504 : 502;
+            const char *title = timeout ? "Gateway Timeout" : "Bad Gateway";
+            char        body[200];
+            int         bodyLength;
+
+            bodyLength = snprintf(body, sizeof(body),
+                                  "<html><head><title>%s</title></head>"
+                                  "<body><h2>%s</h2></body></html>\n", title, title);
+            Tcl_DStringSetLength(&taskPtr->out, 0);
+            taskPtr->outOffset = 0u;
+            Ns_DStringPrintf(&taskPtr->out,
+                             "HTTP/1.%d %d %s\r\n"
+                             "Content-Type: text/html\r\n"
+                             "Content-Length: %d\r\n"
+                             "Connection: close\r\n\r\n%s",
+                             taskPtr->http10 ? 0 : 1, status, title, bodyLength, body);
+            taskPtr->status = status;
+            taskPtr->headSent = NS_TRUE;
+        }
+        taskPtr->clientKeep = NS_FALSE;
+        taskPtr->state = RP_STATE_FLUSH;
+        RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpClientFlush --
+ *
+ *      Try to send the buffered data to the client without blocking.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the output buffer; on send errors, the task is
+ *      switched to RP_STATE_FLUSH with an empty buffer, such that it
+ *      is finished.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpClientFlush(RpTask *taskPtr, const Ns_Time *nowPtr)
+{
+    struct iovec iov;
+    ssize_t      sent;
+    size_t       toSend;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    toSend = (size_t)taskPtr->out.length - taskPtr->outOffset;
+    if (taskPtr->inflight > 0u && taskPtr->inflight <= toSend) {
+        /*
+         * OpenSSL requires to repeat a rejected write with the same
+         * length.
+         */
+        toSend = taskPtr->inflight;
+    }
+    iov.iov_base = taskPtr->out.string + taskPtr->outOffset;
+    iov.iov_len = toSend;
+
+    sent = NsDriverSend(taskPtr->sockPtr, &iov, 1, 0u);
+    if (sent < 0) {
+        Ns_Log(Debug, "revproxy: %s: send to client failed", taskPtr->upstreamPtr->name);
+        Tcl_DStringSetLength(&taskPtr->out, 0);
+        taskPtr->outOffset = 0u;
+        taskPtr->clientKeep = NS_FALSE;
+        if (taskPtr->state != RP_STATE_BODY || !taskPtr->bodyDone) {
+            taskPtr->upstreamKeep = NS_FALSE;
+        }
+        taskPtr->state = RP_STATE_FLUSH;
+
+    } else if (sent == 0) {
+        if ((taskPtr->sockPtr->flags & NS_CONN_SSL_WANT_WRITE) != 0u) {
+            taskPtr->inflight = toSend;
+        }
+    } else {
+        taskPtr->inflight = 0u;
+        taskPtr->outOffset += (size_t)sent;
+        if (taskPtr->state != RP_STATE_TUNNEL) {
+            RpSetDeadline(taskPtr, nowPtr, &taskPtr->timeout);
+        }
+        if (taskPtr->outOffset == (size_t)taskPtr->out.length) {
+            Tcl_DStringSetLength(&taskPtr->out, 0);
+            taskPtr->outOffset = 0u;
+        } else if (taskPtr->outOffset > RP_COMPACT_THRESHOLD) {
+            size_t remaining = (size_t)taskPtr->out.length - taskPtr->outOffset;
+
+            memmove(taskPtr->out.string, taskPtr->out.string + taskPtr->outOffset, remaining);
+            Tcl_DStringSetLength(&taskPtr->out, (TCL_SIZE_T)remaining);
+            taskPtr->outOffset = 0u;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpUpstreamRelease --
+ *
+ *      Return the upstream connection of a finished task to the pool
+ *      of its upstream, or close it. Must be called with rp.lock
+ *      held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Might close the upstream socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpUpstreamRelease(RpTask *taskPtr)
+{
+    RpUpstream *upstreamPtr;
+
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+
+    upstreamPtr = taskPtr->upstreamPtr;
+    if (taskPtr->sock != NS_INVALID_SOCKET) {
+        if (taskPtr->upstreamKeep
+            && taskPtr->bodyDone
+            && taskPtr->state == RP_STATE_BODY
+            && upstreamPtr->nIdle < upstreamPtr->poolSize
+            && !rp.stopping) {
+            RpPooled *pooledPtr = ns_calloc(1u, sizeof(RpPooled));
+
+            pooledPtr->sock = taskPtr->sock;
+            Ns_GetTime(&pooledPtr->expires);
+            Ns_IncrTime(&pooledPtr->expires, upstreamPtr->idleTimeout.sec, upstreamPtr->idleTimeout.usec);
+            pooledPtr->nextPtr = upstreamPtr->idlePtr;
+            upstreamPtr->idlePtr = pooledPtr;
+            upstreamPtr->nIdle++;
+        } else {
+            ns_sockclose(taskPtr->sock);
+        }
+        taskPtr->sock = NS_INVALID_SOCKET;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpTaskFree --
+ *
+ *      Finish a task: release the upstream connection, return the
+ *      client socket to the driver (for keep-alive or closing), and
+ *      free the task. The task must be unlinked from the task list.
+ *      Must be called with rp.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Closes sockets.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpTaskFree(RpTask *taskPtr)
+{
+    NS_NONNULL_ASSERT(taskPtr != NULL);
+
+    RpUpstreamRelease(taskPtr);
+    taskPtr->upstreamPtr->stats.active--;
+    if (taskPtr->memberPtr != NULL) {
+        NsUpstreamRelease(taskPtr->memberPtr, taskPtr->result);
+    }
+
+    Ns_Log(Debug, "revproxy: %s: request finished with status %d, keep %d",
+           taskPtr->upstreamPtr->name, taskPtr->status, taskPtr->clientKeep);
+    NsSockClose(taskPtr->sockPtr, (int)(taskPtr->clientKeep && taskPtr->state == RP_STATE_BODY));
+
+    Tcl_DStringFree(&taskPtr->request);
+    Tcl_DStringFree(&taskPtr->head);
+    Tcl_DStringFree(&taskPtr->out);
+    Tcl_DStringFree(&taskPtr->in);
+    ns_free(taskPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpUpstreamGet --
+ *
+ *      Return the upstream for the specified host and port, create it
+ *      if necessary. The pool is shared by all routes to the same host
+ *      and port, therefore the pool parameters of the route are only
+ *      applied when the upstream is created, i.e., the first route
+ *      wins. Must be called with rp.lock held.
+ *
+ * Results:
+ *      Upstream.
+ *
+ * Side effects:
+ *      Might create an upstream.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static RpUpstream *
+RpUpstreamGet(const char *host, unsigned short port, const RpRoute *routePtr)
+{
+    Tcl_HashEntry *hPtr;
+    RpUpstream    *upstreamPtr;
+    Tcl_DString    ds;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(host != NULL);
+    NS_NONNULL_ASSERT(routePtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    (void) Ns_HttpLocationString(&ds, NULL, host, port, 0u);
+    hPtr = Tcl_CreateHashEntry(&rp.upstreams, ds.string, &isNew);
+    if (isNew != 0) {
+        upstreamPtr = ns_calloc(1u, sizeof(RpUpstream));
+        upstreamPtr->name = ns_strdup(ds.string);
+        upstreamPtr->host = ns_strdup(host);
+        upstreamPtr->port = port;
+        upstreamPtr->poolSize = (routePtr->poolSize >= 0)
+            ? routePtr->poolSize : RP_DEFAULT_POOLSIZE;
+        if (routePtr->idleTimeout.sec >= 0) {
+            upstreamPtr->idleTimeout = routePtr->idleTimeout;
+        } else {
+            upstreamPtr->idleTimeout.sec = RP_DEFAULT_IDLETIMEOUT;
+        }
+        upstreamPtr->nextPtr = rp.firstUpstreamPtr;
+        rp.firstUpstreamPtr = upstreamPtr;
+        Tcl_SetHashValue(hPtr, upstreamPtr);
+    } else {
+        upstreamPtr = Tcl_GetHashValue(hPtr);
+    }
+    Tcl_DStringFree(&ds);
+
+    return upstreamPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpHasToken --
+ *
+ *      Check whether a comma-separated header field value contains
+ *      the specified token (case-insensitive).
+ *
+ * Results:
+ *      Boolean.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RpHasToken(const char *value, const char *token)
+{
+    bool   found = NS_FALSE;
+    size_t tokenLength;
+
+    NS_NONNULL_ASSERT(token != NULL);
+
+    if (value != NULL) {
+        tokenLength = strlen(token);
+        while (*value != '\0' && !found) {
+            const char *end;
+
+            while (*value == ',' || CHARTYPE(space, *value) != 0) {
+                value++;
+            }
+            end = value;
+            while (*end != '\0' && *end != ',') {
+                end++;
+            }
+            while (end > value && CHARTYPE(space, *(end - 1)) != 0) {
+                end--;
+            }
+            found = ((size_t)(end - value) == tokenLength && strncasecmp(value, token, tokenLength) == 0);
+            while (*end != '\0' && *end != ',') {
+                end++;
+            }
+            value = end;
+        }
+    }
+    return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpIsHopByHop --
+ *
+ *      Check whether a header field is hop-by-hop, either by
+ *      definition or since it is named in the "connection" header
+ *      field.
+ *
+ * Results:
+ *      Boolean.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+RpIsHopByHop(const char *key, const char *connection)
+{
+    bool   result;
+    size_t i;
+
+    NS_NONNULL_ASSERT(key != NULL);
+
+    result = RpHasToken(connection, key);
+    for (i = 0u; !result && hopByHopFields[i] != NULL; i++) {
+        result = (strcasecmp(key, hopByHopFields[i]) == 0);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpAppendForwarded --
+ *
+ *      Append a value to a list-valued header field (such as
+ *      "x-forwarded-for" or "via") or add the field.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpAppendForwarded(Ns_Set *set, const char *key, const char *value, const char *sep)
+{
+    const char *oldValue;
+
+    NS_NONNULL_ASSERT(set != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(value != NULL);
+    NS_NONNULL_ASSERT(sep != NULL);
+
+    oldValue = Ns_SetIGet(set, key);
+    if (oldValue != NULL && *oldValue != '\0') {
+        Tcl_DString ds;
+
+        Tcl_DStringInit(&ds);
+        Ns_DStringVarAppend(&ds, oldValue, sep, value, NS_SENTINEL);
+        Ns_SetIUpdateSz(set, key, TCL_INDEX_NONE, ds.string, ds.length);
+        Tcl_DStringFree(&ds);
+    } else {
+        Ns_SetIUpdateSz(set, key, TCL_INDEX_NONE, value, TCL_INDEX_NONE);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpRequestProc --
+ *
+ *      Request procedure registered via "ns_register_revproxy". Build
+ *      the upstream request, run the optional header callback, and
+ *      pass the client socket to the proxy thread.
+ *
+ * Results:
+ *      NS_OK or the result of an error response.
+ *
+ * Side effects:
+ *      The connection is detached from the connection thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+RpRequestProc(const void *arg, Ns_Conn *conn)
+{
+    const RpRoute    *routePtr = arg;
+    Conn             *connPtr = (Conn *)conn;
+    const Ns_Request *request = &connPtr->request;
+    Ns_Set           *headers;
+    const char       *value;
+    RpTask           *taskPtr;
+    Tcl_DString       connectionDs, upgradeDs;
+    Ns_ReturnCode     status = NS_OK;
+    bool              isUpgrade;
+    size_t            i;
+    const char       *host;
+    unsigned short    port;
+
+    if (connPtr->sockPtr == NULL || (connPtr->flags & NS_CONN_SENTHDRS) != 0u) {
+        return NS_ERROR;
+    }
+
+    /*
+     * Copy the request header fields without the hop-by-hop fields of
+     * the client connection. A protocol upgrade (e.g. WebSocket) is
+     * forwarded.
+     */
+    headers = Ns_SetCopy(Ns_ConnHeaders(conn));
+    Tcl_DStringInit(&connectionDs);
+    Tcl_DStringInit(&upgradeDs);
+    value = Ns_SetIGet(headers, "connection");
+    if (value != NULL) {
+        Tcl_DStringAppend(&connectionDs, value, TCL_INDEX_NONE);
+    }
+    value = Ns_SetIGet(headers, "upgrade");
+    isUpgrade = (value != NULL && RpHasToken(connectionDs.string, "upgrade"));
+    if (isUpgrade) {
+        Tcl_DStringAppend(&upgradeDs, value, TCL_INDEX_NONE);
+    }
+    for (i = 0u; i < Ns_SetSize(headers); ) {
+        if (RpIsHopByHop(Ns_SetKey(headers, i), connectionDs.string)) {
+            (void) Ns_SetDelete(headers, (ssize_t)i);
+        } else {
+            i++;
+        }
+    }
+
+    RpAppendForwarded(headers, "x-forwarded-for", Ns_ConnConfiguredPeerAddr(conn), ",");
+    {
+        char via[256];
+
+        snprintf(via, sizeof(via), "%.1f %s-%d", request->version, Ns_ConnServer(conn), Ns_InfoPid());
+        RpAppendForwarded(headers, "via", via, ",");
+    }
+    Ns_SetIUpdateSz(headers, "x-forwarded-proto", TCL_INDEX_NONE, connPtr->drvPtr->protocol, TCL_INDEX_NONE);
+    if (STREQ(connPtr->drvPtr->protocol, "https")) {
+        Ns_SetIUpdateSz(headers, "x-ssl-request", TCL_INDEX_NONE, "1", 1);
+    }
+    if (routePtr->targetHost != NULL) {
+        Ns_SetIUpdateSz(headers, "host", TCL_INDEX_NONE, routePtr->targetHost, TCL_INDEX_NONE);
+    }
+
+    /*
+     * Run the optional header callback, which might modify the header
+     * fields in the provided set.
+     */
+    if (routePtr->cbPtr != NULL) {
+        Tcl_Interp *interp = Ns_GetConnInterp(conn);
+
+        if (Ns_TclEnterSet(interp, headers, NS_TCL_SET_STATIC) != TCL_OK) {
+            status = NS_ERROR;
+        } else {
+            char *setId = ns_strdup(Tcl_GetStringResult(interp));
+
+            if (Ns_TclEvalCallback(interp, routePtr->cbPtr, NULL, setId, NS_SENTINEL) != TCL_OK) {
+                (void) Ns_TclLogErrorInfo(interp, "\n(context: revproxy header callback)");
+                status = NS_ERROR;
+            }
+            (void) Ns_TclFreeSet(interp, setId);
+            ns_free(setId);
+        }
+        if (status != NS_OK) {
+            Ns_SetFree(headers);
+            Tcl_DStringFree(&connectionDs);
+            Tcl_DStringFree(&upgradeDs);
+            return Ns_ConnReturnInternalError(conn);
+        }
+    }
+
+    taskPtr = ns_calloc(1u, sizeof(RpTask));
+    taskPtr->upstreamPtr = routePtr->upstreamPtr;
+    if (routePtr->groupPtr != NULL) {
+        /*
+         * Select the member of the upstream group; the hash policy
+         * uses the header fields of the client request.
+         */
+        taskPtr->memberPtr = NsUpstreamSelect(routePtr->groupPtr, Ns_ConnHeaders(conn), NS_TRUE);
+        taskPtr->result = NS_UPSTREAM_OK;
+    }
+    taskPtr->sock = NS_INVALID_SOCKET;
+    taskPtr->state = RP_STATE_START;
+    taskPtr->connectTimeout = routePtr->connectTimeout;
+    taskPtr->timeout = routePtr->timeout;
+    taskPtr->http10 = (request->version < 1.1);
+    taskPtr->isHead = STREQ(request->method, "HEAD");
+    taskPtr->idempotent = (taskPtr->isHead
+                           || STREQ(request->method, "GET")
+                           || STREQ(request->method, "OPTIONS")
+                           || STREQ(request->method, "PUT")
+                           || STREQ(request->method, "DELETE")
+                           || STREQ(request->method, "TRACE"));
+    taskPtr->clientKeep = ((connPtr->drvPtr->keepwait.sec > 0 || connPtr->drvPtr->keepwait.usec > 0)
+                           && !isUpgrade
+                           && (taskPtr->http10
+                               ? RpHasToken(connectionDs.string, "keep-alive")
+                               : !RpHasToken(connectionDs.string, "close")));
+    Ns_GetTime(&taskPtr->startTime);
+    Tcl_DStringInit(&taskPtr->request);
+    Tcl_DStringInit(&taskPtr->head);
+    Tcl_DStringInit(&taskPtr->out);
+    Tcl_DStringInit(&taskPtr->in);
+
+    /*
+     * Request line: the path of the target followed by the URL of the
+     * request, encoded segment by segment.
+     */
+    Ns_DStringVarAppend(&taskPtr->request, request->method, " ", routePtr->path, NS_SENTINEL);
+    {
+        const char *p = request->url, *segment;
+
+        while (*p == '/') {
+            p++;
+        }
+        for (segment = p; ; p++) {
+            if (*p == '/' || *p == '\0') {
+                Tcl_DString segmentDs;
+
+                Tcl_DStringInit(&segmentDs);
+                Tcl_DStringAppend(&segmentDs, segment, (TCL_SIZE_T)(p - segment));
+                Tcl_DStringAppend(&taskPtr->request, "/", 1);
+                (void) Ns_UrlPathEncode(&taskPtr->request, segmentDs.string, NULL);
+                Tcl_DStringFree(&segmentDs);
+                if (*p == '\0') {
+                    break;
+                }
+                segment = p + 1;
+            }
+        }
+    }
+    if (request->query != NULL) {
+        Ns_DStringVarAppend(&taskPtr->request, "?", request->query, NS_SENTINEL);
+    }
+    Tcl_DStringAppend(&taskPtr->request, taskPtr->http10 ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n", 11);
+
+    for (i = 0u; i < Ns_SetSize(headers); i++) {
+        Ns_DStringVarAppend(&taskPtr->request, Ns_SetKey(headers, i), ": ", Ns_SetValue(headers, i), "\r\n",
+                            NS_SENTINEL);
+    }
+    if (isUpgrade) {
+        Ns_DStringVarAppend(&taskPtr->request, "Connection: Upgrade\r\nUpgrade: ", upgradeDs.string, "\r\n",
+                            NS_SENTINEL);
+    }
+
+    /*
+     * Request body: the driver has received the complete body, either
+     * in memory or in a spool file of the socket. Both stay valid
+     * until the socket is closed by the proxy thread.
+     */
+    taskPtr->contentLength = Ns_ConnContentSize(conn);
+    taskPtr->content = Ns_ConnContent(conn);
+    taskPtr->contentFd = Ns_ConnContentFd(conn);
+    if (taskPtr->content == NULL && taskPtr->contentFd <= 0) {
+        taskPtr->contentLength = 0u;
+    }
+    if (taskPtr->contentLength > 0u || connPtr->reqPtr->expectedLength > 0u
+        || Ns_SetIGet(Ns_ConnHeaders(conn), "content-length") != NULL) {
+        Ns_DStringPrintf(&taskPtr->request, "Content-Length: %" PRIuz "\r\n", taskPtr->contentLength);
+    }
+    Tcl_DStringAppend(&taskPtr->request, "\r\n", 2);
+
+    Ns_SetFree(headers);
+    Tcl_DStringFree(&connectionDs);
+    Tcl_DStringFree(&upgradeDs);
+
+    /*
+     * Take over the socket from the connection. Mark the connection as
+     * closed, such that no further response is attempted.
+     */
+    taskPtr->sockPtr = connPtr->sockPtr;
+    connPtr->sockPtr = NULL;
+    connPtr->flags |= (NS_CONN_CLOSED|NS_CONN_SENTHDRS);
+
+    /*
+     * Resolve the upstream address here, since a slow name lookup in
+     * the single proxy thread would stall all proxied traffic. The host
+     * and port of upstreams and group members are immutable.
+     */
+    if (taskPtr->memberPtr != NULL) {
+        host = taskPtr->memberPtr->host;
+        port = taskPtr->memberPtr->port;
+    } else {
+        host = routePtr->upstreamPtr->host;
+        port = routePtr->upstreamPtr->port;
+    }
+    taskPtr->resolved = (Ns_GetSockAddr((struct sockaddr *)&taskPtr->sa, host, port) == NS_OK);
+
+    Ns_MutexLock(&rp.lock);
+    if (taskPtr->memberPtr != NULL) {
+        taskPtr->upstreamPtr = RpUpstreamGet(taskPtr->memberPtr->host, taskPtr->memberPtr->port, routePtr);
+    }
+    taskPtr->upstreamPtr->stats.requests++;
+    taskPtr->upstreamPtr->stats.active++;
+    taskPtr->nextPtr = rp.firstTaskPtr;
+    rp.firstTaskPtr = taskPtr;
+    RpStartThread();
+    RpTrigger();
+    Ns_MutexUnlock(&rp.lock);
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpArgProc --
+ *
+ *      Append the target of a registered reverse proxy to the
+ *      provided DString, e.g. for "ns_server requestprocs".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpArgProc(Tcl_DString *dsPtr, const void *arg)
+{
+    const RpRoute *routePtr = arg;
+
+    if (routePtr->groupPtr != NULL) {
+        Tcl_DStringAppendElement(dsPtr, "-upstream");
+        Tcl_DStringAppendElement(dsPtr, NsUpstreamGroupName(routePtr->groupPtr));
+    }
+    Tcl_DStringAppendElement(dsPtr, routePtr->target);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RpRouteFree --
+ *
+ *      Free the client data of a registered reverse proxy. The
+ *      upstream is kept, since it is shared.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RpRouteFree(void *arg)
+{
+    RpRoute *routePtr = arg;
+
+    if (routePtr->cbPtr != NULL) {
+        Ns_TclFreeCallback(routePtr->cbPtr);
+    }
+    ns_free(routePtr->target);
+    ns_free(routePtr->path);
+    ns_free(routePtr->targetHost);
+    ns_free(routePtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclRegisterRevProxyObjCmd --
+ *
+ *      Implements "ns_register_revproxy". Registers a native reverse
+ *      proxy for the specified method and URL, forwarding requests to
+ *      an HTTP upstream server.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      See docs.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclRegisterRevProxyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp        *itPtr = clientData;
+    char                  *method, *url, *target, *targetHost = NULL, *upstreamName = NULL;
+    int                    noinherit = 0, poolSize = -1, result = TCL_OK;
+    Tcl_Obj               *callbackObj = NULL;
+    Ns_Time                connectTimeout = {1, 0}, timeout = {60, 0}, idleTimeout = {-1, 0};
+    Ns_Time               *connectTimeoutPtr = &connectTimeout, *timeoutPtr = &timeout,
+                          *idleTimeoutPtr = &idleTimeout;
+    NsUrlSpaceContextSpec *specPtr = NULL;
+    Ns_ObjvValueRange      poolRange = {0, INT_MAX};
+    Ns_ObjvSpec            opts[] = {
+        {"-connecttimeout", Ns_ObjvTime,         &connectTimeoutPtr, NULL},
+        {"-constraints",    Ns_ObjvUrlspaceSpec, &specPtr,           NULL},
+        {"-headercallback", Ns_ObjvObj,          &callbackObj,       NULL},
+        {"-idletimeout",    Ns_ObjvTime,         &idleTimeoutPtr,    NULL},
+        {"-noinherit",      Ns_ObjvBool,         &noinherit,         INT2PTR(NS_TRUE)},
+        {"-poolsize",       Ns_ObjvInt,          &poolSize,          &poolRange},
+        {"-targethost",     Ns_ObjvString,       &targetHost,        NULL},
+        {"-timeout",        Ns_ObjvTime,         &timeoutPtr,        NULL},
+        {"-upstream",       Ns_ObjvString,       &upstreamName,      NULL},
+        {"--",              Ns_ObjvBreak,        NULL,               NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec            args[] = {
+        {"method", Ns_ObjvString, &method, NULL},
+        {"url",    Ns_ObjvString, &url,    NULL},
+        {"target", Ns_ObjvString, &target, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsUpstreamGroup *groupPtr = NULL;
+        Ns_URL           u;
+        const char      *errorMsg = NULL;
+        char            *targetCopy = ns_strdup(target);
+        Tcl_DString      ds;
+
+        Tcl_DStringInit(&ds);
+        memset(&u, 0, sizeof(u));
+
+        if (upstreamName != NULL) {
+            /*
+             * With an upstream group, the target is the path prefix on
+             * the members of the group.
+             */
+            groupPtr = NsUpstreamGroupGet(interp, upstreamName);
+            if (groupPtr == NULL) {
+                result = TCL_ERROR;
+
+            } else if (!NsUpstreamGroupHttpOnly(groupPtr)) {
+                Ns_TclPrintfResult(interp, "upstream group \"%s\": only http members are supported",
+                                   upstreamName);
+                result = TCL_ERROR;
+
+            } else if (*target != '/') {
+                Ns_TclPrintfResult(interp, "invalid target \"%s\": must be a path when used with -upstream",
+                                   target);
+                result = TCL_ERROR;
+
+            } else {
+                Tcl_DStringAppend(&ds, target, TCL_INDEX_NONE);
+            }
+
+        } else if (Ns_ParseUrl(targetCopy, NS_FALSE, &u, &errorMsg) != NS_OK
+                   || u.protocol == NULL || u.host == NULL) {
+            Ns_TclPrintfResult(interp, "invalid target \"%s\": %s", target,
+                               errorMsg != NULL ? errorMsg : "protocol and host required");
+            result = TCL_ERROR;
+
+        } else if (!STREQ(u.protocol, "http")) {
+            Ns_TclPrintfResult(interp, "invalid target \"%s\": only http targets are supported", target);
+            result = TCL_ERROR;
+
+        } else {
+            if (u.path != NULL && *u.path != '\0') {
+                Ns_DStringVarAppend(&ds, "/", u.path, NS_SENTINEL);
+            }
+            if (u.tail != NULL && *u.tail != '\0') {
+                Ns_DStringVarAppend(&ds, "/", u.tail, NS_SENTINEL);
+            }
+        }
+
+        if (result == TCL_OK) {
+            RpRoute     *routePtr;
+            unsigned int flags = 0u;
+
+            routePtr = ns_calloc(1u, sizeof(RpRoute));
+            routePtr->groupPtr = groupPtr;
+            routePtr->target = ns_strdup(target);
+            routePtr->targetHost = ns_strcopy(targetHost);
+            routePtr->connectTimeout = *connectTimeoutPtr;
+            routePtr->timeout = *timeoutPtr;
+            routePtr->idleTimeout = *idleTimeoutPtr;
+            routePtr->poolSize = poolSize;
+
+            /*
+             * Path prefix on the upstream server without trailing
+             * slash; the URL of the request is appended.
+             */
+            while (ds.length > 0 && ds.string[ds.length - 1] == '/') {
+                Tcl_DStringSetLength(&ds, ds.length - 1);
+            }
+            routePtr->path = Ns_DStringExport(&ds);
+
+            if (callbackObj != NULL) {
+                routePtr->cbPtr = Ns_TclNewCallback(interp, (ns_funcptr_t)RpRequestProc, callbackObj, 0, NULL);
+            }
+
+            if (groupPtr == NULL) {
+                unsigned short port = 80u;
+
+                if (u.port != NULL) {
+                    port = (unsigned short)strtol(u.port, NULL, 10);
+                }
+                Ns_MutexLock(&rp.lock);
+                routePtr->upstreamPtr = RpUpstreamGet(u.host, port, routePtr);
+                Ns_MutexUnlock(&rp.lock);
+            }
+
+            if (noinherit != 0) {
+                flags |= NS_OP_NOINHERIT;
+            }
+            result = Ns_RegisterRequest2(interp, itPtr->servPtr->server, method, url,
+                                         RpRequestProc, RpRouteFree, routePtr, flags, specPtr);
+        }
+        Tcl_DStringFree(&ds);
+        ns_free(targetCopy);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RevProxyStatsObjCmd --
+ *
+ *      Implements "ns_revproxy stats". Returns a dict with the
+ *      statistics of all upstream servers or of the specified one.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RevProxyStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    char        *name = NULL;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"?upstream", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const RpUpstream *upstreamPtr;
+        Tcl_Obj          *resultObj = Tcl_NewDictObj();
+
+        Ns_MutexLock(&rp.lock);
+        for (upstreamPtr = rp.firstUpstreamPtr; upstreamPtr != NULL; upstreamPtr = upstreamPtr->nextPtr) {
+            Tcl_Obj *dictObj, *latencyObj;
+            Ns_Time  avg = {0, 0};
+
+            if (name != NULL && !STREQ(name, upstreamPtr->name)) {
+                continue;
+            }
+            if (upstreamPtr->stats.responses > 0u) {
+                Tcl_WideInt us = ((Tcl_WideInt)upstreamPtr->stats.latencySum.sec * 1000000
+                                  + upstreamPtr->stats.latencySum.usec) / (Tcl_WideInt)upstreamPtr->stats.responses;
+                avg.sec = (time_t)(us / 1000000);
+                avg.usec = (long)(us % 1000000);
+            }
+            latencyObj = Tcl_NewDictObj();
+            (void) Tcl_DictObjPut(NULL, latencyObj, Tcl_NewStringObj("min", 3),
+                                  Ns_TclNewTimeObj(&upstreamPtr->stats.latencyMin));
+            (void) Tcl_DictObjPut(NULL, latencyObj, Tcl_NewStringObj("avg", 3), Ns_TclNewTimeObj(&avg));
+            (void) Tcl_DictObjPut(NULL, latencyObj, Tcl_NewStringObj("max", 3),
+                                  Ns_TclNewTimeObj(&upstreamPtr->stats.latencyMax));
+
+            dictObj = Tcl_NewDictObj();
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("requests", 8),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.requests));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("active", 6),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.active));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("responses", 9),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.responses));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("errors", 6),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.errors));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("timeouts", 8),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.timeouts));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("connects", 8),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.connects));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("reused", 6),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.reused));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("retries", 7),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->stats.retries));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("idle", 4),
+                                  Tcl_NewIntObj(upstreamPtr->nIdle));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("poolsize", 8),
+                                  Tcl_NewIntObj(upstreamPtr->poolSize));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("sent", 4),
+                                  Tcl_NewWideIntObj(upstreamPtr->stats.sent));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("received", 8),
+                                  Tcl_NewWideIntObj(upstreamPtr->stats.received));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("latency", 7), latencyObj);
+
+            (void) Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj(upstreamPtr->name, TCL_INDEX_NONE), dictObj);
+        }
+        Ns_MutexUnlock(&rp.lock);
+        Tcl_SetObjResult(interp, resultObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RevProxyUpstreamsObjCmd --
+ *
+ *      Implements "ns_revproxy upstreams". Returns the names of the
+ *      upstream servers used by registered reverse proxies.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RevProxyUpstreamsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const RpUpstream *upstreamPtr;
+        Tcl_Obj          *listObj = Tcl_NewListObj(0, NULL);
+
+        Ns_MutexLock(&rp.lock);
+        for (upstreamPtr = rp.firstUpstreamPtr; upstreamPtr != NULL; upstreamPtr = upstreamPtr->nextPtr) {
+            Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj(upstreamPtr->name, TCL_INDEX_NONE));
+        }
+        Ns_MutexUnlock(&rp.lock);
+        Tcl_SetObjResult(interp, listObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclRevProxyObjCmd --
+ *
+ *      Implements "ns_revproxy".
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Depends on subcommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclRevProxyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"stats",     RevProxyStatsObjCmd},
+        {"upstreams", RevProxyUpstreamsObjCmd},
+        {NULL, NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
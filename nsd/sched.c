@@ -13,32 +13,35 @@
  * sched.c --
  *
  *  Support for the background task and scheduled procedure interfaces.  The
- *  implementation of the priority queue based on a binary heap. A binary heap
+ *  pending events are kept in a hierarchical timing wheel (see
+ *  timerwheel.c) with a resolution of one millisecond. The timing wheel
  *  has the following characteristics:
  *
- *   - Cost of insertion:                O(log N)
- *   - Cost of deletion:                 O(log N)
- *   - Cost of change of key value:      O(log N) (not used here)
- *   - Cost of smallest (largest) value: O(1)
+ *   - Cost of insertion:                O(1)
+ *   - Cost of deletion:                 O(1)
+ *   - Cost of expiry:                   O(1) per event (amortized)
  *
- *  The binary heap code is based on:
- *
- *      "Chapter 9. Priority Queues and Heapsort", Sedgewick "Algorithms
- *       in C, 3rd Edition", Addison-Wesley, 1998.
- *
- *       https://algs4.cs.princeton.edu/24pq/
+ *  Events become due in batches per tick; an event is never started before
+ *  its scheduled time, but up to one tick later.
  */
 
 #include "nsd.h"
 
 /*
- * The following two defines can be used to turn on consistency checking and
- * intense tracing of the scheduling/unscheduling of the commands.
+ * The following define can be used to turn on intense tracing of the
+ * scheduling/unscheduling of the commands.
  *
- * #define NS_SCHED_CONSISTENCY_CHECK
  * #define NS_SCHED_TRACE_EVENTS
  */
 
+/*
+ * Number of buckets of the run time histogram of an event. The
+ * buckets count runs shorter than 1ms, 10ms, 100ms, 1s, 10s, and
+ * longer runs.
+ */
+
+#define SCHED_HISTOGRAM_BUCKETS 6
+
 /*
  * The following structure defines a scheduled event.
  */
@@ -47,7 +50,7 @@ typedef struct Event {
     struct Event   *nextPtr;
     Tcl_HashEntry  *hPtr;       /* Entry in event hash or NULL if deleted. */
     int             id;         /* Unique event id. */
-    int             qid;        /* Current priority queue id. */
+    NsTimerWheelEntry timer;    /* Entry in the timing wheel. */
     Ns_Time         nextqueue;  /* Next time to queue for run. */
     Ns_Time         lastqueue;  /* Last time queued for run. */
     Ns_Time         laststart;  /* Last time run started. */
@@ -60,6 +63,16 @@ typedef struct Event {
     unsigned int    flags;      /* One or more of NS_SCHED_ONCE, NS_SCHED_THREAD,
                                  * NS_SCHED_DAILY, or NS_SCHED_WEEKLY. */
     bool            waslate;    /* true while we are in a \"late\" period */
+    struct {
+        unsigned long runs;     /* Number of completed runs. */
+        unsigned long late;     /* Runs started later than lateTolerance. */
+        unsigned long overruns; /* Runs which ended after the next nominal start. */
+        Ns_Time       maxlate;  /* Maximum delay of a start. */
+        Ns_Time       mintime;  /* Minimum run time. */
+        Ns_Time       maxtime;  /* Maximum run time. */
+        Ns_Time       sumtime;  /* Sum of all run times. */
+        unsigned long histogram[SCHED_HISTOGRAM_BUCKETS];
+    } stats;
 } Event;
 
 /*
@@ -68,14 +81,16 @@ typedef struct Event {
 
 static Ns_ThreadProc SchedThread;       /* Detached event firing thread. */
 static Ns_ThreadProc EventThread;       /* Proc for NS_SCHED_THREAD events. */
-static Event *DeQueueEvent(int k);      /* Remove event from heap. */
 static void FreeEvent(Event *ePtr)      /* Free completed or cancelled event. */
     NS_GNUC_NONNULL(1);
-static void QueueEvent(Event *ePtr)     /* Queue event on heap. */
+static void QueueEvent(Event *ePtr)     /* Queue event in the timing wheel. */
     NS_GNUC_NONNULL(1);
-static void Exchange(int i, int j);     /* Exchange elements in the global queue */
-static bool Larger(int j, int k);       /* Function defining the sorting
-                                           criterium of the binary heap */
+static void EventStarted(Event *ePtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void EventFinished(Event *ePtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void DStringAppendEventStats(Tcl_DString *dsPtr, const Event *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
 
 /*
@@ -83,48 +98,23 @@ static bool Larger(int j, int k);       /* Function defining the sorting
  */
 
 static Tcl_HashTable eventsTable;   /* Hash table of events. */
-static Ns_Mutex lock = NULL;        /* Lock around heap and hash table. */
+static Ns_Mutex lock = NULL;        /* Lock around wheel and hash table. */
 static Ns_Cond schedcond = NULL;    /* Condition to wakeup SchedThread. */
 static Ns_Cond eventcond = NULL;    /* Condition to wakeup EventThread(s). */
-static Event **queue = NULL;        /* Heap priority queue (dynamically re-sized). */
-static Event *firstEventPtr = NULL; /* Pointer to the first event */
-static int nqueue = 0;              /* Number of events in queue. */
-static int maxqueue = 0;            /* Max queue events (dynamically re-sized). */
+static NsTimerWheel wheel;          /* Timing wheel of queued events. */
+static Ns_Time waitUntil = {0, 0};  /* Wakeup time, while SchedThread waits. */
+static Event *firstEventPtr = NULL; /* First event waiting for an EventThread */
+static Event *lastEventPtr = NULL;  /* Last event waiting for an EventThread */
+static const Ns_Time lateTolerance = {0, 100000}; /* 100ms */
 
 static int nThreads = 0;            /* Total number of running threads */
 static int nIdleThreads = 0;        /* Number of idle threads */
+static int nWaitingEvents = 0;      /* Number of events waiting for a thread */
 
 static bool running = NS_FALSE;
 static bool shutdownPending = NS_FALSE;
 static Ns_Thread schedThread;
 
-
-/*
- *----------------------------------------------------------------------
- *
- * Exchange --
- *
- *     Helper function to exchange two events in the global queue,
- *     used in QueueEvent() and DeQueueEvent().
- *
- * Results:
- *     None.
- *
- * Side effects:
- *     Queue elements flipped.
- *
- *----------------------------------------------------------------------
- */
-
-static void Exchange(int i, int j) {
-    Event *tmp = queue[i];
-
-    queue[i] = queue[j];
-    queue[j] = tmp;
-    queue[i]->qid = i;
-    queue[j]->qid = j;
-}
-
 
 /*
  *----------------------------------------------------------------------
@@ -150,6 +140,12 @@ NsInitSched(void)
     Ns_CondInit(&schedcond);
     Ns_CondInit(&eventcond);
     Tcl_InitHashTable(&eventsTable, TCL_ONE_WORD_KEYS);
+    {
+        Ns_Time now, resolution = {0, 1000};
+
+        Ns_GetTime(&now);
+        NsTimerWheelInit(&wheel, &resolution, &now);
+    }
 }
 
 
@@ -337,6 +333,9 @@ Ns_ScheduleProcEx(Ns_SchedProc *proc, void *clientData, unsigned int flags,
         ePtr->proc = proc;
         ePtr->deleteProc = cleanupProc;
         ePtr->arg = clientData;
+        ePtr->waslate = NS_FALSE;
+        memset(&ePtr->stats, 0, sizeof(ePtr->stats));
+        NsTimerWheelEntryInit(&ePtr->timer, ePtr);
 
         Ns_MutexLock(&lock);
         if (shutdownPending) {
@@ -404,8 +403,7 @@ Ns_Cancel(int id)
             ePtr = Tcl_GetHashValue(hPtr);
             Tcl_DeleteHashEntry(hPtr);
             ePtr->hPtr = NULL;
-            if (ePtr->qid > 0) {
-                (void) DeQueueEvent(ePtr->qid);
+            if (NsTimerWheelCancel(&wheel, &ePtr->timer)) {
                 cancelled = NS_TRUE;
             }
         }
@@ -449,9 +447,7 @@ Ns_Pause(int id)
             ePtr = Tcl_GetHashValue(hPtr);
             if ((ePtr->flags & NS_SCHED_PAUSED) == 0u) {
                 ePtr->flags |= NS_SCHED_PAUSED;
-                if (ePtr->qid > 0) {
-                    (void) DeQueueEvent(ePtr->qid);
-                }
+                (void) NsTimerWheelCancel(&wheel, &ePtr->timer);
                 paused = NS_TRUE;
             }
         }
@@ -555,88 +551,12 @@ NsWaitSchedShutdown(const Ns_Time *toPtr)
     }
 }
 
-static bool
-Larger(int j, int k)
-{
-    return (Ns_DiffTime(&queue[j]->nextqueue, &queue[k]->nextqueue, NULL) == 1);
-}
-
-
-#ifndef NS_SCHED_CONSISTENCY_CHECK
-static void QueueConsistencyCheck(const char *UNUSED(startMsg), int UNUSED(n), bool UNUSED(runAsserts)) {
-}
-#else
-
-
-static void
-QueueConsistencyCheck(const char *startMsg, int n, bool runAsserts)
-{
-    int          k;
-
-    Ns_Log(Notice, "=== %s (%d) ", startMsg, n);
-
-#ifdef NS_SCHED_TRACE_EVENTS
-    Event      *ePtr;
-    Tcl_DString ds;
-    time_t      s;
-
-    Tcl_DStringInit(&ds);
-
-    Ns_DStringPrintf(&ds, "=== %s (%d) ", startMsg, n);
-    if (n > 1) {
-        s = queue[1]->nextqueue.sec;
-    }
-    for (k = 1; k <= n; k++) {
-        ePtr = queue[k];
-        Ns_DStringPrintf(&ds, "[%d] (%p id %d qid %d " NS_TIME_FMT ")  ",
-                         k, (void*)ePtr, ePtr->id, ePtr->qid,
-                         (int64_t)ePtr->nextqueue.sec, ePtr->nextqueue.usec);
-    }
-    Ns_Log(Notice, "%s", ds.string);
-    Tcl_DStringFree(&ds);
-#endif
-
-    /*
-     * Check if all parent nodes (k/2) are earlier then the child nodes.
-     */
-    for (k = 2; k <= n; k++) {
-        int  j  = k/2;
-        bool ok = !Larger(j, k);
-
-        if (!ok) {
-            Ns_Log(Error, "=== %s: parent node [%d] (id %d " NS_TIME_FMT
-                   ") is later than child [%d] (id %d " NS_TIME_FMT ")",
-                   startMsg,
-                   j, queue[j]->id, (int64_t)queue[j]->nextqueue.sec, queue[j]->nextqueue.usec,
-                   k, queue[k]->id, (int64_t)queue[k]->nextqueue.sec, queue[k]->nextqueue.usec);
-            if (runAsserts) {
-                assert(ok);
-            }
-        }
-    }
-
-    /*
-     * Check whether all qids correspond to the array position.
-     */
-    for (k = 1; k <= n; k++) {
-        if (queue[k]->qid != k) {
-            Ns_Log(Error, "=== %s inconsistent qid on pos %d (id %d): is %d, should be %d",
-                   startMsg, k, queue[k]->id, queue[k]->qid, k);
-            if (runAsserts) {
-                assert(queue[k]->qid == k);
-            }
-        }
-    }
-}
-#endif
-
-
 /*
  *----------------------------------------------------------------------
  *
  * QueueEvent --
  *
- *  Add an event to the priority queue heap.
+ *  Add an event to the timing wheel.
  *
  * Results:
  *  None.
@@ -722,6 +642,7 @@ QueueEvent(Event *ePtr)
                  */
                 ePtr->nextqueue = now;
                 Ns_IncrTime(&ePtr->nextqueue, 0, 10000);
+                ePtr->stats.overruns++;
                 Ns_Log(Debug, "job %d: we missed nominal time", ePtr->id);
             }
             /*Ns_Log(Notice,
@@ -748,50 +669,23 @@ QueueEvent(Event *ePtr)
         ns_schedule_proc -thread 1s {ns_sleep 2s}
 #endif
 
-        ePtr->qid = ++nqueue;
-        /*
-         * The queue array is extended if necessary.
-         */
-        if (maxqueue <= nqueue) {
-            maxqueue += 25;
-            queue = ns_realloc(queue, sizeof(Event *) * ((size_t)maxqueue + 1u));
-        }
-        /*
-         * Place the new event at the end of the queue array.
-         */
-        queue[nqueue] = ePtr;
+        NsTimerWheelAdd(&wheel, &ePtr->timer, &ePtr->nextqueue);
 
-        if (nqueue > 1) {
-            int j, k;
-
-            QueueConsistencyCheck("Queue event", nqueue - 1, NS_FALSE);
-
-            /*
-             * Bottom-up reheapify: swim up" in the heap.  When a node is
-             * larger than its parent, then the nodes have to swapped.
-             *
-             * In the implementation below, "j" is always k/2 and represents
-             * the parent node in the binary tree.
-             */
-            k = nqueue;
-            j = k / 2;
-            while (k > 1 && Larger(j, k)) {
-                Exchange(j, k);
-                k = j;
-                j = k / 2;
-            }
-            QueueConsistencyCheck("Queue event end", nqueue, NS_TRUE);
-        }
-        Ns_Log(Debug, "QueueEvent (id %d qid %d " NS_TIME_FMT ")",
-               ePtr->id, ePtr->qid,
+        Ns_Log(Debug, "QueueEvent (id %d " NS_TIME_FMT ")",
+               ePtr->id,
                (int64_t)ePtr->nextqueue.sec, ePtr->nextqueue.usec);
 
         /*
-         * Signal or create the SchedThread if necessary.
+         * Signal or create the SchedThread if necessary. The
+         * SchedThread has only to be woken up, when it is waiting for
+         * a later time. When it is not waiting, it determines the next
+         * wakeup time anyway before it waits.
          */
 
         if (running) {
-            Ns_CondSignal(&schedcond);
+            if (Ns_DiffTime(&ePtr->nextqueue, &waitUntil, NULL) < 0) {
+                Ns_CondSignal(&schedcond);
+            }
         } else {
             running = NS_TRUE;
             Ns_ThreadCreate(SchedThread, NULL, 0, &schedThread);
@@ -799,68 +693,6 @@ QueueEvent(Event *ePtr)
     }
 }
 
-
-/*
- *----------------------------------------------------------------------
- *
- * DeQueueEvent --
- *
- *  Remove an event from the priority queue heap.
- *
- * Results:
- *  Pointer to removed event.
- *
- * Side effects:
- *  None.
- *
- *----------------------------------------------------------------------
- */
-
-static Event *
-DeQueueEvent(int k)
-{
-    Event *ePtr;
-
-    Ns_Log(Debug, "DeQueueEvent (id %d qid %d " NS_TIME_FMT ")",
-           queue[k]->id, k,
-           (int64_t)queue[k]->nextqueue.sec, queue[k]->nextqueue.usec);
-
-    QueueConsistencyCheck("Dequeue event start", nqueue, NS_TRUE);
-
-    /*
-     * Remove an element qid (named k in Sedgewick) from the priority queue.
-     *
-     * 1) Exchange element to be deleted with the node at the end. Now, the
-     *    element will violate in most cases the heap order.
-     * 2) Sink down the element.
-     */
-
-    Exchange(k, nqueue);
-    ePtr = queue[nqueue--];
-    ePtr->qid = 0;
-
-    for (;;) {
-        int j =  2 * k;
-
-        if (j > nqueue) {
-            break;
-        }
-
-        if (j < nqueue && Larger(j, j+1)) {
-            ++j;
-        }
-
-        if (!Larger(k, j)) {
-            break;
-        }
-        Exchange(k, j);
-        k = j;
-    }
-    QueueConsistencyCheck("Dequeue event end", nqueue, NS_TRUE);
-
-    return ePtr;
-}
-
 
 /*
  *----------------------------------------------------------------------
@@ -904,8 +736,13 @@ EventThread(void *arg)
         firstEventPtr = ePtr->nextPtr;
         if (firstEventPtr != NULL) {
             Ns_CondSignal(&eventcond);
+        } else {
+            lastEventPtr = NULL;
         }
         --nIdleThreads;
+        --nWaitingEvents;
+        Ns_GetTime(&now);
+        EventStarted(ePtr, &now);
         Ns_MutexUnlock(&lock);
 
         Ns_ThreadSetName("-sched:%" PRIuPTR ":%" PRIuPTR ":%d-",
@@ -921,8 +758,7 @@ EventThread(void *arg)
             FreeEvent(ePtr);
             Ns_MutexLock(&lock);
         } else {
-            ePtr->flags &= ~NS_SCHED_RUNNING;
-            ePtr->lastend = now;
+            EventFinished(ePtr, &now);
             /*
              * EventThread triggers QueueEvent() based on lastqueue.
              */
@@ -974,6 +810,161 @@ FreeEvent(Event *ePtr)
     ns_free(ePtr);
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EventStarted --
+ *
+ *  Mark an event as running and record the delay of its start
+ *  relative to its scheduled time. Must be called with the lock
+ *  held.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Updates the statistics of the event.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EventStarted(Event *ePtr, const Ns_Time *nowPtr)
+{
+    Ns_Time late;
+
+    NS_NONNULL_ASSERT(ePtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    ePtr->flags |= NS_SCHED_RUNNING;
+    ePtr->laststart = *nowPtr;
+
+    if (Ns_DiffTime(nowPtr, &ePtr->scheduled, &late) == 1) {
+        if (Ns_DiffTime(&late, &lateTolerance, NULL) == 1) {
+            ePtr->stats.late++;
+        }
+        if (Ns_DiffTime(&late, &ePtr->stats.maxlate, NULL) == 1) {
+            ePtr->stats.maxlate = late;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EventFinished --
+ *
+ *  Mark an event as not running anymore and record its run
+ *  time. Must be called with the lock held.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Updates the statistics of the event.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EventFinished(Event *ePtr, const Ns_Time *nowPtr)
+{
+    static const long bucketLimits[SCHED_HISTOGRAM_BUCKETS - 1] = {
+        1000, 10000, 100000, 1000000, 10000000
+    };
+    Ns_Time  diff;
+    size_t   bucket;
+
+    NS_NONNULL_ASSERT(ePtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    ePtr->flags &= ~NS_SCHED_RUNNING;
+    ePtr->lastend = *nowPtr;
+
+    if (Ns_DiffTime(nowPtr, &ePtr->laststart, &diff) < 0) {
+        diff.sec = 0;
+        diff.usec = 0;
+    }
+    if (ePtr->stats.runs == 0u
+        || Ns_DiffTime(&diff, &ePtr->stats.mintime, NULL) < 0) {
+        ePtr->stats.mintime = diff;
+    }
+    if (Ns_DiffTime(&diff, &ePtr->stats.maxtime, NULL) == 1) {
+        ePtr->stats.maxtime = diff;
+    }
+    Ns_IncrTime(&ePtr->stats.sumtime, diff.sec, diff.usec);
+    ePtr->stats.runs++;
+
+    if (diff.sec >= 10) {
+        bucket = SCHED_HISTOGRAM_BUCKETS - 1;
+    } else {
+        long usec = (long)diff.sec * 1000000 + diff.usec;
+
+        for (bucket = 0u; bucket < SCHED_HISTOGRAM_BUCKETS - 1; bucket++) {
+            if (usec < bucketLimits[bucket]) {
+                break;
+            }
+        }
+    }
+    ePtr->stats.histogram[bucket]++;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DStringAppendEventStats --
+ *
+ *  Append the statistics of an event as a dict element to the
+ *  DString.
+ *
+ * Results:
+ *  None.
+ *
+ * Side effects:
+ *  Appends to the DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DStringAppendEventStats(Tcl_DString *dsPtr, const Event *ePtr)
+{
+    Ns_Time avgtime = {0, 0};
+    size_t  bucket;
+
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (ePtr->stats.runs > 0u) {
+        Ns_Time t = ePtr->stats.sumtime;
+        long    runs = (long)ePtr->stats.runs;
+
+        avgtime.sec = (time_t)(t.sec / runs);
+        avgtime.usec = (long)(((t.sec % runs) * 1000000 + t.usec) / runs);
+    }
+
+    Tcl_DStringStartSublist(dsPtr);
+    Ns_DStringPrintf(dsPtr, "runs %lu late %lu overruns %lu maxlate ",
+                     ePtr->stats.runs, ePtr->stats.late, ePtr->stats.overruns);
+    Ns_DStringAppendTime(dsPtr, &ePtr->stats.maxlate);
+    Tcl_DStringAppend(dsPtr, " mintime ", 9);
+    Ns_DStringAppendTime(dsPtr, &ePtr->stats.mintime);
+    Tcl_DStringAppend(dsPtr, " avgtime ", 9);
+    Ns_DStringAppendTime(dsPtr, &avgtime);
+    Tcl_DStringAppend(dsPtr, " maxtime ", 9);
+    Ns_DStringAppendTime(dsPtr, &ePtr->stats.maxtime);
+    Tcl_DStringAppend(dsPtr, " histogram {", 12);
+    for (bucket = 0u; bucket < SCHED_HISTOGRAM_BUCKETS; bucket++) {
+        Ns_DStringPrintf(dsPtr, bucket == 0u ? "%lu" : " %lu",
+                         ePtr->stats.histogram[bucket]);
+    }
+    Tcl_DStringAppend(dsPtr, "}", 1);
+    Tcl_DStringEndSublist(dsPtr);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1045,6 +1036,7 @@ SchedThread(void *UNUSED(arg))
     Ns_Time         now;
     Ns_Time         timeout = {0, 0};
     Event          *ePtr, *readyPtr = NULL;
+    NsTimerWheelEntry *entryPtr, *nextEntryPtr;
 
     (void) Ns_WaitForStartup();
 
@@ -1059,13 +1051,22 @@ SchedThread(void *UNUSED(arg))
      * 'now' so they don't appear "late" on the very first run.
      */
     Ns_GetTime(&now);
-    for (int i = 1; i <= nqueue; ++i) {
-        Event *e = queue[i];
-
-        if (Ns_DiffTime(&e->nextqueue, &now, NULL) <= 0) {
-            e->scheduled = now;
-            e->nextqueue = now;
-            e->lastqueue = now;   /* optional, but keeps things consistent */
+    {
+        Tcl_HashSearch       search;
+        const Tcl_HashEntry *hPtr;
+
+        for (hPtr = Tcl_FirstHashEntry(&eventsTable, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            Event *e = Tcl_GetHashValue(hPtr);
+
+            if (NsTimerWheelEntryQueued(&e->timer)
+                && Ns_DiffTime(&e->nextqueue, &now, NULL) <= 0) {
+                e->scheduled = now;
+                e->nextqueue = now;
+                e->lastqueue = now;   /* optional, but keeps things consistent */
+                NsTimerWheelAdd(&wheel, &e->timer, &now);
+            }
         }
     }
 
@@ -1076,10 +1077,13 @@ SchedThread(void *UNUSED(arg))
          * detached events or add to a list of synchronous events.
          */
         Ns_GetTime(&now);
-        while (nqueue > 0 && Ns_DiffTime(&queue[1]->nextqueue, &now, NULL) <= 0) {
-            Ns_Time late, tolerate = {0, 100000};  /* 100 ms */
+        for (entryPtr = NsTimerWheelExpire(&wheel, &now);
+             entryPtr != NULL;
+             entryPtr = nextEntryPtr) {
+            Ns_Time late;
 
-            ePtr = DeQueueEvent(1);
+            nextEntryPtr = entryPtr->nextPtr;
+            ePtr = entryPtr->clientData;
 
 #ifdef NS_SCHED_TRACE_EVENTS
             Ns_Log(Notice, "... dequeue event (id %d) " NS_TIME_FMT,
@@ -1098,7 +1102,7 @@ SchedThread(void *UNUSED(arg))
                        (long)late.sec, (long)late.usec,
                        (long)ePtr->interval.sec, (long)ePtr->interval.usec);*/
 
-                if (Ns_DiffTime(&late, &tolerate, NULL) == 1) { /* late > tolerate */
+                if (Ns_DiffTime(&late, &lateTolerance, NULL) == 1) { /* late > tolerance */
                     if (!ePtr->waslate) {
                         Tcl_DString ds;
                         const char *flagsString;
@@ -1134,10 +1138,20 @@ SchedThread(void *UNUSED(arg))
             }
             ePtr->lastqueue = now;
             if ((ePtr->flags & NS_SCHED_THREAD) != 0u) {
+                /*
+                 * The event is marked as running while it waits for an
+                 * EventThread, such that it is not queued again before
+                 * the current run has finished.
+                 */
                 ePtr->flags |= NS_SCHED_RUNNING;
-                ePtr->laststart = now;
-                ePtr->nextPtr = firstEventPtr;
-                firstEventPtr = ePtr;
+                ePtr->nextPtr = NULL;
+                if (lastEventPtr == NULL) {
+                    firstEventPtr = ePtr;
+                } else {
+                    lastEventPtr->nextPtr = ePtr;
+                }
+                lastEventPtr = ePtr;
+                ++nWaitingEvents;
             } else {
                 ePtr->nextPtr = readyPtr;
                 readyPtr = ePtr;
@@ -1157,11 +1171,20 @@ SchedThread(void *UNUSED(arg))
          */
 
         if (firstEventPtr != NULL) {
-            if (nIdleThreads == 0) {
+            while (nIdleThreads < nWaitingEvents
+                   && (nsconf.sched.maxthreads == 0 || nThreads < nsconf.sched.maxthreads)) {
                 Ns_ThreadCreate(EventThread, INT2PTR(nThreads), 0, NULL);
                 ++nIdleThreads;
                 ++nThreads;
             }
+            if (nIdleThreads == 0) {
+                /*
+                 * All EventThreads are busy. The events are run in
+                 * FIFO order when the next thread becomes idle.
+                 */
+                Ns_Log(Debug, "sched: all %d event threads busy, %d events waiting",
+                       nThreads, nWaitingEvents);
+            }
             Ns_CondSignal(&eventcond);
         }
 
@@ -1173,8 +1196,7 @@ SchedThread(void *UNUSED(arg))
             Ns_Time diff;
 
             readyPtr = ePtr->nextPtr;
-            ePtr->laststart = now;
-            ePtr->flags |= NS_SCHED_RUNNING;
+            EventStarted(ePtr, &now);
             Ns_MutexUnlock(&lock);
             (*ePtr->proc) (ePtr->arg, ePtr->id);
             Ns_GetTime(&now);
@@ -1190,8 +1212,7 @@ SchedThread(void *UNUSED(arg))
             }
             Ns_MutexLock(&lock);
             if (ePtr != NULL) {
-                ePtr->flags &= ~NS_SCHED_RUNNING;
-                ePtr->lastend = now;
+                EventFinished(ePtr, &now);
                 /*
                  * Base repeating thread on the last queue time, and not on
                  * the last endtime to avoid a growing timeshift for events
@@ -1206,15 +1227,20 @@ SchedThread(void *UNUSED(arg))
         /*
          * Wait for the next ready event.
          */
-        if (nqueue == 0) {
+        if (!NsTimerWheelNextTimeout(&wheel, &timeout)) {
+            waitUntil.sec = TIME_T_MAX;
+            waitUntil.usec = 0;
             Ns_CondWait(&schedcond, &lock);
+            waitUntil.sec = 0;
         } else if (!shutdownPending) {
             Ns_ReturnCode status;
 
-            timeout = queue[1]->nextqueue;
             /*Ns_Log(Notice, "after job next queue timeout " NS_TIME_FMT,
                      (int64_t)timeout.sec, timeout.usec);*/
+            waitUntil = timeout;
             status = Ns_CondTimedWait(&schedcond, &lock, &timeout);
+            waitUntil.sec = 0;
+            waitUntil.usec = 0;
             (void)status;
             /*{
                 Ns_Time now;
@@ -1241,10 +1267,10 @@ SchedThread(void *UNUSED(arg))
         }
     }
     Ns_MutexUnlock(&lock);
-    while (nqueue > 0) {
-        FreeEvent(queue[nqueue--]);
+    for (entryPtr = NsTimerWheelDrain(&wheel); entryPtr != NULL; entryPtr = nextEntryPtr) {
+        nextEntryPtr = entryPtr->nextPtr;
+        FreeEvent(entryPtr->clientData);
     }
-    ns_free(queue);
     Tcl_DeleteHashTable(&eventsTable);
     Ns_Log(Notice, "sched: shutdown complete");
 
@@ -1281,6 +1307,7 @@ NsGetScheduled(Tcl_DString *dsPtr)
         Ns_DStringAppendTime(dsPtr, &ePtr->lastend);
         Tcl_DStringAppend(dsPtr, " ", 1);
         Ns_GetProcInfo(dsPtr, (ns_funcptr_t)ePtr->proc, ePtr->arg);
+        DStringAppendEventStats(dsPtr, ePtr);
         Tcl_DStringEndSublist(dsPtr);
         hPtr = Tcl_NextHashEntry(&search);
     }
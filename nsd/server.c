@@ -489,6 +489,7 @@ NsInitServer(const char *server, Ns_ServerInitProc *initProc)
      * from startup scripts.
      */
     NsInitHttp(servPtr);
+    NsInitRespCache(servPtr);
     NsTclInitServer(server);
 
 #ifdef NS_WITH_DEPRECATED
@@ -13,11 +13,23 @@
 /*
  * sockcallback.c --
  *
- *      Support for the socket callback thread.
+ *      Support for the socket callback threads. Socket callbacks are
+ *      distributed over a configurable number of reactor threads
+ *      (parameter "sockcallbackthreads"). Every socket is always
+ *      handled by the same reactor, such that registrations and
+ *      cancellations are processed in order. On Linux, the reactors
+ *      use epoll(); otherwise, poll() is used.
  */
 
 #include "nsd.h"
 
+#if defined(__linux__)
+# include <sys/epoll.h>
+# define NS_SOCKCALLBACK_EPOLL 1
+#endif
+
+#define NS_SOCKCALLBACK_MAX_THREADS 64
+
 /*
  * The following defines a socket being monitored.
  */
@@ -33,6 +45,35 @@ typedef struct Callback {
     void                *arg;
 } Callback;
 
+/*
+ * The following defines a reactor, which is a thread monitoring a
+ * subset of the sockets with registered callbacks.
+ */
+
+typedef struct Reactor {
+    Ns_Mutex             lock;
+    Ns_Cond              cond;
+    Callback            *firstQueuePtr;
+    Callback            *lastQueuePtr;
+    bool                 shutdownPending;
+    bool                 running;
+    Ns_Thread            thread;
+    NS_SOCKET            trigPipe[2];
+    Tcl_HashTable        activeCallbacks;
+    size_t               nTimed;          /* Active callbacks with timeout */
+#ifdef NS_SOCKCALLBACK_EPOLL
+    int                  epfd;
+#endif
+    char                 threadName[32];
+    struct {
+        unsigned long    queued;          /* Registrations and cancels */
+        unsigned long    dispatched;      /* Calls of Ns_SockProcs on events */
+        unsigned long    timeouts;
+        unsigned long    wakeups;         /* Wakeups via trigger pipe */
+        Ns_Time          busy;            /* Time spent in Ns_SockProcs */
+    } stats;
+} Reactor;
+
 /*
  * Local functions defined in this file
  */
@@ -40,22 +81,47 @@ typedef struct Callback {
 static Ns_ThreadProc SockCallbackThread;
 static Ns_ReturnCode Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
                            const Ns_Time *timeout, const char **threadNamePtr);
-static void CallbackTrigger(void);
+static void CallbackTrigger(Reactor *reactorPtr)
+    NS_GNUC_NONNULL(1);
+static void ReactorInit(Reactor *reactorPtr, int id)
+    NS_GNUC_NONNULL(1);
+static Reactor *ReactorGet(NS_SOCKET sock)
+    NS_GNUC_RETURNS_NONNULL;
+static void CallbackAdd(Reactor *reactorPtr, Callback *cbPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void CallbackRemove(Reactor *reactorPtr, Tcl_HashEntry *hPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static unsigned long CallbackDispatch(Reactor *reactorPtr, Tcl_HashEntry *hPtr, unsigned int ready)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static long CallbackTimeouts(Reactor *reactorPtr, unsigned long *timeoutsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+#ifdef NS_SOCKCALLBACK_EPOLL
+static void EpollControl(const Reactor *reactorPtr, int op, const Callback *cbPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+#endif
 
 /*
  * Static variables defined in this file
  */
 
-static Callback     *firstQueuePtr = NULL, *lastQueuePtr = NULL;
-static bool          shutdownPending = NS_FALSE;
-static bool          running = NS_FALSE;
-static Ns_Thread     sockThread;
 static Ns_Mutex      lock = NULL;
-static Ns_Cond       cond = NULL;
-static NS_SOCKET     trigPipe[2];
-static Tcl_HashTable activeCallbacks;
+static Reactor       reactors[NS_SOCKCALLBACK_MAX_THREADS];
+static int           nReactors = 0;
+
+/*
+ * The positions in the following array are for 'r', 'w' and 'e'
+ * callback types in this order. The NS_SOCK* states are reported back
+ * to the Ns_SockProc.
+ */
+
+static const unsigned int whenStates[] = {
+    (unsigned int)NS_SOCK_READ,
+    (unsigned int)NS_SOCK_WRITE,
+    (unsigned int)NS_SOCK_EXCEPTION | (unsigned int)NS_SOCK_DONE
+};
+
 
-
 /*
  *----------------------------------------------------------------------
  *
@@ -86,7 +152,7 @@ Ns_SockCallbackEx(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int whe
     return Queue(sock, proc, arg, when, timeout, threadNamePtr);
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -116,13 +182,15 @@ Ns_SockCancelCallbackEx(NS_SOCKET sock, Ns_SockProc *proc, void *arg, const char
     return Queue(sock, proc, arg, (unsigned int)NS_SOCK_CANCEL, NULL, threadNamePtr);
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
  * NsInitSockCallback --
  *
- *      Global initialization routine for sockcallbacks.
+ *      Global initialization routine for sockcallbacks. Initially, a
+ *      single reactor is available; more reactors are added based on
+ *      the configuration in NsConfigSockCallback().
  *
  * Results:
  *      None.
@@ -139,15 +207,125 @@ NsInitSockCallback(void)
     static bool initialized = NS_FALSE;
 
     if (!initialized) {
-        Tcl_InitHashTable(&activeCallbacks, TCL_ONE_WORD_KEYS);
         Ns_MutexInit(&lock);
-        Ns_MutexSetName(&lock, "ns:sockcallbacks");
-        Ns_CondInit(&cond);
+        Ns_MutexSetName(&lock, "ns:sockcallbacks:config");
+        ReactorInit(&reactors[0], 0);
+        nReactors = 1;
         initialized = NS_TRUE;
     }
 }
 
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsConfigSockCallback --
+ *
+ *      Configure the number of reactor threads for socket callbacks.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Additional reactors are initialized. Their threads are created
+ *      on demand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsConfigSockCallback(void)
+{
+    int n;
+
+    n = Ns_ConfigIntRange(NS_GLOBAL_CONFIG_PARAMETERS, "sockcallbackthreads",
+                          1, 1, NS_SOCKCALLBACK_MAX_THREADS);
+
+    Ns_MutexLock(&lock);
+    if (n > nReactors) {
+        int i;
+
+        for (i = nReactors; i < n; i++) {
+            ReactorInit(&reactors[i], i);
+        }
+        nReactors = n;
+    }
+    Ns_MutexUnlock(&lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReactorInit --
+ *
+ *      Initialize a reactor structure.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReactorInit(Reactor *reactorPtr, int id)
+{
+    char idString[TCL_INTEGER_SPACE];
+
+    memset(reactorPtr, 0, sizeof(Reactor));
+    Tcl_InitHashTable(&reactorPtr->activeCallbacks, TCL_ONE_WORD_KEYS);
+    Ns_MutexInit(&reactorPtr->lock);
+    if (id == 0) {
+        Ns_MutexSetName(&reactorPtr->lock, "ns:sockcallbacks");
+        memcpy(reactorPtr->threadName, "-socks-", sizeof("-socks-"));
+    } else {
+        snprintf(idString, sizeof(idString), "%d", id);
+        Ns_MutexSetName2(&reactorPtr->lock, "ns:sockcallbacks", idString);
+        snprintf(reactorPtr->threadName, sizeof(reactorPtr->threadName), "-socks:%d-", id);
+    }
+    Ns_CondInit(&reactorPtr->cond);
+#ifdef NS_SOCKCALLBACK_EPOLL
+    reactorPtr->epfd = -1;
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReactorGet --
+ *
+ *      Return the reactor responsible for the provided socket. A
+ *      socket is always mapped to the same reactor.
+ *
+ * Results:
+ *      Reactor.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Reactor *
+ReactorGet(NS_SOCKET sock)
+{
+#ifdef _WIN32
+    /*
+     * Windows socket handles are multiples of 4.
+     */
+    size_t key = (size_t)sock >> 2;
+#else
+    size_t key = (size_t)sock;
+#endif
+
+    return &reactors[key % (size_t)nReactors];
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -167,31 +345,43 @@ NsInitSockCallback(void)
 void
 NsStartSockShutdown(void)
 {
-    Ns_MutexLock(&lock);
-    if (running) {
-        shutdownPending = NS_TRUE;
-        CallbackTrigger();
+    int i;
+
+    for (i = 0; i < nReactors; i++) {
+        Reactor *reactorPtr = &reactors[i];
+
+        Ns_MutexLock(&reactorPtr->lock);
+        if (reactorPtr->running) {
+            reactorPtr->shutdownPending = NS_TRUE;
+            CallbackTrigger(reactorPtr);
+        }
+        Ns_MutexUnlock(&reactorPtr->lock);
     }
-    Ns_MutexUnlock(&lock);
 }
 
 void
 NsWaitSockShutdown(const Ns_Time *toPtr)
 {
-    Ns_ReturnCode status = NS_OK;
+    int i;
 
-    Ns_MutexLock(&lock);
-    while (status == NS_OK && running) {
-        status = Ns_CondTimedWait(&cond, &lock, toPtr);
-    }
-    Ns_MutexUnlock(&lock);
-    if (status != NS_OK) {
-        Ns_Log(Warning, "socks: timeout waiting for callback shutdown");
-    } else if (sockThread != NULL) {
-        Ns_ThreadJoin(&sockThread, NULL);
-        sockThread = NULL;
-        ns_sockclose(trigPipe[0]);
-        ns_sockclose(trigPipe[1]);
+    for (i = 0; i < nReactors; i++) {
+        Reactor      *reactorPtr = &reactors[i];
+        Ns_ReturnCode status = NS_OK;
+
+        Ns_MutexLock(&reactorPtr->lock);
+        while (status == NS_OK && reactorPtr->running) {
+            status = Ns_CondTimedWait(&reactorPtr->cond, &reactorPtr->lock, toPtr);
+        }
+        Ns_MutexUnlock(&reactorPtr->lock);
+        if (status != NS_OK) {
+            Ns_Log(Warning, "socks: timeout waiting for callback shutdown of %s",
+                   reactorPtr->threadName);
+        } else if (reactorPtr->thread != NULL) {
+            Ns_ThreadJoin(&reactorPtr->thread, NULL);
+            reactorPtr->thread = NULL;
+            ns_sockclose(reactorPtr->trigPipe[0]);
+            ns_sockclose(reactorPtr->trigPipe[1]);
+        }
     }
 }
 
@@ -213,20 +403,21 @@ NsWaitSockShutdown(const Ns_Time *toPtr)
  */
 
 static void
-CallbackTrigger(void)
+CallbackTrigger(Reactor *reactorPtr)
 {
-    if (ns_send(trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
+    if (ns_send(reactorPtr->trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
         Ns_Fatal("trigger send() failed: %s", ns_sockstrerror(ns_sockerrno));
     }
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
  * Queue --
  *
- *      Queue a callback for socket.
+ *      Queue a callback for socket in the reactor responsible for the
+ *      socket.
  *
  * Results:
  *      NS_OK or NS_ERROR on shutdown pending.
@@ -242,6 +433,7 @@ Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
       const Ns_Time *timeout, const char **threadNamePtr)
 {
     Callback     *cbPtr;
+    Reactor      *reactorPtr;
     Ns_ReturnCode status;
     bool          trigger, create;
 
@@ -261,56 +453,313 @@ Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
         cbPtr->timeout.usec = 0;
     }
 
-    Ns_MutexLock(&lock);
-    if (shutdownPending) {
+    reactorPtr = ReactorGet(sock);
+
+    Ns_MutexLock(&reactorPtr->lock);
+    if (reactorPtr->shutdownPending) {
         ns_free(cbPtr);
         status = NS_ERROR;
     } else {
-        if (!running) {
+        if (!reactorPtr->running) {
             create = NS_TRUE;
-            running = NS_TRUE;
-        } else if (firstQueuePtr == NULL) {
+            reactorPtr->running = NS_TRUE;
+        } else if (reactorPtr->firstQueuePtr == NULL) {
             trigger = NS_TRUE;
         }
-        if (firstQueuePtr == NULL) {
-            firstQueuePtr = cbPtr;
+        if (reactorPtr->firstQueuePtr == NULL) {
+            reactorPtr->firstQueuePtr = cbPtr;
         } else {
-            lastQueuePtr->nextPtr = cbPtr;
+            reactorPtr->lastQueuePtr->nextPtr = cbPtr;
         }
         cbPtr->nextPtr = NULL;
-        lastQueuePtr = cbPtr;
+        reactorPtr->lastQueuePtr = cbPtr;
+        reactorPtr->stats.queued++;
         status = NS_OK;
     }
-    Ns_MutexUnlock(&lock);
+    Ns_MutexUnlock(&reactorPtr->lock);
 
     if (threadNamePtr != NULL) {
-        /*
-         * The thread name is currently just a constant, but when
-         * implementing multiple "-socks-" threads, threadNamePtr should
-         * return the associated queue. This way, we can keep the
-         * interface constant.
-         */
-        *threadNamePtr = "-socks-";
+        *threadNamePtr = reactorPtr->threadName;
     }
 
     if (trigger) {
-        CallbackTrigger();
+        CallbackTrigger(reactorPtr);
     } else if (create) {
-        if (ns_sockpair(trigPipe) != 0) {
+        if (ns_sockpair(reactorPtr->trigPipe) != 0) {
             Ns_Fatal("ns_sockpair() failed: %s", ns_sockstrerror(ns_sockerrno));
         }
-        Ns_ThreadCreate(SockCallbackThread, NULL, 0, &sockThread);
+        Ns_ThreadCreate(SockCallbackThread, reactorPtr, 0, &reactorPtr->thread);
     }
     return status;
 }
 
-
+#ifdef NS_SOCKCALLBACK_EPOLL
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EpollControl --
+ *
+ *      Add, modify or remove the interest of the reactor in the
+ *      socket of the provided callback. Since closed sockets are
+ *      removed automatically from the epoll set, and socket numbers
+ *      might be reused, ADD and MOD are converted into each other when
+ *      necessary.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the epoll set of the reactor.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EpollControl(const Reactor *reactorPtr, int op, const Callback *cbPtr)
+{
+    struct epoll_event ev;
+    int                rc;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = cbPtr->sock;
+    if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
+        ev.events |= (uint32_t)EPOLLIN;
+    }
+    if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
+        ev.events |= (uint32_t)EPOLLOUT;
+    }
+
+    rc = epoll_ctl(reactorPtr->epfd, op, cbPtr->sock, &ev);
+    if (rc != 0) {
+        if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            rc = epoll_ctl(reactorPtr->epfd, EPOLL_CTL_MOD, cbPtr->sock, &ev);
+        } else if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            rc = epoll_ctl(reactorPtr->epfd, EPOLL_CTL_ADD, cbPtr->sock, &ev);
+        } else if (op == EPOLL_CTL_DEL) {
+            /*
+             * The socket might be already closed.
+             */
+            rc = 0;
+        }
+        if (rc != 0) {
+            Ns_Log(Warning, "sockcallback: epoll_ctl() for fd %d failed: %s",
+                   cbPtr->sock, strerror(errno));
+        }
+    }
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallbackAdd --
+ *
+ *      Add a queued callback to the active callbacks of the
+ *      reactor. An existing callback for the same socket is replaced.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Might free an earlier callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CallbackAdd(Reactor *reactorPtr, Callback *cbPtr)
+{
+    Tcl_HashEntry *hPtr;
+    int            isNew;
+
+    hPtr = Tcl_CreateHashEntry(&reactorPtr->activeCallbacks, NSSOCK2PTR(cbPtr->sock), &isNew);
+    if (isNew == 0) {
+        Callback *oldPtr = Tcl_GetHashValue(hPtr);
+
+        if (oldPtr->timeout.sec != 0 || oldPtr->timeout.usec != 0) {
+            reactorPtr->nTimed--;
+        }
+        ns_free(oldPtr);
+    }
+    Tcl_SetHashValue(hPtr, cbPtr);
+    if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
+        reactorPtr->nTimed++;
+    }
+
+    if ((cbPtr->when & NS_SOCK_ANY) == 0u) {
+        CallbackRemove(reactorPtr, hPtr);
+    } else {
+#ifdef NS_SOCKCALLBACK_EPOLL
+        EpollControl(reactorPtr, isNew != 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, cbPtr);
+#endif
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallbackRemove --
+ *
+ *      Remove an active callback from the reactor.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CallbackRemove(Reactor *reactorPtr, Tcl_HashEntry *hPtr)
+{
+    Callback *cbPtr = Tcl_GetHashValue(hPtr);
+
+#ifdef NS_SOCKCALLBACK_EPOLL
+    EpollControl(reactorPtr, EPOLL_CTL_DEL, cbPtr);
+#endif
+    if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
+        reactorPtr->nTimed--;
+    }
+    Tcl_DeleteHashEntry(hPtr);
+    ns_free(cbPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallbackDispatch --
+ *
+ *      Call the Ns_SockProc of an active callback for all states it
+ *      is interested in and which are ready. When the Ns_SockProc
+ *      returns NS_FALSE, the callback is removed.
+ *
+ * Results:
+ *      Number of Ns_SockProc calls.
+ *
+ * Side effects:
+ *      Depends on the callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+CallbackDispatch(Reactor *reactorPtr, Tcl_HashEntry *hPtr, unsigned int ready)
+{
+    Callback     *cbPtr = Tcl_GetHashValue(hPtr);
+    unsigned long calls = 0u;
+    size_t        i;
+
+    for (i = 0u; i < Ns_NrElements(whenStates) && cbPtr->when != 0u; ++i) {
+        if (((cbPtr->when & whenStates[i]) != 0u)
+            && (ready & whenStates[i]) != 0u) {
+            /*
+             * Call the Sock_Proc with the SockState flag combination
+             * from whenStates[i]. This is actually the only place,
+             * where an Ns_SockProc is called with a flag combination
+             * in the last argument. If this would not be the case, we
+             * could set the type of the last parameter of Ns_SockProc
+             * to Ns_SockState.
+             */
+            calls++;
+            if ((*cbPtr->proc)(cbPtr->sock, cbPtr->arg, whenStates[i]) == NS_FALSE) {
+                cbPtr->when = 0u;
+            } else {
+                if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
+                    Ns_GetTime(&cbPtr->expires);
+                    Ns_IncrTime(&cbPtr->expires, cbPtr->timeout.sec, cbPtr->timeout.usec);
+                }
+            }
+        }
+    }
+    if (cbPtr->when == 0u) {
+        CallbackRemove(reactorPtr, hPtr);
+    }
+    return calls;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallbackTimeouts --
+ *
+ *      Notify callbacks with exceeded timeouts and compute the
+ *      timeout for the next poll.
+ *
+ * Results:
+ *      Poll timeout in milliseconds.
+ *
+ * Side effects:
+ *      Callbacks with exceeded timeouts are removed. The number of
+ *      timeouts is added to *timeoutsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static long
+CallbackTimeouts(Reactor *reactorPtr, unsigned long *timeoutsPtr)
+{
+    /*
+     * Wake up every 30 seconds to process expired sockets
+     */
+    long pollTimeout = 30000;
+
+    if (reactorPtr->nTimed > 0u) {
+        Tcl_HashEntry *hPtr;
+        Tcl_HashSearch search;
+        Ns_Time        now;
+
+        Ns_GetTime(&now);
+
+        for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            Callback *cbPtr = Tcl_GetHashValue(hPtr);
+            Ns_Time   diff = {0, 0};
+
+            if (cbPtr->timeout.sec == 0 && cbPtr->timeout.usec == 0) {
+                continue;
+            }
+            if (Ns_DiffTime(&now, &cbPtr->expires, &diff) > 0) {
+                /*
+                 * Call Ns_SockProc to notify about timeout. For the
+                 * time being, ignore boolean result.
+                 */
+                Ns_Log(Notice, "sockcallback: fd %d timeout " NS_TIME_FMT " exceeded by " NS_TIME_FMT,
+                       cbPtr->sock, (int64_t) cbPtr->timeout.sec, cbPtr->timeout.usec,
+                       (int64_t) diff.sec, diff.usec
+                       );
+                (void) (*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_TIMEOUT);
+                (*timeoutsPtr)++;
+                CallbackRemove(reactorPtr, hPtr);
+            } else {
+                long to = (long)(diff.sec * -1000 + diff.usec / 1000 + 1);
+
+                if (to < pollTimeout)  {
+                    /*
+                     * Reduce poll timeout to smaller value.
+                     */
+                    pollTimeout = to;
+                }
+            }
+        }
+    }
+    return pollTimeout;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * SockCallbackThread --
  *
- *      Run callbacks registered with Ns_SockCallback.
+ *      Run callbacks registered with Ns_SockCallback for the sockets
+ *      handled by one reactor.
  *
  * Results:
  *      None.
@@ -322,59 +771,70 @@ Queue(NS_SOCKET sock, Ns_SockProc *proc, void *arg, unsigned int when,
  */
 
 static void
-SockCallbackThread(void *UNUSED(arg))
+SockCallbackThread(void *arg)
 {
+    Reactor       *reactorPtr = arg;
     char           c;
-    unsigned int   when[3];
-    short          events[3];
-    int            n, i, isNew;
-    size_t         maxPollfds = 100u;
+    int            n;
     Callback      *cbPtr, *nextPtr;
     Tcl_HashEntry *hPtr;
     Tcl_HashSearch search;
-    struct pollfd *pfds;
-
-    Ns_ThreadSetName("-socks-");
+    unsigned long  dispatched = 0u, timeouts = 0u, wakeups = 0u;
+    Ns_Time        busy = {0, 0};
+#ifdef NS_SOCKCALLBACK_EPOLL
+    int                 maxEvents = 100;
+    struct epoll_event *events, ev;
+#else
+    NS_POLL_NFDS_TYPE   i;
+    size_t              maxPollfds = 100u;
+    struct pollfd      *pfds;
+#endif
+
+    Ns_ThreadSetName("%s", reactorPtr->threadName);
     (void)Ns_WaitForStartup();
     Ns_Log(Notice, "socks: starting");
 
-    /*
-     * The array events[] is used
-     *   1) for the requested poll mask, and
-     *   2) for associating the revents received by the poll call to the
-     *      NS_SOCK* states reported back
-     *
-     * The NS_SOCK* states are kept in the corresponding when[]
-     * elements.  The positions in this array are for 'r', 'w' and 'e'
-     * callback types in this order.
-     */
-    events[0] = (short)POLLIN;
-    events[1] = (short)POLLOUT;
-    events[2] = (short)POLLERR;
-    when[0] = (unsigned int)NS_SOCK_READ;
-    when[1] = (unsigned int)NS_SOCK_WRITE;
-    when[2] = (unsigned int)NS_SOCK_EXCEPTION | (unsigned int)NS_SOCK_DONE;
-
+#ifdef NS_SOCKCALLBACK_EPOLL
+    reactorPtr->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactorPtr->epfd < 0) {
+        Ns_Fatal("sockcallback: epoll_create1() failed: %s", strerror(errno));
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (uint32_t)EPOLLIN;
+    ev.data.fd = reactorPtr->trigPipe[0];
+    if (epoll_ctl(reactorPtr->epfd, EPOLL_CTL_ADD, reactorPtr->trigPipe[0], &ev) != 0) {
+        Ns_Fatal("sockcallback: epoll_ctl() failed: %s", strerror(errno));
+    }
+    events = ns_malloc(sizeof(struct epoll_event) * (size_t)maxEvents);
+#else
     pfds = (struct pollfd *)ns_malloc(sizeof(struct pollfd) * maxPollfds);
-    pfds[0].fd = trigPipe[0];
+    pfds[0].fd = reactorPtr->trigPipe[0];
     pfds[0].events = (short)POLLIN;
+#endif
 
     for (;;) {
         long              pollTimeout;
-        NS_POLL_NFDS_TYPE nfds;
         bool              stop;
-        Ns_Time           now, diff = {0, 0};
+        Ns_Time           startTime, endTime, diff;
 
         /*
-         * Grab the list of any queue updates and the shutdown flag.
+         * Grab the list of any queue updates and the shutdown flag,
+         * and publish the statistics.
          */
 
-        Ns_MutexLock(&lock);
-        cbPtr = firstQueuePtr;
-        firstQueuePtr = NULL;
-        lastQueuePtr = NULL;
-        stop = shutdownPending;
-        Ns_MutexUnlock(&lock);
+        Ns_MutexLock(&reactorPtr->lock);
+        cbPtr = reactorPtr->firstQueuePtr;
+        reactorPtr->firstQueuePtr = NULL;
+        reactorPtr->lastQueuePtr = NULL;
+        stop = reactorPtr->shutdownPending;
+        reactorPtr->stats.dispatched += dispatched;
+        reactorPtr->stats.timeouts += timeouts;
+        reactorPtr->stats.wakeups += wakeups;
+        Ns_IncrTime(&reactorPtr->stats.busy, busy.sec, busy.usec);
+        Ns_MutexUnlock(&reactorPtr->lock);
+        dispatched = timeouts = wakeups = 0u;
+        busy.sec = 0;
+        busy.usec = 0;
 
         /*
          * Move any queued callbacks to the activeCallbacks table.
@@ -387,10 +847,9 @@ SockCallbackThread(void *UNUSED(arg))
                  * We have a cancel callback. Find active callback in
                  * hash table and remove it.
                  */
-                hPtr = Tcl_FindHashEntry(&activeCallbacks, NSSOCK2PTR(cbPtr->sock));
+                hPtr = Tcl_FindHashEntry(&reactorPtr->activeCallbacks, NSSOCK2PTR(cbPtr->sock));
                 if (hPtr != NULL) {
-                    ns_free(Tcl_GetHashValue(hPtr));
-                    Tcl_DeleteHashEntry(hPtr);
+                    CallbackRemove(reactorPtr, hPtr);
                 }
                 /*
                  * If there is a callback proc, execute it.
@@ -403,98 +862,121 @@ SockCallbackThread(void *UNUSED(arg))
                 }
                 ns_free(cbPtr);
             } else {
-                hPtr = Tcl_CreateHashEntry(&activeCallbacks, NSSOCK2PTR(cbPtr->sock), &isNew);
-                if (isNew == 0) {
-                    ns_free(Tcl_GetHashValue(hPtr));
-                }
-                Tcl_SetHashValue(hPtr, cbPtr);
+                CallbackAdd(reactorPtr, cbPtr);
             }
             cbPtr = nextPtr;
         }
 
         /*
-         * Check, if we have to extend maxPollfds and realloc memory if
-         * necessary.
+         * Process expired sockets.
          */
-        if (maxPollfds <= (size_t)activeCallbacks.numEntries) {
-            maxPollfds  = (size_t)activeCallbacks.numEntries + 100u;
-            pfds = (struct pollfd *)ns_realloc(pfds, sizeof(struct pollfd) * maxPollfds);
+        pollTimeout = CallbackTimeouts(reactorPtr, &timeouts);
+
+        if (stop) {
+            break;
         }
 
+#ifdef NS_SOCKCALLBACK_EPOLL
         /*
-         * Wake up every 30 seconds to process expired sockets
+         * Wait for events and drain the trigger pipe if necessary.
          */
+        do {
+            Ns_Log(Debug, "SockCallback before epoll_wait nfds %ld timeout %ld",
+                   (long)reactorPtr->activeCallbacks.numEntries, pollTimeout);
+            n = epoll_wait(reactorPtr->epfd, events, maxEvents, (int)pollTimeout);
+            Ns_Log(Debug, "SockCallback epoll_wait returned %d", n);
+        } while (n < 0  && errno == EINTR);
 
-        pollTimeout = 30000;
-        Ns_GetTime(&now);
+        if (n < 0) {
+            Ns_Fatal("sockcallback: epoll_wait() failed: %s", strerror(errno));
+        }
 
         /*
-         * Verify and set the poll bits for all active callbacks.
+         * Execute any ready callbacks.
          */
+        Ns_GetTime(&startTime);
+        {
+            int j;
 
-        nfds = 1;
-        for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
-            cbPtr = Tcl_GetHashValue(hPtr);
-            if ((cbPtr->timeout.sec > 0 || cbPtr->timeout.usec > 0)) {
+            for (j = 0; j < n; j++) {
+                uint32_t     revents = events[j].events;
+                unsigned int ready = 0u;
 
-                if (Ns_DiffTime(&now, &cbPtr->expires, &diff) > 0) {
+                if (events[j].data.fd == reactorPtr->trigPipe[0]) {
+                    if (recv(reactorPtr->trigPipe[0], &c, 1, 0) != 1) {
+                        Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+                    }
+                    wakeups++;
+                    continue;
+                }
+                hPtr = Tcl_FindHashEntry(&reactorPtr->activeCallbacks, NSSOCK2PTR(events[j].data.fd));
+                if (hPtr == NULL) {
+                    continue;
+                }
+                if ((revents & (uint32_t)EPOLLIN) != 0u) {
+                    ready |= (unsigned int)NS_SOCK_READ;
+                }
+                if ((revents & (uint32_t)EPOLLOUT) != 0u) {
+                    ready |= (unsigned int)NS_SOCK_WRITE;
+                }
+                if ((revents & ((uint32_t)EPOLLERR | (uint32_t)EPOLLHUP)) != 0u) {
                     /*
-                     * Call Ns_SockProc to notify about timeout. For the
-                     * time being, ignore boolean result.
+                     * Errors and hangups are reported by epoll regardless
+                     * of the registered events. Report them to all
+                     * registered callback types, such that the callback
+                     * sees the end of file or the error; otherwise, e.g.
+                     * a write-only callback would never be called and
+                     * epoll_wait() would return immediately forever.
                      */
-                    Ns_Log(Notice, "sockcallback: fd %d timeout " NS_TIME_FMT " exceeded by " NS_TIME_FMT,
-                           cbPtr->sock, (int64_t) cbPtr->timeout.sec, cbPtr->timeout.usec,
-                           (int64_t) diff.sec, diff.usec
-                           );
-                    (void) (*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_TIMEOUT);
-                    cbPtr->when = 0u;
+                    ready |= ((Callback *)Tcl_GetHashValue(hPtr))->when;
                 }
+                dispatched += CallbackDispatch(reactorPtr, hPtr, ready);
             }
-            if ((cbPtr->when & NS_SOCK_ANY) == 0u) {
-                Tcl_DeleteHashEntry(hPtr);
-                ns_free(cbPtr);
-            } else {
-                cbPtr->idx = nfds;
-                pfds[nfds].fd = cbPtr->sock;
-                pfds[nfds].events = pfds[nfds].revents = 0;
-                for (i = 0; i < Ns_NrElements(when); ++i) {
-                    //Ns_Log(Notice, "SockCallback check when[%d]: fd %d %.4x", i, pfds[i].fd, when[i]);
-                    if ((cbPtr->when & when[i]) != 0u) {
-                        pfds[nfds].events = (short)(pfds[nfds].events | events[i]);
-                    }
-                }
-                ++nfds;
-
-                if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
-                    time_t to = diff.sec * -1000 + diff.usec / 1000 + 1;
+        }
+        if (n == maxEvents) {
+            maxEvents *= 2;
+            events = ns_realloc(events, sizeof(struct epoll_event) * (size_t)maxEvents);
+        }
+#else
+        /*
+         * Check, if we have to extend maxPollfds and realloc memory if
+         * necessary.
+         */
+        if (maxPollfds <= (size_t)reactorPtr->activeCallbacks.numEntries) {
+            maxPollfds  = (size_t)reactorPtr->activeCallbacks.numEntries + 100u;
+            pfds = (struct pollfd *)ns_realloc(pfds, sizeof(struct pollfd) * maxPollfds);
+        }
 
-                    if (to < pollTimeout)  {
-                        /*
-                         * Reduce poll timeout to smaller value.
-                         */
-                        pollTimeout = (long)to;
-                    }
-                }
+        /*
+         * Set the poll bits for all active callbacks.
+         */
+        i = 1;
+        for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            cbPtr = Tcl_GetHashValue(hPtr);
+            cbPtr->idx = i;
+            pfds[i].fd = cbPtr->sock;
+            pfds[i].events = pfds[i].revents = 0;
+            if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
+                pfds[i].events |= (short)POLLIN;
             }
+            if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
+                pfds[i].events |= (short)POLLOUT;
+            }
+            if ((cbPtr->when & (unsigned int)NS_SOCK_EXCEPTION) != 0u) {
+                pfds[i].events |= (short)POLLERR;
+            }
+            ++i;
         }
 
-        /*for (i=0; i<(int)nfds; i++) {
-            Ns_Log(Notice, "SockCallback pollbits [%d]: fd %d %.4x", i, pfds[i].fd, pfds[i].events);
-            }*/
-
         /*
          * Call poll() on the sockets and drain the trigger pipe if
          * necessary.
          */
-
-        if (stop) {
-            break;
-        }
-
         pfds[0].revents = 0;
         do {
-            Ns_Log(Debug, "SockCallback before poll nfds %ld timeout %zd", (long)nfds, pollTimeout);
-            n = ns_poll(pfds, nfds, pollTimeout);
+            Ns_Log(Debug, "SockCallback before poll nfds %ld timeout %ld", (long)i, pollTimeout);
+            n = ns_poll(pfds, i, pollTimeout);
             Ns_Log(Debug, "SockCallback poll returned %d", n);
         } while (n < 0  && errno == NS_EINTR);
 
@@ -502,49 +984,54 @@ SockCallbackThread(void *UNUSED(arg))
             Ns_Fatal("sockcallback: ns_poll() failed: %s",
                      ns_sockstrerror(ns_sockerrno));
         }
-        if (((pfds[0].revents & POLLIN) != 0)
-            && recv(trigPipe[0], &c, 1, 0) != 1) {
-            Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+        if ((pfds[0].revents & POLLIN) != 0) {
+            if (recv(reactorPtr->trigPipe[0], &c, 1, 0) != 1) {
+                Ns_Fatal("trigger ns_read() failed: %s", strerror(errno));
+            }
+            wakeups++;
         }
 
+        /*
+         * Execute any ready callbacks.
+         */
+        Ns_GetTime(&startTime);
         if (n > 0) {
-            /*
-             * Execute any ready callbacks.
-             */
-            for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL;
+            for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
                  hPtr = Tcl_NextHashEntry(&search)) {
+                short        revents;
+                unsigned int ready = 0u;
+
                 cbPtr = Tcl_GetHashValue(hPtr);
-                for (i = 0; i < Ns_NrElements(when); ++i) {
-                    if (((cbPtr->when & when[i]) != 0u)
-                        && (pfds[cbPtr->idx].revents & events[i]) != 0) {
-                        /*
-                         * Call the Sock_Proc with the SockState flag
-                         * combination from when[i]. This is actually
-                         * the only place, where an Ns_SockProc is called
-                         * with a flag combination in the last
-                         * argument. If this would not be the case, we
-                         * could set the type of the last parameter of
-                         * Ns_SockProc to Ns_SockState.
-                         */
-                        if ((*cbPtr->proc)(cbPtr->sock, cbPtr->arg, when[i]) == NS_FALSE) {
-                            cbPtr->when = 0u;
-                        } else {
-                            if (cbPtr->timeout.sec != 0 || cbPtr->timeout.usec != 0) {
-                                Ns_GetTime(&cbPtr->expires);
-                                Ns_IncrTime(&cbPtr->expires, cbPtr->timeout.sec, cbPtr->timeout.usec);
-                            }
-                        }
-                    }
+                revents = pfds[cbPtr->idx].revents;
+                if ((revents & POLLIN) != 0) {
+                    ready |= (unsigned int)NS_SOCK_READ;
+                }
+                if ((revents & POLLOUT) != 0) {
+                    ready |= (unsigned int)NS_SOCK_WRITE;
+                }
+                if ((revents & (POLLERR|POLLHUP)) != 0) {
+                    /*
+                     * See the epoll case above.
+                     */
+                    ready |= cbPtr->when;
+                }
+                if (ready != 0u) {
+                    dispatched += CallbackDispatch(reactorPtr, hPtr, ready);
                 }
             }
         }
+#endif
+        Ns_GetTime(&endTime);
+        (void)Ns_DiffTime(&endTime, &startTime, &diff);
+        Ns_IncrTime(&busy, diff.sec, diff.usec);
     }
     /*
      * Fire socket exit callbacks.
      */
 
     Ns_Log(Notice, "socks: shutdown pending");
-    for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+    for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
         cbPtr = Tcl_GetHashValue(hPtr);
         if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
             (void) ((*cbPtr->proc)(cbPtr->sock, cbPtr->arg, (unsigned int)NS_SOCK_EXIT));
@@ -553,24 +1040,31 @@ SockCallbackThread(void *UNUSED(arg))
     /*
      * Clean up the registered callbacks.
      */
-    for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+    for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
         ns_free(Tcl_GetHashValue(hPtr));
     }
-    Tcl_DeleteHashTable(&activeCallbacks);
+#ifdef NS_SOCKCALLBACK_EPOLL
+    ns_free(events);
+    (void)close(reactorPtr->epfd);
+    reactorPtr->epfd = -1;
+#else
     ns_free(pfds);
+#endif
 
     Ns_Log(Notice, "socks: shutdown complete");
 
     /*
      * Tell others that shutdown is complete.
      */
-    Ns_MutexLock(&lock);
-    running = NS_FALSE;
-    Ns_CondBroadcast(&cond);
-    Ns_MutexUnlock(&lock);
+    Ns_MutexLock(&reactorPtr->lock);
+    Tcl_DeleteHashTable(&reactorPtr->activeCallbacks);
+    reactorPtr->running = NS_FALSE;
+    Ns_CondBroadcast(&reactorPtr->cond);
+    Ns_MutexUnlock(&reactorPtr->lock);
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -592,46 +1086,101 @@ SockCallbackThread(void *UNUSED(arg))
 void
 NsGetSockCallbacks(Tcl_DString *dsPtr)
 {
-    Tcl_HashSearch  search;
+    int i;
 
     NS_NONNULL_ASSERT(dsPtr != NULL);
 
-    Ns_MutexLock(&lock);
-    if (running) {
-        const Tcl_HashEntry *hPtr;
+    for (i = 0; i < nReactors; i++) {
+        Reactor *reactorPtr = &reactors[i];
 
-        for (hPtr = Tcl_FirstHashEntry(&activeCallbacks, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
-            const Callback *cbPtr = Tcl_GetHashValue(hPtr);
-            char            buf[TCL_INTEGER_SPACE];
+        Ns_MutexLock(&reactorPtr->lock);
+        if (reactorPtr->running) {
+            const Tcl_HashEntry *hPtr;
+            Tcl_HashSearch       search;
 
-            /*
-             * The "when" conditions are ORed together. Return these
-             * as a sublist of conditions.
-             */
-            Tcl_DStringStartSublist(dsPtr);
-            snprintf(buf, sizeof(buf), "%d", (int) cbPtr->sock);
-            Tcl_DStringAppendElement(dsPtr, buf);
-            Tcl_DStringStartSublist(dsPtr);
-            if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "read");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "write");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_EXCEPTION) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "exception");
-            }
-            if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
-                Tcl_DStringAppendElement(dsPtr, "exit");
+            for (hPtr = Tcl_FirstHashEntry(&reactorPtr->activeCallbacks, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                const Callback *cbPtr = Tcl_GetHashValue(hPtr);
+                char            buf[TCL_INTEGER_SPACE];
+
+                /*
+                 * The "when" conditions are ORed together. Return these
+                 * as a sublist of conditions.
+                 */
+                Tcl_DStringStartSublist(dsPtr);
+                snprintf(buf, sizeof(buf), "%d", (int) cbPtr->sock);
+                Tcl_DStringAppendElement(dsPtr, buf);
+                Tcl_DStringStartSublist(dsPtr);
+                if ((cbPtr->when & (unsigned int)NS_SOCK_READ) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "read");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_WRITE) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "write");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_EXCEPTION) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "exception");
+                }
+                if ((cbPtr->when & (unsigned int)NS_SOCK_EXIT) != 0u) {
+                    Tcl_DStringAppendElement(dsPtr, "exit");
+                }
+                Tcl_DStringEndSublist(dsPtr);
+                Ns_GetProcInfo(dsPtr, (ns_funcptr_t)cbPtr->proc, cbPtr->arg);
+                Tcl_DStringAppend(dsPtr, " ", 1);
+                Ns_DStringAppendTime(dsPtr, &cbPtr->timeout);
+                Tcl_DStringEndSublist(dsPtr);
             }
-            Tcl_DStringEndSublist(dsPtr);
-            Ns_GetProcInfo(dsPtr, (ns_funcptr_t)cbPtr->proc, cbPtr->arg);
-            Tcl_DStringAppend(dsPtr, " ", 1);
-            Ns_DStringAppendTime(dsPtr, &cbPtr->timeout);
-            Tcl_DStringEndSublist(dsPtr);
         }
+        Ns_MutexUnlock(&reactorPtr->lock);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsGetSockCallbackReactors --
+ *
+ *      Return statistics about the socket callback reactors in form
+ *      of a Tcl list of dicts in the provided Tcl_DString. The passed
+ *      Tcl_DString has to be initialized by the caller.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      DString is updated
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsGetSockCallbackReactors(Tcl_DString *dsPtr)
+{
+    int i;
+
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    for (i = 0; i < nReactors; i++) {
+        Reactor *reactorPtr = &reactors[i];
+
+        Ns_MutexLock(&reactorPtr->lock);
+        Tcl_DStringStartSublist(dsPtr);
+        Ns_DStringPrintf(dsPtr, "name %s backend %s running %d sockets %ld"
+                         " queued %lu dispatched %lu timeouts %lu wakeups %lu busytime ",
+                         reactorPtr->threadName,
+#ifdef NS_SOCKCALLBACK_EPOLL
+                         "epoll",
+#else
+                         "poll",
+#endif
+                         reactorPtr->running ? 1 : 0,
+                         reactorPtr->running ? (long)reactorPtr->activeCallbacks.numEntries : 0L,
+                         reactorPtr->stats.queued, reactorPtr->stats.dispatched,
+                         reactorPtr->stats.timeouts, reactorPtr->stats.wakeups);
+        Ns_DStringAppendTime(dsPtr, &reactorPtr->stats.busy);
+        Tcl_DStringEndSublist(dsPtr);
+        Ns_MutexUnlock(&reactorPtr->lock);
     }
-    Ns_MutexUnlock(&lock);
 }
 
 /*
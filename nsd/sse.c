@@ -0,0 +1,1509 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * sse.c --
+ *
+ *      Support for Server-Sent Events (SSE) via the "ns_sse" command.
+ *      After sending the response headers, the socket is detached from
+ *      the connection thread and handed to a single SSE writer
+ *      thread. The writer thread multiplexes all SSE clients with
+ *      non-blocking writes, sends heartbeats to idle clients and
+ *      detects closed connections. Events can be sent to single
+ *      clients or published to topics from every thread. Every client
+ *      has a bound for the buffered (not yet sent) data; clients
+ *      exceeding this limit are either closed or lose events.
+ */
+
+#include "nsd.h"
+
+#define SSE_DEFAULT_MAXBUFFER  (1024 * 1024)
+#define SSE_DEFAULT_HEARTBEAT  15
+#define SSE_COMPACT_THRESHOLD  16384u
+
+typedef enum {
+    SSE_OVERFLOW_CLOSE,
+    SSE_OVERFLOW_DROP
+} SseOverflow;
+
+/*
+ * The following structure defines an SSE client. Clients are created
+ * by "ns_sse open" and are owned by the writer thread, which is the
+ * only place where clients are freed. Other threads append to
+ * "pending" under sse.lock. The writer thread moves this data to
+ * "outbuf" and sends it without holding the lock; the members marked
+ * as "writer only" are not accessed by other threads.
+ */
+
+typedef struct SseClient {
+    struct SseClient *nextPtr;
+    char              name[TCL_INTEGER_SPACE + 4];
+    NsServer         *servPtr;
+    Sock             *sockPtr;
+    char              peer[NS_IPADDR_SIZE];
+    Ns_Time           startTime;
+    Ns_Time           lastActivity;       /* Time of the last queued data */
+    Ns_Time           heartbeat;
+    size_t            maxBuffer;
+    SseOverflow       overflow;
+    Tcl_DString       pending;            /* Queued data, not yet handed to the writer */
+    size_t            unsent;             /* Unsent bytes of outbuf, updated under sse.lock */
+    Tcl_DString       outbuf;             /* Data being sent (writer only) */
+    size_t            offset;             /* Already sent bytes from outbuf (writer only) */
+    size_t            inflight;           /* Length of a rejected TLS write, which has to be repeated (writer only) */
+    size_t            sentNow;            /* Bytes sent in the current round (writer only) */
+    NS_POLL_NFDS_TYPE pollIdx;            /* (writer only) */
+    bool              finish;             /* Close after the current round (writer only) */
+    bool              failed;             /* Send or receive failed (writer only) */
+    bool              closing;
+    bool              dead;
+    struct {
+        size_t        sent;
+        unsigned long events;
+        unsigned long dropped;
+        unsigned long heartbeats;
+    } stats;
+} SseClient;
+
+/*
+ * Local functions defined in this file.
+ */
+
+static void SseStartWriter(void);
+static void SseTrigger(void);
+static Ns_ThreadProc SseWriterThread;
+static Ns_ShutdownProc SseShutdown;
+
+static SseClient *SseClientGet(Tcl_Interp *interp, const NsServer *servPtr, const char *name)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static bool SseClientQueue(SseClient *clientPtr, const char *data, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void SseClientFlush(SseClient *clientPtr)
+    NS_GNUC_NONNULL(1);
+static void SseClientRead(SseClient *clientPtr)
+    NS_GNUC_NONNULL(1);
+static void SseClientUnregister(SseClient *clientPtr)
+    NS_GNUC_NONNULL(1);
+static void SseClientFree(SseClient *clientPtr)
+    NS_GNUC_NONNULL(1);
+static int SseFormatEvent(Tcl_Interp *interp, Tcl_DString *dsPtr, const char *event, const char *id,
+                          int retry, const char *data, TCL_SIZE_T length)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(6);
+
+static TCL_OBJCMDPROC_T SseCloseObjCmd;
+static TCL_OBJCMDPROC_T SseListObjCmd;
+static TCL_OBJCMDPROC_T SseOpenObjCmd;
+static TCL_OBJCMDPROC_T SsePublishObjCmd;
+static TCL_OBJCMDPROC_T SseSendObjCmd;
+static TCL_OBJCMDPROC_T SseStatsObjCmd;
+static TCL_OBJCMDPROC_T SseStatusObjCmd;
+static TCL_OBJCMDPROC_T SseSubscribeObjCmd;
+static TCL_OBJCMDPROC_T SseUnsubscribeObjCmd;
+
+/*
+ * Static variables defined in this file.
+ */
+
+static struct {
+    Ns_Mutex          lock;
+    Ns_Cond           cond;
+    Ns_Thread         thread;
+    bool              running;
+    bool              stopping;
+    bool              triggered;
+    NS_SOCKET         trigPipe[2];
+    SseClient        *firstClientPtr;
+    Tcl_HashTable     clients;            /* Open clients, keys are client names */
+    unsigned long     nextId;
+    struct {
+        unsigned long published;
+        unsigned long events;
+        unsigned long dropped;
+        unsigned long overflows;
+        unsigned long heartbeats;
+        unsigned long closed;
+        size_t        sent;
+    } stats;
+} sse;
+
+static const char heartbeatString[] = ": keepalive\n\n";
+
+static Ns_ObjvTable overflowTable[] = {
+    {"close", (unsigned int)SSE_OVERFLOW_CLOSE},
+    {"drop",  (unsigned int)SSE_OVERFLOW_DROP},
+    {NULL,    0u}
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitSse --
+ *
+ *      Initialize the SSE subsystem. The writer thread is started on
+ *      demand by the first "ns_sse open".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitSse(void)
+{
+    Ns_MutexInit(&sse.lock);
+    Ns_MutexSetName(&sse.lock, "ns:sse");
+    Ns_CondInit(&sse.cond);
+    Tcl_InitHashTable(&sse.clients, TCL_STRING_KEYS);
+    sse.trigPipe[0] = NS_INVALID_SOCKET;
+    sse.trigPipe[1] = NS_INVALID_SOCKET;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseStartWriter --
+ *
+ *      Start the SSE writer thread, unless it is already
+ *      running. Must be called with sse.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Creates the trigger pipe and the writer thread, registers a
+ *      shutdown procedure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseStartWriter(void)
+{
+    if (!sse.running) {
+        if (ns_sockpair(sse.trigPipe) != 0) {
+            Ns_Fatal("sse: ns_sockpair() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+        sse.running = NS_TRUE;
+        sse.stopping = NS_FALSE;
+        Ns_ThreadCreate(SseWriterThread, NULL, 0, &sse.thread);
+        (void) Ns_RegisterAtShutdown(SseShutdown, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseTrigger --
+ *
+ *      Wake up the writer thread, e.g. after new data was
+ *      queued. Must be called with sse.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes a byte to the trigger pipe, unless a wakeup is already
+ *      pending.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseTrigger(void)
+{
+    if (sse.running && !sse.triggered) {
+        sse.triggered = NS_TRUE;
+        if (ns_send(sse.trigPipe[1], NS_EMPTY_STRING, 1u, 0) != 1) {
+            Ns_Fatal("sse: trigger send() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseShutdown --
+ *
+ *      Shutdown procedure for the SSE writer thread. The first call
+ *      (with NULL timeout) signals the thread to stop, the second
+ *      call waits for the thread to finish.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      All SSE client connections are closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseShutdown(const Ns_Time *toPtr, void *UNUSED(arg))
+{
+    Ns_ReturnCode status = NS_OK;
+
+    Ns_MutexLock(&sse.lock);
+    if (toPtr == NULL) {
+        sse.stopping = NS_TRUE;
+        SseTrigger();
+    } else {
+        while (sse.running && status == NS_OK) {
+            status = Ns_CondTimedWait(&sse.cond, &sse.lock, toPtr);
+        }
+    }
+    Ns_MutexUnlock(&sse.lock);
+
+    if (toPtr != NULL) {
+        if (status != NS_OK) {
+            Ns_Log(Warning, "sse: timeout waiting for writer thread exit");
+        } else if (sse.thread != NULL) {
+            Ns_ThreadJoin(&sse.thread, NULL);
+            sse.thread = NULL;
+            ns_sockclose(sse.trigPipe[0]);
+            ns_sockclose(sse.trigPipe[1]);
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseWriterThread --
+ *
+ *      Thread serving all SSE clients. The thread polls the sockets of
+ *      all clients, writes buffered data when the sockets are
+ *      writable, sends heartbeats to idle clients and frees clients
+ *      which are closed or have lost their connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Writes to and closes client sockets.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseWriterThread(void *UNUSED(arg))
+{
+    struct pollfd    *pfds = NULL;
+    NS_POLL_NFDS_TYPE maxFds = 0u;
+    SseClient        *clientPtr, *firstPtr, **nextPtrPtr;
+
+    Ns_ThreadSetName("-sse-");
+    Ns_Log(Notice, "sse: starting");
+
+    Ns_MutexLock(&sse.lock);
+    while (!sse.stopping) {
+        NS_POLL_NFDS_TYPE nfds = 1u;
+        long              pollTimeout = -1;
+        Ns_Time           now;
+        int               n;
+
+        /*
+         * Build the poll set. The first entry is the trigger pipe. The
+         * socket of every client is polled for reading to detect
+         * closed connections and for writing, when there is buffered
+         * data.
+         */
+        Ns_GetTime(&now);
+        for (clientPtr = sse.firstClientPtr; clientPtr != NULL; clientPtr = clientPtr->nextPtr) {
+            if (nfds >= maxFds) {
+                maxFds = nfds + 100u;
+                pfds = ns_realloc(pfds, maxFds * sizeof(struct pollfd));
+            }
+            clientPtr->pollIdx = nfds;
+            pfds[nfds].fd = clientPtr->sockPtr->sock;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            if (clientPtr->pending.length > 0 || (size_t)clientPtr->outbuf.length > clientPtr->offset) {
+                pfds[nfds].events |= POLLOUT;
+            }
+            if (clientPtr->heartbeat.sec > 0 || clientPtr->heartbeat.usec > 0) {
+                Ns_Time due, diff;
+                long    ms;
+
+                due = clientPtr->lastActivity;
+                Ns_IncrTime(&due, clientPtr->heartbeat.sec, clientPtr->heartbeat.usec);
+                ms = (Ns_DiffTime(&due, &now, &diff) > 0) ? (long)Ns_TimeToMilliseconds(&diff) + 1 : 0;
+                if (pollTimeout < 0 || ms < pollTimeout) {
+                    pollTimeout = ms;
+                }
+            }
+            nfds++;
+        }
+        if (pfds == NULL) {
+            maxFds = 100u;
+            pfds = ns_malloc(maxFds * sizeof(struct pollfd));
+        }
+        pfds[0].fd = sse.trigPipe[0];
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        Ns_MutexUnlock(&sse.lock);
+
+        do {
+            n = ns_poll(pfds, nfds, pollTimeout);
+        } while (n < 0 && errno == NS_EINTR);
+
+        if (n < 0) {
+            Ns_Fatal("sse: ns_poll() failed: %s", ns_sockstrerror(ns_sockerrno));
+        }
+
+        Ns_MutexLock(&sse.lock);
+        if ((pfds[0].revents & POLLIN) != 0) {
+            char c;
+
+            if (recv(sse.trigPipe[0], &c, 1, 0) != 1) {
+                Ns_Fatal("sse: trigger recv() failed: %s", ns_sockstrerror(ns_sockerrno));
+            }
+            sse.triggered = NS_FALSE;
+        }
+
+        /*
+         * Queue heartbeats and hand the queued data of all clients over
+         * to the writer. Clients added while polling are at the front of
+         * the list and have no valid poll index.
+         */
+        Ns_GetTime(&now);
+        for (clientPtr = sse.firstClientPtr; clientPtr != NULL; clientPtr = clientPtr->nextPtr) {
+            if (!clientPtr->dead
+                && !clientPtr->closing
+                && clientPtr->pending.length == 0
+                && (size_t)clientPtr->outbuf.length == clientPtr->offset
+                && (clientPtr->heartbeat.sec > 0 || clientPtr->heartbeat.usec > 0)) {
+                Ns_Time due;
+
+                due = clientPtr->lastActivity;
+                Ns_IncrTime(&due, clientPtr->heartbeat.sec, clientPtr->heartbeat.usec);
+                if (Ns_DiffTime(&due, &now, NULL) <= 0) {
+                    Tcl_DStringAppend(&clientPtr->pending, heartbeatString,
+                                      (TCL_SIZE_T)sizeof(heartbeatString) - 1);
+                    clientPtr->lastActivity = now;
+                    clientPtr->stats.heartbeats++;
+                    sse.stats.heartbeats++;
+                }
+            }
+            if (clientPtr->pending.length > 0) {
+                Tcl_DStringAppend(&clientPtr->outbuf, clientPtr->pending.string, clientPtr->pending.length);
+                Tcl_DStringSetLength(&clientPtr->pending, 0);
+            }
+            clientPtr->finish = clientPtr->closing;
+        }
+        firstPtr = sse.firstClientPtr;
+        Ns_MutexUnlock(&sse.lock);
+
+        /*
+         * Receive and send without holding the lock, such that "ns_sse
+         * send" and "ns_sse publish" are not blocked by the I/O. Other
+         * threads only add clients to the front of the list, and only
+         * this thread removes clients.
+         */
+        for (clientPtr = firstPtr; clientPtr != NULL; clientPtr = clientPtr->nextPtr) {
+            if (clientPtr->pollIdx > 0u && clientPtr->pollIdx < nfds
+                && (pfds[clientPtr->pollIdx].revents & (POLLIN|POLLHUP|POLLERR|POLLNVAL)) != 0) {
+                SseClientRead(clientPtr);
+            }
+            if (!clientPtr->failed && (size_t)clientPtr->outbuf.length > clientPtr->offset) {
+                SseClientFlush(clientPtr);
+            }
+        }
+
+        /*
+         * Update the statistics and free the clients, which are closed
+         * or have lost their connection.
+         */
+        Ns_MutexLock(&sse.lock);
+        nextPtrPtr = &sse.firstClientPtr;
+        while ((clientPtr = *nextPtrPtr) != NULL) {
+            clientPtr->stats.sent += clientPtr->sentNow;
+            sse.stats.sent += clientPtr->sentNow;
+            clientPtr->sentNow = 0u;
+            clientPtr->unsent = (size_t)clientPtr->outbuf.length - clientPtr->offset;
+            if (clientPtr->failed || clientPtr->finish) {
+                /*
+                 * For closing clients, the final flush was attempted.
+                 */
+                clientPtr->dead = NS_TRUE;
+            }
+            clientPtr->pollIdx = 0u;
+
+            if (clientPtr->dead) {
+                *nextPtrPtr = clientPtr->nextPtr;
+                SseClientUnregister(clientPtr);
+                SseClientFree(clientPtr);
+            } else {
+                nextPtrPtr = &clientPtr->nextPtr;
+            }
+        }
+    }
+
+    /*
+     * Shutdown: close all client connections.
+     */
+    while ((clientPtr = sse.firstClientPtr) != NULL) {
+        sse.firstClientPtr = clientPtr->nextPtr;
+        SseClientUnregister(clientPtr);
+        SseClientFree(clientPtr);
+    }
+    sse.running = NS_FALSE;
+    Ns_CondBroadcast(&sse.cond);
+    Ns_MutexUnlock(&sse.lock);
+
+    ns_free(pfds);
+    Ns_Log(Notice, "sse: exiting");
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientFlush --
+ *
+ *      Try to send the buffered data of a client without
+ *      blocking. Called by the writer thread without holding sse.lock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the send buffer; marks the client as failed on send
+ *      errors.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseClientFlush(SseClient *clientPtr)
+{
+    struct iovec iov;
+    ssize_t      sent;
+    size_t       toSend;
+
+    NS_NONNULL_ASSERT(clientPtr != NULL);
+
+    toSend = (size_t)clientPtr->outbuf.length - clientPtr->offset;
+    if (clientPtr->inflight > 0u && clientPtr->inflight <= toSend) {
+        /*
+         * OpenSSL requires to repeat a rejected write with the same
+         * length.
+         */
+        toSend = clientPtr->inflight;
+    }
+    iov.iov_base = clientPtr->outbuf.string + clientPtr->offset;
+    iov.iov_len = toSend;
+
+    sent = NsDriverSend(clientPtr->sockPtr, &iov, 1, 0u);
+    if (sent < 0) {
+        Ns_Log(Debug, "sse: %s send failed, closing", clientPtr->name);
+        clientPtr->failed = NS_TRUE;
+
+    } else if (sent == 0) {
+        if ((clientPtr->sockPtr->flags & NS_CONN_SSL_WANT_WRITE) != 0u) {
+            clientPtr->inflight = toSend;
+        }
+    } else {
+        clientPtr->inflight = 0u;
+        clientPtr->offset += (size_t)sent;
+        clientPtr->sentNow += (size_t)sent;
+
+        if (clientPtr->offset == (size_t)clientPtr->outbuf.length) {
+            Tcl_DStringSetLength(&clientPtr->outbuf, 0);
+            clientPtr->offset = 0u;
+        } else if (clientPtr->offset > SSE_COMPACT_THRESHOLD) {
+            size_t remaining = (size_t)clientPtr->outbuf.length - clientPtr->offset;
+
+            memmove(clientPtr->outbuf.string, clientPtr->outbuf.string + clientPtr->offset, remaining);
+            Tcl_DStringSetLength(&clientPtr->outbuf, (TCL_SIZE_T)remaining);
+            clientPtr->offset = 0u;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientRead --
+ *
+ *      Handle readable client sockets. SSE clients do not send data
+ *      after the request, so received data is discarded; end of file
+ *      or errors mark the client as failed. Called by the writer thread
+ *      without holding sse.lock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Consumes data from the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseClientRead(SseClient *clientPtr)
+{
+    char         buffer[1024];
+    struct iovec iov;
+    ssize_t      nRead;
+
+    NS_NONNULL_ASSERT(clientPtr != NULL);
+
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+    nRead = NsDriverRecv(clientPtr->sockPtr, &iov, 1, NULL);
+    if (nRead <= 0 && clientPtr->sockPtr->recvSockState != NS_SOCK_AGAIN) {
+        Ns_Log(Debug, "sse: %s connection closed by peer", clientPtr->name);
+        clientPtr->failed = NS_TRUE;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientQueue --
+ *
+ *      Append data to the send buffer of a client, respecting the
+ *      configured buffer limit of the client. Must be called with
+ *      sse.lock held.
+ *
+ * Results:
+ *      NS_TRUE when the data was queued, NS_FALSE when the data was
+ *      dropped.
+ *
+ * Side effects:
+ *      Clients exceeding the buffer limit with overflow policy "close"
+ *      are closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+SseClientQueue(SseClient *clientPtr, const char *data, size_t length)
+{
+    bool   success = NS_TRUE;
+    size_t buffered;
+
+    NS_NONNULL_ASSERT(clientPtr != NULL);
+    NS_NONNULL_ASSERT(data != NULL);
+
+    buffered = (size_t)clientPtr->pending.length + clientPtr->unsent;
+    if (clientPtr->closing || clientPtr->dead) {
+        success = NS_FALSE;
+
+    } else if (buffered + length > clientPtr->maxBuffer) {
+        clientPtr->stats.dropped++;
+        sse.stats.dropped++;
+        if (clientPtr->overflow == SSE_OVERFLOW_CLOSE) {
+            Ns_Log(Notice, "sse: %s exceeds buffer limit %" PRIuz ", closing",
+                   clientPtr->name, clientPtr->maxBuffer);
+            sse.stats.overflows++;
+            SseClientUnregister(clientPtr);
+            clientPtr->closing = NS_TRUE;
+            /*
+             * Do not deliver a truncated stream. The data handed to the
+             * writer consists of complete events.
+             */
+            Tcl_DStringSetLength(&clientPtr->pending, 0);
+        }
+        success = NS_FALSE;
+
+    } else {
+        Tcl_DStringAppend(&clientPtr->pending, data, (TCL_SIZE_T)length);
+        Ns_GetTime(&clientPtr->lastActivity);
+        clientPtr->stats.events++;
+        sse.stats.events++;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientUnregister --
+ *
+ *      Remove a client from the client table and from all topics of
+ *      its server, such that it can't receive further events. Must
+ *      be called with sse.lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Empty topics are deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseClientUnregister(SseClient *clientPtr)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+    Tcl_HashTable  *topicsPtr;
+
+    NS_NONNULL_ASSERT(clientPtr != NULL);
+
+    hPtr = Tcl_FindHashEntry(&sse.clients, clientPtr->name);
+    if (hPtr != NULL && Tcl_GetHashValue(hPtr) == clientPtr) {
+        Tcl_DeleteHashEntry(hPtr);
+    }
+
+    topicsPtr = &clientPtr->servPtr->sse.topics;
+    hPtr = Tcl_FirstHashEntry(topicsPtr, &search);
+    while (hPtr != NULL) {
+        Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+        Tcl_HashEntry *memberPtr = Tcl_FindHashEntry(membersPtr, (const char *)clientPtr);
+
+        if (memberPtr != NULL) {
+            Tcl_DeleteHashEntry(memberPtr);
+            if (membersPtr->numEntries == 0) {
+                Tcl_DeleteHashTable(membersPtr);
+                ns_free(membersPtr);
+                Tcl_DeleteHashEntry(hPtr);
+            }
+        }
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientFree --
+ *
+ *      Close the connection of a client and free its memory. The
+ *      client must be already unregistered and unlinked from the
+ *      client list.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Closes the socket.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SseClientFree(SseClient *clientPtr)
+{
+    NS_NONNULL_ASSERT(clientPtr != NULL);
+
+    Ns_Log(Debug, "sse: %s closed, sent %" PRIuz " bytes", clientPtr->name, clientPtr->stats.sent);
+    NsSockClose(clientPtr->sockPtr, (int)NS_FALSE);
+    Tcl_DStringFree(&clientPtr->pending);
+    Tcl_DStringFree(&clientPtr->outbuf);
+    sse.stats.closed++;
+    ns_free(clientPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseClientGet --
+ *
+ *      Look up an open SSE client of the specified server by
+ *      name. Must be called with sse.lock held.
+ *
+ * Results:
+ *      Client or NULL, in which case an error message is left in the
+ *      interpreter.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SseClient *
+SseClientGet(Tcl_Interp *interp, const NsServer *servPtr, const char *name)
+{
+    const Tcl_HashEntry *hPtr;
+    SseClient           *clientPtr = NULL;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(name != NULL);
+
+    hPtr = Tcl_FindHashEntry(&sse.clients, name);
+    if (hPtr != NULL) {
+        clientPtr = Tcl_GetHashValue(hPtr);
+        if (clientPtr->servPtr != servPtr) {
+            clientPtr = NULL;
+        }
+    }
+    if (clientPtr == NULL) {
+        Ns_TclPrintfResult(interp, "SSE channel \"%s\" does not exist", name);
+    }
+    return clientPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseFormatEvent --
+ *
+ *      Format an event according to the "text/event-stream" format.
+ *      Every line of the data is sent as a separate "data:" field.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Appends to the provided DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseFormatEvent(Tcl_Interp *interp, Tcl_DString *dsPtr, const char *event, const char *id,
+               int retry, const char *data, TCL_SIZE_T length)
+{
+    int result = TCL_OK;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(data != NULL);
+
+    if ((event != NULL && strpbrk(event, "\r\n") != NULL)
+        || (id != NULL && strpbrk(id, "\r\n") != NULL)) {
+        Ns_TclPrintfResult(interp, "event name and id must not contain line breaks");
+        result = TCL_ERROR;
+
+    } else {
+        const char *p = data, *end = data + length;
+
+        if (event != NULL) {
+            Ns_DStringVarAppend(dsPtr, "event: ", event, "\n", NS_SENTINEL);
+        }
+        if (id != NULL) {
+            Ns_DStringVarAppend(dsPtr, "id: ", id, "\n", NS_SENTINEL);
+        }
+        if (retry >= 0) {
+            Ns_DStringPrintf(dsPtr, "retry: %d\n", retry);
+        }
+        for (;;) {
+            const char *eol = memchr(p, INTCHAR('\n'), (size_t)(end - p));
+            const char *lineEnd = (eol != NULL) ? eol : end;
+
+            if (lineEnd > p && *(lineEnd - 1) == '\r') {
+                lineEnd--;
+            }
+            Tcl_DStringAppend(dsPtr, "data: ", 6);
+            Tcl_DStringAppend(dsPtr, p, (TCL_SIZE_T)(lineEnd - p));
+            Tcl_DStringAppend(dsPtr, "\n", 1);
+            if (eol == NULL) {
+                break;
+            }
+            p = eol + 1;
+        }
+        Tcl_DStringAppend(dsPtr, "\n", 1);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseOpenObjCmd --
+ *
+ *      Implements "ns_sse open". Sends the response headers of the
+ *      current connection and hands the socket to the SSE writer
+ *      thread. The connection thread is free afterwards.
+ *
+ * Results:
+ *      Tcl result code, the name of the SSE channel on success.
+ *
+ * Side effects:
+ *      The connection is detached from the connection thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseOpenObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    Conn             *connPtr = (Conn *)itPtr->conn;
+    int               result = TCL_OK, overflow = (int)SSE_OVERFLOW_CLOSE;
+    Tcl_WideInt       maxBuffer = SSE_DEFAULT_MAXBUFFER;
+    Ns_Time           heartbeat = {SSE_DEFAULT_HEARTBEAT, 0}, *heartbeatPtr = &heartbeat;
+    Ns_ObjvValueRange bufferRange = {1024, LLONG_MAX};
+    Ns_ObjvSpec       opts[] = {
+        {"-heartbeat", Ns_ObjvTime,    &heartbeatPtr, NULL},
+        {"-maxbuffer", Ns_ObjvMemUnit, &maxBuffer,    &bufferRange},
+        {"-overflow",  Ns_ObjvIndex,   &overflow,     overflowTable},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (connPtr == NULL) {
+        Ns_TclPrintfResult(interp, "no current connection");
+        result = TCL_ERROR;
+
+    } else if (connPtr->sockPtr == NULL || (connPtr->flags & NS_CONN_SENTHDRS) != 0u) {
+        Ns_TclPrintfResult(interp, "connection already closed or headers already sent");
+        result = TCL_ERROR;
+
+    } else {
+        Ns_Conn       *conn = itPtr->conn;
+        SseClient     *clientPtr;
+        Tcl_HashEntry *hPtr;
+        int            isNew;
+
+        clientPtr = ns_calloc(1u, sizeof(SseClient));
+        clientPtr->servPtr = itPtr->servPtr;
+        clientPtr->maxBuffer = (size_t)maxBuffer;
+        clientPtr->overflow = (SseOverflow)overflow;
+        clientPtr->heartbeat = *heartbeatPtr;
+        strncpy(clientPtr->peer, Ns_ConnConfiguredPeerAddr(conn), NS_IPADDR_SIZE - 1);
+        Ns_GetTime(&clientPtr->startTime);
+        clientPtr->lastActivity = clientPtr->startTime;
+        Tcl_DStringInit(&clientPtr->pending);
+        Tcl_DStringInit(&clientPtr->outbuf);
+
+        /*
+         * Construct the response headers. The headers are sent by the
+         * writer thread as the first data of the stream.
+         */
+        Ns_ConnSetResponseStatus(conn, 200);
+        Ns_ConnSetTypeHeader(conn, "text/event-stream");
+        Ns_ConnUpdateHeaders(conn, "Cache-Control", "no-cache");
+        Ns_ConnUpdateHeaders(conn, "X-Accel-Buffering", "no");
+        Ns_ConnConstructHeaders(conn, &clientPtr->pending);
+
+        /*
+         * Take over the socket from the connection. Mark the
+         * connection as closed, such that no further response is
+         * attempted.
+         */
+        clientPtr->sockPtr = connPtr->sockPtr;
+        connPtr->sockPtr = NULL;
+        connPtr->flags |= (NS_CONN_CLOSED|NS_CONN_SENTHDRS);
+
+        Ns_MutexLock(&sse.lock);
+        snprintf(clientPtr->name, sizeof(clientPtr->name), "sse%lu", sse.nextId++);
+        hPtr = Tcl_CreateHashEntry(&sse.clients, clientPtr->name, &isNew);
+        Tcl_SetHashValue(hPtr, clientPtr);
+        clientPtr->nextPtr = sse.firstClientPtr;
+        sse.firstClientPtr = clientPtr;
+        SseStartWriter();
+        SseTrigger();
+        Ns_MutexUnlock(&sse.lock);
+
+        Tcl_SetObjResult(interp, Tcl_NewStringObj(clientPtr->name, TCL_INDEX_NONE));
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseSendObjCmd --
+ *
+ *      Implements "ns_sse send". Queues an event for a single SSE
+ *      channel.
+ *
+ * Results:
+ *      Tcl result code, boolean result indicating whether the event
+ *      was queued.
+ *
+ * Side effects:
+ *      Wakes up the writer thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseSendObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    char             *name = NULL, *event = NULL, *id = NULL;
+    int               result = TCL_OK, retry = -1;
+    Tcl_Obj          *dataObj = NULL;
+    Ns_ObjvValueRange retryRange = {0, INT_MAX};
+    Ns_ObjvSpec       opts[] = {
+        {"-event", Ns_ObjvString, &event, NULL},
+        {"-id",    Ns_ObjvString, &id,    NULL},
+        {"-retry", Ns_ObjvInt,    &retry, &retryRange},
+        {"--",     Ns_ObjvBreak,  NULL,   NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec       args[] = {
+        {"channel", Ns_ObjvString, &name,    NULL},
+        {"data",    Ns_ObjvObj,    &dataObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_DString  ds;
+        TCL_SIZE_T   length;
+        const char  *data = Tcl_GetStringFromObj(dataObj, &length);
+
+        Tcl_DStringInit(&ds);
+        result = SseFormatEvent(interp, &ds, event, id, retry, data, length);
+        if (result == TCL_OK) {
+            SseClient *clientPtr;
+
+            Ns_MutexLock(&sse.lock);
+            clientPtr = SseClientGet(interp, itPtr->servPtr, name);
+            if (clientPtr == NULL) {
+                result = TCL_ERROR;
+            } else {
+                bool success = SseClientQueue(clientPtr, ds.string, (size_t)ds.length);
+
+                SseTrigger();
+                Tcl_SetObjResult(interp, Tcl_NewBooleanObj(success));
+            }
+            Ns_MutexUnlock(&sse.lock);
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SsePublishObjCmd --
+ *
+ *      Implements "ns_sse publish". Formats an event once and queues
+ *      it for all SSE channels subscribed to the topic. The command
+ *      can be used from every thread.
+ *
+ * Results:
+ *      Tcl result code, the number of channels the event was queued
+ *      for.
+ *
+ * Side effects:
+ *      Wakes up the writer thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SsePublishObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    char             *topic = NULL, *event = NULL, *id = NULL;
+    int               result = TCL_OK, retry = -1;
+    Tcl_Obj          *dataObj = NULL;
+    Ns_ObjvValueRange retryRange = {0, INT_MAX};
+    Ns_ObjvSpec       opts[] = {
+        {"-event", Ns_ObjvString, &event, NULL},
+        {"-id",    Ns_ObjvString, &id,    NULL},
+        {"-retry", Ns_ObjvInt,    &retry, &retryRange},
+        {"--",     Ns_ObjvBreak,  NULL,   NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec       args[] = {
+        {"topic", Ns_ObjvString, &topic,   NULL},
+        {"data",  Ns_ObjvObj,    &dataObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_DString  ds;
+        TCL_SIZE_T   length;
+        const char  *data = Tcl_GetStringFromObj(dataObj, &length);
+
+        Tcl_DStringInit(&ds);
+        result = SseFormatEvent(interp, &ds, event, id, retry, data, length);
+        if (result == TCL_OK) {
+            const Tcl_HashEntry *hPtr;
+            int                  nQueued = 0;
+
+            Ns_MutexLock(&sse.lock);
+            sse.stats.published++;
+            hPtr = Tcl_FindHashEntry(&itPtr->servPtr->sse.topics, topic);
+            if (hPtr != NULL) {
+                Tcl_HashTable  *membersPtr = Tcl_GetHashValue(hPtr);
+                Tcl_HashEntry  *memberPtr;
+                Tcl_HashSearch  search;
+
+                /*
+                 * Overflowing clients might be removed from the topic
+                 * during the iteration, so fetch the next entry first.
+                 */
+                memberPtr = Tcl_FirstHashEntry(membersPtr, &search);
+                while (memberPtr != NULL) {
+                    SseClient *clientPtr = (SseClient *)Tcl_GetHashKey(membersPtr, memberPtr);
+                    bool       lastMember = (membersPtr->numEntries == 1);
+
+                    memberPtr = Tcl_NextHashEntry(&search);
+                    if (SseClientQueue(clientPtr, ds.string, (size_t)ds.length)) {
+                        nQueued++;
+                    } else if (clientPtr->closing && lastMember) {
+                        /*
+                         * The topic was deleted together with its last
+                         * member.
+                         */
+                        break;
+                    }
+                }
+                SseTrigger();
+            }
+            Ns_MutexUnlock(&sse.lock);
+            Tcl_SetObjResult(interp, Tcl_NewIntObj(nQueued));
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseSubscribeObjCmd, SseUnsubscribeObjCmd --
+ *
+ *      Implements "ns_sse subscribe" and "ns_sse unsubscribe", adding
+ *      an SSE channel to a topic or removing it from a topic. Topics
+ *      are created on the first subscription and deleted when the
+ *      last subscriber leaves.
+ *
+ * Results:
+ *      Tcl result code, boolean result indicating whether the
+ *      subscriptions were changed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseSubscribeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *name = NULL, *topic = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"channel", Ns_ObjvString, &name,  NULL},
+        {"topic",   Ns_ObjvString, &topic, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        SseClient *clientPtr;
+
+        Ns_MutexLock(&sse.lock);
+        clientPtr = SseClientGet(interp, itPtr->servPtr, name);
+        if (clientPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            Tcl_HashEntry *hPtr;
+            Tcl_HashTable *membersPtr;
+            int            isNew;
+
+            hPtr = Tcl_CreateHashEntry(&itPtr->servPtr->sse.topics, topic, &isNew);
+            if (isNew != 0) {
+                membersPtr = ns_malloc(sizeof(Tcl_HashTable));
+                Tcl_InitHashTable(membersPtr, TCL_ONE_WORD_KEYS);
+                Tcl_SetHashValue(hPtr, membersPtr);
+            } else {
+                membersPtr = Tcl_GetHashValue(hPtr);
+            }
+            (void) Tcl_CreateHashEntry(membersPtr, (const char *)clientPtr, &isNew);
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(isNew));
+        }
+        Ns_MutexUnlock(&sse.lock);
+    }
+    return result;
+}
+
+static int
+SseUnsubscribeObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *name = NULL, *topic = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"channel", Ns_ObjvString, &name,  NULL},
+        {"topic",   Ns_ObjvString, &topic, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        SseClient *clientPtr;
+
+        Ns_MutexLock(&sse.lock);
+        clientPtr = SseClientGet(interp, itPtr->servPtr, name);
+        if (clientPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            Tcl_HashEntry *hPtr;
+            bool           removed = NS_FALSE;
+
+            hPtr = Tcl_FindHashEntry(&itPtr->servPtr->sse.topics, topic);
+            if (hPtr != NULL) {
+                Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+                Tcl_HashEntry *memberPtr = Tcl_FindHashEntry(membersPtr, (const char *)clientPtr);
+
+                if (memberPtr != NULL) {
+                    Tcl_DeleteHashEntry(memberPtr);
+                    removed = NS_TRUE;
+                    if (membersPtr->numEntries == 0) {
+                        Tcl_DeleteHashTable(membersPtr);
+                        ns_free(membersPtr);
+                        Tcl_DeleteHashEntry(hPtr);
+                    }
+                }
+            }
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(removed));
+        }
+        Ns_MutexUnlock(&sse.lock);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseCloseObjCmd --
+ *
+ *      Implements "ns_sse close". The channel is removed immediately
+ *      from all topics; the writer thread tries to send the buffered
+ *      data and closes the connection afterwards.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Wakes up the writer thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseCloseObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *name = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"channel", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        SseClient *clientPtr;
+
+        Ns_MutexLock(&sse.lock);
+        clientPtr = SseClientGet(interp, itPtr->servPtr, name);
+        if (clientPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            SseClientUnregister(clientPtr);
+            clientPtr->closing = NS_TRUE;
+            SseTrigger();
+        }
+        Ns_MutexUnlock(&sse.lock);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseListObjCmd --
+ *
+ *      Implements "ns_sse list". Returns the names of the open SSE
+ *      channels of the current server, or the channels subscribed to
+ *      a topic. With "-topics", the names of the topics are returned.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseListObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *topic = NULL;
+    int             result = TCL_OK, topics = 0;
+    Ns_ObjvSpec     opts[] = {
+        {"-topics", Ns_ObjvBool,  &topics, INT2PTR(NS_TRUE)},
+        {"--",      Ns_ObjvBreak, NULL,    NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec     args[] = {
+        {"?topic", Ns_ObjvString, &topic, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (topics == 1 && topic != NULL) {
+        Ns_TclPrintfResult(interp, "the option '-topics' can't be combined with a topic");
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_Obj             *listObj = Tcl_NewListObj(0, NULL);
+        Tcl_HashTable       *topicsPtr = &itPtr->servPtr->sse.topics;
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+
+        Ns_MutexLock(&sse.lock);
+        if (topics == 1) {
+            for (hPtr = Tcl_FirstHashEntry(topicsPtr, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                Tcl_ListObjAppendElement(NULL, listObj,
+                                         Tcl_NewStringObj(Tcl_GetHashKey(topicsPtr, hPtr), TCL_INDEX_NONE));
+            }
+        } else if (topic != NULL) {
+            hPtr = Tcl_FindHashEntry(topicsPtr, topic);
+            if (hPtr != NULL) {
+                Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+
+                for (hPtr = Tcl_FirstHashEntry(membersPtr, &search); hPtr != NULL;
+                     hPtr = Tcl_NextHashEntry(&search)) {
+                    const SseClient *clientPtr = (const SseClient *)Tcl_GetHashKey(membersPtr, hPtr);
+
+                    Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewStringObj(clientPtr->name, TCL_INDEX_NONE));
+                }
+            }
+        } else {
+            for (hPtr = Tcl_FirstHashEntry(&sse.clients, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                const SseClient *clientPtr = Tcl_GetHashValue(hPtr);
+
+                if (clientPtr->servPtr == itPtr->servPtr) {
+                    Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewStringObj(clientPtr->name, TCL_INDEX_NONE));
+                }
+            }
+        }
+        Ns_MutexUnlock(&sse.lock);
+        Tcl_SetObjResult(interp, listObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseStatusObjCmd --
+ *
+ *      Implements "ns_sse status", returning a dict with information
+ *      about an SSE channel.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseStatusObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *name = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"channel", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const SseClient *clientPtr;
+
+        Ns_MutexLock(&sse.lock);
+        clientPtr = SseClientGet(interp, itPtr->servPtr, name);
+        if (clientPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            Tcl_Obj             *dictObj = Tcl_NewDictObj(), *topicsObj = Tcl_NewListObj(0, NULL);
+            Tcl_HashTable       *topicsPtr = &itPtr->servPtr->sse.topics;
+            const Tcl_HashEntry *hPtr;
+            Tcl_HashSearch       search;
+
+            for (hPtr = Tcl_FirstHashEntry(topicsPtr, &search); hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                Tcl_HashTable *membersPtr = Tcl_GetHashValue(hPtr);
+
+                if (Tcl_FindHashEntry(membersPtr, (const char *)clientPtr) != NULL) {
+                    Tcl_ListObjAppendElement(NULL, topicsObj,
+                                             Tcl_NewStringObj(Tcl_GetHashKey(topicsPtr, hPtr), TCL_INDEX_NONE));
+                }
+            }
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("peer", 4),
+                                  Tcl_NewStringObj(clientPtr->peer, TCL_INDEX_NONE));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("start", 5),
+                                  Ns_TclNewTimeObj(&clientPtr->startTime));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("topics", 6), topicsObj);
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("buffered", 8),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)((size_t)clientPtr->pending.length + clientPtr->unsent)));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("maxbuffer", 9),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)clientPtr->maxBuffer));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("overflow", 8),
+                                  Tcl_NewStringObj(overflowTable[clientPtr->overflow].key, TCL_INDEX_NONE));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("heartbeat", 9),
+                                  Ns_TclNewTimeObj(&clientPtr->heartbeat));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("sent", 4),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)clientPtr->stats.sent));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("events", 6),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)clientPtr->stats.events));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("dropped", 7),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)clientPtr->stats.dropped));
+            (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("heartbeats", 10),
+                                  Tcl_NewWideIntObj((Tcl_WideInt)clientPtr->stats.heartbeats));
+            Tcl_SetObjResult(interp, dictObj);
+        }
+        Ns_MutexUnlock(&sse.lock);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SseStatsObjCmd --
+ *
+ *      Implements "ns_sse stats", returning a dict with global
+ *      statistics of the SSE writer.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SseStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_Obj *dictObj = Tcl_NewDictObj();
+
+        Ns_MutexLock(&sse.lock);
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("running", 7),
+                              Tcl_NewBooleanObj(sse.running));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("clients", 7),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.clients.numEntries));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("published", 9),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.published));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("events", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.events));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("dropped", 7),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.dropped));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("overflows", 9),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.overflows));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("heartbeats", 10),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.heartbeats));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("closed", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.closed));
+        (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("sent", 4),
+                              Tcl_NewWideIntObj((Tcl_WideInt)sse.stats.sent));
+        Ns_MutexUnlock(&sse.lock);
+        Tcl_SetObjResult(interp, dictObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclSseObjCmd --
+ *
+ *      Implements "ns_sse".
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Depends on the subcommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclSseObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"close",       SseCloseObjCmd},
+        {"list",        SseListObjCmd},
+        {"open",        SseOpenObjCmd},
+        {"publish",     SsePublishObjCmd},
+        {"send",        SseSendObjCmd},
+        {"stats",       SseStatsObjCmd},
+        {"status",      SseStatusObjCmd},
+        {"subscribe",   SseSubscribeObjCmd},
+        {"unsubscribe", SseUnsubscribeObjCmd},
+        {NULL, NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -163,6 +163,7 @@ static const Cmd basicCmds[] = {
     {"ns_truncate",              NsTclTruncateObjCmd},
     {"ns_unquotehtml",           NsTclUnquoteHtmlObjCmd},
     {"ns_unschedule_proc",       NsTclUnscheduleObjCmd},
+    {"ns_upstream",              NsTclUpstreamObjCmd},
     {"ns_urldecode",             NsTclUrlDecodeObjCmd},
     {"ns_urlencode",             NsTclUrlEncodeObjCmd},
     {"ns_uudecode",              NsTclBase64DecodeObjCmd},
@@ -195,6 +196,7 @@ static const Cmd servCmds[] = {
     {"ns_adp_info",              NsTclAdpInfoObjCmd},
     {"ns_adp_mimetype",          NsTclAdpMimeTypeObjCmd},
     {"ns_adp_parse",             NsTclAdpParseObjCmd},
+    {"ns_adp_precompile",        NsTclAdpPrecompileObjCmd},
     {"ns_adp_puts",              NsTclAdpPutsObjCmd},
     {"ns_adp_registeradp",       NsTclAdpRegisterAdpObjCmd},
     {"ns_adp_registerproc",      NsTclAdpRegisterProcObjCmd},
@@ -268,10 +270,12 @@ static const Cmd servCmds[] = {
     {"ns_register_filter",       NsTclRegisterFilterObjCmd},
     {"ns_register_proc",         NsTclRegisterProcObjCmd},
     {"ns_register_proxy",        NsTclRegisterProxyObjCmd},
+    {"ns_register_revproxy",     NsTclRegisterRevProxyObjCmd},
     {"ns_register_tcl",          NsTclRegisterTclObjCmd},
     {"ns_register_trace",        NsTclRegisterTraceObjCmd},
     {"ns_register_url2file",     NsTclRegisterUrl2FileObjCmd},
     {"ns_requestauthorize",      NsTclRequestAuthorizeObjCmd},
+    {"ns_respcache",             NsTclRespCacheObjCmd},
     {"ns_respond",               NsTclRespondObjCmd},
     {"ns_return",                NsTclReturnObjCmd},
     {"ns_returnbadrequest",      NsTclReturnBadRequestObjCmd},
@@ -285,6 +289,7 @@ static const Cmd servCmds[] = {
     {"ns_returnredirect",        NsTclReturnRedirectObjCmd},
     {"ns_returnunauthorized",    NsTclReturnUnauthorizedObjCmd},
     {"ns_returnunavailable",     NsTclReturnUnavailableObjCmd},
+    {"ns_revproxy",              NsTclRevProxyObjCmd},
     {"ns_runonce",               NsTclRunOnceObjCmd},
     {"ns_rwlock",                NsTclRWLockObjCmd},
     {"ns_sema",                  NsTclSemaObjCmd},
@@ -292,6 +297,7 @@ static const Cmd servCmds[] = {
     {"ns_setcookie",             NsTclSetCookieObjCmd},
     {"ns_setgroup",              NsTclSetGroupObjCmd},
     {"ns_setuser",               NsTclSetUserObjCmd},
+    {"ns_sse",                   NsTclSseObjCmd},
 #ifdef NS_WITH_DEPRECATED
     {"ns_startcontent",          NsTclStartContentObjCmd},
 #endif
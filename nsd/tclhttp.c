@@ -64,6 +64,28 @@ static Ns_Mutex closeWaitingMutex = NULL;  // TODO: maybe an rwlock
 static Ns_DList closeWaitingList;
 static Ns_SchedProc CloseWaitingCheckExpire;
 
+/*
+ * Per-upstream (host + port) statistics of the outgoing connections. The
+ * entries are kept in the "upstreams" hash table and are protected by the
+ * closeWaitingMutex. The table holds at most HTTP_UPSTREAMS_MAX entries;
+ * when it is full, the least recently used idle upstream is removed.
+ */
+#define HTTP_UPSTREAMS_MAX 1024
+
+typedef struct HttpUpstream {
+    uintptr_t lastUsed;        /* value of upstreamsClock at the last use */
+    size_t    active;          /* number of currently running requests */
+    size_t    peak;            /* max number of concurrently running requests */
+    uintptr_t requests;        /* total number of requests */
+    uintptr_t connections;     /* number of freshly opened connections */
+    uintptr_t reused;          /* requests sent over a persistent connection */
+    uintptr_t tlsFull;         /* TLS connections with full handshake */
+    uintptr_t tlsResumed;      /* TLS connections with resumed session */
+} HttpUpstream;
+
+static Tcl_HashTable upstreams;
+static uintptr_t     upstreamsClock = 0u;
+
 /*
  * String equivalents of some methods, header keys
  */
@@ -298,6 +320,12 @@ static bool PersistentConnectionAdd(NsHttpTask *httpPtr, const char **reasonPtr)
     NS_GNUC_NONNULL(1,2);
 static void HttpCloseWaitingDataRelease(NsHttpTask *httpPtr)
     NS_GNUC_NONNULL(1);
+static void HttpUpstreamAcquire(NsHttpTask *httpPtr, bool reused)
+    NS_GNUC_NONNULL(1);
+static void HttpUpstreamRelease(NsHttpTask *httpPtr)
+    NS_GNUC_NONNULL(1);
+static void HttpUpstreamPrune(void);
+static Tcl_Obj *HttpUpstreamStats(void);
 
 static void LogDebug(const char *before, NsHttpTask *httpPtr, const char *after)
     NS_GNUC_NONNULL(1,2,3);
@@ -2375,15 +2403,26 @@ HttpStatsObjCmd(
     Tcl_Obj    *const* objv
 ) {
     char          *idString = NULL;
-    int            result = TCL_OK;
+    int            result = TCL_OK, upstreamsFlag = 0;
+    Ns_ObjvSpec    opts[] = {
+        {"-upstreams", Ns_ObjvBool,  &upstreamsFlag, INT2PTR(NS_TRUE)},
+        {"--",         Ns_ObjvBreak, NULL,           NULL},
+        {NULL, NULL, NULL, NULL}
+    };
     Ns_ObjvSpec    args[] = {
         {"?id", Ns_ObjvString, &idString, NULL},
         {NULL, NULL, NULL, NULL}
     };
 
-    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
+    } else if (upstreamsFlag != 0) {
+        /*
+         * Statistics about the connections per upstream (host + port).
+         */
+        Tcl_SetObjResult(interp, HttpUpstreamStats());
+
     } else {
         NsInterp      *itPtr = clientData;
         Tcl_Obj       *resultObj = NULL;
@@ -2697,6 +2736,7 @@ static bool InitOnceHttp(void) {
     Ns_DListInit(&closeWaitingList);
     Ns_MutexInit(&closeWaitingMutex);
     Ns_MutexSetName2(&closeWaitingMutex, "ns:closewaiting", NULL);
+    Tcl_InitHashTable(&upstreams, TCL_STRING_KEYS);
 
 #ifdef MEM_RECORD_DEBUG
     Ns_MutexInit(&ckMutex);
@@ -2927,7 +2967,8 @@ HttpQueue(
 #endif
                *doneCallback = NULL,
                *bodyChanName = NULL,
-               *bodyFileName = NULL;
+               *bodyFileName = NULL,
+               *upstreamName = NULL;
     Ns_Set     *requestHdrPtr = NULL;
     Tcl_Obj    *bodyObj = NULL, *proxyObj = NULL, *responseDataObj = NULL, *responseHeaderObj = NULL;
     Ns_Time    *timeoutPtr = NULL,
@@ -2938,6 +2979,8 @@ HttpQueue(
     Ns_URL            u;
     unsigned short    portNr;
     Ns_ObjvValueRange sizeRange = {0, LLONG_MAX};
+    NsUpstreamMember *memberPtr = NULL;
+    Tcl_DString       urlDs;
 
     Ns_ObjvSpec opts[] = {
         {"-binary",                   Ns_ObjvBool,    &binary,                 INT2PTR(NS_TRUE)},
@@ -2973,6 +3016,7 @@ HttpQueue(
         {"-spoolsize",                Ns_ObjvMemUnit, &spoolLimit,             NULL},
         {"-timeout",                  Ns_ObjvTime,    &timeoutPtr,             NULL},
         {"-unix_socket",              Ns_ObjvString,  &udsPath,                NULL},
+        {"-upstream",                 Ns_ObjvString,  &upstreamName,           NULL},
 #ifdef NS_WITH_DEPRECATED_5_0
         {"-verify",                   Ns_ObjvBool,    &verifyCertInt,          INT2PTR(NS_TRUE)},
 #endif
@@ -3061,6 +3105,26 @@ HttpQueue(
         }
     }
 
+    /*
+     * With an upstream group, the provided URL is a path, which is
+     * appended to the URL of the selected member of the group.
+     */
+    Tcl_DStringInit(&urlDs);
+    if (result == TCL_OK && upstreamName != NULL) {
+        NsUpstreamGroup *groupPtr = NsUpstreamGroupGet(interp, upstreamName);
+
+        if (groupPtr == NULL) {
+            result = TCL_ERROR;
+        } else if (*url != '/') {
+            Ns_TclPrintfResult(interp, "invalid URL \"%s\": must be a path when used with -upstream", url);
+            result = TCL_ERROR;
+        } else {
+            memberPtr = NsUpstreamSelect(groupPtr, requestHdrPtr, NS_TRUE);
+            Ns_DStringVarAppend(&urlDs, memberPtr->url, url, NS_SENTINEL);
+            url = urlDs.string;
+        }
+    }
+
     /*
      * Check TLS specific parameters and return optionally the default values.
      * Furthermore, leave an error message in the interp, when called without
@@ -3108,6 +3172,13 @@ HttpQueue(
             result = TCL_ERROR;
 
         } else {
+            /*
+             * From now on, the result for the upstream member is
+             * reported by HttpClose().
+             */
+            httpPtr->memberPtr = memberPtr;
+            memberPtr = NULL;
+
             /*
              * httpPtr is valid and initialized
              */
@@ -3144,6 +3215,10 @@ HttpQueue(
 
             if (result != TCL_OK) {
                 Ns_Log(Ns_LogTaskDebug, "HttpQueue calls HttpClose() after invalid request");
+                if (httpPtr->memberPtr != NULL) {
+                    NsUpstreamRelease(httpPtr->memberPtr, NS_UPSTREAM_ERROR);
+                    httpPtr->memberPtr = NULL;
+                }
                 HttpClose(httpPtr, "Connect");
                 httpPtr = NULL;
             }
@@ -3158,6 +3233,12 @@ HttpQueue(
     if (urlCopy != NULL) {
         ns_free(urlCopy);
     }
+    if (memberPtr != NULL) {
+        /*
+         * The request failed before the task was created.
+         */
+        NsUpstreamRelease(memberPtr, NS_UPSTREAM_IGNORE);
+    }
 
     if (result == TCL_OK && httpPtr != NULL) {
         /*
@@ -3327,7 +3408,7 @@ HttpQueue(
             }
         }
     }
-
+    Tcl_DStringFree(&urlDs);
 
     return result;
 }
@@ -4326,6 +4407,8 @@ EstablishTCPConnection(
             return TCL_ERROR;
         }
     }
+    HttpUpstreamAcquire(httpPtr, reuseConnection);
+
     return TCL_OK;
 }
 
@@ -4448,6 +4531,20 @@ EstablishTLSConnection(
 #ifdef HAVE_OPENSSL_EVP_H
             HttpAddInfo(httpPtr, NsAtomObj(NS_ATOM_sslversion), SSL_get_version(ssl));
             HttpAddInfo(httpPtr, NsAtomObj(NS_ATOM_cipher),     SSL_get_cipher(ssl));
+            if (ssl != NULL) {
+                HttpAddInfo(httpPtr, Tcl_NewStringObj("sessionreused", 13),
+                            SSL_session_reused(ssl) == 1 ? "1" : "0");
+
+                if (rc == NS_OK && httpPtr->upstreamPtr != NULL) {
+                    Ns_MutexLock(&closeWaitingMutex);
+                    if (SSL_session_reused(ssl) == 1) {
+                        httpPtr->upstreamPtr->tlsResumed++;
+                    } else {
+                        httpPtr->upstreamPtr->tlsFull++;
+                    }
+                    Ns_MutexUnlock(&closeWaitingMutex);
+                }
+            }
             SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
 #endif
         }
@@ -5922,6 +6019,29 @@ HttpClose(
     httpPtr->ssl = NULL;
     httpPtr->ctx = NULL;
     httpPtr->sock = NS_INVALID_SOCKET;
+    HttpUpstreamRelease(httpPtr);
+
+    if (httpPtr->memberPtr != NULL) {
+        NsUpstreamResult result = NS_UPSTREAM_OK;
+
+        /*
+         * Report the outcome to the upstream group for passive outlier
+         * detection. Cancelled requests and shutdown are not
+         * attributed to the upstream server.
+         */
+        if (httpPtr->error != NULL) {
+            if (httpPtr->errorSockState == NS_SOCK_TIMEOUT) {
+                result = NS_UPSTREAM_TIMEOUT;
+            } else if (httpPtr->errorSockState == NS_SOCK_CANCEL
+                       || httpPtr->errorSockState == NS_SOCK_EXIT) {
+                result = NS_UPSTREAM_IGNORE;
+            } else {
+                result = NS_UPSTREAM_ERROR;
+            }
+        }
+        NsUpstreamRelease(httpPtr->memberPtr, result);
+        httpPtr->memberPtr = NULL;
+    }
 
     HttpCleanupPerRequestData(httpPtr);
     if (httpPtr->host != NULL) {
@@ -5973,6 +6093,213 @@ static void HttpCloseWaitingDataRelease(NsHttpTask *httpPtr)
     }
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpUpstreamAcquire --
+ *
+ *        Account a request to the upstream (host + port) of the provided
+ *        task, which is either sent over a freshly opened or over a reused
+ *        persistent connection.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Updates the per-upstream statistics, sets httpPtr->upstreamPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpUpstreamAcquire(NsHttpTask *httpPtr, bool reused)
+{
+    Tcl_HashEntry *hPtr;
+    HttpUpstream  *upstreamPtr;
+    Tcl_DString    ds;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(httpPtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    Ns_DStringPrintf(&ds, "%s:%hu", httpPtr->host, httpPtr->port);
+
+    Ns_MutexLock(&closeWaitingMutex);
+    if (upstreams.numEntries >= HTTP_UPSTREAMS_MAX
+        && Tcl_FindHashEntry(&upstreams, ds.string) == NULL) {
+        HttpUpstreamPrune();
+    }
+    hPtr = Tcl_CreateHashEntry(&upstreams, ds.string, &isNew);
+    if (isNew != 0) {
+        upstreamPtr = ns_calloc(1u, sizeof(HttpUpstream));
+        Tcl_SetHashValue(hPtr, upstreamPtr);
+    } else {
+        upstreamPtr = Tcl_GetHashValue(hPtr);
+    }
+    upstreamPtr->lastUsed = ++upstreamsClock;
+    upstreamPtr->requests++;
+    if (reused) {
+        upstreamPtr->reused++;
+    } else {
+        upstreamPtr->connections++;
+    }
+    upstreamPtr->active++;
+    if (upstreamPtr->active > upstreamPtr->peak) {
+        upstreamPtr->peak = upstreamPtr->active;
+    }
+    Ns_MutexUnlock(&closeWaitingMutex);
+
+    httpPtr->upstreamPtr = upstreamPtr;
+    Tcl_DStringFree(&ds);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpUpstreamRelease --
+ *
+ *        Mark the request of the task as finished in the per-upstream
+ *        statistics.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Resets httpPtr->upstreamPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpUpstreamRelease(NsHttpTask *httpPtr)
+{
+    NS_NONNULL_ASSERT(httpPtr != NULL);
+
+    if (httpPtr->upstreamPtr != NULL) {
+        Ns_MutexLock(&closeWaitingMutex);
+        httpPtr->upstreamPtr->active--;
+        Ns_MutexUnlock(&closeWaitingMutex);
+        httpPtr->upstreamPtr = NULL;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpUpstreamPrune --
+ *
+ *        Remove the least recently used upstream without running
+ *        requests from the statistics. When all upstreams have running
+ *        requests, nothing is removed. Must be called with the
+ *        closeWaitingMutex locked.
+ *
+ * Results:
+ *        None.
+ *
+ * Side effects:
+ *        Might free an entry of the "upstreams" hash table.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+HttpUpstreamPrune(void)
+{
+    Tcl_HashEntry  *hPtr, *oldestPtr = NULL;
+    Tcl_HashSearch  search;
+    uintptr_t       oldest = UINTPTR_MAX;
+
+    for (hPtr = Tcl_FirstHashEntry(&upstreams, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        const HttpUpstream *upstreamPtr = Tcl_GetHashValue(hPtr);
+
+        if (upstreamPtr->active == 0u && upstreamPtr->lastUsed < oldest) {
+            oldest = upstreamPtr->lastUsed;
+            oldestPtr = hPtr;
+        }
+    }
+    if (oldestPtr != NULL) {
+        ns_free(Tcl_GetHashValue(oldestPtr));
+        Tcl_DeleteHashEntry(oldestPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HttpUpstreamStats --
+ *
+ *        Return the per-upstream statistics as a list of dicts. The number
+ *        of idle persistent connections is obtained from the close-waiting
+ *        list.
+ *
+ * Results:
+ *        Tcl_Obj containing a list of dicts.
+ *
+ * Side effects:
+ *        None.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Obj *
+HttpUpstreamStats(void)
+{
+    Tcl_Obj             *resultObj = Tcl_NewListObj(0, NULL);
+    const Tcl_HashEntry *hPtr;
+    Tcl_HashSearch       search;
+    Tcl_DString          ds;
+
+    Tcl_DStringInit(&ds);
+    Ns_MutexLock(&closeWaitingMutex);
+    for (hPtr = Tcl_FirstHashEntry(&upstreams, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        const HttpUpstream *upstreamPtr = Tcl_GetHashValue(hPtr);
+        const char         *peer = Tcl_GetHashKey(&upstreams, hPtr);
+        Tcl_Obj            *entryObj = Tcl_NewDictObj();
+        long                idle = 0;
+        size_t              i;
+
+        for (i = 0; i < closeWaitingList.size; i ++) {
+            const CloseWaitingData *cwDataPtr = closeWaitingList.data[i];
+
+            if (cwDataPtr->state == CW_WAITING) {
+                Tcl_DStringSetLength(&ds, 0);
+                Ns_DStringPrintf(&ds, "%s:%hu", cwDataPtr->host, cwDataPtr->port);
+                if (STREQ(ds.string, peer)) {
+                    idle++;
+                }
+            }
+        }
+
+        (void) Tcl_DictObjPut(NULL, entryObj, NsAtomObj(NS_ATOM_peer),
+                              Tcl_NewStringObj(peer, TCL_INDEX_NONE));
+        (void) Tcl_DictObjPut(NULL, entryObj, NsAtomObj(NS_ATOM_requests),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->requests));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("active", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->active));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("peak", 4),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->peak));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("connections", 11),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->connections));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("reused", 6),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->reused));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("idle", 4),
+                              Tcl_NewLongObj(idle));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("tlsfull", 7),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->tlsFull));
+        (void) Tcl_DictObjPut(NULL, entryObj, Tcl_NewStringObj("tlsresumed", 10),
+                              Tcl_NewWideIntObj((Tcl_WideInt)upstreamPtr->tlsResumed));
+        (void) Tcl_ListObjAppendElement(NULL, resultObj, entryObj);
+    }
+    Ns_MutexUnlock(&closeWaitingMutex);
+    Tcl_DStringFree(&ds);
+
+    return resultObj;
+}
+
 
 /*
  *----------------------------------------------------------------------
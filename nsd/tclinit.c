@@ -331,6 +331,8 @@ ConfigServerTcl(const char *server)
         Ns_MutexSetName2(&servPtr->chans.lock, "nstcl:chans", server);
 
         Tcl_InitHashTable(&servPtr->connchans.table, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&servPtr->connchans.groups, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&servPtr->sse.topics, TCL_STRING_KEYS);
         Ns_RWLockInit(&servPtr->connchans.lock);
         Ns_RWLockSetName2(&servPtr->connchans.lock, "nstcl:connchans", server);
         //Ns_MutexInit(&servPtr->connchans.wlock);
@@ -26,10 +26,23 @@
  *     lock, lock the queuelock first
  *   - To avoid deadlock, the tp queuelock should be locked before
  *     the queue's lock.
+ *   - The workerslock (rwlock) protects the array of workers. It is
+ *     locked before all other locks. Pending jobs are kept in the
+ *     deques of the workers, protected by the worker's lock. The
+ *     queue's lock may be locked while holding a worker's lock, but
+ *     never the other way round.
  *
  *
  * Notes:
  *
+ *   Every job thread is a worker with its own deque of pending
+ *   jobs. All pending jobs of a queue are kept in the deque of the
+ *   "home" worker of the queue, such that the jobs of a queue are
+ *   started in FIFO order. A worker takes jobs from the front of its
+ *   own deque; when this is empty, it steals jobs from the deques of
+ *   the other workers. The per-queue "maxThreads" is a logical limit
+ *   enforced when a job is taken from a deque.
+ *
  *   The threadpool's max number of thread is the sum of all the
  *   current queue's max threads.
  *
@@ -109,6 +122,8 @@ typedef enum ThreadPoolRequests {
 
 typedef struct Job {
     struct Job       *nextPtr;
+    struct Job       *prevPtr;
+    struct Queue     *queuePtr;
     const NsServer   *servPtr;
     JobStates         state;
     int               code;
@@ -140,10 +155,31 @@ typedef struct Queue {
     QueueRequests      req;
     int                maxThreads;
     int                nRunning;
+    int                nPending;
+    struct Worker     *homePtr;    /* Deque of pending jobs, valid when nPending > 0 */
     Tcl_HashTable      jobs;
     int                refCount;
 } Queue;
 
+/*
+ * A worker is a job thread with its deque of pending jobs.
+ */
+
+typedef struct Worker {
+    Ns_Mutex           lock;
+    Ns_Cond            cond;
+    Job               *firstPtr;
+    Job               *lastPtr;
+    int                nJobs;
+    uintptr_t          tid;
+    bool               idle;
+    bool               wakeup;
+    bool               stop;
+    unsigned long      executed;
+    unsigned long      steals;
+    Ns_Time            lockWait;   /* Time spent waiting for the lock of this deque */
+} Worker;
+
 
 /*
  * A threadpool manages a global set of threads.
@@ -157,11 +193,20 @@ typedef struct ThreadPool {
     unsigned long      nextQueueId;
     int                maxThreads;
     int                nthreads;
-    int                nidle;
     int                jobsPerThread;
-    Job               *firstPtr;
     Ns_Time            timeout;
     Ns_Time            logminduration;
+    Ns_RWLock          workerslock;
+    Worker           **workers;
+    int                nworkers;
+    int                workersSize;
+    unsigned int       nextHome;
+    Worker             inject;     /* Pending jobs submitted when no worker exists */
+    struct {
+        unsigned long  executed;
+        unsigned long  steals;
+        Ns_Time        lockWait;
+    } retired;                     /* Statistics of exited workers */
 } ThreadPool;
 
 
@@ -186,7 +231,36 @@ static TCL_OBJCMDPROC_T  JobWaitAnyObjCmd;
 static TCL_OBJCMDPROC_T  JobWaitObjCmd;
 
 static void   JobThread(void *arg);
-static Job*   GetNextJob(void);
+
+static void   WorkerInit(Worker *workerPtr, const char *name)
+    NS_GNUC_NONNULL(1,2);
+
+static void   WorkerLock(Worker *workerPtr)
+    NS_GNUC_NONNULL(1);
+
+static Worker *WorkerRegister(Tcl_AsyncHandler *asyncPtr)
+    NS_GNUC_NONNULL(1)
+    NS_GNUC_RETURNS_NONNULL;
+
+static void   WorkerUnregister(Worker *workerPtr)
+    NS_GNUC_NONNULL(1);
+
+static Job*   WorkerNextJob(Worker *workerPtr, bool *stolenPtr)
+    NS_GNUC_NONNULL(1,2);
+
+static Job*   FindJob(Worker *workerPtr, bool *stolenPtr)
+    NS_GNUC_NONNULL(1,2);
+
+static bool   WakeIdleWorker(const Worker *excludePtr);
+
+static void   DequePush(Worker *workerPtr, Job *jobPtr, bool head)
+    NS_GNUC_NONNULL(1,2);
+
+static void   DequeRemove(Worker *workerPtr, Job *jobPtr)
+    NS_GNUC_NONNULL(1,2);
+
+static Job*   DequeTake(Worker *workerPtr)
+    NS_GNUC_NONNULL(1);
 
 static Queue* NewQueue(const char* queueName, const char* queueDesc, int maxThreads)
     NS_GNUC_NONNULL(1,2)
@@ -237,6 +311,10 @@ static int AppendFieldLong(Tcl_Interp *interp, Tcl_Obj *list,
                            const char *name, long value)
     NS_GNUC_NONNULL(2,3);
 
+static int AppendFieldObj(Tcl_Interp *interp, Tcl_Obj *list,
+                          const char *name, Tcl_Obj *valueObj)
+    NS_GNUC_NONNULL(2,3,4);
+
 /*
  * Globals
  */
@@ -269,14 +347,20 @@ NsTclInitQueueType(void)
     tp.nextQueueId = 0u;
     tp.maxThreads = 0;
     tp.nthreads = 0;
-    tp.nidle = 0;
-    tp.firstPtr = NULL;
     tp.req = THREADPOOL_REQ_NONE;
     tp.jobsPerThread = 0;
     tp.timeout.sec = 0;
     tp.timeout.usec = 0;
     tp.logminduration.sec = 0;
     tp.logminduration.usec = 0;
+
+    Ns_RWLockInit(&tp.workerslock);
+    Ns_RWLockSetName2(&tp.workerslock, "jobThreadPool", "workers");
+    tp.workers = NULL;
+    tp.nworkers = 0;
+    tp.workersSize = 0;
+    tp.nextHome = 0u;
+    WorkerInit(&tp.inject, "inject");
 }
 
 
@@ -310,6 +394,24 @@ NsStartJobsShutdown(void)
         Ns_MutexUnlock(&tp.queuelock);
         hPtr = Tcl_NextHashEntry(&search);
     }
+
+    /*
+     * Wake up all workers, such they notice the stop request.
+     */
+    Ns_RWLockRdLock(&tp.workerslock);
+    {
+        int i;
+
+        for (i = 0; i < tp.nworkers; i++) {
+            Worker *workerPtr = tp.workers[i];
+
+            Ns_MutexLock(&workerPtr->lock);
+            workerPtr->stop = NS_TRUE;
+            Ns_CondSignal(&workerPtr->cond);
+            Ns_MutexUnlock(&workerPtr->lock);
+        }
+    }
+    Ns_RWLockUnlock(&tp.workerslock);
 }
 
 
@@ -550,7 +652,8 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
     } else {
         const NsInterp *itPtr = clientData;
         Queue          *queue = NULL;
-        Job            *jobPtr;
+        Job            *jobPtr = NULL;
+        Worker         *homePtr = NULL;
         JobTypes        jobType = JOB_NON_DETACHED;
         Tcl_HashEntry  *hPtr;
         int             isNew;
@@ -561,6 +664,11 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
             jobType = JOB_DETACHED;
         }
 
+        /*
+         * Keep the set of workers stable until the job is pushed to
+         * the deque of its home worker.
+         */
+        Ns_RWLockRdLock(&tp.workerslock);
         Ns_MutexLock(&tp.queuelock);
         if (LookupQueue(interp, queueIdString, &queue, NS_TRUE) != TCL_OK) {
             result = TCL_ERROR;
@@ -616,42 +724,64 @@ JobQueueObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_O
         }
 
         /*
-         * Add the job to the thread pool's job list, if "-head" is
-         * specified, insert new job at the beginning, otherwise
-         * append new job to the end.
-         */
-        if (head != 0) {
-            jobPtr->nextPtr = tp.firstPtr;
-            tp.firstPtr = jobPtr;
-        } else {
-            Job  **nextPtrPtr = &tp.firstPtr;
-
-            while (*nextPtrPtr != NULL) {
-                nextPtrPtr = &((*nextPtrPtr)->nextPtr);
-            }
-            *nextPtrPtr = jobPtr;
-        }
-
-        /*
-         * Start a new thread if there are less than maxThreads
-         * currently running and there currently no idle threads.
+         * All pending jobs of a queue are kept in the deque of the
+         * home worker of the queue. When the queue has no pending
+         * jobs, assign the next worker in round-robin order.
          */
-        if (tp.nidle == 0 && tp.nthreads < tp.maxThreads) {
-            create = NS_TRUE;
-            ++tp.nthreads;
-        } else {
-            create = NS_FALSE;
+        if (queue->nPending == 0 || queue->homePtr == NULL) {
+            queue->homePtr = (tp.nworkers > 0)
+                ? tp.workers[tp.nextHome++ % (unsigned int)tp.nworkers]
+                : &tp.inject;
         }
+        homePtr = queue->homePtr;
+        ++queue->nPending;
+        jobPtr->queuePtr = queue;
 
         Tcl_DStringAppend(&jobPtr->id, jobIdString, jobIdLength);
         Tcl_SetHashValue(hPtr, jobPtr);
-        Ns_CondBroadcast(&tp.cond);
 
     releaseQueue:
         if (queue != NULL) {
             (void)ReleaseQueue(queue, NS_TRUE);
         }
         Ns_MutexUnlock(&tp.queuelock);
+
+        if (result == TCL_OK) {
+            bool woken = NS_FALSE;
+
+            /*
+             * Add the job to the deque of the home worker, if "-head"
+             * is specified, insert new job at the beginning,
+             * otherwise append new job to the end.
+             */
+            WorkerLock(homePtr);
+            DequePush(homePtr, jobPtr, (head != 0));
+            if (homePtr->idle && !homePtr->wakeup) {
+                homePtr->wakeup = NS_TRUE;
+                Ns_CondSignal(&homePtr->cond);
+                woken = NS_TRUE;
+            }
+            Ns_MutexUnlock(&homePtr->lock);
+
+            if (!woken) {
+                woken = WakeIdleWorker(homePtr);
+            }
+
+            /*
+             * Start a new thread if there are less than maxThreads
+             * currently running and there currently no idle threads.
+             */
+            if (!woken) {
+                Ns_MutexLock(&tp.queuelock);
+                if (tp.nthreads < tp.maxThreads) {
+                    create = NS_TRUE;
+                    ++tp.nthreads;
+                }
+                Ns_MutexUnlock(&tp.queuelock);
+            }
+        }
+        Ns_RWLockUnlock(&tp.workerslock);
+
         if (create) {
             Ns_ThreadCreate(JobThread, NULL, 0, NULL);
         }
@@ -1348,23 +1478,69 @@ JobThreadListObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_
         result = TCL_ERROR;
 
     } else {
-        Tcl_Obj    *tpFieldList;
-        const char *tpReq;
+        Tcl_Obj      *tpFieldList, *workersList;
+        const char   *tpReq;
+        int           i, maxThreads, nthreads, nidle = 0;
+        unsigned long steals;
+        Ns_Time       lockWait;
 
         /*
          * Create a Tcl List to hold the list of thread fields.
          */
         tpFieldList = Tcl_NewListObj(0, NULL);
+        workersList = Tcl_NewListObj(0, NULL);
+        Tcl_IncrRefCount(workersList);
+
+        Ns_RWLockRdLock(&tp.workerslock);
         Ns_MutexLock(&tp.queuelock);
         tpReq = GetTpReqStr(tp.req);
-        if (AppendFieldInt(interp, tpFieldList, "maxthreads", tp.maxThreads) != TCL_OK
-            || AppendFieldInt(interp, tpFieldList, "numthreads", tp.nthreads) != TCL_OK
-            || AppendFieldInt(interp, tpFieldList, "numidle", tp.nidle) != TCL_OK
-            || AppendField(interp, tpFieldList, "req", tpReq) != TCL_OK
-            ) {
+        maxThreads = tp.maxThreads;
+        nthreads = tp.nthreads;
+        Ns_MutexUnlock(&tp.queuelock);
+
+        steals = tp.retired.steals;
+        lockWait = tp.retired.lockWait;
+
+        for (i = 0; i < tp.nworkers; i++) {
+            Worker  *workerPtr = tp.workers[i];
+            Tcl_Obj *workerFieldList = Tcl_NewListObj(0, NULL);
+
+            Ns_MutexLock(&workerPtr->lock);
+            if (workerPtr->idle) {
+                nidle++;
+            }
+            steals += workerPtr->steals;
+            Ns_IncrTime(&lockWait, workerPtr->lockWait.sec, workerPtr->lockWait.usec);
+
+            if (AppendFieldLong(interp, workerFieldList, "id", (long)workerPtr->tid) != TCL_OK
+                || AppendFieldInt(interp, workerFieldList, "jobs", workerPtr->nJobs) != TCL_OK
+                || AppendFieldLong(interp, workerFieldList, "executed", (long)workerPtr->executed) != TCL_OK
+                || AppendFieldLong(interp, workerFieldList, "steals", (long)workerPtr->steals) != TCL_OK
+                || AppendFieldObj(interp, workerFieldList, "lockwait",
+                                  Ns_TclNewTimeObj(&workerPtr->lockWait)) != TCL_OK
+                || AppendFieldInt(interp, workerFieldList, "idle", workerPtr->idle) != TCL_OK
+                ) {
+                result = TCL_ERROR;
+            }
+            Ns_MutexUnlock(&workerPtr->lock);
+            if (Tcl_ListObjAppendElement(interp, workersList, workerFieldList) != TCL_OK) {
+                result = TCL_ERROR;
+            }
+        }
+        Ns_RWLockUnlock(&tp.workerslock);
+
+        if (result == TCL_OK
+            && (AppendFieldInt(interp, tpFieldList, "maxthreads", maxThreads) != TCL_OK
+                || AppendFieldInt(interp, tpFieldList, "numthreads", nthreads) != TCL_OK
+                || AppendFieldInt(interp, tpFieldList, "numidle", nidle) != TCL_OK
+                || AppendField(interp, tpFieldList, "req", tpReq) != TCL_OK
+                || AppendFieldLong(interp, tpFieldList, "steals", (long)steals) != TCL_OK
+                || AppendFieldObj(interp, tpFieldList, "lockwait", Ns_TclNewTimeObj(&lockWait)) != TCL_OK
+                || AppendFieldObj(interp, tpFieldList, "workers", workersList) != TCL_OK
+                )) {
             result = TCL_ERROR;
         }
-        Ns_MutexUnlock(&tp.queuelock);
+        Tcl_DecrRefCount(workersList);
 
         if (likely( result == TCL_OK )) {
             Tcl_SetObjResult(interp, tpFieldList);
@@ -1438,64 +1614,44 @@ static void
 JobThread(void *UNUSED(arg))
 {
     const char        *err;
-    Queue             *queue;
     Tcl_HashEntry     *hPtr;
     Tcl_AsyncHandler  async;
-    const Ns_Time    *timePtr;
-    Ns_Time           wait;
     int               jpt, njobs;
     uintptr_t         tid;
+    Worker           *workerPtr;
 
     (void)Ns_WaitForStartup();
-    Ns_MutexLock(&tp.queuelock);
-    tid = tp.nextThreadId++;
-    Ns_ThreadSetName("-nsjob:%lx-", tid);
-    Ns_Log(Notice, "Starting thread: -ns_job_%" PRIxPTR "-", tid);
 
-    async = Tcl_AsyncCreate(JobAbort, NULL);
-
-    SetupJobDefaults();
+    workerPtr = WorkerRegister(&async);
+    tid = workerPtr->tid;
 
     /*
      * Setting parameter "jobsperthread" to > 0 will cause the thread
      * to graciously exit after processing that many job requests,
      * thus initiating kind-of Tcl-level garbage collection.
      */
-
+    Ns_MutexLock(&tp.queuelock);
     jpt = njobs = tp.jobsPerThread;
+    Ns_MutexUnlock(&tp.queuelock);
 
     while (jpt == 0 || njobs > 0) {
         Job          *jobPtr;
+        Queue        *queue;
         Tcl_Interp   *interp;
         int           code;
-        Ns_ReturnCode status;
+        bool          stolen = NS_FALSE;
         size_t        memBefore = 0u;
 
-        ++tp.nidle;
-        status = NS_OK;
-        if (tp.timeout.sec > 0 || tp.timeout.usec > 0) {
-            Ns_GetTime(&wait);
-            Ns_IncrTime(&wait, tp.timeout.sec, tp.timeout.usec);
-            timePtr = &wait;
-        } else {
-            timePtr = NULL;
-        }
-        jobPtr = NULL;
-        while (status == NS_OK &&
-               !(tp.req == THREADPOOL_REQ_STOP) &&
-               ((jobPtr = GetNextJob()) == NULL)) {
-            status = Ns_CondTimedWait(&tp.cond, &tp.queuelock, timePtr);
-        }
-        --tp.nidle;
-        if (tp.req == THREADPOOL_REQ_STOP || jobPtr == NULL) {
+        jobPtr = WorkerNextJob(workerPtr, &stolen);
+        if (jobPtr == NULL) {
             break;
         }
 
-        if (LookupQueue(NULL, jobPtr->queueId, &queue, NS_TRUE) != TCL_OK) {
-            Ns_Log(Fatal, "cannot find queue: %s", jobPtr->queueId);
-            break;
-        }
-        assert(queue != NULL);
+        /*
+         * The job was reserved in its queue. Since the job is still
+         * in the jobs table, the queue can't be deleted.
+         */
+        queue = jobPtr->queuePtr;
 
         if (Ns_LogSeverityEnabled(Ns_LogMemoryDebug)) {
             (void) NsTcmallocGetNumericProperty("generic.current_allocated_bytes",
@@ -1507,6 +1663,8 @@ JobThread(void *UNUSED(arg))
          */
         interp = NsTclAllocateInterp((const NsServer*)jobPtr->servPtr);
 
+        Ns_MutexLock(&queue->lock);
+
         /*
          * Initialize times ...
          */
@@ -1524,24 +1682,20 @@ JobThread(void *UNUSED(arg))
         if (jobPtr->cancel == NS_TRUE) {
             Tcl_AsyncMark(jobPtr->async);
         }
+        Ns_MutexUnlock(&queue->lock);
 
         /*
          * ... Rename the thread according to the job ...
          */
         Ns_ThreadSetName("-nsjob:%s:%lx", jobPtr->queueId, tid);
-        ++queue->nRunning;
-
-        Ns_MutexUnlock(&queue->lock);
-        Ns_MutexUnlock(&tp.queuelock);
 
         /*
          * ... and execute the job.
          */
         code = Tcl_EvalEx(interp, jobPtr->script.string, jobPtr->script.length, 0);
 
-        Ns_MutexLock(&tp.queuelock);
         Ns_MutexLock(&queue->lock);
-
+        ++queue->refCount;
         --queue->nRunning;
 
         /*
@@ -1592,7 +1746,7 @@ JobThread(void *UNUSED(arg))
         }
 
         Ns_TclDeAllocateInterp(interp);
-        
+
         NsLogMemoryStatsDelta("after job eval", NULL, Ns_ThreadId(), jobPtr->script.string,
                               memBefore, 1024u * 1024u);
 
@@ -1608,9 +1762,30 @@ JobThread(void *UNUSED(arg))
             }
             FreeJob(jobPtr);
         }
-        
+
         Ns_CondBroadcast(&queue->cond);
-        (void)ReleaseQueue(queue, NS_TRUE);
+
+        /*
+         * A deleted queue is freed by ReleaseQueue() with the
+         * queuelock held, which has to be locked before the queue's
+         * lock.
+         */
+        if (queue->req == QUEUE_REQ_DELETE) {
+            Ns_MutexUnlock(&queue->lock);
+            Ns_MutexLock(&tp.queuelock);
+            Ns_MutexLock(&queue->lock);
+            (void)ReleaseQueue(queue, NS_TRUE);
+            Ns_MutexUnlock(&tp.queuelock);
+        } else {
+            (void)ReleaseQueue(queue, NS_TRUE);
+        }
+
+        Ns_MutexLock(&workerPtr->lock);
+        workerPtr->executed++;
+        if (stolen) {
+            workerPtr->steals++;
+        }
+        Ns_MutexUnlock(&workerPtr->lock);
 
         if ((jpt != 0) && --njobs <= 0) {
             /*
@@ -1620,15 +1795,13 @@ JobThread(void *UNUSED(arg))
         }
     }
 
-    --tp.nthreads;
+    WorkerUnregister(workerPtr);
 
     Tcl_AsyncDelete(async);
-    Ns_CondBroadcast(&tp.cond);
-    Ns_MutexUnlock(&tp.queuelock);
 
     Ns_Log(Notice, "exiting");
 }
-
+
 /*
  *----------------------------------------------------------------------
  +
@@ -1664,64 +1837,549 @@ JobAbort(ClientData UNUSED(clientData), Tcl_Interp *interp, int UNUSED(code))
 /*
  *----------------------------------------------------------------------
  *
- * GetNextJob --
+ * WorkerInit --
  *
- *      Get the next job from the queue.
- *      The queuelock should be held locked.
+ *      Initialize a worker structure with an empty deque.
  *
  * Results:
- *      The job.
+ *      None.
  *
  * Side effects:
- *      Queues have a "maxThreads" so if the queue is already
- *      at "maxThreads", jobs of that queue will be skipped.
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WorkerInit(Worker *workerPtr, const char *name)
+{
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+    NS_NONNULL_ASSERT(name != NULL);
+
+    memset(workerPtr, 0, sizeof(Worker));
+    Ns_MutexInit(&workerPtr->lock);
+    Ns_MutexSetName2(&workerPtr->lock, "jobWorker", name);
+    Ns_CondInit(&workerPtr->cond);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WorkerLock --
+ *
+ *      Lock the deque of a worker. When the lock is busy, the time
+ *      spent waiting for it is added to the lock wait time of the
+ *      worker.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Locks the worker's lock.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WorkerLock(Worker *workerPtr)
+{
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+
+    if (Ns_MutexTryLock(&workerPtr->lock) != NS_OK) {
+        Ns_Time startTime, now, diffTime;
+
+        Ns_GetTime(&startTime);
+        Ns_MutexLock(&workerPtr->lock);
+        Ns_GetTime(&now);
+        (void)Ns_DiffTime(&now, &startTime, &diffTime);
+        Ns_IncrTime(&workerPtr->lockWait, diffTime.sec, diffTime.usec);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WorkerRegister --
+ *
+ *      Create the worker for the current job thread and add it to
+ *      the thread pool.
+ *
+ * Results:
+ *      The new worker.
+ *
+ * Side effects:
+ *      Sets the thread name and creates the async handler for
+ *      cancelling jobs.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Worker *
+WorkerRegister(Tcl_AsyncHandler *asyncPtr)
+{
+    Worker   *workerPtr;
+    uintptr_t tid;
+    char      name[TCL_INTEGER_SPACE];
+
+    NS_NONNULL_ASSERT(asyncPtr != NULL);
+
+    Ns_MutexLock(&tp.queuelock);
+    tid = tp.nextThreadId++;
+    SetupJobDefaults();
+    Ns_MutexUnlock(&tp.queuelock);
+
+    Ns_ThreadSetName("-nsjob:%lx-", tid);
+    Ns_Log(Notice, "Starting thread: -ns_job_%" PRIxPTR "-", tid);
+
+    *asyncPtr = Tcl_AsyncCreate(JobAbort, NULL);
+
+    workerPtr = ns_malloc(sizeof(Worker));
+    snprintf(name, sizeof(name), "%" PRIxPTR, tid);
+    WorkerInit(workerPtr, name);
+    workerPtr->tid = tid;
+
+    Ns_RWLockWrLock(&tp.workerslock);
+    if (tp.nworkers == tp.workersSize) {
+        tp.workersSize = (tp.workersSize == 0) ? 8 : tp.workersSize * 2;
+        tp.workers = ns_realloc(tp.workers, sizeof(Worker *) * (size_t)tp.workersSize);
+    }
+    tp.workers[tp.nworkers++] = workerPtr;
+
+    Ns_MutexLock(&tp.queuelock);
+    workerPtr->stop = (tp.req == THREADPOOL_REQ_STOP);
+    Ns_MutexUnlock(&tp.queuelock);
+    Ns_RWLockUnlock(&tp.workerslock);
+
+    return workerPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WorkerUnregister --
+ *
+ *      Remove the worker of an exiting job thread from the thread
+ *      pool. Jobs still pending in the deque of the worker are moved
+ *      to another worker, or to the inject deque, when this was the
+ *      last worker.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the worker, decrements the number of threads and might
+ *      wake up or create another job thread for pending jobs.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WorkerUnregister(Worker *workerPtr)
+{
+    Worker *successorPtr;
+    Job    *jobPtr;
+    int     i;
+    bool    pending = NS_FALSE, create = NS_FALSE;
+
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+
+    Ns_RWLockWrLock(&tp.workerslock);
+    for (i = 0; i < tp.nworkers; i++) {
+        if (tp.workers[i] == workerPtr) {
+            tp.workers[i] = tp.workers[--tp.nworkers];
+            break;
+        }
+    }
+    successorPtr = (tp.nworkers > 0) ? tp.workers[0] : &tp.inject;
+
+    Ns_MutexLock(&workerPtr->lock);
+    Ns_MutexLock(&successorPtr->lock);
+    while ((jobPtr = workerPtr->firstPtr) != NULL) {
+        Queue *queue = jobPtr->queuePtr;
+
+        DequeRemove(workerPtr, jobPtr);
+        DequePush(successorPtr, jobPtr, NS_FALSE);
+        Ns_MutexLock(&queue->lock);
+        if (queue->homePtr == workerPtr) {
+            queue->homePtr = successorPtr;
+        }
+        Ns_MutexUnlock(&queue->lock);
+    }
+    Ns_MutexUnlock(&successorPtr->lock);
+
+    tp.retired.executed += workerPtr->executed;
+    tp.retired.steals += workerPtr->steals;
+    Ns_IncrTime(&tp.retired.lockWait, workerPtr->lockWait.sec, workerPtr->lockWait.usec);
+    Ns_MutexUnlock(&workerPtr->lock);
+    Ns_RWLockUnlock(&tp.workerslock);
+
+    /*
+     * Other workers might refer to the exited worker as home of a
+     * queue without pending jobs. Such references are replaced when
+     * the next job of the queue is enqueued.
+     */
+    Ns_MutexDestroy(&workerPtr->lock);
+    Ns_CondDestroy(&workerPtr->cond);
+    ns_free(workerPtr);
+
+    /*
+     * Make sure, the remaining pending jobs are not left behind.
+     */
+    Ns_RWLockRdLock(&tp.workerslock);
+    Ns_MutexLock(&tp.inject.lock);
+    pending = (tp.inject.firstPtr != NULL);
+    Ns_MutexUnlock(&tp.inject.lock);
+    for (i = 0; !pending && i < tp.nworkers; i++) {
+        Ns_MutexLock(&tp.workers[i]->lock);
+        pending = (tp.workers[i]->firstPtr != NULL);
+        Ns_MutexUnlock(&tp.workers[i]->lock);
+    }
+
+    if (pending) {
+        pending = !WakeIdleWorker(NULL);
+    }
+
+    Ns_MutexLock(&tp.queuelock);
+    --tp.nthreads;
+    if (pending
+        && tp.req != THREADPOOL_REQ_STOP
+        && tp.nthreads < tp.maxThreads) {
+        create = NS_TRUE;
+        ++tp.nthreads;
+    }
+    Ns_CondBroadcast(&tp.cond);
+    Ns_MutexUnlock(&tp.queuelock);
+    Ns_RWLockUnlock(&tp.workerslock);
+
+    if (create) {
+        Ns_ThreadCreate(JobThread, NULL, 0, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WorkerNextJob --
+ *
+ *      Get the next job for the worker. The job is taken from the
+ *      deque of the worker, from the inject deque, or stolen from the
+ *      deque of another worker. When no job is available, the worker
+ *      waits until it is woken up.
+ *
+ * Results:
+ *      The job or NULL, when the thread pool is stopping or the idle
+ *      timeout was reached.
+ *
+ * Side effects:
+ *      The returned job is reserved in its queue.
  *
  *----------------------------------------------------------------------
  */
 
 static Job*
-GetNextJob(void)
+WorkerNextJob(Worker *workerPtr, bool *stolenPtr)
 {
-    Queue         *queue;
-    Job           *prevPtr, *jobPtr;
-    bool           done = NS_FALSE;
+    Job *jobPtr = NULL;
 
-    jobPtr = prevPtr = tp.firstPtr;
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+    NS_NONNULL_ASSERT(stolenPtr != NULL);
 
-    while (!done && jobPtr != NULL) {
+    for (;;) {
+        Ns_Time        wait;
+        const Ns_Time *timePtr = NULL;
+        Ns_ReturnCode  status = NS_OK;
+        bool           stop, forward = NS_FALSE;
 
-        if (LookupQueue(NULL, jobPtr->queueId, &queue, NS_TRUE) != TCL_OK) {
-            Ns_Log(Fatal, "cannot find queue: %s", jobPtr->queueId);
+        Ns_MutexLock(&workerPtr->lock);
+        stop = workerPtr->stop;
+        Ns_MutexUnlock(&workerPtr->lock);
+        if (stop) {
             break;
         }
-        assert(queue != NULL);
 
-        if (queue->nRunning < queue->maxThreads) {
-            /*
-             * Job can be serviced; remove it from the pending list.
-             */
-            if (jobPtr == tp.firstPtr) {
-                tp.firstPtr = jobPtr->nextPtr;
-            } else {
-                prevPtr->nextPtr = jobPtr->nextPtr;
+        jobPtr = FindJob(workerPtr, stolenPtr);
+        if (jobPtr != NULL) {
+            break;
+        }
+
+        /*
+         * Announce that this worker is idle and look again, such
+         * that no job pushed in the meantime is missed.
+         */
+        Ns_MutexLock(&workerPtr->lock);
+        workerPtr->idle = NS_TRUE;
+        Ns_MutexUnlock(&workerPtr->lock);
+
+        jobPtr = FindJob(workerPtr, stolenPtr);
+
+        Ns_MutexLock(&tp.queuelock);
+        if (jobPtr == NULL && (tp.timeout.sec > 0 || tp.timeout.usec > 0)) {
+            Ns_GetTime(&wait);
+            Ns_IncrTime(&wait, tp.timeout.sec, tp.timeout.usec);
+            timePtr = &wait;
+        }
+        Ns_MutexUnlock(&tp.queuelock);
+
+        Ns_MutexLock(&workerPtr->lock);
+        while (jobPtr == NULL
+               && status == NS_OK
+               && !workerPtr->wakeup
+               && !workerPtr->stop) {
+            status = Ns_CondTimedWait(&workerPtr->cond, &workerPtr->lock, timePtr);
+        }
+        /*
+         * When this worker was woken up, but has found a job on its
+         * own, pass the wakeup to another idle worker.
+         */
+        forward = (jobPtr != NULL && workerPtr->wakeup);
+        workerPtr->idle = NS_FALSE;
+        workerPtr->wakeup = NS_FALSE;
+        Ns_MutexUnlock(&workerPtr->lock);
+
+        if (forward) {
+            Ns_RWLockRdLock(&tp.workerslock);
+            (void) WakeIdleWorker(workerPtr);
+            Ns_RWLockUnlock(&tp.workerslock);
+        }
+        if (jobPtr != NULL || status != NS_OK) {
+            break;
+        }
+    }
+
+    return jobPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindJob --
+ *
+ *      Look for a job which can be started: first in the deque of
+ *      the worker, then in the inject deque and finally in the deques
+ *      of the other workers.
+ *
+ * Results:
+ *      The job or NULL.
+ *
+ * Side effects:
+ *      The returned job is reserved in its queue. The flag pointed to
+ *      by stolenPtr is set, when the job was stolen from another
+ *      worker.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Job*
+FindJob(Worker *workerPtr, bool *stolenPtr)
+{
+    Job *jobPtr;
+
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+    NS_NONNULL_ASSERT(stolenPtr != NULL);
+
+    *stolenPtr = NS_FALSE;
+
+    WorkerLock(workerPtr);
+    jobPtr = DequeTake(workerPtr);
+    Ns_MutexUnlock(&workerPtr->lock);
+
+    if (jobPtr == NULL) {
+        WorkerLock(&tp.inject);
+        jobPtr = DequeTake(&tp.inject);
+        Ns_MutexUnlock(&tp.inject.lock);
+    }
+
+    if (jobPtr == NULL) {
+        int i, self = 0;
+
+        Ns_RWLockRdLock(&tp.workerslock);
+        for (i = 0; i < tp.nworkers; i++) {
+            if (tp.workers[i] == workerPtr) {
+                self = i;
+                break;
+            }
+        }
+        /*
+         * Start with the next worker, such that the victims are
+         * distributed over the workers.
+         */
+        for (i = 1; jobPtr == NULL && i < tp.nworkers; i++) {
+            Worker *victimPtr = tp.workers[(self + i) % tp.nworkers];
+
+            WorkerLock(victimPtr);
+            jobPtr = DequeTake(victimPtr);
+            Ns_MutexUnlock(&victimPtr->lock);
+        }
+        Ns_RWLockUnlock(&tp.workerslock);
+        *stolenPtr = (jobPtr != NULL);
+    }
+
+    return jobPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WakeIdleWorker --
+ *
+ *      Wake up an idle worker, skipping the specified one. The
+ *      workerslock has to be held by the caller.
+ *
+ * Results:
+ *      NS_TRUE when an idle worker was woken up.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+WakeIdleWorker(const Worker *excludePtr)
+{
+    int  i;
+    bool woken = NS_FALSE;
+
+    for (i = 0; !woken && i < tp.nworkers; i++) {
+        Worker *workerPtr = tp.workers[i];
+
+        if (workerPtr != excludePtr) {
+            Ns_MutexLock(&workerPtr->lock);
+            if (workerPtr->idle && !workerPtr->wakeup) {
+                workerPtr->wakeup = NS_TRUE;
+                Ns_CondSignal(&workerPtr->cond);
+                woken = NS_TRUE;
             }
-            done = NS_TRUE;
+            Ns_MutexUnlock(&workerPtr->lock);
+        }
+    }
+
+    return woken;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DequePush, DequeRemove --
+ *
+ *      Add a job to the front or end of the deque of a worker, or
+ *      remove it from the deque. The worker's lock has to be held
+ *      by the caller.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
 
+static void
+DequePush(Worker *workerPtr, Job *jobPtr, bool head)
+{
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+    NS_NONNULL_ASSERT(jobPtr != NULL);
+
+    if (head) {
+        jobPtr->prevPtr = NULL;
+        jobPtr->nextPtr = workerPtr->firstPtr;
+        if (workerPtr->firstPtr != NULL) {
+            workerPtr->firstPtr->prevPtr = jobPtr;
         } else {
-            /*
-             * Go to next job.
-             */
-            prevPtr = jobPtr;
-            jobPtr = jobPtr->nextPtr;
+            workerPtr->lastPtr = jobPtr;
+        }
+        workerPtr->firstPtr = jobPtr;
+    } else {
+        jobPtr->nextPtr = NULL;
+        jobPtr->prevPtr = workerPtr->lastPtr;
+        if (workerPtr->lastPtr != NULL) {
+            workerPtr->lastPtr->nextPtr = jobPtr;
+        } else {
+            workerPtr->firstPtr = jobPtr;
+        }
+        workerPtr->lastPtr = jobPtr;
+    }
+    workerPtr->nJobs++;
+}
+
+static void
+DequeRemove(Worker *workerPtr, Job *jobPtr)
+{
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+    NS_NONNULL_ASSERT(jobPtr != NULL);
+
+    if (jobPtr->prevPtr != NULL) {
+        jobPtr->prevPtr->nextPtr = jobPtr->nextPtr;
+    } else {
+        workerPtr->firstPtr = jobPtr->nextPtr;
+    }
+    if (jobPtr->nextPtr != NULL) {
+        jobPtr->nextPtr->prevPtr = jobPtr->prevPtr;
+    } else {
+        workerPtr->lastPtr = jobPtr->prevPtr;
+    }
+    jobPtr->nextPtr = jobPtr->prevPtr = NULL;
+    workerPtr->nJobs--;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DequeTake --
+ *
+ *      Take the first job from the deque of the worker, which can be
+ *      started. The worker's lock has to be held by the caller.
+ *
+ * Results:
+ *      The job or NULL.
+ *
+ * Side effects:
+ *      Queues have a "maxThreads" so if the queue is already
+ *      at "maxThreads", jobs of that queue will be skipped. The
+ *      returned job is reserved by incrementing nRunning of its
+ *      queue.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Job*
+DequeTake(Worker *workerPtr)
+{
+    Job *jobPtr;
+
+    NS_NONNULL_ASSERT(workerPtr != NULL);
+
+    for (jobPtr = workerPtr->firstPtr; jobPtr != NULL; jobPtr = jobPtr->nextPtr) {
+        Queue *queue = jobPtr->queuePtr;
+        bool   reserved = NS_FALSE;
+
+        Ns_MutexLock(&queue->lock);
+        if (queue->nRunning < queue->maxThreads) {
+            ++queue->nRunning;
+            --queue->nPending;
+            reserved = NS_TRUE;
         }
+        Ns_MutexUnlock(&queue->lock);
 
-        (void)ReleaseQueue(queue, NS_TRUE);
+        if (reserved) {
+            DequeRemove(workerPtr, jobPtr);
+            break;
+        }
     }
 
     return jobPtr;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2391,6 +3049,42 @@ AppendFieldLong(Tcl_Interp *interp, Tcl_Obj *list, const char *name,
     return result;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendFieldObj --
+ *
+ *     Append a name and a Tcl_Obj value to a list. The value object
+ *     is typically a fresh object with a refCount of 0.
+ *
+ * Results:
+ *     Standard Tcl result.
+ *
+ * Side effects:
+ *     None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AppendFieldObj(Tcl_Interp *interp, Tcl_Obj *list, const char *name,
+               Tcl_Obj *valueObj)
+{
+    int result;
+
+    NS_NONNULL_ASSERT(list != NULL);
+    NS_NONNULL_ASSERT(name != NULL);
+    NS_NONNULL_ASSERT(valueObj != NULL);
+
+    result = Tcl_ListObjAppendElement(interp, list, Tcl_NewStringObj(name, TCL_INDEX_NONE));
+    if (likely( result == TCL_OK )) {
+        result = Tcl_ListObjAppendElement(interp, list, valueObj);
+    }
+
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -30,6 +30,23 @@
  */
 #include <math.h>
 
+/*
+ * The structural index of the lazy parsing mode (-pointers) classifies
+ * 32 bytes per step with AVX2 (selected when the CPU supports it) or 16
+ * bytes per step with SSE2 on x86; other platforms use the portable
+ * word-at-a-time implementation.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# if defined(__SSE2__)
+#  define NS_JSON_INDEX_SSE2 1
+#  include <emmintrin.h>
+# endif
+# if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#  define NS_JSON_INDEX_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+
 #if defined(_MSC_VER)
 # define NS_ISFINITE(x) _finite(x)
 # define NS_ISINF(x)    (!_finite(x) && !_isnan(x))
@@ -194,6 +211,39 @@ typedef struct JsonKey {
     const char *bytes;
 } JsonKey;
 
+/*
+ * JsonIndex --
+ *
+ *      Structural index of a JSON document used by the lazy parsing mode.
+ *      The entries contain the byte offsets of all structural characters
+ *      ("{}[]:,") outside of strings and of the opening and closing quotes
+ *      of strings in document order.  For opening brackets, "match" is the
+ *      entry index of the corresponding closing bracket, such that complete
+ *      subtrees can be skipped in one step.
+ */
+typedef struct JsonIndexEntry {
+    uint32_t pos;
+    uint32_t match;
+} JsonIndexEntry;
+
+typedef struct JsonIndex {
+    const unsigned char *buf;
+    size_t               len;
+    JsonIndexEntry      *entries;
+    size_t               nEntries;
+    size_t               size;
+} JsonIndex;
+
+/*
+ * JsonEncodeOptions --
+ *
+ *      Options of "ns_json encode" passed through the recursive encoder.
+ */
+typedef struct JsonEncodeOptions {
+    Tcl_Obj    *nullValueObj;
+    bool        pretty;
+} JsonEncodeOptions;
+
 /*
  * Ranges for numeric options.
  */
@@ -254,6 +304,7 @@ typedef struct {
 /*
  * Local functions defined in this file
  */
+static TCL_OBJCMDPROC_T JsonEncodeObjCmd;
 static TCL_OBJCMDPROC_T JsonIsNullObjCmd;
 static TCL_OBJCMDPROC_T JsonKeyDecodeObjCmd;
 static TCL_OBJCMDPROC_T JsonKeyEncodeObjCmd;
@@ -369,6 +420,7 @@ static Tcl_Obj      *JsonInternKeyObj(JsonParser *jp, const char *bytes, TCL_SIZ
 static const char *  JsonTypeString(JsonValueType vt);
 static JsonValueType JsonTypeObjToVt(Tcl_Obj *typeObj) NS_GNUC_NONNULL(1);
 static JsonValueType JsonValueTypeDetect(Tcl_Interp *interp, Tcl_Obj *valueObj) NS_GNUC_NONNULL(1,2);
+static JsonValueType JsonScalarTypeDetect(Tcl_Obj *valueObj) NS_GNUC_NONNULL(1);
 static JsonValueType TriplesDetectRootWrapper(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj **rootTypeObjPtr, Tcl_Obj **rootValuePtr)  NS_GNUC_NONNULL(1,2,4);
 static Ns_ReturnCode JsonRequireValidNumberObj(Tcl_Interp *interp, Tcl_Obj *valueObj) NS_GNUC_NONNULL(2);
 static Ns_ReturnCode JsonTriplesRequireValidContainerObj(Tcl_Interp *interp, Tcl_Obj *containerObj,
@@ -445,6 +497,18 @@ static int           JsonEmitValueFromTriple(Tcl_Interp *interp, Tcl_Obj *typeOb
 static int           JsonEmitContainerFromTriples(Tcl_Interp *interp, Tcl_Obj *triplesObj, bool isObject,
                                                   bool validateNumbers, int depth, bool pretty,
                                                   Tcl_DString *dsPtr) NS_GNUC_NONNULL(1,2,7);
+/*
+ * Tcl value encoding helpers.
+ */
+static JsonValueType JsonEncodeTypeNameToVt(Tcl_Obj *typeObj) NS_GNUC_NONNULL(1);
+static Ns_ReturnCode JsonEncodeResolveSchema(Tcl_Interp *interp, Tcl_Obj *schemaObj,
+                                             JsonValueType *vtPtr, Tcl_Obj **nodePtr) NS_GNUC_NONNULL(1,2,3,4);
+static int           JsonEncodeValue(Tcl_Interp *interp, Tcl_Obj *schemaObj, Tcl_Obj *valueObj,
+                                     const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr) NS_GNUC_NONNULL(1,3,4,6);
+static int           JsonEncodeObject(Tcl_Interp *interp, Tcl_Obj *propertiesObj, Tcl_Obj *valueObj,
+                                      const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr) NS_GNUC_NONNULL(1,3,4,6);
+static int           JsonEncodeArray(Tcl_Interp *interp, Tcl_Obj *itemsObj, Tcl_Obj *valueObj,
+                                     const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr) NS_GNUC_NONNULL(1,3,4,6);
 /*
  * Pretty-print helpers.
  */
@@ -533,6 +597,20 @@ static Tcl_Obj      *JsonSchemaBuildAnyOf2(Tcl_Obj *schema1Obj, Tcl_Obj *schema2
 static Ns_ReturnCode JsonSchemaRequiredIntersection(Tcl_Interp *interp, Tcl_Obj *required1Obj, Tcl_Obj *required2Obj, Tcl_Obj **requiredOutObjPtr) NS_GNUC_NONNULL(1,4);
 static bool          JsonSchemaRequiredContains(Tcl_Interp *interp, Tcl_Obj *requiredObj, Tcl_Obj *nameObj) NS_GNUC_NONNULL(1,2,3);
 
+/*
+ * Structural index and lazy extraction helpers.
+ */
+static Ns_ReturnCode JsonIndexBuild(JsonIndex *ixPtr, const unsigned char *buf, size_t len, int maxDepth,
+                                    Tcl_DString *errDsPtr) NS_GNUC_NONNULL(1,2,5);
+static void          JsonIndexFree(JsonIndex *ixPtr) NS_GNUC_NONNULL(1);
+static size_t        JsonIndexSkipValue(const JsonIndex *ixPtr, size_t pos, size_t k) NS_GNUC_NONNULL(1);
+static size_t        JsonIndexValueEnd(const JsonIndex *ixPtr, size_t pos, size_t k) NS_GNUC_NONNULL(1);
+static Ns_ReturnCode JsonIndexLookup(const JsonIndex *ixPtr, Tcl_Obj *pathObj, const Ns_JsonOptions *opt,
+                                     size_t *startPtr, size_t *endPtr, bool *foundPtr,
+                                     Tcl_DString *errDsPtr) NS_GNUC_NONNULL(1,2,3,4,5,6,7);
+static int           JsonParsePointers(Tcl_Interp *interp, const unsigned char *buf, size_t len,
+                                       const Ns_JsonOptions *opt, Tcl_Obj *pointersObj) NS_GNUC_NONNULL(1,2,4,5);
+
 /*
  * Result post-processing helpers.
  */
@@ -847,6 +925,11 @@ JsonAppendDecoded(JsonParser *jp, const unsigned char *at, const char *bytes, si
  *      contains the required JSON escape sequences for quotes, backslashes,
  *      and control characters.
  *
+ *      Runs of bytes requiring no escaping are located word-at-a-time (8
+ *      bytes per step, using the same bit tricks as the parser's scan
+ *      helpers) and copied with a single append, such that typical
+ *      strings without special characters are copied in one step.
+ *
  * Results:
  *      None.
  *
@@ -860,11 +943,41 @@ JsonAppendQuotedString(Tcl_DString *dsPtr, const char *s, TCL_SIZE_T len)
 {
     const unsigned char *p = (const unsigned char *)s;
     const unsigned char *end = p + len;
+    const unsigned char *run = p;
 
     Tcl_DStringAppend(dsPtr, "\"", 1);
 
-    while (p < end) {
-        unsigned char c = *p++;
+    for (;;) {
+        unsigned char c;
+
+        /*
+         * Skip over bytes needing no escape: first in full words, then
+         * bytewise up to the next special character.
+         */
+        while (p + 8 <= end) {
+            uint64_t w;
+
+            memcpy(&w, p, sizeof(w));
+            if ((JsonHasByteLt0x20(w)
+                 | JsonEqByteMask(w, 0x2222222222222222ULL)    /* '"' */
+                 | JsonEqByteMask(w, 0x5C5C5C5C5C5C5C5CULL))   /* '\\' */
+                != 0u) {
+                break;
+            }
+            p += 8;
+        }
+        while (p < end && *p >= 0x20u && *p != UCHAR('"') && *p != UCHAR('\\')) {
+            p++;
+        }
+        if (p > run) {
+            Tcl_DStringAppend(dsPtr, (const char *)run, (TCL_SIZE_T)(p - run));
+        }
+        if (p == end) {
+            break;
+        }
+
+        c = *p++;
+        run = p;
         switch (c) {
         case '\"': Tcl_DStringAppend(dsPtr, "\\\"", 2); break;
         case '\\': Tcl_DStringAppend(dsPtr, "\\\\", 2); break;
@@ -873,22 +986,48 @@ JsonAppendQuotedString(Tcl_DString *dsPtr, const char *s, TCL_SIZE_T len)
         case '\n': Tcl_DStringAppend(dsPtr, "\\n", 2); break;
         case '\r': Tcl_DStringAppend(dsPtr, "\\r", 2); break;
         case '\t': Tcl_DStringAppend(dsPtr, "\\t", 2); break;
-        default:
-            if (c < 0x20) {
-                char buf[7];
-                (void)snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)c);
-                Tcl_DStringAppend(dsPtr, buf, 6);
-            } else {
-                Tcl_DStringAppend(dsPtr, (const char *)&c, 1);
-            }
+        default: {
+            char buf[7];
+            (void)snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)c);
+            Tcl_DStringAppend(dsPtr, buf, 6);
             break;
         }
+        }
     }
 
     Tcl_DStringAppend(dsPtr, "\"", 1);
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_JsonAppendString --
+ *
+ *      Public variant of JsonAppendQuotedString() for modules producing
+ *      JSON output, e.g. structured access logs.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Appends bytes to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+Ns_JsonAppendString(Tcl_DString *dsPtr, const char *s, TCL_SIZE_T len)
+{
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(s != NULL);
+
+    if (len == TCL_INDEX_NONE) {
+        len = (TCL_SIZE_T)strlen(s);
+    }
+    JsonAppendQuotedString(dsPtr, s, len);
+}
+
+
 /*======================================================================
  * Function Implementation: Low-level byte/scan helpers.
  *======================================================================
@@ -2293,24 +2432,43 @@ JsonValueTypeDetect(Tcl_Interp *interp, Tcl_Obj *valueObj)
         return tvt;
     }
 
-    /*
-     * Conservative scalar AUTO: number, boolean, null atom, else string.
-     */
-    {
-        int         b;
-        TCL_SIZE_T  len;
-        const char *s = Tcl_GetStringFromObj(valueObj, &len);
+    return JsonScalarTypeDetect(valueObj);
+}
 
-        if (JsonNumberLexemeIsValid((const unsigned char *)s, (size_t)len)) {
-            return JSON_VT_NUMBER;
-        }
-        if (!(s[0] == '0' && len > 1)
-            && Tcl_GetBooleanFromObj(NULL, valueObj, &b) == TCL_OK) {
-            return JSON_VT_BOOL;
-        }
-        if (JsonIsNullObj(valueObj)) {
-            return JSON_VT_NULL;
-        }
+/*
+ *-----------------------------------------------------------------------
+ *
+ * JsonScalarTypeDetect --
+ *
+ *      Conservative scalar classification used for AUTO values: number,
+ *      boolean, null atom, else string.  In contrast to
+ *      JsonValueTypeDetect(), no triples container detection is performed,
+ *      such that plain strings are not converted to Tcl lists.
+ *
+ * Results:
+ *      The inferred scalar JsonValueType.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------
+ */
+static JsonValueType
+JsonScalarTypeDetect(Tcl_Obj *valueObj)
+{
+    int         b;
+    TCL_SIZE_T  len;
+    const char *s = Tcl_GetStringFromObj(valueObj, &len);
+
+    if (JsonNumberLexemeIsValid((const unsigned char *)s, (size_t)len)) {
+        return JSON_VT_NUMBER;
+    }
+    if (!(s[0] == '0' && len > 1)
+        && Tcl_GetBooleanFromObj(NULL, valueObj, &b) == TCL_OK) {
+        return JSON_VT_BOOL;
+    }
+    if (JsonIsNullObj(valueObj)) {
+        return JSON_VT_NULL;
     }
 
     return JSON_VT_STRING;
@@ -4810,642 +4968,1022 @@ JsonEmitContainerFromTriples(Tcl_Interp *interp, Tcl_Obj *triplesObj, bool isObj
 }
 
 /*======================================================================
- * Function Implementations: Pretty-print helpers.
+ * Function Implementations: Tcl value encoding helpers.
  *======================================================================
  */
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonPrettyIndent --
- *
- *      Append a newline followed by indentation for pretty-printed JSON
- *      output.
+ * JsonEncodeTypeNameToVt --
  *
- *      Indentation uses two spaces per nesting level. The caller provides
- *      the current nesting depth, where depth 0 corresponds to the top
- *      level.
+ *      Map a JSON Schema type name to the JSON value type.  In addition
+ *      to the type names accepted by JsonTypeObjToVt(), the JSON Schema
+ *      type "integer" is accepted and emitted as number.
  *
  * Results:
- *      None.
+ *      JsonValueType, JSON_VT_AUTO for unknown type names.
  *
- * Side effects:
- *      Appends to dsPtr.
+ * Side Effects:
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static void
-JsonPrettyIndent(Tcl_DString *dsPtr, int depth)
+static JsonValueType
+JsonEncodeTypeNameToVt(Tcl_Obj *typeObj)
 {
-    int i;
-    Tcl_DStringAppend(dsPtr, "\n", 1);
-    for (i = 0; i < depth * 2; i++) {
-        Tcl_DStringAppend(dsPtr, " ", 1);
+    JsonValueType vt = JsonTypeObjToVt(typeObj);
+
+    if (vt == JSON_VT_AUTO) {
+        TCL_SIZE_T  len;
+        const char *t = Tcl_GetStringFromObj(typeObj, &len);
+
+        if (len == 7 && memcmp(t, "integer", 7) == 0) {
+            vt = JSON_VT_NUMBER;
+        }
     }
+    return vt;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonObjectPrettySingleLine --
- *
- *      Determine whether a JSON object should be rendered on a single
- *      line in pretty-print mode.
- *
- *      As a first approximation, objects are rendered without line breaks
- *      when all values are either scalar JSON values or simple schema
- *      objects of the form
- *
- *          {type string VALUE}
- *          {type array  {0 string ...}}
- *
- *      Objects containing nested nontrivial objects or arrays are rendered
- *      across multiple lines.
- *
- *      The input is the VALUE part of an object in triples form, i.e. an
- *      object container-content triples list of the form
+ * JsonEncodeResolveSchema --
  *
- *          NAME TYPE VALUE NAME TYPE VALUE ...
+ *      Determine the JSON type described by a schema node for
+ *      "ns_json encode".  A schema node is either a plain type name
+ *      ("string", "number", "integer", "boolean", "null", "object",
+ *      "array") or a JSON Schema-like dict using the keywords "type",
+ *      "properties", "items" and "anyOf", as produced by "ns_json triples
+ *      schema".  For type unions (e.g. {string null}) and "anyOf", the
+ *      first non-null alternative is used, since null values are
+ *      recognized independently of the schema.  Other keywords are
+ *      ignored.
  *
  * Results:
- *      NS_TRUE  when the object should be formatted on a single line,
- *      NS_FALSE otherwise.
+ *      NS_OK or NS_ERROR (with error message in interp).
  *
- * Side effects:
- *      None.
+ * Side Effects:
+ *      Sets *vtPtr to the resolved type and *nodePtr to the schema dict
+ *      containing "properties" or "items" for containers (or NULL).
  *
  *----------------------------------------------------------------------
  */
-static bool
-JsonObjectPrettySingleLine(Tcl_Interp *interp, TCL_SIZE_T oc, Tcl_Obj **ov)
+static Ns_ReturnCode
+JsonEncodeResolveSchema(Tcl_Interp *interp, Tcl_Obj *schemaObj,
+                        JsonValueType *vtPtr, Tcl_Obj **nodePtr)
 {
     JsonValueType vt;
+    Tcl_Obj      *typeObj, *anyOfObj;
+    TCL_SIZE_T    size;
 
-    if (oc != 3) {
-        return NS_FALSE;
+    /*
+     * Fast path: schema node is a plain type name.
+     */
+    vt = JsonEncodeTypeNameToVt(schemaObj);
+    if (vt != JSON_VT_AUTO) {
+        *vtPtr = vt;
+        *nodePtr = NULL;
+        return NS_OK;
     }
 
-    vt = JsonTypeObjToVt(ov[1]);
+    if (Tcl_DictObjSize(NULL, schemaObj, &size) != TCL_OK) {
+        Ns_TclPrintfResult(interp, "ns_json encode: invalid schema \"%s\"",
+                           Tcl_GetString(schemaObj));
+        return NS_ERROR;
+    }
+    *nodePtr = schemaObj;
 
-    switch (vt) {
-    case JSON_VT_STRING:
-    case JSON_VT_NUMBER:
-    case JSON_VT_BOOL:
-    case JSON_VT_NULL:
-        return NS_TRUE;
+    typeObj = JsonSchemaDictGet(schemaObj, JSON_ATOM_TYPE);
+    if (typeObj != NULL) {
+        Tcl_Obj  **tv;
+        TCL_SIZE_T tc, i;
 
-    case JSON_VT_ARRAY: {
-        Tcl_Obj   **aov;
-        TCL_SIZE_T  aoc;
+        if (Tcl_ListObjGetElements(NULL, typeObj, &tc, &tv) != TCL_OK || tc == 0) {
+            Ns_TclPrintfResult(interp, "ns_json encode: invalid schema type \"%s\"",
+                               Tcl_GetString(typeObj));
+            return NS_ERROR;
+        }
+        for (i = 0; i < tc; i++) {
+            JsonValueType tvt = JsonEncodeTypeNameToVt(tv[i]);
 
-        if (Tcl_ListObjGetElements(interp, ov[2], &aoc, &aov) != TCL_OK) {
-            return NS_FALSE;
+            if (tvt == JSON_VT_AUTO) {
+                Ns_TclPrintfResult(interp, "ns_json encode: invalid schema type \"%s\"",
+                                   Tcl_GetString(typeObj));
+                return NS_ERROR;
+            }
+            if (tvt != JSON_VT_NULL) {
+                *vtPtr = tvt;
+                return NS_OK;
+            }
         }
-        return JsonArrayPrettySingleLine(aoc, aov);
+        *vtPtr = JSON_VT_NULL;
+        return NS_OK;
     }
 
-    case JSON_VT_OBJECT: {
-        Tcl_Obj   **iov;
-        TCL_SIZE_T  ioc;
+    anyOfObj = JsonSchemaDictGet(schemaObj, JSON_ATOM_ANYOF);
+    if (anyOfObj != NULL) {
+        Tcl_Obj  **bv;
+        TCL_SIZE_T bc, i;
 
-        if (Tcl_ListObjGetElements(interp, ov[2], &ioc, &iov) != TCL_OK) {
-            return NS_FALSE;
+        if (Tcl_ListObjGetElements(interp, anyOfObj, &bc, &bv) != TCL_OK) {
+            return NS_ERROR;
         }
-        return JsonObjectPrettySingleLine(interp, ioc, iov);
+        vt = JSON_VT_NULL;
+        for (i = 0; i < bc; i++) {
+            if (JsonEncodeResolveSchema(interp, bv[i], &vt, nodePtr) != NS_OK) {
+                return NS_ERROR;
+            }
+            if (vt != JSON_VT_NULL) {
+                break;
+            }
+        }
+        *vtPtr = vt;
+        return NS_OK;
     }
 
-    case JSON_VT_AUTO:
-    default:
-        return NS_FALSE;
+    if (JsonSchemaDictGet(schemaObj, JSON_ATOM_PROPERTIES) != NULL) {
+        *vtPtr = JSON_VT_OBJECT;
+    } else if (JsonSchemaDictGet(schemaObj, JSON_ATOM_ITEMS) != NULL) {
+        *vtPtr = JSON_VT_ARRAY;
+    } else {
+        *vtPtr = JSON_VT_AUTO;
     }
+    return NS_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonArrayPrettySingleLine --
- *
- *      Determine whether a JSON array should be rendered on a single
- *      line in pretty-print mode.
- *
- *      As a first approximation, arrays are rendered without line breaks
- *      when all elements are scalar values (string, number, boolean, or
- *      null).  Arrays containing nested objects or arrays are rendered
- *      across multiple lines.
- *
- *      The input is the VALUE part of an array in triples form, i.e. an
- *      array container-content triples list of the form
+ * JsonEncodeValue --
  *
- *          0 TYPE VALUE 1 TYPE VALUE ...
+ *      Emit the JSON representation of a plain Tcl value (scalar, dict or
+ *      list) as described by the optional schema node into the destination
+ *      DString.  Without a schema node, the type of the value is detected
+ *      via JsonScalarTypeDetect().  JSON null objects and values equal to
+ *      the configured null value are always emitted as null.
  *
  * Results:
- *      NS_TRUE  when the array should be formatted on a single line,
- *      NS_FALSE otherwise.
+ *      TCL_OK on success, TCL_ERROR on invalid schema or values, with an
+ *      error message set in interp.
  *
- * Side effects:
- *      None.
+ * Side Effects:
+ *      Appends bytes to dsPtr.
  *
  *----------------------------------------------------------------------
  */
-static bool
-JsonArrayPrettySingleLine(TCL_SIZE_T  oc, Tcl_Obj   **ov)
+static int
+JsonEncodeValue(Tcl_Interp *interp, Tcl_Obj *schemaObj, Tcl_Obj *valueObj,
+                const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr)
 {
-    for (TCL_SIZE_T i = 0; i < oc; i += 3) {
-        JsonValueType vt = JsonTypeObjToVt(ov[i + 1]);
+    JsonValueType vt = JSON_VT_AUTO;
+    Tcl_Obj      *nodeObj = NULL;
+    const char   *s;
+    TCL_SIZE_T    len;
 
-        if (vt == JSON_VT_OBJECT || vt == JSON_VT_ARRAY || vt == JSON_VT_AUTO) {
-            return NS_FALSE;
+    if (JsonIsNullObj(valueObj)) {
+        Tcl_DStringAppend(dsPtr, "null", 4);
+        return TCL_OK;
+    }
+    if (opt->nullValueObj != NULL) {
+        TCL_SIZE_T  nullLen;
+        const char *nullString = Tcl_GetStringFromObj(opt->nullValueObj, &nullLen);
+
+        s = Tcl_GetStringFromObj(valueObj, &len);
+        if (len == nullLen && memcmp(s, nullString, (size_t)len) == 0) {
+            Tcl_DStringAppend(dsPtr, "null", 4);
+            return TCL_OK;
         }
     }
 
-    return NS_TRUE;
-}
+    if (schemaObj != NULL
+        && JsonEncodeResolveSchema(interp, schemaObj, &vt, &nodeObj) != NS_OK) {
+        return TCL_ERROR;
+    }
+    if (vt == JSON_VT_AUTO) {
+        vt = JsonScalarTypeDetect(valueObj);
+    }
 
+    switch (vt) {
+    case JSON_VT_STRING:
+        s = Tcl_GetStringFromObj(valueObj, &len);
+        JsonAppendQuotedString(dsPtr, s, len);
+        break;
 
-/*======================================================================
- * Function Implementations: Sorting helpers.
- *======================================================================
- */
+    case JSON_VT_NUMBER: {
+        Tcl_Obj *numObj;
 
-/*
- *----------------------------------------------------------------------
- *
- * JsonTriplesSortObject --
- *
- *      Return a sorted copy of an object container represented in
- *      triples form.
- *
- *      The function sorts the NAME TYPE VALUE triples by key name to
- *      obtain a stable canonical ordering of object members.
- *
- * Results:
- *      NS_OK or NS_ERROR.
- *
- * Side effects:
- *      Allocates a new Tcl list object containing the sorted triples
- *      and stores it in *sortedObjPtr.
- *
- *----------------------------------------------------------------------
- */
-static Ns_ReturnCode
-JsonTriplesSortObject(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj **sortedObjPtr)
-{
-    TCL_SIZE_T   lc;
-    Tcl_Obj    **lv;
-    Tcl_Obj      *sortedObj;
-    TCL_SIZE_T   nentries;
-
-    NS_NONNULL_ASSERT(sortedObjPtr != NULL);
-    *sortedObjPtr = NULL;
-
-    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
-        return NS_ERROR;
-    }
-    if ((lc % 3) != 0) {
-        Ns_TclPrintfResult(interp,
-                           "ns_json: object triples length must be multiple of 3");
-        return NS_ERROR;
+        if (JsonNumberObjToLexeme(interp, valueObj, &numObj) != NS_OK) {
+            return TCL_ERROR;
+        }
+        if (numObj != valueObj) {
+            Tcl_IncrRefCount(numObj);
+        }
+        s = Tcl_GetStringFromObj(numObj, &len);
+        Tcl_DStringAppend(dsPtr, s, len);
+        if (numObj != valueObj) {
+            Tcl_DecrRefCount(numObj);
+        }
+        break;
     }
 
-    nentries = lc / 3;
-    if (nentries == 0) {
-        *sortedObjPtr = Tcl_NewListObj(0, NULL);
-
-    } else {
-        JsonTripleEntry  *entries = (JsonTripleEntry *)ns_malloc_nonzero((size_t)nentries * sizeof(JsonTripleEntry));
+    case JSON_VT_BOOL: {
+        int b = 0;
 
-        for (TCL_SIZE_T i = 0, j = 0; i < lc; i += 3, j++) {
-            entries[j].nameObj  = lv[i + 0];
-            entries[j].typeObj  = lv[i + 1];
-            entries[j].valueObj = lv[i + 2];
+        if (Tcl_GetBooleanFromObj(interp, valueObj, &b) != TCL_OK) {
+            return TCL_ERROR;
         }
+        Tcl_DStringAppend(dsPtr, b ? "true" : "false", b ? 4 : 5);
+        break;
+    }
 
-        qsort(entries, (size_t)nentries, sizeof(JsonTripleEntry), JsonTripleEntryNameCmp);
+    case JSON_VT_NULL:
+        Tcl_DStringAppend(dsPtr, "null", 4);
+        break;
 
-        sortedObj = Tcl_NewListObj(0, NULL);
-        for (TCL_SIZE_T i = 0; i < nentries; i++) {
-            JsonTriplesAppend(sortedObj,
-                              entries[i].nameObj,
-                              entries[i].typeObj,
-                              entries[i].valueObj);
-        }
+    case JSON_VT_OBJECT:
+        return JsonEncodeObject(interp,
+                                nodeObj != NULL ? JsonSchemaDictGet(nodeObj, JSON_ATOM_PROPERTIES) : NULL,
+                                valueObj, opt, depth, dsPtr);
 
-        ns_free(entries);
-        *sortedObjPtr = sortedObj;
+    case JSON_VT_ARRAY:
+        return JsonEncodeArray(interp,
+                               nodeObj != NULL ? JsonSchemaDictGet(nodeObj, JSON_ATOM_ITEMS) : NULL,
+                               valueObj, opt, depth, dsPtr);
+
+    case JSON_VT_AUTO:
+    default:
+        Ns_TclPrintfResult(interp, "ns_json encode: unsupported type");
+        return TCL_ERROR;
     }
-    return NS_OK;
+
+    return TCL_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonTripleEntryNameCmp --
- *
- *      Comparison function used when sorting triples representing an
- *      object container.
+ * JsonEncodeObject --
  *
- *      The function compares the NAME element of two triples and
- *      returns the ordering required by qsort().
+ *      Emit a Tcl dict as JSON object.  The members are emitted in the
+ *      order of the dict.  The schema of a member is looked up in the
+ *      provided "properties" dict of the schema; members without schema
+ *      are emitted with detected scalar types.
  *
  * Results:
- *      An integer less than, equal to, or greater than zero depending
- *      on the lexical ordering of the compared keys.
+ *      TCL_OK on success, TCL_ERROR on invalid input with an error message
+ *      set in interp.
  *
- * Side effects:
- *      None.
+ * Side Effects:
+ *      Appends bytes to dsPtr.
  *
  *----------------------------------------------------------------------
  */
 static int
-JsonTripleEntryNameCmp(const void *a, const void *b)
+JsonEncodeObject(Tcl_Interp *interp, Tcl_Obj *propertiesObj, Tcl_Obj *valueObj,
+                 const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr)
 {
-    const JsonTripleEntry *ea = (const JsonTripleEntry *)a;
-    const JsonTripleEntry *eb = (const JsonTripleEntry *)b;
-    const char *sa = Tcl_GetString(ea->nameObj);
-    const char *sb = Tcl_GetString(eb->nameObj);
-    return strcmp(sa, sb);
+    Tcl_DictSearch search;
+    Tcl_Obj       *keyObj, *memberObj;
+    int            done, result = TCL_OK;
+    bool           first = NS_TRUE;
+
+    if (Tcl_DictObjFirst(interp, valueObj, &search, &keyObj, &memberObj, &done) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (done) {
+        Tcl_DStringAppend(dsPtr, "{}", 2);
+        return TCL_OK;
+    }
+
+    Tcl_DStringAppend(dsPtr, "{", 1);
+    for (; !done; Tcl_DictObjNext(&search, &keyObj, &memberObj, &done)) {
+        Tcl_Obj    *memberSchemaObj = NULL;
+        const char *key;
+        TCL_SIZE_T  keyLen;
+
+        if (!first) {
+            Tcl_DStringAppend(dsPtr, ",", 1);
+        }
+        first = NS_FALSE;
+        if (opt->pretty) {
+            JsonPrettyIndent(dsPtr, depth + 1);
+        }
+
+        key = Tcl_GetStringFromObj(keyObj, &keyLen);
+        JsonAppendQuotedString(dsPtr, key, keyLen);
+        Tcl_DStringAppend(dsPtr, opt->pretty ? ": " : ":", opt->pretty ? 2 : 1);
+
+        if (propertiesObj != NULL) {
+            (void) Tcl_DictObjGet(NULL, propertiesObj, keyObj, &memberSchemaObj);
+        }
+        result = JsonEncodeValue(interp, memberSchemaObj, memberObj, opt, depth + 1, dsPtr);
+        if (result != TCL_OK) {
+            Tcl_AppendObjToErrorInfo(interp, Tcl_ObjPrintf("\n    (encoding member \"%s\")", key));
+            break;
+        }
+    }
+    Tcl_DictObjDone(&search);
+
+    if (result == TCL_OK) {
+        if (opt->pretty) {
+            JsonPrettyIndent(dsPtr, depth);
+        }
+        Tcl_DStringAppend(dsPtr, "}", 1);
+    }
+    return result;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaStringEntryCmp --
- *
- *      Comparison function used when sorting arrays of strings in
- *      schema objects.
+ * JsonEncodeArray --
  *
- *      This helper is primarily used when canonicalizing schema fields
- *      such as "required" or type unions, where stable lexicographic
- *      ordering is desired.
+ *      Emit a Tcl list as JSON array.  All elements are emitted according
+ *      to the "items" schema, or with detected scalar types when no such
+ *      schema is provided.
  *
  * Results:
- *      An integer less than, equal to, or greater than zero depending
- *      on the lexical ordering of the compared strings.
+ *      TCL_OK on success, TCL_ERROR on invalid input with an error message
+ *      set in interp.
  *
- * Side effects:
- *      None.
+ * Side Effects:
+ *      Appends bytes to dsPtr.
  *
  *----------------------------------------------------------------------
  */
 static int
-JsonSchemaStringEntryCmp(const void *a, const void *b)
+JsonEncodeArray(Tcl_Interp *interp, Tcl_Obj *itemsObj, Tcl_Obj *valueObj,
+                const JsonEncodeOptions *opt, int depth, Tcl_DString *dsPtr)
 {
-    const JsonStringEntry *ea = (const JsonStringEntry *)a;
-    const JsonStringEntry *eb = (const JsonStringEntry *)b;
+    Tcl_Obj  **ov;
+    TCL_SIZE_T oc, i;
 
-    return strcmp(Tcl_GetString(ea->valueObj), Tcl_GetString(eb->valueObj));
+    if (Tcl_ListObjGetElements(interp, valueObj, &oc, &ov) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (oc == 0) {
+        Tcl_DStringAppend(dsPtr, "[]", 2);
+        return TCL_OK;
+    }
+
+    Tcl_DStringAppend(dsPtr, "[", 1);
+    for (i = 0; i < oc; i++) {
+        if (i > 0) {
+            Tcl_DStringAppend(dsPtr, ",", 1);
+        }
+        if (opt->pretty) {
+            JsonPrettyIndent(dsPtr, depth + 1);
+        }
+        if (JsonEncodeValue(interp, itemsObj, ov[i], opt, depth + 1, dsPtr) != TCL_OK) {
+            Tcl_AppendObjToErrorInfo(interp, Tcl_ObjPrintf("\n    (encoding element %ld)", (long)i));
+            return TCL_ERROR;
+        }
+    }
+    if (opt->pretty) {
+        JsonPrettyIndent(dsPtr, depth);
+    }
+    Tcl_DStringAppend(dsPtr, "]", 1);
+    return TCL_OK;
 }
 
 /*======================================================================
- * Function Implementations: Schema triples field access helpers.
+ * Function Implementations: Pretty-print helpers.
  *======================================================================
  */
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaFindField --
+ * JsonPrettyIndent --
  *
- *      Locate a field in a schema object represented in triples form.
+ *      Append a newline followed by indentation for pretty-printed JSON
+ *      output.
  *
- *      The function searches the NAME TYPE VALUE triples of triplesObj
- *      for an entry whose NAME matches nameObj.  When found, the index
- *      of the triple (the position of the NAME element) is returned via
- *      baseIdxPtr.
+ *      Indentation uses two spaces per nesting level. The caller provides
+ *      the current nesting depth, where depth 0 corresponds to the top
+ *      level.
  *
  * Results:
- *      Returns NS_TRUE when the field is present, NS_FALSE otherwise.
+ *      None.
  *
  * Side effects:
- *      On success, stores the index of the triple in *baseIdxPtr.
+ *      Appends to dsPtr.
  *
  *----------------------------------------------------------------------
  */
-static bool
-JsonSchemaFindField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
-                           TCL_SIZE_T *baseIdxPtr)
+static void
+JsonPrettyIndent(Tcl_DString *dsPtr, int depth)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc;
-
-    *baseIdxPtr = TCL_INDEX_NONE;
-
-    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
-        return NS_FALSE;
-    }
-    if ((lc % 3) != 0) {
-        return NS_FALSE;
-    }
-
-    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
-        if (TripleKeyMatches(lv[i], nameObj)) {
-            *baseIdxPtr = i;
-            return NS_TRUE;
-        }
+    int i;
+    Tcl_DStringAppend(dsPtr, "\n", 1);
+    for (i = 0; i < depth * 2; i++) {
+        Tcl_DStringAppend(dsPtr, " ", 1);
     }
-    return NS_FALSE;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaGetField --
+ * JsonObjectPrettySingleLine --
  *
- *      Retrieve a field from a schema object represented in triples form.
+ *      Determine whether a JSON object should be rendered on a single
+ *      line in pretty-print mode.
  *
- *      The function searches triplesObj for a triple with NAME equal to
- *      nameObj.  When found, the TYPE and VALUE elements of the triple
- *      can be returned to the caller via typeObjPtr and valueObjPtr.
+ *      As a first approximation, objects are rendered without line breaks
+ *      when all values are either scalar JSON values or simple schema
+ *      objects of the form
+ *
+ *          {type string VALUE}
+ *          {type array  {0 string ...}}
+ *
+ *      Objects containing nested nontrivial objects or arrays are rendered
+ *      across multiple lines.
+ *
+ *      The input is the VALUE part of an object in triples form, i.e. an
+ *      object container-content triples list of the form
+ *
+ *          NAME TYPE VALUE NAME TYPE VALUE ...
  *
  * Results:
- *      Returns NS_TRUE when the field is present, NS_FALSE otherwise.
+ *      NS_TRUE  when the object should be formatted on a single line,
+ *      NS_FALSE otherwise.
  *
  * Side effects:
- *      When the field exists, stores the TYPE and VALUE objects and
- *      optionally the base index of the triple in the provided output
- *      pointers.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
 static bool
-JsonSchemaGetField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
-                          Tcl_Obj **typeObjPtr, Tcl_Obj **valueObjPtr, TCL_SIZE_T *baseIdxPtr)
+JsonObjectPrettySingleLine(Tcl_Interp *interp, TCL_SIZE_T oc, Tcl_Obj **ov)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc, base;
-
-    if (typeObjPtr != NULL)  { *typeObjPtr = NULL; }
-    if (valueObjPtr != NULL) { *valueObjPtr = NULL; }
-    if (baseIdxPtr != NULL)  { *baseIdxPtr = TCL_INDEX_NONE; }
+    JsonValueType vt;
 
-    if (!JsonSchemaFindField(interp, triplesObj, nameObj, &base)) {
-        return NS_FALSE;
-    }
-    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
+    if (oc != 3) {
         return NS_FALSE;
     }
 
-    if (typeObjPtr != NULL)  { *typeObjPtr  = lv[base + 1]; }
-    if (valueObjPtr != NULL) { *valueObjPtr = lv[base + 2]; }
-    if (baseIdxPtr != NULL)  { *baseIdxPtr  = base; }
+    vt = JsonTypeObjToVt(ov[1]);
 
-    return NS_TRUE;
-}
+    switch (vt) {
+    case JSON_VT_STRING:
+    case JSON_VT_NUMBER:
+    case JSON_VT_BOOL:
+    case JSON_VT_NULL:
+        return NS_TRUE;
 
-/*
- *----------------------------------------------------------------------
- *
- * JsonSchemaSetField --
- *
- *      Set or replace a field in a schema object represented in triples
- *      form.
- *
- *      The function ensures that triplesObj contains a NAME TYPE VALUE
- *      triple for nameObj.  When the field already exists, its TYPE and
- *      VALUE elements are replaced.  Otherwise a new triple is appended.
- *
- * Results:
- *      NS_OK on success, NS_ERROR on failure.
- *
- * Side effects:
- *      Modifies triplesObj by replacing an existing triple or appending
- *      a new one.
- *
- *----------------------------------------------------------------------
- */
-static Ns_ReturnCode
-JsonSchemaSetField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
-                          JsonValueType vt, Tcl_Obj *valueObj)
-{
-    TCL_SIZE_T base;
+    case JSON_VT_ARRAY: {
+        Tcl_Obj   **aov;
+        TCL_SIZE_T  aoc;
 
-    if (JsonSchemaFindField(interp, triplesObj, nameObj, &base)) {
-        Tcl_Obj *repl[3];
+        if (Tcl_ListObjGetElements(interp, ov[2], &aoc, &aov) != TCL_OK) {
+            return NS_FALSE;
+        }
+        return JsonArrayPrettySingleLine(aoc, aov);
+    }
 
-        repl[0] = nameObj;
-        repl[1] = JsonAtomObj((JsonAtom)vt);
-        repl[2] = valueObj;
+    case JSON_VT_OBJECT: {
+        Tcl_Obj   **iov;
+        TCL_SIZE_T  ioc;
 
-        return Tcl_ListObjReplace(interp, triplesObj, base, 3, 3, repl) == TCL_OK ? NS_OK : NS_ERROR;
+        if (Tcl_ListObjGetElements(interp, ov[2], &ioc, &iov) != TCL_OK) {
+            return NS_FALSE;
+        }
+        return JsonObjectPrettySingleLine(interp, ioc, iov);
     }
 
-    JsonTriplesAppendVt(triplesObj, nameObj, vt, valueObj);
-    return TCL_OK;
+    case JSON_VT_AUTO:
+    default:
+        return NS_FALSE;
+    }
 }
 
-/*======================================================================
- * Function Implementations: Schema derivation helpers.
- *======================================================================
- */
-
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaNewTypeTriple --
- *
- *      Create a new schema fragment representing a simple JSON type.
- *
- *      The function allocates a new triples-form list containing a
- *      single NAME TYPE VALUE triple for the "type" field, where the
- *      VALUE element is the JSON type name specified by atom.
- *
- * Results:
- *      Returns a newly allocated Tcl list object representing the
- *      schema fragment.
- *
- * Side effects:
- *      Allocates a new Tcl object.
- *
- *----------------------------------------------------------------------
- */
-static Tcl_Obj*
-JsonSchemaNewTypeTriple(JsonAtom atom)
-{
-    Tcl_Obj* schemaObj = Tcl_NewListObj(0, NULL);
-    JsonTriplesAppendVt(schemaObj,
-                        JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, JsonAtomObj(atom));
-    return schemaObj;
-}
-
-/*
- * ----------------------------------------------------------------------*
- *
- * JsonSchemaFromValue --
+ * JsonArrayPrettySingleLine --
  *
- *      Derive a schema fragment from one JSON value.
+ *      Determine whether a JSON array should be rendered on a single
+ *      line in pretty-print mode.
  *
- *      The returned schema fragment is encoded as object triples, so it can
- *      be serialized via JsonTriplesValueToJson() like other ns_json values.
+ *      As a first approximation, arrays are rendered without line breaks
+ *      when all elements are scalar values (string, number, boolean, or
+ *      null).  Arrays containing nested objects or arrays are rendered
+ *      across multiple lines.
  *
- *      Examples:
+ *      The input is the VALUE part of an array in triples form, i.e. an
+ *      array container-content triples list of the form
  *
- *          JSON string  ->  {type string string}
- *          JSON number  ->  {type string number}
- *          JSON null    ->  {type string null}
- *          JSON object  ->  {
- *                              type string object
- *                              properties object {...}
- *                           }
- *          JSON array   ->  {
- *                              type string array
- *                              items object {...}
- *                           }
+ *          0 TYPE VALUE 1 TYPE VALUE ...
  *
  * Results:
- *      NS_OK on success, NS_ERROR on malformed triples or allocation failure.
+ *      NS_TRUE  when the array should be formatted on a single line,
+ *      NS_FALSE otherwise.
  *
  * Side effects:
- *      On success, *schemaObjPtr is set to an object-triples Tcl list.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static Ns_ReturnCode
-JsonSchemaFromValue(Tcl_Interp *interp, JsonValueType vt, Tcl_Obj *valueObj,
-                    bool includeRequired, Tcl_Obj **schemaObjPtr)
+static bool
+JsonArrayPrettySingleLine(TCL_SIZE_T  oc, Tcl_Obj   **ov)
 {
-    NS_NONNULL_ASSERT(schemaObjPtr != NULL);
-
-    switch (vt) {
-    case JSON_VT_STRING:
-        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_STRING);
-        return NS_OK;
-
-    case JSON_VT_NUMBER:
-        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_NUMBER);
-        return NS_OK;
-
-    case JSON_VT_BOOL:
-        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_BOOLEAN);
-        return NS_OK;
+    for (TCL_SIZE_T i = 0; i < oc; i += 3) {
+        JsonValueType vt = JsonTypeObjToVt(ov[i + 1]);
 
-    case JSON_VT_NULL:
-        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_NULL);
-        return NS_OK;
+        if (vt == JSON_VT_OBJECT || vt == JSON_VT_ARRAY || vt == JSON_VT_AUTO) {
+            return NS_FALSE;
+        }
+    }
 
-    case JSON_VT_OBJECT:
-        return JsonSchemaFromObject(interp, valueObj, includeRequired, schemaObjPtr);
+    return NS_TRUE;
+}
 
-    case JSON_VT_ARRAY:
-        return JsonSchemaFromArray(interp, valueObj, includeRequired, schemaObjPtr);
 
-    case JSON_VT_AUTO:
-    default:
-        Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: unsupported value type");
-        return NS_ERROR;
-    }
-}
+/*======================================================================
+ * Function Implementations: Sorting helpers.
+ *======================================================================
+ */
 
 /*
- * ----------------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * JsonSchemaFromObject --
+ * JsonTriplesSortObject --
  *
- *      Derive a schema fragment from an object container-content triples list.
+ *      Return a sorted copy of an object container represented in
+ *      triples form.
+ *
+ *      The function sorts the NAME TYPE VALUE triples by key name to
+ *      obtain a stable canonical ordering of object members.
  *
  * Results:
  *      NS_OK or NS_ERROR.
  *
  * Side effects:
- *      On success, *schemaObjPtr is set to a Tcl dict object.
+ *      Allocates a new Tcl list object containing the sorted triples
+ *      and stores it in *sortedObjPtr.
  *
  *----------------------------------------------------------------------
  */
 static Ns_ReturnCode
-JsonSchemaFromObject(Tcl_Interp *interp, Tcl_Obj *triplesObj,
-                     bool includeRequired, Tcl_Obj **schemaObjPtr)
+JsonTriplesSortObject(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj **sortedObjPtr)
 {
-    Tcl_Obj   *schemaObj, *propertiesObj, *requiredObj;
-    Tcl_Obj  **lv;
-    TCL_SIZE_T lc;
+    TCL_SIZE_T   lc;
+    Tcl_Obj    **lv;
+    Tcl_Obj      *sortedObj;
+    TCL_SIZE_T   nentries;
 
-    NS_NONNULL_ASSERT(schemaObjPtr != NULL);
-    *schemaObjPtr = NULL;
+    NS_NONNULL_ASSERT(sortedObjPtr != NULL);
+    *sortedObjPtr = NULL;
 
     if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
         return NS_ERROR;
     }
     if ((lc % 3) != 0) {
         Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: malformed object triples "
-                           "(length not multiple of 3)");
+                           "ns_json: object triples length must be multiple of 3");
         return NS_ERROR;
     }
 
-    schemaObj     = Tcl_NewListObj(0, NULL);
-    propertiesObj = Tcl_NewListObj(0, NULL);
-    requiredObj   = Tcl_NewListObj(0, NULL);
-
-    JsonTriplesAppendVt(schemaObj,
-                        JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, JsonAtomObj(JSON_ATOM_T_OBJECT));
+    nentries = lc / 3;
+    if (nentries == 0) {
+        *sortedObjPtr = Tcl_NewListObj(0, NULL);
 
-    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
-        Tcl_Obj       *nameObj  = lv[i + 0];
-        Tcl_Obj       *typeObj  = lv[i + 1];
-        Tcl_Obj       *valueObj = lv[i + 2];
-        Tcl_Obj       *childSchemaObj = NULL;
-        JsonValueType  vt = JsonTypeObjToVt(typeObj);
+    } else {
+        JsonTripleEntry  *entries = (JsonTripleEntry *)ns_malloc_nonzero((size_t)nentries * sizeof(JsonTripleEntry));
 
-        if (vt == JSON_VT_AUTO) {
-            Ns_TclPrintfResult(interp,
-                               "ns_json triples schema: malformed object triples "
-                               "(invalid type token)");
-            return NS_ERROR;
-        }
-        if (JsonSchemaFromValue(interp, vt, valueObj, includeRequired,
-                                &childSchemaObj) != NS_OK) {
-            return NS_ERROR;
+        for (TCL_SIZE_T i = 0, j = 0; i < lc; i += 3, j++) {
+            entries[j].nameObj  = lv[i + 0];
+            entries[j].typeObj  = lv[i + 1];
+            entries[j].valueObj = lv[i + 2];
         }
 
-        /*
-         * properties.NAME = childSchema
-         */
-        JsonTriplesAppendVt(propertiesObj,
-                            nameObj, JSON_VT_OBJECT, childSchemaObj);
-
-        if (includeRequired) {
-            Tcl_Obj *idxObj = Tcl_NewWideIntObj((Tcl_WideInt)(i / 3));
+        qsort(entries, (size_t)nentries, sizeof(JsonTripleEntry), JsonTripleEntryNameCmp);
 
-            JsonTriplesAppendVt(requiredObj,
-                                idxObj, JSON_VT_STRING, nameObj);
+        sortedObj = Tcl_NewListObj(0, NULL);
+        for (TCL_SIZE_T i = 0; i < nentries; i++) {
+            JsonTriplesAppend(sortedObj,
+                              entries[i].nameObj,
+                              entries[i].typeObj,
+                              entries[i].valueObj);
         }
-    }
 
-    JsonTriplesAppendVt(schemaObj,
-                        JsonAtomObj(JSON_ATOM_PROPERTIES), JSON_VT_OBJECT, propertiesObj);
-
-    if (includeRequired) {
-        JsonTriplesAppendVt(schemaObj,
-                            JsonAtomObj(JSON_ATOM_REQUIRED), JSON_VT_ARRAY, requiredObj);
+        ns_free(entries);
+        *sortedObjPtr = sortedObj;
     }
-
-    *schemaObjPtr = schemaObj;
     return NS_OK;
 }
 
 /*
- * ----------------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * JsonSchemaFromArray --
+ * JsonTripleEntryNameCmp --
  *
- *      Derive a schema fragment from an array container-content triples list.
+ *      Comparison function used when sorting triples representing an
+ *      object container.
  *
- *      Array item schemas are merged into a single "items" schema.  When
- *      incompatible structures are observed, the merge falls back to "anyOf".
+ *      The function compares the NAME element of two triples and
+ *      returns the ordering required by qsort().
  *
  * Results:
- *      NS_OK or NS_ERROR.
+ *      An integer less than, equal to, or greater than zero depending
+ *      on the lexical ordering of the compared keys.
  *
  * Side effects:
- *      On success, *schemaObjPtr is set to a Tcl dict object.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static Ns_ReturnCode
-JsonSchemaFromArray(Tcl_Interp *interp, Tcl_Obj *triplesObj,
-                    bool includeRequired, Tcl_Obj **schemaObjPtr)
+static int
+JsonTripleEntryNameCmp(const void *a, const void *b)
 {
-    Tcl_Obj   *schemaObj, *itemsObj = NULL;
+    const JsonTripleEntry *ea = (const JsonTripleEntry *)a;
+    const JsonTripleEntry *eb = (const JsonTripleEntry *)b;
+    const char *sa = Tcl_GetString(ea->nameObj);
+    const char *sb = Tcl_GetString(eb->nameObj);
+    return strcmp(sa, sb);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaStringEntryCmp --
+ *
+ *      Comparison function used when sorting arrays of strings in
+ *      schema objects.
+ *
+ *      This helper is primarily used when canonicalizing schema fields
+ *      such as "required" or type unions, where stable lexicographic
+ *      ordering is desired.
+ *
+ * Results:
+ *      An integer less than, equal to, or greater than zero depending
+ *      on the lexical ordering of the compared strings.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+JsonSchemaStringEntryCmp(const void *a, const void *b)
+{
+    const JsonStringEntry *ea = (const JsonStringEntry *)a;
+    const JsonStringEntry *eb = (const JsonStringEntry *)b;
+
+    return strcmp(Tcl_GetString(ea->valueObj), Tcl_GetString(eb->valueObj));
+}
+
+/*======================================================================
+ * Function Implementations: Schema triples field access helpers.
+ *======================================================================
+ */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaFindField --
+ *
+ *      Locate a field in a schema object represented in triples form.
+ *
+ *      The function searches the NAME TYPE VALUE triples of triplesObj
+ *      for an entry whose NAME matches nameObj.  When found, the index
+ *      of the triple (the position of the NAME element) is returned via
+ *      baseIdxPtr.
+ *
+ * Results:
+ *      Returns NS_TRUE when the field is present, NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      On success, stores the index of the triple in *baseIdxPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+JsonSchemaFindField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
+                           TCL_SIZE_T *baseIdxPtr)
+{
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc;
+
+    *baseIdxPtr = TCL_INDEX_NONE;
+
+    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
+        return NS_FALSE;
+    }
+    if ((lc % 3) != 0) {
+        return NS_FALSE;
+    }
+
+    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
+        if (TripleKeyMatches(lv[i], nameObj)) {
+            *baseIdxPtr = i;
+            return NS_TRUE;
+        }
+    }
+    return NS_FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaGetField --
+ *
+ *      Retrieve a field from a schema object represented in triples form.
+ *
+ *      The function searches triplesObj for a triple with NAME equal to
+ *      nameObj.  When found, the TYPE and VALUE elements of the triple
+ *      can be returned to the caller via typeObjPtr and valueObjPtr.
+ *
+ * Results:
+ *      Returns NS_TRUE when the field is present, NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      When the field exists, stores the TYPE and VALUE objects and
+ *      optionally the base index of the triple in the provided output
+ *      pointers.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+JsonSchemaGetField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
+                          Tcl_Obj **typeObjPtr, Tcl_Obj **valueObjPtr, TCL_SIZE_T *baseIdxPtr)
+{
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc, base;
+
+    if (typeObjPtr != NULL)  { *typeObjPtr = NULL; }
+    if (valueObjPtr != NULL) { *valueObjPtr = NULL; }
+    if (baseIdxPtr != NULL)  { *baseIdxPtr = TCL_INDEX_NONE; }
+
+    if (!JsonSchemaFindField(interp, triplesObj, nameObj, &base)) {
+        return NS_FALSE;
+    }
+    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
+        return NS_FALSE;
+    }
+
+    if (typeObjPtr != NULL)  { *typeObjPtr  = lv[base + 1]; }
+    if (valueObjPtr != NULL) { *valueObjPtr = lv[base + 2]; }
+    if (baseIdxPtr != NULL)  { *baseIdxPtr  = base; }
+
+    return NS_TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaSetField --
+ *
+ *      Set or replace a field in a schema object represented in triples
+ *      form.
+ *
+ *      The function ensures that triplesObj contains a NAME TYPE VALUE
+ *      triple for nameObj.  When the field already exists, its TYPE and
+ *      VALUE elements are replaced.  Otherwise a new triple is appended.
+ *
+ * Results:
+ *      NS_OK on success, NS_ERROR on failure.
+ *
+ * Side effects:
+ *      Modifies triplesObj by replacing an existing triple or appending
+ *      a new one.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonSchemaSetField(Tcl_Interp *interp, Tcl_Obj *triplesObj, Tcl_Obj *nameObj,
+                          JsonValueType vt, Tcl_Obj *valueObj)
+{
+    TCL_SIZE_T base;
+
+    if (JsonSchemaFindField(interp, triplesObj, nameObj, &base)) {
+        Tcl_Obj *repl[3];
+
+        repl[0] = nameObj;
+        repl[1] = JsonAtomObj((JsonAtom)vt);
+        repl[2] = valueObj;
+
+        return Tcl_ListObjReplace(interp, triplesObj, base, 3, 3, repl) == TCL_OK ? NS_OK : NS_ERROR;
+    }
+
+    JsonTriplesAppendVt(triplesObj, nameObj, vt, valueObj);
+    return TCL_OK;
+}
+
+/*======================================================================
+ * Function Implementations: Schema derivation helpers.
+ *======================================================================
+ */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaNewTypeTriple --
+ *
+ *      Create a new schema fragment representing a simple JSON type.
+ *
+ *      The function allocates a new triples-form list containing a
+ *      single NAME TYPE VALUE triple for the "type" field, where the
+ *      VALUE element is the JSON type name specified by atom.
+ *
+ * Results:
+ *      Returns a newly allocated Tcl list object representing the
+ *      schema fragment.
+ *
+ * Side effects:
+ *      Allocates a new Tcl object.
+ *
+ *----------------------------------------------------------------------
+ */
+static Tcl_Obj*
+JsonSchemaNewTypeTriple(JsonAtom atom)
+{
+    Tcl_Obj* schemaObj = Tcl_NewListObj(0, NULL);
+    JsonTriplesAppendVt(schemaObj,
+                        JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, JsonAtomObj(atom));
+    return schemaObj;
+}
+
+/*
+ * ----------------------------------------------------------------------*
+ *
+ * JsonSchemaFromValue --
+ *
+ *      Derive a schema fragment from one JSON value.
+ *
+ *      The returned schema fragment is encoded as object triples, so it can
+ *      be serialized via JsonTriplesValueToJson() like other ns_json values.
+ *
+ *      Examples:
+ *
+ *          JSON string  ->  {type string string}
+ *          JSON number  ->  {type string number}
+ *          JSON null    ->  {type string null}
+ *          JSON object  ->  {
+ *                              type string object
+ *                              properties object {...}
+ *                           }
+ *          JSON array   ->  {
+ *                              type string array
+ *                              items object {...}
+ *                           }
+ *
+ * Results:
+ *      NS_OK on success, NS_ERROR on malformed triples or allocation failure.
+ *
+ * Side effects:
+ *      On success, *schemaObjPtr is set to an object-triples Tcl list.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonSchemaFromValue(Tcl_Interp *interp, JsonValueType vt, Tcl_Obj *valueObj,
+                    bool includeRequired, Tcl_Obj **schemaObjPtr)
+{
+    NS_NONNULL_ASSERT(schemaObjPtr != NULL);
+
+    switch (vt) {
+    case JSON_VT_STRING:
+        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_STRING);
+        return NS_OK;
+
+    case JSON_VT_NUMBER:
+        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_NUMBER);
+        return NS_OK;
+
+    case JSON_VT_BOOL:
+        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_BOOLEAN);
+        return NS_OK;
+
+    case JSON_VT_NULL:
+        *schemaObjPtr = JsonSchemaNewTypeTriple(JSON_ATOM_T_NULL);
+        return NS_OK;
+
+    case JSON_VT_OBJECT:
+        return JsonSchemaFromObject(interp, valueObj, includeRequired, schemaObjPtr);
+
+    case JSON_VT_ARRAY:
+        return JsonSchemaFromArray(interp, valueObj, includeRequired, schemaObjPtr);
+
+    case JSON_VT_AUTO:
+    default:
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: unsupported value type");
+        return NS_ERROR;
+    }
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * JsonSchemaFromObject --
+ *
+ *      Derive a schema fragment from an object container-content triples list.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      On success, *schemaObjPtr is set to a Tcl dict object.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonSchemaFromObject(Tcl_Interp *interp, Tcl_Obj *triplesObj,
+                     bool includeRequired, Tcl_Obj **schemaObjPtr)
+{
+    Tcl_Obj   *schemaObj, *propertiesObj, *requiredObj;
+    Tcl_Obj  **lv;
+    TCL_SIZE_T lc;
+
+    NS_NONNULL_ASSERT(schemaObjPtr != NULL);
+    *schemaObjPtr = NULL;
+
+    if (Tcl_ListObjGetElements(interp, triplesObj, &lc, &lv) != TCL_OK) {
+        return NS_ERROR;
+    }
+    if ((lc % 3) != 0) {
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: malformed object triples "
+                           "(length not multiple of 3)");
+        return NS_ERROR;
+    }
+
+    schemaObj     = Tcl_NewListObj(0, NULL);
+    propertiesObj = Tcl_NewListObj(0, NULL);
+    requiredObj   = Tcl_NewListObj(0, NULL);
+
+    JsonTriplesAppendVt(schemaObj,
+                        JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, JsonAtomObj(JSON_ATOM_T_OBJECT));
+
+    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
+        Tcl_Obj       *nameObj  = lv[i + 0];
+        Tcl_Obj       *typeObj  = lv[i + 1];
+        Tcl_Obj       *valueObj = lv[i + 2];
+        Tcl_Obj       *childSchemaObj = NULL;
+        JsonValueType  vt = JsonTypeObjToVt(typeObj);
+
+        if (vt == JSON_VT_AUTO) {
+            Ns_TclPrintfResult(interp,
+                               "ns_json triples schema: malformed object triples "
+                               "(invalid type token)");
+            return NS_ERROR;
+        }
+        if (JsonSchemaFromValue(interp, vt, valueObj, includeRequired,
+                                &childSchemaObj) != NS_OK) {
+            return NS_ERROR;
+        }
+
+        /*
+         * properties.NAME = childSchema
+         */
+        JsonTriplesAppendVt(propertiesObj,
+                            nameObj, JSON_VT_OBJECT, childSchemaObj);
+
+        if (includeRequired) {
+            Tcl_Obj *idxObj = Tcl_NewWideIntObj((Tcl_WideInt)(i / 3));
+
+            JsonTriplesAppendVt(requiredObj,
+                                idxObj, JSON_VT_STRING, nameObj);
+        }
+    }
+
+    JsonTriplesAppendVt(schemaObj,
+                        JsonAtomObj(JSON_ATOM_PROPERTIES), JSON_VT_OBJECT, propertiesObj);
+
+    if (includeRequired) {
+        JsonTriplesAppendVt(schemaObj,
+                            JsonAtomObj(JSON_ATOM_REQUIRED), JSON_VT_ARRAY, requiredObj);
+    }
+
+    *schemaObjPtr = schemaObj;
+    return NS_OK;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ *
+ * JsonSchemaFromArray --
+ *
+ *      Derive a schema fragment from an array container-content triples list.
+ *
+ *      Array item schemas are merged into a single "items" schema.  When
+ *      incompatible structures are observed, the merge falls back to "anyOf".
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      On success, *schemaObjPtr is set to a Tcl dict object.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonSchemaFromArray(Tcl_Interp *interp, Tcl_Obj *triplesObj,
+                    bool includeRequired, Tcl_Obj **schemaObjPtr)
+{
+    Tcl_Obj   *schemaObj, *itemsObj = NULL;
     Tcl_Obj  **lv;
     TCL_SIZE_T lc;
 
@@ -6910,200 +7448,489 @@ JsonPointerPathPushKey(Tcl_DString *dsPtr, Tcl_Obj *keyObj)
 /*
  *----------------------------------------------------------------------
  *
- * JsonPointerPathPushIndex --
+ * JsonPointerPathPushIndex --
+ *
+ *      Append an array index to the current JSON Pointer path.
+ *
+ *      The function extends the pointer stored in dsPtr by adding a
+ *      slash followed by the decimal representation of the array index.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      dsPtr is extended with a new path segment representing the
+ *      specified array index.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+JsonPointerPathPushIndex(Tcl_DString *dsPtr, TCL_SIZE_T idx)
+{
+    JsonKeyPathAppendIndex(dsPtr, (size_t)idx);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonPointerPathPop --
+ *
+ *      Restore the JSON Pointer path to a previous length.
+ *
+ *      This helper truncates the path stored in dsPtr to the length
+ *      specified by oldLen.  It is typically used to undo a previous
+ *      JsonPointerPathPushKey() or JsonPointerPathPushIndex() call
+ *      after returning from recursive schema matching.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      dsPtr is shortened to the specified length.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+JsonPointerPathPop(Tcl_DString *dsPtr, TCL_SIZE_T oldLen)
+{
+    if (oldLen < 0) {
+        oldLen = 0;
+    }
+    Tcl_DStringSetLength(dsPtr, oldLen);
+}
+
+
+/*======================================================================
+ * Function Implementations: Schema type helpers.
+ *======================================================================
+ */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaIsTypeOnlySchema --
+ *
+ *      Determine whether the provided schema object consists solely
+ *      of a "type" specification.
+ *
+ *      The function checks whether schemaObj contains exactly one
+ *      field named "type".  When this condition holds, the TYPE and
+ *      VALUE objects of the triple are returned via the provided
+ *      output pointers.
+ *
+ * Results:
+ *      Returns NS_TRUE when schemaObj represents a type-only schema,
+ *      NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      When the schema is type-only, stores the TYPE and VALUE objects
+ *      of the "type" field in the provided output pointers.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+JsonSchemaIsTypeOnlySchema(Tcl_Interp *interp, Tcl_Obj *schemaObj,
+                           Tcl_Obj **typeTypeObjPtr, Tcl_Obj **typeValueObjPtr)
+{
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc;
+
+    if (typeTypeObjPtr != NULL) {
+        *typeTypeObjPtr = NULL;
+    }
+    if (typeValueObjPtr != NULL) {
+        *typeValueObjPtr = NULL;
+    }
+
+    if (Tcl_ListObjGetElements(interp, schemaObj, &lc, &lv) != TCL_OK) {
+        return NS_FALSE;
+    }
+    if (lc != 3) {
+        return NS_FALSE;
+    }
+    if (!TripleKeyMatches(lv[0], JsonAtomObj(JSON_ATOM_TYPE))) {
+        return NS_FALSE;
+    }
+
+    /*
+     * Allowed forms:
+     *   type string <typename>
+     *   type array  {0 string <typename> ...}
+     */
+    if (JsonTypeObjToVt(lv[1]) != JSON_VT_STRING
+        && JsonTypeObjToVt(lv[1]) != JSON_VT_ARRAY) {
+        return NS_FALSE;
+    }
+
+    if (typeTypeObjPtr != NULL) {
+        *typeTypeObjPtr = lv[1];
+    }
+    if (typeValueObjPtr != NULL) {
+        *typeValueObjPtr = lv[2];
+    }
+    return NS_TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaExtractTypeUnion --
+ *
+ *      Extract the set of type names from the "type" field of a schema
+ *      object.
+ *
+ *      The function retrieves the "type" specification from schemaObj
+ *      and returns a normalized Tcl list containing the individual
+ *      type names.  A scalar type is returned as a single-element list,
+ *      while an array-valued type union is returned as-is.
+ *
+ * Results:
+ *      NS_OK on success, NS_ERROR on failure.
+ *
+ * Side effects:
+ *      Allocates a Tcl object containing the list of type names and
+ *      stores it in *typesObjPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonSchemaExtractTypeUnion(Tcl_Interp *interp, Tcl_Obj *schemaObj, Tcl_Obj **typesObjPtr)
+{
+    Tcl_Obj *typeTypeObj = NULL, *typeValueObj = NULL;
+
+    *typesObjPtr = NULL;
+
+    if (!JsonSchemaIsTypeOnlySchema(interp, schemaObj, &typeTypeObj, &typeValueObj)) {
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: expected type-only schema");
+        return NS_ERROR;
+    }
+
+    if (JsonTypeObjToVt(typeTypeObj) == JSON_VT_STRING) {
+        Tcl_Obj *typesObj = Tcl_NewListObj(0, NULL);
+
+        /*
+         * Normalize:
+         *   {type string number}
+         * to:
+         *   {0 string number}
+         */
+        JsonTriplesAppendVt(typesObj,
+                            Tcl_NewWideIntObj(0), JSON_VT_STRING, typeValueObj);
+        *typesObjPtr = typesObj;
+        return NS_OK;
+    }
+
+    /*
+     * Already a type union:
+     *   {type array {0 string number 1 string null ...}}
+     */
+    *typesObjPtr = typeValueObj;
+    return NS_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaTypeUnionContains --
+ *
+ *      Check whether a type union contains the specified type name.
+ *
+ *      The function scans the list of type names in typesObj and
+ *      returns whether typeNameObj appears in the union.
+ *
+ * Results:
+ *      Returns NS_TRUE when the type is present in the union,
+ *      NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static bool
+JsonSchemaTypeUnionContains(Tcl_Interp *interp, Tcl_Obj *typesObj, Tcl_Obj *typeNameObj)
+{
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc;
+
+    if (Tcl_ListObjGetElements(interp, typesObj, &lc, &lv) != TCL_OK) {
+        return NS_FALSE;
+    }
+    if ((lc % 3) != 0) {
+        return NS_FALSE;
+    }
+
+    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
+        if (JsonTypeObjToVt(lv[i + 1]) != JSON_VT_STRING) {
+            continue;
+        }
+        if (strcmp(Tcl_GetString(lv[i + 2]), Tcl_GetString(typeNameObj)) == 0) {
+            return NS_TRUE;
+        }
+    }
+    return NS_FALSE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonSchemaMergeTypeUnion --
  *
- *      Append an array index to the current JSON Pointer path.
+ *      Merge two sets of type names into a single union.
  *
- *      The function extends the pointer stored in dsPtr by adding a
- *      slash followed by the decimal representation of the array index.
+ *      The function combines the type names from types1Obj and
+ *      types2Obj, producing a merged list that contains each type
+ *      at most once.
  *
  * Results:
- *      None.
+ *      NS_OK on success, NS_ERROR on failure.
  *
  * Side effects:
- *      dsPtr is extended with a new path segment representing the
- *      specified array index.
+ *      Allocates a Tcl object containing the merged type list and
+ *      stores it in *mergedTypesObjPtr.
  *
  *----------------------------------------------------------------------
  */
-static void
-JsonPointerPathPushIndex(Tcl_DString *dsPtr, TCL_SIZE_T idx)
+static Ns_ReturnCode
+JsonSchemaMergeTypeUnion(Tcl_Interp *interp, Tcl_Obj *types1Obj, Tcl_Obj *types2Obj,
+                         Tcl_Obj **mergedTypesObjPtr)
 {
-    JsonKeyPathAppendIndex(dsPtr, (size_t)idx);
+    Tcl_Obj   *mergedObj;
+    Tcl_Obj  **lv;
+    TCL_SIZE_T lc, nextIdx;
+
+    *mergedTypesObjPtr = NULL;
+
+    mergedObj = Tcl_DuplicateObj(types1Obj);
+
+    if (Tcl_ListObjGetElements(interp, mergedObj, &lc, &lv) != TCL_OK) {
+        return NS_ERROR;
+    }
+    if ((lc % 3) != 0) {
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: malformed type union");
+        return NS_ERROR;
+    }
+    nextIdx = lc / 3;
+
+    if (Tcl_ListObjGetElements(interp, types2Obj, &lc, &lv) != TCL_OK) {
+        return NS_ERROR;
+    }
+    if ((lc % 3) != 0) {
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: malformed type union");
+        return NS_ERROR;
+    }
+
+    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
+        Tcl_Obj *typeNameObj = lv[i + 2];
+
+        if (!JsonSchemaTypeUnionContains(interp, mergedObj, typeNameObj)) {
+            JsonTriplesAppendVt(mergedObj,
+                                Tcl_NewWideIntObj((Tcl_WideInt)nextIdx), JSON_VT_STRING, typeNameObj);
+            nextIdx++;
+        }
+    }
+
+    *mergedTypesObjPtr = mergedObj;
+    return NS_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonPointerPathPop --
+ * JsonSchemaBuildTypeUnion --
  *
- *      Restore the JSON Pointer path to a previous length.
+ *      Build a schema fragment representing a union of JSON types.
  *
- *      This helper truncates the path stored in dsPtr to the length
- *      specified by oldLen.  It is typically used to undo a previous
- *      JsonPointerPathPushKey() or JsonPointerPathPushIndex() call
- *      after returning from recursive schema matching.
+ *      The function constructs a triples-form schema object whose
+ *      "type" field represents the provided list of type names.
+ *      When the union contains a single type, the field is emitted as
+ *      a scalar; otherwise it is emitted as an array of type names.
  *
  * Results:
- *      None.
+ *      NS_OK on success, NS_ERROR on failure.
  *
  * Side effects:
- *      dsPtr is shortened to the specified length.
+ *      Allocates a Tcl object representing the schema fragment and
+ *      stores it in *schemaObjPtr.
  *
  *----------------------------------------------------------------------
  */
-static void
-JsonPointerPathPop(Tcl_DString *dsPtr, TCL_SIZE_T oldLen)
+static Ns_ReturnCode
+JsonSchemaBuildTypeUnion(Tcl_Interp *interp, Tcl_Obj *typesObj, Tcl_Obj **schemaObjPtr)
 {
-    if (oldLen < 0) {
-        oldLen = 0;
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc;
+    Tcl_Obj    *schemaObj;
+
+    *schemaObjPtr = NULL;
+
+    if (Tcl_ListObjGetElements(interp, typesObj, &lc, &lv) != TCL_OK) {
+        return NS_ERROR;
+    }
+    if ((lc % 3) != 0 || lc == 0) {
+        Ns_TclPrintfResult(interp,
+                           "ns_json triples schema: malformed type union");
+        return NS_ERROR;
     }
-    Tcl_DStringSetLength(dsPtr, oldLen);
-}
 
+    schemaObj = Tcl_NewListObj(0, NULL);
 
-/*======================================================================
- * Function Implementations: Schema type helpers.
- *======================================================================
- */
+    if (lc == 3) {
+        /*
+         * Compact back to:
+         *   {type string X}
+         */
+        JsonTriplesAppendVt(schemaObj,
+                            JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, lv[2]);
+    } else {
+        /*
+         * Keep union form:
+         *   {type array {0 string X 1 string Y ...}}
+         */
+        JsonTriplesAppendVt(schemaObj,
+                            JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_ARRAY, typesObj);
+    }
 
-/*
- *----------------------------------------------------------------------
- *
- * JsonSchemaIsTypeOnlySchema --
+    *schemaObjPtr = schemaObj;
+    return NS_OK;
+}
+
+/*----------------------------------------------------------------------
  *
- *      Determine whether the provided schema object consists solely
- *      of a "type" specification.
+ * JsonSchemaBuildAnyOf2 --
  *
- *      The function checks whether schemaObj contains exactly one
- *      field named "type".  When this condition holds, the TYPE and
- *      VALUE objects of the triple are returned via the provided
- *      output pointers.
+ *      Build a minimal anyOf schema combining two schema fragments.
  *
  * Results:
- *      Returns NS_TRUE when schemaObj represents a type-only schema,
- *      NS_FALSE otherwise.
+ *      list of triples
  *
  * Side effects:
- *      When the schema is type-only, stores the TYPE and VALUE objects
- *      of the "type" field in the provided output pointers.
+ *      None.
  *
- *----------------------------------------------------------------------
- */
-static bool
-JsonSchemaIsTypeOnlySchema(Tcl_Interp *interp, Tcl_Obj *schemaObj,
-                           Tcl_Obj **typeTypeObjPtr, Tcl_Obj **typeValueObjPtr)
+ *----------------------------------------------------------------------*/
+static Tcl_Obj *
+JsonSchemaBuildAnyOf2(Tcl_Obj *schema1Obj, Tcl_Obj *schema2Obj)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc;
-
-    if (typeTypeObjPtr != NULL) {
-        *typeTypeObjPtr = NULL;
-    }
-    if (typeValueObjPtr != NULL) {
-        *typeValueObjPtr = NULL;
-    }
+    Tcl_Obj *schemaObj = Tcl_NewListObj(0, NULL);
+    Tcl_Obj *anyOfObj  = Tcl_NewListObj(0, NULL);
 
-    if (Tcl_ListObjGetElements(interp, schemaObj, &lc, &lv) != TCL_OK) {
-        return NS_FALSE;
-    }
-    if (lc != 3) {
-        return NS_FALSE;
-    }
-    if (!TripleKeyMatches(lv[0], JsonAtomObj(JSON_ATOM_TYPE))) {
-        return NS_FALSE;
-    }
+    /*
+     * anyOf is an array of schema objects
+     */
+    (void)JsonTriplesAppendVt(anyOfObj,
+                              Tcl_NewWideIntObj(0), JSON_VT_OBJECT, schema1Obj);
+    (void)JsonTriplesAppendVt(anyOfObj,
+                              Tcl_NewWideIntObj(1), JSON_VT_OBJECT, schema2Obj);
 
     /*
-     * Allowed forms:
-     *   type string <typename>
-     *   type array  {0 string <typename> ...}
+     * schemaObj = { anyOf array anyOfObj }
      */
-    if (JsonTypeObjToVt(lv[1]) != JSON_VT_STRING
-        && JsonTypeObjToVt(lv[1]) != JSON_VT_ARRAY) {
-        return NS_FALSE;
-    }
+    (void)JsonTriplesAppendVt(schemaObj,
+                              JsonAtomObj(JSON_ATOM_ANYOF), JSON_VT_ARRAY, anyOfObj);
 
-    if (typeTypeObjPtr != NULL) {
-        *typeTypeObjPtr = lv[1];
-    }
-    if (typeValueObjPtr != NULL) {
-        *typeValueObjPtr = lv[2];
-    }
-    return NS_TRUE;
+    return schemaObj;
 }
 
+/*======================================================================
+ * Function Implementations: Schema required-field helpers.
+ *======================================================================
+ */
+
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaExtractTypeUnion --
+ * JsonSchemaRequiredIntersection --
  *
- *      Extract the set of type names from the "type" field of a schema
- *      object.
+ *      Compute the intersection of two "required" property lists.
  *
- *      The function retrieves the "type" specification from schemaObj
- *      and returns a normalized Tcl list containing the individual
- *      type names.  A scalar type is returned as a single-element list,
- *      while an array-valued type union is returned as-is.
+ *      This helper is used during schema merging when the -required
+ *      option is active.  The function determines which property names
+ *      occur in both input "required" arrays and returns a new array
+ *      containing only these common elements.
+ *
+ *      The order of elements in the resulting list follows the order
+ *      of the first input list.  Duplicate entries are not introduced.
  *
  * Results:
- *      NS_OK on success, NS_ERROR on failure.
+ *      NS_OK on success.  The resulting intersection list is stored in
+ *      *requiredOutObjPtr.
+ *
+ *      NS_ERROR on failure (e.g., malformed input).
  *
  * Side effects:
- *      Allocates a Tcl object containing the list of type names and
- *      stores it in *typesObjPtr.
+ *      A new Tcl list object is created and returned via
+ *      *requiredOutObjPtr.  On error, an explanatory message is left in
+ *      the interpreter result.
  *
  *----------------------------------------------------------------------
  */
 static Ns_ReturnCode
-JsonSchemaExtractTypeUnion(Tcl_Interp *interp, Tcl_Obj *schemaObj, Tcl_Obj **typesObjPtr)
+JsonSchemaRequiredIntersection(Tcl_Interp *interp, Tcl_Obj *required1Obj, Tcl_Obj *required2Obj,
+                               Tcl_Obj **requiredOutObjPtr)
 {
-    Tcl_Obj *typeTypeObj = NULL, *typeValueObj = NULL;
+    Tcl_Obj   **lv;
+    TCL_SIZE_T  lc;
+    Tcl_Obj    *outObj;
+    TCL_SIZE_T  idx = 0;
 
-    *typesObjPtr = NULL;
+    *requiredOutObjPtr = NULL;
 
-    if (!JsonSchemaIsTypeOnlySchema(interp, schemaObj, &typeTypeObj, &typeValueObj)) {
+    if (required1Obj == NULL || required2Obj == NULL) {
+        /*
+         * Intersection with missing required-set is empty.
+         */
+        *requiredOutObjPtr = Tcl_NewListObj(0, NULL);
+        return NS_OK;
+    }
+
+    if (Tcl_ListObjGetElements(interp, required1Obj, &lc, &lv) != TCL_OK) {
+        return NS_ERROR;
+    }
+    if ((lc % 3) != 0) {
         Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: expected type-only schema");
+                           "ns_json triples schema: malformed required array");
         return NS_ERROR;
     }
 
-    if (JsonTypeObjToVt(typeTypeObj) == JSON_VT_STRING) {
-        Tcl_Obj *typesObj = Tcl_NewListObj(0, NULL);
+    outObj = Tcl_NewListObj(0, NULL);
 
-        /*
-         * Normalize:
-         *   {type string number}
-         * to:
-         *   {0 string number}
-         */
-        JsonTriplesAppendVt(typesObj,
-                            Tcl_NewWideIntObj(0), JSON_VT_STRING, typeValueObj);
-        *typesObjPtr = typesObj;
-        return NS_OK;
+    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
+        Tcl_Obj *nameObj = lv[i + 2];
+
+        if (JsonTypeObjToVt(lv[i + 1]) != JSON_VT_STRING) {
+            Ns_TclPrintfResult(interp,
+                               "ns_json triples schema: malformed required array");
+            return NS_ERROR;
+        }
+
+        if (JsonSchemaRequiredContains(interp, required2Obj, nameObj)) {
+            JsonTriplesAppendVt(outObj,
+                                Tcl_NewWideIntObj((Tcl_WideInt)idx), JSON_VT_STRING, nameObj);
+            idx++;
+        }
     }
 
-    /*
-     * Already a type union:
-     *   {type array {0 string number 1 string null ...}}
-     */
-    *typesObjPtr = typeValueObj;
+    *requiredOutObjPtr = outObj;
     return NS_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaTypeUnionContains --
+ * JsonSchemaRequiredContains --
  *
- *      Check whether a type union contains the specified type name.
+ *      Determine whether the specified property name occurs in the
+ *      "required" array of a schema object.
  *
- *      The function scans the list of type names in typesObj and
- *      returns whether typeNameObj appears in the union.
+ *      The function scans the list of property names contained in
+ *      requiredObj and checks whether nameObj is present.
  *
  * Results:
- *      Returns NS_TRUE when the type is present in the union,
- *      NS_FALSE otherwise.
+ *      Returns NS_TRUE when the property name is contained in the
+ *      required list, NS_FALSE otherwise.
  *
  * Side effects:
  *      None.
@@ -7111,12 +7938,12 @@ JsonSchemaExtractTypeUnion(Tcl_Interp *interp, Tcl_Obj *schemaObj, Tcl_Obj **typ
  *----------------------------------------------------------------------
  */
 static bool
-JsonSchemaTypeUnionContains(Tcl_Interp *interp, Tcl_Obj *typesObj, Tcl_Obj *typeNameObj)
+JsonSchemaRequiredContains(Tcl_Interp *interp, Tcl_Obj *requiredObj, Tcl_Obj *nameObj)
 {
     Tcl_Obj   **lv;
     TCL_SIZE_T  lc;
 
-    if (Tcl_ListObjGetElements(interp, typesObj, &lc, &lv) != TCL_OK) {
+    if (Tcl_ListObjGetElements(interp, requiredObj, &lc, &lv) != TCL_OK) {
         return NS_FALSE;
     }
     if ((lc % 3) != 0) {
@@ -7127,300 +7954,750 @@ JsonSchemaTypeUnionContains(Tcl_Interp *interp, Tcl_Obj *typesObj, Tcl_Obj *type
         if (JsonTypeObjToVt(lv[i + 1]) != JSON_VT_STRING) {
             continue;
         }
-        if (strcmp(Tcl_GetString(lv[i + 2]), Tcl_GetString(typeNameObj)) == 0) {
+        if (strcmp(Tcl_GetString(lv[i + 2]), Tcl_GetString(nameObj)) == 0) {
             return NS_TRUE;
         }
     }
     return NS_FALSE;
 }
 
+
+/*======================================================================
+ * Function Implementations: Structural index and lazy extraction helpers.
+ *======================================================================
+ */
+
+/*
+ * Bytes relevant for the structural index.
+ */
+static const unsigned char jsonIndexChars[256] = {
+    ['"'] = 1, ['\\'] = 1, [','] = 1, [':'] = 1,
+    ['['] = 1, [']'] = 1, ['{'] = 1, ['}'] = 1
+};
+
+/*
+ * State of the structural index construction.
+ */
+typedef struct JsonIndexBuilder {
+    JsonIndex           *ixPtr;
+    uint32_t            *stack;
+    size_t               depth;
+    size_t               maxDepth;
+    const unsigned char *escapedPtr;
+    bool                 inString;
+    bool                 closed;
+} JsonIndexBuilder;
+
+/*
+ * Kernels classifying the input for the structural index. The kernel is
+ * selected by NsInitJsonIndex() and defaults to the portable
+ * implementation.
+ */
+typedef Ns_ReturnCode (JsonIndexScanProc)(JsonIndexBuilder *bPtr, const unsigned char *p,
+                                          const unsigned char *end, Tcl_DString *errDsPtr);
+
+static JsonIndexScanProc JsonIndexScanScalar;
+#ifdef NS_JSON_INDEX_SSE2
+static JsonIndexScanProc JsonIndexScanSse2;
+#endif
+#ifdef NS_JSON_INDEX_AVX2
+static JsonIndexScanProc JsonIndexScanAvx2 __attribute__((target("avx2")));
+#endif
+
+static JsonIndexScanProc *jsonIndexScanProc = JsonIndexScanScalar;
+
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaMergeTypeUnion --
- *
- *      Merge two sets of type names into a single union.
+ * JsonIndexAddEntry, JsonIndexAddByte --
  *
- *      The function combines the type names from types1Obj and
- *      types2Obj, producing a merged list that contains each type
- *      at most once.
+ *      Stage 1 state machine of the structural index: process a single
+ *      byte classified as relevant by jsonIndexChars.  Inside strings,
+ *      only unescaped quotes are recorded; outside strings, brackets are
+ *      matched via the builder stack.
  *
  * Results:
- *      NS_OK on success, NS_ERROR on failure.
+ *      NS_OK or NS_ERROR (with message in errDsPtr).
  *
- * Side effects:
- *      Allocates a Tcl object containing the merged type list and
- *      stores it in *mergedTypesObjPtr.
+ * Side Effects:
+ *      Appends entries to the index.
  *
  *----------------------------------------------------------------------
  */
-static Ns_ReturnCode
-JsonSchemaMergeTypeUnion(Tcl_Interp *interp, Tcl_Obj *types1Obj, Tcl_Obj *types2Obj,
-                         Tcl_Obj **mergedTypesObjPtr)
+static inline void
+JsonIndexAddEntry(JsonIndex *ixPtr, size_t pos)
 {
-    Tcl_Obj   *mergedObj;
-    Tcl_Obj  **lv;
-    TCL_SIZE_T lc, nextIdx;
+    if (ixPtr->nEntries == ixPtr->size) {
+        ixPtr->size *= 2u;
+        ixPtr->entries = ns_realloc(ixPtr->entries, ixPtr->size * sizeof(JsonIndexEntry));
+    }
+    ixPtr->entries[ixPtr->nEntries].pos = (uint32_t)pos;
+    ixPtr->entries[ixPtr->nEntries].match = 0u;
+    ixPtr->nEntries++;
+}
 
-    *mergedTypesObjPtr = NULL;
+static inline Ns_ReturnCode
+JsonIndexAddByte(JsonIndexBuilder *bPtr, const unsigned char *q, Tcl_DString *errDsPtr)
+{
+    JsonIndex    *ixPtr = bPtr->ixPtr;
+    size_t        pos = (size_t)(q - ixPtr->buf);
+    unsigned char c = *q;
 
-    mergedObj = Tcl_DuplicateObj(types1Obj);
+    if (bPtr->inString) {
+        if (q == bPtr->escapedPtr) {
+            /* nothing to do */
+        } else if (c == UCHAR('\\')) {
+            bPtr->escapedPtr = q + 1;
+        } else if (c == UCHAR('"')) {
+            bPtr->inString = NS_FALSE;
+            JsonIndexAddEntry(ixPtr, pos);
+        }
+        return NS_OK;
+    }
 
-    if (Tcl_ListObjGetElements(interp, mergedObj, &lc, &lv) != TCL_OK) {
+    if (bPtr->closed) {
+        Ns_DStringPrintf(errDsPtr, "ns_json parse: trailing data at byte %lu", (unsigned long)pos);
         return NS_ERROR;
     }
-    if ((lc % 3) != 0) {
-        Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: malformed type union");
-        return NS_ERROR;
+
+    switch (c) {
+    case '"':
+        bPtr->inString = NS_TRUE;
+        JsonIndexAddEntry(ixPtr, pos);
+        if (bPtr->depth == 0u) {
+            bPtr->closed = NS_TRUE;
+        }
+        break;
+
+    case '{':
+    case '[':
+        if (bPtr->depth >= bPtr->maxDepth) {
+            Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: maximum nesting depth exceeded",
+                             (unsigned long)pos);
+            return NS_ERROR;
+        }
+        bPtr->stack[bPtr->depth++] = (uint32_t)ixPtr->nEntries;
+        JsonIndexAddEntry(ixPtr, pos);
+        break;
+
+    case '}':
+    case ']': {
+        uint32_t open;
+
+        if (bPtr->depth == 0u
+            || ixPtr->buf[ixPtr->entries[bPtr->stack[bPtr->depth - 1u]].pos] != (c == UCHAR('}') ? UCHAR('{') : UCHAR('['))) {
+            Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: unexpected '%c'",
+                             (unsigned long)pos, c);
+            return NS_ERROR;
+        }
+        open = bPtr->stack[--bPtr->depth];
+        ixPtr->entries[open].match = (uint32_t)ixPtr->nEntries;
+        JsonIndexAddEntry(ixPtr, pos);
+        if (bPtr->depth == 0u) {
+            bPtr->closed = NS_TRUE;
+        }
+        break;
     }
-    nextIdx = lc / 3;
 
-    if (Tcl_ListObjGetElements(interp, types2Obj, &lc, &lv) != TCL_OK) {
+    case ':':
+    case ',':
+        if (bPtr->depth == 0u) {
+            Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: unexpected '%c'",
+                             (unsigned long)pos, c);
+            return NS_ERROR;
+        }
+        JsonIndexAddEntry(ixPtr, pos);
+        break;
+
+    default:
+        Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: unexpected '%c'",
+                         (unsigned long)pos, c);
         return NS_ERROR;
     }
-    if ((lc % 3) != 0) {
-        Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: malformed type union");
-        return NS_ERROR;
+    return NS_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitJsonIndex --
+ *
+ *      Select the kernel for the structural index based on the
+ *      capabilities of the CPU.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Sets the kernel function pointer.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsInitJsonIndex(void)
+{
+#ifdef NS_JSON_INDEX_SSE2
+    jsonIndexScanProc = JsonIndexScanSse2;
+#endif
+#ifdef NS_JSON_INDEX_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        jsonIndexScanProc = JsonIndexScanAvx2;
     }
+#endif
+}
 
-    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
-        Tcl_Obj *typeNameObj = lv[i + 2];
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonIndexScanScalar, JsonIndexScanSse2, JsonIndexScanAvx2 --
+ *
+ *      Classify the bytes from p to end and pass the relevant ones to
+ *      the state machine.  The vector kernels compare 16 (SSE2) or 32
+ *      (AVX2) bytes against all relevant characters at once and process
+ *      only the positions of set bits in the resulting mask; the rest of
+ *      the input is handled by the portable kernel, which skips 8-byte
+ *      words without relevant bytes via JsonEqByteMask().  Inside
+ *      strings, only quotes and backslashes are relevant, such that long
+ *      strings are passed without per-byte work.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR (with message in errDsPtr).
+ *
+ * Side Effects:
+ *      Appends entries to the index.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+JsonIndexScanScalar(JsonIndexBuilder *bPtr, const unsigned char *p, const unsigned char *end,
+                    Tcl_DString *errDsPtr)
+{
+    Ns_ReturnCode status = NS_OK;
+
+    while (p < end && status == NS_OK) {
+        if (p + 8 <= end) {
+            uint64_t w, m;
+
+            memcpy(&w, p, sizeof(w));
+            m  = JsonEqByteMask(w, 0x2222222222222222ULL);     /* '"' */
+            m |= JsonEqByteMask(w, 0x5C5C5C5C5C5C5C5CULL);     /* '\\' */
+            if (!bPtr->inString) {
+                m |= JsonEqByteMask(w, 0x2C2C2C2C2C2C2C2CULL); /* ',' */
+                m |= JsonEqByteMask(w, 0x3A3A3A3A3A3A3A3AULL); /* ':' */
+                m |= JsonEqByteMask(w, 0x5B5B5B5B5B5B5B5BULL); /* '[' */
+                m |= JsonEqByteMask(w, 0x5D5D5D5D5D5D5D5DULL); /* ']' */
+                m |= JsonEqByteMask(w, 0x7B7B7B7B7B7B7B7BULL); /* '{' */
+                m |= JsonEqByteMask(w, 0x7D7D7D7D7D7D7D7DULL); /* '}' */
+            }
+            if (m == 0u) {
+                p += 8;
+                continue;
+            }
+        }
+        if (jsonIndexChars[*p] != 0u && JsonIndexAddByte(bPtr, p, errDsPtr) != NS_OK) {
+            status = NS_ERROR;
+        }
+        p++;
+    }
+    return status;
+}
 
-        if (!JsonSchemaTypeUnionContains(interp, mergedObj, typeNameObj)) {
-            JsonTriplesAppendVt(mergedObj,
-                                Tcl_NewWideIntObj((Tcl_WideInt)nextIdx), JSON_VT_STRING, typeNameObj);
-            nextIdx++;
+/*
+ * Process the set bits of the mask of a block starting at p. When a
+ * string ends within the block, the remaining bytes of the block were
+ * not classified for structural characters and are checked one by one.
+ */
+static inline Ns_ReturnCode
+JsonIndexScanMask(JsonIndexBuilder *bPtr, const unsigned char *p, size_t blockSize,
+                  unsigned int mask, Tcl_DString *errDsPtr)
+{
+    Ns_ReturnCode status = NS_OK;
+
+    while (mask != 0u) {
+        const unsigned char *q = p + __builtin_ctz(mask);
+        bool                 wasInString = bPtr->inString;
+
+        mask &= mask - 1u;
+        if (JsonIndexAddByte(bPtr, q, errDsPtr) != NS_OK) {
+            status = NS_ERROR;
+            break;
+        }
+        if (wasInString && !bPtr->inString) {
+            for (q++; q < p + blockSize; q++) {
+                if (jsonIndexChars[*q] != 0u
+                    && JsonIndexAddByte(bPtr, q, errDsPtr) != NS_OK) {
+                    status = NS_ERROR;
+                    break;
+                }
+            }
+            break;
         }
     }
+    return status;
+}
 
-    *mergedTypesObjPtr = mergedObj;
-    return NS_OK;
+#ifdef NS_JSON_INDEX_SSE2
+static Ns_ReturnCode
+JsonIndexScanSse2(JsonIndexBuilder *bPtr, const unsigned char *p, const unsigned char *end,
+                  Tcl_DString *errDsPtr)
+{
+    const __m128i quote = _mm_set1_epi8('"'),  bslash = _mm_set1_epi8('\\');
+    const __m128i comma = _mm_set1_epi8(','),  colon  = _mm_set1_epi8(':');
+    const __m128i lbrk  = _mm_set1_epi8('['),  rbrk   = _mm_set1_epi8(']');
+    const __m128i lbrc  = _mm_set1_epi8('{'),  rbrc   = _mm_set1_epi8('}');
+    Ns_ReturnCode status = NS_OK;
+
+    for (; p + 16 <= end && status == NS_OK; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+        __m128i m;
+
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash));
+        if (!bPtr->inString) {
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, colon)));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, lbrk), _mm_cmpeq_epi8(v, rbrk)));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, lbrc), _mm_cmpeq_epi8(v, rbrc)));
+        }
+        status = JsonIndexScanMask(bPtr, p, 16u, (unsigned int)_mm_movemask_epi8(m), errDsPtr);
+    }
+    if (status == NS_OK) {
+        status = JsonIndexScanScalar(bPtr, p, end, errDsPtr);
+    }
+    return status;
+}
+#endif
+
+#ifdef NS_JSON_INDEX_AVX2
+static Ns_ReturnCode
+JsonIndexScanAvx2(JsonIndexBuilder *bPtr, const unsigned char *p, const unsigned char *end,
+                  Tcl_DString *errDsPtr)
+{
+    const __m256i quote = _mm256_set1_epi8('"'),  bslash = _mm256_set1_epi8('\\');
+    const __m256i comma = _mm256_set1_epi8(','),  colon  = _mm256_set1_epi8(':');
+    const __m256i lbrk  = _mm256_set1_epi8('['),  rbrk   = _mm256_set1_epi8(']');
+    const __m256i lbrc  = _mm256_set1_epi8('{'),  rbrc   = _mm256_set1_epi8('}');
+    Ns_ReturnCode status = NS_OK;
+
+    for (; p + 32 <= end && status == NS_OK; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+        __m256i m;
+
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash));
+        if (!bPtr->inString) {
+            m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, colon)));
+            m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, lbrk), _mm256_cmpeq_epi8(v, rbrk)));
+            m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, lbrc), _mm256_cmpeq_epi8(v, rbrc)));
+        }
+        status = JsonIndexScanMask(bPtr, p, 32u, (unsigned int)_mm256_movemask_epi8(m), errDsPtr);
+    }
+    if (status == NS_OK) {
+        status = JsonIndexScanScalar(bPtr, p, end, errDsPtr);
+    }
+    return status;
 }
+#endif
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaBuildTypeUnion --
+ * JsonIndexBuild --
  *
- *      Build a schema fragment representing a union of JSON types.
+ *      Build the structural index of a JSON document (stage 1 of the lazy
+ *      parsing mode).  The input is classified by the kernel selected in
+ *      NsInitJsonIndex() (AVX2, SSE2 or portable).
  *
- *      The function constructs a triples-form schema object whose
- *      "type" field represents the provided list of type names.
- *      When the union contains a single type, the field is emitted as
- *      a scalar; otherwise it is emitted as an array of type names.
+ *      Only the structure is checked (balanced brackets, terminated
+ *      strings, no trailing data); the values are validated when
+ *      extracted.
  *
  * Results:
- *      NS_OK on success, NS_ERROR on failure.
+ *      NS_OK or NS_ERROR (with message in errDsPtr).
  *
- * Side effects:
- *      Allocates a Tcl object representing the schema fragment and
- *      stores it in *schemaObjPtr.
+ * Side Effects:
+ *      Allocates the index entries, to be freed via JsonIndexFree().
  *
  *----------------------------------------------------------------------
  */
 static Ns_ReturnCode
-JsonSchemaBuildTypeUnion(Tcl_Interp *interp, Tcl_Obj *typesObj, Tcl_Obj **schemaObjPtr)
+JsonIndexBuild(JsonIndex *ixPtr, const unsigned char *buf, size_t len, int maxDepth,
+               Tcl_DString *errDsPtr)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc;
-    Tcl_Obj    *schemaObj;
+    JsonIndexBuilder     b;
+    const unsigned char *end = buf + len;
+    Ns_ReturnCode        status;
 
-    *schemaObjPtr = NULL;
+    ixPtr->buf = buf;
+    ixPtr->len = len;
+    ixPtr->nEntries = 0u;
+    ixPtr->size = len / 16u + 16u;
+    ixPtr->entries = ns_malloc(ixPtr->size * sizeof(JsonIndexEntry));
 
-    if (Tcl_ListObjGetElements(interp, typesObj, &lc, &lv) != TCL_OK) {
+    if (len > (size_t)UINT32_MAX) {
+        Ns_DStringPrintf(errDsPtr, "ns_json parse: input too large for -pointers");
         return NS_ERROR;
     }
-    if ((lc % 3) != 0 || lc == 0) {
-        Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: malformed type union");
-        return NS_ERROR;
-    }
-
-    schemaObj = Tcl_NewListObj(0, NULL);
 
-    if (lc == 3) {
-        /*
-         * Compact back to:
-         *   {type string X}
-         */
-        JsonTriplesAppendVt(schemaObj,
-                            JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_STRING, lv[2]);
-    } else {
-        /*
-         * Keep union form:
-         *   {type array {0 string X 1 string Y ...}}
-         */
-        JsonTriplesAppendVt(schemaObj,
-                            JsonAtomObj(JSON_ATOM_TYPE), JSON_VT_ARRAY, typesObj);
+    memset(&b, 0, sizeof(b));
+    b.ixPtr = ixPtr;
+    b.maxDepth = (size_t)maxDepth;
+    b.stack = ns_malloc(b.maxDepth * sizeof(uint32_t));
+
+    status = (*jsonIndexScanProc)(&b, buf, end, errDsPtr);
+
+    if (status == NS_OK) {
+        if (b.inString) {
+            Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: unterminated string",
+                             (unsigned long)len);
+            status = NS_ERROR;
+        } else if (b.depth > 0u) {
+            Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: unexpected end of input",
+                             (unsigned long)len);
+            status = NS_ERROR;
+        } else if (ixPtr->nEntries > 0u) {
+            const unsigned char *q = JsonSkipWsPtr(buf + ixPtr->entries[ixPtr->nEntries - 1u].pos + 1, end);
+
+            if (q != end) {
+                Ns_DStringPrintf(errDsPtr, "ns_json parse: trailing data at byte %lu",
+                                 (unsigned long)(q - buf));
+                status = NS_ERROR;
+            }
+        }
     }
+    ns_free(b.stack);
+
+    return status;
+}
 
-    *schemaObjPtr = schemaObj;
-    return NS_OK;
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonIndexFree --
+ *
+ *      Free the entries of a structural index.
+ *
+ * Results:
+ *      None.
+ *
+ * Side Effects:
+ *      Frees memory.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+JsonIndexFree(JsonIndex *ixPtr)
+{
+    ns_free(ixPtr->entries);
+    ixPtr->entries = NULL;
 }
 
-/*----------------------------------------------------------------------
+/*
+ *----------------------------------------------------------------------
  *
- * JsonSchemaBuildAnyOf2 --
+ * JsonIndexSkipValue, JsonIndexValueEnd --
  *
- *      Build a minimal anyOf schema combining two schema fragments.
+ *      Helpers for navigating over a value starting at byte offset "pos",
+ *      where "k" is the first index entry not consumed so far.  Containers
+ *      and strings start with an index entry at "pos", scalars are not
+ *      indexed and end at the next entry.
  *
  * Results:
- *      list of triples
+ *      JsonIndexSkipValue: first index entry after the value.
+ *      JsonIndexValueEnd:  byte offset after the value.
  *
- * Side effects:
+ * Side Effects:
  *      None.
  *
- *----------------------------------------------------------------------*/
-static Tcl_Obj *
-JsonSchemaBuildAnyOf2(Tcl_Obj *schema1Obj, Tcl_Obj *schema2Obj)
+ *----------------------------------------------------------------------
+ */
+static size_t
+JsonIndexSkipValue(const JsonIndex *ixPtr, size_t pos, size_t k)
 {
-    Tcl_Obj *schemaObj = Tcl_NewListObj(0, NULL);
-    Tcl_Obj *anyOfObj  = Tcl_NewListObj(0, NULL);
+    unsigned char c = ixPtr->buf[pos];
 
-    /*
-     * anyOf is an array of schema objects
-     */
-    (void)JsonTriplesAppendVt(anyOfObj,
-                              Tcl_NewWideIntObj(0), JSON_VT_OBJECT, schema1Obj);
-    (void)JsonTriplesAppendVt(anyOfObj,
-                              Tcl_NewWideIntObj(1), JSON_VT_OBJECT, schema2Obj);
+    if (k < ixPtr->nEntries && ixPtr->entries[k].pos == pos) {
+        if (c == UCHAR('{') || c == UCHAR('[')) {
+            return (size_t)ixPtr->entries[k].match + 1u;
+        } else if (c == UCHAR('"')) {
+            return k + 2u;
+        }
+    }
+    return k;
+}
 
-    /*
-     * schemaObj = { anyOf array anyOfObj }
-     */
-    (void)JsonTriplesAppendVt(schemaObj,
-                              JsonAtomObj(JSON_ATOM_ANYOF), JSON_VT_ARRAY, anyOfObj);
+static size_t
+JsonIndexValueEnd(const JsonIndex *ixPtr, size_t pos, size_t k)
+{
+    size_t next = JsonIndexSkipValue(ixPtr, pos, k), end;
 
-    return schemaObj;
+    if (next != k) {
+        end = (size_t)ixPtr->entries[next - 1u].pos + 1u;
+    } else {
+        end = (k < ixPtr->nEntries) ? (size_t)ixPtr->entries[k].pos : ixPtr->len;
+        while (end > pos && CHARTYPE(space, ixPtr->buf[end - 1u]) != 0) {
+            end--;
+        }
+    }
+    return end;
 }
 
-/*======================================================================
- * Function Implementations: Schema required-field helpers.
- *======================================================================
- */
-
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaRequiredIntersection --
- *
- *      Compute the intersection of two "required" property lists.
- *
- *      This helper is used during schema merging when the -required
- *      option is active.  The function determines which property names
- *      occur in both input "required" arrays and returns a new array
- *      containing only these common elements.
+ * JsonIndexLookup --
  *
- *      The order of elements in the resulting list follows the order
- *      of the first input list.  Duplicate entries are not introduced.
+ *      Stage 2 of the lazy parsing mode: locate the value addressed by
+ *      the path (list of decoded JSON Pointer segments) using the
+ *      structural index.  Members and elements not on the path are
+ *      skipped without parsing; nested containers are skipped in one
+ *      step via the matching bracket.
  *
  * Results:
- *      NS_OK on success.  The resulting intersection list is stored in
- *      *requiredOutObjPtr.
- *
- *      NS_ERROR on failure (e.g., malformed input).
+ *      NS_OK or NS_ERROR for structurally invalid input (with message in
+ *      errDsPtr).
  *
- * Side effects:
- *      A new Tcl list object is created and returned via
- *      *requiredOutObjPtr.  On error, an explanatory message is left in
- *      the interpreter result.
+ * Side Effects:
+ *      Sets *foundPtr and for found values the byte range in *startPtr
+ *      and *endPtr.
  *
  *----------------------------------------------------------------------
  */
 static Ns_ReturnCode
-JsonSchemaRequiredIntersection(Tcl_Interp *interp, Tcl_Obj *required1Obj, Tcl_Obj *required2Obj,
-                               Tcl_Obj **requiredOutObjPtr)
+JsonIndexLookup(const JsonIndex *ixPtr, Tcl_Obj *pathObj, const Ns_JsonOptions *opt,
+                size_t *startPtr, size_t *endPtr, bool *foundPtr, Tcl_DString *errDsPtr)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc;
-    Tcl_Obj    *outObj;
-    TCL_SIZE_T  idx = 0;
+    const unsigned char  *buf = ixPtr->buf, *end = buf + ixPtr->len;
+    const JsonIndexEntry *e = ixPtr->entries;
+    size_t                n = ixPtr->nEntries, pos, k = 0u;
+    Tcl_Obj             **segv;
+    TCL_SIZE_T            segc, i;
 
-    *requiredOutObjPtr = NULL;
+#define ENTRY_IS(k, ch) ((k) < n && buf[e[(k)].pos] == UCHAR(ch))
+#define SKIP_WS(offset) ((size_t)(JsonSkipWsPtr(buf + (offset), end) - buf))
 
-    if (required1Obj == NULL || required2Obj == NULL) {
-        /*
-         * Intersection with missing required-set is empty.
-         */
-        *requiredOutObjPtr = Tcl_NewListObj(0, NULL);
+    *foundPtr = NS_FALSE;
+    if (Tcl_ListObjGetElements(NULL, pathObj, &segc, &segv) != TCL_OK) {
         return NS_OK;
     }
 
-    if (Tcl_ListObjGetElements(interp, required1Obj, &lc, &lv) != TCL_OK) {
-        return NS_ERROR;
-    }
-    if ((lc % 3) != 0) {
-        Ns_TclPrintfResult(interp,
-                           "ns_json triples schema: malformed required array");
-        return NS_ERROR;
-    }
+    pos = SKIP_WS(0u);
+    for (i = 0; i < segc; i++) {
+        TCL_SIZE_T  segLen;
+        const char *seg = Tcl_GetStringFromObj(segv[i], &segLen);
 
-    outObj = Tcl_NewListObj(0, NULL);
+        if (pos >= ixPtr->len || k >= n || e[k].pos != pos) {
+            /* Scalar values have no members. */
+            return NS_OK;
 
-    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
-        Tcl_Obj *nameObj = lv[i + 2];
+        } else if (buf[pos] == UCHAR('{')) {
+            bool found = NS_FALSE;
 
-        if (JsonTypeObjToVt(lv[i + 1]) != JSON_VT_STRING) {
-            Ns_TclPrintfResult(interp,
-                               "ns_json triples schema: malformed required array");
-            return NS_ERROR;
-        }
+            k++;
+            while (!found) {
+                const unsigned char *key;
+                size_t               keyLen;
 
-        if (JsonSchemaRequiredContains(interp, required2Obj, nameObj)) {
-            JsonTriplesAppendVt(outObj,
-                                Tcl_NewWideIntObj((Tcl_WideInt)idx), JSON_VT_STRING, nameObj);
-            idx++;
+                if (ENTRY_IS(k, '}')) {
+                    return NS_OK;
+                }
+                if (!ENTRY_IS(k, '"') || !ENTRY_IS(k + 2u, ':')) {
+                    goto invalid;
+                }
+                key = buf + e[k].pos + 1;
+                keyLen = (size_t)(e[k + 1u].pos - e[k].pos) - 1u;
+                pos = SKIP_WS((size_t)e[k + 2u].pos + 1u);
+                k += 3u;
+
+                if (memchr(key, '\\', keyLen) == NULL) {
+                    found = (keyLen == (size_t)segLen && memcmp(key, seg, keyLen) == 0);
+                } else {
+                    Ns_JsonOptions keyOpt = *opt;
+                    Tcl_Obj       *keyObj = NULL;
+                    size_t         consumed;
+
+                    /*
+                     * Key with escape sequences: decode via the regular
+                     * parser.
+                     */
+                    keyOpt.output = NS_JSON_OUTPUT_TCL_VALUE;
+                    keyOpt.top = NS_JSON_TOP_ANY;
+                    if (Ns_JsonParse(key - 1, keyLen + 2u, &keyOpt, &keyObj, NULL, &consumed, errDsPtr) != NS_OK) {
+                        return NS_ERROR;
+                    }
+                    Tcl_IncrRefCount(keyObj);
+                    found = (strcmp(Tcl_GetString(keyObj), seg) == 0);
+                    Tcl_DecrRefCount(keyObj);
+                }
+
+                if (!found) {
+                    k = JsonIndexSkipValue(ixPtr, pos, k);
+                    if (ENTRY_IS(k, ',')) {
+                        k++;
+                    } else if (!ENTRY_IS(k, '}')) {
+                        goto invalid;
+                    }
+                }
+            }
+
+        } else if (buf[pos] == UCHAR('[')) {
+            Tcl_WideInt idx, j;
+
+            /*
+             * RFC 6901 array indices: digits without leading zeros.
+             */
+            if (segLen == 0 || (seg[0] == '0' && segLen > 1)
+                || strspn(seg, "0123456789") != (size_t)segLen
+                || Tcl_GetWideIntFromObj(NULL, segv[i], &idx) != TCL_OK) {
+                return NS_OK;
+            }
+            pos = SKIP_WS((size_t)e[k].pos + 1u);
+            k++;
+            if (pos < ixPtr->len && buf[pos] == UCHAR(']')) {
+                return NS_OK;
+            }
+            for (j = 0; j < idx; j++) {
+                k = JsonIndexSkipValue(ixPtr, pos, k);
+                if (ENTRY_IS(k, ']')) {
+                    return NS_OK;
+                } else if (!ENTRY_IS(k, ',')) {
+                    goto invalid;
+                }
+                pos = SKIP_WS((size_t)e[k].pos + 1u);
+                k++;
+            }
+
+        } else {
+            return NS_OK;
         }
     }
 
-    *requiredOutObjPtr = outObj;
+    if (pos >= ixPtr->len) {
+        goto invalid;
+    }
+    *startPtr = pos;
+    *endPtr = JsonIndexValueEnd(ixPtr, pos, k);
+    if (*endPtr == pos) {
+        /* E.g. missing value after ':' or trailing ',' */
+        goto invalid;
+    }
+    *foundPtr = NS_TRUE;
     return NS_OK;
+
+ invalid:
+    Ns_DStringPrintf(errDsPtr, "ns_json: parse error at byte %lu: invalid structure",
+                     (unsigned long)(k < n ? e[k].pos : ixPtr->len));
+    return NS_ERROR;
+
+#undef ENTRY_IS
+#undef SKIP_WS
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * JsonSchemaRequiredContains --
- *
- *      Determine whether the specified property name occurs in the
- *      "required" array of a schema object.
+ * JsonParsePointers --
  *
- *      The function scans the list of property names contained in
- *      requiredObj and checks whether nameObj is present.
+ *      Implements the lazy parsing mode "ns_json parse -pointers".  After
+ *      building the structural index of the document, only the values
+ *      addressed by the JSON Pointers are located and converted by the
+ *      regular parser into the requested output format.  The full tree
+ *      of the document is never built.
  *
  * Results:
- *      Returns NS_TRUE when the property name is contained in the
- *      required list, NS_FALSE otherwise.
+ *      Tcl result code.
  *
- * Side effects:
- *      None.
+ * Side Effects:
+ *      Sets the interpreter result to a dict mapping the pointers to the
+ *      extracted values.  Pointers not addressing a value are omitted.
  *
  *----------------------------------------------------------------------
  */
-static bool
-JsonSchemaRequiredContains(Tcl_Interp *interp, Tcl_Obj *requiredObj, Tcl_Obj *nameObj)
+static int
+JsonParsePointers(Tcl_Interp *interp, const unsigned char *buf, size_t len,
+                  const Ns_JsonOptions *opt, Tcl_Obj *pointersObj)
 {
-    Tcl_Obj   **lv;
-    TCL_SIZE_T  lc;
+    JsonIndex      ix;
+    Ns_JsonOptions valueOpt = *opt;
+    Tcl_DString    errDs;
+    Tcl_Obj      **pv, *resultObj;
+    TCL_SIZE_T     pc, i;
+    int            result = TCL_OK;
 
-    if (Tcl_ListObjGetElements(interp, requiredObj, &lc, &lv) != TCL_OK) {
-        return NS_FALSE;
+    if (Tcl_ListObjGetElements(interp, pointersObj, &pc, &pv) != TCL_OK) {
+        return TCL_ERROR;
     }
-    if ((lc % 3) != 0) {
-        return NS_FALSE;
+    if (opt->top == NS_JSON_TOP_CONTAINER) {
+        const unsigned char *p = JsonSkipWsPtr(buf, buf + len);
+
+        if (p == buf + len || (*p != UCHAR('{') && *p != UCHAR('['))) {
+            Ns_TclPrintfResult(interp,
+                               "ns_json: parse error at byte %lu: top-level value must be object or array (-top container)",
+                               (unsigned long)(p - buf));
+            return TCL_ERROR;
+        }
     }
+    valueOpt.top = NS_JSON_TOP_ANY;
 
-    for (TCL_SIZE_T i = 0; i < lc; i += 3) {
-        if (JsonTypeObjToVt(lv[i + 1]) != JSON_VT_STRING) {
-            continue;
+    if (JsonSkipWsPtr(buf, buf + len) == buf + len) {
+        Ns_TclPrintfResult(interp, "ns_json: parse error at byte %lu: unexpected end of input",
+                           (unsigned long)len);
+        return TCL_ERROR;
+    }
+
+    Tcl_DStringInit(&errDs);
+    if (JsonIndexBuild(&ix, buf, len, opt->maxDepth, &errDs) != NS_OK) {
+        JsonIndexFree(&ix);
+        Tcl_DStringResult(interp, &errDs);
+        return TCL_ERROR;
+    }
+
+    resultObj = Tcl_NewDictObj();
+    for (i = 0; i < pc && result == TCL_OK; i++) {
+        TCL_SIZE_T  ptrLen;
+        const char *ptr = Tcl_GetStringFromObj(pv[i], &ptrLen);
+        Tcl_Obj    *pathObj = JsonPointerToPathObj(interp, ptr, ptrLen);
+        size_t      start = 0u, end = 0u, consumed = 0u;
+        bool        found;
+        Tcl_Obj    *valueObj = NULL;
+
+        if (pathObj == NULL) {
+            result = TCL_ERROR;
+            break;
         }
-        if (strcmp(Tcl_GetString(lv[i + 2]), Tcl_GetString(nameObj)) == 0) {
-            return NS_TRUE;
+        Tcl_IncrRefCount(pathObj);
+        if (JsonIndexLookup(&ix, pathObj, opt, &start, &end, &found, &errDs) != NS_OK) {
+            Tcl_DStringResult(interp, &errDs);
+            result = TCL_ERROR;
+
+        } else if (found) {
+            if (Ns_JsonParse(buf + start, end - start, &valueOpt, &valueObj, NULL,
+                             &consumed, &errDs) != NS_OK) {
+                Ns_DStringPrintf(&errDs, " (value at byte %lu)", (unsigned long)start);
+                Tcl_DStringResult(interp, &errDs);
+                result = TCL_ERROR;
+
+            } else if (JsonSkipWsPtr(buf + start + consumed, buf + end) != buf + end) {
+                Ns_TclPrintfResult(interp, "ns_json parse: trailing data at byte %lu",
+                                   (unsigned long)(JsonSkipWsPtr(buf + start + consumed, buf + end) - buf));
+                Tcl_IncrRefCount(valueObj);
+                Tcl_DecrRefCount(valueObj);
+                result = TCL_ERROR;
+
+            } else {
+                (void) Tcl_DictObjPut(NULL, resultObj, pv[i], valueObj);
+            }
         }
+        Tcl_DecrRefCount(pathObj);
     }
-    return NS_FALSE;
+
+    JsonIndexFree(&ix);
+    Tcl_DStringFree(&errDs);
+
+    if (result == TCL_OK) {
+        Tcl_SetObjResult(interp, resultObj);
+    } else {
+        Tcl_DecrRefCount(resultObj);
+    }
+    return result;
 }
 
 
@@ -7965,7 +9242,7 @@ static int
 JsonParseObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
     Ns_JsonOptions opt;
-    Tcl_Obj       *resultObj = NULL, *valueObj;
+    Tcl_Obj       *resultObj = NULL, *valueObj, *pointersObj = NULL;
     Tcl_DString    errDs;
     int            result = TCL_OK, isScan = 0;
     size_t         consumed = 0;
@@ -7976,6 +9253,7 @@ JsonParseObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T ob
         {"-output",          Ns_ObjvIndex, &opt.output,          outputFormats},
         {"-scan",            Ns_ObjvBool,  &isScan,              INT2PTR(NS_TRUE)},
         {"-top",             Ns_ObjvIndex, &opt.top,             topModes},
+        {"-pointers",        Ns_ObjvObj,   &pointersObj,         NULL},
         {"-nullvalue",       Ns_ObjvObj,   &opt.nullValueObj,    NULL},
         {"-validatenumbers", Ns_ObjvBool,  &opt.validateNumbers, INT2PTR(NS_TRUE)},
         {"-maxdepth",        Ns_ObjvInt,   &opt.maxDepth,        &posIntRange1},
@@ -8007,6 +9285,19 @@ JsonParseObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T ob
     }
 
     buf = (const unsigned char *)Tcl_GetStringFromObj(valueObj, &len);
+
+    if (pointersObj != NULL) {
+        /*
+         * Lazy parsing mode: extract only the values addressed by the
+         * provided JSON Pointers.
+         */
+        if (opt.output == NS_JSON_OUTPUT_NS_SET || isScan) {
+            Ns_TclPrintfResult(interp, "ns_json parse: -pointers cannot be combined with -output set or -scan");
+            return TCL_ERROR;
+        }
+        return JsonParsePointers(interp, buf, (size_t)len, &opt, pointersObj);
+    }
+
     Tcl_DStringInit(&errDs);
 
     if (opt.output == NS_JSON_OUTPUT_NS_SET) {
@@ -8235,6 +9526,95 @@ JsonValueObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * JsonEncodeObjCmd --
+ *
+ *      Implements "ns_json encode".
+ *
+ *      Encode a plain Tcl value (dict, list or scalar) as JSON text.  The
+ *      optional -schema describes the JSON types of the value (see
+ *      JsonEncodeResolveSchema()); without a schema, the value is encoded
+ *      as JSON object with detected member types.  In contrast to
+ *      "ns_json value", no triples representation has to be built by the
+ *      caller, the JSON text is emitted directly into a single DString.
+ *
+ *      With -write, the JSON text is sent to the current connection
+ *      instead of being returned.  When no headers were sent so far, it
+ *      is sent as complete response with the content type
+ *      application/json, otherwise it is appended like with ns_write.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side Effects:
+ *      Sets the interpreter result, might write to the connection.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+JsonEncodeObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
+                 TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    Tcl_Obj          *valueObj, *schemaObj = NULL, *nullValueObj = NULL;
+    int               pretty = 0, write = 0, result = TCL_OK;
+    Ns_ObjvSpec       opts[] = {
+        {"-nullvalue", Ns_ObjvObj,  &nullValueObj, NULL},
+        {"-pretty",    Ns_ObjvBool, &pretty,       INT2PTR(NS_TRUE)},
+        {"-schema",    Ns_ObjvObj,  &schemaObj,    NULL},
+        {"-write",     Ns_ObjvBool, &write,        INT2PTR(NS_TRUE)},
+        {"--",         Ns_ObjvBreak, NULL,         NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"value", Ns_ObjvObj, &valueObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        JsonEncodeOptions opt;
+        Tcl_DString       ds;
+
+        opt.nullValueObj = nullValueObj;
+        opt.pretty = (pretty != 0);
+
+        Tcl_DStringInit(&ds);
+        result = JsonEncodeValue(interp,
+                                 schemaObj != NULL ? schemaObj : JsonAtomObj(JSON_ATOM_T_OBJECT),
+                                 valueObj, &opt, 0, &ds);
+        if (result == TCL_OK) {
+            if (write == 0) {
+                Tcl_DStringResult(interp, &ds);
+
+            } else {
+                Ns_Conn *conn = NULL;
+
+                if (NsConnRequire(interp, NS_CONN_REQUIRE_ALL, &conn, &result) == NS_OK) {
+                    struct iovec  iov;
+                    Ns_ReturnCode status;
+
+                    (void)Ns_SetVec(&iov, 0, ds.string, (size_t)ds.length);
+                    if ((conn->flags & NS_CONN_SENTHDRS) == 0u) {
+                        Ns_ConnSetEncodedTypeHeader(conn, "application/json");
+                        status = Ns_ConnWriteVChars(conn, &iov, 1, 0u);
+                        (void) Ns_ConnClose(conn);
+                    } else {
+                        status = Ns_ConnWriteVChars(conn, &iov, 1,
+                                                    Ns_ConnResponseLength(conn) < 0 ? NS_CONN_STREAM : 0u);
+                    }
+                    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(status == NS_OK));
+                }
+            }
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -8722,6 +10102,7 @@ int
 NsTclJsonObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
 {
     const Ns_SubCmdSpec subcmds[] = {
+        {"encode",     JsonEncodeObjCmd},
         {"isnull",     JsonIsNullObjCmd},
         {"null",       JsonNullObjCmd},
         {"keydecode",  JsonKeyDecodeObjCmd},
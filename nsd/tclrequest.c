@@ -104,11 +104,12 @@ NsTclRegisterProcObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T ob
     Tcl_Obj      *scriptObj;
     char         *method, *url;
     TCL_SIZE_T    remain = 0;
-    int           noinherit = 0, result = TCL_OK;
+    int           noinherit = 0, streambody = 0, result = TCL_OK;
     NsUrlSpaceContextSpec *specPtr = NULL;
     Ns_ObjvSpec   opts[] = {
         {"-constraints", Ns_ObjvUrlspaceSpec, &specPtr, NULL},
         {"-noinherit",     Ns_ObjvBool,        &noinherit,    INT2PTR(NS_TRUE)},
+        {"-streambody",    Ns_ObjvBool,        &streambody,   INT2PTR(NS_TRUE)},
         {"--",             Ns_ObjvBreak,       NULL,          NULL},
         {NULL, NULL, NULL, NULL}
     };
@@ -131,6 +132,9 @@ NsTclRegisterProcObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T ob
         if (noinherit != 0) {
             flags |= NS_OP_NOINHERIT;
         }
+        if (streambody != 0) {
+            flags |= NS_OP_STREAMBODY;
+        }
         cbPtr = Ns_TclNewCallback(interp, (ns_funcptr_t)NsTclRequestProc, scriptObj,
                                   remain, objv + ((TCL_SIZE_T)objc - remain));
         result = Ns_RegisterRequest2(interp, itPtr->servPtr->server, method, url,
@@ -0,0 +1,539 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * timerwheel.c --
+ *
+ *      Hierarchical timing wheel for managing large numbers of
+ *      timers. Time is divided into ticks of a fixed resolution. Level
+ *      0 of the wheel has one slot per tick, the slots of level n
+ *      cover NS_TIMERWHEEL_SLOTS^n ticks. When the wheel advances
+ *      past the end of a lower level, the entries of the next slot of
+ *      the higher level are distributed ("cascaded") to the lower
+ *      levels.
+ *
+ *   - Cost of insertion:               O(1)
+ *   - Cost of cancellation:            O(1)
+ *   - Cost of expiry:                  O(1) per entry (amortized,
+ *                                      including cascading)
+ *
+ *      Timers expire in batches per tick, never before their expiry
+ *      time, but up to one tick later. Entries of the same tick
+ *      expire in the order they were added.
+ *
+ *      The wheel performs no locking; the users have to protect it.
+ */
+
+#include "nsd.h"
+
+#define TW_MASK ((int64_t)NS_TIMERWHEEL_SLOTS - 1)
+
+/*
+ * Local functions defined in this file.
+ */
+
+static void SlotAppend(NsTimerWheelEntry **headPtr, NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1,2);
+
+static void SlotRemove(NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1);
+
+static void Insert(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+    NS_GNUC_NONNULL(1,2);
+
+static void Cascade(NsTimerWheel *wheelPtr, int level)
+    NS_GNUC_NONNULL(1);
+
+static int64_t TimeToTicks(const NsTimerWheel *wheelPtr, const Ns_Time *timePtr, bool roundUp)
+    NS_GNUC_NONNULL(1,2) NS_GNUC_PURE;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelInit --
+ *
+ *      Initialize an empty timing wheel with the given resolution
+ *      (duration of a tick). The wheel starts at the provided time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelInit(NsTimerWheel *wheelPtr, const Ns_Time *resolutionPtr, const Ns_Time *nowPtr)
+{
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(resolutionPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    memset(wheelPtr, 0, sizeof(NsTimerWheel));
+    wheelPtr->resolution = (int64_t)resolutionPtr->sec * 1000000 + (int64_t)resolutionPtr->usec;
+    if (wheelPtr->resolution <= 0) {
+        wheelPtr->resolution = 1000;
+    }
+    wheelPtr->current = TimeToTicks(wheelPtr, nowPtr, NS_FALSE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelEntryInit --
+ *
+ *      Initialize a timing wheel entry, which is not queued.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelEntryInit(NsTimerWheelEntry *entryPtr, void *clientData)
+{
+    NS_NONNULL_ASSERT(entryPtr != NULL);
+
+    entryPtr->nextPtr = NULL;
+    entryPtr->prevPtr = NULL;
+    entryPtr->headPtr = NULL;
+    entryPtr->tick = 0;
+    entryPtr->clientData = clientData;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelAdd --
+ *
+ *      Queue an entry to expire at the specified time. An entry
+ *      which is already queued is moved to the new expiry time. Entries
+ *      with an expiry time in the past expire with the next call of
+ *      NsTimerWheelExpire().
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTimerWheelAdd(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr, const Ns_Time *expiresPtr)
+{
+    int64_t tick;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(entryPtr != NULL);
+    NS_NONNULL_ASSERT(expiresPtr != NULL);
+
+    (void) NsTimerWheelCancel(wheelPtr, entryPtr);
+
+    /*
+     * Round up, such that an entry never expires too early.
+     */
+    tick = TimeToTicks(wheelPtr, expiresPtr, NS_TRUE);
+    if (tick < wheelPtr->current) {
+        tick = wheelPtr->current;
+    }
+    entryPtr->tick = tick;
+    Insert(wheelPtr, entryPtr);
+    wheelPtr->count++;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelCancel --
+ *
+ *      Remove an entry from the timing wheel.
+ *
+ * Results:
+ *      NS_TRUE when the entry was queued.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsTimerWheelCancel(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+{
+    bool success = NS_FALSE;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(entryPtr != NULL);
+
+    if (entryPtr->headPtr != NULL) {
+        SlotRemove(entryPtr);
+        wheelPtr->count--;
+        success = NS_TRUE;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelExpire --
+ *
+ *      Advance the timing wheel to the provided time and remove all
+ *      entries with an expiry time up to this time.
+ *
+ * Results:
+ *      List of expired entries linked via nextPtr in the order of
+ *      their expiry, or NULL.
+ *
+ * Side effects:
+ *      The returned entries are not queued anymore.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsTimerWheelEntry *
+NsTimerWheelExpire(NsTimerWheel *wheelPtr, const Ns_Time *nowPtr)
+{
+    NsTimerWheelEntry *firstPtr = NULL, **lastPtrPtr = &firstPtr;
+    int64_t            target;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    target = TimeToTicks(wheelPtr, nowPtr, NS_FALSE);
+
+    while (wheelPtr->current <= target) {
+        int64_t            idx, base, j;
+        NsTimerWheelEntry *entryPtr;
+
+        if (wheelPtr->count == 0u) {
+            /*
+             * Nothing is queued, no need to visit the slots.
+             */
+            wheelPtr->current = target + 1;
+            break;
+        }
+
+        idx = wheelPtr->current & TW_MASK;
+        base = wheelPtr->current - idx;
+        if (idx == 0) {
+            Cascade(wheelPtr, 1);
+        }
+
+        while ((entryPtr = wheelPtr->slots[0][idx]) != NULL) {
+            SlotRemove(entryPtr);
+            wheelPtr->count--;
+            *lastPtrPtr = entryPtr;
+            lastPtrPtr = &entryPtr->nextPtr;
+        }
+        wheelPtr->current++;
+
+        /*
+         * Skip empty slots up to the next non-empty slot of level 0
+         * or the end of this level.
+         */
+        for (j = idx + 1; j <= TW_MASK && wheelPtr->slots[0][j] == NULL; j++) {
+            ;
+        }
+        j += base;
+        if (j > wheelPtr->current) {
+            wheelPtr->current = MIN(j, target + 1);
+        }
+    }
+
+    return firstPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelNextTimeout --
+ *
+ *      Determine the time, when NsTimerWheelExpire() has to be called
+ *      next. This is either the expiry time of the next entry in
+ *      level 0 or the time, when the next non-empty slot of a higher
+ *      level has to be cascaded.
+ *
+ * Results:
+ *      NS_FALSE when the wheel is empty, NS_TRUE otherwise.
+ *
+ * Side effects:
+ *      Sets the time in timePtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsTimerWheelNextTimeout(const NsTimerWheel *wheelPtr, Ns_Time *timePtr)
+{
+    bool success = NS_FALSE;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+    NS_NONNULL_ASSERT(timePtr != NULL);
+
+    if (wheelPtr->count > 0u) {
+        int64_t next = INT64_MAX, usec;
+        int     level;
+
+        for (level = 0; level < NS_TIMERWHEEL_LEVELS; level++) {
+            int     shift = level * NS_TIMERWHEEL_BITS;
+            int64_t base = wheelPtr->current >> shift, k;
+
+            /*
+             * Slots are checked in the order they are reached. In level
+             * 0, the current slot is due now; in higher levels, the
+             * current slot was already cascaded.
+             */
+            for (k = (level == 0) ? 0 : 1; k <= TW_MASK + 1; k++) {
+                if (wheelPtr->slots[level][(base + k) & TW_MASK] != NULL) {
+                    int64_t tick = (base + k) << shift;
+
+                    if (tick < next) {
+                        next = tick;
+                    }
+                    break;
+                }
+            }
+        }
+        if (next < wheelPtr->current) {
+            next = wheelPtr->current;
+        }
+        usec = next * wheelPtr->resolution;
+        timePtr->sec = (time_t)(usec / 1000000);
+        timePtr->usec = (long)(usec % 1000000);
+        success = NS_TRUE;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTimerWheelDrain --
+ *
+ *      Remove all entries from the timing wheel.
+ *
+ * Results:
+ *      List of removed entries linked via nextPtr, or NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsTimerWheelEntry *
+NsTimerWheelDrain(NsTimerWheel *wheelPtr)
+{
+    NsTimerWheelEntry *firstPtr = NULL;
+    int                level, idx;
+
+    NS_NONNULL_ASSERT(wheelPtr != NULL);
+
+    for (level = 0; level < NS_TIMERWHEEL_LEVELS; level++) {
+        for (idx = 0; idx < NS_TIMERWHEEL_SLOTS; idx++) {
+            NsTimerWheelEntry *entryPtr;
+
+            while ((entryPtr = wheelPtr->slots[level][idx]) != NULL) {
+                SlotRemove(entryPtr);
+                entryPtr->nextPtr = firstPtr;
+                firstPtr = entryPtr;
+            }
+        }
+    }
+    wheelPtr->count = 0u;
+
+    return firstPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Insert --
+ *
+ *      Add an entry to the slot corresponding to its expiry tick. The
+ *      level is determined by the distance from the current tick.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Insert(NsTimerWheel *wheelPtr, NsTimerWheelEntry *entryPtr)
+{
+    int64_t delta = entryPtr->tick - wheelPtr->current, idx;
+    int     level = 0;
+
+    while (level < NS_TIMERWHEEL_LEVELS - 1
+           && delta >= ((int64_t)1 << ((level + 1) * NS_TIMERWHEEL_BITS))) {
+        level++;
+    }
+    if (level == NS_TIMERWHEEL_LEVELS - 1
+        && delta >= ((int64_t)1 << (NS_TIMERWHEEL_LEVELS * NS_TIMERWHEEL_BITS))) {
+        /*
+         * Beyond the range of the wheel. Use the last slot of the
+         * highest level, the entry is reinserted when this slot is
+         * cascaded.
+         */
+        idx = ((wheelPtr->current >> (level * NS_TIMERWHEEL_BITS)) - 1) & TW_MASK;
+    } else {
+        idx = (entryPtr->tick >> (level * NS_TIMERWHEEL_BITS)) & TW_MASK;
+    }
+    SlotAppend(&wheelPtr->slots[level][idx], entryPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Cascade --
+ *
+ *      Distribute the entries of the current slot of the specified
+ *      level to the lower levels. When the current slot is the first
+ *      slot of this level, the next higher level is cascaded as well.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Cascade(NsTimerWheel *wheelPtr, int level)
+{
+    int64_t            idx = (wheelPtr->current >> (level * NS_TIMERWHEEL_BITS)) & TW_MASK;
+    NsTimerWheelEntry *entryPtr;
+
+    if (idx == 0 && level < NS_TIMERWHEEL_LEVELS - 1) {
+        Cascade(wheelPtr, level + 1);
+    }
+    while ((entryPtr = wheelPtr->slots[level][idx]) != NULL) {
+        SlotRemove(entryPtr);
+        Insert(wheelPtr, entryPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlotAppend, SlotRemove --
+ *
+ *      Add an entry to the end of a slot list or remove it from its
+ *      slot list. The prevPtr of the first entry points to the last
+ *      entry of the list.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SlotAppend(NsTimerWheelEntry **headPtr, NsTimerWheelEntry *entryPtr)
+{
+    NsTimerWheelEntry *firstPtr = *headPtr;
+
+    entryPtr->nextPtr = NULL;
+    entryPtr->headPtr = headPtr;
+    if (firstPtr == NULL) {
+        entryPtr->prevPtr = entryPtr;
+        *headPtr = entryPtr;
+    } else {
+        entryPtr->prevPtr = firstPtr->prevPtr;
+        firstPtr->prevPtr->nextPtr = entryPtr;
+        firstPtr->prevPtr = entryPtr;
+    }
+}
+
+static void
+SlotRemove(NsTimerWheelEntry *entryPtr)
+{
+    NsTimerWheelEntry **headPtr = entryPtr->headPtr, *firstPtr = *headPtr;
+
+    if (entryPtr == firstPtr) {
+        *headPtr = entryPtr->nextPtr;
+        if (entryPtr->nextPtr != NULL) {
+            entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+        }
+    } else {
+        entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+        if (entryPtr->nextPtr != NULL) {
+            entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+        } else {
+            firstPtr->prevPtr = entryPtr->prevPtr;
+        }
+    }
+    entryPtr->nextPtr = NULL;
+    entryPtr->prevPtr = NULL;
+    entryPtr->headPtr = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimeToTicks --
+ *
+ *      Convert an absolute time into ticks of the wheel.
+ *
+ * Results:
+ *      Number of ticks.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int64_t
+TimeToTicks(const NsTimerWheel *wheelPtr, const Ns_Time *timePtr, bool roundUp)
+{
+    int64_t usec = (int64_t)timePtr->sec * 1000000 + (int64_t)timePtr->usec;
+
+    if (roundUp) {
+        usec += wheelPtr->resolution - 1;
+    }
+    return usec / wheelPtr->resolution;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
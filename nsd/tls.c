@@ -24,8 +24,13 @@
 # include <openssl/ssl.h>
 # include <openssl/err.h>
 
+# include <openssl/rand.h>
+
 # ifndef  HAVE_OPENSSL_3
 #  include <openssl/x509v3.h>
+#  include <openssl/hmac.h>
+# else
+#  include <openssl/core_names.h>
 # endif
 
 # ifdef HAVE_OPENSSL_OCSP
@@ -64,6 +69,43 @@ static int ClientCtxServerDataIndex;
  */
 static int ServerCtxALPNProtosDataIndex;
 
+/*
+ * Client-side TLS session cache for outgoing connections (ns_http,
+ * ns_connchan). Sessions are keyed by peer address, port, SNI hostname
+ * and the verification settings. The SSL ex-data index holds the cache
+ * key of a client connection until the server sends a session ticket.
+ */
+static int       ClientSessionKeyIndex = -1;
+static Ns_Cache *clientSessionCache = NULL;
+static Ns_Time   clientSessionTTL = {300, 0};
+
+/*
+ * Session ticket keys of a server driver, loaded from a file or from the
+ * output of a script, such that several instances can share the keys and
+ * resume sessions across restarts. Every key consists of a 16 byte name,
+ * a 32 byte HMAC secret and a 32 byte AES key. The first key is used for
+ * issuing tickets, the others are accepted for decryption only, such that
+ * tickets remain valid for a while after a rotation.
+ */
+#define NS_TLS_TICKET_KEYS_MAX 8
+
+typedef struct TicketKey {
+    unsigned char name[16];
+    unsigned char hmacSecret[32];
+    unsigned char aesKey[32];
+} TicketKey;
+
+typedef struct NsTLSTicketKeys {
+    Ns_Mutex    lock;
+    const char *file;
+    const char *script;
+    size_t      nkeys;
+    TicketKey   keys[NS_TLS_TICKET_KEYS_MAX];
+} NsTLSTicketKeys;
+
+static int TicketKeysDataIndex = -1;
+static int TicketKeysSSLDataIndex = -1;
+
 static TCL_OBJCMDPROC_T NsCertCtlInfoObjCmd;
 static TCL_OBJCMDPROC_T NsCertCtlListObjCmd;
 static TCL_OBJCMDPROC_T NsCertCtlReloadObjCmd;
@@ -86,6 +128,16 @@ static void SSL_infoCB(const SSL *ssl, int where, int ret);
 static int CertficateValidationCB(int preverify_ok, X509_STORE_CTX *ctx);
 static void ALPNProtosFreeCB(void *UNUSED(parent), void *ptr, CRYPTO_EX_DATA *UNUSED(ad),
                              int UNUSED(idx), long UNUSED(argl), void *UNUSED(argp));
+static int ClientSessionNewCB(SSL *ssl, SSL_SESSION *session);
+#ifdef HAVE_OPENSSL_3
+static int TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                       EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc);
+#else
+static int TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+                       EVP_CIPHER_CTX *cipherCtx, HMAC_CTX *macCtx, int enc);
+#endif
+static void ClientSessionKeyFreeCB(void *UNUSED(parent), void *ptr, CRYPTO_EX_DATA *UNUSED(ad),
+                                   int UNUSED(idx), long UNUSED(argl), void *UNUSED(argp));
 /*
  * Misc helper
  */
@@ -100,6 +152,9 @@ static void ReportError(Tcl_Interp *interp, const char *fmt, ...)
 static char *FilenameToEnvVar(Tcl_DString *dsPtr, const char *filename)
     NS_GNUC_NONNULL(1,2);
 
+static Ns_ReturnCode ExecuteKeyScript(Tcl_DString *dsPtr, const char *scriptPath, const char *pemPath)
+    NS_GNUC_NONNULL(1,2);
+
 static Ns_ReturnCode BuildALPNWireFormat(Tcl_DString *dsPtr, const char *alpnStr)
     NS_GNUC_NONNULL(1,2);
 
@@ -132,6 +187,25 @@ static void DrainErrorStack(Ns_LogSeverity severity, const char *errorContext, u
 
 static Ns_ReturnCode WaitFor(NS_SOCKET sock, unsigned int st, const Ns_Time *timeoutPtr);
 
+static void ClientSessionFree(void *arg)
+    NS_GNUC_NONNULL(1);
+static void ClientSessionLookup(NS_TLS_SSL *ssl, NS_SOCKET sock, const char *sni_hostname,
+                                const char *caFile, const char *caPath)
+    NS_GNUC_NONNULL(1);
+
+static int HexDigitValue(char c)
+    NS_GNUC_CONST;
+static Ns_ReturnCode TicketKeysParse(const char *string, TicketKey *keys, size_t *nkeysPtr)
+    NS_GNUC_NONNULL(1,2,3);
+static Ns_ReturnCode TicketKeysLoad(NsTLSTicketKeys *tkPtr)
+    NS_GNUC_NONNULL(1);
+static void TicketKeysReload(void *arg, int UNUSED(id))
+    NS_GNUC_NONNULL(1);
+static unsigned int TicketKeysSessionIdContext(const char *section, Ns_TLSClientCertMode mode,
+                                               const char *cafile, const char *capath,
+                                               unsigned char *sidCtx)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(5);
+
 static void CertTableInit(void);
 static void CertTableReload(void *UNUSED(arg));
 static void CertTableAdd(const NS_TLS_SSL_CTX *ctx, const char *cert, const char *key)
@@ -426,6 +500,15 @@ SSL_serverNameCB(SSL *ssl, int *UNUSED(al), void *arg)
             if (ctx != NULL) {
                 Ns_Log(Debug, "SSL_serverNameCB switches server context to %p", (void*)ctx);
                 SSL_set_SSL_CTX(ssl, ctx);
+                if (dc->ticketKeys != NULL) {
+                    /*
+                     * OpenSSL calls the ticket key callback of the
+                     * initial context. Keep the keys and the session id
+                     * context of the driver for this connection.
+                     */
+                    SSL_set_ex_data(ssl, TicketKeysSSLDataIndex, dc->ticketKeys);
+                    SSL_set_session_id_context(ssl, dc->sidCtx, dc->sidCtxLength);
+                }
                 result = SSL_TLSEXT_ERR_OK;
             }
             Tcl_DStringFree(&ds);
@@ -463,6 +546,504 @@ ALPNProtosFreeCB(void *UNUSED(parent), void *ptr, CRYPTO_EX_DATA *UNUSED(ad),
     ns_free(ptr);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClientSessionKeyFreeCB --
+ *
+ *      OpenSSL SSL ex-data cleanup callback for the session cache key of
+ *      a client connection.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the key string.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ClientSessionKeyFreeCB(void *UNUSED(parent), void *ptr, CRYPTO_EX_DATA *UNUSED(ad),
+                       int UNUSED(idx), long UNUSED(argl), void *UNUSED(argp))
+{
+    ns_free(ptr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClientSessionFree --
+ *
+ *      Free procedure for the client session cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Drops the reference to the cached SSL_SESSION.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ClientSessionFree(void *arg)
+{
+    SSL_SESSION_free((SSL_SESSION *)arg);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClientSessionNewCB --
+ *
+ *      OpenSSL new-session callback for client contexts. Called after a
+ *      full handshake (TLS 1.2) or when a session ticket was received
+ *      (TLS 1.3, possibly multiple times per connection).
+ *
+ * Results:
+ *      1 when the session was stored in the cache (the cache owns the
+ *      reference), 0 otherwise.
+ *
+ * Side effects:
+ *      Adds or replaces a client session cache entry.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+ClientSessionNewCB(SSL *ssl, SSL_SESSION *session)
+{
+    const char *key = SSL_get_ex_data(ssl, ClientSessionKeyIndex);
+    int         result = 0;
+
+    if (key != NULL && clientSessionCache != NULL && SSL_SESSION_is_resumable(session) == 1) {
+        Ns_Entry *entry;
+        Ns_Time   expires;
+        int       isNew;
+
+        Ns_GetTime(&expires);
+        Ns_IncrTime(&expires, clientSessionTTL.sec, clientSessionTTL.usec);
+
+        Ns_CacheLock(clientSessionCache);
+        entry = Ns_CacheCreateEntry(clientSessionCache, key, &isNew);
+        (void) Ns_CacheSetValueExpires(entry, session, (size_t)i2d_SSL_SESSION(session, NULL),
+                                       &expires, 0, 0u, 0u);
+        Ns_CacheUnlock(clientSessionCache);
+        Ns_Log(Debug, "tls: cached client session for '%s'", key);
+        result = 1;
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClientSessionLookup --
+ *
+ *      Try to find a cached session for a new client connection and
+ *      offer it for resumption. The cache key is built from the peer
+ *      address, the SNI hostname and the verification settings, such
+ *      that a session established without verification is never resumed
+ *      by a verifying client. Connections presenting a client
+ *      certificate are not cached.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets the session and the cache key on the SSL structure. TLS 1.3
+ *      tickets are removed from the cache when used, since they should
+ *      not be reused.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ClientSessionLookup(NS_TLS_SSL *ssl, NS_SOCKET sock, const char *sni_hostname,
+                    const char *caFile, const char *caPath)
+{
+    struct NS_SOCKADDR_STORAGE sa;
+    socklen_t                  socklen = (socklen_t)sizeof(sa);
+    char                       ipString[NS_IPADDR_SIZE];
+    Tcl_DString                ds;
+    Ns_Entry                  *entry;
+
+    NS_NONNULL_ASSERT(ssl != NULL);
+
+    if (SSL_get_certificate(ssl) != NULL
+        || getpeername(sock, (struct sockaddr *)&sa, &socklen) != 0) {
+        return;
+    }
+    Tcl_DStringInit(&ds);
+    Ns_DStringPrintf(&ds, "%s %hu %s %d %s %s",
+                     ns_inet_ntop((struct sockaddr *)&sa, ipString, sizeof(ipString)),
+                     Ns_SockaddrGetPort((struct sockaddr *)&sa),
+                     sni_hostname != NULL ? sni_hostname : "-",
+                     SSL_get_verify_mode(ssl),
+                     caFile != NULL ? caFile : "-",
+                     caPath != NULL ? caPath : "-");
+
+    Ns_CacheLock(clientSessionCache);
+    entry = Ns_CacheFindEntry(clientSessionCache, ds.string);
+    if (entry != NULL) {
+        SSL_SESSION *session = Ns_CacheGetValue(entry);
+
+        (void) SSL_set_session(ssl, session);
+        if (SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION) {
+            Ns_CacheDeleteEntry(entry);
+        }
+    }
+    Ns_CacheUnlock(clientSessionCache);
+
+    (void) SSL_set_ex_data(ssl, ClientSessionKeyIndex, ns_strdup(ds.string));
+    Tcl_DStringFree(&ds);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HexDigitValue --
+ *
+ *      Return the numeric value of a hex digit.
+ *
+ * Results:
+ *      0..15, or -1 when the character is not a hex digit.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+HexDigitValue(char c)
+{
+    int result;
+
+    if (c >= '0' && c <= '9') {
+        result = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        result = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        result = c - 'A' + 10;
+    } else {
+        result = -1;
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysParse --
+ *
+ *      Parse session ticket keys. Every non-empty line not starting with
+ *      "#" contains one key as 160 hex digits (80 bytes, e.g. produced
+ *      by "openssl rand -hex 80"). The first key is the current one.
+ *
+ * Results:
+ *      NS_OK when at least one key was parsed and all lines were valid,
+ *      NS_ERROR otherwise.
+ *
+ * Side effects:
+ *      Fills the keys array and updates *nkeysPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+TicketKeysParse(const char *string, TicketKey *keys, size_t *nkeysPtr)
+{
+    Ns_ReturnCode result = NS_OK;
+    size_t        nkeys = 0u;
+    const char   *p = string;
+
+    NS_NONNULL_ASSERT(string != NULL);
+    NS_NONNULL_ASSERT(keys != NULL);
+    NS_NONNULL_ASSERT(nkeysPtr != NULL);
+
+    while (*p != '\0' && result == NS_OK) {
+        const char *eol = strchr(p, INTCHAR('\n'));
+        size_t      lineLength = (eol != NULL) ? (size_t)(eol - p) : strlen(p);
+
+        while (lineLength > 0u && CHARTYPE(space, p[lineLength - 1u]) != 0) {
+            lineLength--;
+        }
+        while (lineLength > 0u && CHARTYPE(space, *p) != 0) {
+            p++;
+            lineLength--;
+        }
+        if (lineLength > 0u && *p != '#') {
+            if (lineLength != 2u * sizeof(TicketKey) || nkeys == NS_TLS_TICKET_KEYS_MAX) {
+                result = NS_ERROR;
+            } else {
+                unsigned char *octets = (unsigned char *)&keys[nkeys];
+                size_t         i;
+
+                for (i = 0u; i < sizeof(TicketKey); i++) {
+                    int hi = HexDigitValue(p[2u * i]), lo = HexDigitValue(p[2u * i + 1u]);
+
+                    if (hi < 0 || lo < 0) {
+                        result = NS_ERROR;
+                        break;
+                    }
+                    octets[i] = (unsigned char)((hi << 4) | lo);
+                }
+                nkeys++;
+            }
+        }
+        if (eol == NULL) {
+            break;
+        }
+        p = eol + 1;
+    }
+    if (nkeys == 0u) {
+        result = NS_ERROR;
+    }
+    *nkeysPtr = nkeys;
+
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysLoad --
+ *
+ *      Load the session ticket keys from the configured file or from the
+ *      output of the configured script.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      On success, replaces the keys used for issuing and accepting
+ *      session tickets.
+ *
+ *----------------------------------------------------------------------
+ */
+static Ns_ReturnCode
+TicketKeysLoad(NsTLSTicketKeys *tkPtr)
+{
+    Ns_ReturnCode result = NS_OK;
+    Tcl_DString   ds;
+    TicketKey     keys[NS_TLS_TICKET_KEYS_MAX];
+    size_t        nkeys = 0u;
+    const char   *source;
+
+    NS_NONNULL_ASSERT(tkPtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    if (tkPtr->file != NULL) {
+        FILE *fp = fopen(tkPtr->file, "r");
+
+        source = tkPtr->file;
+        if (fp == NULL) {
+            Ns_Log(Error, "tls: cannot open session ticket key file '%s': %s",
+                   source, strerror(errno));
+            result = NS_ERROR;
+        } else {
+            char   buffer[1024];
+            size_t n;
+
+            while ((n = fread(buffer, 1u, sizeof(buffer), fp)) > 0u) {
+                Tcl_DStringAppend(&ds, buffer, (TCL_SIZE_T)n);
+            }
+            (void) fclose(fp);
+        }
+    } else {
+        source = tkPtr->script;
+        assert(source != NULL);
+        result = ExecuteKeyScript(&ds, source, NULL);
+        if (result != NS_OK) {
+            Ns_Log(Error, "tls: session ticket key script '%s' failed", source);
+        }
+    }
+
+    if (result == NS_OK) {
+        result = TicketKeysParse(ds.string, keys, &nkeys);
+        if (result != NS_OK) {
+            Ns_Log(Error, "tls: invalid session ticket keys from '%s'"
+                   " (expect up to %d lines with 160 hex digits)",
+                   source, NS_TLS_TICKET_KEYS_MAX);
+        } else {
+            Ns_MutexLock(&tkPtr->lock);
+            memcpy(tkPtr->keys, keys, nkeys * sizeof(TicketKey));
+            tkPtr->nkeys = nkeys;
+            Ns_MutexUnlock(&tkPtr->lock);
+            Ns_Log(Notice, "tls: loaded %lu session ticket keys from '%s'",
+                   (unsigned long)nkeys, source);
+        }
+    }
+    OPENSSL_cleanse(keys, sizeof(keys));
+    OPENSSL_cleanse(ds.string, (size_t)ds.length);
+    Tcl_DStringFree(&ds);
+
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysReload --
+ *
+ *      Scheduled procedure for rotating session ticket keys. When the
+ *      file or the script provides new keys, these are used from now on;
+ *      on failure, the previous keys are kept.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      See TicketKeysLoad().
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+TicketKeysReload(void *arg, int UNUSED(id))
+{
+    (void) TicketKeysLoad((NsTLSTicketKeys *)arg);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeysSessionIdContext --
+ *
+ *      Compute the session id context used together with shared ticket
+ *      keys. The context is the SHA-256 digest over the configuration
+ *      section of the driver and its client certificate settings
+ *      (clientcertmode, clientcafile, clientcapath). It is stable across
+ *      restarts and instances with the same configuration, but differs
+ *      between drivers, such that a session established with one driver
+ *      is not resumed by a driver with different client certificate
+ *      requirements.
+ *
+ * Results:
+ *      Length of the context written to sidCtx (at most
+ *      SSL_MAX_SID_CTX_LENGTH bytes).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+static unsigned int
+TicketKeysSessionIdContext(const char *section, Ns_TLSClientCertMode mode,
+                           const char *cafile, const char *capath,
+                           unsigned char *sidCtx)
+{
+    Tcl_DString   ds;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int  length = 0u;
+
+    Tcl_DStringInit(&ds);
+    Ns_DStringPrintf(&ds, "%s\n%d\n%s\n%s", section, (int)mode,
+                     cafile != NULL ? cafile : "",
+                     capath != NULL ? capath : "");
+    if (EVP_Digest(ds.string, (size_t)ds.length, digest, &length, EVP_sha256(), NULL) != 1) {
+        length = 0u;
+    }
+    Tcl_DStringFree(&ds);
+
+    if (length > SSL_MAX_SID_CTX_LENGTH) {
+        length = SSL_MAX_SID_CTX_LENGTH;
+    }
+    memcpy(sidCtx, digest, length);
+
+    return length;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TicketKeyCB --
+ *
+ *      OpenSSL session ticket key callback. For encryption (enc == 1),
+ *      the current key is used. For decryption, the key is looked up by
+ *      its name.
+ *
+ * Results:
+ *      -1 on error, 0 when no key was found (which results in a full
+ *      handshake), 1 when the ticket was handled, 2 when the ticket was
+ *      decrypted and should be renewed.
+ *
+ * Side effects:
+ *      Initializes the cipher and HMAC contexts.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+#ifdef HAVE_OPENSSL_3
+TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+            EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int enc)
+#else
+TicketKeyCB(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+            EVP_CIPHER_CTX *cipherCtx, HMAC_CTX *macCtx, int enc)
+#endif
+{
+    NsTLSTicketKeys *tkPtr;
+    TicketKey        key;
+    size_t           i;
+    int              result = 0;
+
+    tkPtr = SSL_get_ex_data(ssl, TicketKeysSSLDataIndex);
+    if (tkPtr == NULL) {
+        tkPtr = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TicketKeysDataIndex);
+    }
+    if (tkPtr == NULL) {
+        return 0;
+    }
+
+    Ns_MutexLock(&tkPtr->lock);
+    if (enc == 1) {
+        if (tkPtr->nkeys > 0u) {
+            key = tkPtr->keys[0];
+            result = 1;
+        }
+    } else {
+        for (i = 0u; i < tkPtr->nkeys; i++) {
+            if (memcmp(keyName, tkPtr->keys[i].name, sizeof(key.name)) == 0) {
+                key = tkPtr->keys[i];
+                /*
+                 * Renew tickets of older keys. TLS 1.3 tickets are
+                 * renewed as well, since clients use these only once.
+                 */
+                result = (i == 0u && SSL_version(ssl) < TLS1_3_VERSION) ? 1 : 2;
+                break;
+            }
+        }
+    }
+    Ns_MutexUnlock(&tkPtr->lock);
+
+    if (result > 0) {
+#ifdef HAVE_OPENSSL_3
+        OSSL_PARAM params[2];
+
+        params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0u);
+        params[1] = OSSL_PARAM_construct_end();
+#endif
+        if (enc == 1) {
+            memcpy(keyName, key.name, sizeof(key.name));
+            if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1
+                || EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+                result = -1;
+            }
+        } else if (EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+            result = -1;
+        }
+#ifdef HAVE_OPENSSL_3
+        if (result > 0
+            && EVP_MAC_init(macCtx, key.hmacSecret, sizeof(key.hmacSecret), params) != 1) {
+            result = -1;
+        }
+#else
+        if (result > 0
+            && HMAC_Init_ex(macCtx, key.hmacSecret, (int)sizeof(key.hmacSecret), EVP_sha256(), NULL) != 1) {
+            result = -1;
+        }
+#endif
+        OPENSSL_cleanse(&key, sizeof(key));
+    }
+
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1864,6 +2445,8 @@ NsInitOpenSSL(void)
     if (!initialized) {
         static char ns_client_info_tag[] = "NaviServer Client Info";
         static char ns_server_alpn_protos_tag[] = "NaviServer server ALPN protocols";
+        static char ns_client_session_key_tag[] = "NaviServer client session key";
+        static char ns_ticket_keys_tag[] = "NaviServer session ticket keys";
         /*
          * With the release of OpenSSL 1.1.0 the interface of
          * CRYPTO_set_mem_functions() changed. Before that, we could
@@ -1887,6 +2470,10 @@ NsInitOpenSSL(void)
         ClientCtxServerDataIndex = SSL_CTX_get_ex_new_index(0, ns_client_info_tag, NULL, NULL, NULL);
         ServerCtxALPNProtosDataIndex = SSL_CTX_get_ex_new_index(0, ns_server_alpn_protos_tag,
                                                                 NULL, NULL, ALPNProtosFreeCB);
+        ClientSessionKeyIndex = SSL_get_ex_new_index(0, ns_client_session_key_tag,
+                                                     NULL, NULL, ClientSessionKeyFreeCB);
+        TicketKeysDataIndex = SSL_CTX_get_ex_new_index(0, ns_ticket_keys_tag, NULL, NULL, NULL);
+        TicketKeysSSLDataIndex = SSL_get_ex_new_index(0, ns_ticket_keys_tag, NULL, NULL, NULL);
         initialized = 1;
         /*
          * We do not want to get this message when, e.g., the nsproxy
@@ -1902,6 +2489,41 @@ NsInitOpenSSL(void)
 # endif
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsConfigTLSClient --
+ *
+ *      Enable caching of TLS sessions for outgoing connections.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Further TLS client connections will try to resume sessions
+ *      obtained from earlier connections to the same peer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsConfigTLSClient(void)
+{
+    const char *section = NS_GLOBAL_CONFIG_PARAMETERS;
+
+    if (Ns_ConfigBool(section, "tlsclientsessioncache", NS_TRUE) == NS_TRUE) {
+        size_t maxSize = (size_t)Ns_ConfigMemUnitRange(section, "tlsclientsessioncachemaxsize", "200KB",
+                                                       (Tcl_WideInt)1024 * 200, 0, INT_MAX);
+        if (maxSize > 0u) {
+            Ns_ConfigTimeUnitRange(section, "tlsclientsessioncachetimeout",
+                                   "5m", 1, 0, INT_MAX, 0,
+                                   &clientSessionTTL);
+            clientSessionCache = Ns_CacheCreateSz("ns:tlsclientsessions", TCL_STRING_KEYS,
+                                                  maxSize, ClientSessionFree);
+        }
+    }
+}
+
 
 
 /*
@@ -2040,6 +2662,16 @@ Ns_TLS_CtxClientCreateCfg(Tcl_Interp *interp,
 
     //SSL_CTX_set_verify(ctx, verify ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, NULL);
     SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+
+    if (clientSessionCache != NULL) {
+        /*
+         * Sessions are kept in our own cache, since client contexts are
+         * typically created per connection. In TLS 1.3, tickets arrive
+         * after the handshake, therefore the new-session callback is used.
+         */
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, ClientSessionNewCB);
+    }
     SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE|SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
     if (cert != NULL) {
@@ -2247,6 +2879,9 @@ Ns_TLS_SSLConnect(Tcl_Interp *interp, NS_SOCKET sock, NS_TLS_SSL_CTX *ctx,
         }
         SSL_set_fd(ssl, sock);
         SSL_set_connect_state(ssl);
+        if (clientSessionCache != NULL) {
+            ClientSessionLookup(ssl, sock, sni_hostname, caFile, caPath);
+        }
 
         for (;;) {
             int           sslRc;
@@ -2658,6 +3293,39 @@ NsTLSConfigNew(const char *section)
                    dc->vhostcertificates);
         }
     }
+
+    if (Ns_ConfigParameterProvided(section, "ticketkeyfile")
+        || Ns_ConfigParameterProvided(section, "ticketkeyscript")) {
+        NsTLSTicketKeys *tkPtr = ns_calloc(1u, sizeof(NsTLSTicketKeys));
+        Ns_Time          interval;
+
+        Ns_MutexInit(&tkPtr->lock);
+        Ns_MutexSetName2(&tkPtr->lock, "ns:ticketkeys", section);
+        if (Ns_ConfigParameterProvided(section, "ticketkeyfile")) {
+            tkPtr->file = Ns_ConfigFilename(section, "ticketkeyfile", 13,
+                                            nsconf.home, "", NS_TRUE, NS_FALSE);
+        } else {
+            tkPtr->script = Ns_ConfigFilename(section, "ticketkeyscript", 15,
+                                              nsconf.binDir, "", NS_TRUE, NS_FALSE);
+        }
+        Ns_ConfigTimeUnitRange(section, "ticketkeyinterval",
+                               "1h", 0, 0, INT_MAX, 0, &interval);
+
+        if (TicketKeysLoad(tkPtr) == NS_OK) {
+            dc->ticketKeys = tkPtr;
+            if (interval.sec > 0 || interval.usec > 0) {
+                (void) Ns_ScheduleProcEx(TicketKeysReload, tkPtr, NS_SCHED_THREAD, &interval, NULL);
+            }
+        } else {
+            Ns_Log(Error, "tls: no valid session ticket keys for %s, using built-in ticket keys",
+                   section);
+            Ns_MutexDestroy(&tkPtr->lock);
+            ns_free_const(tkPtr->file);
+            ns_free_const(tkPtr->script);
+            ns_free(tkPtr);
+        }
+    }
+
     Ns_Log(Debug, "ssl: driver configuration %p created, size %ld",
            (void*)dc, sizeof(NsTLSConfig));
 
@@ -2930,6 +3598,8 @@ Ns_TLS_CtxServerInit(const char *section, Tcl_Interp *interp,
         NsTLSConfig *dc = app_data;
         Ns_DList     dl, *dlPtr = &dl;
         Ns_TLSClientCertMode clientCertMode;
+        unsigned char sidCtx[SSL_MAX_SID_CTX_LENGTH];
+        unsigned int  sidCtxLength;
 
         Ns_Log(Notice, "load certificate '%s' specified in section %s", cert, section);
 
@@ -2986,6 +3656,9 @@ Ns_TLS_CtxServerInit(const char *section, Tcl_Interp *interp,
         Ns_Log(Notice, "Ns_TLS_CtxServerInit: Ns_TLS_CtxServerCreate with dc %p -> sslCtx %p",
                (void*)dc, (void*)(*ctxPtr));
 
+        sidCtxLength = TicketKeysSessionIdContext(section, clientCertMode,
+                                                  clientcafile, clientcapath,
+                                                  sidCtx);
         if (clientcafile != NULL) {
             ns_free_const(clientcafile);
         }
@@ -3017,7 +3690,27 @@ Ns_TLS_CtxServerInit(const char *section, Tcl_Interp *interp,
                 SSL_CTX_set_app_data(*ctxPtr, (void *)dc);
             }
 
-            SSL_CTX_set_session_id_context(*ctxPtr, (const unsigned char *)&nsconf.pid, sizeof(pid_t));
+            if (dc->ticketKeys != NULL) {
+                /*
+                 * With shared ticket keys, sessions have to be resumable
+                 * by other instances and after a restart, therefore the
+                 * session id context must not depend on the process. It
+                 * depends on the driver and its client certificate
+                 * settings, such that drivers sharing the keys cannot
+                 * resume each other's sessions.
+                 */
+                memcpy(dc->sidCtx, sidCtx, sidCtxLength);
+                dc->sidCtxLength = sidCtxLength;
+                SSL_CTX_set_session_id_context(*ctxPtr, dc->sidCtx, dc->sidCtxLength);
+                SSL_CTX_set_ex_data(*ctxPtr, TicketKeysDataIndex, dc->ticketKeys);
+# ifdef HAVE_OPENSSL_3
+                SSL_CTX_set_tlsext_ticket_key_evp_cb(*ctxPtr, TicketKeyCB);
+# else
+                SSL_CTX_set_tlsext_ticket_key_cb(*ctxPtr, TicketKeyCB);
+# endif
+            } else {
+                SSL_CTX_set_session_id_context(*ctxPtr, (const unsigned char *)&nsconf.pid, sizeof(pid_t));
+            }
             SSL_CTX_set_session_cache_mode(*ctxPtr, SSL_SESS_CACHE_SERVER);
 
             SSL_CTX_set_info_callback(*ctxPtr, SSL_infoCB);
@@ -4625,6 +5318,12 @@ Ns_TLS_CtxFree(NS_TLS_SSL_CTX *UNUSED(ctx))
     /* dummy stub */
 }
 
+void
+NsConfigTLSClient(void)
+{
+    /* dummy stub */
+}
+
 int
 NsTclCertCtlObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T UNUSED(objc), Tcl_Obj *const* UNUSED(objv))
 {
@@ -0,0 +1,1081 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+/*
+ * upstream.c --
+ *
+ *      Named upstream groups, i.e. sets of backend servers with a load
+ *      balancing policy (round robin, least outstanding requests, or
+ *      consistent hashing on a request header field or cookie). The
+ *      groups are used by the native reverse proxy
+ *      ("ns_register_revproxy -upstream") and by "ns_http -upstream".
+ *
+ *      The availability of the members is determined by optional
+ *      active health checks, executed periodically via the scheduler,
+ *      and by passive outlier detection: a member with several
+ *      consecutive failed requests (connection errors or timeouts) is
+ *      ejected from the selection for a configurable time.
+ *
+ *      Groups are process-wide and are never freed, since requests in
+ *      progress and registered request procedures refer to their
+ *      members.
+ */
+
+#include "nsd.h"
+
+#define UPSTREAM_RING_POINTS      64     /* Points per member on the hash ring */
+#define UPSTREAM_CHECK_BUFSIZE    256
+
+typedef enum {
+    UPSTREAM_ROUNDROBIN,
+    UPSTREAM_LEASTOUTSTANDING,
+    UPSTREAM_HASH
+} UpstreamPolicy;
+
+typedef struct RingPoint {
+    uint32_t          hash;
+    NsUpstreamMember *memberPtr;
+} RingPoint;
+
+struct NsUpstreamGroup {
+    char             *name;
+    Ns_Mutex          lock;
+    UpstreamPolicy    policy;
+    char             *hashHeader;        /* Hash key from a request header field */
+    char             *hashCookie;        /* Hash key from a cookie */
+    char             *checkPath;         /* Path for active health checks, or NULL */
+    Ns_Time           checkInterval;
+    Ns_Time           checkTimeout;
+    Ns_Time           ejectTime;
+    int               maxFails;
+    int               schedId;
+    unsigned long     next;              /* Round robin position */
+    size_t            nMembers;
+    NsUpstreamMember *members;
+    size_t            nPoints;
+    RingPoint        *ring;
+};
+
+/*
+ * Local functions defined in this file.
+ */
+
+static uint32_t UpstreamHash(const char *string, size_t length)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+static int RingPointCompare(const void *arg1, const void *arg2)
+    NS_GNUC_NONNULL(1,2) NS_GNUC_PURE;
+static bool MemberAvailable(const NsUpstreamMember *memberPtr, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1,2) NS_GNUC_PURE;
+static NsUpstreamMember *SelectRoundRobin(NsUpstreamGroup *groupPtr, const Ns_Time *nowPtr, bool checkAvailable)
+    NS_GNUC_NONNULL(1,2);
+static NsUpstreamMember *SelectLeastOutstanding(NsUpstreamGroup *groupPtr, const Ns_Time *nowPtr, bool checkAvailable)
+    NS_GNUC_NONNULL(1,2);
+static NsUpstreamMember *SelectHash(const NsUpstreamGroup *groupPtr, uint32_t hash, const Ns_Time *nowPtr,
+                                    bool checkAvailable)
+    NS_GNUC_NONNULL(1,3);
+static bool UpstreamProbe(const NsUpstreamGroup *groupPtr, const NsUpstreamMember *memberPtr)
+    NS_GNUC_NONNULL(1,2);
+static void UpstreamCheck(NsUpstreamGroup *groupPtr)
+    NS_GNUC_NONNULL(1);
+
+static Ns_SchedProc UpstreamCheckProc;
+
+static TCL_OBJCMDPROC_T UpstreamCheckObjCmd;
+static TCL_OBJCMDPROC_T UpstreamCreateObjCmd;
+static TCL_OBJCMDPROC_T UpstreamListObjCmd;
+static TCL_OBJCMDPROC_T UpstreamSelectObjCmd;
+static TCL_OBJCMDPROC_T UpstreamStatsObjCmd;
+
+/*
+ * Static variables defined in this file.
+ */
+
+static Ns_Mutex      lock;
+static Tcl_HashTable groups;
+
+static Ns_ObjvTable policyTable[] = {
+    {"roundrobin",       (unsigned int)UPSTREAM_ROUNDROBIN},
+    {"leastoutstanding", (unsigned int)UPSTREAM_LEASTOUTSTANDING},
+    {"hash",             (unsigned int)UPSTREAM_HASH},
+    {NULL,               0u}
+};
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitUpstreams --
+ *
+ *      Initialize the table of upstream groups.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitUpstreams(void)
+{
+    Ns_MutexInit(&lock);
+    Ns_MutexSetName(&lock, "ns:upstreams");
+    Tcl_InitHashTable(&groups, TCL_STRING_KEYS);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsUpstreamGroupGet --
+ *
+ *      Look up an upstream group by name.
+ *
+ * Results:
+ *      Group or NULL. When the group does not exist and an interp is
+ *      provided, an error message is left in the interp.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsUpstreamGroup *
+NsUpstreamGroupGet(Tcl_Interp *interp, const char *name)
+{
+    const Tcl_HashEntry *hPtr;
+    NsUpstreamGroup     *groupPtr = NULL;
+
+    NS_NONNULL_ASSERT(name != NULL);
+
+    Ns_MutexLock(&lock);
+    hPtr = Tcl_FindHashEntry(&groups, name);
+    if (hPtr != NULL) {
+        groupPtr = Tcl_GetHashValue(hPtr);
+    }
+    Ns_MutexUnlock(&lock);
+
+    if (groupPtr == NULL && interp != NULL) {
+        Ns_TclPrintfResult(interp, "no such upstream group \"%s\"", name);
+    }
+    return groupPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsUpstreamGroupName, NsUpstreamGroupHttpOnly --
+ *
+ *      Accessors for the name of the group and for checking whether
+ *      all members use plain HTTP.
+ *
+ * Results:
+ *      Name or boolean.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+const char *
+NsUpstreamGroupName(const NsUpstreamGroup *groupPtr)
+{
+    NS_NONNULL_ASSERT(groupPtr != NULL);
+
+    return groupPtr->name;
+}
+
+bool
+NsUpstreamGroupHttpOnly(const NsUpstreamGroup *groupPtr)
+{
+    size_t i;
+
+    NS_NONNULL_ASSERT(groupPtr != NULL);
+
+    for (i = 0u; i < groupPtr->nMembers; i++) {
+        if (groupPtr->members[i].https) {
+            return NS_FALSE;
+        }
+    }
+    return NS_TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsUpstreamSelect --
+ *
+ *      Select a member of the group according to its policy. For the
+ *      hash policy, the key is taken from the provided request header
+ *      fields; without a key, round robin is used. Members which
+ *      failed the health checks or which are ejected are skipped. When
+ *      no member is available, the selection is made among all
+ *      members, since refusing all requests is worse than trying an
+ *      unhealthy member.
+ *
+ *      When "acquire" is true, the request is counted as outstanding
+ *      and must be finished via NsUpstreamRelease().
+ *
+ * Results:
+ *      Selected member.
+ *
+ * Side effects:
+ *      Updates the round robin position and the statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+NsUpstreamMember *
+NsUpstreamSelect(NsUpstreamGroup *groupPtr, const Ns_Set *headers, bool acquire)
+{
+    NsUpstreamMember *memberPtr = NULL;
+    Ns_Time           now;
+    bool              hasKey = NS_FALSE;
+    uint32_t          hash = 0u;
+
+    NS_NONNULL_ASSERT(groupPtr != NULL);
+
+    if (groupPtr->policy == UPSTREAM_HASH && headers != NULL) {
+        const char *key = NULL;
+        Tcl_DString ds;
+
+        Tcl_DStringInit(&ds);
+        if (groupPtr->hashHeader != NULL) {
+            key = Ns_SetIGet(headers, groupPtr->hashHeader);
+        } else if (groupPtr->hashCookie != NULL) {
+            key = NsHeadersGetCookie(&ds, headers, groupPtr->hashCookie);
+        }
+        if (key != NULL && *key != '\0') {
+            hash = UpstreamHash(key, strlen(key));
+            hasKey = NS_TRUE;
+        }
+        Tcl_DStringFree(&ds);
+    }
+
+    Ns_GetTime(&now);
+    Ns_MutexLock(&groupPtr->lock);
+    if (hasKey) {
+        memberPtr = SelectHash(groupPtr, hash, &now, NS_TRUE);
+    } else if (groupPtr->policy == UPSTREAM_LEASTOUTSTANDING) {
+        memberPtr = SelectLeastOutstanding(groupPtr, &now, NS_TRUE);
+    } else {
+        memberPtr = SelectRoundRobin(groupPtr, &now, NS_TRUE);
+    }
+    if (memberPtr == NULL) {
+        Ns_Log(Debug, "upstream %s: no member available", groupPtr->name);
+        if (hasKey) {
+            memberPtr = SelectHash(groupPtr, hash, &now, NS_FALSE);
+        } else if (groupPtr->policy == UPSTREAM_LEASTOUTSTANDING) {
+            memberPtr = SelectLeastOutstanding(groupPtr, &now, NS_FALSE);
+        } else {
+            memberPtr = SelectRoundRobin(groupPtr, &now, NS_FALSE);
+        }
+    }
+    assert(memberPtr != NULL);
+    if (acquire) {
+        memberPtr->outstanding++;
+        memberPtr->stats.requests++;
+    }
+    Ns_MutexUnlock(&groupPtr->lock);
+
+    return memberPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsUpstreamRelease --
+ *
+ *      Finish a request to a member acquired via NsUpstreamSelect() and
+ *      record its result for passive outlier detection. After
+ *      "maxfails" consecutive errors or timeouts, the member is ejected
+ *      for the configured eject time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Might eject the member.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsUpstreamRelease(NsUpstreamMember *memberPtr, NsUpstreamResult result)
+{
+    NsUpstreamGroup *groupPtr;
+
+    NS_NONNULL_ASSERT(memberPtr != NULL);
+
+    groupPtr = memberPtr->groupPtr;
+    Ns_MutexLock(&groupPtr->lock);
+    if (memberPtr->outstanding > 0u) {
+        memberPtr->outstanding--;
+    }
+    switch (result) {
+    case NS_UPSTREAM_OK:
+        memberPtr->failures = 0;
+        break;
+
+    case NS_UPSTREAM_ERROR:
+        NS_FALL_THROUGH; /* fall through */
+    case NS_UPSTREAM_TIMEOUT:
+        if (result == NS_UPSTREAM_TIMEOUT) {
+            memberPtr->stats.timeouts++;
+        } else {
+            memberPtr->stats.errors++;
+        }
+        memberPtr->failures++;
+        if (memberPtr->failures >= groupPtr->maxFails) {
+            Ns_GetTime(&memberPtr->ejectedUntil);
+            Ns_IncrTime(&memberPtr->ejectedUntil, groupPtr->ejectTime.sec, groupPtr->ejectTime.usec);
+            memberPtr->failures = 0;
+            memberPtr->stats.ejections++;
+            Ns_Log(Warning, "upstream %s: member %s ejected for " NS_TIME_FMT "s after %d failed requests",
+                   groupPtr->name, memberPtr->url,
+                   (int64_t)groupPtr->ejectTime.sec, groupPtr->ejectTime.usec, groupPtr->maxFails);
+        }
+        break;
+
+    case NS_UPSTREAM_IGNORE:
+        break;
+    }
+    Ns_MutexUnlock(&groupPtr->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MemberAvailable --
+ *
+ *      Check whether the member passed the health checks and is not
+ *      ejected. Must be called with the group lock held.
+ *
+ * Results:
+ *      Boolean.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+MemberAvailable(const NsUpstreamMember *memberPtr, const Ns_Time *nowPtr)
+{
+    return (memberPtr->healthy && Ns_DiffTime(nowPtr, &memberPtr->ejectedUntil, NULL) >= 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SelectRoundRobin, SelectLeastOutstanding, SelectHash --
+ *
+ *      Selection policies. When "checkAvailable" is true, only
+ *      available members are considered. Must be called with the group
+ *      lock held.
+ *
+ * Results:
+ *      Member or NULL, when no member is available.
+ *
+ * Side effects:
+ *      Round robin and least outstanding advance the round robin
+ *      position.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static NsUpstreamMember *
+SelectRoundRobin(NsUpstreamGroup *groupPtr, const Ns_Time *nowPtr, bool checkAvailable)
+{
+    size_t i;
+
+    for (i = 0u; i < groupPtr->nMembers; i++) {
+        NsUpstreamMember *memberPtr = &groupPtr->members[(groupPtr->next + i) % groupPtr->nMembers];
+
+        if (!checkAvailable || MemberAvailable(memberPtr, nowPtr)) {
+            groupPtr->next += i + 1u;
+            return memberPtr;
+        }
+    }
+    return NULL;
+}
+
+static NsUpstreamMember *
+SelectLeastOutstanding(NsUpstreamGroup *groupPtr, const Ns_Time *nowPtr, bool checkAvailable)
+{
+    NsUpstreamMember *bestPtr = NULL;
+    size_t            i;
+
+    /*
+     * Start at the round robin position, such that members with the
+     * same number of outstanding requests are used in turn.
+     */
+    for (i = 0u; i < groupPtr->nMembers; i++) {
+        NsUpstreamMember *memberPtr = &groupPtr->members[(groupPtr->next + i) % groupPtr->nMembers];
+
+        if ((!checkAvailable || MemberAvailable(memberPtr, nowPtr))
+            && (bestPtr == NULL || memberPtr->outstanding < bestPtr->outstanding)) {
+            bestPtr = memberPtr;
+        }
+    }
+    groupPtr->next++;
+    return bestPtr;
+}
+
+static NsUpstreamMember *
+SelectHash(const NsUpstreamGroup *groupPtr, uint32_t hash, const Ns_Time *nowPtr, bool checkAvailable)
+{
+    size_t lo = 0u, hi = groupPtr->nPoints, i;
+
+    /*
+     * Find the first point on the ring with a hash value >= the hash
+     * of the key, and walk the ring clockwise from there until an
+     * available member is found. When a member becomes unavailable,
+     * only its keys are moved.
+     */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+
+        if (groupPtr->ring[mid].hash < hash) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    for (i = 0u; i < groupPtr->nPoints; i++) {
+        NsUpstreamMember *memberPtr = groupPtr->ring[(lo + i) % groupPtr->nPoints].memberPtr;
+
+        if (!checkAvailable || MemberAvailable(memberPtr, nowPtr)) {
+            return memberPtr;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamHash --
+ *
+ *      32-bit FNV-1a hash with a final avalanche step, used for the
+ *      points of the hash ring and for the keys of requests.
+ *
+ * Results:
+ *      Hash value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32_t
+UpstreamHash(const char *string, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    size_t   i;
+
+    for (i = 0u; i < length; i++) {
+        hash ^= (uint32_t)(unsigned char)string[i];
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static int
+RingPointCompare(const void *arg1, const void *arg2)
+{
+    const RingPoint *p1 = arg1, *p2 = arg2;
+
+    return (p1->hash > p2->hash) - (p1->hash < p2->hash);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamProbe --
+ *
+ *      Perform a single health check of a member: connect within the
+ *      check timeout and, for plain HTTP members with a configured
+ *      check path, send a GET request and expect a 2xx or 3xx status
+ *      code. For HTTPS members, only the TCP connection is checked.
+ *
+ * Results:
+ *      NS_TRUE when the member is healthy.
+ *
+ * Side effects:
+ *      Network I/O, blocks up to the check timeout.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+UpstreamProbe(const NsUpstreamGroup *groupPtr, const NsUpstreamMember *memberPtr)
+{
+    NS_SOCKET     sock;
+    Ns_ReturnCode status = NS_OK;
+    bool          success = NS_FALSE;
+
+    sock = Ns_SockTimedConnect2(memberPtr->host, memberPtr->port, NULL, 0u,
+                                &groupPtr->checkTimeout, &status);
+    if (sock != NS_INVALID_SOCKET) {
+        if (memberPtr->https) {
+            success = NS_TRUE;
+
+        } else {
+            Tcl_DString ds;
+            char        buffer[UPSTREAM_CHECK_BUFSIZE];
+            ssize_t     n;
+            size_t      received = 0u;
+
+            Tcl_DStringInit(&ds);
+            Ns_DStringVarAppend(&ds, "GET ", groupPtr->checkPath, " HTTP/1.1\r\nHost: ", NS_SENTINEL);
+            (void) Ns_HttpLocationString(&ds, NULL, memberPtr->host, memberPtr->port, 80u);
+            Ns_DStringVarAppend(&ds, "\r\nUser-Agent: ", PACKAGE_NAME, "/", PACKAGE_VERSION,
+                                "\r\nConnection: close\r\n\r\n", NS_SENTINEL);
+
+            if (Ns_SockSend(sock, ds.string, (size_t)ds.length, &groupPtr->checkTimeout) == (ssize_t)ds.length) {
+                /*
+                 * Read until the status line "HTTP/1.x NNN" is complete.
+                 */
+                while (received < 12u) {
+                    n = Ns_SockRecv(sock, buffer + received, sizeof(buffer) - 1u - received,
+                                    &groupPtr->checkTimeout);
+                    if (n <= 0) {
+                        break;
+                    }
+                    received += (size_t)n;
+                }
+                if (received >= 12u && strncmp(buffer, "HTTP/1.", 7u) == 0) {
+                    success = (buffer[9] == '2' || buffer[9] == '3');
+                }
+            }
+            Tcl_DStringFree(&ds);
+        }
+        ns_sockclose(sock);
+    }
+    Ns_Log(Debug, "upstream %s: health check of %s: %s", groupPtr->name, memberPtr->url,
+           success ? "ok" : "failed");
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamCheck, UpstreamCheckProc --
+ *
+ *      Run the health checks for all members of a group. A member is
+ *      marked unhealthy after "maxfails" consecutive failed checks,
+ *      and healthy again after the first successful check. The probes
+ *      are performed without holding the group lock.
+ *      UpstreamCheckProc is the scheduled procedure.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the health state of the members.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UpstreamCheck(NsUpstreamGroup *groupPtr)
+{
+    size_t i;
+
+    for (i = 0u; i < groupPtr->nMembers; i++) {
+        NsUpstreamMember *memberPtr = &groupPtr->members[i];
+        bool              success = UpstreamProbe(groupPtr, memberPtr);
+
+        Ns_MutexLock(&groupPtr->lock);
+        memberPtr->stats.checks++;
+        if (success) {
+            if (!memberPtr->healthy) {
+                Ns_Log(Notice, "upstream %s: member %s is healthy", groupPtr->name, memberPtr->url);
+            }
+            memberPtr->healthy = NS_TRUE;
+            memberPtr->failedChecks = 0;
+        } else {
+            memberPtr->failedChecks++;
+            if (memberPtr->healthy && memberPtr->failedChecks >= groupPtr->maxFails) {
+                Ns_Log(Warning, "upstream %s: member %s is unhealthy after %d failed health checks",
+                       groupPtr->name, memberPtr->url, memberPtr->failedChecks);
+                memberPtr->healthy = NS_FALSE;
+            }
+        }
+        Ns_MutexUnlock(&groupPtr->lock);
+    }
+}
+
+static void
+UpstreamCheckProc(void *arg, int UNUSED(id))
+{
+    UpstreamCheck((NsUpstreamGroup *)arg);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamCreateObjCmd --
+ *
+ *      Implements "ns_upstream create". Creates a named upstream group
+ *      from a list of member URLs and schedules the health checks,
+ *      when a check path is provided.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Creates a group.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpstreamCreateObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    char              *name = NULL, *hashKey = NULL, *checkPath = NULL;
+    int                result = TCL_OK, policy = (int)UPSTREAM_ROUNDROBIN, maxFails = 3;
+    Tcl_Obj           *membersObj = NULL;
+    Ns_Time            checkInterval = {10, 0}, checkTimeout = {2, 0}, ejectTime = {30, 0},
+                      *checkIntervalPtr = &checkInterval, *checkTimeoutPtr = &checkTimeout,
+                      *ejectTimePtr = &ejectTime;
+    Ns_ObjvValueRange  failRange = {1, INT_MAX};
+    Ns_ObjvSpec        opts[] = {
+        {"-checktimeout", Ns_ObjvTime,   &checkTimeoutPtr,  NULL},
+        {"-ejecttime",    Ns_ObjvTime,   &ejectTimePtr,     NULL},
+        {"-hashkey",      Ns_ObjvString, &hashKey,          NULL},
+        {"-healthcheck",  Ns_ObjvString, &checkPath,        NULL},
+        {"-interval",     Ns_ObjvTime,   &checkIntervalPtr, NULL},
+        {"-maxfails",     Ns_ObjvInt,    &maxFails,         &failRange},
+        {"-policy",       Ns_ObjvIndex,  &policy,           policyTable},
+        {"--",            Ns_ObjvBreak,  NULL,              NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec        args[] = {
+        {"name",    Ns_ObjvString, &name,       NULL},
+        {"members", Ns_ObjvObj,    &membersObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        TCL_SIZE_T       nMembers = 0, i;
+        Tcl_Obj        **memberObjv;
+        NsUpstreamGroup *groupPtr;
+        Tcl_HashEntry   *hPtr;
+        int              isNew;
+
+        if (Tcl_ListObjGetElements(interp, membersObj, &nMembers, &memberObjv) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        if (nMembers == 0) {
+            Ns_TclPrintfResult(interp, "upstream group \"%s\" requires at least one member", name);
+            return TCL_ERROR;
+        }
+        if ((policy == (int)UPSTREAM_HASH) != (hashKey != NULL)) {
+            Ns_TclPrintfResult(interp, "option -hashkey is required for and only allowed with policy hash");
+            return TCL_ERROR;
+        }
+        if (hashKey != NULL && strncmp(hashKey, "header:", 7u) != 0 && strncmp(hashKey, "cookie:", 7u) != 0) {
+            Ns_TclPrintfResult(interp, "invalid hash key \"%s\": must be header:/name/ or cookie:/name/", hashKey);
+            return TCL_ERROR;
+        }
+        if (checkPath != NULL && *checkPath != '/') {
+            Ns_TclPrintfResult(interp, "invalid health check path \"%s\": must start with /", checkPath);
+            return TCL_ERROR;
+        }
+
+        groupPtr = ns_calloc(1u, sizeof(NsUpstreamGroup));
+        groupPtr->name = ns_strdup(name);
+        groupPtr->policy = (UpstreamPolicy)policy;
+        groupPtr->checkPath = ns_strcopy(checkPath);
+        groupPtr->checkInterval = *checkIntervalPtr;
+        groupPtr->checkTimeout = *checkTimeoutPtr;
+        groupPtr->ejectTime = *ejectTimePtr;
+        groupPtr->maxFails = maxFails;
+        groupPtr->schedId = -1;
+        if (hashKey != NULL) {
+            if (*hashKey == 'h') {
+                groupPtr->hashHeader = ns_strdup(hashKey + 7);
+            } else {
+                groupPtr->hashCookie = ns_strdup(hashKey + 7);
+            }
+        }
+        groupPtr->nMembers = (size_t)nMembers;
+        groupPtr->members = ns_calloc((size_t)nMembers, sizeof(NsUpstreamMember));
+
+        for (i = 0; i < nMembers && result == TCL_OK; i++) {
+            NsUpstreamMember *memberPtr = &groupPtr->members[i];
+            const char       *url = Tcl_GetString(memberObjv[i]), *errorMsg = NULL;
+            char             *urlCopy = ns_strdup(url);
+            Ns_URL            u;
+
+            if (Ns_ParseUrl(urlCopy, NS_FALSE, &u, &errorMsg) != NS_OK
+                || u.protocol == NULL || u.host == NULL) {
+                Ns_TclPrintfResult(interp, "invalid member \"%s\": %s", url,
+                                   errorMsg != NULL ? errorMsg : "protocol and host required");
+                result = TCL_ERROR;
+
+            } else if (!STREQ(u.protocol, "http") && !STREQ(u.protocol, "https")) {
+                Ns_TclPrintfResult(interp, "invalid member \"%s\": invalid scheme", url);
+                result = TCL_ERROR;
+
+            } else {
+                Tcl_DString    ds;
+                unsigned short defPort;
+
+                memberPtr->groupPtr = groupPtr;
+                memberPtr->https = (u.protocol[4] == 's');
+                defPort = memberPtr->https ? 443u : 80u;
+                memberPtr->port = (u.port != NULL) ? (unsigned short)strtol(u.port, NULL, 10) : defPort;
+                memberPtr->host = ns_strdup(u.host);
+                memberPtr->healthy = NS_TRUE;
+
+                Tcl_DStringInit(&ds);
+                (void) Ns_HttpLocationString(&ds, u.protocol, u.host, memberPtr->port, defPort);
+                memberPtr->url = Ns_DStringExport(&ds);
+            }
+            ns_free(urlCopy);
+        }
+
+        if (result == TCL_OK) {
+            size_t m, p;
+
+            groupPtr->nPoints = groupPtr->nMembers * UPSTREAM_RING_POINTS;
+            groupPtr->ring = ns_malloc(groupPtr->nPoints * sizeof(RingPoint));
+            for (m = 0u; m < groupPtr->nMembers; m++) {
+                for (p = 0u; p < UPSTREAM_RING_POINTS; p++) {
+                    char   key[256];
+                    int    keyLength;
+                    RingPoint *pointPtr = &groupPtr->ring[m * UPSTREAM_RING_POINTS + p];
+
+                    keyLength = snprintf(key, sizeof(key), "%s#%" PRIuz, groupPtr->members[m].url, p);
+                    pointPtr->hash = UpstreamHash(key, (size_t)keyLength);
+                    pointPtr->memberPtr = &groupPtr->members[m];
+                }
+            }
+            qsort(groupPtr->ring, groupPtr->nPoints, sizeof(RingPoint), RingPointCompare);
+            Ns_MutexInit(&groupPtr->lock);
+            Ns_MutexSetName2(&groupPtr->lock, "ns:upstream", name);
+
+            Ns_MutexLock(&lock);
+            hPtr = Tcl_CreateHashEntry(&groups, name, &isNew);
+            if (isNew != 0) {
+                Tcl_SetHashValue(hPtr, groupPtr);
+            }
+            Ns_MutexUnlock(&lock);
+
+            if (isNew == 0) {
+                Ns_TclPrintfResult(interp, "upstream group \"%s\" exists already", name);
+                Ns_MutexDestroy(&groupPtr->lock);
+                result = TCL_ERROR;
+            }
+        }
+
+        if (result == TCL_OK) {
+            if (groupPtr->checkPath != NULL) {
+                groupPtr->schedId = Ns_ScheduleProcEx(UpstreamCheckProc, groupPtr, NS_SCHED_THREAD,
+                                                      &groupPtr->checkInterval, NULL);
+            }
+            Tcl_SetObjResult(interp, Tcl_NewStringObj(name, TCL_INDEX_NONE));
+
+        } else {
+            for (i = 0; i < nMembers; i++) {
+                ns_free(groupPtr->members[i].url);
+                ns_free(groupPtr->members[i].host);
+            }
+            ns_free(groupPtr->members);
+            ns_free(groupPtr->ring);
+            ns_free(groupPtr->hashHeader);
+            ns_free(groupPtr->hashCookie);
+            ns_free(groupPtr->checkPath);
+            ns_free(groupPtr->name);
+            ns_free(groupPtr);
+        }
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamSelectObjCmd --
+ *
+ *      Implements "ns_upstream select". Returns the URL of the member
+ *      which would be used for a request with the provided header
+ *      fields. The selection is not counted as outstanding request.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Advances the round robin position.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpstreamSelectObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    char        *name = NULL;
+    Ns_Set      *headers = NULL;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  opts[] = {
+        {"-headers", Ns_ObjvSet,   &headers, NULL},
+        {"--",       Ns_ObjvBreak, NULL,     NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec  args[] = {
+        {"name", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsUpstreamGroup *groupPtr = NsUpstreamGroupGet(interp, name);
+
+        if (groupPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            const NsUpstreamMember *memberPtr = NsUpstreamSelect(groupPtr, headers, NS_FALSE);
+
+            Tcl_SetObjResult(interp, Tcl_NewStringObj(memberPtr->url, TCL_INDEX_NONE));
+        }
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamCheckObjCmd --
+ *
+ *      Implements "ns_upstream check". Runs the health checks of the
+ *      group immediately in the current thread.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Updates the health state of the members.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpstreamCheckObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    char        *name = NULL;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"name", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsUpstreamGroup *groupPtr = NsUpstreamGroupGet(interp, name);
+
+        if (groupPtr == NULL) {
+            result = TCL_ERROR;
+        } else if (groupPtr->checkPath == NULL) {
+            Ns_TclPrintfResult(interp, "upstream group \"%s\" has no health check", name);
+            result = TCL_ERROR;
+        } else {
+            UpstreamCheck(groupPtr);
+        }
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamStatsObjCmd --
+ *
+ *      Implements "ns_upstream stats". Returns a dict with the state
+ *      and the statistics of the members of the group, keyed by the
+ *      URL of the member.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpstreamStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    char        *name = NULL;
+    int          result = TCL_OK;
+    Ns_ObjvSpec  args[] = {
+        {"name", Ns_ObjvString, &name, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsUpstreamGroup *groupPtr = NsUpstreamGroupGet(interp, name);
+
+        if (groupPtr == NULL) {
+            result = TCL_ERROR;
+        } else {
+            Tcl_Obj *resultObj = Tcl_NewDictObj();
+            Ns_Time  now;
+            size_t   i;
+
+            Ns_GetTime(&now);
+            Ns_MutexLock(&groupPtr->lock);
+            for (i = 0u; i < groupPtr->nMembers; i++) {
+                const NsUpstreamMember *memberPtr = &groupPtr->members[i];
+                Tcl_Obj                *dictObj = Tcl_NewDictObj();
+
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("healthy", 7),
+                                      Tcl_NewBooleanObj(memberPtr->healthy));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("ejected", 7),
+                                      Tcl_NewBooleanObj(Ns_DiffTime(&now, &memberPtr->ejectedUntil, NULL) < 0));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("outstanding", 11),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->outstanding));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("requests", 8),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->stats.requests));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("errors", 6),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->stats.errors));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("timeouts", 8),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->stats.timeouts));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("ejections", 9),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->stats.ejections));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("checks", 6),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)memberPtr->stats.checks));
+                (void) Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj(memberPtr->url, TCL_INDEX_NONE), dictObj);
+            }
+            Ns_MutexUnlock(&groupPtr->lock);
+            Tcl_SetObjResult(interp, resultObj);
+        }
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpstreamListObjCmd --
+ *
+ *      Implements "ns_upstream list". Returns the names of the upstream
+ *      groups.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpstreamListObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    int result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+        Tcl_Obj             *listObj = Tcl_NewListObj(0, NULL);
+
+        Ns_MutexLock(&lock);
+        for (hPtr = Tcl_FirstHashEntry(&groups, &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+            Tcl_ListObjAppendElement(interp, listObj,
+                                     Tcl_NewStringObj(Tcl_GetHashKey(&groups, hPtr), TCL_INDEX_NONE));
+        }
+        Ns_MutexUnlock(&lock);
+        Tcl_SetObjResult(interp, listObj);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclUpstreamObjCmd --
+ *
+ *      Implements "ns_upstream".
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects:
+ *      Depends on subcommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclUpstreamObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"check",  UpstreamCheckObjCmd},
+        {"create", UpstreamCreateObjCmd},
+        {"list",   UpstreamListObjCmd},
+        {"select", UpstreamSelectObjCmd},
+        {"stats",  UpstreamStatsObjCmd},
+        {NULL, NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * indent-tabs-mode: nil
+ * End:
+ */
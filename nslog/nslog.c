@@ -11,7 +11,8 @@
 /*
  * nslog.c --
  *
- *    Implements access logging in the NCSA Common Log format.
+ *    Implements access logging in the NCSA Common Log format or as
+ *    newline-delimited JSON, optionally accompanied by a binary time index.
  *
  */
 
@@ -33,6 +34,51 @@
 # define PIPE_BUF 512
 #endif
 
+/*
+ * Size of a record in the time index file: 64-bit epoch seconds followed by
+ * the 64-bit offset of the first log entry written at or after that time,
+ * both in little-endian byte order.
+ */
+#define LOG_INDEX_RECORD_SIZE 16
+
+typedef enum {
+    LOG_FORMAT_CLF,
+    LOG_FORMAT_JSON
+} LogFormat;
+
+static Ns_ObjvTable logFormats[] = {
+    {"clf",  LOG_FORMAT_CLF},
+    {"json", LOG_FORMAT_JSON},
+    {NULL,   0u}
+};
+
+/*
+ * Per-URL log policies, registered in the URL space of the server.
+ */
+typedef enum {
+    LOG_POLICY_ALL,
+    LOG_POLICY_NONE,
+    LOG_POLICY_ERRORS,
+    LOG_POLICY_SAMPLE,
+    LOG_POLICY_SLOW
+} LogPolicyType;
+
+static Ns_ObjvTable logPolicies[] = {
+    {"all",    LOG_POLICY_ALL},
+    {"none",   LOG_POLICY_NONE},
+    {"errors", LOG_POLICY_ERRORS},
+    {"sample", LOG_POLICY_SAMPLE},
+    {"slow",   LOG_POLICY_SLOW},
+    {NULL,     0u}
+};
+
+typedef struct LogPolicy {
+    LogPolicyType type;
+    unsigned long rate;       /* LOG_POLICY_SAMPLE: log 1 in rate requests */
+    unsigned long counter;    /* LOG_POLICY_SAMPLE: requests seen so far */
+    Ns_Time       threshold;  /* LOG_POLICY_SLOW: minimum request time */
+} LogPolicy;
+
 NS_EXTERN const int Ns_ModuleVersion;
 NS_EXPORT const int Ns_ModuleVersion = 1;
 static const char *logType = "ACCESSLOG";
@@ -62,6 +108,14 @@ typedef struct {
 #endif
     Tcl_DString   buffer;
     bool serverRootProcEnabled;
+    LogFormat     format;
+    int           indexFd;
+    const char   *indexFilename;
+    time_t        indexInterval;
+    time_t        nextIndexTime;
+    Ns_Server    *servPtr;
+    int           policyId;
+    bool          hasPolicies;
 } Log;
 
 /*
@@ -79,6 +133,15 @@ static Ns_ReturnCode LogFlush(Log *logPtr, Tcl_DString *dsPtr);
 static Ns_LogCallbackProc LogOpen;
 static Ns_LogCallbackProc LogClose;
 static Ns_LogCallbackProc LogRoll;
+static Ns_LogCallbackProc LogRollClose;
+static void LogIndexAppend(Log *logPtr, time_t now) NS_GNUC_NONNULL(1);
+static int LogPolicySet(Tcl_Interp *interp, Log *logPtr, const char *method, const char *url,
+                        LogPolicyType type, Tcl_Obj *valueObj, unsigned int flags)
+    NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+static void LogPolicyMap(Log *logPtr, const char *section, const char *policyString, unsigned int flags)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+static bool LogPolicyCheck(Log *logPtr, Ns_Conn *conn, unsigned long *weightPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
 
 NS_EXPORT Ns_ModuleInitProc Ns_ModuleInit;
 NS_EXPORT Ns_ModuleInfoProc Ns_ModuleGetInfo;
@@ -102,6 +165,17 @@ static Ns_ReturnCode ParseExtendedHeaders(Log *logPtr, const char *str)
 static void
 AppendExtHeaders(Tcl_DString *dsPtr, const char **argv, const Ns_Set *set)
     NS_GNUC_NONNULL(1);
+static void
+AppendJsonHeaders(Tcl_DString *dsPtr, const char *key, const char **argv, const Ns_Set *set)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static void
+AppendClfEntry(const Log *logPtr, Ns_Conn *conn, Tcl_DString *dsPtr, const char *peer,
+               unsigned long weight)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+static void
+AppendJsonEntry(const Log *logPtr, Ns_Conn *conn, Tcl_DString *dsPtr, const char *peer,
+                unsigned long weight)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
 
 
 /*
@@ -161,6 +235,9 @@ Ns_ModuleInit(const char *server, const char *module)
     logPtr->module = module;
     logPtr->server = server;
     logPtr->fd = NS_INVALID_FD;
+    logPtr->indexFd = NS_INVALID_FD;
+    logPtr->servPtr = Ns_GetServer(server);
+    logPtr->policyId = Ns_UrlSpecificAlloc();
     logPtr->serverRootProcEnabled = Ns_ServerRootProcEnabled(server);
     Ns_MutexInit(&logPtr->lock);
     Ns_MutexSetName2(&logPtr->lock, "nslog", server);
@@ -236,6 +313,33 @@ Ns_ModuleInit(const char *server, const char *module)
     }
 #endif
     logPtr->driverPattern = ns_strcopy(Ns_NullIfEmpty(Ns_ConfigString(section, "driver", "")));
+    logPtr->format = Ns_ConfigGetEnum(section, "format", logFormats, LOG_FORMAT_CLF);
+
+    /*
+     * The time index is written next to the log file ("access.log.idx") and
+     * is rolled together with it. It is not available when the log files are
+     * managed per server root.
+     */
+    {
+        Ns_Time interval;
+
+        Ns_ConfigTimeUnitRange(section, "indexinterval",
+                               "0s", 0, 0, INT_MAX, 0,
+                               &interval);
+        logPtr->indexInterval = interval.sec;
+        if (logPtr->indexInterval > 0) {
+            if (logPtr->serverRootProcEnabled) {
+                Ns_Log(Warning, "nslog: parameter 'indexinterval' is ignored"
+                       " when serverrootproc is enabled");
+                logPtr->indexInterval = 0;
+            } else {
+                Tcl_DStringSetLength(&ds, 0);
+                Tcl_DStringAppend(&ds, logPtr->filename, TCL_INDEX_NONE);
+                Tcl_DStringAppend(&ds, ".idx", 4);
+                logPtr->indexFilename = ns_strdup(ds.string);
+            }
+        }
+    }
 
     logPtr->ipv4maskPtr = NULL;
 #ifdef HAVE_IPV6
@@ -282,6 +386,25 @@ Ns_ModuleInit(const char *server, const char *module)
         Ns_RegisterAtSignal((Ns_Callback *)(ns_funcptr_t)LogRollCallback, logPtr);
     }
 
+    /*
+     * Register the per-URL log policies, provided as "policy" or
+     * "policy-noinherit" entries in the form "METHOD URL POLICY ?VALUE?".
+     */
+    {
+        const Ns_Set *set = Ns_ConfigGetSection(section);
+        size_t        i;
+
+        for (i = 0u; set != NULL && i < Ns_SetSize(set); ++i) {
+            const char *key = Ns_SetKey(set, i);
+
+            if (STREQ(key, "policy")) {
+                LogPolicyMap(logPtr, section, Ns_SetValue(set, i), 0u);
+            } else if (STREQ(key, "policy-noinherit")) {
+                LogPolicyMap(logPtr, section, Ns_SetValue(set, i), NS_OP_NOINHERIT);
+            }
+        }
+    }
+
     /*
      * Parse extended headers; it is just a list of names
      */
@@ -460,11 +583,11 @@ LogObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
 
     enum {
         ROLLFMT, MAXBACKUP, MAXBUFFER, EXTHDRS,
-        FLAGS, FILE, ROLL
+        FLAGS, FILE, ROLL, FORMAT, POLICY
     };
     static const char *const subcmd[] = {
         "rollfmt", "maxbackup", "maxbuffer", "extendedheaders",
-        "flags", "file", "roll", NULL
+        "flags", "file", "roll", "format", "policy", NULL
     };
 
     if (objc < 2) {
@@ -677,6 +800,13 @@ LogObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
                 ns_free_const(logPtr->filename);
                 logPtr->filename = ns_strdup(strarg);
                 Tcl_DStringFree(&ds);
+                if (logPtr->indexFilename != NULL) {
+                    Tcl_DStringAppend(&ds, logPtr->filename, TCL_INDEX_NONE);
+                    Tcl_DStringAppend(&ds, ".idx", 4);
+                    ns_free_const(logPtr->indexFilename);
+                    logPtr->indexFilename = ns_strdup(ds.string);
+                    Tcl_DStringFree(&ds);
+                }
                 LogOpen(logPtr);
             }
 
@@ -729,6 +859,82 @@ LogObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
         }
         break;
     }
+
+    case FORMAT: {
+        int         format = -1;
+        Ns_ObjvSpec largs[] = {
+            {"?format", Ns_ObjvIndex, &format, logFormats},
+            {NULL, NULL, NULL, NULL}
+        };
+
+        if (Ns_ParseObjv(NULL, largs, interp, 2, objc, objv) != NS_OK) {
+            result = TCL_ERROR;
+
+        } else {
+            Ns_MutexLock(&logPtr->lock);
+            if (format != -1) {
+                logPtr->format = (LogFormat)format;
+            } else {
+                format = (int)logPtr->format;
+            }
+            Ns_MutexUnlock(&logPtr->lock);
+            Tcl_SetObjResult(interp, Tcl_NewStringObj(Ns_ObjvTableGetString(logFormats, (unsigned int)format),
+                                                      TCL_INDEX_NONE));
+        }
+        break;
+    }
+
+    case POLICY: {
+        int         noinherit = 0, type = -1;
+        char       *method, *url;
+        Tcl_Obj    *valueObj = NULL;
+        Ns_ObjvSpec lopts[] = {
+            {"-noinherit", Ns_ObjvBool,  &noinherit, INT2PTR(NS_TRUE)},
+            {"--",         Ns_ObjvBreak, NULL,       NULL},
+            {NULL, NULL, NULL, NULL}
+        };
+        Ns_ObjvSpec largs[] = {
+            {"method",  Ns_ObjvString, &method,   NULL},
+            {"url",     Ns_ObjvString, &url,      NULL},
+            {"?policy", Ns_ObjvIndex,  &type,     logPolicies},
+            {"?value",  Ns_ObjvObj,    &valueObj, NULL},
+            {NULL, NULL, NULL, NULL}
+        };
+
+        if (Ns_ParseObjv(lopts, largs, interp, 2, objc, objv) != NS_OK) {
+            result = TCL_ERROR;
+
+        } else {
+            unsigned int flags = (noinherit != 0) ? NS_OP_NOINHERIT : 0u;
+
+            Ns_MutexLock(&logPtr->lock);
+            if (type != -1) {
+                result = LogPolicySet(interp, logPtr, method, url, (LogPolicyType)type, valueObj, flags);
+            }
+            if (result == TCL_OK) {
+                const LogPolicy *policyPtr = NULL;
+
+                if (logPtr->hasPolicies) {
+                    policyPtr = Ns_UrlSpecificGet(logPtr->servPtr, method, url,
+                                                  logPtr->policyId, flags,
+                                                  NS_URLSPACE_DEFAULT, NULL, NULL, NULL);
+                }
+                Tcl_DStringInit(&ds);
+                Tcl_DStringAppendElement(&ds, Ns_ObjvTableGetString(logPolicies, policyPtr != NULL
+                                                                    ? (unsigned int)policyPtr->type
+                                                                    : (unsigned int)LOG_POLICY_ALL));
+                if (policyPtr != NULL && policyPtr->type == LOG_POLICY_SAMPLE) {
+                    Ns_DStringPrintf(&ds, " %lu", policyPtr->rate);
+                } else if (policyPtr != NULL && policyPtr->type == LOG_POLICY_SLOW) {
+                    Tcl_DStringAppend(&ds, " ", 1);
+                    Ns_DStringAppendTime(&ds, &policyPtr->threshold);
+                }
+                Tcl_DStringResult(interp, &ds);
+            }
+            Ns_MutexUnlock(&logPtr->lock);
+        }
+        break;
+    }
     }
     return result;
 }
@@ -775,116 +981,29 @@ AppendExtHeaders(Tcl_DString *dsPtr, const char **argv, const Ns_Set *set)
 /*
  *----------------------------------------------------------------------
  *
- * LogTrace --
+ * AppendClfEntry --
  *
- *      Trace routine for appending the access.log with the current
- *      connection results.
+ *      Append an access log entry in NCSA Common Log format (or combined
+ *      format, depending on the flags) followed by the optional timing
+ *      information and extended header fields.
  *
  * Results:
- *      None.
+ *      None
  *
  * Side effects:
- *      Entry is appended to the open log.
+ *      Append to Tcl_DString
  *
  *----------------------------------------------------------------------
  */
 
 static void
-LogTrace(void *arg, Ns_Conn *conn)
+AppendClfEntry(const Log *logPtr, Ns_Conn *conn, Tcl_DString *dsPtr, const char *peer,
+               unsigned long weight)
 {
-    Log          *logPtr = arg;
-    const char   *user, *p, *driverName;
-    char          buffer[PIPE_BUF], *bufferPtr = NULL;
-    int           n, fd;
-    Ns_ReturnCode status;
-    size_t        bufferSize = 0u;
-    Tcl_DString   ds, *dsPtr = &ds;
-    char          ipString[NS_IPADDR_SIZE];
-    const char   *server;
-    struct NS_SOCKADDR_STORAGE  ipStruct, maskedStruct;
-    struct sockaddr            *maskPtr = NULL,
-        *ipPtr     = (struct sockaddr *)&ipStruct,
-        *maskedPtr = (struct sockaddr *)&maskedStruct;
-
-    driverName = Ns_ConnDriverName(conn);
-    Ns_Log(Debug, "nslog called with driver pattern '%s' via driver '%s' req: %s",
-           logPtr->driverPattern, driverName, conn->request.line);
-
-    if (logPtr->driverPattern != NULL
-        && Tcl_StringMatch(driverName, logPtr->driverPattern) == 0
-        ) {
-        /*
-         * This is not for us.
-         */
-        return;
-    }
-    server = Ns_ConnServer(conn);
-
-    Tcl_DStringInit(dsPtr);
-
-    if (logPtr->serverRootProcEnabled) {
-        const char *section = Ns_ConfigSectionPath(NULL, server, logPtr->module, NS_SENTINEL);
-        const char *filename = Ns_ConfigString(section, "file", "access.log"), *fullFilename;
-
-        fullFilename = Ns_LogPath(dsPtr, server, filename);
-        fprintf(stderr, "LogTrace: server %s filename '%s' -> fullFilename '%s'\n", server, filename, fullFilename);
-        fd = Ns_ServerLogGetFd(server, logType, fullFilename);
-        Tcl_DStringSetLength(dsPtr, 0);
-    } else {
-        fd = logPtr->fd;
-    }
-
-    Ns_MutexLock(&logPtr->lock);
-
-    /*
-     * Append the peer address.
-     */
-#ifdef NS_WITH_DEPRECATED
-    if ((logPtr->flags & LOG_CHECKFORPROXY) != 0u) {
-        /*
-         * This branch is deprecated and kept only for backward
-         * compatibility (added Dec 2020).
-         */
-        p = Ns_ConnForwardedPeerAddr(conn);
-        if (*p == '\0') {
-            p = Ns_ConnPeerAddr(conn);
-        }
-    } else
-#endif
-    {
-        p = Ns_ConnConfiguredPeerAddr(conn);
-    }
-
-    /*
-     * Check if the actual IP address can be converted to internal format (this
-     * should be always possible).
-     */
-    if ((logPtr->flags |= LOG_MASKIP)
-        && (ns_inet_pton(ipPtr, p) == 1)
-        ) {
-
-        /*
-         * Depending on the class of the IP address, use the appropriate mask.
-         */
-        if (ipPtr->sa_family == AF_INET) {
-            maskPtr = logPtr->ipv4maskPtr;
-        }
-#ifdef HAVE_IPV6
-        if (ipPtr->sa_family == AF_INET6) {
-            maskPtr = logPtr->ipv6maskPtr;
-        }
-#endif
-        /*
-         * If the mask is non-null, the IP "anonymizing" was configured.
-         */
-        if (maskPtr != NULL) {
-            Ns_SockaddrMask(ipPtr, maskPtr, maskedPtr);
-            ns_inet_ntop(maskedPtr, ipString, NS_IPADDR_SIZE);
-            p = ipString;
-        }
-    }
+    const char *user, *p;
+    int         n;
 
-    Tcl_DStringAppend(dsPtr, p, TCL_INDEX_NONE);
+    Tcl_DStringAppend(dsPtr, peer, TCL_INDEX_NONE);
 
     /*
      * Append the thread name, if requested.
@@ -1019,90 +1138,601 @@ LogTrace(void *arg, Ns_Conn *conn)
     AppendExtHeaders(dsPtr, logPtr->requestHeaders, conn->headers);
     AppendExtHeaders(dsPtr, logPtr->responseHeaders, conn->outputheaders);
 
-    {
-        TCL_SIZE_T l;
-        for (l = 0; l < dsPtr->length; l++) {
-            /*
-             * Quick fix to disallow terminal escape characters in the log
-             * file. See e.g. http://www.securityfocus.com/bid/37712/info
-             */
-            if (unlikely(dsPtr->string[l] == 0x1b)) {
-                dsPtr->string[l] = 7; /* bell */
-            }
-        }
+    /*
+     * Append the sample weight for sampled entries.
+     */
+    if (weight > 1u) {
+        Ns_DStringPrintf(dsPtr, " weight=%lu", weight);
     }
+}
 
-    Ns_Log(Ns_LogAccessDebug, "%s", dsPtr->string);
 
-    /*
-     * Append the trailing newline and optionally
-     * flush the buffer
-     */
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendJsonHeaders --
+ *
+ *      Append named extended header fields from provided set as a JSON
+ *      object member named "key". Missing header fields are reported as
+ *      null.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Append to Tcl_DString
+ *
+ *----------------------------------------------------------------------
+ */
 
-    Tcl_DStringAppend(dsPtr, "\n", 1);
+static void
+AppendJsonHeaders(Tcl_DString *dsPtr, const char *key, const char **argv, const Ns_Set *set)
+{
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
 
-    if (logPtr->maxlines == 0) {
-        bufferSize = (size_t)dsPtr->length;
-        if (bufferSize < PIPE_BUF) {
-          /*
-           * Only ns_write() operations < PIPE_BUF are guaranteed to be atomic
-           */
-            bufferPtr = dsPtr->string;
-            status = NS_OK;
-        } else {
-            status = LogFlush(logPtr, dsPtr);
-        }
-    } else {
-        Tcl_DStringAppend(&logPtr->buffer, dsPtr->string, dsPtr->length);
-        if (++logPtr->curlines > logPtr->maxlines) {
-            bufferSize = (size_t)logPtr->buffer.length;
-            if (bufferSize < PIPE_BUF) {
-                /*
-                 * Only ns_write() operations < PIPE_BUF are guaranteed to be
-                 * atomic.  In most cases, the other branch is used.
-                 */
-              memcpy(buffer, logPtr->buffer.string, bufferSize);
-              bufferPtr = buffer;
-              Tcl_DStringSetLength(&logPtr->buffer, 0);
-              status = NS_OK;
+    if (argv != NULL && *argv != NULL) {
+        const char **h;
+
+        Ns_DStringPrintf(dsPtr, ",\"%s\":{", key);
+        for (h = argv; *h != NULL; h++) {
+            const char *p = (set != NULL) ? Ns_SetIGet(set, *h) : NULL;
+
+            if (h != argv) {
+                Tcl_DStringAppend(dsPtr, ",", 1);
+            }
+            Ns_JsonAppendString(dsPtr, *h, TCL_INDEX_NONE);
+            Tcl_DStringAppend(dsPtr, ":", 1);
+            if (p != NULL) {
+                Ns_JsonAppendString(dsPtr, p, TCL_INDEX_NONE);
             } else {
-              status = LogFlush(logPtr, &logPtr->buffer);
+                Tcl_DStringAppend(dsPtr, "null", 4);
             }
-            logPtr->curlines = 0;
-        } else {
-            status = NS_OK;
         }
+        Tcl_DStringAppend(dsPtr, "}", 1);
     }
-    Ns_MutexUnlock(&logPtr->lock);
-    (void)(status); /* ignore status */
-
-    if (likely(bufferPtr != NULL) && likely(fd >= 0) && likely(bufferSize > 0)) {
-        (void)NsAsyncWrite(fd, bufferPtr, bufferSize);
-    }
-
-    Tcl_DStringFree(dsPtr);
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * LogOpen --
+ * AppendJsonEntry --
  *
- *      Open the access log, closing previous log if opened.
- *      Assume caller is holding the log mutex.
+ *      Append an access log entry as a single-line JSON object. The
+ *      members correspond to the fields of the CLF entry; optional
+ *      members are included based on the same flags. Timestamps and
+ *      durations are numbers in seconds, such that the entries can be
+ *      processed without re-parsing formatted text.
  *
  * Results:
- *      NS_OK or NS_ERROR.
+ *      None
  *
  * Side effects:
- *      Log re-opened.
+ *      Append to Tcl_DString
  *
  *----------------------------------------------------------------------
  */
 
-static Ns_ReturnCode
-LogOpen(void *arg)
+static void
+AppendJsonEntry(const Log *logPtr, Ns_Conn *conn, Tcl_DString *dsPtr, const char *peer,
+                unsigned long weight)
+{
+    const char *user, *p;
+    Ns_Time     now;
+    int         n;
+
+    Ns_GetTime(&now);
+
+    Tcl_DStringAppend(dsPtr, "{\"time\":", 8);
+    Ns_DStringAppendTime(dsPtr, &now);
+    Tcl_DStringAppend(dsPtr, ",\"peer\":", 8);
+    Ns_JsonAppendString(dsPtr, peer, TCL_INDEX_NONE);
+
+    if ((logPtr->flags & LOG_THREADNAME) != 0) {
+        Tcl_DStringAppend(dsPtr, ",\"thread\":", 10);
+        Ns_JsonAppendString(dsPtr, Ns_ThreadGetName(), TCL_INDEX_NONE);
+    }
+
+    Tcl_DStringAppend(dsPtr, ",\"user\":", 8);
+    user = Ns_ConnAuthUser(conn);
+    if (user == NULL) {
+        Tcl_DStringAppend(dsPtr, "null", 4);
+    } else {
+        Ns_JsonAppendString(dsPtr, user, TCL_INDEX_NONE);
+    }
+
+    if (likely(conn->request.line != NULL)) {
+        const char *string = (logPtr->flags & LOG_SUPPRESSQUERY) ?
+            conn->request.url :
+            conn->request.line;
+
+        Tcl_DStringAppend(dsPtr, ",\"request\":", 11);
+        Ns_JsonAppendString(dsPtr, string != NULL ? string : "", TCL_INDEX_NONE);
+        if (conn->request.method != NULL) {
+            Tcl_DStringAppend(dsPtr, ",\"method\":", 10);
+            Ns_JsonAppendString(dsPtr, conn->request.method, TCL_INDEX_NONE);
+        }
+        if (conn->request.url != NULL) {
+            Tcl_DStringAppend(dsPtr, ",\"url\":", 7);
+            Ns_JsonAppendString(dsPtr, conn->request.url, TCL_INDEX_NONE);
+        }
+    } else {
+        Tcl_DStringAppend(dsPtr, ",\"request\":\"\"", 13);
+    }
+
+    n = Ns_ConnResponseStatus(conn);
+    Ns_DStringPrintf(dsPtr, ",\"status\":%d,\"bytes\":%" PRIdz,
+                     (n != 0) ? n : 200, Ns_ConnContentSent(conn));
+
+    if ((logPtr->flags & LOG_COMBINED)) {
+        p = Ns_SetIGet(conn->headers, "referer");
+        Tcl_DStringAppend(dsPtr, ",\"referer\":", 11);
+        Ns_JsonAppendString(dsPtr, p != NULL ? p : "", TCL_INDEX_NONE);
+        p = Ns_SetIGet(conn->headers, "user-agent");
+        Tcl_DStringAppend(dsPtr, ",\"useragent\":", 13);
+        Ns_JsonAppendString(dsPtr, p != NULL ? p : "", TCL_INDEX_NONE);
+    }
+
+    if ((logPtr->flags & LOG_REQTIME) != 0u) {
+        Ns_Time reqTime;
+
+        Ns_DiffTime(&now, Ns_ConnStartTime(conn), &reqTime);
+        Tcl_DStringAppend(dsPtr, ",\"reqtime\":", 11);
+        Ns_DStringAppendTime(dsPtr, &reqTime);
+    }
+
+    if ((logPtr->flags & LOG_PARTIALTIMES) != 0u) {
+        Ns_Time  acceptTime, queueTime, filterTime, runTime;
+
+        Ns_ConnTimeSpans(conn, &acceptTime, &queueTime, &filterTime, &runTime);
+
+        Tcl_DStringAppend(dsPtr, ",\"partialtimes\":{\"start\":", 25);
+        Ns_DStringAppendTime(dsPtr, Ns_ConnStartTime(conn));
+        Tcl_DStringAppend(dsPtr, ",\"accept\":", 10);
+        Ns_DStringAppendTime(dsPtr, &acceptTime);
+        Tcl_DStringAppend(dsPtr, ",\"queue\":", 9);
+        Ns_DStringAppendTime(dsPtr, &queueTime);
+        Tcl_DStringAppend(dsPtr, ",\"filter\":", 10);
+        Ns_DStringAppendTime(dsPtr, &filterTime);
+        Tcl_DStringAppend(dsPtr, ",\"run\":", 7);
+        Ns_DStringAppendTime(dsPtr, &runTime);
+        Tcl_DStringAppend(dsPtr, "}", 1);
+    }
+
+    AppendJsonHeaders(dsPtr, "requestheaders", logPtr->requestHeaders, conn->headers);
+    AppendJsonHeaders(dsPtr, "responseheaders", logPtr->responseHeaders, conn->outputheaders);
+
+    if (weight > 1u) {
+        Ns_DStringPrintf(dsPtr, ",\"weight\":%lu", weight);
+    }
+    Tcl_DStringAppend(dsPtr, "}", 1);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogPolicySet --
+ *
+ *      Register a log policy for the provided method and URL in the URL
+ *      space of the server. The value is required for the policies
+ *      "sample" (number of requests per logged entry) and "slow" (minimum
+ *      request time).
+ *      Assume caller is holding the log mutex.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      Replaces a previously registered policy for the same URL.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LogPolicySet(Tcl_Interp *interp, Log *logPtr, const char *method, const char *url,
+             LogPolicyType type, Tcl_Obj *valueObj, unsigned int flags)
+{
+    LogPolicy policy;
+    int       result = TCL_OK;
+
+    NS_NONNULL_ASSERT(logPtr != NULL);
+    NS_NONNULL_ASSERT(method != NULL);
+    NS_NONNULL_ASSERT(url != NULL);
+
+    memset(&policy, 0, sizeof(policy));
+    policy.type = type;
+    policy.rate = 1u;
+
+    if (type == LOG_POLICY_SAMPLE || type == LOG_POLICY_SLOW) {
+        if (valueObj == NULL) {
+            Ns_TclPrintfResult(interp, "policy \"%s\" requires a value",
+                               Ns_ObjvTableGetString(logPolicies, (unsigned int)type));
+            result = TCL_ERROR;
+
+        } else if (type == LOG_POLICY_SAMPLE) {
+            int rate;
+
+            if (Tcl_GetIntFromObj(interp, valueObj, &rate) != TCL_OK) {
+                result = TCL_ERROR;
+            } else if (rate < 1) {
+                Ns_TclPrintfResult(interp, "sample rate must be at least 1");
+                result = TCL_ERROR;
+            } else {
+                policy.rate = (unsigned long)rate;
+            }
+        } else if (Ns_TclGetTimeFromObj(interp, valueObj, &policy.threshold) != TCL_OK) {
+            result = TCL_ERROR;
+        }
+    } else if (valueObj != NULL) {
+        Ns_TclPrintfResult(interp, "policy \"%s\" accepts no value",
+                           Ns_ObjvTableGetString(logPolicies, (unsigned int)type));
+        result = TCL_ERROR;
+    }
+
+    if (result == TCL_OK) {
+        LogPolicy *policyPtr = ns_malloc(sizeof(LogPolicy));
+
+        *policyPtr = policy;
+        Ns_UrlSpecificSet(logPtr->server, method, url, logPtr->policyId,
+                          policyPtr, flags, ns_free);
+        logPtr->hasPolicies = NS_TRUE;
+    }
+
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogPolicyMap --
+ *
+ *      Register a log policy from the configuration file, provided in the
+ *      form "METHOD URL POLICY ?VALUE?".
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Policy is registered; invalid specifications are logged and
+ *      ignored.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogPolicyMap(Log *logPtr, const char *section, const char *policyString, unsigned int flags)
+{
+    Tcl_Interp *interp = Tcl_CreateInterp();
+    Tcl_Obj    *specObj = Tcl_NewStringObj(policyString, TCL_INDEX_NONE);
+    Tcl_Obj   **ov;
+    TCL_SIZE_T  oc;
+    int         type;
+
+    Tcl_IncrRefCount(specObj);
+    if (Tcl_ListObjGetElements(interp, specObj, &oc, &ov) != TCL_OK
+        || oc < 3 || oc > 4
+        ) {
+        Ns_Log(Warning, "nslog: section '%s': invalid policy '%s'; must be a list "
+               "containing HTTP method, URL, policy, and optionally a value",
+               section, policyString);
+
+    } else if (Tcl_GetIndexFromObjStruct(interp, ov[2], logPolicies, sizeof(Ns_ObjvTable),
+                                         "policy", 0, &type) != TCL_OK
+               || LogPolicySet(interp, logPtr, Tcl_GetString(ov[0]), Tcl_GetString(ov[1]),
+                               (LogPolicyType)logPolicies[type].value,
+                               oc == 4 ? ov[3] : NULL, flags) != TCL_OK
+               ) {
+        Ns_Log(Warning, "nslog: section '%s': ignoring policy '%s': %s",
+               section, policyString, Tcl_GetStringResult(interp));
+    }
+    Tcl_DecrRefCount(specObj);
+    Tcl_DeleteInterp(interp);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogPolicyCheck --
+ *
+ *      Determine from the log policy registered for the URL of the
+ *      request, whether an entry is written to the access log. For
+ *      sampled requests, the weight (number of requests represented by
+ *      the entry) is returned in weightPtr.
+ *
+ * Results:
+ *      Boolean value indicating whether the request is logged.
+ *
+ * Side effects:
+ *      Updates the sample counter of the policy.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+LogPolicyCheck(Log *logPtr, Ns_Conn *conn, unsigned long *weightPtr)
+{
+    LogPolicy *policyPtr;
+    bool       success = NS_TRUE;
+
+    if (conn->request.method == NULL || conn->request.url == NULL
+        || logPtr->servPtr == NULL
+        ) {
+        return NS_TRUE;
+    }
+
+    Ns_MutexLock(&logPtr->lock);
+    policyPtr = Ns_UrlSpecificGet(logPtr->servPtr, conn->request.method, conn->request.url,
+                                  logPtr->policyId, 0u, NS_URLSPACE_DEFAULT, NULL, NULL, NULL);
+    if (policyPtr != NULL) {
+        switch (policyPtr->type) {
+        case LOG_POLICY_ALL:
+            break;
+
+        case LOG_POLICY_NONE:
+            success = NS_FALSE;
+            break;
+
+        case LOG_POLICY_ERRORS: {
+            int status = Ns_ConnResponseStatus(conn);
+
+            success = (status >= 400);
+            break;
+        }
+
+        case LOG_POLICY_SAMPLE:
+            /*
+             * Log the first of every "rate" requests, such that the weight
+             * of the logged entries sums up to the number of requests.
+             */
+            success = ((policyPtr->counter++ % policyPtr->rate) == 0u);
+            *weightPtr = policyPtr->rate;
+            break;
+
+        case LOG_POLICY_SLOW: {
+            Ns_Time now, reqTime;
+
+            Ns_GetTime(&now);
+            (void)Ns_DiffTime(&now, Ns_ConnStartTime(conn), &reqTime);
+            success = (Ns_DiffTime(&reqTime, &policyPtr->threshold, NULL) >= 0);
+            break;
+        }
+        }
+    }
+    Ns_MutexUnlock(&logPtr->lock);
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogTrace --
+ *
+ *      Trace routine for appending the access.log with the current
+ *      connection results.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entry is appended to the open log.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogTrace(void *arg, Ns_Conn *conn)
+{
+    Log          *logPtr = arg;
+    const char   *p, *driverName;
+    char          buffer[PIPE_BUF], *bufferPtr = NULL;
+    int           fd;
+    Ns_ReturnCode status;
+    size_t        bufferSize = 0u;
+    Tcl_DString   ds, *dsPtr = &ds;
+    char          ipString[NS_IPADDR_SIZE];
+    const char   *server;
+    unsigned long weight = 1u;
+    struct NS_SOCKADDR_STORAGE  ipStruct, maskedStruct;
+    struct sockaddr            *maskPtr = NULL,
+        *ipPtr     = (struct sockaddr *)&ipStruct,
+        *maskedPtr = (struct sockaddr *)&maskedStruct;
+
+    driverName = Ns_ConnDriverName(conn);
+    Ns_Log(Debug, "nslog called with driver pattern '%s' via driver '%s' req: %s",
+           logPtr->driverPattern, driverName, conn->request.line);
+
+    if (logPtr->driverPattern != NULL
+        && Tcl_StringMatch(driverName, logPtr->driverPattern) == 0
+        ) {
+        /*
+         * This is not for us.
+         */
+        return;
+    }
+    if (logPtr->hasPolicies && !LogPolicyCheck(logPtr, conn, &weight)) {
+        return;
+    }
+    server = Ns_ConnServer(conn);
+
+    Tcl_DStringInit(dsPtr);
+
+    if (logPtr->serverRootProcEnabled) {
+        const char *section = Ns_ConfigSectionPath(NULL, server, logPtr->module, NS_SENTINEL);
+        const char *filename = Ns_ConfigString(section, "file", "access.log"), *fullFilename;
+
+        fullFilename = Ns_LogPath(dsPtr, server, filename);
+        fprintf(stderr, "LogTrace: server %s filename '%s' -> fullFilename '%s'\n", server, filename, fullFilename);
+        fd = Ns_ServerLogGetFd(server, logType, fullFilename);
+        Tcl_DStringSetLength(dsPtr, 0);
+    } else {
+        fd = logPtr->fd;
+    }
+
+    Ns_MutexLock(&logPtr->lock);
+
+    /*
+     * Append the peer address.
+     */
+#ifdef NS_WITH_DEPRECATED
+    if ((logPtr->flags & LOG_CHECKFORPROXY) != 0u) {
+        /*
+         * This branch is deprecated and kept only for backward
+         * compatibility (added Dec 2020).
+         */
+        p = Ns_ConnForwardedPeerAddr(conn);
+        if (*p == '\0') {
+            p = Ns_ConnPeerAddr(conn);
+        }
+    } else
+#endif
+    {
+        p = Ns_ConnConfiguredPeerAddr(conn);
+    }
+
+    /*
+     * Check if the actual IP address can be converted to internal format (this
+     * should be always possible).
+     */
+    if ((logPtr->flags |= LOG_MASKIP)
+        && (ns_inet_pton(ipPtr, p) == 1)
+        ) {
+
+        /*
+         * Depending on the class of the IP address, use the appropriate mask.
+         */
+        if (ipPtr->sa_family == AF_INET) {
+            maskPtr = logPtr->ipv4maskPtr;
+        }
+#ifdef HAVE_IPV6
+        if (ipPtr->sa_family == AF_INET6) {
+            maskPtr = logPtr->ipv6maskPtr;
+        }
+#endif
+        /*
+         * If the mask is non-null, the IP "anonymizing" was configured.
+         */
+        if (maskPtr != NULL) {
+            Ns_SockaddrMask(ipPtr, maskPtr, maskedPtr);
+            ns_inet_ntop(maskedPtr, ipString, NS_IPADDR_SIZE);
+            p = ipString;
+        }
+    }
+
+    if (logPtr->format == LOG_FORMAT_JSON) {
+        AppendJsonEntry(logPtr, conn, dsPtr, p, weight);
+    } else {
+        AppendClfEntry(logPtr, conn, dsPtr, p, weight);
+    }
+
+    {
+        TCL_SIZE_T l;
+        for (l = 0; l < dsPtr->length; l++) {
+            /*
+             * Quick fix to disallow terminal escape characters in the log
+             * file. See e.g. http://www.securityfocus.com/bid/37712/info
+             */
+            if (unlikely(dsPtr->string[l] == 0x1b)) {
+                dsPtr->string[l] = 7; /* bell */
+            }
+        }
+    }
+
+    Ns_Log(Ns_LogAccessDebug, "%s", dsPtr->string);
+
+    /*
+     * Append the trailing newline and optionally
+     * flush the buffer
+     */
+
+    Tcl_DStringAppend(dsPtr, "\n", 1);
+
+    if (logPtr->indexFd != NS_INVALID_FD) {
+        time_t now = time(NULL);
+
+        if (now >= logPtr->nextIndexTime) {
+            LogIndexAppend(logPtr, now);
+        }
+    }
+
+    if (logPtr->maxlines == 0) {
+        bufferSize = (size_t)dsPtr->length;
+        if (bufferSize < PIPE_BUF) {
+          /*
+           * Only ns_write() operations < PIPE_BUF are guaranteed to be atomic
+           */
+            bufferPtr = dsPtr->string;
+            status = NS_OK;
+        } else {
+            status = LogFlush(logPtr, dsPtr);
+        }
+    } else {
+        Tcl_DStringAppend(&logPtr->buffer, dsPtr->string, dsPtr->length);
+        if (++logPtr->curlines > logPtr->maxlines) {
+            bufferSize = (size_t)logPtr->buffer.length;
+            if (bufferSize < PIPE_BUF) {
+                /*
+                 * Only ns_write() operations < PIPE_BUF are guaranteed to be
+                 * atomic.  In most cases, the other branch is used.
+                 */
+              memcpy(buffer, logPtr->buffer.string, bufferSize);
+              bufferPtr = buffer;
+              Tcl_DStringSetLength(&logPtr->buffer, 0);
+              status = NS_OK;
+            } else {
+              status = LogFlush(logPtr, &logPtr->buffer);
+            }
+            logPtr->curlines = 0;
+        } else {
+            status = NS_OK;
+        }
+    }
+    if (logPtr->indexFd != NS_INVALID_FD && bufferPtr != NULL) {
+        /*
+         * With a time index, the offsets of the entries have to be exact.
+         * Write in order under the lock and bypass the async writer queue.
+         */
+        if (likely(fd >= 0) && likely(bufferSize > 0)
+            && ns_write(fd, bufferPtr, bufferSize) != (ssize_t)bufferSize) {
+            Ns_Log(Error, "nslog: ns_write() failed: '%s'", strerror(errno));
+        }
+        bufferPtr = NULL;
+    }
+    Ns_MutexUnlock(&logPtr->lock);
+    (void)(status); /* ignore status */
+
+    if (likely(bufferPtr != NULL) && likely(fd >= 0) && likely(bufferSize > 0)) {
+        (void)NsAsyncWrite(fd, bufferPtr, bufferSize);
+    }
+
+    Tcl_DStringFree(dsPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogOpen --
+ *
+ *      Open the access log, closing previous log if opened.
+ *      Assume caller is holding the log mutex.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Log re-opened.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+LogOpen(void *arg)
 {
     int           fd;
     Ns_ReturnCode status;
@@ -1121,6 +1751,22 @@ LogOpen(void *arg)
 
         logPtr->fd = fd;
         Ns_Log(Notice, "nslog: opened '%s'", logPtr->filename);
+
+        if (logPtr->indexFilename != NULL) {
+            if (logPtr->indexFd >= 0) {
+                ns_close(logPtr->indexFd);
+            }
+            logPtr->indexFd = ns_open(logPtr->indexFilename,
+                                      O_APPEND | O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (logPtr->indexFd == NS_INVALID_FD) {
+                Ns_Log(Error, "nslog: error '%s' opening index '%s'",
+                       strerror(errno), logPtr->indexFilename);
+            }
+            /*
+             * Force an index record for the first entry of the file.
+             */
+            logPtr->nextIndexTime = 0;
+        }
     }
 
     return status;
@@ -1161,6 +1807,10 @@ LogClose(void *arg)
         Tcl_DStringFree(&logPtr->buffer);
         Ns_Log(Notice, "nslog: closed '%s'", logPtr->filename);
     }
+    if (logPtr->indexFd >= 0) {
+        ns_close(logPtr->indexFd);
+        logPtr->indexFd = NS_INVALID_FD;
+    }
 
     return status;
 }
@@ -1203,6 +1853,107 @@ LogFlush(Log *logPtr, Tcl_DString *dsPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogIndexAppend --
+ *
+ *      Append a record to the time index, mapping the provided time to the
+ *      offset in the log file, where the next entry is written. Buffered
+ *      entries are flushed first.
+ *      Assume caller is holding the log mutex.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Disables the index on write errors.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LogIndexAppend(Log *logPtr, time_t now)
+{
+    unsigned char record[LOG_INDEX_RECORD_SIZE];
+    uint64_t      values[2];
+    off_t         offset;
+    size_t        i, j;
+
+    NS_NONNULL_ASSERT(logPtr != NULL);
+
+    (void)LogFlush(logPtr, &logPtr->buffer);
+    logPtr->curlines = 0;
+    if (logPtr->fd < 0) {
+        return;
+    }
+    offset = lseek(logPtr->fd, 0, SEEK_END);
+    if (offset == (off_t)-1) {
+        return;
+    }
+
+    values[0] = (uint64_t)now;
+    values[1] = (uint64_t)offset;
+    for (i = 0u; i < 2u; i++) {
+        for (j = 0u; j < 8u; j++) {
+            record[i * 8u + j] = (unsigned char)((values[i] >> (j * 8u)) & 0xffu);
+        }
+    }
+
+    if (ns_write(logPtr->indexFd, record, sizeof(record)) != (ssize_t)sizeof(record)) {
+        Ns_Log(Error, "nslog: index disabled: ns_write() failed: '%s'",
+               strerror(errno));
+        ns_close(logPtr->indexFd);
+        logPtr->indexFd = NS_INVALID_FD;
+    }
+
+    /*
+     * Align the next index point to the interval.
+     */
+    logPtr->nextIndexTime = now - (now % logPtr->indexInterval) + logPtr->indexInterval;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LogRollClose --
+ *
+ *      Close callback used during rolling. Closes the log and rolls the
+ *      time index (if any) together with the log file, such that every
+ *      backup file has its matching index.
+ *      Assume caller is holding the log mutex.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Index file is rolled to new name.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+LogRollClose(void *arg)
+{
+    Ns_ReturnCode status;
+    Log          *logPtr = arg;
+
+    status = LogClose(logPtr);
+    if (status == NS_OK && logPtr->indexFilename != NULL) {
+        Tcl_Obj *pathObj = Tcl_NewStringObj(logPtr->indexFilename, TCL_INDEX_NONE);
+
+        Tcl_IncrRefCount(pathObj);
+        if (Tcl_FSAccess(pathObj, F_OK) == 0) {
+            status = Ns_RollFileFmt(pathObj, logPtr->rollfmt, logPtr->maxbackup);
+        }
+        Tcl_DecrRefCount(pathObj);
+    }
+
+    return status;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1235,7 +1986,7 @@ LogRoll(void *arg)
         status = Ns_ServerLogRollAll(logPtr->server, logType, logPtr->rollfmt, logPtr->maxbackup);
 
     } else {
-        status = Ns_RollFileCondFmt(LogOpen, LogClose, logPtr,
+        status = Ns_RollFileCondFmt(LogOpen, LogRollClose, logPtr,
                                     logPtr->filename,
                                     logPtr->rollfmt,
                                     logPtr->maxbackup);
@@ -205,6 +205,8 @@ typedef struct Pool {
     const char    *reinit;   /* Re-init scripts to eval on proxy put */
     int            waiting;  /* Thread waiting for handles */
     int            maxworker; /* Max number of allowed worker processes */
+    int            minworker; /* Min number of warm idle worker processes */
+    bool           prespawn; /* Pre-spawn workers based on recent demand */
     int            nfree;    /* Current number of available proxy handles */
     int            nused;    /* Current number of used proxy handles */
     uintptr_t      nextid;   /* Next in proxy unique ids; corresponds to nr of workers */
@@ -214,10 +216,26 @@ typedef struct Pool {
     Ns_Cond        cond;     /* Cond for use while allocating handles */
     Ns_Time        runTime;  /* cumulated run times */
     uintptr_t      nruns;    /* number of runs in this pool */
+    uintptr_t      ngets;    /* number of handles obtained from this pool */
+    uintptr_t      nspawnwaits; /* number of gets waiting for a worker spawn */
+    uintptr_t      nspawns;  /* number of worker processes spawned */
+    uintptr_t      nprespawns; /* number of workers spawned in background */
+    Ns_Time        spawnTime; /* cumulated spawn times */
+    uintptr_t      intervalGets; /* gets since the last rate computation */
+    double         getRate;  /* EWMA of gets per second */
 } Pool;
 
 #define MIN_IDLE_TIMEOUT_SEC 10 /* == 10 seconds */
 
+/*
+ * The spawner thread recomputes the demand of each pool in intervals of
+ * SPAWN_INTERVAL_SEC seconds. The demand is the exponentially weighted
+ * moving average of the gets per second using SPAWN_EWMA_ALPHA as the
+ * weight for the last interval.
+ */
+#define SPAWN_INTERVAL_SEC 1
+#define SPAWN_EWMA_ALPHA   0.3
+
 /*
  * The following enum lists all possible error conditions.
  */
@@ -360,6 +378,9 @@ static void   UpdateIov(struct iovec *iov, size_t n)
 static void   SetOpt(const char *str, char const **optPtr)
     NS_GNUC_NONNULL(1,2);
 static void   ReaperThread(void *UNUSED(arg));
+static void   SpawnerThread(void *UNUSED(arg));
+static void   SpawnProxies(void);
+static int    WarmTarget(const Pool *poolPtr) NS_GNUC_NONNULL(1);
 static void   CloseWorker(Worker *workerPtr, const Ns_Time *timePtr)
     NS_GNUC_NONNULL(1);
 static void   ReapProxies(void);
@@ -377,10 +398,12 @@ static Tcl_Obj* StringObj(const char* chars);
 static Tcl_HashTable pools;     /* Tracks proxy pools */
 
 static ReaperState reaperState = Stopped;
+static ReaperState spawnerState = Stopped;
 
 static Ns_Cond  pcond = NULL;          /* Those are used to control access to */
 static Ns_Mutex plock = NULL;          /* The list of Worker structures of worker */
 static Worker    *firstClosePtr = NULL; /* Processes which are being closed. */
+static Ns_Cond  scond = NULL;          /* Used to wake up the spawner thread */
 
 static Tcl_DString defexec;             /* Stores full path of the proxy executable */
 
@@ -411,6 +434,7 @@ Nsproxy_LibInit(void)
         Ns_MutexInit(&plock);
         Ns_MutexSetName(&plock, "ns:proxy");
         Ns_CondInit(&pcond);
+        Ns_CondInit(&scond);
 
         Nsd_LibInit();
 
@@ -805,6 +829,14 @@ Shutdown(const Ns_Time *timeoutPtr, void *UNUSED(arg))
         Tcl_HashEntry *hPtr;
 
         Ns_MutexLock(&plock);
+        /*
+         * Tell the spawner thread to stop. It checks the state before it
+         * touches the pools again, so we do not have to wait for it here.
+         */
+        if (spawnerState != Stopped) {
+            spawnerState = Stopping;
+            Ns_CondBroadcast(&scond);
+        }
         hPtr = Tcl_FirstHashEntry(&pools, &search);
         while (hPtr != NULL) {
             poolPtr = (Pool *)Tcl_GetHashValue(hPtr);
@@ -835,6 +867,13 @@ Shutdown(const Ns_Time *timeoutPtr, void *UNUSED(arg))
     }
 
     Ns_MutexLock(&plock);
+    status = NS_OK;
+    while (spawnerState != Stopped && status == NS_OK) {
+        status = Ns_CondTimedWait(&scond, &plock, timeoutPtr);
+        if (status != NS_OK) {
+            Ns_Log(Warning, "nsproxy: timeout waiting for spawner exit");
+        }
+    }
     reap = firstClosePtr != NULL || reaperState != Stopped;
     Ns_MutexUnlock(&plock);
 
@@ -1210,6 +1249,12 @@ Send(Tcl_Interp *interp, Proxy *proxyPtr, const char *scriptString, TCL_SIZE_T s
                    proxyPtr->poolPtr->name, (long)proxyPtr->workerPtr->pid);
             CloseProxy(proxyPtr);
             err = CreateWorker(interp, proxyPtr);
+            if (err == ENone && scriptString != NULL) {
+                /*
+                 * Count the current run for the new worker.
+                 */
+                proxyPtr->numruns = 1;
+            }
         }
         if (err == ENone) {
 
@@ -1815,6 +1860,17 @@ StatsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj
         Ns_DStringPrintf(dsPtr, " processes %d", processes);
         Tcl_DStringAppend(dsPtr, " runtime ", 9);
         Ns_DStringAppendTime(dsPtr, &poolPtr->runTime);
+        Ns_DStringPrintf(dsPtr, " minworkers %d", poolPtr->minworker);
+        Ns_DStringPrintf(dsPtr, " gets %" PRIuPTR, poolPtr->ngets);
+        Ns_DStringPrintf(dsPtr, " getrate %.2f", poolPtr->getRate);
+        Ns_DStringPrintf(dsPtr, " spawns %" PRIuPTR, poolPtr->nspawns);
+        Ns_DStringPrintf(dsPtr, " prespawns %" PRIuPTR, poolPtr->nprespawns);
+        Ns_DStringPrintf(dsPtr, " spawnwaits %" PRIuPTR, poolPtr->nspawnwaits);
+        Ns_DStringPrintf(dsPtr, " spawnwaitratio %.4f", poolPtr->ngets > 0u
+                         ? (double)poolPtr->nspawnwaits / (double)poolPtr->ngets
+                         : 0.0);
+        Tcl_DStringAppend(dsPtr, " spawntime ", 11);
+        Ns_DStringAppendTime(dsPtr, &poolPtr->spawnTime);
 
         Ns_MutexUnlock(&poolPtr->lock);
         Ns_MutexUnlock(&plock);
@@ -2385,19 +2441,19 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
     const InterpData *idataPtr = data;
     Pool       *poolPtr;
     Proxy      *proxyPtr;
-    int         flag = 0, n, result = TCL_OK, reap = 0;
+    int         flag = 0, n, result = TCL_OK, reap = 0, spawn = 0;
 
     static const char *flags[] = {
         "-init", "-reinit", "-maxslaves", "-exec", "-env",
         "-gettimeout", "-evaltimeout", "-sendtimeout", "-recvtimeout",
         "-waittimeout", "-idletimeout", "-logminduration", "-maxruns",
-        "-maxworkers",  NULL
+        "-maxworkers", "-minworkers", "-prespawn", NULL
     };
     enum {
         CInitIdx, CReinitIdx, CMaxslaveIdx, CExecIdx, CEnvIdx,
         CGetIdx, CEvalIdx, CSendIdx, CRecvIdx,
         CWaitIdx, CIdleIdx, CLogmindurationIdx, CMaxrunsIdx,
-        CMaxworkerIdx
+        CMaxworkerIdx, CMinworkerIdx, CPrespawnIdx
     };
 
     if (objc < 3) {
@@ -2412,6 +2468,8 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
                          " ?-maxruns /integer/?"
                          " ?-maxslaves /integer/?"
                          " ?-maxworkers /integer/?"
+                         " ?-minworkers /integer/?"
+                         " ?-prespawn true|false?"
                          " ?-recvtimeout /time/?"
                          " ?-reinit /value/?"
                          " ?-sendtimeout /time/?"
@@ -2497,6 +2555,7 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
 
             case CMaxslaveIdx: NS_FALL_THROUGH; /* fall through */
             case CMaxworkerIdx: NS_FALL_THROUGH; /* fall through */
+            case CMinworkerIdx: NS_FALL_THROUGH; /* fall through */
             case CMaxrunsIdx:
                 if (Tcl_GetIntFromObj(interp, objv[i], &n) != TCL_OK) {
                     result = TCL_ERROR;
@@ -2514,11 +2573,26 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
                     poolPtr->maxworker = n;
                     reap = 1;
                     break;
+                case CMinworkerIdx:
+                    poolPtr->minworker = n;
+                    spawn = 1;
+                    break;
                 case CMaxrunsIdx:
                     poolPtr->conf.maxruns = n;
                     break;
                 }
                 break;
+            case CPrespawnIdx: {
+                int prespawn;
+
+                if (Tcl_GetBooleanFromObj(interp, objv[i], &prespawn) != TCL_OK) {
+                    result = TCL_ERROR;
+                    goto err;
+                }
+                poolPtr->prespawn = (prespawn != 0);
+                spawn = 1;
+                break;
+            }
             case CInitIdx:
                 SetOpt(str, &poolPtr->init);
                 break;
@@ -2576,6 +2650,8 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
             AppendObj(listObj, flags[CInitIdx],     StringObj(poolPtr->init));
             AppendObj(listObj, flags[CReinitIdx],   StringObj(poolPtr->reinit));
             AppendObj(listObj, flags[CMaxworkerIdx], Tcl_NewIntObj(poolPtr->maxworker));
+            AppendObj(listObj, flags[CMinworkerIdx], Tcl_NewIntObj(poolPtr->minworker));
+            AppendObj(listObj, flags[CPrespawnIdx], Tcl_NewBooleanObj(poolPtr->prespawn));
             AppendObj(listObj, flags[CMaxrunsIdx],  Tcl_NewIntObj(poolPtr->conf.maxruns));
             AppendObj(listObj, flags[CGetIdx],      Ns_TclNewTimeObj(&poolPtr->conf.tget));
             AppendObj(listObj, flags[CEvalIdx],     Ns_TclNewTimeObj(&poolPtr->conf.teval));
@@ -2598,6 +2674,10 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
         case CMaxslaveIdx: NS_FALL_THROUGH; /* fall through */
         case CMaxworkerIdx: Tcl_SetObjResult(interp, Tcl_NewIntObj(poolPtr->maxworker));
             break;
+        case CMinworkerIdx: Tcl_SetObjResult(interp, Tcl_NewIntObj(poolPtr->minworker));
+            break;
+        case CPrespawnIdx: Tcl_SetObjResult(interp, Tcl_NewBooleanObj(poolPtr->prespawn));
+            break;
         case CMaxrunsIdx:  Tcl_SetObjResult(interp, Tcl_NewIntObj(poolPtr->conf.maxruns));
             break;
         case CGetIdx:      Tcl_SetObjResult(interp, Ns_TclNewTimeObj(&poolPtr->conf.tget));
@@ -2646,6 +2726,14 @@ ConfigureObjCmd(ClientData data, Tcl_Interp *interp, TCL_SIZE_T objc, Tcl_Obj *c
         ReapProxies();
     }
 
+    /*
+     * Start or wake up the spawner thread to provide the requested
+     * warm workers.
+     */
+    if (spawn != 0 && result == TCL_OK) {
+        SpawnProxies();
+    }
+
     return result;
 }
 
@@ -2846,6 +2934,7 @@ PopProxy(Pool *poolPtr, Proxy **proxyPtrPtr, int nwant, const Ns_Time *timePtr)
     Err           err;
     Ns_ReturnCode status = NS_OK;
     Ns_Time       waitTimeout;
+    bool          replenish;
 
     NS_NONNULL_ASSERT(poolPtr != NULL);
     NS_NONNULL_ASSERT(proxyPtrPtr != NULL);
@@ -2885,10 +2974,27 @@ PopProxy(Pool *poolPtr, Proxy **proxyPtrPtr, int nwant, const Ns_Time *timePtr)
 
             poolPtr->nfree -= nwant;
             poolPtr->nused += nwant;
+            poolPtr->ngets += (uintptr_t)nwant;
+            poolPtr->intervalGets += (uintptr_t)nwant;
 
             for (i = 0, *proxyPtrPtr = NULL; i < nwant; ++i) {
-                proxyPtr = poolPtr->firstPtr;
-                poolPtr->firstPtr = proxyPtr->nextPtr;
+                Proxy **prevPtrPtr = &poolPtr->firstPtr;
+
+                /*
+                 * Prefer proxies with a warm (already running) worker
+                 * process, fall back to the first free one.
+                 */
+                for (proxyPtr = poolPtr->firstPtr;
+                     proxyPtr != NULL && proxyPtr->workerPtr == NULL;
+                     proxyPtr = proxyPtr->nextPtr) {
+                    prevPtrPtr = &proxyPtr->nextPtr;
+                }
+                if (proxyPtr == NULL) {
+                    prevPtrPtr = &poolPtr->firstPtr;
+                    proxyPtr = poolPtr->firstPtr;
+                    assert(proxyPtr != NULL);
+                }
+                *prevPtrPtr = proxyPtr->nextPtr;
                 proxyPtr->nextPtr = *proxyPtrPtr;
                 *proxyPtrPtr = proxyPtr;
                 proxyPtr->conf = poolPtr->conf;
@@ -2898,8 +3004,18 @@ PopProxy(Pool *poolPtr, Proxy **proxyPtrPtr, int nwant, const Ns_Time *timePtr)
         poolPtr->waiting = 0;
         Ns_CondBroadcast(&poolPtr->cond);
     }
+    replenish = (err == ENone && (poolPtr->minworker > 0 || poolPtr->prespawn));
     Ns_MutexUnlock(&poolPtr->lock);
 
+    if (replenish) {
+        /*
+         * Let the spawner replenish the warm workers.
+         */
+        Ns_MutexLock(&plock);
+        Ns_CondSignal(&scond);
+        Ns_MutexUnlock(&plock);
+    }
+
     return err;
 }
 
@@ -3043,6 +3159,8 @@ GetPool(const char *poolName, const InterpData *idataPtr)
                 }
                 poolPtr->maxworker = Ns_ConfigInt(section, "maxworker", max);
             }
+            poolPtr->minworker = Ns_ConfigIntRange(section, "minworker", 0, 0, INT_MAX);
+            poolPtr->prespawn = Ns_ConfigBool(section, "prespawn", NS_FALSE);
 
             Ns_ConfigTimeUnitRange(section, "logminduration",
                                    "1s", 0, 0, INT_MAX, 0,
@@ -3065,6 +3183,10 @@ GetPool(const char *poolName, const InterpData *idataPtr)
     }
     Ns_MutexUnlock(&plock);
 
+    if (isNew != 0 && (poolPtr->minworker > 0 || poolPtr->prespawn)) {
+        SpawnProxies();
+    }
+
     return poolPtr;
 }
 
@@ -3175,6 +3297,9 @@ CheckProxy(Tcl_Interp *interp, Proxy *proxyPtr)
         Tcl_ResetResult(interp);
     }
     if (proxyPtr->workerPtr == NULL) {
+        Ns_MutexLock(&proxyPtr->poolPtr->lock);
+        proxyPtr->poolPtr->nspawnwaits++;
+        Ns_MutexUnlock(&proxyPtr->poolPtr->lock);
         err = CreateWorker(interp, proxyPtr);
     }
 
@@ -3205,12 +3330,14 @@ CreateWorker(Tcl_Interp *interp, Proxy *proxyPtr)
     Err          err;
     int          init;
     Tcl_DString  ds;
+    Ns_Time      startTime;
 
     NS_NONNULL_ASSERT(interp != NULL);
     NS_NONNULL_ASSERT(proxyPtr != NULL);
 
     poolPtr = proxyPtr->poolPtr;
     proxyPtr->created ++;
+    Ns_GetTime(&startTime);
 
     Tcl_DStringInit(&ds);
     Ns_MutexLock(&poolPtr->lock);
@@ -3231,8 +3358,17 @@ CreateWorker(Tcl_Interp *interp, Proxy *proxyPtr)
         CloseProxy(proxyPtr);
         err = EInit;
     } else {
+        Ns_Time now, diff;
+
         err = ENone;
         Tcl_ResetResult(interp);
+
+        Ns_GetTime(&now);
+        (void)Ns_DiffTime(&now, &startTime, &diff);
+        Ns_MutexLock(&poolPtr->lock);
+        Ns_IncrTime(&poolPtr->spawnTime, diff.sec, diff.usec);
+        poolPtr->nspawns++;
+        Ns_MutexUnlock(&poolPtr->lock);
     }
     Tcl_DStringFree(&ds);
     if (err != EExec) {
@@ -3435,6 +3571,7 @@ ReaperThread(void *UNUSED(arg))
     Worker           *workerPtr, *tmpWorkerPtr;
     Ns_Time         timeout, now, diff;
     long            ntotal;
+    int             nwarm;
 
     Ns_ThreadSetName("-nsproxy:reap-");
     Ns_Log(Notice, "starting");
@@ -3485,6 +3622,17 @@ ReaperThread(void *UNUSED(arg))
                 }
             }
 
+            /*
+             * Count the warm idle workers, since we keep at least
+             * "minworker" of these alive.
+             */
+            nwarm = 0;
+            for (proxyPtr = poolPtr->firstPtr; proxyPtr != NULL; proxyPtr = proxyPtr->nextPtr) {
+                if (proxyPtr->workerPtr != NULL) {
+                    nwarm++;
+                }
+            }
+
             /*
              * Get max time to wait for one of the worker process.
              * This is less than the time for the whole pool.
@@ -3525,16 +3673,27 @@ ReaperThread(void *UNUSED(arg))
                     }
                     if (workerPtr != NULL) {
                         CloseWorker(workerPtr, &proxyPtr->conf.twait);
+                        nwarm--;
                     }
                     FreeProxy(proxyPtr);
                     proxyPtr = NULL;
                     poolPtr->nfree--;
+                } else if (expired && nwarm <= poolPtr->minworker) {
+                    /*
+                     * Keep the minimum number of warm workers, just
+                     * extend the idle time of this one.
+                     */
+                    SetExpire(workerPtr, &proxyPtr->conf.tidle);
+                    if (Ns_DiffTime(&workerPtr->expire, &timeout, NULL) < 0) {
+                        timeout = workerPtr->expire;
+                    }
                 } else if (expired) {
                     /*
                      * Close the worker but leave the proxy.
                      */
                     CloseWorker(proxyPtr->workerPtr, &proxyPtr->conf.twait);
                     proxyPtr->workerPtr = NULL;
+                    nwarm--;
                 }
                 if (proxyPtr != NULL) {
                     prevPtr = proxyPtr;
@@ -4082,6 +4241,232 @@ ReapProxies(void)
     Ns_MutexUnlock(&plock);
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SpawnProxies --
+ *
+ *      Wake up the spawner thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Will start the spawner thread if not already running.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SpawnProxies(void)
+{
+    Ns_MutexLock(&plock);
+    if (spawnerState == Stopped) {
+        spawnerState = Starting;
+        Ns_ThreadCreate(SpawnerThread, NULL, 0, NULL);
+    } else if (spawnerState != Stopping) {
+        Ns_CondSignal(&scond);
+    }
+    Ns_MutexUnlock(&plock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WarmTarget --
+ *
+ *      Compute the number of idle workers with a running process the
+ *      pool should have. This is at least "minworker". When "prespawn"
+ *      is activated, the number is derived from the recent demand: by
+ *      Little's law, the expected number of handles in use is the get
+ *      rate multiplied by the time a handle is held, which is the average
+ *      run time plus the average spawn time covering the requests arriving
+ *      while a new worker is being started.
+ *
+ * Results:
+ *      Number of desired warm idle workers.
+ *
+ * Side effects:
+ *      None. Assumes pool lock is held.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WarmTarget(const Pool *poolPtr)
+{
+    int target;
+
+    NS_NONNULL_ASSERT(poolPtr != NULL);
+
+    target = poolPtr->minworker;
+    if (poolPtr->prespawn && poolPtr->getRate > 0.0) {
+        double holdTime = 0.0;
+        int    demand;
+
+        if (poolPtr->nruns > 0u) {
+            holdTime += ((double)poolPtr->runTime.sec + (double)poolPtr->runTime.usec / 1000000.0)
+                / (double)poolPtr->nruns;
+        }
+        if (poolPtr->nspawns > 0u) {
+            holdTime += ((double)poolPtr->spawnTime.sec + (double)poolPtr->spawnTime.usec / 1000000.0)
+                / (double)poolPtr->nspawns;
+        }
+        demand = (int)(poolPtr->getRate * holdTime + 0.5) - poolPtr->nused;
+        if (demand > target) {
+            target = demand;
+        }
+    }
+    if (target > poolPtr->maxworker) {
+        target = poolPtr->maxworker;
+    }
+
+    return target;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SpawnerThread --
+ *
+ *      Detached thread which keeps the configured number of warm idle
+ *      workers in the pools and pre-spawns workers based on the recent
+ *      demand, such that Ns_ProxyGet() does not have to wait for the
+ *      exec and initialization of a worker process.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Starts worker processes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SpawnerThread(void *UNUSED(arg))
+{
+    Tcl_Interp *interp;
+    Ns_Time     lastTime;
+
+    Ns_ThreadSetName("-nsproxy:spawn-");
+    Ns_Log(Notice, "starting");
+
+    /*
+     * The interp is only used for collecting error messages.
+     */
+    interp = Tcl_CreateInterp();
+    Ns_GetTime(&lastTime);
+
+    Ns_MutexLock(&plock);
+    if (spawnerState == Starting) {
+        spawnerState = Running;
+    }
+
+    while (spawnerState != Stopping) {
+        Tcl_HashSearch  search;
+        Tcl_HashEntry  *hPtr;
+        Proxy          *spawnPtr = NULL, *proxyPtr;
+        Ns_Time         now, diff, timeout;
+        double          elapsed = 0.0;
+
+        Ns_GetTime(&now);
+        (void)Ns_DiffTime(&now, &lastTime, &diff);
+        if (diff.sec >= SPAWN_INTERVAL_SEC) {
+            elapsed = (double)diff.sec + (double)diff.usec / 1000000.0;
+            lastTime = now;
+        }
+
+        /*
+         * Update the demand of every pool and collect the free proxies
+         * without a worker process, for which we want to start one.
+         */
+        hPtr = Tcl_FirstHashEntry(&pools, &search);
+        while (hPtr != NULL) {
+            Pool *poolPtr = (Pool *)Tcl_GetHashValue(hPtr);
+            int   nwarm = 0, missing;
+
+            Ns_MutexLock(&poolPtr->lock);
+            if (elapsed > 0.0) {
+                poolPtr->getRate = SPAWN_EWMA_ALPHA * ((double)poolPtr->intervalGets / elapsed)
+                    + (1.0 - SPAWN_EWMA_ALPHA) * poolPtr->getRate;
+                poolPtr->intervalGets = 0u;
+            }
+            for (proxyPtr = poolPtr->firstPtr; proxyPtr != NULL; proxyPtr = proxyPtr->nextPtr) {
+                if (proxyPtr->workerPtr != NULL) {
+                    nwarm++;
+                }
+            }
+            missing = WarmTarget(poolPtr) - nwarm;
+
+            while (missing > 0) {
+                Proxy **prevPtrPtr = &poolPtr->firstPtr;
+
+                for (proxyPtr = poolPtr->firstPtr;
+                     proxyPtr != NULL && proxyPtr->workerPtr != NULL;
+                     proxyPtr = proxyPtr->nextPtr) {
+                    prevPtrPtr = &proxyPtr->nextPtr;
+                }
+                if (proxyPtr == NULL) {
+                    break;
+                }
+                /*
+                 * Account the proxy as used while the worker is started,
+                 * PushProxy() returns it to the pool afterwards.
+                 */
+                *prevPtrPtr = proxyPtr->nextPtr;
+                poolPtr->nfree--;
+                poolPtr->nused++;
+                proxyPtr->conf = poolPtr->conf;
+                proxyPtr->nextPtr = spawnPtr;
+                spawnPtr = proxyPtr;
+                missing--;
+            }
+            Ns_MutexUnlock(&poolPtr->lock);
+            hPtr = Tcl_NextHashEntry(&search);
+        }
+        Ns_MutexUnlock(&plock);
+
+        while ((proxyPtr = spawnPtr) != NULL) {
+            Pool *poolPtr = proxyPtr->poolPtr;
+
+            spawnPtr = proxyPtr->nextPtr;
+            proxyPtr->nextPtr = NULL;
+
+            if (CreateWorker(interp, proxyPtr) != ENone) {
+                Ns_Log(Warning, "nsproxy [%s]: could not pre-spawn worker: %s",
+                       poolPtr->name, Tcl_GetStringResult(interp));
+                Tcl_ResetResult(interp);
+            } else {
+                Ns_Log(Ns_LogNsProxyDebug, "nsproxy [%s]: pre-spawned worker %ld",
+                       poolPtr->name, (long)proxyPtr->workerPtr->pid);
+                Ns_MutexLock(&poolPtr->lock);
+                poolPtr->nprespawns++;
+                Ns_MutexUnlock(&poolPtr->lock);
+            }
+            PushProxy(proxyPtr);
+        }
+
+        Ns_MutexLock(&plock);
+        if (spawnerState == Stopping) {
+            break;
+        }
+        timeout = now;
+        Ns_IncrTime(&timeout, SPAWN_INTERVAL_SEC, 0);
+        (void) Ns_CondTimedWait(&scond, &plock, &timeout);
+    }
+
+    spawnerState = Stopped;
+    Ns_CondBroadcast(&scond);
+    Ns_MutexUnlock(&plock);
+
+    Tcl_DeleteInterp(interp);
+    Ns_Log(Notice, "exiting");
+}
+
 
 /*
  *----------------------------------------------------------------------
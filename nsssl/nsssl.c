@@ -44,6 +44,7 @@ NS_EXPORT const int Ns_ModuleVersion = 1;
 typedef struct {
     SSL         *ssl;
     int          verified;
+    int          handshakeDone;
 } NssslSockCtx;
 
 /*
@@ -328,6 +329,25 @@ Recv(Ns_Sock *sock, struct iovec *bufs, int nbufs,
 
     nRead = Ns_SSLRecvBufs2(sslCtx->ssl, bufs, nbufs, &sockState, &sslERRcode);
 
+    /*
+     * Count full and resumed handshakes per driver. Recv() is called from
+     * the driver, spooler and connection threads, so the counters are
+     * updated under the driver lock.
+     */
+    if (sslCtx->handshakeDone == 0 && nRead > -1 && SSL_is_init_finished(sslCtx->ssl)) {
+        Driver *drvPtr = (Driver *)sock->driver;
+        bool    resumed = (SSL_session_reused(sslCtx->ssl) == 1);
+
+        Ns_MutexLock(&drvPtr->lock);
+        if (resumed) {
+            drvPtr->stats.tlsresumed++;
+        } else {
+            drvPtr->stats.tlsfull++;
+        }
+        Ns_MutexUnlock(&drvPtr->lock);
+        sslCtx->handshakeDone = 1;
+    }
+
     /*
      * Verify client certificate, driver may require valid cert
      */
@@ -195,18 +195,31 @@ proc ns_getform {args}  {
         }
 
         set tmpfile [ns_conn contentfile]
-        if { $tmpfile eq "" } {
+        if { $tmpfile eq "" || [ns_set size $::_ns_form] > 0 } {
             #
             # Get the content via memory (indirectly via [ns_conn
-            # content], the command [ns_conn form] does this)
+            # content], the command [ns_conn form] does this), or
+            # from the form parsed already while the content was
+            # spooled. In the latter case, the uploaded files are
+            # already in temporary files.
             #
             ns_log debug "ns_getform: get content from memory (files [ns_conn files])"
             foreach {file} [ns_conn files] {
                 set offs [ns_conn fileoffset $file]
                 set lens [ns_conn filelength $file]
                 set hdrs [ns_conn fileheaders $file]
-                foreach off $offs len $lens hdr $hdrs {
-
+                set tmps [ns_conn filetmpfile $file]
+                foreach off $offs len $lens hdr $hdrs spooled $tmps {
+
+                    if {$spooled ne ""} {
+                        ns_atclose [list file delete -- $spooled]
+                        lappend ::_ns_formfiles($file) $spooled
+                        set type [ns_set get $hdr content-type]
+                        ns_set put $::_ns_form $file.content-type $type
+                        # NB: Insecure, access via ns_getformfile.
+                        ns_set put $::_ns_form $file.tmpfile $spooled
+                        continue
+                    }
                     set fp [ns_opentmpfile tmpfile]
                     #set nocomplain [expr {$::tcl_version < 9.0 ? "" : "-profile tcl8"}]
                     set nocomplain "" ;# Tcl9 is a moving target, not sure yet, how this will end up when released